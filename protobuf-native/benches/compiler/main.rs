@@ -0,0 +1,198 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Benchmarks of how schema loading scales with the size of the schema.
+//!
+//! Like `benchmarks/gen_synthetic_protos.py` in the vendored protobuf
+//! sources, these generate synthetic schemas: here, trees of `files` files
+//! of `messages` messages each, in which every file imports up to `fanout`
+//! of the files before it and refers to a message in each. The schemas are
+//! parsed from a `VirtualSourceTree` and from a `DiskSourceTree` with
+//! `SourceTreeDescriptorDatabase::build_file_descriptor_set`, and the parsed
+//! files built into a `DescriptorPool` with `DescriptorPool::build_file`.
+//!
+//! Run with `cargo bench --bench compiler`.
+
+use std::fmt::Write;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::pin::Pin;
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use protobuf_native::compiler::{
+    DiskSourceTree, SourceTree, SourceTreeDescriptorDatabase, VirtualSourceTree,
+};
+use protobuf_native::{DescriptorDatabase, DescriptorPool, FileDescriptorProto};
+
+/// The shape of a synthetic schema.
+#[derive(Debug, Clone, Copy)]
+struct Shape {
+    files: usize,
+    messages: usize,
+    fanout: usize,
+}
+
+const fn shape(files: usize, messages: usize, fanout: usize) -> Shape {
+    Shape {
+        files,
+        messages,
+        fanout,
+    }
+}
+
+impl Shape {
+    fn id(&self) -> String {
+        format!("{}x{}/fanout={}", self.files, self.messages, self.fanout)
+    }
+}
+
+/// The shapes to benchmark: scaling the number of files, the number of
+/// messages per file, and the import fan-out in turn.
+const SHAPES: &[Shape] = &[
+    shape(16, 16, 4),
+    shape(64, 16, 4),
+    shape(256, 16, 4),
+    shape(64, 64, 4),
+    shape(64, 16, 1),
+    shape(64, 16, 16),
+];
+
+fn file_name(i: usize) -> PathBuf {
+    PathBuf::from(format!("synthetic/file_{i:04}.proto"))
+}
+
+/// Generates the files of a schema of the given shape, in dependency order.
+fn generate(shape: Shape) -> Vec<(PathBuf, Vec<u8>)> {
+    (0..shape.files)
+        .map(|i| {
+            let deps: Vec<usize> = (i.saturating_sub(shape.fanout)..i).collect();
+            let mut source = String::from("syntax = \"proto3\";\n\npackage synthetic;\n\n");
+            for &dep in &deps {
+                writeln!(source, "import \"{}\";", file_name(dep).display()).unwrap();
+            }
+            for m in 0..shape.messages {
+                writeln!(source, "\nmessage File{i}Message{m} {{").unwrap();
+                writeln!(source, "    int64 id = 1;").unwrap();
+                writeln!(source, "    string name = 2;").unwrap();
+                writeln!(source, "    repeated double values = 3;").unwrap();
+                writeln!(source, "    map<string, string> labels = 4;").unwrap();
+                for (n, &dep) in deps.iter().enumerate() {
+                    writeln!(source, "    File{dep}Message{m} dep{n} = {};", n + 5).unwrap();
+                }
+                writeln!(source, "}}").unwrap();
+            }
+            (file_name(i), source.into_bytes())
+        })
+        .collect()
+}
+
+fn bytes(files: &[(PathBuf, Vec<u8>)]) -> u64 {
+    files
+        .iter()
+        .map(|(_, contents)| contents.len() as u64)
+        .sum()
+}
+
+fn roots(files: &[(PathBuf, Vec<u8>)]) -> Vec<&Path> {
+    files.iter().map(|(path, _)| path.as_path()).collect()
+}
+
+fn virtual_source_tree(files: &[(PathBuf, Vec<u8>)]) -> Pin<Box<VirtualSourceTree>> {
+    let mut source_tree = VirtualSourceTree::new();
+    for (path, contents) in files {
+        source_tree.as_mut().add_file(path, contents.clone());
+    }
+    source_tree
+}
+
+/// Parses every file of a schema, in dependency order.
+fn parse_files(
+    source_tree: Pin<&mut dyn SourceTree>,
+    files: &[(PathBuf, Vec<u8>)],
+) -> Vec<Pin<Box<FileDescriptorProto>>> {
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree);
+    files
+        .iter()
+        .map(|(path, _)| db.as_mut().find_file_by_name(path).unwrap())
+        .collect()
+}
+
+fn bench_parse(c: &mut Criterion) {
+    let mut group = c.benchmark_group("build_file_descriptor_set");
+    group.sample_size(10);
+    for &shape in SHAPES {
+        let files = generate(shape);
+        let roots = roots(&files);
+        group.throughput(Throughput::Bytes(bytes(&files)));
+
+        // Populating the virtual source tree is part of the cost of loading a
+        // schema from memory, as reading the files is for one on disk.
+        group.bench_with_input(
+            BenchmarkId::new("virtual", shape.id()),
+            &files,
+            |b, files| {
+                b.iter(|| {
+                    let mut source_tree = virtual_source_tree(files);
+                    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+                    db.as_mut().build_file_descriptor_set(&roots).unwrap()
+                })
+            },
+        );
+
+        let dir = tempfile::tempdir().unwrap();
+        for (path, contents) in &files {
+            let path = dir.path().join(path);
+            fs::create_dir_all(path.parent().unwrap()).unwrap();
+            fs::write(path, contents).unwrap();
+        }
+        group.bench_function(BenchmarkId::new("disk", shape.id()), |b| {
+            b.iter(|| {
+                let mut source_tree = DiskSourceTree::new();
+                source_tree.as_mut().map_path(Path::new(""), dir.path());
+                let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+                db.as_mut().build_file_descriptor_set(&roots).unwrap()
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_build(c: &mut Criterion) {
+    let mut group = c.benchmark_group("build_file");
+    group.sample_size(10);
+    for &shape in SHAPES {
+        let files = generate(shape);
+        let mut source_tree = virtual_source_tree(&files);
+        let protos = parse_files(source_tree.as_mut(), &files);
+        group.throughput(Throughput::Elements((shape.files * shape.messages) as u64));
+        group.bench_with_input(
+            BenchmarkId::from_parameter(shape.id()),
+            &protos,
+            |b, protos| {
+                b.iter(|| {
+                    let mut pool = DescriptorPool::new();
+                    for proto in protos {
+                        pool.as_mut().build_file(proto);
+                    }
+                    pool
+                })
+            },
+        );
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_parse, bench_build);
+criterion_main!(benches);
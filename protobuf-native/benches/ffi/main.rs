@@ -0,0 +1,144 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Benchmarks of the cost of calling into libprotobuf through the cxx bridge.
+//!
+//! Each benchmark compares a binding, called once per iteration from Rust,
+//! against `protobuf_native::bench`'s loop that makes the same call the same
+//! number of times from C++. Criterion's reported time is per call, so the
+//! difference between the two is the overhead that the bridge adds to each
+//! call, and the ratio between them tells how much a batched API would save.
+//!
+//! Run with `cargo bench --features bench --bench ffi`.
+
+use std::hint::black_box;
+use std::path::Path;
+use std::pin::Pin;
+use std::time::{Duration, Instant};
+
+use criterion::{criterion_group, criterion_main, Criterion};
+use protobuf_native::bench;
+use protobuf_native::compiler::{SourceTreeDescriptorDatabase, VirtualSourceTree};
+use protobuf_native::io::CodedInputStream;
+use protobuf_native::{FileDescriptorSet, MessageLite};
+
+/// The number of values in the inputs of the stream benchmarks, which are
+/// read again from the start once exhausted.
+const VALUES: usize = 4096;
+
+/// Builds a small file descriptor set, whose size and initialization checks
+/// are cheap enough for the cost of the call itself to dominate.
+fn small_descriptor_set() -> Pin<Box<FileDescriptorSet>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("small.proto"),
+        b"syntax = \"proto3\"; message Small { int32 id = 1; }".to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut()
+        .build_file_descriptor_set(&[Path::new("small.proto")])
+        .unwrap()
+}
+
+/// Times `iters` calls to `read`, which must consume one value from `input`,
+/// restarting from a new stream over `data` after every [`VALUES`] calls.
+fn time_stream_calls<F>(data: &[u8], iters: u64, mut read: F) -> Duration
+where
+    F: FnMut(Pin<&mut CodedInputStream>) -> u32,
+{
+    let start = Instant::now();
+    let mut remaining = iters;
+    while remaining > 0 {
+        let n = remaining.min(VALUES as u64);
+        let mut input = CodedInputStream::from_slice(data);
+        for _ in 0..n {
+            black_box(read(input.as_mut()));
+        }
+        remaining -= n;
+    }
+    start.elapsed()
+}
+
+/// Like [`time_stream_calls`], but makes the calls from C++ with `read_loop`,
+/// one chunk of up to [`VALUES`] calls at a time.
+fn time_stream_loops<F>(data: &[u8], iters: u64, read_loop: F) -> Duration
+where
+    F: Fn(&[u8], usize) -> u64,
+{
+    let start = Instant::now();
+    let mut remaining = iters;
+    while remaining > 0 {
+        let n = remaining.min(VALUES as u64);
+        black_box(read_loop(data, n as usize));
+        remaining -= n;
+    }
+    start.elapsed()
+}
+
+fn bench_coded_input_stream(c: &mut Criterion) {
+    // Two-byte varints, so that each read takes the slower of the inline
+    // paths.
+    let varints = [0x96_u8, 0x01].repeat(VALUES);
+    let mut group = c.benchmark_group("read_varint32");
+    group.bench_function("rust", |b| {
+        b.iter_custom(|iters| {
+            time_stream_calls(&varints, iters, |input| input.read_varint32().unwrap())
+        })
+    });
+    group.bench_function("cpp", |b| {
+        b.iter_custom(|iters| time_stream_loops(&varints, iters, bench::read_varint32_loop))
+    });
+    group.finish();
+
+    // The tag of field 1 with the varint wire type.
+    let tags = [0x08_u8].repeat(VALUES);
+    let mut group = c.benchmark_group("read_tag");
+    group.bench_function("rust", |b| {
+        b.iter_custom(|iters| time_stream_calls(&tags, iters, |input| input.read_tag().unwrap()))
+    });
+    group.bench_function("cpp", |b| {
+        b.iter_custom(|iters| time_stream_loops(&tags, iters, bench::read_tag_loop))
+    });
+    group.finish();
+}
+
+fn bench_message_lite(c: &mut Criterion) {
+    let fds = small_descriptor_set();
+
+    let mut group = c.benchmark_group("byte_size");
+    group.bench_function("rust", |b| b.iter(|| fds.byte_size()));
+    group.bench_function("cpp", |b| {
+        b.iter_custom(|iters| {
+            let start = Instant::now();
+            black_box(bench::byte_size_loop(&*fds, iters as usize));
+            start.elapsed()
+        })
+    });
+    group.finish();
+
+    let mut group = c.benchmark_group("is_initialized");
+    group.bench_function("rust", |b| b.iter(|| fds.is_initialized()));
+    group.bench_function("cpp", |b| {
+        b.iter_custom(|iters| {
+            let start = Instant::now();
+            black_box(bench::is_initialized_loop(&*fds, iters as usize));
+            start.elapsed()
+        })
+    });
+    group.finish();
+}
+
+criterion_group!(benches, bench_coded_input_stream, bench_message_lite);
+criterion_main!(benches);
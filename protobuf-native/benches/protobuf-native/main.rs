@@ -0,0 +1,139 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Benchmarks for the I/O and serialization paths of protobuf-native.
+//!
+//! The payload throughout is the file descriptor set for the copy of
+//! `descriptor.proto` in the vendored protobuf benchmarks, source code info
+//! included. At a few dozen kilobytes of nested messages, strings and
+//! repeated fields, it is representative of descriptor-sized messages.
+//!
+//! Run with `cargo bench`. Criterion saves a baseline of each run under
+//! `target/criterion` and reports changes against it on the next, so
+//! `cargo bench -- --save-baseline main` on the base branch followed by
+//! `cargo bench -- --baseline main` on a change shows its regressions.
+
+use std::hint::black_box;
+use std::path::Path;
+use std::pin::Pin;
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use protobuf_native::compiler::{DiskSourceTree, SourceTreeDescriptorDatabase};
+use protobuf_native::io::{
+    CodedInputStream, ReaderStream, SliceInputStream, VecOutputStream, WriterStream,
+    ZeroCopyInputStream,
+};
+use protobuf_native::{FileDescriptorSet, MessageLite};
+
+/// The directory of the vendored protobuf benchmarks, which contains
+/// `descriptor.proto`.
+const BENCHMARKS_DIR: &str = concat!(
+    env!("CARGO_MANIFEST_DIR"),
+    "/../protobuf-src/protobuf/benchmarks"
+);
+
+fn build_descriptor_set() -> Pin<Box<FileDescriptorSet>> {
+    let mut source_tree = DiskSourceTree::new();
+    source_tree
+        .as_mut()
+        .map_path(Path::new(""), Path::new(BENCHMARKS_DIR));
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut()
+        .build_file_descriptor_set(&[Path::new("descriptor.proto")])
+        .unwrap()
+}
+
+/// Reads `stream` to its end, returning the number of bytes read.
+fn drain(mut stream: Pin<&mut dyn ZeroCopyInputStream>) -> usize {
+    let mut len = 0;
+    while let Ok(buf) = stream.as_mut().next() {
+        len += black_box(buf).len();
+    }
+    len
+}
+
+fn bench_input_streams(c: &mut Criterion) {
+    let data = build_descriptor_set().serialize().unwrap();
+    let mut group = c.benchmark_group("input_stream");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("slice", |b| {
+        b.iter(|| drain(SliceInputStream::new(&data).as_mut()))
+    });
+    group.bench_function("reader", |b| {
+        b.iter(|| {
+            let mut reader = &data[..];
+            drain(ReaderStream::new(&mut reader).as_mut())
+        })
+    });
+    group.finish();
+}
+
+fn bench_output_streams(c: &mut Criterion) {
+    let fds = build_descriptor_set();
+    let len = fds.serialize().unwrap().len();
+    let mut group = c.benchmark_group("output_stream");
+    group.throughput(Throughput::Bytes(len as u64));
+    let mut output = Vec::with_capacity(len);
+    group.bench_function("vec", |b| {
+        b.iter(|| {
+            output.clear();
+            let mut stream = VecOutputStream::new(&mut output);
+            fds.serialize_to_zero_copy_stream(stream.as_mut()).unwrap();
+        })
+    });
+    group.bench_function("writer", |b| {
+        b.iter(|| {
+            output.clear();
+            let mut stream = WriterStream::new(&mut output);
+            fds.serialize_to_zero_copy_stream(stream.as_mut()).unwrap();
+        })
+    });
+    group.finish();
+}
+
+fn bench_messages(c: &mut Criterion) {
+    let fds = build_descriptor_set();
+    let data = fds.serialize().unwrap();
+    let mut group = c.benchmark_group("message");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("serialize", |b| b.iter(|| fds.serialize().unwrap()));
+    let mut message = MessageLite::new(&*fds);
+    group.bench_function("merge_from_coded_stream", |b| {
+        b.iter(|| {
+            message.as_mut().clear();
+            let mut input = CodedInputStream::from_slice(&data);
+            message
+                .as_mut()
+                .merge_from_coded_stream(input.as_mut())
+                .unwrap();
+        })
+    });
+    group.finish();
+
+    let mut group = c.benchmark_group("compiler");
+    group.sample_size(20);
+    group.bench_function("build_file_descriptor_set", |b| {
+        b.iter(build_descriptor_set)
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_input_streams,
+    bench_output_streams,
+    bench_messages
+);
+criterion_main!(benches);
@@ -0,0 +1,200 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Benchmarks that replay captured traffic through the parse, serialize and
+//! JSON paths.
+//!
+//! The samples are read from the record file named by the
+//! `PROTOBUF_NATIVE_REPLAY_SAMPLES` environment variable, as written by a
+//! `sample::Capture`, and their types are resolved from the `.proto` files
+//! under the directory named by `PROTOBUF_NATIVE_REPLAY_PROTO_PATH`. Each
+//! message type is benchmarked separately, over all of its samples.
+//!
+//! Without `PROTOBUF_NATIVE_REPLAY_SAMPLES`, the samples are instead captured
+//! on the spot from the copy of `descriptor.proto` in the vendored protobuf
+//! benchmarks, by parsing and serializing its file descriptor set and files
+//! as messages of the types it defines.
+//!
+//! Run with `cargo bench --bench replay`.
+
+use std::env;
+use std::fs;
+use std::hint::black_box;
+use std::path::{Path, PathBuf};
+use std::pin::Pin;
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use protobuf_native::any::AnyResolver;
+use protobuf_native::compiler::{DiskSourceTree, SourceTreeDescriptorDatabase};
+use protobuf_native::json::{self, PrintOptions};
+use protobuf_native::record::{RecordReader, RecordWriter, RecordWriterOptions};
+use protobuf_native::sample::{self, Capture, CaptureOptions, TypeSamples};
+use protobuf_native::{DescriptorPool, DynamicMessageFactory, FileDescriptorSet, MessageLite};
+
+/// The directory of the vendored protobuf benchmarks, which contains
+/// `descriptor.proto`.
+const BENCHMARKS_DIR: &str = concat!(
+    env!("CARGO_MANIFEST_DIR"),
+    "/../protobuf-src/protobuf/benchmarks"
+);
+
+/// Finds the `.proto` files under `dir`, relative to `dir`.
+fn find_protos(dir: &Path, prefix: &Path, protos: &mut Vec<PathBuf>) {
+    for entry in fs::read_dir(dir.join(prefix)).unwrap() {
+        let entry = entry.unwrap();
+        let path = prefix.join(entry.file_name());
+        if entry.file_type().unwrap().is_dir() {
+            find_protos(dir, &path, protos);
+        } else if path.extension().map_or(false, |ext| ext == "proto") {
+            protos.push(path);
+        }
+    }
+}
+
+fn build_descriptor_set(dir: &Path, roots: &[PathBuf]) -> Pin<Box<FileDescriptorSet>> {
+    let mut source_tree = DiskSourceTree::new();
+    source_tree.as_mut().map_path(Path::new(""), dir);
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut().build_file_descriptor_set(roots).unwrap()
+}
+
+/// Captures samples by parsing and serializing the file descriptor set of
+/// `descriptor.proto`, and each of its files, as dynamic messages of the
+/// types that `descriptor.proto` defines.
+fn capture_descriptor_samples(pool: &DescriptorPool, fds: &FileDescriptorSet) -> Vec<u8> {
+    let mut factory = DynamicMessageFactory::new();
+    let mut set = factory
+        .as_mut()
+        .get_prototype(
+            pool.find_message_type_by_name("upb_benchmark.FileDescriptorSet")
+                .unwrap(),
+        )
+        .new_message();
+    let mut file = factory
+        .as_mut()
+        .get_prototype(
+            pool.find_message_type_by_name("upb_benchmark.FileDescriptorProto")
+                .unwrap(),
+        )
+        .new_message();
+
+    let writer = RecordWriter::new(vec![], RecordWriterOptions::default()).unwrap();
+    let capture = Capture::start(
+        writer,
+        CaptureOptions {
+            sample_rate: 1,
+            ..Default::default()
+        },
+    )
+    .unwrap();
+    set.as_mut()
+        .parse_from_bytes(&fds.serialize().unwrap())
+        .unwrap();
+    set.serialize().unwrap();
+    for proto in fds.files() {
+        file.as_mut()
+            .parse_from_bytes(&proto.serialize().unwrap())
+            .unwrap();
+        file.serialize().unwrap();
+    }
+    capture.finish().unwrap()
+}
+
+/// Loads the samples to replay and a file descriptor set that defines their
+/// types.
+fn load() -> (Vec<TypeSamples>, Pin<Box<FileDescriptorSet>>) {
+    match env::var_os("PROTOBUF_NATIVE_REPLAY_SAMPLES") {
+        Some(samples) => {
+            let proto_path = env::var_os("PROTOBUF_NATIVE_REPLAY_PROTO_PATH")
+                .expect("PROTOBUF_NATIVE_REPLAY_PROTO_PATH must be set");
+            let proto_path = Path::new(&proto_path);
+            let mut roots = vec![];
+            find_protos(proto_path, Path::new(""), &mut roots);
+            let fds = build_descriptor_set(proto_path, &roots);
+            let file = fs::read(samples).unwrap();
+            let samples = sample::load(&RecordReader::new(&file).unwrap()).unwrap();
+            (samples, fds)
+        }
+        None => {
+            let fds = build_descriptor_set(
+                Path::new(BENCHMARKS_DIR),
+                &[PathBuf::from("descriptor.proto")],
+            );
+            let mut pool = DescriptorPool::new();
+            pool.as_mut().build_file_set(&fds).unwrap();
+            let file = capture_descriptor_samples(&pool, &fds);
+            let samples = sample::load(&RecordReader::new(&file).unwrap()).unwrap();
+            (samples, fds)
+        }
+    }
+}
+
+fn bench_replay(c: &mut Criterion) {
+    let (samples, fds) = load();
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file_set(&fds).unwrap();
+    let resolver = AnyResolver::new(&pool);
+    let print_options = PrintOptions::default();
+
+    for type_samples in &samples {
+        let prototype = resolver
+            .resolve(type_samples.type_url.as_bytes())
+            .unwrap_or_else(|| panic!("unknown type: {}", type_samples.type_url))
+            .prototype;
+        let type_name = type_samples.type_url.rsplit('/').next().unwrap();
+        let mut group = c.benchmark_group(format!("replay/{type_name}"));
+        group.throughput(Throughput::Bytes(type_samples.bytes()));
+
+        let mut message = prototype.new_message();
+        group.bench_function("parse", |b| {
+            b.iter(|| {
+                for sample in &type_samples.samples {
+                    message.as_mut().parse_from_bytes(sample).unwrap();
+                }
+            })
+        });
+
+        let messages: Vec<_> = type_samples
+            .samples
+            .iter()
+            .map(|sample| {
+                let mut message = prototype.new_message();
+                message.as_mut().parse_from_bytes(sample).unwrap();
+                message
+            })
+            .collect();
+        let mut output = vec![];
+        group.bench_function("serialize", |b| {
+            b.iter(|| {
+                for message in &messages {
+                    output.clear();
+                    message.serialize_into(&mut output).unwrap();
+                    black_box(&output);
+                }
+            })
+        });
+        group.bench_function("json", |b| {
+            b.iter(|| {
+                for message in &messages {
+                    black_box(json::message_to_json(&**message, &print_options).unwrap());
+                }
+            })
+        });
+        group.finish();
+    }
+}
+
+criterion_group!(benches, bench_replay);
+criterion_main!(benches);
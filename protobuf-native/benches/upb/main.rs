@@ -0,0 +1,257 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Benchmarks comparing libprotobuf and upb, ported from the workloads of
+//! `benchmarks/benchmark.cc` in the vendored protobuf sources.
+//!
+//! As there, the payload is `descriptor.proto` from the same directory,
+//! here as its own file descriptor set, which is parsed and serialized with
+//! the generated C++ `FileDescriptorSet` on one side and with upb, from the
+//! schema in the same file, on the other. Parsing is measured on the heap,
+//! on an arena, and on an arena with an initial block, and with upb also
+//! with string fields aliased rather than copied.
+//!
+//! Unlike the original, the arena benchmarks create and drop an arena without
+//! allocating from it, as the bindings do not expose raw allocation, and the
+//! C++ side has no aliasing parse, which the original measures only with a
+//! schema variant whose string fields are `string_view`s.
+//!
+//! Run with `cargo bench --features upb --bench upb`.
+
+use std::hint::black_box;
+use std::mem::MaybeUninit;
+use std::path::Path;
+use std::pin::Pin;
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+use protobuf_native::compiler::{DiskSourceTree, SourceTreeDescriptorDatabase};
+use protobuf_native::upb::{self, AliasedMessage, DefPool};
+use protobuf_native::{json, Arena, ArenaOptions, DescriptorPool, FileDescriptorSet, MessageLite};
+
+/// The directory of the vendored protobuf benchmarks, which contains
+/// `descriptor.proto`.
+const BENCHMARKS_DIR: &str = concat!(
+    env!("CARGO_MANIFEST_DIR"),
+    "/../protobuf-src/protobuf/benchmarks"
+);
+
+/// The size of the initial blocks given to arenas, as in the original.
+const INITIAL_BLOCK_SIZE: usize = 65536;
+
+/// The name of the payload's message type in the upb pool. The schema is a
+/// copy of `descriptor.proto` in its own package.
+const UPB_TYPE_NAME: &str = "upb_benchmark.FileDescriptorSet";
+
+fn build_descriptor_set() -> Pin<Box<FileDescriptorSet>> {
+    let mut source_tree = DiskSourceTree::new();
+    source_tree
+        .as_mut()
+        .map_path(Path::new(""), Path::new(BENCHMARKS_DIR));
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut()
+        .build_file_descriptor_set(&[Path::new("descriptor.proto")])
+        .unwrap()
+}
+
+fn build_def_pool(fds: &FileDescriptorSet) -> Pin<Box<DefPool>> {
+    let mut pool = DefPool::new();
+    pool.as_mut().add_file_set(fds).unwrap();
+    pool
+}
+
+fn bench_arena(c: &mut Criterion) {
+    let mut group = c.benchmark_group("arena");
+    group.bench_function("upb/new", |b| b.iter(upb::Arena::new));
+    let mut block = vec![MaybeUninit::uninit(); INITIAL_BLOCK_SIZE];
+    group.bench_function("upb/initial_block", |b| {
+        b.iter(|| drop(upb::Arena::with_initial_block(&mut block)))
+    });
+    group.bench_function("cpp/new", |b| b.iter(Arena::new));
+    group.bench_function("cpp/initial_block", |b| {
+        b.iter(|| {
+            drop(Arena::with_options(ArenaOptions {
+                initial_block: Some(&mut block[..]),
+                ..Default::default()
+            }))
+        })
+    });
+    group.finish();
+
+    // Fusing arena 0 with each of the others in turn, and fusing the arenas
+    // pairwise into ever larger groups.
+    let mut group = c.benchmark_group("arena_fuse");
+    for n in [2, 8, 32, 128] {
+        group.bench_with_input(BenchmarkId::new("unbalanced", n), &n, |b, &n| {
+            b.iter(|| {
+                let arenas: Vec<_> = (0..n).map(|_| upb::Arena::new()).collect();
+                for arena in &arenas[1..] {
+                    arenas[0].fuse(arena).unwrap();
+                }
+            })
+        });
+        group.bench_with_input(BenchmarkId::new("balanced", n), &n, |b, &n| {
+            b.iter(|| {
+                let arenas: Vec<_> = (0..n).map(|_| upb::Arena::new()).collect();
+                let mut step = 2;
+                while step <= n {
+                    for i in (0..n).step_by(step) {
+                        arenas[i].fuse(&arenas[i + step / 2]).unwrap();
+                    }
+                    step *= 2;
+                }
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_load_descriptor(c: &mut Criterion) {
+    let fds = build_descriptor_set();
+    let mut group = c.benchmark_group("load_descriptor");
+    group.bench_function("upb", |b| b.iter(|| build_def_pool(&fds)));
+    group.bench_function("cpp", |b| {
+        b.iter(|| {
+            let mut pool = DescriptorPool::new();
+            pool.as_mut().build_file_set(&fds).unwrap();
+            pool
+        })
+    });
+    group.finish();
+}
+
+fn bench_parse(c: &mut Criterion) {
+    let fds = build_descriptor_set();
+    let data = fds.serialize().unwrap();
+    let pool = build_def_pool(&fds);
+    let def = pool.find_message_by_name(UPB_TYPE_NAME).unwrap();
+    let mut block = vec![MaybeUninit::uninit(); INITIAL_BLOCK_SIZE];
+
+    let mut group = c.benchmark_group("parse");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("upb/arena/copy", |b| {
+        b.iter(|| {
+            let arena = upb::Arena::new();
+            black_box(upb::Message::parse(def, &arena, &data).unwrap());
+        })
+    });
+    group.bench_function("upb/arena/alias", |b| {
+        b.iter(|| {
+            let arena = upb::Arena::new();
+            black_box(AliasedMessage::parse(def, &arena, &data).unwrap());
+        })
+    });
+    group.bench_function("upb/initial_block/copy", |b| {
+        b.iter(|| {
+            let arena = upb::Arena::with_initial_block(&mut block);
+            black_box(upb::Message::parse(def, &arena, &data).unwrap());
+        })
+    });
+    group.bench_function("upb/initial_block/alias", |b| {
+        b.iter(|| {
+            let arena = upb::Arena::with_initial_block(&mut block);
+            black_box(AliasedMessage::parse(def, &arena, &data).unwrap());
+        })
+    });
+    group.bench_function("cpp/heap", |b| {
+        b.iter(|| {
+            let mut message = MessageLite::new(&*fds);
+            message.as_mut().parse_from_bytes(&data).unwrap();
+            message
+        })
+    });
+    group.bench_function("cpp/arena", |b| {
+        b.iter(|| {
+            let arena = Arena::new();
+            let message = fds.new_in(&arena);
+            message.parse_from_bytes(&data).unwrap();
+        })
+    });
+    group.bench_function("cpp/initial_block", |b| {
+        b.iter(|| {
+            let arena = Arena::with_options(ArenaOptions {
+                initial_block: Some(&mut block[..]),
+                ..Default::default()
+            });
+            let message = fds.new_in(&arena);
+            message.parse_from_bytes(&data).unwrap();
+        })
+    });
+    group.finish();
+}
+
+fn bench_serialize(c: &mut Criterion) {
+    let fds = build_descriptor_set();
+    let data = fds.serialize().unwrap();
+    let pool = build_def_pool(&fds);
+    let def = pool.find_message_by_name(UPB_TYPE_NAME).unwrap();
+    let arena = upb::Arena::new();
+    let message = upb::Message::parse(def, &arena, &data).unwrap();
+
+    let mut group = c.benchmark_group("serialize");
+    group.throughput(Throughput::Bytes(data.len() as u64));
+    group.bench_function("upb", |b| b.iter(|| message.serialize().unwrap()));
+    group.bench_function("cpp", |b| b.iter(|| fds.serialize().unwrap()));
+    group.finish();
+}
+
+fn bench_json(c: &mut Criterion) {
+    let fds = build_descriptor_set();
+    let data = fds.serialize().unwrap();
+    let pool = build_def_pool(&fds);
+    let def = pool.find_message_by_name(UPB_TYPE_NAME).unwrap();
+    let arena = upb::Arena::new();
+    let message = upb::Message::parse(def, &arena, &data).unwrap();
+    let upb_json = message.to_json(&Default::default()).unwrap();
+    let cpp_json = json::message_to_json(&*fds, &Default::default()).unwrap();
+
+    let mut group = c.benchmark_group("json_parse");
+    group.throughput(Throughput::Bytes(upb_json.len() as u64));
+    group.bench_function("upb", |b| {
+        b.iter(|| {
+            let arena = upb::Arena::new();
+            black_box(
+                upb::Message::parse_json(def, &arena, &upb_json, &Default::default()).unwrap(),
+            );
+        })
+    });
+    let mut target = build_descriptor_set();
+    group.bench_function("cpp", |b| {
+        b.iter(|| {
+            target.as_mut().clear();
+            json::json_to_message(&cpp_json, target.as_mut(), &Default::default()).unwrap();
+        })
+    });
+    group.finish();
+
+    let mut group = c.benchmark_group("json_serialize");
+    group.throughput(Throughput::Bytes(upb_json.len() as u64));
+    group.bench_function("upb", |b| {
+        b.iter(|| message.to_json(&Default::default()).unwrap())
+    });
+    group.bench_function("cpp", |b| {
+        b.iter(|| json::message_to_json(&*fds, &Default::default()).unwrap())
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_arena,
+    bench_load_descriptor,
+    bench_parse,
+    bench_serialize,
+    bench_json
+);
+criterion_main!(benches);
@@ -16,16 +16,98 @@
 use std::env;
 
 fn main() {
-    cxx_build::bridges([
+    let mut bridges = vec![
+        "src/any.rs",
+        "src/columnar.rs",
+        "src/compat.rs",
         "src/compiler.rs",
         "src/internal.rs",
         "src/io.rs",
+        "src/json.rs",
         "src/lib.rs",
-    ])
-    .flag("-std=c++14")
-    .files(["src/compiler.cc", "src/io.cc", "src/lib.cc"])
-    .warnings_into_errors(cfg!(deny_warnings))
-    .compile("protobuf_native");
+        "src/numa.rs",
+        "src/profile.rs",
+        "src/text_format.rs",
+        "src/util.rs",
+    ];
+    let mut files = vec![
+        "src/any.cc",
+        "src/columnar.cc",
+        "src/compat.cc",
+        "src/compiler.cc",
+        "src/io.cc",
+        "src/json.cc",
+        "src/lib.cc",
+        "src/numa.cc",
+        "src/profile.cc",
+        "src/text_format.cc",
+        "src/util.cc",
+    ];
+    let arenaz = env::var("DEP_PROTOBUF_SRC_ARENAZ").ok();
+    if arenaz.is_some() {
+        bridges.push("src/arenaz.rs");
+        files.push("src/arenaz.cc");
+    }
+    let bench = env::var_os("CARGO_FEATURE_BENCH").is_some();
+    if bench {
+        bridges.push("src/bench.rs");
+        files.push("src/bench.cc");
+    }
+    let rust_alloc = env::var_os("CARGO_FEATURE_RUST_ALLOC").is_some();
+    if rust_alloc {
+        bridges.push("src/alloc.rs");
+    }
+    // Both features replace the global allocation functions, which only one
+    // file may define.
+    if bench || rust_alloc {
+        files.push("src/alloc.cc");
+    }
+    let upb = env::var_os("CARGO_FEATURE_UPB").is_some();
+    if upb {
+        bridges.push("src/upb.rs");
+        files.push("src/upb.cc");
+    }
+    let serde_json = env::var_os("CARGO_FEATURE_SERDE_JSON").is_some();
+    if serde_json {
+        bridges.push("src/struct_value.rs");
+        files.push("src/struct_value.cc");
+    }
+    let protoc = env::var_os("CARGO_FEATURE_PROTOC").is_some();
+    if protoc {
+        bridges.push("src/protoc.rs");
+        files.push("src/protoc.cc");
+    }
+
+    let mut build = cxx_build::bridges(bridges);
+    if let Some(prelude) = &arenaz {
+        // Must match the configuration of libprotobuf; see protobuf-src.
+        build
+            .define("PROTOBUF_ARENAZ_SAMPLE", None)
+            .flag("-include")
+            .flag(prelude);
+    }
+    if bench {
+        build.define("PROTOBUF_NATIVE_COUNT_ALLOCATIONS", None);
+    }
+    if rust_alloc {
+        build.define("PROTOBUF_NATIVE_RUST_ALLOC", None);
+    }
+    let zlib = env::var_os("CARGO_FEATURE_ZLIB").is_some();
+    if zlib {
+        build.define("PROTOBUF_NATIVE_ZLIB", None);
+    }
+    if env::var_os("DEP_PROTOBUF_SRC_LTO").is_some() {
+        // Compile to bitcode like libprotobuf, for cross-language LTO; see
+        // protobuf-src.
+        build
+            .flag("-flto=thin")
+            .archiver(env::var("DEP_PROTOBUF_SRC_LLVM_AR").unwrap());
+    }
+    build
+        .flag("-std=c++14")
+        .files(files)
+        .warnings_into_errors(cfg!(deny_warnings))
+        .compile("protobuf_native");
 
     // NOTE(benesch): once the bindings in protobuf-sys are more complete,
     // we'll switch to depending on protobuf-sys instead of protobuf-src,
@@ -35,99 +117,31 @@ fn main() {
         env::var("DEP_PROTOBUF_SRC_ROOT").unwrap()
     );
 
-    for lib in [
-        "absl_bad_any_cast_impl",
-        "absl_bad_optional_access",
-        "absl_bad_variant_access",
-        "absl_base",
-        "absl_city",
-        "absl_civil_time",
-        "absl_cord",
-        "absl_cordz_functions",
-        "absl_cordz_handle",
-        "absl_cordz_info",
-        "absl_cordz_sample_token",
-        "absl_cord_internal",
-        "absl_crc32c",
-        "absl_crc_cord_state",
-        "absl_crc_cpu_detect",
-        "absl_crc_internal",
-        "absl_debugging_internal",
-        "absl_decode_rust_punycode",
-        "absl_demangle_internal",
-        "absl_demangle_rust",
-        "absl_die_if_null",
-        "absl_examine_stack",
-        "absl_exponential_biased",
-        "absl_failure_signal_handler",
-        "absl_flags_commandlineflag",
-        "absl_flags_commandlineflag_internal",
-        "absl_flags_config",
-        "absl_flags_internal",
-        "absl_flags_marshalling",
-        "absl_flags_parse",
-        "absl_flags_private_handle_accessor",
-        "absl_flags_program_name",
-        "absl_flags_reflection",
-        "absl_flags_usage",
-        "absl_flags_usage_internal",
-        "absl_graphcycles_internal",
-        "absl_hash",
-        "absl_hashtablez_sampler",
-        "absl_int128",
-        "absl_kernel_timeout_internal",
-        "absl_leak_check",
-        "absl_log_entry",
-        "absl_log_flags",
-        "absl_log_globals",
-        "absl_log_initialize",
-        "absl_log_internal_check_op",
-        "absl_log_internal_conditions",
-        "absl_log_internal_fnmatch",
-        "absl_log_internal_format",
-        "absl_log_internal_globals",
-        "absl_log_internal_log_sink_set",
-        "absl_log_internal_message",
-        "absl_log_internal_nullguard",
-        "absl_log_internal_proto",
-        "absl_log_severity",
-        "absl_log_sink",
-        "absl_low_level_hash",
-        "absl_malloc_internal",
-        "absl_periodic_sampler",
-        "absl_random_distributions",
-        "absl_random_internal_distribution_test_util",
-        "absl_random_internal_platform",
-        "absl_random_internal_pool_urbg",
-        "absl_random_internal_randen",
-        "absl_random_internal_randen_hwaes",
-        "absl_random_internal_randen_hwaes_impl",
-        "absl_random_internal_randen_slow",
-        "absl_random_internal_seed_material",
-        "absl_random_seed_gen_exception",
-        "absl_random_seed_sequences",
-        "absl_raw_hash_set",
-        "absl_raw_logging_internal",
-        "absl_scoped_set_env",
-        "absl_spinlock_wait",
-        "absl_stacktrace",
-        "absl_status",
-        "absl_statusor",
-        "absl_strerror",
-        "absl_strings",
-        "absl_strings_internal",
-        "absl_string_view",
-        "absl_str_format_internal",
-        "absl_symbolize",
-        "absl_synchronization",
-        "absl_throw_delegate",
-        "absl_time",
-        "absl_time_zone",
-        "absl_utf8_for_code_point",
-        "absl_vlog_config_internal",
-        "protobuf",
-        "utf8_validity",
-    ] {
+    // libupb must precede the libraries below, as it depends on the UTF-8
+    // validation routines in utf8_validity.
+    if upb {
+        println!(
+            "cargo:rustc-link-lib=static={}",
+            env::var("DEP_PROTOBUF_SRC_UPB").unwrap()
+        );
+    }
+
+    // libprotoc depends on libprotobuf and Abseil, so it too must precede the
+    // libraries below.
+    if protoc {
+        println!(
+            "cargo:rustc-link-lib=static={}",
+            env::var("DEP_PROTOBUF_SRC_PROTOC").unwrap()
+        );
+    }
+
+    for lib in env::var("DEP_PROTOBUF_SRC_LIBS").unwrap().split(',') {
         println!("cargo:rustc-link-lib=static={lib}");
     }
+
+    // With the `zlib` feature, the gzip streams in libprotobuf and the
+    // bindings' own compression depend on the system zlib.
+    if zlib {
+        println!("cargo:rustc-link-lib=z");
+    }
 }
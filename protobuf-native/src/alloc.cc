@@ -0,0 +1,131 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Replacements for the global allocation functions, which libprotobuf uses
+// for messages, strings and descriptor tables as well as for arena blocks.
+//
+// With the `rust-alloc` feature, they allocate through the Rust global
+// allocator; otherwise, with `malloc`. With the `bench` feature, they also
+// count allocations for `CppAllocationCount`. The aligned forms, which are
+// new in C++17, are not used at the C++ standard that the crate is built with.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#ifdef PROTOBUF_NATIVE_COUNT_ALLOCATIONS
+#include "protobuf-native/src/bench.h"
+#endif
+#ifdef PROTOBUF_NATIVE_RUST_ALLOC
+#include "protobuf-native/src/alloc.rs.h"
+#endif
+
+namespace protobuf_native {
+namespace alloc {
+namespace {
+
+#ifdef PROTOBUF_NATIVE_RUST_ALLOC
+
+// The Rust allocator needs the size of an allocation to free it, which the
+// unsized `operator delete` does not provide, so every allocation is
+// prefixed with a header that records it. The header is as large as the
+// alignment that `operator new` guarantees, to preserve that alignment.
+constexpr size_t kAlign = alignof(std::max_align_t);
+constexpr size_t kHeaderSize = kAlign;
+
+void* Allocate(size_t size) noexcept {
+    if (size > SIZE_MAX - kHeaderSize) {
+        return nullptr;
+    }
+    size_t total = kHeaderSize + size;
+    uint8_t* block = rust_alloc(total, kAlign);
+    if (block == nullptr) {
+        return nullptr;
+    }
+    *reinterpret_cast<size_t*>(block) = total;
+    return block + kHeaderSize;
+}
+
+void Free(void* ptr) noexcept {
+    if (ptr == nullptr) {
+        return;
+    }
+    uint8_t* block = static_cast<uint8_t*>(ptr) - kHeaderSize;
+    rust_dealloc(block, *reinterpret_cast<size_t*>(block), kAlign);
+}
+
+#else
+
+void* Allocate(size_t size) noexcept { return std::malloc(size == 0 ? 1 : size); }
+
+void Free(void* ptr) noexcept { std::free(ptr); }
+
+#endif
+
+void* CountedAllocate(size_t size) noexcept {
+#ifdef PROTOBUF_NATIVE_COUNT_ALLOCATIONS
+    bench::cpp_allocations++;
+#endif
+    return Allocate(size);
+}
+
+}  // namespace
+}  // namespace alloc
+}  // namespace protobuf_native
+
+void* operator new(size_t size) {
+    void* ptr = protobuf_native::alloc::CountedAllocate(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return protobuf_native::alloc::CountedAllocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return protobuf_native::alloc::CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    protobuf_native::alloc::Free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    protobuf_native::alloc::Free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    protobuf_native::alloc::Free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    protobuf_native::alloc::Free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    protobuf_native::alloc::Free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    protobuf_native::alloc::Free(ptr);
+}
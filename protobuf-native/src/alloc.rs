@@ -0,0 +1,44 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Routes the C++ runtime's allocations through the Rust global allocator.
+//!
+//! With the `rust-alloc` feature, the replacements for the global C++
+//! `operator new` and `operator delete` in alloc.cc call the functions here,
+//! which allocate with whatever `#[global_allocator]` the binary installs.
+//! libupb, which allocates with `malloc`, is unaffected.
+
+use std::alloc::{self, Layout};
+use std::ptr;
+
+#[cxx::bridge(namespace = "protobuf_native::alloc")]
+mod ffi {
+    extern "Rust" {
+        fn rust_alloc(size: usize, align: usize) -> *mut u8;
+        unsafe fn rust_dealloc(ptr: *mut u8, size: usize, align: usize);
+    }
+}
+
+fn rust_alloc(size: usize, align: usize) -> *mut u8 {
+    // `operator new` always passes a nonzero size, as it prefixes a header.
+    match Layout::from_size_align(size, align) {
+        Ok(layout) if size > 0 => unsafe { alloc::alloc(layout) },
+        _ => ptr::null_mut(),
+    }
+}
+
+unsafe fn rust_dealloc(ptr: *mut u8, size: usize, align: usize) {
+    alloc::dealloc(ptr, Layout::from_size_align_unchecked(size, align))
+}
@@ -0,0 +1,42 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/any.h"
+
+#include "protobuf-native/src/any.rs.h"
+
+namespace protobuf_native {
+namespace any {
+
+Any* NewAny() { return new Any(); }
+
+void DeleteAny(Any* any) { delete any; }
+
+void AnySetTypeUrl(Any& any, absl::string_view type_url) {
+    any.set_type_url(type_url);
+}
+
+void AnySetValue(Any& any, rust::Slice<const uint8_t> value) {
+    any.set_value(absl::string_view(reinterpret_cast<const char*>(value.data()), value.size()));
+}
+
+bool AnyPackFrom(Any& any, const Message& message, absl::string_view type_url_prefix) {
+    return any.PackFrom(message, type_url_prefix);
+}
+
+bool AnyUnpackTo(const Any& any, Message& message) { return any.UnpackTo(&message); }
+
+}  // namespace any
+}  // namespace protobuf_native
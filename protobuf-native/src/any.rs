@@ -0,0 +1,351 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Messages packed into `google.protobuf.Any`.
+//!
+//! An [`Any`] holds a serialized message along with a type URL, like
+//! `type.googleapis.com/package.Message`, that names the message's type.
+//! [`Any::pack_from`] and [`Any::unpack_to`] convert between an `Any` and a
+//! message whose type is known to the caller.
+//!
+//! When the type is only known from the type URL, an [`AnyResolver`] finds
+//! it in a [`DescriptorPool`] and caches the result, so that unpacking many
+//! `Any`s of the same few types looks each type up only once.
+
+use std::marker::PhantomPinned;
+use std::mem;
+use std::pin::Pin;
+use std::ptr;
+use std::str;
+use std::sync::atomic::{AtomicPtr, Ordering};
+use std::sync::Mutex;
+
+use crate::internal::{unsafe_ffi_conversions, BoolExt};
+use crate::{
+    private, Descriptor, DescriptorPool, DynamicMessageFactory, Message, MessageLite,
+    OperationFailedError,
+};
+
+#[cxx::bridge(namespace = "protobuf_native::any")]
+pub(crate) mod ffi {
+    unsafe extern "C++" {
+        include!("protobuf-native/src/any.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "absl"]
+        type string_view<'a> = crate::internal::StringView<'a>;
+
+        #[namespace = "google::protobuf"]
+        type Message = crate::ffi::Message;
+
+        #[namespace = "google::protobuf"]
+        type Any;
+
+        fn NewAny() -> *mut Any;
+        unsafe fn DeleteAny(any: *mut Any);
+        fn type_url(self: &Any) -> &CxxString;
+        fn value(self: &Any) -> &CxxString;
+        fn AnySetTypeUrl(any: Pin<&mut Any>, type_url: string_view);
+        fn AnySetValue(any: Pin<&mut Any>, value: &[u8]);
+        fn AnyPackFrom(any: Pin<&mut Any>, message: &Message, type_url_prefix: string_view)
+            -> bool;
+        fn AnyUnpackTo(any: &Any, message: Pin<&mut Message>) -> bool;
+    }
+}
+
+/// The type URL prefix used by [`Any::pack_from`].
+pub const DEFAULT_TYPE_URL_PREFIX: &str = "type.googleapis.com/";
+
+/// The initial number of slots in the table of an [`AnyResolver`].
+const INITIAL_CAPACITY: usize = 64;
+
+/// A message of any type, serialized, along with a URL that identifies its
+/// type.
+pub struct Any {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for Any {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteAny(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Any {
+    /// Creates a new empty `Any`.
+    pub fn new() -> Pin<Box<Any>> {
+        let any = ffi::NewAny();
+        unsafe { Self::from_ffi_owned(any) }
+    }
+
+    /// Returns the URL that identifies the type of the packed message.
+    pub fn type_url(&self) -> &[u8] {
+        self.as_ffi().type_url().as_bytes()
+    }
+
+    /// Sets the URL that identifies the type of the packed message.
+    pub fn set_type_url(self: Pin<&mut Self>, type_url: &str) {
+        ffi::AnySetTypeUrl(self.as_ffi_mut(), type_url.into())
+    }
+
+    /// Returns the serialized packed message.
+    pub fn value(&self) -> &[u8] {
+        self.as_ffi().value().as_bytes()
+    }
+
+    /// Sets the serialized packed message.
+    pub fn set_value(self: Pin<&mut Self>, value: &[u8]) {
+        ffi::AnySetValue(self.as_ffi_mut(), value)
+    }
+
+    /// Packs `message` into this `Any`, with a type URL formed from
+    /// [`DEFAULT_TYPE_URL_PREFIX`] and the message's full type name.
+    ///
+    /// Returns an error if the message could not be serialized.
+    pub fn pack_from(
+        self: Pin<&mut Self>,
+        message: &dyn Message,
+    ) -> Result<(), OperationFailedError> {
+        self.pack_from_with_prefix(message, DEFAULT_TYPE_URL_PREFIX)
+    }
+
+    /// Like [`Any::pack_from`], but with the given type URL prefix.
+    pub fn pack_from_with_prefix(
+        self: Pin<&mut Self>,
+        message: &dyn Message,
+        type_url_prefix: &str,
+    ) -> Result<(), OperationFailedError> {
+        let message: &crate::ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+        ffi::AnyPackFrom(self.as_ffi_mut(), message, type_url_prefix.into()).as_result()
+    }
+
+    /// Unpacks the message in this `Any` into `message`, replacing its
+    /// contents.
+    ///
+    /// Returns an error if the type URL does not name the type of `message`,
+    /// or if the packed message could not be parsed.
+    pub fn unpack_to(&self, message: Pin<&mut dyn Message>) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut crate::ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) };
+        ffi::AnyUnpackTo(self.as_ffi(), message).as_result()
+    }
+
+    unsafe_ffi_conversions!(ffi::Any);
+}
+
+impl MessageLite for Any {}
+
+impl private::MessageLite for Any {
+    fn upcast(&self) -> &crate::ffi::MessageLite {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut crate::ffi::MessageLite> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+impl Message for Any {}
+impl private::Message for Any {}
+
+/// A message type resolved from a type URL by an [`AnyResolver`].
+#[derive(Clone, Copy)]
+pub struct ResolvedType<'r> {
+    /// The descriptor of the type.
+    pub descriptor: &'r Descriptor,
+    /// A prototype message of the type, from which new messages of the type
+    /// are constructed with [`Message::new_message`].
+    pub prototype: &'r dyn Message,
+}
+
+/// Resolves the type URLs of [`Any`]s to message types, caching the results.
+///
+/// Types are found by name in a [`DescriptorPool`], and messages of them are
+/// constructed with a [`DynamicMessageFactory`] that the resolver owns. Each
+/// type URL is looked up in the pool only once; afterwards it is found in a
+/// hash table that is read without taking any lock, so a resolver may be
+/// shared by any number of threads that unpack `Any`s concurrently. Only the
+/// first resolution of each type URL takes a lock. Type URLs that do not
+/// resolve are not cached.
+///
+/// As with a `DynamicMessageFactory`, messages constructed from the
+/// resolver's prototypes, including those returned by
+/// [`AnyResolver::unpack`], must be dropped before the resolver is.
+pub struct AnyResolver<'a> {
+    pool: &'a DescriptorPool<'a>,
+    /// The current table. Points into `Inner::tables`.
+    table: AtomicPtr<Table<'a>>,
+    inner: Mutex<Inner<'a>>,
+}
+
+struct Inner<'a> {
+    factory: Pin<Box<DynamicMessageFactory<'a>>>,
+    /// Every resolved type, in order of resolution.
+    entries: Vec<Box<Entry<'a>>>,
+    /// Every table, the current one last. Tables that have been outgrown may
+    /// still be in use by readers, so they are only freed along with the
+    /// resolver. Each is half the size of the next, so together they take at
+    /// most as much memory as the current table.
+    tables: Vec<Box<Table<'a>>>,
+}
+
+/// An open-addressed hash table of resolved types, with linear probing.
+///
+/// Tables are kept at most half full, so every probe sequence ends at an
+/// empty slot. Slots are only ever filled, and only while holding the
+/// resolver's lock.
+struct Table<'a> {
+    slots: Box<[AtomicPtr<Entry<'a>>]>,
+}
+
+struct Entry<'a> {
+    type_url: Box<[u8]>,
+    descriptor: &'a Descriptor,
+    /// Owned by the resolver's factory.
+    prototype: &'a dyn Message,
+}
+
+impl<'a> Table<'a> {
+    fn new(capacity: usize) -> Box<Table<'a>> {
+        Box::new(Table {
+            slots: (0..capacity)
+                .map(|_| AtomicPtr::new(ptr::null_mut()))
+                .collect(),
+        })
+    }
+
+    fn find(&self, type_url: &[u8]) -> Option<&Entry<'a>> {
+        let mask = self.slots.len() - 1;
+        let mut i = hash(type_url) as usize & mask;
+        loop {
+            let entry = self.slots[i].load(Ordering::Acquire);
+            if entry.is_null() {
+                return None;
+            }
+            // SAFETY: entries are only freed along with the resolver.
+            let entry = unsafe { &*entry };
+            if *entry.type_url == *type_url {
+                return Some(entry);
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    fn insert(&self, entry: &Entry<'a>) {
+        let mask = self.slots.len() - 1;
+        let mut i = hash(&entry.type_url) as usize & mask;
+        while !self.slots[i].load(Ordering::Relaxed).is_null() {
+            i = (i + 1) & mask;
+        }
+        let entry = entry as *const Entry<'a> as *mut Entry<'a>;
+        self.slots[i].store(entry, Ordering::Release);
+    }
+}
+
+impl<'a> AnyResolver<'a> {
+    /// Creates a resolver that finds types in `pool`.
+    pub fn new(pool: &'a DescriptorPool<'a>) -> AnyResolver<'a> {
+        let mut table = Table::new(INITIAL_CAPACITY);
+        let ptr = &mut *table as *mut Table<'a>;
+        AnyResolver {
+            pool,
+            table: AtomicPtr::new(ptr),
+            inner: Mutex::new(Inner {
+                factory: DynamicMessageFactory::new(),
+                entries: vec![],
+                tables: vec![table],
+            }),
+        }
+    }
+
+    /// Resolves `type_url` to a message type.
+    ///
+    /// The type name is the part of the URL after the last `/`. Returns
+    /// `None` if the URL has no `/`, or if the pool has no message type with
+    /// that name.
+    pub fn resolve(&self, type_url: &[u8]) -> Option<ResolvedType<'_>> {
+        // SAFETY: tables are only freed along with the resolver.
+        let table = unsafe { &*self.table.load(Ordering::Acquire) };
+        let entry = match table.find(type_url) {
+            Some(entry) => entry,
+            None => self.resolve_slow(type_url)?,
+        };
+        Some(ResolvedType {
+            descriptor: entry.descriptor,
+            prototype: entry.prototype,
+        })
+    }
+
+    /// Unpacks the message in `any` into a new message of the type that its
+    /// type URL names.
+    ///
+    /// Returns an error if the type URL does not resolve, or if the packed
+    /// message could not be parsed.
+    pub fn unpack(&self, any: &Any) -> Result<Pin<Box<dyn Message>>, OperationFailedError> {
+        let resolved = self.resolve(any.type_url()).ok_or(OperationFailedError)?;
+        let mut message = resolved.prototype.new_message();
+        message.as_mut().parse_from_bytes(any.value())?;
+        Ok(message)
+    }
+
+    fn resolve_slow(&self, type_url: &[u8]) -> Option<&Entry<'a>> {
+        let mut inner = self.inner.lock().expect("any resolver poisoned");
+        // SAFETY: tables are only freed along with the resolver.
+        let table = unsafe { &*self.table.load(Ordering::Acquire) };
+        // Another thread may have resolved the type while this one waited
+        // for the lock.
+        if let Some(entry) = table.find(type_url) {
+            return Some(entry);
+        }
+
+        let slash = type_url.iter().rposition(|b| *b == b'/')?;
+        let type_name = str::from_utf8(&type_url[slash + 1..]).ok()?;
+        let descriptor = self.pool.find_message_type_by_name(type_name)?;
+        let prototype = inner.factory.as_mut().get_prototype(descriptor);
+        // SAFETY: the factory owns the prototype, and is dropped only along
+        // with the resolver.
+        let prototype: &'a dyn Message = unsafe { mem::transmute(prototype) };
+        let entry = Box::new(Entry {
+            type_url: type_url.into(),
+            descriptor,
+            prototype,
+        });
+        let entry_ptr = &*entry as *const Entry<'a>;
+        inner.entries.push(entry);
+
+        if inner.entries.len() * 2 > table.slots.len() {
+            let mut grown = Table::new(table.slots.len() * 2);
+            for entry in &inner.entries {
+                grown.insert(entry);
+            }
+            self.table.store(&mut *grown, Ordering::Release);
+            inner.tables.push(grown);
+        } else {
+            table.insert(unsafe { &*entry_ptr });
+        }
+        // SAFETY: entries are only freed along with the resolver.
+        Some(unsafe { &*entry_ptr })
+    }
+}
+
+/// Hashes a type URL with FNV-1a.
+fn hash(bytes: &[u8]) -> u64 {
+    let mut h: u64 = 0xcbf2_9ce4_8422_2325;
+    for &b in bytes {
+        h = (h ^ u64::from(b)).wrapping_mul(0x0100_0000_01b3);
+    }
+    h
+}
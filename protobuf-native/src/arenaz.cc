@@ -0,0 +1,67 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/arenaz.h"
+
+#include <atomic>
+
+#include "protobuf-native/src/arenaz.rs.h"
+
+namespace protobuf_native {
+namespace arenaz {
+
+using google::protobuf::internal::GlobalThreadSafeArenazSampler;
+using google::protobuf::internal::ThreadSafeArenaStats;
+
+void SetEnabled(bool enabled) { google::protobuf::internal::SetThreadSafeArenazEnabled(enabled); }
+
+void SetSampleRate(int32_t rate) {
+    google::protobuf::internal::SetThreadSafeArenazSampleParameter(rate);
+}
+
+void SetMaxSamples(int32_t max) { google::protobuf::internal::SetThreadSafeArenazMaxSamples(max); }
+
+rust::Vec<ArenaStats> CollectStats() {
+    rust::Vec<ArenaStats> out;
+    // The sampler holds each sample's lock while it is visited, so its fields
+    // are read consistently. The counters are updated without ordering, so
+    // relaxed loads suffice.
+    GlobalThreadSafeArenazSampler().Iterate([&](const ThreadSafeArenaStats& stats) {
+        ArenaStats arena{
+            .weight = stats.weight,
+            .max_block_size = stats.max_block_size.load(std::memory_order_relaxed),
+            .thread_ids = stats.thread_ids.load(std::memory_order_relaxed),
+            .block_histogram = {},
+        };
+        for (size_t bin = 0; bin < ThreadSafeArenaStats::kBlockHistogramBins; ++bin) {
+            const ThreadSafeArenaStats::BlockStats& block = stats.block_histogram[bin];
+            std::pair<size_t, size_t> sizes = ThreadSafeArenaStats::MinMaxBlockSizeForBin(bin);
+            arena.block_histogram.push_back(BlockStats{
+                .min_block_size = sizes.first,
+                .max_block_size = sizes.second,
+                .num_allocations = static_cast<size_t>(
+                    block.num_allocations.load(std::memory_order_relaxed)),
+                .bytes_allocated = block.bytes_allocated.load(std::memory_order_relaxed),
+                .bytes_used = block.bytes_used.load(std::memory_order_relaxed),
+                .bytes_wasted = block.bytes_wasted.load(std::memory_order_relaxed),
+            });
+        }
+        out.push_back(std::move(arena));
+    });
+    return out;
+}
+
+}  // namespace arenaz
+}  // namespace protobuf_native
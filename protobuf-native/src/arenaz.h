@@ -0,0 +1,34 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+
+#include "google/protobuf/arenaz_sampler.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace arenaz {
+
+struct ArenaStats;
+
+void SetEnabled(bool enabled);
+void SetSampleRate(int32_t rate);
+void SetMaxSamples(int32_t max);
+rust::Vec<ArenaStats> CollectStats();
+
+}  // namespace arenaz
+}  // namespace protobuf_native
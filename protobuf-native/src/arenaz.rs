@@ -0,0 +1,148 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Sampling of arena allocation statistics.
+//!
+//! When the `arenaz` feature is enabled, libprotobuf samples a random subset
+//! of the [`Arena`](crate::Arena)s that are created and records how each
+//! sampled arena allocates its memory blocks. The statistics are intended to
+//! inform the choice of [`ArenaOptions`](crate::ArenaOptions), such as the
+//! initial and maximum block sizes.
+//!
+//! Sampling is enabled by default, with one in every 1024 arenas sampled on
+//! average.
+//!
+//! This module is only available if the `arenaz` feature is enabled.
+
+#[cxx::bridge(namespace = "protobuf_native::arenaz")]
+pub(crate) mod ffi {
+    struct BlockStats {
+        min_block_size: usize,
+        max_block_size: usize,
+        num_allocations: usize,
+        bytes_allocated: usize,
+        bytes_used: usize,
+        bytes_wasted: usize,
+    }
+
+    struct ArenaStats {
+        weight: i64,
+        max_block_size: usize,
+        thread_ids: u64,
+        block_histogram: Vec<BlockStats>,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/arenaz.h");
+
+        fn SetEnabled(enabled: bool);
+        fn SetSampleRate(rate: i32);
+        fn SetMaxSamples(max: i32);
+        fn CollectStats() -> Vec<ArenaStats>;
+    }
+}
+
+/// Statistics about the blocks of a sampled arena whose sizes fall within a
+/// range.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct BlockStats {
+    /// The smallest block size in the range, inclusive.
+    pub min_block_size: usize,
+    /// The largest block size in the range, inclusive.
+    pub max_block_size: usize,
+    /// The number of blocks allocated.
+    pub num_allocations: usize,
+    /// The total size of the blocks allocated.
+    pub bytes_allocated: usize,
+    /// The number of bytes of the blocks that were used by the time the arena
+    /// moved on to a new block.
+    pub bytes_used: usize,
+    /// The number of bytes of the blocks that were left unused when the arena
+    /// moved on to a new block.
+    pub bytes_wasted: usize,
+}
+
+impl From<ffi::BlockStats> for BlockStats {
+    fn from(stats: ffi::BlockStats) -> BlockStats {
+        BlockStats {
+            min_block_size: stats.min_block_size,
+            max_block_size: stats.max_block_size,
+            num_allocations: stats.num_allocations,
+            bytes_allocated: stats.bytes_allocated,
+            bytes_used: stats.bytes_used,
+            bytes_wasted: stats.bytes_wasted,
+        }
+    }
+}
+
+/// Statistics about a sampled arena.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct ArenaStats {
+    /// The number of arenas created since the previous arena was sampled,
+    /// which weights this sample when extrapolating to all arenas.
+    pub weight: i64,
+    /// The size of the largest block allocated by the arena.
+    pub max_block_size: usize,
+    /// A bit set of the threads that allocated from the arena. Bit `i` is set
+    /// if a thread whose thread ID modulo 63 is `i` allocated from the arena.
+    pub thread_ids: u64,
+    /// The blocks allocated by the arena, in ascending ranges of block size.
+    pub block_histogram: Vec<BlockStats>,
+}
+
+impl From<ffi::ArenaStats> for ArenaStats {
+    fn from(stats: ffi::ArenaStats) -> ArenaStats {
+        ArenaStats {
+            weight: stats.weight,
+            max_block_size: stats.max_block_size,
+            thread_ids: stats.thread_ids,
+            block_histogram: stats.block_histogram.into_iter().map(Into::into).collect(),
+        }
+    }
+}
+
+/// Enables or disables sampling of arenas created from now on.
+pub fn set_enabled(enabled: bool) {
+    ffi::SetEnabled(enabled)
+}
+
+/// Sets the average number of arenas created between sampled arenas.
+///
+/// # Panics
+///
+/// Panics if `rate` is zero or greater than `i32::MAX`.
+pub fn set_sample_rate(rate: u32) {
+    match i32::try_from(rate) {
+        Ok(rate) if rate > 0 => ffi::SetSampleRate(rate),
+        _ => panic!("invalid arenaz sample rate: {}", rate),
+    }
+}
+
+/// Sets the maximum number of arenas that are sampled at once.
+///
+/// # Panics
+///
+/// Panics if `max` is zero or greater than `i32::MAX`.
+pub fn set_max_samples(max: u32) {
+    match i32::try_from(max) {
+        Ok(max) if max > 0 => ffi::SetMaxSamples(max),
+        _ => panic!("invalid arenaz max samples: {}", max),
+    }
+}
+
+/// Returns the statistics of the sampled arenas that are still alive.
+pub fn collect_stats() -> Vec<ArenaStats> {
+    ffi::CollectStats().into_iter().map(Into::into).collect()
+}
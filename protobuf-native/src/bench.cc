@@ -0,0 +1,75 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/bench.h"
+
+#include "google/protobuf/io/coded_stream.h"
+
+namespace protobuf_native {
+namespace bench {
+
+using google::protobuf::MessageLite;
+using google::protobuf::io::CodedInputStream;
+
+thread_local uint64_t cpp_allocations = 0;
+
+uint64_t CodedInputStreamReadVarint32Loop(rust::Slice<const uint8_t> data, size_t count) {
+    CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value;
+        if (!input.ReadVarint32(&value)) {
+            break;
+        }
+        sum += value;
+    }
+    return sum;
+}
+
+uint64_t CodedInputStreamReadTagLoop(rust::Slice<const uint8_t> data, size_t count) {
+    CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            break;
+        }
+        sum += tag;
+    }
+    return sum;
+}
+
+uint64_t MessageLiteByteSizeLongLoop(const MessageLite& message, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += message.ByteSizeLong();
+    }
+    return sum;
+}
+
+size_t MessageLiteIsInitializedLoop(const MessageLite& message, size_t count) {
+    size_t initialized = 0;
+    for (size_t i = 0; i < count; i++) {
+        initialized += message.IsInitialized();
+    }
+    return initialized;
+}
+
+uint64_t CppAllocationCount() {
+    return cpp_allocations;
+}
+
+}  // namespace bench
+}  // namespace protobuf_native
@@ -0,0 +1,36 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "google/protobuf/message_lite.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace bench {
+
+uint64_t CodedInputStreamReadVarint32Loop(rust::Slice<const uint8_t> data, size_t count);
+uint64_t CodedInputStreamReadTagLoop(rust::Slice<const uint8_t> data, size_t count);
+uint64_t MessageLiteByteSizeLongLoop(const google::protobuf::MessageLite& message, size_t count);
+size_t MessageLiteIsInitializedLoop(const google::protobuf::MessageLite& message, size_t count);
+
+// The number of calls to the global `operator new` made on the current thread,
+// as counted by the replacement operators in alloc.cc.
+extern thread_local uint64_t cpp_allocations;
+
+uint64_t CppAllocationCount();
+
+}  // namespace bench
+}  // namespace protobuf_native
@@ -0,0 +1,150 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Hooks for the crate's benchmarks and allocation tests.
+//!
+//! The loop functions here each run a loop in C++ that makes the same
+//! libprotobuf call as a binding elsewhere in this crate, so that the
+//! benchmarks can compare a call made from Rust through the cxx bridge
+//! against the call alone.
+//!
+//! [`allocations`] counts the heap allocations made on the current thread,
+//! so that tests can assert that steady-state loops do not allocate. C++
+//! allocations are counted by replacements for the global `operator new`
+//! that are linked in along with this module; Rust allocations are counted
+//! only in binaries that install [`CountingAllocator`] as their global
+//! allocator. With the `rust-alloc` feature, C++ allocations are counted as
+//! Rust allocations, too. Memory that upb allocates with `malloc` is not counted.
+//!
+//! This module is not part of the public API; it is only available if the
+//! `bench` feature is enabled, for the crate's own use.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::cell::Cell;
+
+#[cxx::bridge(namespace = "protobuf_native::bench")]
+pub(crate) mod ffi {
+    unsafe extern "C++" {
+        include!("protobuf-native/src/bench.h");
+
+        #[namespace = "google::protobuf"]
+        type MessageLite = crate::ffi::MessageLite;
+
+        fn CodedInputStreamReadVarint32Loop(data: &[u8], count: usize) -> u64;
+        fn CodedInputStreamReadTagLoop(data: &[u8], count: usize) -> u64;
+        fn MessageLiteByteSizeLongLoop(message: &MessageLite, count: usize) -> u64;
+        fn MessageLiteIsInitializedLoop(message: &MessageLite, count: usize) -> usize;
+
+        fn CppAllocationCount() -> u64;
+    }
+}
+
+/// Reads up to `count` varints from `data` with
+/// `CodedInputStream::ReadVarint32`, stopping at the first failure, and
+/// returns their sum.
+pub fn read_varint32_loop(data: &[u8], count: usize) -> u64 {
+    ffi::CodedInputStreamReadVarint32Loop(data, count)
+}
+
+/// Reads up to `count` tags from `data` with `CodedInputStream::ReadTag`,
+/// stopping at the end of the input, and returns their sum.
+pub fn read_tag_loop(data: &[u8], count: usize) -> u64 {
+    ffi::CodedInputStreamReadTagLoop(data, count)
+}
+
+/// Calls `MessageLite::ByteSizeLong` `count` times and returns the sum of
+/// the results.
+pub fn byte_size_loop(message: &dyn MessageLite, count: usize) -> u64 {
+    ffi::MessageLiteByteSizeLongLoop(private::MessageLite::upcast(message), count)
+}
+
+/// Calls `MessageLite::IsInitialized` `count` times and returns the number
+/// of calls that returned true.
+pub fn is_initialized_loop(message: &dyn MessageLite, count: usize) -> usize {
+    ffi::MessageLiteIsInitializedLoop(private::MessageLite::upcast(message), count)
+}
+
+thread_local! {
+    static RUST_ALLOCATIONS: Cell<u64> = const { Cell::new(0) };
+}
+
+/// A global allocator that counts the allocations made on each thread before
+/// delegating them to the system allocator.
+///
+/// Install it with `#[global_allocator]` for [`allocations`] to count Rust
+/// allocations.
+pub struct CountingAllocator;
+
+impl CountingAllocator {
+    fn count(&self) {
+        // The counter may already be destroyed if the thread is exiting.
+        let _ = RUST_ALLOCATIONS.try_with(|count| count.set(count.get() + 1));
+    }
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        self.count();
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        self.count();
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        self.count();
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+/// The number of heap allocations made on a thread.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Allocations {
+    /// Allocations, including reallocations, made through the Rust global
+    /// allocator, if it is a [`CountingAllocator`].
+    pub rust: u64,
+    /// Calls to the global C++ `operator new`, in any of its forms.
+    pub cpp: u64,
+}
+
+/// Returns the number of heap allocations made on the current thread so far.
+pub fn allocations() -> Allocations {
+    Allocations {
+        rust: RUST_ALLOCATIONS.with(|count| count.get()),
+        cpp: ffi::CppAllocationCount(),
+    }
+}
+
+/// Calls `f` and returns its result along with the number of heap
+/// allocations that it made on the current thread.
+pub fn count_allocations<F, R>(f: F) -> (R, Allocations)
+where
+    F: FnOnce() -> R,
+{
+    let before = allocations();
+    let result = f();
+    let after = allocations();
+    let allocations = Allocations {
+        rust: after.rust - before.rust,
+        cpp: after.cpp - before.cpp,
+    };
+    (result, allocations)
+}
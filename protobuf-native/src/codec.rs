@@ -0,0 +1,174 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Integration with the codecs of [`tokio_util`].
+//!
+//! [`DelimitedCodec`] frames a byte stream as a sequence of messages, each of
+//! which is preceded by its length encoded as a varint, which is the format
+//! written by [`MessageLite::serialize_delimited_to_zero_copy_stream`] and
+//! read by [`DelimitedReader`]. Messages are decoded directly from the read
+//! buffer and encoded directly into the write buffer, without intermediate
+//! copies.
+//!
+//! This module is only available if the `tokio-util` feature is enabled.
+//!
+//! [`DelimitedReader`]: crate::io::DelimitedReader
+
+use std::fmt;
+use std::io;
+use std::pin::Pin;
+
+use bytes::{Buf, BufMut, BytesMut};
+use tokio_util::codec::{Decoder, Encoder};
+
+use crate::MessageLite;
+
+/// A codec for length-delimited messages.
+///
+/// Decoded messages are new instances of the same type as the codec's
+/// prototype. Each frame is parsed straight out of the read buffer once it
+/// has arrived in full, and each encoded message is written into the write
+/// buffer's spare capacity, which is reserved up front from the message's
+/// size.
+///
+/// Decoding and encoding fail with an error of kind
+/// [`io::ErrorKind::InvalidData`] if a frame is longer than the codec's
+/// maximum frame length, or if a message cannot be parsed or serialized.
+#[derive(Clone, Copy)]
+pub struct DelimitedCodec<'a> {
+    prototype: &'a dyn MessageLite,
+    max_frame_len: usize,
+}
+
+impl<'a> DelimitedCodec<'a> {
+    /// The default maximum frame length, 8 MiB.
+    pub const DEFAULT_MAX_FRAME_LEN: usize = 8 << 20;
+
+    /// Creates a codec that decodes messages of the same type as
+    /// `prototype`.
+    pub fn new(prototype: &'a dyn MessageLite) -> DelimitedCodec<'a> {
+        DelimitedCodec {
+            prototype,
+            max_frame_len: Self::DEFAULT_MAX_FRAME_LEN,
+        }
+    }
+
+    /// Sets the maximum length of a frame, not counting its length prefix.
+    ///
+    /// The length cannot usefully exceed 2 GiB, the largest message that can
+    /// be parsed.
+    pub fn with_max_frame_len(mut self, max_frame_len: usize) -> DelimitedCodec<'a> {
+        self.max_frame_len = max_frame_len;
+        self
+    }
+
+    /// Returns the maximum length of a frame.
+    pub fn max_frame_len(&self) -> usize {
+        self.max_frame_len
+    }
+}
+
+impl fmt::Debug for DelimitedCodec<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("DelimitedCodec")
+            .field("max_frame_len", &self.max_frame_len)
+            .finish_non_exhaustive()
+    }
+}
+
+impl Decoder for DelimitedCodec<'_> {
+    type Item = Pin<Box<dyn MessageLite>>;
+    type Error = io::Error;
+
+    fn decode(&mut self, src: &mut BytesMut) -> Result<Option<Self::Item>, io::Error> {
+        let mut len = 0;
+        let mut header_len = 0;
+        for (i, &b) in src.iter().take(10).enumerate() {
+            len |= u64::from(b & 0x7f) << (7 * i);
+            if b < 0x80 {
+                header_len = i + 1;
+                break;
+            }
+        }
+        if header_len == 0 {
+            return match src.len() < 10 {
+                true => Ok(None),
+                false => Err(invalid_data("malformed frame length")),
+            };
+        }
+        let len = match usize::try_from(len) {
+            Ok(len) if len <= self.max_frame_len => len,
+            _ => return Err(invalid_data("frame exceeds maximum length")),
+        };
+        if src.len() - header_len < len {
+            src.reserve(header_len + len - src.len());
+            return Ok(None);
+        }
+        let mut message = self.prototype.new();
+        message
+            .as_mut()
+            .parse_from_bytes(&src[header_len..header_len + len])
+            .map_err(|_| invalid_data("failed to parse message"))?;
+        src.advance(header_len + len);
+        Ok(Some(message))
+    }
+}
+
+impl<M> Encoder<&M> for DelimitedCodec<'_>
+where
+    M: MessageLite + ?Sized,
+{
+    type Error = io::Error;
+
+    fn encode(&mut self, item: &M, dst: &mut BytesMut) -> Result<(), io::Error> {
+        if !item.is_initialized() {
+            return Err(invalid_data("message is missing required fields"));
+        }
+        let len = item.byte_size();
+        if len > self.max_frame_len || len > i32::MAX as usize {
+            return Err(invalid_data("frame exceeds maximum length"));
+        }
+        dst.reserve(10 + len);
+        let mut prefix = len as u64;
+        while prefix >= 0x80 {
+            dst.put_u8(prefix as u8 | 0x80);
+            prefix >>= 7;
+        }
+        dst.put_u8(prefix as u8);
+        // SAFETY: `byte_size` has just cached the sizes of the message and
+        // its submessages, which cannot be modified while it is borrowed, and
+        // the encoder initializes exactly `len` bytes of the spare capacity.
+        unsafe {
+            item.serialize_with_cached_sizes_to_uninit_slice(dst.spare_capacity_mut());
+            dst.advance_mut(len);
+        }
+        Ok(())
+    }
+}
+
+impl<M> Encoder<Pin<Box<M>>> for DelimitedCodec<'_>
+where
+    M: MessageLite + ?Sized,
+{
+    type Error = io::Error;
+
+    fn encode(&mut self, item: Pin<Box<M>>, dst: &mut BytesMut) -> Result<(), io::Error> {
+        self.encode(&*item, dst)
+    }
+}
+
+fn invalid_data(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message)
+}
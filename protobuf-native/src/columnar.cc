@@ -0,0 +1,688 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "protobuf-native/src/columnar.h"
+
+#include <algorithm>
+#include <climits>
+
+#include "google/protobuf/wire_format_lite.h"
+#include "protobuf-native/src/columnar.rs.h"
+
+namespace protobuf_native {
+namespace columnar {
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+
+namespace {
+
+// Returns the column type for a singular scalar field, or false if the field
+// cannot be extracted into a column.
+bool ColumnTypeForField(const FieldDescriptor* field, ColumnType* type) {
+    switch (field->cpp_type()) {
+        case FieldDescriptor::CPPTYPE_INT32:
+        case FieldDescriptor::CPPTYPE_INT64:
+        case FieldDescriptor::CPPTYPE_ENUM:
+            *type = kColumnTypeInt64;
+            return true;
+        case FieldDescriptor::CPPTYPE_UINT32:
+        case FieldDescriptor::CPPTYPE_UINT64:
+            *type = kColumnTypeUInt64;
+            return true;
+        case FieldDescriptor::CPPTYPE_FLOAT:
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+            *type = kColumnTypeDouble;
+            return true;
+        case FieldDescriptor::CPPTYPE_BOOL:
+            *type = kColumnTypeBool;
+            return true;
+        case FieldDescriptor::CPPTYPE_STRING:
+            *type = kColumnTypeBytes;
+            return true;
+        case FieldDescriptor::CPPTYPE_MESSAGE:
+            return false;
+    }
+    return false;
+}
+
+template <typename T>
+rust::Slice<const T> AsSlice(const std::vector<T>& v) {
+    return rust::Slice<const T>(v.data(), v.size());
+}
+
+}  // namespace
+
+ColumnarExtractor::ColumnarExtractor(const Descriptor* descriptor) : descriptor_(descriptor) {
+    nodes_.emplace_back();
+    nodes_[0].descriptor = descriptor;
+}
+
+bool ColumnarExtractor::AddColumn(absl::string_view path) {
+    // Adding a column after extraction has begun would leave it short.
+    if (num_rows_ > 0) {
+        return false;
+    }
+    Column column;
+    const Descriptor* descriptor = descriptor_;
+    while (true) {
+        size_t dot = path.find('.');
+        absl::string_view name = path.substr(0, dot);
+        if (descriptor == nullptr) {
+            return false;
+        }
+        const FieldDescriptor* field = descriptor->FindFieldByName(name);
+        if (field == nullptr || field->is_repeated()) {
+            return false;
+        }
+        column.path.push_back(field);
+        if (dot == absl::string_view::npos) {
+            break;
+        }
+        path = path.substr(dot + 1);
+        descriptor = field->message_type();
+    }
+    if (!ColumnTypeForField(column.path.back(), &column.type)) {
+        return false;
+    }
+    if (column.type == kColumnTypeBytes) {
+        column.offsets.push_back(0);
+    }
+    AddWireColumn(column);
+    columns_.push_back(std::move(column));
+    return true;
+}
+
+void ColumnarExtractor::AddWireColumn(Column& column) {
+    int index = columns_.size();
+    int node = 0;
+    for (size_t i = 0; i < column.path.size(); ++i) {
+        const FieldDescriptor* field = column.path[i];
+        if (field->real_containing_oneof() != nullptr && !nodes_[node].track_oneofs) {
+            nodes_[node].track_oneofs = true;
+            nodes_[node].oneof_case.assign(nodes_[node].descriptor->real_oneof_decl_count(), 0);
+        }
+        WireField& wire_field = nodes_[node].fields[field->number()];
+        wire_field.field = field;
+        if (i + 1 == column.path.size()) {
+            wire_field.columns.push_back(index);
+            nodes_[node].columns.push_back(index);
+            column.node = node;
+            break;
+        }
+        if (wire_field.node < 0) {
+            wire_field.node = nodes_.size();
+            nodes_[node].children.push_back(wire_field.node);
+            Node child;
+            child.descriptor = field->message_type();
+            nodes_.push_back(std::move(child));
+        }
+        node = nodes_[node].fields[field->number()].node;
+    }
+    pending_.emplace_back();
+}
+
+bool ColumnarExtractor::ExtractBatch(rust::Slice<const MessageRef> messages) {
+    for (const MessageRef& ref : messages) {
+        if (ref.message.GetDescriptor() != descriptor_) {
+            return false;
+        }
+    }
+    for (Column& column : columns_) {
+        size_t rows = num_rows_ + messages.size();
+        column.validity.reserve((rows + 7) / 8);
+        switch (column.type) {
+            case kColumnTypeInt64:
+                column.int64_values.reserve(rows);
+                break;
+            case kColumnTypeUInt64:
+                column.uint64_values.reserve(rows);
+                break;
+            case kColumnTypeDouble:
+                column.double_values.reserve(rows);
+                break;
+            case kColumnTypeBool:
+                column.bool_values.reserve(rows);
+                break;
+            case kColumnTypeBytes:
+                column.offsets.reserve(rows + 1);
+                break;
+        }
+    }
+    for (const MessageRef& ref : messages) {
+        for (Column& column : columns_) {
+            Append(column, ref.message);
+        }
+        ++num_rows_;
+    }
+    return true;
+}
+
+bool ColumnarExtractor::DecodeBatch(rust::Slice<const uint8_t> data, bool delimited) {
+    if (data.size() > INT_MAX) {
+        return false;
+    }
+    int size = data.size();
+    std::vector<Checkpoint> checkpoints = Save();
+    size_t num_rows = num_rows_;
+
+    CodedInputStream input(data.data(), size);
+    bool ok = true;
+    if (!delimited) {
+        ok = DecodeRow(input);
+    }
+    while (delimited && ok && input.CurrentPosition() < size) {
+        int length;
+        if (!input.ReadVarintSizeAsInt(&length) || length > size - input.CurrentPosition()) {
+            ok = false;
+            break;
+        }
+        CodedInputStream::Limit limit = input.PushLimit(length);
+        ok = DecodeRow(input);
+        input.PopLimit(limit);
+    }
+    if (!ok) {
+        Restore(checkpoints, num_rows);
+    }
+    return ok;
+}
+
+bool ColumnarExtractor::DecodeRow(CodedInputStream& input) {
+    ResetNode(0);
+    if (!DecodeMessage(input, 0, 0)) {
+        return false;
+    }
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        Column& column = columns_[i];
+        const Pending& pending = pending_[i];
+        // Like reflection, a field without presence is never null once its
+        // containing message is present, even if the field is not on the wire.
+        if (!pending.seen &&
+            (!nodes_[column.node].present || column.path.back()->has_presence())) {
+            AppendNull(column);
+            continue;
+        }
+        AppendValidity(column, true);
+        switch (column.type) {
+            case kColumnTypeInt64:
+                column.int64_values.push_back(pending.seen ? pending.int64_value : 0);
+                break;
+            case kColumnTypeUInt64:
+                column.uint64_values.push_back(pending.seen ? pending.uint64_value : 0);
+                break;
+            case kColumnTypeDouble:
+                column.double_values.push_back(pending.seen ? pending.double_value : 0);
+                break;
+            case kColumnTypeBool:
+                column.bool_values.push_back(pending.seen && pending.bool_value);
+                break;
+            case kColumnTypeBytes:
+                if (pending.seen) {
+                    column.data.insert(column.data.end(), pending.bytes_value.begin(),
+                                       pending.bytes_value.end());
+                }
+                column.offsets.push_back(column.data.size());
+                break;
+        }
+    }
+    ++num_rows_;
+    return true;
+}
+
+bool ColumnarExtractor::DecodeMessage(CodedInputStream& input, int node_index, int end_group) {
+    Node& node = nodes_[node_index];
+    node.present = true;
+    while (true) {
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return end_group == 0 && input.ConsumedEntireMessage();
+        }
+        int number = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType wire_type = WireFormatLite::GetTagWireType(tag);
+        if (wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+            return end_group != 0 && number == end_group;
+        }
+
+        // Fields outside the projection are only looked up when they might
+        // clear a projected member of the same oneof.
+        auto it = node.fields.find(number);
+        const FieldDescriptor* field = nullptr;
+        if (it != node.fields.end()) {
+            field = it->second.field;
+        } else if (node.track_oneofs) {
+            field = node.descriptor->FindFieldByNumber(number);
+        }
+        // A field with an unexpected wire type is an unknown field.
+        if (field != nullptr &&
+            wire_type != WireFormatLite::WireTypeForFieldType(
+                             static_cast<WireFormatLite::FieldType>(field->type()))) {
+            field = nullptr;
+        }
+        if (field != nullptr && field->real_containing_oneof() != nullptr && node.track_oneofs) {
+            SetOneofCase(node, field);
+        }
+        if (field == nullptr || it == node.fields.end()) {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+            continue;
+        }
+
+        const WireField& wire_field = it->second;
+        if (wire_field.node < 0) {
+            if (!DecodeValue(input, wire_field)) {
+                return false;
+            }
+        } else if (field->type() == FieldDescriptor::TYPE_GROUP) {
+            if (!input.IncrementRecursionDepth() || !DecodeMessage(input, wire_field.node, number)) {
+                return false;
+            }
+            input.DecrementRecursionDepth();
+        } else {
+            int length;
+            if (!input.ReadVarintSizeAsInt(&length)) {
+                return false;
+            }
+            std::pair<CodedInputStream::Limit, int> limit =
+                input.IncrementRecursionDepthAndPushLimit(length);
+            if (limit.second < 0 || !DecodeMessage(input, wire_field.node, 0) ||
+                !input.DecrementRecursionDepthAndPopLimit(limit.first)) {
+                return false;
+            }
+        }
+    }
+}
+
+bool ColumnarExtractor::DecodeValue(CodedInputStream& input, const WireField& wire_field) {
+    const FieldDescriptor* field = wire_field.field;
+    Pending& pending = pending_[wire_field.columns.front()];
+    bool ok = false;
+    switch (field->type()) {
+        case FieldDescriptor::TYPE_INT32: {
+            int32_t value;
+            ok = WireFormatLite::ReadPrimitive<int32_t, WireFormatLite::TYPE_INT32>(&input, &value);
+            pending.int64_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_SINT32: {
+            int32_t value;
+            ok = WireFormatLite::ReadPrimitive<int32_t, WireFormatLite::TYPE_SINT32>(&input, &value);
+            pending.int64_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_SFIXED32: {
+            int32_t value;
+            ok = WireFormatLite::ReadPrimitive<int32_t, WireFormatLite::TYPE_SFIXED32>(&input,
+                                                                                     &value);
+            pending.int64_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_INT64:
+            ok = WireFormatLite::ReadPrimitive<int64_t, WireFormatLite::TYPE_INT64>(
+                &input, &pending.int64_value);
+            break;
+        case FieldDescriptor::TYPE_SINT64:
+            ok = WireFormatLite::ReadPrimitive<int64_t, WireFormatLite::TYPE_SINT64>(
+                &input, &pending.int64_value);
+            break;
+        case FieldDescriptor::TYPE_SFIXED64:
+            ok = WireFormatLite::ReadPrimitive<int64_t, WireFormatLite::TYPE_SFIXED64>(
+                &input, &pending.int64_value);
+            break;
+        case FieldDescriptor::TYPE_UINT32: {
+            uint32_t value;
+            ok = WireFormatLite::ReadPrimitive<uint32_t, WireFormatLite::TYPE_UINT32>(&input,
+                                                                                    &value);
+            pending.uint64_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_FIXED32: {
+            uint32_t value;
+            ok = WireFormatLite::ReadPrimitive<uint32_t, WireFormatLite::TYPE_FIXED32>(&input,
+                                                                                     &value);
+            pending.uint64_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_UINT64:
+            ok = WireFormatLite::ReadPrimitive<uint64_t, WireFormatLite::TYPE_UINT64>(
+                &input, &pending.uint64_value);
+            break;
+        case FieldDescriptor::TYPE_FIXED64:
+            ok = WireFormatLite::ReadPrimitive<uint64_t, WireFormatLite::TYPE_FIXED64>(
+                &input, &pending.uint64_value);
+            break;
+        case FieldDescriptor::TYPE_FLOAT: {
+            float value;
+            ok = WireFormatLite::ReadPrimitive<float, WireFormatLite::TYPE_FLOAT>(&input, &value);
+            pending.double_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_DOUBLE:
+            ok = WireFormatLite::ReadPrimitive<double, WireFormatLite::TYPE_DOUBLE>(
+                &input, &pending.double_value);
+            break;
+        case FieldDescriptor::TYPE_BOOL:
+            ok = WireFormatLite::ReadPrimitive<bool, WireFormatLite::TYPE_BOOL>(
+                &input, &pending.bool_value);
+            break;
+        case FieldDescriptor::TYPE_ENUM: {
+            int value;
+            ok = WireFormatLite::ReadPrimitive<int, WireFormatLite::TYPE_ENUM>(&input, &value);
+            // Unknown values of closed enums are unknown fields.
+            if (ok && field->legacy_enum_field_treated_as_closed() &&
+                field->enum_type()->FindValueByNumber(value) == nullptr) {
+                return true;
+            }
+            pending.int64_value = value;
+            break;
+        }
+        case FieldDescriptor::TYPE_STRING:
+        case FieldDescriptor::TYPE_BYTES:
+            ok = WireFormatLite::ReadBytes(&input, &pending.bytes_value);
+            if (ok && field->requires_utf8_validation()) {
+                ok = WireFormatLite::VerifyUtf8String(
+                    pending.bytes_value.data(), pending.bytes_value.size(),
+                    WireFormatLite::PARSE, field->full_name().c_str());
+            }
+            break;
+        case FieldDescriptor::TYPE_GROUP:
+        case FieldDescriptor::TYPE_MESSAGE:
+            break;
+    }
+    if (!ok) {
+        return false;
+    }
+    pending.seen = true;
+    for (size_t i = 1; i < wire_field.columns.size(); ++i) {
+        pending_[wire_field.columns[i]] = pending;
+    }
+    return true;
+}
+
+void ColumnarExtractor::SetOneofCase(Node& node, const FieldDescriptor* field) {
+    int& oneof_case = node.oneof_case[field->real_containing_oneof()->index()];
+    if (oneof_case != 0 && oneof_case != field->number()) {
+        auto it = node.fields.find(oneof_case);
+        if (it != node.fields.end()) {
+            for (int column : it->second.columns) {
+                pending_[column].seen = false;
+            }
+            if (it->second.node >= 0) {
+                ResetNode(it->second.node);
+            }
+        }
+    }
+    oneof_case = field->number();
+}
+
+void ColumnarExtractor::ResetNode(int node_index) {
+    Node& node = nodes_[node_index];
+    node.present = false;
+    std::fill(node.oneof_case.begin(), node.oneof_case.end(), 0);
+    for (int column : node.columns) {
+        pending_[column].seen = false;
+    }
+    for (int child : node.children) {
+        ResetNode(child);
+    }
+}
+
+std::vector<ColumnarExtractor::Checkpoint> ColumnarExtractor::Save() const {
+    std::vector<Checkpoint> checkpoints;
+    checkpoints.reserve(columns_.size());
+    for (const Column& column : columns_) {
+        Checkpoint checkpoint;
+        checkpoint.validity = column.validity.size();
+        checkpoint.null_count = column.null_count;
+        checkpoint.data = column.data.size();
+        switch (column.type) {
+            case kColumnTypeInt64:
+                checkpoint.values = column.int64_values.size();
+                break;
+            case kColumnTypeUInt64:
+                checkpoint.values = column.uint64_values.size();
+                break;
+            case kColumnTypeDouble:
+                checkpoint.values = column.double_values.size();
+                break;
+            case kColumnTypeBool:
+                checkpoint.values = column.bool_values.size();
+                break;
+            case kColumnTypeBytes:
+                checkpoint.values = column.offsets.size();
+                break;
+        }
+        checkpoints.push_back(checkpoint);
+    }
+    return checkpoints;
+}
+
+void ColumnarExtractor::Restore(const std::vector<Checkpoint>& checkpoints, size_t num_rows) {
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        Column& column = columns_[i];
+        const Checkpoint& checkpoint = checkpoints[i];
+        column.validity.resize(checkpoint.validity);
+        if (num_rows % 8 != 0) {
+            column.validity.back() &= (1 << (num_rows % 8)) - 1;
+        }
+        column.null_count = checkpoint.null_count;
+        column.data.resize(checkpoint.data);
+        switch (column.type) {
+            case kColumnTypeInt64:
+                column.int64_values.resize(checkpoint.values);
+                break;
+            case kColumnTypeUInt64:
+                column.uint64_values.resize(checkpoint.values);
+                break;
+            case kColumnTypeDouble:
+                column.double_values.resize(checkpoint.values);
+                break;
+            case kColumnTypeBool:
+                column.bool_values.resize(checkpoint.values);
+                break;
+            case kColumnTypeBytes:
+                column.offsets.resize(checkpoint.values);
+                break;
+        }
+    }
+    num_rows_ = num_rows;
+}
+
+void ColumnarExtractor::Append(Column& column, const Message& root) {
+    const Message* message = &root;
+    for (size_t i = 0; i + 1 < column.path.size(); ++i) {
+        const Reflection* reflection = message->GetReflection();
+        if (!reflection->HasField(*message, column.path[i])) {
+            AppendNull(column);
+            return;
+        }
+        message = &reflection->GetMessage(*message, column.path[i]);
+    }
+
+    const FieldDescriptor* field = column.path.back();
+    const Reflection* reflection = message->GetReflection();
+    // Fields without presence, like proto3 scalars, are never null.
+    if (field->has_presence() && !reflection->HasField(*message, field)) {
+        AppendNull(column);
+        return;
+    }
+    AppendValidity(column, true);
+    switch (field->cpp_type()) {
+        case FieldDescriptor::CPPTYPE_INT32:
+            column.int64_values.push_back(reflection->GetInt32(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_INT64:
+            column.int64_values.push_back(reflection->GetInt64(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_ENUM:
+            column.int64_values.push_back(reflection->GetEnumValue(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_UINT32:
+            column.uint64_values.push_back(reflection->GetUInt32(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_UINT64:
+            column.uint64_values.push_back(reflection->GetUInt64(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_FLOAT:
+            column.double_values.push_back(reflection->GetFloat(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+            column.double_values.push_back(reflection->GetDouble(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_BOOL:
+            column.bool_values.push_back(reflection->GetBool(*message, field));
+            break;
+        case FieldDescriptor::CPPTYPE_STRING: {
+            const std::string& value = reflection->GetStringReference(*message, field, &scratch_);
+            column.data.insert(column.data.end(), value.begin(), value.end());
+            column.offsets.push_back(column.data.size());
+            break;
+        }
+        case FieldDescriptor::CPPTYPE_MESSAGE:
+            break;
+    }
+}
+
+void ColumnarExtractor::AppendNull(Column& column) {
+    AppendValidity(column, false);
+    ++column.null_count;
+    switch (column.type) {
+        case kColumnTypeInt64:
+            column.int64_values.push_back(0);
+            break;
+        case kColumnTypeUInt64:
+            column.uint64_values.push_back(0);
+            break;
+        case kColumnTypeDouble:
+            column.double_values.push_back(0);
+            break;
+        case kColumnTypeBool:
+            column.bool_values.push_back(0);
+            break;
+        case kColumnTypeBytes:
+            column.offsets.push_back(column.data.size());
+            break;
+    }
+}
+
+void ColumnarExtractor::AppendValidity(Column& column, bool valid) {
+    if (num_rows_ % 8 == 0) {
+        column.validity.push_back(0);
+    }
+    if (valid) {
+        column.validity.back() |= 1 << (num_rows_ % 8);
+    }
+}
+
+void ColumnarExtractor::Clear() {
+    for (Column& column : columns_) {
+        column.validity.clear();
+        column.null_count = 0;
+        column.int64_values.clear();
+        column.uint64_values.clear();
+        column.double_values.clear();
+        column.bool_values.clear();
+        column.data.clear();
+        if (column.type == kColumnTypeBytes) {
+            column.offsets.assign(1, 0);
+        }
+    }
+    num_rows_ = 0;
+}
+
+size_t ColumnarExtractor::NumRows() const { return num_rows_; }
+
+size_t ColumnarExtractor::NumColumns() const { return columns_.size(); }
+
+int ColumnarExtractor::Type(size_t column) const { return columns_.at(column).type; }
+
+size_t ColumnarExtractor::NullCount(size_t column) const { return columns_.at(column).null_count; }
+
+rust::Slice<const uint8_t> ColumnarExtractor::Validity(size_t column) const {
+    return AsSlice(columns_.at(column).validity);
+}
+
+rust::Slice<const int64_t> ColumnarExtractor::Int64Values(size_t column) const {
+    return AsSlice(columns_.at(column).int64_values);
+}
+
+rust::Slice<const uint64_t> ColumnarExtractor::UInt64Values(size_t column) const {
+    return AsSlice(columns_.at(column).uint64_values);
+}
+
+rust::Slice<const double> ColumnarExtractor::DoubleValues(size_t column) const {
+    return AsSlice(columns_.at(column).double_values);
+}
+
+rust::Slice<const uint8_t> ColumnarExtractor::BoolValues(size_t column) const {
+    return AsSlice(columns_.at(column).bool_values);
+}
+
+rust::Slice<const int64_t> ColumnarExtractor::Offsets(size_t column) const {
+    return AsSlice(columns_.at(column).offsets);
+}
+
+rust::Slice<const uint8_t> ColumnarExtractor::Data(size_t column) const {
+    return AsSlice(columns_.at(column).data);
+}
+
+bool PresenceBitmaps(rust::Slice<const MessageRef> messages, rust::Slice<const FieldRef> fields,
+                     rust::Slice<uint8_t> bitmaps, size_t stride) {
+    if (messages.empty() || fields.empty()) {
+        return true;
+    }
+    const Descriptor* descriptor = messages[0].message.GetDescriptor();
+    for (const FieldRef& ref : fields) {
+        if (ref.field.containing_type() != descriptor) {
+            return false;
+        }
+    }
+    for (const MessageRef& ref : messages) {
+        if (ref.message.GetDescriptor() != descriptor) {
+            return false;
+        }
+    }
+    if (bitmaps.size() < fields.size() * stride || stride < (messages.size() + 7) / 8) {
+        return false;
+    }
+    // With the types checked up front, `HasField` reduces to reading the
+    // message's has-bit for each field that has one.
+    for (size_t row = 0; row < messages.size(); ++row) {
+        const Message& message = messages[row].message;
+        const Reflection* reflection = message.GetReflection();
+        uint8_t* byte = bitmaps.data() + row / 8;
+        uint8_t bit = 1 << (row % 8);
+        for (const FieldRef& ref : fields) {
+            bool present = ref.field.is_repeated()
+                               ? reflection->FieldSize(message, &ref.field) > 0
+                               : reflection->HasField(message, &ref.field);
+            if (present) {
+                *byte |= bit;
+            }
+            byte += stride;
+        }
+    }
+    return true;
+}
+
+ColumnarExtractor* NewColumnarExtractor(const Descriptor* descriptor) {
+    return new ColumnarExtractor(descriptor);
+}
+
+void DeleteColumnarExtractor(ColumnarExtractor* extractor) { delete extractor; }
+
+}  // namespace columnar
+}  // namespace protobuf_native
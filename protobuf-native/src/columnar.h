@@ -0,0 +1,174 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/message.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace columnar {
+
+using namespace google::protobuf;
+
+struct FieldRef;
+struct MessageRef;
+
+// The physical type of a column. Must be kept in sync with `ColumnType` in
+// columnar.rs.
+enum ColumnType : int {
+    kColumnTypeInt64 = 0,
+    kColumnTypeUInt64 = 1,
+    kColumnTypeDouble = 2,
+    kColumnTypeBool = 3,
+    kColumnTypeBytes = 4,
+};
+
+// Extracts singular scalar fields from messages of a single type into
+// columnar buffers.
+//
+// The field path for each column is resolved to a chain of field descriptors
+// once, when the column is added, so that extraction performs no lookups by
+// name.
+//
+// Columns can be filled either from parsed messages, via reflection, or
+// directly from the wire format, in which case the paths of all columns are
+// compiled into a tree of field numbers and every field outside the tree is
+// skipped without being decoded.
+class ColumnarExtractor {
+   public:
+    ColumnarExtractor(const Descriptor* descriptor);
+
+    bool AddColumn(absl::string_view path);
+    bool ExtractBatch(rust::Slice<const MessageRef> messages);
+    bool DecodeBatch(rust::Slice<const uint8_t> data, bool delimited);
+    void Clear();
+
+    size_t NumRows() const;
+    size_t NumColumns() const;
+    int Type(size_t column) const;
+    size_t NullCount(size_t column) const;
+    rust::Slice<const uint8_t> Validity(size_t column) const;
+    rust::Slice<const int64_t> Int64Values(size_t column) const;
+    rust::Slice<const uint64_t> UInt64Values(size_t column) const;
+    rust::Slice<const double> DoubleValues(size_t column) const;
+    rust::Slice<const uint8_t> BoolValues(size_t column) const;
+    rust::Slice<const int64_t> Offsets(size_t column) const;
+    rust::Slice<const uint8_t> Data(size_t column) const;
+
+   private:
+    struct Column {
+        // The path from the root message to the leaf field. All but the last
+        // field are singular message fields.
+        std::vector<const FieldDescriptor*> path;
+        ColumnType type;
+        // A bitmap with one bit per row, least significant bit first, in which
+        // set bits indicate non-null values.
+        std::vector<uint8_t> validity;
+        size_t null_count = 0;
+        std::vector<int64_t> int64_values;
+        std::vector<uint64_t> uint64_values;
+        std::vector<double> double_values;
+        std::vector<uint8_t> bool_values;
+        // For bytes columns, value `i` is `data[offsets[i]..offsets[i + 1]]`.
+        std::vector<int64_t> offsets;
+        std::vector<uint8_t> data;
+        // The index of the node in `nodes_` for the message containing the
+        // leaf field.
+        int node;
+    };
+
+    // A field of interest to the wire decoder.
+    struct WireField {
+        const FieldDescriptor* field;
+        // The columns for this field, if it is a leaf.
+        std::vector<int> columns;
+        // The index of the node in `nodes_` for this field, if it is a message
+        // along the path to some leaf, or -1.
+        int node = -1;
+    };
+
+    // A message type along the paths of the columns, keyed by field number.
+    struct Node {
+        const Descriptor* descriptor;
+        absl::flat_hash_map<int, WireField> fields;
+        // The columns whose leaf fields are direct children of this node.
+        std::vector<int> columns;
+        std::vector<int> children;
+        // Whether any field in `fields` belongs to a oneof, in which case
+        // setting any other member of that oneof must clear it.
+        bool track_oneofs = false;
+
+        // Decoding state for the current row.
+        bool present = false;
+        std::vector<int> oneof_case;
+    };
+
+    // The last value for a column seen in the wire format of the current row.
+    struct Pending {
+        bool seen = false;
+        int64_t int64_value = 0;
+        uint64_t uint64_value = 0;
+        double double_value = 0;
+        bool bool_value = false;
+        std::string bytes_value;
+    };
+
+    // The lengths of a column's buffers, for rolling back a failed batch.
+    struct Checkpoint {
+        size_t validity;
+        size_t null_count;
+        size_t values;
+        size_t data;
+    };
+
+    void AddWireColumn(Column& column);
+    void Append(Column& column, const Message& message);
+    void AppendNull(Column& column);
+    void AppendValidity(Column& column, bool valid);
+    bool DecodeRow(google::protobuf::io::CodedInputStream& input);
+    bool DecodeMessage(google::protobuf::io::CodedInputStream& input, int node, int end_group);
+    bool DecodeValue(google::protobuf::io::CodedInputStream& input, const WireField& field);
+    void SetOneofCase(Node& node, const FieldDescriptor* field);
+    void ResetNode(int node);
+    std::vector<Checkpoint> Save() const;
+    void Restore(const std::vector<Checkpoint>& checkpoints, size_t num_rows);
+
+    const Descriptor* descriptor_;
+    std::vector<Column> columns_;
+    std::vector<Node> nodes_;
+    std::vector<Pending> pending_;
+    size_t num_rows_ = 0;
+    std::string scratch_;
+};
+
+// Writes one bitmap per field to `bitmaps`, with one bit per message, in
+// which set bits indicate that the field is present in the message. Bitmap
+// `i` starts at byte `i * stride`, and `bitmaps` must be zeroed.
+bool PresenceBitmaps(rust::Slice<const MessageRef> messages, rust::Slice<const FieldRef> fields,
+                     rust::Slice<uint8_t> bitmaps, size_t stride);
+
+ColumnarExtractor* NewColumnarExtractor(const Descriptor* descriptor);
+void DeleteColumnarExtractor(ColumnarExtractor*);
+
+}  // namespace columnar
+}  // namespace protobuf_native
@@ -0,0 +1,391 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Extraction of message fields into columnar buffers.
+//!
+//! A [`ColumnarExtractor`] transposes a batch of messages of a single type
+//! into one buffer per field, in the layout used by [Apache Arrow]: values are
+//! stored contiguously, strings and bytes as an offsets buffer plus a data
+//! buffer, and a validity bitmap records which values are present. Field paths
+//! are resolved to field descriptors once, when a column is added, so that
+//! extraction walks each message via reflection without any lookups by name.
+//!
+//! Columns can also be decoded directly from the wire format, without
+//! materializing any messages at all. This is much faster than parsing when
+//! only a few fields of a large message are of interest, as every field that
+//! is not along the path to some column is skipped without being decoded.
+//!
+//! [Apache Arrow]: https://arrow.apache.org/docs/format/Columnar.html
+
+use std::marker::{PhantomData, PhantomPinned};
+use std::mem;
+use std::pin::Pin;
+
+use crate::internal::{unsafe_ffi_conversions, BoolExt};
+use crate::{private, Descriptor, FieldDescriptor, Message, OperationFailedError};
+
+#[cxx::bridge(namespace = "protobuf_native::columnar")]
+pub(crate) mod ffi {
+    struct MessageRef<'a> {
+        message: &'a Message,
+    }
+
+    struct FieldRef<'a> {
+        field: &'a FieldDescriptor,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/columnar.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "protobuf_native::internal"]
+        type CInt = crate::internal::CInt;
+
+        #[namespace = "absl"]
+        type string_view<'a> = crate::internal::StringView<'a>;
+
+        #[namespace = "google::protobuf"]
+        type Descriptor = crate::ffi::Descriptor;
+
+        #[namespace = "google::protobuf"]
+        type FieldDescriptor = crate::ffi::FieldDescriptor;
+
+        #[namespace = "google::protobuf"]
+        type Message = crate::ffi::Message;
+
+        type ColumnarExtractor;
+        unsafe fn NewColumnarExtractor(descriptor: *const Descriptor) -> *mut ColumnarExtractor;
+        unsafe fn DeleteColumnarExtractor(extractor: *mut ColumnarExtractor);
+        fn AddColumn(self: Pin<&mut ColumnarExtractor>, path: string_view) -> bool;
+        fn ExtractBatch(self: Pin<&mut ColumnarExtractor>, messages: &[MessageRef]) -> bool;
+        fn DecodeBatch(self: Pin<&mut ColumnarExtractor>, data: &[u8], delimited: bool) -> bool;
+        fn Clear(self: Pin<&mut ColumnarExtractor>);
+        fn NumRows(self: &ColumnarExtractor) -> usize;
+        fn NumColumns(self: &ColumnarExtractor) -> usize;
+        fn Type(self: &ColumnarExtractor, column: usize) -> CInt;
+        fn NullCount(self: &ColumnarExtractor, column: usize) -> usize;
+        fn Validity(self: &ColumnarExtractor, column: usize) -> &[u8];
+        fn Int64Values(self: &ColumnarExtractor, column: usize) -> &[i64];
+        fn UInt64Values(self: &ColumnarExtractor, column: usize) -> &[u64];
+        fn DoubleValues(self: &ColumnarExtractor, column: usize) -> &[f64];
+        fn BoolValues(self: &ColumnarExtractor, column: usize) -> &[u8];
+        fn Offsets(self: &ColumnarExtractor, column: usize) -> &[i64];
+        fn Data(self: &ColumnarExtractor, column: usize) -> &[u8];
+
+        fn PresenceBitmaps(
+            messages: &[MessageRef],
+            fields: &[FieldRef],
+            bitmaps: &mut [u8],
+            stride: usize,
+        ) -> bool;
+    }
+}
+
+/// The physical type of a column.
+///
+/// Signed integers and enums are widened to [`ColumnType::Int64`], unsigned
+/// integers to [`ColumnType::UInt64`], and floats to [`ColumnType::Double`].
+/// Both `string` and `bytes` fields are extracted as [`ColumnType::Bytes`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ColumnType {
+    /// 64-bit signed integers.
+    Int64,
+    /// 64-bit unsigned integers.
+    UInt64,
+    /// 64-bit floating point numbers.
+    Double,
+    /// Booleans.
+    Bool,
+    /// Variable-length byte strings.
+    Bytes,
+}
+
+/// The values of a column extracted by a [`ColumnarExtractor`].
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum ColumnValues<'a> {
+    /// The values of an [`ColumnType::Int64`] column.
+    Int64(&'a [i64]),
+    /// The values of an [`ColumnType::UInt64`] column.
+    UInt64(&'a [u64]),
+    /// The values of an [`ColumnType::Double`] column.
+    Double(&'a [f64]),
+    /// The values of an [`ColumnType::Bool`] column.
+    Bool(&'a [bool]),
+    /// The values of an [`ColumnType::Bytes`] column.
+    ///
+    /// Value `i` is `data[offsets[i]..offsets[i + 1]]`. There is one more
+    /// offset than there are rows.
+    Bytes {
+        /// The offsets of each value in `data`.
+        offsets: &'a [i64],
+        /// The concatenated values.
+        data: &'a [u8],
+    },
+}
+
+/// A column extracted by a [`ColumnarExtractor`].
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Column<'a> {
+    /// The values in the column.
+    ///
+    /// Null rows hold a zero or empty value.
+    pub values: ColumnValues<'a>,
+    /// A bitmap with one bit per row, least significant bit first, in which
+    /// set bits indicate non-null values.
+    pub validity: &'a [u8],
+    /// The number of null rows.
+    pub null_count: usize,
+}
+
+impl<'a> Column<'a> {
+    /// Reports whether the value in the specified row is non-null.
+    pub fn is_valid(&self, row: usize) -> bool {
+        self.validity[row / 8] & (1 << (row % 8)) != 0
+    }
+}
+
+/// Extracts fields from batches of messages into columnar buffers.
+///
+/// Each column is identified by a path of field names separated by periods,
+/// like `address.city`, which is resolved against the extractor's message
+/// type when the column is added. Every field in the path must be singular,
+/// all but the last must be message fields, and the last must be a scalar,
+/// string, or bytes field.
+///
+/// A row is null in a column if any message along the path is not set, or if
+/// the leaf field tracks presence and is not set. Fields without presence,
+/// like proto3 scalar fields, are never null.
+///
+/// Buffers accumulate across calls to [`extract`] until [`clear`] is called,
+/// which retains their allocations for reuse by the next batch.
+///
+/// [`extract`]: ColumnarExtractor::extract
+/// [`clear`]: ColumnarExtractor::clear
+pub struct ColumnarExtractor<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for ColumnarExtractor<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteColumnarExtractor(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> ColumnarExtractor<'a> {
+    /// Creates a new extractor for messages of the specified type.
+    pub fn new(descriptor: &'a Descriptor) -> Pin<Box<ColumnarExtractor<'a>>> {
+        let extractor = unsafe { ffi::NewColumnarExtractor(descriptor.as_ffi()) };
+        unsafe { Self::from_ffi_owned(extractor) }
+    }
+
+    /// Adds a column for the field at the specified path, returning the index
+    /// of the new column.
+    ///
+    /// Returns an error if the path does not name an extractable field, or if
+    /// any rows have already been extracted.
+    pub fn add_column(self: Pin<&mut Self>, path: &str) -> Result<usize, OperationFailedError> {
+        let index = self.num_columns();
+        self.as_ffi_mut().AddColumn(path.into()).as_result()?;
+        Ok(index)
+    }
+
+    /// Appends one row per message to each column.
+    ///
+    /// Returns an error, without extracting any rows, if any message is not of
+    /// the extractor's message type.
+    pub fn extract(
+        self: Pin<&mut Self>,
+        messages: &[&dyn Message],
+    ) -> Result<(), OperationFailedError> {
+        let messages: Vec<_> = messages
+            .iter()
+            .map(|m| ffi::MessageRef {
+                message: unsafe { mem::transmute(private::MessageLite::upcast(*m)) },
+            })
+            .collect();
+        self.as_ffi_mut().ExtractBatch(&messages).as_result()
+    }
+
+    /// Decodes one row from the wire format of a single message.
+    ///
+    /// The result is the same as parsing the message and passing it to
+    /// [`extract`], except that only the fields along the paths of the columns
+    /// are decoded; all other fields are skipped.
+    ///
+    /// Returns an error, without extracting any rows, if the input is not a
+    /// valid protocol buffer. Malformed data within skipped fields is not
+    /// necessarily detected.
+    ///
+    /// [`extract`]: ColumnarExtractor::extract
+    pub fn decode(self: Pin<&mut Self>, data: &[u8]) -> Result<(), OperationFailedError> {
+        self.as_ffi_mut().DecodeBatch(data, false).as_result()
+    }
+
+    /// Decodes one row per message from a buffer of length-delimited
+    /// messages, like that produced by [`serialize_batch`] or a
+    /// [`DelimitedWriter`].
+    ///
+    /// Returns an error, without extracting any rows, if any message is not a
+    /// valid protocol buffer.
+    ///
+    /// [`serialize_batch`]: crate::serialize_batch
+    /// [`DelimitedWriter`]: crate::io::DelimitedWriter
+    pub fn decode_delimited(self: Pin<&mut Self>, data: &[u8]) -> Result<(), OperationFailedError> {
+        self.as_ffi_mut().DecodeBatch(data, true).as_result()
+    }
+
+    /// Removes all rows from each column, retaining the allocated buffers.
+    pub fn clear(self: Pin<&mut Self>) {
+        self.as_ffi_mut().Clear()
+    }
+
+    /// Returns the number of rows extracted.
+    pub fn num_rows(&self) -> usize {
+        self.as_ffi().NumRows()
+    }
+
+    /// Returns the number of columns.
+    pub fn num_columns(&self) -> usize {
+        self.as_ffi().NumColumns()
+    }
+
+    /// Returns the type of the `i`th column.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `i` is out of bounds.
+    pub fn column_type(&self, i: usize) -> ColumnType {
+        self.check_index(i);
+        match self.as_ffi().Type(i).0 {
+            0 => ColumnType::Int64,
+            1 => ColumnType::UInt64,
+            2 => ColumnType::Double,
+            3 => ColumnType::Bool,
+            4 => ColumnType::Bytes,
+            n => unreachable!("unknown column type {}", n),
+        }
+    }
+
+    /// Returns the `i`th column.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `i` is out of bounds.
+    pub fn column(&self, i: usize) -> Column<'_> {
+        let ffi = self.as_ffi();
+        let values = match self.column_type(i) {
+            ColumnType::Int64 => ColumnValues::Int64(ffi.Int64Values(i)),
+            ColumnType::UInt64 => ColumnValues::UInt64(ffi.UInt64Values(i)),
+            ColumnType::Double => ColumnValues::Double(ffi.DoubleValues(i)),
+            // SAFETY: boolean values are stored as bytes that are either zero
+            // or one.
+            ColumnType::Bool => ColumnValues::Bool(unsafe { mem::transmute(ffi.BoolValues(i)) }),
+            ColumnType::Bytes => ColumnValues::Bytes {
+                offsets: ffi.Offsets(i),
+                data: ffi.Data(i),
+            },
+        };
+        Column {
+            values,
+            validity: ffi.Validity(i),
+            null_count: ffi.NullCount(i),
+        }
+    }
+
+    fn check_index(&self, i: usize) {
+        let len = self.num_columns();
+        if i >= len {
+            panic!(
+                "index out of bounds: the length is {} but the index is {}",
+                len, i
+            );
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::ColumnarExtractor);
+}
+
+/// Computes the presence of each of `fields` in each of `messages` as one
+/// validity bitmap per field.
+///
+/// This replaces `messages.len() * fields.len()` calls to check the presence
+/// of a field with a single call that loops over the batch in C++ and packs
+/// the bits as it goes.
+///
+/// `bitmaps` is cleared and then filled with one bitmap per field, in the
+/// order of `fields`, each `(messages.len() + 7) / 8` bytes long. As in a
+/// [`Column`], bit `i` of a bitmap, least significant bit first, is set if the
+/// field is present in message `i`. A repeated field is present if it is not
+/// empty, and a field without presence, like a proto3 scalar field, if it
+/// does not hold its default value.
+///
+/// Returns an error, leaving `bitmaps` empty, if the messages are not all of
+/// the same type, or if any of `fields` is not a field of that type.
+///
+/// # Examples
+///
+/// ```
+/// # use protobuf_native::{DescriptorPool, DynamicMessageFactory, MessageLite};
+/// # use protobuf_native::compiler::{SourceTreeDescriptorDatabase, VirtualSourceTree};
+/// # use std::path::Path;
+/// # let mut source_tree = VirtualSourceTree::new();
+/// # source_tree.as_mut().add_file(
+/// #     Path::new("test.proto"),
+/// #     b"syntax = \"proto3\"; message Test { optional int32 a = 1; string b = 2; }".to_vec(),
+/// # );
+/// # let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+/// # let fds = db.as_mut().build_file_descriptor_set(&[Path::new("test.proto")])?;
+/// # let mut pool = DescriptorPool::new();
+/// # pool.as_mut().build_file(fds.file(0));
+/// # let descriptor = pool.find_message_type_by_name("Test").unwrap();
+/// # let mut factory = DynamicMessageFactory::new();
+/// # let prototype = factory.as_mut().get_prototype(descriptor);
+/// use protobuf_native::columnar;
+///
+/// let mut a = prototype.new_message();
+/// a.as_mut().parse_from_bytes(b"\x08\x00")?;
+/// let mut b = prototype.new_message();
+/// b.as_mut().parse_from_bytes(b"\x12\x01x")?;
+/// let fields = [descriptor.field(0), descriptor.field(1)];
+/// let mut bitmaps = vec![];
+/// columnar::presence_bitmaps(&[&*a, &*b], &fields, &mut bitmaps)?;
+/// assert_eq!(bitmaps, [0b01, 0b10]);
+/// # Ok::<_, Box<dyn std::error::Error>>(())
+/// ```
+pub fn presence_bitmaps(
+    messages: &[&dyn Message],
+    fields: &[&FieldDescriptor],
+    bitmaps: &mut Vec<u8>,
+) -> Result<(), OperationFailedError> {
+    let stride = (messages.len() + 7) / 8;
+    bitmaps.clear();
+    bitmaps.resize(stride * fields.len(), 0);
+    let messages: Vec<_> = messages
+        .iter()
+        .map(|m| ffi::MessageRef {
+            message: unsafe { mem::transmute(private::MessageLite::upcast(*m)) },
+        })
+        .collect();
+    let fields: Vec<_> = fields
+        .iter()
+        .map(|f| ffi::FieldRef { field: f.as_ffi() })
+        .collect();
+    let ok = ffi::PresenceBitmaps(&messages, &fields, bitmaps, stride);
+    if !ok {
+        bitmaps.clear();
+    }
+    ok.as_result()
+}
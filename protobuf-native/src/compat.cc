@@ -0,0 +1,218 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/compat.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "protobuf-native/src/compat.rs.h"
+#include "protobuf-native/src/util.h"
+
+namespace protobuf_native {
+namespace compat {
+
+namespace {
+
+// Reserved numbers, as half-open ranges sorted by start.
+using Ranges = std::vector<std::pair<int, int>>;
+
+Ranges ReservedRanges(const DescriptorProto& message) {
+    Ranges ranges;
+    ranges.reserve(message.reserved_range_size());
+    for (const auto& range : message.reserved_range()) {
+        ranges.emplace_back(range.start(), range.end());
+    }
+    std::sort(ranges.begin(), ranges.end());
+    return ranges;
+}
+
+// Reports whether every number in [start, end) is in `ranges`.
+bool Covers(const Ranges& ranges, int start, int end) {
+    for (const auto& range : ranges) {
+        if (range.first > start) {
+            break;
+        }
+        start = std::max(start, range.second);
+        if (start >= end) {
+            return true;
+        }
+    }
+    return start >= end;
+}
+
+std::string Join(const std::string& scope, const std::string& name) {
+    return scope.empty() ? name : scope + "." + name;
+}
+
+// Collects the messages of a file, nested ones included, by full name.
+void CollectMessages(const std::string& scope,
+                     const RepeatedPtrField<DescriptorProto>& messages,
+                     std::unordered_map<std::string, const DescriptorProto*>& out) {
+    for (const DescriptorProto& message : messages) {
+        std::string name = Join(scope, message.name());
+        CollectMessages(name, message.nested_type(), out);
+        out.emplace(std::move(name), &message);
+    }
+}
+
+std::string DescribeType(const FieldDescriptorProto& field) {
+    if (field.has_type_name()) {
+        return field.type_name();
+    }
+    return FieldDescriptor::TypeName(static_cast<FieldDescriptor::Type>(field.type()));
+}
+
+std::string LabelName(FieldDescriptorProto::Label label) {
+    switch (label) {
+        case FieldDescriptorProto::LABEL_REQUIRED:
+            return "required";
+        case FieldDescriptorProto::LABEL_REPEATED:
+            return "repeated";
+        default:
+            return "optional";
+    }
+}
+
+class Checker {
+   public:
+    Checker(const std::string& file, rust::Vec<CompatibilityIssue>& issues)
+        : file_(file), issues_(issues) {}
+
+    void CheckMessage(const std::string& name, const DescriptorProto& old_message,
+                      const DescriptorProto& new_message) {
+        std::unordered_map<int, const FieldDescriptorProto*> new_fields;
+        std::unordered_set<std::string> new_field_names;
+        for (const auto& field : new_message.field()) {
+            new_fields.emplace(field.number(), &field);
+            new_field_names.insert(field.name());
+        }
+        Ranges new_reserved = ReservedRanges(new_message);
+
+        for (const auto& old_field : old_message.field()) {
+            std::string field_name = Join(name, old_field.name());
+            auto it = new_fields.find(old_field.number());
+            if (it == new_fields.end()) {
+                if (!Covers(new_reserved, old_field.number(), old_field.number() + 1)) {
+                    Report(CompatibilityIssueKind::FieldRemoved, field_name, old_field.number(),
+                           DescribeType(old_field), "");
+                }
+                continue;
+            }
+            const FieldDescriptorProto& new_field = *it->second;
+            if (old_field.type() != new_field.type() ||
+                old_field.type_name() != new_field.type_name()) {
+                Report(CompatibilityIssueKind::FieldTypeChanged, field_name, old_field.number(),
+                       DescribeType(old_field), DescribeType(new_field));
+            }
+            if (old_field.label() != new_field.label()) {
+                Report(CompatibilityIssueKind::FieldLabelChanged, field_name, old_field.number(),
+                       LabelName(old_field.label()), LabelName(new_field.label()));
+            }
+        }
+
+        for (const auto& range : ReservedRanges(old_message)) {
+            if (Covers(new_reserved, range.first, range.second)) {
+                continue;
+            }
+            bool reused = false;
+            for (const auto& new_field : new_message.field()) {
+                if (new_field.number() >= range.first && new_field.number() < range.second) {
+                    reused = true;
+                    Report(CompatibilityIssueKind::ReservedNumberReused,
+                           Join(name, new_field.name()), new_field.number(), "", "");
+                }
+            }
+            if (!reused) {
+                Report(CompatibilityIssueKind::ReservationRemoved, name, range.first,
+                       std::to_string(range.first) + " to " + std::to_string(range.second - 1),
+                       "");
+            }
+        }
+
+        std::unordered_set<std::string> new_reserved_names(new_message.reserved_name().begin(),
+                                                           new_message.reserved_name().end());
+        for (const std::string& reserved : old_message.reserved_name()) {
+            if (new_reserved_names.count(reserved) != 0) {
+                continue;
+            }
+            if (new_field_names.count(reserved) != 0) {
+                Report(CompatibilityIssueKind::ReservedNameReused, Join(name, reserved), 0, "",
+                       "");
+            } else {
+                Report(CompatibilityIssueKind::ReservationRemoved, name, 0, reserved, "");
+            }
+        }
+    }
+
+    void Report(CompatibilityIssueKind kind, const std::string& element, int number,
+                const std::string& old_value, const std::string& new_value) {
+        issues_.push_back(CompatibilityIssue{kind, rust::String(file_), rust::String(element),
+                                             number, rust::String(old_value),
+                                             rust::String(new_value)});
+    }
+
+   private:
+    const std::string& file_;
+    rust::Vec<CompatibilityIssue>& issues_;
+};
+
+}  // namespace
+
+uint64_t FileFingerprint(const FileDescriptorProto& file) {
+    // Comments and spans do not affect compatibility.
+    static const FieldDescriptor* source_code_info =
+        FileDescriptorProto::descriptor()->FindFieldByName("source_code_info");
+    return util::HashMessageIgnoringField(file, 0, source_code_info);
+}
+
+void CheckFileCompatibility(const FileDescriptorProto& old_file,
+                            const FileDescriptorProto& new_file,
+                            rust::Vec<CompatibilityIssue>& issues) {
+    std::unordered_map<std::string, const DescriptorProto*> new_messages;
+    CollectMessages(new_file.package(), new_file.message_type(), new_messages);
+
+    // The old messages are visited depth first, in declaration order, so
+    // that issues are reported in the order of the old file.
+    Checker checker(new_file.name(), issues);
+    std::vector<std::pair<std::string, const DescriptorProto*>> stack;
+    for (int i = old_file.message_type_size() - 1; i >= 0; i--) {
+        stack.emplace_back(Join(old_file.package(), old_file.message_type(i).name()),
+                           &old_file.message_type(i));
+    }
+    while (!stack.empty()) {
+        std::pair<std::string, const DescriptorProto*> entry = std::move(stack.back());
+        stack.pop_back();
+        const DescriptorProto& old_message = *entry.second;
+        auto it = new_messages.find(entry.first);
+        if (it == new_messages.end()) {
+            // Its nested messages are removed along with it.
+            checker.Report(CompatibilityIssueKind::MessageRemoved, entry.first, 0, "", "");
+            continue;
+        }
+        checker.CheckMessage(entry.first, old_message, *it->second);
+        for (int i = old_message.nested_type_size() - 1; i >= 0; i--) {
+            stack.emplace_back(Join(entry.first, old_message.nested_type(i).name()),
+                               &old_message.nested_type(i));
+        }
+    }
+}
+
+}  // namespace compat
+}  // namespace protobuf_native
@@ -0,0 +1,34 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "google/protobuf/descriptor.pb.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace compat {
+
+using namespace google::protobuf;
+
+struct CompatibilityIssue;
+
+uint64_t FileFingerprint(const FileDescriptorProto& file);
+void CheckFileCompatibility(const FileDescriptorProto& old_file,
+                            const FileDescriptorProto& new_file,
+                            rust::Vec<CompatibilityIssue>& issues);
+
+}  // namespace compat
+}  // namespace protobuf_native
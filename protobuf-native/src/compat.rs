@@ -0,0 +1,314 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Schema compatibility checks between two versions of a set of files.
+//!
+//! A [`CompatibilityChecker`] compares the files of a new
+//! [`FileDescriptorSet`] against those of an old one, typically the last
+//! release, and reports the changes that break the wire compatibility of
+//! their messages: removed files and messages, fields removed without
+//! reserving their numbers, fields whose type or label changed, and
+//! reservations that were dropped or whose numbers or names were reused.
+//!
+//! The checker fingerprints each old file when it is created, ignoring
+//! source code info, so that comments and formatting do not count as
+//! changes. Checking a new set fingerprints its files, skips those whose
+//! fingerprints match, and compares the remaining files on several threads.
+//! As most commits touch few files, checking a large registry costs little
+//! more than fingerprinting it.
+//!
+//! # Examples
+//!
+//! ```
+//! use protobuf_native::compat::CompatibilityChecker;
+//! # use protobuf_native::FileDescriptorSet;
+//! # fn f(old: &FileDescriptorSet, new: &FileDescriptorSet) {
+//!
+//! let checker = CompatibilityChecker::new(old, 8);
+//! for issue in checker.check(new, 8) {
+//!     eprintln!("{}", issue);
+//! }
+//! # }
+//! ```
+
+use std::collections::HashMap;
+use std::fmt;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::thread;
+
+use crate::{FileDescriptorProto, FileDescriptorSet};
+
+#[cxx::bridge(namespace = "protobuf_native::compat")]
+pub(crate) mod ffi {
+    enum CompatibilityIssueKind {
+        FileRemoved,
+        MessageRemoved,
+        FieldRemoved,
+        FieldTypeChanged,
+        FieldLabelChanged,
+        ReservedNumberReused,
+        ReservedNameReused,
+        ReservationRemoved,
+    }
+
+    struct CompatibilityIssue {
+        kind: CompatibilityIssueKind,
+        file: String,
+        element: String,
+        number: i32,
+        old_value: String,
+        new_value: String,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/compat.h");
+
+        #[namespace = "google::protobuf"]
+        type FileDescriptorProto = crate::ffi::FileDescriptorProto;
+
+        fn FileFingerprint(file: &FileDescriptorProto) -> u64;
+        fn CheckFileCompatibility(
+            old_file: &FileDescriptorProto,
+            new_file: &FileDescriptorProto,
+            issues: &mut Vec<CompatibilityIssue>,
+        );
+    }
+}
+
+/// The kind of a [`CompatibilityIssue`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum IssueKind {
+    /// A file was removed.
+    FileRemoved,
+    /// A message was removed, along with any messages nested in it.
+    MessageRemoved,
+    /// A field was removed without reserving its number.
+    FieldRemoved,
+    /// The type of a field changed. The old and new values of the issue are
+    /// the old and new types.
+    FieldTypeChanged,
+    /// The label of a field changed, for example from optional to repeated.
+    /// The old and new values of the issue are the old and new labels.
+    FieldLabelChanged,
+    /// A field uses a number that was reserved.
+    ReservedNumberReused,
+    /// A field uses a name that was reserved.
+    ReservedNameReused,
+    /// A reserved range or name is no longer reserved, but is not in use
+    /// either. The old value of the issue is the range or name.
+    ReservationRemoved,
+}
+
+/// A change between two versions of a file that breaks compatibility.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct CompatibilityIssue {
+    /// The kind of change.
+    pub kind: IssueKind,
+    /// The name of the file.
+    pub file: String,
+    /// The full name of the message or field that changed, or of the message
+    /// whose reservation changed.
+    pub element: String,
+    /// The number of the field that changed, or the first number of the
+    /// reserved range that changed, if any.
+    pub number: Option<i32>,
+    /// The old value of the changed property, if any.
+    pub old_value: String,
+    /// The new value of the changed property, if any.
+    pub new_value: String,
+}
+
+impl From<ffi::CompatibilityIssue> for CompatibilityIssue {
+    fn from(ffi: ffi::CompatibilityIssue) -> CompatibilityIssue {
+        let kind = match ffi.kind {
+            ffi::CompatibilityIssueKind::FileRemoved => IssueKind::FileRemoved,
+            ffi::CompatibilityIssueKind::MessageRemoved => IssueKind::MessageRemoved,
+            ffi::CompatibilityIssueKind::FieldRemoved => IssueKind::FieldRemoved,
+            ffi::CompatibilityIssueKind::FieldTypeChanged => IssueKind::FieldTypeChanged,
+            ffi::CompatibilityIssueKind::FieldLabelChanged => IssueKind::FieldLabelChanged,
+            ffi::CompatibilityIssueKind::ReservedNumberReused => IssueKind::ReservedNumberReused,
+            ffi::CompatibilityIssueKind::ReservedNameReused => IssueKind::ReservedNameReused,
+            ffi::CompatibilityIssueKind::ReservationRemoved => IssueKind::ReservationRemoved,
+            _ => unreachable!("unknown compatibility issue kind"),
+        };
+        CompatibilityIssue {
+            kind,
+            file: ffi.file,
+            element: ffi.element,
+            number: (ffi.number != 0).then_some(ffi.number),
+            old_value: ffi.old_value,
+            new_value: ffi.new_value,
+        }
+    }
+}
+
+impl fmt::Display for CompatibilityIssue {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(f, "{}: ", self.file)?;
+        match self.kind {
+            IssueKind::FileRemoved => write!(f, "file removed"),
+            IssueKind::MessageRemoved => write!(f, "message {} removed", self.element),
+            IssueKind::FieldRemoved => write!(
+                f,
+                "field {} removed without reserving its number",
+                self.element
+            ),
+            IssueKind::FieldTypeChanged => write!(
+                f,
+                "field {} changed type from {} to {}",
+                self.element, self.old_value, self.new_value
+            ),
+            IssueKind::FieldLabelChanged => write!(
+                f,
+                "field {} changed label from {} to {}",
+                self.element, self.old_value, self.new_value
+            ),
+            IssueKind::ReservedNumberReused => {
+                write!(f, "field {} uses a reserved number", self.element)
+            }
+            IssueKind::ReservedNameReused => {
+                write!(f, "field {} uses a reserved name", self.element)
+            }
+            IssueKind::ReservationRemoved => write!(
+                f,
+                "message {} no longer reserves {}",
+                self.element, self.old_value
+            ),
+        }?;
+        if let Some(number) = self.number {
+            write!(f, " (field number {})", number)?;
+        }
+        Ok(())
+    }
+}
+
+/// Computes a fingerprint of `file` that changes whenever its definitions
+/// change, but not when only its source code info does.
+///
+/// Fingerprints are stable across processes, but, as with
+/// [`util::hash_message`](crate::util::hash_message), equal fingerprints do
+/// not guarantee equal files.
+pub fn file_fingerprint(file: &FileDescriptorProto) -> u64 {
+    ffi::FileFingerprint(file.as_ffi())
+}
+
+/// Checks new versions of a set of files for compatibility with the old
+/// versions.
+///
+/// See the [module documentation](self) for details.
+pub struct CompatibilityChecker<'a> {
+    /// The old files, in order, with their fingerprints.
+    files: Vec<(&'a FileDescriptorProto, u64)>,
+    by_name: HashMap<&'a [u8], usize>,
+}
+
+impl<'a> CompatibilityChecker<'a> {
+    /// Creates a checker against the files in `old`, fingerprinting them on
+    /// up to `threads` threads.
+    pub fn new(old: &'a FileDescriptorSet, threads: usize) -> CompatibilityChecker<'a> {
+        let files = old.files();
+        let fingerprints = parallel_map(files, threads, |file| file_fingerprint(file));
+        let files: Vec<_> = files.iter().copied().zip(fingerprints).collect();
+        let by_name = files
+            .iter()
+            .enumerate()
+            .map(|(i, (file, _))| (file.name(), i))
+            .collect();
+        CompatibilityChecker { files, by_name }
+    }
+
+    /// Checks the files in `new` against the old files, on up to `threads`
+    /// threads, returning the issues found.
+    ///
+    /// Issues are reported in the order of the old files, and within each
+    /// file in the order of its old definitions. Files that are new in
+    /// `new` cannot break compatibility and are not checked.
+    pub fn check(&self, new: &FileDescriptorSet, threads: usize) -> Vec<CompatibilityIssue> {
+        let new_files = new.files();
+        let fingerprints = parallel_map(new_files, threads, |file| file_fingerprint(file));
+
+        // The new version of each old file, if it has one.
+        let mut pairs = vec![None; self.files.len()];
+        for (new_file, fingerprint) in new_files.iter().zip(fingerprints) {
+            if let Some(&i) = self.by_name.get(new_file.name()) {
+                pairs[i] = Some((*new_file, fingerprint));
+            }
+        }
+        let jobs: Vec<_> = self
+            .files
+            .iter()
+            .zip(pairs)
+            .filter(|((_, old_fingerprint), new)| {
+                !matches!(new, Some((_, fingerprint)) if fingerprint == old_fingerprint)
+            })
+            .map(|((old_file, _), new)| (*old_file, new.map(|(new_file, _)| new_file)))
+            .collect();
+
+        let issues = parallel_map(&jobs, threads, |(old_file, new_file)| match new_file {
+            Some(new_file) => {
+                let mut issues = vec![];
+                ffi::CheckFileCompatibility(old_file.as_ffi(), new_file.as_ffi(), &mut issues);
+                issues.into_iter().map(CompatibilityIssue::from).collect()
+            }
+            None => vec![CompatibilityIssue {
+                kind: IssueKind::FileRemoved,
+                file: String::from_utf8_lossy(old_file.name()).into_owned(),
+                element: String::new(),
+                number: None,
+                old_value: String::new(),
+                new_value: String::new(),
+            }],
+        });
+        issues.into_iter().flatten().collect()
+    }
+}
+
+/// Applies `f` to each item on up to `threads` threads, returning the
+/// results in order.
+fn parallel_map<T, R, F>(items: &[T], threads: usize, f: F) -> Vec<R>
+where
+    T: Sync,
+    R: Send,
+    F: Fn(&T) -> R + Sync,
+{
+    let threads = threads.clamp(1, items.len().max(1));
+    if threads == 1 {
+        return items.iter().map(f).collect();
+    }
+    let next = AtomicUsize::new(0);
+    let mut results: Vec<_> = thread::scope(|s| {
+        let workers: Vec<_> = (0..threads)
+            .map(|_| {
+                s.spawn(|| {
+                    let mut results = vec![];
+                    loop {
+                        let i = next.fetch_add(1, Ordering::Relaxed);
+                        match items.get(i) {
+                            Some(item) => results.push((i, f(item))),
+                            None => break,
+                        }
+                    }
+                    results
+                })
+            })
+            .collect();
+        workers
+            .into_iter()
+            .flat_map(|worker| worker.join().expect("compatibility thread panicked"))
+            .collect()
+    });
+    results.sort_by_key(|(i, _)| *i);
+    results.into_iter().map(|(_, result)| result).collect()
+}
@@ -15,6 +15,25 @@
 
 #include "protobuf-native/src/compiler.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iterator>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "google/protobuf/compiler/parser.h"
+#include "google/protobuf/io/tokenizer.h"
 #include "protobuf-native/src/compiler.rs.h"
 #include "protobuf-native/src/internal.rs.h"
 
@@ -35,6 +54,11 @@ void SimpleErrorCollector::RecordWarning(absl::string_view filename, int line, i
 
 void SimpleErrorCollector::RecordErrorOrWarning(absl::string_view filename, int line, int column,
                                                 absl::string_view message, bool warning) {
+    // Check the limits before copying anything.
+    if ((warning && ignore_warnings_) || errors_.size() >= max_errors_) {
+        dropped_++;
+        return;
+    }
     errors_.push_back(FileLoadError{.filename = rust::String(filename.data(), filename.size()),
                                     .line = line,
                                     .column = column,
@@ -44,10 +68,45 @@ void SimpleErrorCollector::RecordErrorOrWarning(absl::string_view filename, int
 
 std::vector<FileLoadError>& SimpleErrorCollector::Errors() { return errors_; }
 
+void SimpleErrorCollector::SetMaxErrors(size_t max_errors) { max_errors_ = max_errors; }
+
+void SimpleErrorCollector::SetIgnoreWarnings(bool ignore_warnings) {
+    ignore_warnings_ = ignore_warnings;
+}
+
+size_t SimpleErrorCollector::Dropped() const { return dropped_; }
+
 SimpleErrorCollector* NewSimpleErrorCollector() { return new SimpleErrorCollector(); }
 
 void DeleteSimpleErrorCollector(SimpleErrorCollector* collector) { delete collector; }
 
+namespace {
+
+rust::Slice<const uint8_t> ToSlice(absl::string_view s) {
+    return rust::Slice<const uint8_t>(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+}  // namespace
+
+RustErrorCollector::RustErrorCollector(rust::Box<ErrorCollectorAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+void RustErrorCollector::RecordError(absl::string_view filename, int line, int column,
+                                     absl::string_view message) {
+    adaptor_->record(ToSlice(filename), line, column, ToSlice(message), false);
+}
+
+void RustErrorCollector::RecordWarning(absl::string_view filename, int line, int column,
+                                       absl::string_view message) {
+    adaptor_->record(ToSlice(filename), line, column, ToSlice(message), true);
+}
+
+RustErrorCollector* NewRustErrorCollector(rust::Box<ErrorCollectorAdaptor> adaptor) {
+    return new RustErrorCollector(std::move(adaptor));
+}
+
+void DeleteRustErrorCollector(RustErrorCollector* collector) { delete collector; }
+
 rust::String SourceTreeGetLastErrorMessage(SourceTree& source_tree) {
     return rust::String::lossy(source_tree.GetLastErrorMessage());
 }
@@ -57,7 +116,15 @@ VirtualSourceTree* NewVirtualSourceTree() { return new VirtualSourceTree(); }
 void DeleteVirtualSourceTree(VirtualSourceTree* tree) { delete tree; }
 
 void VirtualSourceTree::AddFile(absl::string_view name, rust::Vec<rust::u8> contents) {
-    files_[std::string(name)] = contents;
+    File& file = files_[std::string(name)];
+    file.owned = std::move(contents);
+    file.shared.reset();
+}
+
+void VirtualSourceTree::AddSharedFile(absl::string_view name, rust::Box<SharedBytes> contents) {
+    File& file = files_[std::string(name)];
+    file.owned.clear();
+    file.shared = std::move(contents);
 }
 
 io::ZeroCopyInputStream* VirtualSourceTree::Open(absl::string_view filename) {
@@ -66,7 +133,11 @@ io::ZeroCopyInputStream* VirtualSourceTree::Open(absl::string_view filename) {
         return nullptr;
     }
     auto& file = entry->second;
-    return new io::ArrayInputStream(file.data(), file.size());
+    if (file.shared.has_value()) {
+        rust::Slice<const rust::u8> contents = (*file.shared)->as_slice();
+        return new io::ArrayInputStream(contents.data(), contents.size());
+    }
+    return new io::ArrayInputStream(file.owned.data(), file.owned.size());
 }
 
 std::string VirtualSourceTree::GetLastErrorMessage() { return "File not found."; }
@@ -74,6 +145,246 @@ std::string VirtualSourceTree::GetLastErrorMessage() { return "File not found.";
 DiskSourceTree* NewDiskSourceTree() { return new DiskSourceTree(); }
 void DeleteDiskSourceTree(DiskSourceTree* tree) { delete tree; }
 
+RustSourceTree::RustSourceTree(rust::Box<SourceTreeAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+io::ZeroCopyInputStream* RustSourceTree::Open(absl::string_view filename) {
+    rust::String error;
+    io::ZeroCopyInputStream* stream = adaptor_->open(ToSlice(filename), error);
+    if (stream == nullptr) {
+        last_error_message_ = std::string(error);
+    }
+    return stream;
+}
+
+std::string RustSourceTree::GetLastErrorMessage() { return last_error_message_; }
+
+RustSourceTree* NewRustSourceTree(rust::Box<SourceTreeAdaptor> adaptor) {
+    return new RustSourceTree(std::move(adaptor));
+}
+
+void DeleteRustSourceTree(RustSourceTree* tree) { delete tree; }
+
+CachingSourceTree::CachingSourceTree(SourceTree* source_tree) : source_tree_(source_tree) {}
+
+io::ZeroCopyInputStream* CachingSourceTree::Open(absl::string_view filename) {
+    auto entry = entries_.find(filename);
+    if (entry == entries_.end()) {
+        Entry new_entry;
+        std::unique_ptr<io::ZeroCopyInputStream> input(source_tree_->Open(filename));
+        new_entry.found = input != nullptr;
+        if (new_entry.found) {
+            const void* data;
+            int size;
+            while (input->Next(&data, &size)) {
+                new_entry.contents.append(static_cast<const char*>(data), size);
+            }
+        } else {
+            new_entry.contents = source_tree_->GetLastErrorMessage();
+        }
+        entry = entries_.emplace(std::string(filename), std::move(new_entry)).first;
+    }
+    if (!entry->second.found) {
+        last_error_message_ = entry->second.contents;
+        return nullptr;
+    }
+    const std::string& contents = entry->second.contents;
+    return new io::ArrayInputStream(contents.data(), contents.size());
+}
+
+std::string CachingSourceTree::GetLastErrorMessage() { return last_error_message_; }
+
+void CachingSourceTree::Clear() { entries_.clear(); }
+
+CachingSourceTree* NewCachingSourceTree(SourceTree* source_tree) {
+    return new CachingSourceTree(source_tree);
+}
+
+void DeleteCachingSourceTree(CachingSourceTree* tree) { delete tree; }
+
+MappedFile::MappedFile(void* data, size_t size) : data_(data), size_(size) {}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+#endif
+}
+
+namespace {
+
+#ifndef _WIN32
+// Identifies a version of a file on disk.
+struct FileVersion {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+
+    explicit FileVersion(const struct stat& sb)
+        : device(sb.st_dev), inode(sb.st_ino), size(sb.st_size), modified(sb.st_mtim) {}
+
+    bool operator==(const FileVersion& other) const {
+        return device == other.device && inode == other.inode && size == other.size &&
+               modified.tv_sec == other.modified.tv_sec &&
+               modified.tv_nsec == other.modified.tv_nsec;
+    }
+};
+#endif
+
+// Maps the file open as `fd`, which is described by `sb`. Returns null and
+// sets errno on failure.
+std::shared_ptr<const MappedFile> MapFile(int fd, const struct stat& sb) {
+#ifdef _WIN32
+    errno = ENOSYS;
+    return nullptr;
+#else
+    if (S_ISDIR(sb.st_mode)) {
+        errno = EISDIR;
+        return nullptr;
+    }
+    size_t size = sb.st_size;
+    // ZeroCopyInputStream sizes are ints.
+    if (size > INT_MAX) {
+        errno = EFBIG;
+        return nullptr;
+    }
+    // Mapping a zero-length region is an error, but an empty file is not.
+    void* data = nullptr;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+    }
+    return std::make_shared<const MappedFile>(data, size);
+#endif
+}
+
+// Reads from a mapped file, keeping the mapping alive.
+class MappedFileInputStream : public io::ZeroCopyInputStream {
+   public:
+    MappedFileInputStream(std::shared_ptr<const MappedFile> file)
+        : file_(std::move(file)), stream_(file_->data(), file_->size()) {}
+
+    bool Next(const void** data, int* size) override { return stream_.Next(data, size); }
+    void BackUp(int count) override { stream_.BackUp(count); }
+    bool Skip(int count) override { return stream_.Skip(count); }
+    int64_t ByteCount() const override { return stream_.ByteCount(); }
+
+   private:
+    std::shared_ptr<const MappedFile> file_;
+    io::ArrayInputStream stream_;
+};
+
+}  // namespace
+
+struct MappedFileCache::State {
+    absl::Mutex mutex;
+#ifndef _WIN32
+    struct Entry {
+        FileVersion version;
+        std::shared_ptr<const MappedFile> file;
+    };
+    absl::flat_hash_map<std::string, Entry> entries ABSL_GUARDED_BY(mutex);
+#endif
+};
+
+MappedFileCache::MappedFileCache() : state_(std::make_shared<State>()) {}
+
+std::shared_ptr<const MappedFile> MappedFileCache::Map(const std::string& path) {
+#ifdef _WIN32
+    errno = ENOSYS;
+    return nullptr;
+#else
+    int fd;
+    do {
+        fd = open(path.c_str(), O_RDONLY);
+    } while (fd < 0 && errno == EINTR);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) != 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return nullptr;
+    }
+    FileVersion version(sb);
+
+    absl::MutexLock lock(&state_->mutex);
+    auto entry = state_->entries.find(path);
+    if (entry != state_->entries.end() && entry->second.version == version) {
+        close(fd);
+        return entry->second.file;
+    }
+    std::shared_ptr<const MappedFile> file = MapFile(fd, sb);
+    int error = errno;
+    close(fd);
+    if (file == nullptr) {
+        errno = error;
+        return nullptr;
+    }
+    state_->entries.insert_or_assign(path, State::Entry{version, file});
+    return file;
+#endif
+}
+
+MappedFileCache* NewMappedFileCache() { return new MappedFileCache(); }
+
+void DeleteMappedFileCache(MappedFileCache* cache) { delete cache; }
+
+MmapSourceTree::MmapSourceTree(MappedFileCache cache) : cache_(std::move(cache)) {}
+
+void MmapSourceTree::MapPath(absl::string_view virtual_path, absl::string_view disk_path) {
+    disk_source_tree_.MapPath(virtual_path, disk_path);
+}
+
+io::ZeroCopyInputStream* MmapSourceTree::Open(absl::string_view filename) {
+    std::string disk_file;
+    if (!disk_source_tree_.VirtualFileToDiskFile(filename, &disk_file)) {
+        last_error_message_ = disk_source_tree_.GetLastErrorMessage();
+        return nullptr;
+    }
+    std::shared_ptr<const MappedFile> file = cache_.Map(disk_file);
+    if (file == nullptr) {
+        last_error_message_ = std::strerror(errno);
+        return nullptr;
+    }
+    return new MappedFileInputStream(std::move(file));
+}
+
+std::string MmapSourceTree::GetLastErrorMessage() { return last_error_message_; }
+
+MmapSourceTree* NewMmapSourceTree() { return new MmapSourceTree(MappedFileCache()); }
+
+MmapSourceTree* NewMmapSourceTreeWithCache(const MappedFileCache& cache) {
+    return new MmapSourceTree(cache);
+}
+
+void DeleteMmapSourceTree(MmapSourceTree* tree) { delete tree; }
+
+SourceTreeDescriptorDatabase::SourceTreeDescriptorDatabase(SourceTree* source_tree)
+    : google::protobuf::compiler::SourceTreeDescriptorDatabase(source_tree) {}
+
+void SourceTreeDescriptorDatabase::SetIncludeSourceCodeInfo(bool include) {
+    include_source_code_info_ = include;
+}
+
+bool SourceTreeDescriptorDatabase::FindFileByName(const std::string& filename,
+                                                  FileDescriptorProto* output) {
+    // The parser always records source locations, so they can only be
+    // discarded after the fact.
+    bool ok =
+        google::protobuf::compiler::SourceTreeDescriptorDatabase::FindFileByName(filename, output);
+    if (!include_source_code_info_) {
+        output->clear_source_code_info();
+    }
+    return ok;
+}
+
 SourceTreeDescriptorDatabase* NewSourceTreeDescriptorDatabase(SourceTree* source_tree) {
     return new SourceTreeDescriptorDatabase(source_tree);
 }
@@ -82,5 +393,357 @@ void DeleteSourceTreeDescriptorDatabase(SourceTreeDescriptorDatabase* source_tre
     delete source_tree;
 }
 
+Importer* NewImporter(SourceTree* source_tree, MultiFileErrorCollector* error_collector) {
+    return new Importer(source_tree, error_collector);
+}
+
+void DeleteImporter(Importer* importer) { delete importer; }
+
+namespace {
+
+// Records the errors in a single file to a vector.
+class FileErrorVecCollector : public io::ErrorCollector {
+   public:
+    FileErrorVecCollector(absl::string_view filename, rust::Vec<FileLoadError>& errors)
+        : filename_(filename), errors_(errors) {}
+
+    void RecordError(int line, io::ColumnNumber column, absl::string_view message) override {
+        Record(line, column, message, false);
+        had_errors_ = true;
+    }
+
+    void RecordWarning(int line, io::ColumnNumber column, absl::string_view message) override {
+        Record(line, column, message, true);
+    }
+
+    void Record(int line, int column, absl::string_view message, bool warning) {
+        errors_.push_back(
+            FileLoadError{.filename = rust::String(filename_.data(), filename_.size()),
+                          .line = line,
+                          .column = column,
+                          .message = rust::String(message.data(), message.size()),
+                          .warning = warning});
+    }
+
+    bool had_errors() const { return had_errors_; }
+
+   private:
+    absl::string_view filename_;
+    rust::Vec<FileLoadError>& errors_;
+    bool had_errors_ = false;
+};
+
+// Parses `input` into `output` in the same way as
+// SourceTreeDescriptorDatabase::FindFileByName.
+bool ParseInput(absl::string_view filename, io::ZeroCopyInputStream* input,
+                FileDescriptorProto* output, FileErrorVecCollector& error_collector) {
+    io::Tokenizer tokenizer(input, &error_collector);
+    Parser parser;
+    parser.RecordErrorsTo(&error_collector);
+    output->set_name(filename);
+    return parser.Parse(&tokenizer, output) && !error_collector.had_errors();
+}
+
+}  // namespace
+
+bool ParseFileContents(absl::string_view filename, rust::Slice<const uint8_t> contents,
+                       FileDescriptorProto* output, rust::Vec<FileLoadError>& errors) {
+    FileErrorVecCollector error_collector(filename, errors);
+    io::ArrayInputStream input(contents.data(), contents.size());
+    return ParseInput(filename, &input, output, error_collector);
+}
+
+ParallelSourceTreeParser::ParallelSourceTreeParser(SourceTree* source_tree)
+    : source_tree_(source_tree) {}
+
+void ParallelSourceTreeParser::RecordErrorsTo(MultiFileErrorCollector* error_collector) {
+    error_collector_ = error_collector;
+}
+
+bool ParallelSourceTreeParser::ParseFile(absl::string_view filename, FileDescriptorProto* output,
+                                         rust::Vec<FileLoadError>& errors) const {
+    FileErrorVecCollector error_collector(filename, errors);
+    std::unique_ptr<io::ZeroCopyInputStream> input;
+    {
+        absl::MutexLock lock(&mutex_);
+        input.reset(source_tree_->Open(filename));
+        if (input == nullptr) {
+            error_collector.Record(-1, 0, source_tree_->GetLastErrorMessage(), false);
+            return false;
+        }
+    }
+
+    return ParseInput(filename, input.get(), output, error_collector);
+}
+
+void ParallelSourceTreeParser::RecordErrors(const rust::Vec<FileLoadError>& errors) {
+    if (error_collector_ == nullptr) {
+        return;
+    }
+    for (const FileLoadError& error : errors) {
+        absl::string_view filename(error.filename.data(), error.filename.size());
+        absl::string_view message(error.message.data(), error.message.size());
+        if (error.warning) {
+            error_collector_->RecordWarning(filename, error.line, error.column, message);
+        } else {
+            error_collector_->RecordError(filename, error.line, error.column, message);
+        }
+    }
+}
+
+bool ParallelSourceTreeParser::ReadFile(absl::string_view filename, rust::Vec<uint8_t>& contents,
+                                        rust::Vec<FileLoadError>& errors) const {
+    FileErrorVecCollector error_collector(filename, errors);
+    std::unique_ptr<io::ZeroCopyInputStream> input;
+    {
+        absl::MutexLock lock(&mutex_);
+        input.reset(source_tree_->Open(filename));
+        if (input == nullptr) {
+            error_collector.Record(-1, 0, source_tree_->GetLastErrorMessage(), false);
+            return false;
+        }
+    }
+
+    const void* data;
+    int size;
+    while (input->Next(&data, &size)) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        contents.reserve(contents.size() + size);
+        std::copy(bytes, bytes + size, std::back_inserter(contents));
+    }
+    return true;
+}
+
+void ParallelSourceTreeParser::SetSplitLargeFiles(bool split) { split_large_files_ = split; }
+
+bool ParallelSourceTreeParser::SplitLargeFiles() const { return split_large_files_; }
+
+ParallelSourceTreeParser* NewParallelSourceTreeParser(SourceTree* source_tree) {
+    return new ParallelSourceTreeParser(source_tree);
+}
+
+void DeleteParallelSourceTreeParser(ParallelSourceTreeParser* parser) { delete parser; }
+
+namespace {
+
+// Chunks smaller than this are not worth parsing on their own thread.
+constexpr size_t kMinChunkSize = 64 * 1024;
+
+// A statement at the top level of a .proto file.
+struct Statement {
+    absl::string_view keyword;
+    // The offset of the beginning of the line on which the statement starts,
+    // or npos if the statement is preceded by something other than whitespace
+    // on that line.
+    size_t line_begin;
+    size_t begin;
+};
+
+bool IsIdentifierStart(char c) { return absl::ascii_isalpha(c) || c == '_'; }
+
+bool IsIdentifierChar(char c) { return absl::ascii_isalnum(c) || c == '_'; }
+
+size_t LineBegin(absl::string_view contents, size_t pos) {
+    size_t begin = pos;
+    while (begin > 0 && contents[begin - 1] != '\n') {
+        if (!absl::ascii_isspace(contents[begin - 1])) {
+            return absl::string_view::npos;
+        }
+        begin--;
+    }
+    return begin;
+}
+
+// Finds the top-level statements of a .proto file. Only comments, string
+// literals, and braces are recognized, which is enough to find where each
+// statement begins in a file that parses. Returns false if the file is
+// malformed, in which case the parser reports the problem.
+bool ScanTopLevelStatements(absl::string_view contents, std::vector<Statement>& statements) {
+    size_t depth = 0;
+    bool expect_statement = true;
+    size_t i = 0;
+    while (i < contents.size()) {
+        char c = contents[i];
+        if (absl::StartsWith(contents.substr(i), "//")) {
+            i = contents.find('\n', i);
+        } else if (absl::StartsWith(contents.substr(i), "/*")) {
+            i = contents.find("*/", i + 2);
+            if (i == absl::string_view::npos) {
+                return false;
+            }
+            i += 2;
+        } else if (c == '"' || c == '\'') {
+            for (i++; i < contents.size() && contents[i] != c; i++) {
+                if (contents[i] == '\\') {
+                    i++;
+                } else if (contents[i] == '\n') {
+                    return false;
+                }
+            }
+            if (i >= contents.size()) {
+                return false;
+            }
+            i++;
+        } else if (c == '{') {
+            depth++;
+            i++;
+        } else if (c == '}') {
+            if (depth == 0) {
+                return false;
+            }
+            if (--depth == 0) {
+                expect_statement = true;
+            }
+            i++;
+        } else if (c == ';') {
+            if (depth == 0) {
+                expect_statement = true;
+            }
+            i++;
+        } else if (depth == 0 && expect_statement && IsIdentifierStart(c)) {
+            size_t begin = i;
+            while (i < contents.size() && IsIdentifierChar(contents[i])) {
+                i++;
+            }
+            statements.push_back(Statement{
+                .keyword = contents.substr(begin, i - begin),
+                .line_begin = LineBegin(contents, begin),
+                .begin = begin,
+            });
+            expect_statement = false;
+        } else {
+            if (depth == 0 && !absl::ascii_isspace(c)) {
+                expect_statement = false;
+            }
+            i++;
+        }
+    }
+    return depth == 0;
+}
+
+bool IsDefinition(absl::string_view keyword) {
+    return keyword == "message" || keyword == "enum" || keyword == "service" ||
+           keyword == "extend";
+}
+
+// Adjusts the positions of errors in a chunk parsed after the header of a file
+// to their positions in the file, and drops errors in the header, which are
+// reported when parsing the first chunk.
+class ChunkErrorCollector : public io::ErrorCollector {
+   public:
+    ChunkErrorCollector(FileErrorVecCollector& errors, int header_lines, int chunk_line)
+        : errors_(errors), header_lines_(header_lines), chunk_line_(chunk_line) {}
+
+    void RecordError(int line, io::ColumnNumber column, absl::string_view message) override {
+        if (line >= header_lines_) {
+            errors_.RecordError(line - header_lines_ + chunk_line_, column, message);
+        }
+    }
+
+    void RecordWarning(int line, io::ColumnNumber column, absl::string_view message) override {
+        if (line >= header_lines_) {
+            errors_.RecordWarning(line - header_lines_ + chunk_line_, column, message);
+        }
+    }
+
+   private:
+    FileErrorVecCollector& errors_;
+    int header_lines_;
+    int chunk_line_;
+};
+
+template <typename T>
+void MoveRepeatedField(RepeatedPtrField<T>* from, RepeatedPtrField<T>* to) {
+    std::vector<T*> elements(from->size());
+    from->ExtractSubrange(0, from->size(), elements.data());
+    for (T* element : elements) {
+        to->AddAllocated(element);
+    }
+}
+
+}  // namespace
+
+rust::Vec<size_t> SplitFileContents(rust::Slice<const uint8_t> contents, size_t max_chunks,
+                                    size_t& header_end) {
+    rust::Vec<size_t> begins;
+    begins.push_back(0);
+    header_end = contents.size();
+
+    absl::string_view text(reinterpret_cast<const char*>(contents.data()), contents.size());
+    std::vector<Statement> statements;
+    if (!ScanTopLevelStatements(text, statements)) {
+        return begins;
+    }
+    auto first_definition = std::find_if(statements.begin(), statements.end(),
+                                         [](const Statement& s) { return IsDefinition(s.keyword); });
+    if (first_definition == statements.end()) {
+        return begins;
+    }
+    // Every chunk is parsed after the header, so the header must declare the
+    // syntax, and nothing that belongs in the header may follow it.
+    bool has_syntax = std::any_of(statements.begin(), first_definition, [](const Statement& s) {
+        return s.keyword == "syntax" || s.keyword == "edition";
+    });
+    bool only_definitions =
+        std::all_of(first_definition, statements.end(),
+                    [](const Statement& s) { return IsDefinition(s.keyword); });
+    if (!has_syntax || !only_definitions) {
+        return begins;
+    }
+    header_end = first_definition->begin;
+
+    size_t body_size = contents.size() - header_end;
+    size_t chunks = std::min(max_chunks, body_size / kMinChunkSize);
+    if (chunks < 2) {
+        return begins;
+    }
+    size_t target = header_end + body_size / chunks;
+    for (auto it = first_definition + 1; it != statements.end(); ++it) {
+        if (it->line_begin != absl::string_view::npos && it->line_begin >= target) {
+            begins.push_back(it->line_begin);
+            if (begins.size() == chunks) {
+                break;
+            }
+            target = it->line_begin + body_size / chunks;
+        }
+    }
+    return begins;
+}
+
+bool ParseFileChunk(absl::string_view filename, rust::Slice<const uint8_t> contents,
+                    size_t header_end, size_t begin, size_t end, FileDescriptorProto* output,
+                    rust::Vec<FileLoadError>& errors) {
+    FileErrorVecCollector error_collector(filename, errors);
+    absl::string_view text(reinterpret_cast<const char*>(contents.data()), contents.size());
+    if (begin == 0) {
+        io::ArrayInputStream input(text.data(), end);
+        return ParseInput(filename, &input, output, error_collector);
+    }
+
+    std::string chunk(text.substr(0, header_end));
+    if (!chunk.empty() && chunk.back() != '\n') {
+        chunk.push_back('\n');
+    }
+    int header_lines = std::count(chunk.begin(), chunk.end(), '\n');
+    int chunk_line = std::count(text.begin(), text.begin() + begin, '\n');
+    chunk.append(text.data() + begin, end - begin);
+
+    ChunkErrorCollector chunk_error_collector(error_collector, header_lines, chunk_line);
+    io::ArrayInputStream input(chunk.data(), chunk.size());
+    io::Tokenizer tokenizer(&input, &chunk_error_collector);
+    Parser parser;
+    parser.RecordErrorsTo(&chunk_error_collector);
+    output->set_name(filename);
+    return parser.Parse(&tokenizer, output) && !error_collector.had_errors();
+}
+
+void MergeFileChunk(FileDescriptorProto& output, FileDescriptorProto& chunk) {
+    MoveRepeatedField(chunk.mutable_message_type(), output.mutable_message_type());
+    MoveRepeatedField(chunk.mutable_enum_type(), output.mutable_enum_type());
+    MoveRepeatedField(chunk.mutable_service(), output.mutable_service());
+    MoveRepeatedField(chunk.mutable_extension(), output.mutable_extension());
+    output.clear_source_code_info();
+}
+
 }  // namespace compiler
 }  // namespace protobuf_native
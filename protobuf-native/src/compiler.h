@@ -15,6 +15,11 @@
 
 #pragma once
 
+#include <memory>
+
+#include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/optional.h"
 #include "google/protobuf/compiler/importer.h"
 #include "rust/cxx.h"
 
@@ -25,6 +30,9 @@ using namespace google::protobuf;
 using namespace google::protobuf::compiler;
 
 struct FileLoadError;
+struct ErrorCollectorAdaptor;
+struct SharedBytes;
+struct SourceTreeAdaptor;
 
 class SimpleErrorCollector : public MultiFileErrorCollector {
    public:
@@ -33,26 +41,58 @@ class SimpleErrorCollector : public MultiFileErrorCollector {
     void RecordWarning(absl::string_view filename, int line, int column,
                        absl::string_view message) override;
     std::vector<FileLoadError>& Errors();
+    void SetMaxErrors(size_t max_errors);
+    void SetIgnoreWarnings(bool ignore_warnings);
+    size_t Dropped() const;
 
    private:
     void RecordErrorOrWarning(absl::string_view filename, int line, int column,
                               absl::string_view message, bool warning);
     std::vector<FileLoadError> errors_;
+    size_t max_errors_ = SIZE_MAX;
+    bool ignore_warnings_ = false;
+    // The number of errors and warnings that were not stored.
+    size_t dropped_ = 0;
 };
 
 SimpleErrorCollector* NewSimpleErrorCollector();
 void DeleteSimpleErrorCollector(SimpleErrorCollector*);
 
+// An error collector that passes each error to Rust as it is reported.
+class RustErrorCollector : public MultiFileErrorCollector {
+   public:
+    RustErrorCollector(rust::Box<ErrorCollectorAdaptor> adaptor);
+
+    void RecordError(absl::string_view filename, int line, int column,
+                     absl::string_view message) override;
+    void RecordWarning(absl::string_view filename, int line, int column,
+                       absl::string_view message) override;
+
+   private:
+    rust::Box<ErrorCollectorAdaptor> adaptor_;
+};
+
+RustErrorCollector* NewRustErrorCollector(rust::Box<ErrorCollectorAdaptor> adaptor);
+void DeleteRustErrorCollector(RustErrorCollector* collector);
+
 rust::String SourceTreeGetLastErrorMessage(SourceTree&);
 
 class VirtualSourceTree : public SourceTree {
    public:
     void AddFile(absl::string_view name, rust::Vec<rust::u8> contents);
+    void AddSharedFile(absl::string_view name, rust::Box<SharedBytes> contents);
     io::ZeroCopyInputStream* Open(absl::string_view filename);
     std::string GetLastErrorMessage();
 
    private:
-    absl::flat_hash_map<std::string, rust::Vec<rust::u8>> files_;
+    // The contents of a file, which are either owned by the tree or shared
+    // with Rust.
+    struct File {
+        rust::Vec<rust::u8> owned;
+        absl::optional<rust::Box<SharedBytes>> shared;
+    };
+
+    absl::flat_hash_map<std::string, File> files_;
 };
 
 VirtualSourceTree* NewVirtualSourceTree();
@@ -63,9 +103,180 @@ DiskSourceTree* NewDiskSourceTree();
 
 void DeleteDiskSourceTree(DiskSourceTree*);
 
+// A source tree implemented in Rust.
+class RustSourceTree : public SourceTree {
+   public:
+    RustSourceTree(rust::Box<SourceTreeAdaptor> adaptor);
+
+    io::ZeroCopyInputStream* Open(absl::string_view filename) override;
+    std::string GetLastErrorMessage() override;
+
+   private:
+    rust::Box<SourceTreeAdaptor> adaptor_;
+    std::string last_error_message_;
+};
+
+RustSourceTree* NewRustSourceTree(rust::Box<SourceTreeAdaptor> adaptor);
+void DeleteRustSourceTree(RustSourceTree* tree);
+
+// A source tree that remembers the result of opening each file in another
+// source tree. The contents of files that were found are kept in memory, and
+// so are the error messages for files that were not.
+class CachingSourceTree : public SourceTree {
+   public:
+    CachingSourceTree(SourceTree* source_tree);
+
+    io::ZeroCopyInputStream* Open(absl::string_view filename) override;
+    std::string GetLastErrorMessage() override;
+    void Clear();
+
+   private:
+    struct Entry {
+        bool found;
+        // The contents of the file if it was found, or the error message
+        // otherwise.
+        std::string contents;
+    };
+
+    SourceTree* source_tree_;
+    // Streams point into the entries, which must therefore be stable.
+    absl::node_hash_map<std::string, Entry> entries_;
+    std::string last_error_message_;
+};
+
+CachingSourceTree* NewCachingSourceTree(SourceTree* source_tree);
+void DeleteCachingSourceTree(CachingSourceTree* tree);
+
+// A read-only memory mapping of a file.
+class MappedFile {
+   public:
+    MappedFile(void* data, size_t size);
+    ~MappedFile();
+
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+
+   private:
+    void* data_;
+    size_t size_;
+};
+
+// A cache of mapped files, keyed by their path on disk, that may be shared by
+// several MmapSourceTrees.
+class MappedFileCache {
+   public:
+    MappedFileCache();
+
+    // Maps the file at `path`, or returns the existing mapping if the file
+    // has not changed since it was mapped. Returns null and sets errno on
+    // failure.
+    std::shared_ptr<const MappedFile> Map(const std::string& path);
+
+   private:
+    struct State;
+
+    std::shared_ptr<State> state_;
+};
+
+MappedFileCache* NewMappedFileCache();
+void DeleteMappedFileCache(MappedFileCache* cache);
+
+// A source tree that resolves paths like DiskSourceTree, but maps files into
+// memory rather than reading them through a buffer.
+class MmapSourceTree : public SourceTree {
+   public:
+    MmapSourceTree(MappedFileCache cache);
+
+    void MapPath(absl::string_view virtual_path, absl::string_view disk_path);
+    io::ZeroCopyInputStream* Open(absl::string_view filename) override;
+    std::string GetLastErrorMessage() override;
+
+   private:
+    DiskSourceTree disk_source_tree_;
+    MappedFileCache cache_;
+    std::string last_error_message_;
+};
+
+MmapSourceTree* NewMmapSourceTree();
+MmapSourceTree* NewMmapSourceTreeWithCache(const MappedFileCache& cache);
+void DeleteMmapSourceTree(MmapSourceTree* tree);
+
+// A compiler::SourceTreeDescriptorDatabase that can discard the source code
+// info of the files it parses.
+class SourceTreeDescriptorDatabase
+    : public google::protobuf::compiler::SourceTreeDescriptorDatabase {
+   public:
+    SourceTreeDescriptorDatabase(SourceTree* source_tree);
+
+    void SetIncludeSourceCodeInfo(bool include);
+    bool FindFileByName(const std::string& filename, FileDescriptorProto* output) override;
+
+   private:
+    bool include_source_code_info_ = true;
+};
+
 SourceTreeDescriptorDatabase* NewSourceTreeDescriptorDatabase(SourceTree* source_tree);
 
 void DeleteSourceTreeDescriptorDatabase(SourceTreeDescriptorDatabase* source_tree);
 
+bool ParseFileContents(absl::string_view filename, rust::Slice<const uint8_t> contents,
+                       FileDescriptorProto* output, rust::Vec<FileLoadError>& errors);
+
+Importer* NewImporter(SourceTree* source_tree, MultiFileErrorCollector* error_collector);
+
+void DeleteImporter(Importer* importer);
+
+// Parses files from a SourceTree on several threads at once, in the same way
+// as SourceTreeDescriptorDatabase. Source trees are not thread-safe, so opening
+// files is serialized, but the opened files are tokenized and parsed
+// concurrently.
+class ParallelSourceTreeParser {
+   public:
+    ParallelSourceTreeParser(SourceTree* source_tree);
+
+    void RecordErrorsTo(MultiFileErrorCollector* error_collector);
+    // Thread-safe.
+    bool ParseFile(absl::string_view filename, FileDescriptorProto* output,
+                   rust::Vec<FileLoadError>& errors) const;
+    // Reads the entire contents of a file. Thread-safe.
+    bool ReadFile(absl::string_view filename, rust::Vec<uint8_t>& contents,
+                  rust::Vec<FileLoadError>& errors) const;
+    // Reports errors returned by ParseFile to the error collector, if any.
+    void RecordErrors(const rust::Vec<FileLoadError>& errors);
+    void SetSplitLargeFiles(bool split);
+    bool SplitLargeFiles() const;
+
+   private:
+    SourceTree* source_tree_;
+    MultiFileErrorCollector* error_collector_ = nullptr;
+    bool split_large_files_ = false;
+    mutable absl::Mutex mutex_;
+};
+
+ParallelSourceTreeParser* NewParallelSourceTreeParser(SourceTree* source_tree);
+
+void DeleteParallelSourceTreeParser(ParallelSourceTreeParser* parser);
+
+// Splits the contents of a .proto file into at most `max_chunks` chunks that
+// can be parsed independently by ParseFileChunk, returning the offset at which
+// each chunk begins. The first chunk begins at zero and contains the header of
+// the file: the statements, like `syntax` and `import`, that precede the first
+// definition. `header_end` is set to the end of the header. Returns a single
+// chunk if the file is small or cannot be split safely.
+rust::Vec<size_t> SplitFileContents(rust::Slice<const uint8_t> contents, size_t max_chunks,
+                                    size_t& header_end);
+
+// Parses the chunk of `contents` between `begin` and `end`, as returned by
+// SplitFileContents, as if it followed the header of the file. Errors are
+// reported at their position in the whole file. Thread-safe.
+bool ParseFileChunk(absl::string_view filename, rust::Slice<const uint8_t> contents,
+                    size_t header_end, size_t begin, size_t end, FileDescriptorProto* output,
+                    rust::Vec<FileLoadError>& errors);
+
+// Moves the definitions of a chunk parsed by ParseFileChunk to the end of
+// `output`, which must hold the preceding chunks. Source code info, which
+// cannot be combined, is cleared.
+void MergeFileChunk(FileDescriptorProto& output, FileDescriptorProto& chunk);
+
 }  // namespace compiler
 }  // namespace protobuf_native
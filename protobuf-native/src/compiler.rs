@@ -19,20 +19,41 @@
 //! on them. It is particularly useful when you need to deal with arbitrary
 //! Protobuf messages at runtime.
 
-use std::collections::HashSet;
+use std::collections::{HashMap, HashSet, VecDeque};
 use std::error::Error;
 use std::fmt;
+use std::fs;
+use std::io;
+#[cfg(unix)]
+use std::io::{Read, Write};
 use std::marker::PhantomData;
 use std::marker::PhantomPinned;
 use std::mem;
-use std::path::Path;
+#[cfg(unix)]
+use std::net::Shutdown;
+#[cfg(unix)]
+use std::os::unix::net::{UnixListener, UnixStream};
+use std::path::{Path, PathBuf};
 use std::pin::Pin;
+use std::process;
+use std::ptr;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Arc;
+use std::thread;
+use std::time::{Duration, SystemTime};
 
 use cxx::let_cxx_string;
 
-use crate::internal::{unsafe_ffi_conversions, CInt, ProtobufPath};
-use crate::io::DynZeroCopyInputStream;
-use crate::{DescriptorDatabase, FileDescriptorProto, FileDescriptorSet, OperationFailedError};
+use crate::internal::{
+    unsafe_ffi_conversions, BoolExt, CInt, ErrorCollectorAdaptor, ProtobufPath, SharedBytes,
+    SourceTreeAdaptor,
+};
+use crate::io::{DynZeroCopyInputStream, ZeroCopyInputStream};
+use crate::trace;
+use crate::{
+    BuildFileSetError, DescriptorDatabase, DescriptorPool, FileDescriptor, FileDescriptorProto,
+    FileDescriptorSet, MessageLite, OperationFailedError,
+};
 
 #[cxx::bridge(namespace = "protobuf_native::compiler")]
 pub(crate) mod ffi {
@@ -45,6 +66,28 @@ pub(crate) mod ffi {
         warning: bool,
     }
 
+    extern "Rust" {
+        type ErrorCollectorAdaptor<'a>;
+        fn record(
+            self: &mut ErrorCollectorAdaptor<'_>,
+            filename: &[u8],
+            line: i32,
+            column: i32,
+            message: &[u8],
+            warning: bool,
+        );
+
+        type SharedBytes;
+        fn as_slice(self: &SharedBytes) -> &[u8];
+
+        type SourceTreeAdaptor<'a>;
+        fn open(
+            self: &SourceTreeAdaptor<'_>,
+            filename: &[u8],
+            error: &mut String,
+        ) -> *mut ZeroCopyInputStream;
+    }
+
     unsafe extern "C++" {
         include!("protobuf-native/src/compiler.h");
         include!("protobuf-native/src/internal.h");
@@ -58,6 +101,12 @@ pub(crate) mod ffi {
         #[namespace = "google::protobuf"]
         type FileDescriptorProto = crate::ffi::FileDescriptorProto;
 
+        #[namespace = "google::protobuf"]
+        type FileDescriptor = crate::ffi::FileDescriptor;
+
+        #[namespace = "google::protobuf"]
+        type DescriptorPool = crate::ffi::DescriptorPool;
+
         #[namespace = "google::protobuf::io"]
         type ZeroCopyInputStream = crate::io::ffi::ZeroCopyInputStream;
 
@@ -65,6 +114,15 @@ pub(crate) mod ffi {
         fn NewSimpleErrorCollector() -> *mut SimpleErrorCollector;
         unsafe fn DeleteSimpleErrorCollector(collector: *mut SimpleErrorCollector);
         fn Errors(self: Pin<&mut SimpleErrorCollector>) -> Pin<&mut CxxVector<FileLoadError>>;
+        fn SetMaxErrors(self: Pin<&mut SimpleErrorCollector>, max_errors: usize);
+        fn SetIgnoreWarnings(self: Pin<&mut SimpleErrorCollector>, ignore_warnings: bool);
+        fn Dropped(self: &SimpleErrorCollector) -> usize;
+
+        type RustErrorCollector;
+        fn NewRustErrorCollector(
+            adaptor: Box<ErrorCollectorAdaptor<'_>>,
+        ) -> *mut RustErrorCollector;
+        unsafe fn DeleteRustErrorCollector(collector: *mut RustErrorCollector);
 
         #[namespace = "google::protobuf::compiler"]
         type MultiFileErrorCollector;
@@ -88,7 +146,6 @@ pub(crate) mod ffi {
         fn Open(self: Pin<&mut SourceTree>, filename: string_view) -> *mut ZeroCopyInputStream;
         fn SourceTreeGetLastErrorMessage(source_tree: Pin<&mut SourceTree>) -> String;
 
-        #[namespace = "google::protobuf::compiler"]
         type SourceTreeDescriptorDatabase;
         unsafe fn NewSourceTreeDescriptorDatabase(
             source_tree: *mut SourceTree,
@@ -105,11 +162,78 @@ pub(crate) mod ffi {
             self: Pin<&mut SourceTreeDescriptorDatabase>,
             error_collector: *mut MultiFileErrorCollector,
         );
+        fn SetIncludeSourceCodeInfo(self: Pin<&mut SourceTreeDescriptorDatabase>, include: bool);
+
+        unsafe fn ParseFileContents(
+            filename: string_view,
+            contents: &[u8],
+            output: *mut FileDescriptorProto,
+            errors: &mut Vec<FileLoadError>,
+        ) -> bool;
+
+        type ParallelSourceTreeParser;
+        unsafe fn NewParallelSourceTreeParser(
+            source_tree: *mut SourceTree,
+        ) -> *mut ParallelSourceTreeParser;
+        unsafe fn DeleteParallelSourceTreeParser(parser: *mut ParallelSourceTreeParser);
+        unsafe fn RecordErrorsTo(
+            self: Pin<&mut ParallelSourceTreeParser>,
+            error_collector: *mut MultiFileErrorCollector,
+        );
+        unsafe fn ParseFile(
+            self: &ParallelSourceTreeParser,
+            filename: string_view,
+            output: *mut FileDescriptorProto,
+            errors: &mut Vec<FileLoadError>,
+        ) -> bool;
+        fn ReadFile(
+            self: &ParallelSourceTreeParser,
+            filename: string_view,
+            contents: &mut Vec<u8>,
+            errors: &mut Vec<FileLoadError>,
+        ) -> bool;
+        fn RecordErrors(self: Pin<&mut ParallelSourceTreeParser>, errors: &Vec<FileLoadError>);
+        fn SetSplitLargeFiles(self: Pin<&mut ParallelSourceTreeParser>, split: bool);
+        fn SplitLargeFiles(self: &ParallelSourceTreeParser) -> bool;
+
+        fn SplitFileContents(
+            contents: &[u8],
+            max_chunks: usize,
+            header_end: &mut usize,
+        ) -> Vec<usize>;
+        unsafe fn ParseFileChunk(
+            filename: string_view,
+            contents: &[u8],
+            header_end: usize,
+            begin: usize,
+            end: usize,
+            output: *mut FileDescriptorProto,
+            errors: &mut Vec<FileLoadError>,
+        ) -> bool;
+        fn MergeFileChunk(
+            output: Pin<&mut FileDescriptorProto>,
+            chunk: Pin<&mut FileDescriptorProto>,
+        );
+
+        #[namespace = "google::protobuf::compiler"]
+        type Importer;
+        unsafe fn NewImporter(
+            source_tree: *mut SourceTree,
+            error_collector: *mut MultiFileErrorCollector,
+        ) -> *mut Importer;
+        unsafe fn DeleteImporter(importer: *mut Importer);
+        fn Import(self: Pin<&mut Importer>, filename: &CxxString) -> *const FileDescriptor;
+        fn pool(self: &Importer) -> *const DescriptorPool;
 
         type VirtualSourceTree;
         fn NewVirtualSourceTree() -> *mut VirtualSourceTree;
         unsafe fn DeleteVirtualSourceTree(tree: *mut VirtualSourceTree);
         fn AddFile(self: Pin<&mut VirtualSourceTree>, filename: string_view, contents: Vec<u8>);
+        fn AddSharedFile(
+            self: Pin<&mut VirtualSourceTree>,
+            filename: string_view,
+            contents: Box<SharedBytes>,
+        );
 
         #[namespace = "google::protobuf::compiler"]
         type DiskSourceTree;
@@ -120,6 +244,29 @@ pub(crate) mod ffi {
             virtual_path: string_view,
             disk_path: string_view,
         );
+
+        type RustSourceTree;
+        fn NewRustSourceTree(adaptor: Box<SourceTreeAdaptor<'_>>) -> *mut RustSourceTree;
+        unsafe fn DeleteRustSourceTree(tree: *mut RustSourceTree);
+
+        type CachingSourceTree;
+        unsafe fn NewCachingSourceTree(source_tree: *mut SourceTree) -> *mut CachingSourceTree;
+        unsafe fn DeleteCachingSourceTree(tree: *mut CachingSourceTree);
+        fn Clear(self: Pin<&mut CachingSourceTree>);
+
+        type MappedFileCache;
+        fn NewMappedFileCache() -> *mut MappedFileCache;
+        unsafe fn DeleteMappedFileCache(cache: *mut MappedFileCache);
+
+        type MmapSourceTree;
+        fn NewMmapSourceTree() -> *mut MmapSourceTree;
+        fn NewMmapSourceTreeWithCache(cache: &MappedFileCache) -> *mut MmapSourceTree;
+        unsafe fn DeleteMmapSourceTree(tree: *mut MmapSourceTree);
+        fn MapPath(
+            self: Pin<&mut MmapSourceTree>,
+            virtual_path: string_view,
+            disk_path: string_view,
+        );
     }
 }
 
@@ -153,93 +300,1079 @@ pub trait MultiFileErrorCollector: multi_file_error_collector::Sealed {
             message.into(),
         )
     }
-}
+}
+
+mod multi_file_error_collector {
+    use std::pin::Pin;
+
+    use super::ffi;
+
+    pub trait Sealed {
+        fn upcast(&self) -> &ffi::MultiFileErrorCollector;
+        fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MultiFileErrorCollector>;
+        unsafe fn upcast_mut_ptr(self: Pin<&mut Self>) -> *mut ffi::MultiFileErrorCollector {
+            self.upcast_mut().get_unchecked_mut() as *mut _
+        }
+    }
+}
+
+/// A simple implementation of [`MultiFileErrorCollector`] that records errors
+/// in memory for later retrieval.
+pub struct SimpleErrorCollector {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for SimpleErrorCollector {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteSimpleErrorCollector(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl SimpleErrorCollector {
+    /// Creates a new simple error collector.
+    pub fn new() -> Pin<Box<SimpleErrorCollector>> {
+        let collector = ffi::NewSimpleErrorCollector();
+        unsafe { Self::from_ffi_owned(collector) }
+    }
+
+    /// Limits the number of errors and warnings that the collector holds at
+    /// once.
+    ///
+    /// Errors reported while the collector is full are counted by
+    /// [`SimpleErrorCollector::dropped`] but not stored. There is no limit by
+    /// default.
+    pub fn set_max_errors(self: Pin<&mut Self>, max_errors: usize) {
+        self.as_ffi_mut().SetMaxErrors(max_errors)
+    }
+
+    /// Controls whether the collector discards warnings rather than storing
+    /// them. Discarded warnings are counted by [`SimpleErrorCollector::dropped`].
+    pub fn set_ignore_warnings(self: Pin<&mut Self>, ignore_warnings: bool) {
+        self.as_ffi_mut().SetIgnoreWarnings(ignore_warnings)
+    }
+
+    /// Returns the number of errors and warnings that were reported but not
+    /// stored, either because the collector was full or because warnings are
+    /// ignored.
+    pub fn dropped(&self) -> usize {
+        self.as_ffi().Dropped()
+    }
+
+    unsafe_ffi_conversions!(ffi::SimpleErrorCollector);
+}
+
+impl<'a> Iterator for Pin<&'a mut SimpleErrorCollector> {
+    type Item = FileLoadError;
+
+    fn next(&mut self) -> Option<FileLoadError> {
+        self.as_mut().as_ffi_mut().Errors().pop().map(Into::into)
+    }
+}
+
+impl MultiFileErrorCollector for SimpleErrorCollector {}
+
+impl multi_file_error_collector::Sealed for SimpleErrorCollector {
+    fn upcast(&self) -> &ffi::MultiFileErrorCollector {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MultiFileErrorCollector> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A receiver of errors and warnings implemented in Rust.
+///
+/// Wrap an implementation in a [`RustErrorCollector`] to use it wherever a
+/// [`MultiFileErrorCollector`] is required. Closures taking the same
+/// arguments as [`CustomErrorCollector::record`] implement this trait.
+pub trait CustomErrorCollector {
+    /// Called as each error or warning is reported.
+    ///
+    /// The location is `None` for errors that concern the entire file.
+    fn record(
+        &mut self,
+        filename: &str,
+        location: Option<Location>,
+        severity: Severity,
+        message: &str,
+    );
+}
+
+impl<F> CustomErrorCollector for F
+where
+    F: FnMut(&str, Option<Location>, Severity, &str),
+{
+    fn record(
+        &mut self,
+        filename: &str,
+        location: Option<Location>,
+        severity: Severity,
+        message: &str,
+    ) {
+        self(filename, location, severity, message)
+    }
+}
+
+/// An implementation of [`MultiFileErrorCollector`] that passes each error to
+/// a [`CustomErrorCollector`] as it is reported, rather than storing it.
+pub struct RustErrorCollector<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for RustErrorCollector<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteRustErrorCollector(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> RustErrorCollector<'a> {
+    /// Creates a new error collector that passes errors to `collector`.
+    pub fn new(collector: Box<dyn CustomErrorCollector + 'a>) -> Pin<Box<RustErrorCollector<'a>>> {
+        let collector = ffi::NewRustErrorCollector(Box::new(ErrorCollectorAdaptor(collector)));
+        unsafe { Self::from_ffi_owned(collector) }
+    }
+
+    unsafe_ffi_conversions!(ffi::RustErrorCollector);
+}
+
+impl<'a> MultiFileErrorCollector for RustErrorCollector<'a> {}
+
+impl<'a> multi_file_error_collector::Sealed for RustErrorCollector<'a> {
+    fn upcast(&self) -> &ffi::MultiFileErrorCollector {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MultiFileErrorCollector> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// An implementation of `DescriptorDatabase` which loads files from a
+/// `SourceTree` and parses them.
+///
+/// Note: This class does not implement `FindFileContainingSymbol` or
+/// `FindFileContainingExtension`; these will always return false.
+pub struct SourceTreeDescriptorDatabase<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for SourceTreeDescriptorDatabase<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteSourceTreeDescriptorDatabase(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> SourceTreeDescriptorDatabase<'a> {
+    /// Constructs a new descriptor database for the provided source tree.
+    pub fn new(
+        source_tree: Pin<&'a mut dyn SourceTree>,
+    ) -> Pin<Box<SourceTreeDescriptorDatabase<'a>>> {
+        let db = unsafe { ffi::NewSourceTreeDescriptorDatabase(source_tree.upcast_mut_ptr()) };
+        unsafe { Self::from_ffi_owned(db) }
+    }
+
+    /// Instructs the source tree descriptor database to report any parse errors
+    /// to the given [`MultiFileErrorCollector`].
+    ///
+    /// This should b ecalled before parsing.
+    pub fn record_errors_to(
+        self: Pin<&mut Self>,
+        error_collector: Pin<&'a mut dyn MultiFileErrorCollector>,
+    ) {
+        unsafe {
+            self.as_ffi_mut()
+                .RecordErrorsTo(error_collector.upcast_mut_ptr())
+        }
+    }
+
+    /// Controls whether parsed files include their source code info, which
+    /// records the location of every definition in the file.
+    ///
+    /// Source code info is included by default. It is often larger than the
+    /// rest of the file descriptor, and is only needed by tools that report
+    /// locations or read comments.
+    pub fn set_include_source_code_info(self: Pin<&mut Self>, include: bool) {
+        self.as_ffi_mut().SetIncludeSourceCodeInfo(include)
+    }
+
+    /// Builds a file descriptor set containing all file descriptor protos
+    /// reachable from the specified roots.
+    pub fn build_file_descriptor_set<P>(
+        mut self: Pin<&mut Self>,
+        roots: &[P],
+    ) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
+    where
+        P: AsRef<Path>,
+    {
+        // Parse each file directly into its place in the set.
+        build_file_descriptor_set(roots, |filename, out| {
+            let_cxx_string!(filename = ProtobufPath::from(filename).as_bytes());
+            let file = out.add_file().as_ffi_mut_ptr();
+            unsafe { self.as_mut().as_ffi_mut().FindFileByName(&filename, file) }.as_result()
+        })
+    }
+
+    unsafe_ffi_conversions!(ffi::SourceTreeDescriptorDatabase);
+}
+
+impl<'a> DescriptorDatabase for SourceTreeDescriptorDatabase<'a> {
+    fn find_file_by_name(
+        self: Pin<&mut Self>,
+        filename: &Path,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        let mut fd = FileDescriptorProto::new();
+        let_cxx_string!(filename = ProtobufPath::from(filename).as_bytes());
+        if unsafe {
+            self.as_ffi_mut()
+                .FindFileByName(&filename, fd.as_mut().as_ffi_mut_ptr())
+        } {
+            Ok(fd)
+        } else {
+            Err(OperationFailedError)
+        }
+    }
+}
+
+/// Parses .proto files from a [`SourceTree`] and builds them into a
+/// [`DescriptorPool`] in one step.
+///
+/// Each imported file, and each of its dependencies, is parsed and built only
+/// once, no matter how many files import it, so the same importer can be used
+/// to import many root files into one pool.
+pub struct Importer<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for Importer<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteImporter(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> Importer<'a> {
+    /// Constructs a new importer for the provided source tree.
+    ///
+    /// Parse and build errors are reported to `error_collector`, if provided.
+    pub fn new(
+        source_tree: Pin<&'a mut dyn SourceTree>,
+        error_collector: Option<Pin<&'a mut dyn MultiFileErrorCollector>>,
+    ) -> Pin<Box<Importer<'a>>> {
+        let error_collector = match error_collector {
+            Some(error_collector) => unsafe { error_collector.upcast_mut_ptr() },
+            None => ptr::null_mut(),
+        };
+        let importer = unsafe { ffi::NewImporter(source_tree.upcast_mut_ptr(), error_collector) };
+        unsafe { Self::from_ffi_owned(importer) }
+    }
+
+    /// Imports the given file and builds a [`FileDescriptor`] representing it.
+    ///
+    /// Dependencies of the file are imported too. Files that were already
+    /// imported are not parsed again. If the file or any of its dependencies
+    /// cannot be parsed or built, the errors are reported to the error
+    /// collector; errors for a given file are only reported once.
+    pub fn import(
+        self: Pin<&mut Self>,
+        filename: &Path,
+    ) -> Result<&FileDescriptor, OperationFailedError> {
+        let_cxx_string!(filename = ProtobufPath::from(filename).as_bytes());
+        let file = self.as_ffi_mut().Import(&filename);
+        match file.is_null() {
+            true => Err(OperationFailedError),
+            false => Ok(unsafe { FileDescriptor::from_ffi_ptr(file) }),
+        }
+    }
+
+    /// Returns the pool into which files are imported.
+    pub fn pool(&self) -> &DescriptorPool<'a> {
+        unsafe { DescriptorPool::from_ffi_ptr(self.as_ffi().pool()) }
+    }
+
+    unsafe_ffi_conversions!(ffi::Importer);
+}
+
+/// Builds a file descriptor set containing all file descriptor protos
+/// reachable from the specified roots.
+///
+/// `find` must append the named file to the end of the set.
+fn build_file_descriptor_set<P, F>(
+    roots: &[P],
+    find: F,
+) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
+where
+    P: AsRef<Path>,
+    F: FnMut(&Path, Pin<&mut FileDescriptorSet>) -> Result<(), OperationFailedError>,
+{
+    let span = trace::span!("build_file_descriptor_set", roots, files);
+    span.record_u64("roots", || roots.len() as u64);
+    let out = collect_file_descriptor_set(roots, find);
+    finish_build_span(span, &out);
+    out
+}
+
+fn collect_file_descriptor_set<P, F>(
+    roots: &[P],
+    mut find: F,
+) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
+where
+    P: AsRef<Path>,
+    F: FnMut(&Path, Pin<&mut FileDescriptorSet>) -> Result<(), OperationFailedError>,
+{
+    let mut out = FileDescriptorSet::new();
+    let mut seen = HashSet::new();
+    let mut stack = vec![];
+    for root in roots {
+        let root = ProtobufPath::from(root.as_ref()).as_bytes().to_vec();
+        if seen.insert(root.clone()) {
+            stack.push(root);
+        }
+    }
+    while let Some(filename) = stack.pop() {
+        find(
+            ProtobufPath::from(&filename[..]).as_path().as_ref(),
+            out.as_mut(),
+        )?;
+        let file = out.file(out.file_size() - 1);
+        for i in 0..file.dependency_size() {
+            let dep = file.dependency(i);
+            if !seen.contains(dep) {
+                seen.insert(dep.to_vec());
+                stack.push(dep.to_vec());
+            }
+        }
+    }
+    Ok(out)
+}
+
+/// Records the outcome of building a file descriptor set in its span.
+fn finish_build_span(
+    span: trace::Span,
+    out: &Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>,
+) {
+    if let Ok(out) = out {
+        span.record_u64("files", || out.file_size() as u64);
+    }
+    span.finish_ok(out.is_ok());
+}
+
+/// Hashes the length-prefixed concatenation of `parts` with FNV-1a, whose
+/// results, unlike those of `std::hash`, are stable across Rust releases.
+/// 128 bits make collisions implausible.
+fn stable_hash(parts: &[&[u8]]) -> u128 {
+    let mut hash: u128 = 0x6c62272e07bb014262b821756295c58d;
+    for part in parts {
+        for bytes in [&(part.len() as u64).to_le_bytes()[..], part] {
+            for byte in bytes {
+                hash ^= u128::from(*byte);
+                hash = hash.wrapping_mul(0x0000000001000000000000000000013b);
+            }
+        }
+    }
+    hash
+}
+
+/// A [`DescriptorDatabase`] that parses .proto files from a [`SourceTree`],
+/// like [`SourceTreeDescriptorDatabase`], but caches the parsed files on disk.
+///
+/// Parsed files are stored in a cache directory, keyed by a hash of the
+/// file's path and contents and of the version of this crate, which
+/// determines how files are parsed. Before parsing a file, the database reads
+/// the file from the source tree and looks for a cached result for its current
+/// contents, so unchanged files are never parsed again, even across processes.
+///
+/// Entries in the cache directory are never removed; delete the directory to
+/// clear the cache. Failing to read or write the cache is not an error: the
+/// file is simply parsed.
+pub struct CachingSourceTreeDescriptorDatabase<'a> {
+    source_tree: Pin<&'a mut dyn SourceTree>,
+    cache_dir: PathBuf,
+    error_collector: Option<Pin<&'a mut dyn MultiFileErrorCollector>>,
+}
+
+impl<'a> CachingSourceTreeDescriptorDatabase<'a> {
+    /// Identifies the format of cache entries and the way files are parsed.
+    /// Part of every cache key.
+    const CACHE_VERSION: &'static str = concat!("protobuf-native ", env!("CARGO_PKG_VERSION"));
+
+    /// Constructs a new descriptor database for the provided source tree that
+    /// caches parsed files in `cache_dir`.
+    ///
+    /// The cache directory is created when the first file is cached, if it
+    /// does not already exist.
+    pub fn new(
+        source_tree: Pin<&'a mut dyn SourceTree>,
+        cache_dir: impl Into<PathBuf>,
+    ) -> CachingSourceTreeDescriptorDatabase<'a> {
+        CachingSourceTreeDescriptorDatabase {
+            source_tree,
+            cache_dir: cache_dir.into(),
+            error_collector: None,
+        }
+    }
+
+    /// Instructs the database to report any parse errors to the given
+    /// [`MultiFileErrorCollector`].
+    ///
+    /// Errors are only reported for files that are parsed, not for files that
+    /// are found in the cache, which never contains files with errors.
+    pub fn record_errors_to(&mut self, error_collector: Pin<&'a mut dyn MultiFileErrorCollector>) {
+        self.error_collector = Some(error_collector);
+    }
+
+    /// Builds a file descriptor set containing all file descriptor protos
+    /// reachable from the specified roots.
+    pub fn build_file_descriptor_set<P>(
+        &mut self,
+        roots: &[P],
+    ) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
+    where
+        P: AsRef<Path>,
+    {
+        build_file_descriptor_set(roots, |filename, out| {
+            let file = Pin::new(&mut *self).find_file_by_name(filename)?;
+            out.add_allocated_file(file);
+            Ok(())
+        })
+    }
+
+    fn read_file(&mut self, filename: &Path) -> Result<Vec<u8>, FileOpenError> {
+        let mut stream = self.source_tree.as_mut().open(filename)?;
+        let mut contents = vec![];
+        while let Ok(buf) = stream.as_mut().next() {
+            contents.extend_from_slice(buf);
+        }
+        Ok(contents)
+    }
+
+    fn cache_path(&self, filename: &[u8], contents: &[u8]) -> PathBuf {
+        let hash = stable_hash(&[Self::CACHE_VERSION.as_bytes(), filename, contents]);
+        self.cache_dir.join(format!("{:032x}.pb", hash))
+    }
+
+    /// Writes a cache entry atomically, so that concurrent processes never
+    /// observe a partially written entry.
+    fn write_cache(&self, path: &Path, file: &FileDescriptorProto) -> Result<(), Box<dyn Error>> {
+        fs::create_dir_all(&self.cache_dir)?;
+        let tmp_path = path.with_extension(format!("{}.tmp", process::id()));
+        fs::write(&tmp_path, file.serialize()?)?;
+        if let Err(e) = fs::rename(&tmp_path, path) {
+            let _ = fs::remove_file(&tmp_path);
+            return Err(e.into());
+        }
+        Ok(())
+    }
+
+    fn report_errors(&mut self, errors: Vec<ffi::FileLoadError>) {
+        if let Some(error_collector) = &mut self.error_collector {
+            for error in errors {
+                let line = CInt::expect_from(error.line).0;
+                let column = CInt::expect_from(error.column).0;
+                let error_collector = error_collector.as_mut();
+                match error.warning {
+                    true => {
+                        error_collector.add_warning(&error.filename, line, column, &error.message)
+                    }
+                    false => {
+                        error_collector.add_error(&error.filename, line, column, &error.message)
+                    }
+                }
+            }
+        }
+    }
+}
+
+impl<'a> DescriptorDatabase for CachingSourceTreeDescriptorDatabase<'a> {
+    fn find_file_by_name(
+        self: Pin<&mut Self>,
+        filename: &Path,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        let this = self.get_mut();
+        let name = ProtobufPath::from(filename);
+        let contents = match this.read_file(filename) {
+            Ok(contents) => contents,
+            Err(e) => {
+                this.report_errors(vec![ffi::FileLoadError {
+                    filename: String::from_utf8_lossy(name.as_bytes()).into_owned(),
+                    line: -1,
+                    column: 0,
+                    message: e.to_string(),
+                    warning: false,
+                }]);
+                return Err(OperationFailedError);
+            }
+        };
+
+        let cache_path = this.cache_path(name.as_bytes(), &contents);
+        let mut fd = FileDescriptorProto::new();
+        if let Ok(cached) = fs::read(&cache_path) {
+            if fd.as_mut().parse_from_bytes(&cached).is_ok() {
+                return Ok(fd);
+            }
+        }
+
+        let mut errors = vec![];
+        let ok = unsafe {
+            ffi::ParseFileContents(
+                name.into(),
+                &contents,
+                fd.as_mut().as_ffi_mut_ptr(),
+                &mut errors,
+            )
+        };
+        this.report_errors(errors);
+        if !ok {
+            return Err(OperationFailedError);
+        }
+        let _ = this.write_cache(&cache_path, &fd);
+        Ok(fd)
+    }
+}
+
+/// Keeps the .proto files parsed from a [`SourceTree`], along with the import
+/// graph between them, so that sets of files can be rebuilt after some of
+/// them change without reparsing the rest.
+///
+/// The workspace does not watch the source tree itself. Callers must report
+/// each file that is changed, added, or removed with
+/// [`ProtoWorkspace::file_changed`]; only those files are parsed again by the
+/// next call to [`ProtoWorkspace::build_file_descriptor_set`].
+pub struct ProtoWorkspace<'a> {
+    db: Pin<Box<SourceTreeDescriptorDatabase<'a>>>,
+    files: HashMap<Vec<u8>, Pin<Box<FileDescriptorProto>>>,
+    // Maps each file to the parsed files that import it.
+    dependents: HashMap<Vec<u8>, HashSet<Vec<u8>>>,
+}
+
+impl<'a> ProtoWorkspace<'a> {
+    /// Constructs a new, empty workspace for the provided source tree.
+    pub fn new(source_tree: Pin<&'a mut dyn SourceTree>) -> ProtoWorkspace<'a> {
+        ProtoWorkspace {
+            db: SourceTreeDescriptorDatabase::new(source_tree),
+            files: HashMap::new(),
+            dependents: HashMap::new(),
+        }
+    }
+
+    /// Instructs the workspace to report any parse errors to the given
+    /// [`MultiFileErrorCollector`].
+    pub fn record_errors_to(&mut self, error_collector: Pin<&'a mut dyn MultiFileErrorCollector>) {
+        self.db.as_mut().record_errors_to(error_collector)
+    }
+
+    /// Controls whether parsed files include their source code info.
+    ///
+    /// See [`SourceTreeDescriptorDatabase::set_include_source_code_info`].
+    /// Only affects files parsed after the call.
+    pub fn set_include_source_code_info(&mut self, include: bool) {
+        self.db.as_mut().set_include_source_code_info(include)
+    }
+
+    /// Reports that the named file has changed, been added, or been removed.
+    ///
+    /// Returns the files whose definitions may now differ: the named file, if
+    /// it had been parsed, followed by every parsed file that imports it,
+    /// directly or indirectly. Only the named file itself is parsed again, as
+    /// a file's dependencies do not affect how it parses.
+    pub fn file_changed(&mut self, filename: &Path) -> Vec<PathBuf> {
+        let name = ProtobufPath::from(filename).as_bytes().to_vec();
+        let mut affected = vec![];
+        if let Some(file) = self.files.remove(&name) {
+            for i in 0..file.dependency_size() {
+                if let Some(dependents) = self.dependents.get_mut(file.dependency(i)) {
+                    dependents.remove(&name);
+                }
+            }
+            affected.push(name.clone());
+        }
+        let mut seen = HashSet::from([name.clone()]);
+        let mut queue = VecDeque::from([name]);
+        while let Some(name) = queue.pop_front() {
+            for dependent in self.dependents.get(&name).into_iter().flatten() {
+                if seen.insert(dependent.clone()) {
+                    affected.push(dependent.clone());
+                    queue.push_back(dependent.clone());
+                }
+            }
+        }
+        affected
+            .iter()
+            .map(|name| {
+                ProtobufPath::from(&name[..])
+                    .as_path()
+                    .as_ref()
+                    .to_path_buf()
+            })
+            .collect()
+    }
+
+    /// Forgets all parsed files, so that every file is parsed again.
+    pub fn clear(&mut self) {
+        self.files.clear();
+        self.dependents.clear();
+    }
+
+    /// Builds a file descriptor set containing all file descriptor protos
+    /// reachable from the specified roots, parsing only those files that have
+    /// not been parsed before or have changed since.
+    pub fn build_file_descriptor_set<P>(
+        &mut self,
+        roots: &[P],
+    ) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
+    where
+        P: AsRef<Path>,
+    {
+        build_file_descriptor_set(roots, |filename, out| {
+            let file = self.file(filename)?;
+            out.add_file().copy_from(file);
+            Ok(())
+        })
+    }
+
+    /// Returns the named file, parsing it if necessary.
+    fn file(&mut self, filename: &Path) -> Result<&FileDescriptorProto, OperationFailedError> {
+        let name = ProtobufPath::from(filename).as_bytes().to_vec();
+        if !self.files.contains_key(&name) {
+            let file = self.db.as_mut().find_file_by_name(filename)?;
+            for i in 0..file.dependency_size() {
+                self.dependents
+                    .entry(file.dependency(i).to_vec())
+                    .or_default()
+                    .insert(name.clone());
+            }
+            self.files.insert(name.clone(), file);
+        }
+        Ok(&self.files[&name])
+    }
+}
+
+impl<'a> DescriptorDatabase for ProtoWorkspace<'a> {
+    fn find_file_by_name(
+        self: Pin<&mut Self>,
+        filename: &Path,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        let file = self.get_mut().file(filename)?;
+        let mut copy = FileDescriptorProto::new();
+        copy.as_mut().copy_from(file);
+        Ok(copy)
+    }
+}
+
+/// A long-lived compiler that keeps parsed .proto files, and the descriptors
+/// built from them, in memory between compilations.
+///
+/// Editors and build systems tend to compile the same files over and over.
+/// A compile server parses each file once, and on later compilations only
+/// checks whether the file has changed on disk: a file whose modification
+/// time and size are unchanged is not read again, and a file whose contents
+/// hash to the same value as before is not parsed again. Files are also
+/// built into a resident [`DescriptorPool`], which is only rebuilt from the
+/// parsed files when one of the files in it has changed.
+///
+/// Files are located like by a [`DiskSourceTree`], by mapping locations in
+/// the source tree to paths on disk with [`CompileServer::map_path`].
+///
+/// On Unix, the server can answer compilation requests from other processes
+/// over a Unix socket with [`CompileServer::serve`]; see
+/// [`compile_remote`] for the client side.
+///
+/// Changes are detected by modification time, so a file that is rewritten
+/// with the same size within the granularity of the file system's
+/// timestamps could go unnoticed. To guard against this, files modified
+/// shortly before they were last checked are always hashed again. Call
+/// [`CompileServer::clear`] to forget all files if in doubt.
+pub struct CompileServer {
+    mappings: Vec<(Vec<u8>, PathBuf)>,
+    files: HashMap<Vec<u8>, ServedFile>,
+    pool: Option<Pin<Box<DescriptorPool<'static>>>>,
+    // The names of the files built in `pool`.
+    pool_files: HashSet<Vec<u8>>,
+    request_timeout: Duration,
+}
+
+struct ServedFile {
+    disk_path: PathBuf,
+    modified: Option<SystemTime>,
+    len: u64,
+    checked: SystemTime,
+    hash: u128,
+    proto: Pin<Box<FileDescriptorProto>>,
+}
+
+impl CompileServer {
+    /// How long before it was last checked a file must have been modified for
+    /// its modification time to be trusted.
+    const RACY_WINDOW: Duration = Duration::from_secs(2);
+
+    /// Constructs a new compile server with no mapped paths.
+    pub fn new() -> CompileServer {
+        CompileServer {
+            mappings: vec![],
+            files: HashMap::new(),
+            pool: None,
+            pool_files: HashSet::new(),
+            request_timeout: Duration::from_secs(10),
+        }
+    }
+
+    /// Sets how long [`CompileServer::handle`] waits for a client to send
+    /// its request, or to accept the response, before giving up on it.
+    /// Defaults to ten seconds.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `timeout` is zero.
+    pub fn set_request_timeout(&mut self, timeout: Duration) {
+        assert!(!timeout.is_zero(), "request timeout must be nonzero");
+        self.request_timeout = timeout;
+    }
+
+    /// Maps a path on disk to a location in the source tree.
+    ///
+    /// Mappings are searched in order, as described in
+    /// [`DiskSourceTree::map_path`].
+    pub fn map_path(&mut self, virtual_path: &Path, disk_path: &Path) {
+        let virtual_path = ProtobufPath::from(virtual_path).as_bytes().to_vec();
+        self.mappings.push((virtual_path, disk_path.to_path_buf()));
+        // The same name may now resolve to a different file on disk, which
+        // the next compilation will notice.
+    }
+
+    /// Forgets all parsed files and the descriptor pool, so that every file
+    /// is read and parsed again.
+    pub fn clear(&mut self) {
+        self.files.clear();
+        self.pool = None;
+        self.pool_files.clear();
+    }
+
+    /// Returns the descriptor pool containing the files of every successful
+    /// compilation since the pool was last rebuilt, or `None` if nothing has
+    /// been compiled yet.
+    pub fn pool(&self) -> Option<&DescriptorPool<'static>> {
+        self.pool.as_deref()
+    }
+
+    /// Compiles the specified roots and all the files they import, directly
+    /// or indirectly, returning them as a file descriptor set.
+    ///
+    /// Only files that have changed since they were last compiled are parsed.
+    /// The files are also built into the server's descriptor pool, which
+    /// reports semantic errors, like references to undefined types.
+    pub fn compile<P>(&mut self, roots: &[P]) -> Result<Pin<Box<FileDescriptorSet>>, CompileError>
+    where
+        P: AsRef<Path>,
+    {
+        let mut errors = vec![];
+        let mut changed = false;
+        let set = build_file_descriptor_set(roots, |filename, out| {
+            let name = ProtobufPath::from(filename).as_bytes().to_vec();
+            match self.refresh(&name) {
+                Ok(file_changed) => {
+                    changed |= file_changed && self.pool_files.contains(&name);
+                    out.add_file().copy_from(&self.files[&name].proto);
+                    Ok(())
+                }
+                Err(e) => {
+                    errors.extend(e.into_iter().map(FileLoadError::from));
+                    Err(OperationFailedError)
+                }
+            }
+        });
+        let set = match set {
+            Ok(set) => set,
+            Err(OperationFailedError) => return Err(CompileError::Load(errors)),
+        };
+
+        if changed {
+            self.pool = None;
+            self.pool_files.clear();
+        }
+        let pool = self.pool.get_or_insert_with(DescriptorPool::new);
+        let mut new_files = FileDescriptorSet::new();
+        for i in 0..set.file_size() {
+            let file = set.file(i);
+            if !self.pool_files.contains(file.name()) {
+                new_files.as_mut().add_file().copy_from(file);
+            }
+        }
+        if let Err(e) = pool.as_mut().build_file_set(&new_files) {
+            // Files that did build remain in the pool, under names that are
+            // not recorded; start over next time.
+            self.pool = None;
+            self.pool_files.clear();
+            return Err(CompileError::Build(e));
+        }
+        for i in 0..new_files.file_size() {
+            self.pool_files.insert(new_files.file(i).name().to_vec());
+        }
+        Ok(set)
+    }
 
-mod multi_file_error_collector {
-    use std::pin::Pin;
+    /// Answers compilation requests from clients connecting to `listener`,
+    /// one at a time, until accepting a connection fails.
+    ///
+    /// Each request is a list of root files, separated by newlines, which the
+    /// client terminates by shutting down its side of the connection. The
+    /// response is a status byte, followed by either the encoded
+    /// [`FileDescriptorSet`], if the status byte is zero, or a description of
+    /// the errors, after which the server closes the connection. Failures to
+    /// communicate with an individual client are ignored, including clients
+    /// that exceed the [request timeout](CompileServer::set_request_timeout),
+    /// so that a stalled client cannot block the server.
+    #[cfg(unix)]
+    pub fn serve(&mut self, listener: &UnixListener) -> io::Result<()> {
+        loop {
+            let (stream, _) = listener.accept()?;
+            let _ = self.handle(stream);
+        }
+    }
 
-    use super::ffi;
+    /// Answers a single compilation request from `stream`, as described in
+    /// [`CompileServer::serve`].
+    #[cfg(unix)]
+    pub fn handle(&mut self, mut stream: UnixStream) -> io::Result<()> {
+        stream.set_read_timeout(Some(self.request_timeout))?;
+        stream.set_write_timeout(Some(self.request_timeout))?;
+        let mut request = vec![];
+        stream.read_to_end(&mut request)?;
+        let roots: Vec<_> = request
+            .split(|b| *b == b'\n')
+            .filter(|root| !root.is_empty())
+            .map(|root| ProtobufPath::from(root).as_path().as_ref().to_path_buf())
+            .collect();
+        let response = match self.compile(&roots).map(|set| set.serialize()) {
+            Ok(Ok(encoded)) => (0, encoded),
+            Ok(Err(OperationFailedError)) => (1, b"failed to encode file set".to_vec()),
+            Err(e) => (1, e.to_string().into_bytes()),
+        };
+        stream.write_all(&[response.0])?;
+        stream.write_all(&response.1)
+    }
 
-    pub trait Sealed {
-        fn upcast(&self) -> &ffi::MultiFileErrorCollector;
-        fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MultiFileErrorCollector>;
-        unsafe fn upcast_mut_ptr(self: Pin<&mut Self>) -> *mut ffi::MultiFileErrorCollector {
-            self.upcast_mut().get_unchecked_mut() as *mut _
+    /// Makes sure that the named file is parsed and up to date, returning
+    /// whether it was parsed again.
+    fn refresh(&mut self, name: &[u8]) -> Result<bool, Vec<ffi::FileLoadError>> {
+        let load_error = |message: String| ffi::FileLoadError {
+            filename: String::from_utf8_lossy(name).into_owned(),
+            line: -1,
+            column: 0,
+            message,
+            warning: false,
+        };
+        let (disk_path, metadata) = match self.resolve(name) {
+            Ok(resolved) => resolved,
+            Err(message) => {
+                self.files.remove(name);
+                return Err(vec![load_error(message.into())]);
+            }
+        };
+        let modified = metadata.modified().ok();
+        let now = SystemTime::now();
+        if let Some(file) = self.files.get_mut(name) {
+            let racy = match (modified, file.checked.checked_sub(Self::RACY_WINDOW)) {
+                (Some(modified), Some(trusted)) => modified >= trusted,
+                _ => true,
+            };
+            if file.disk_path == disk_path
+                && file.modified == modified
+                && file.len == metadata.len()
+                && !racy
+            {
+                return Ok(false);
+            }
+        }
+
+        let contents = fs::read(&disk_path).map_err(|e| vec![load_error(e.to_string())])?;
+        let hash = stable_hash(&[&contents]);
+        if let Some(file) = self.files.get_mut(name) {
+            if file.disk_path == disk_path && file.hash == hash {
+                file.modified = modified;
+                file.len = contents.len() as u64;
+                file.checked = now;
+                return Ok(false);
+            }
         }
+        let mut proto = FileDescriptorProto::new();
+        let mut errors = vec![];
+        let ok = unsafe {
+            ffi::ParseFileContents(
+                ProtobufPath::from(name).into(),
+                &contents,
+                proto.as_mut().as_ffi_mut_ptr(),
+                &mut errors,
+            )
+        };
+        if !ok {
+            self.files.remove(name);
+            return Err(errors);
+        }
+        self.files.insert(
+            name.to_vec(),
+            ServedFile {
+                disk_path,
+                modified,
+                len: contents.len() as u64,
+                checked: now,
+                hash,
+                proto,
+            },
+        );
+        Ok(true)
     }
-}
 
-/// A simple implementation of [`MultiFileErrorCollector`] that records errors
-/// in memory for later retrieval.
-pub struct SimpleErrorCollector {
-    _opaque: PhantomPinned,
+    /// Finds the file on disk that the named file maps to, using the same
+    /// rules as [`DiskSourceTree`].
+    ///
+    /// In particular, names that are not canonical, or that refer to a
+    /// parent directory, are rejected, and the empty virtual path does not
+    /// match absolute names, so that no name resolves to a file outside the
+    /// mapped directories.
+    fn resolve(&self, name: &[u8]) -> Result<(PathBuf, fs::Metadata), &'static str> {
+        if !is_canonical_virtual_path(name) {
+            return Err(
+                "Backslashes, consecutive slashes, \".\", or \"..\" are not allowed in the \
+                 virtual path",
+            );
+        }
+        for (virtual_path, disk_path) in &self.mappings {
+            let rest = if virtual_path.is_empty() {
+                if is_absolute_virtual_path(name) {
+                    continue;
+                }
+                name
+            } else if name == &virtual_path[..] {
+                &[][..]
+            } else if name.starts_with(virtual_path) && name[virtual_path.len()] == b'/' {
+                &name[virtual_path.len() + 1..]
+            } else {
+                continue;
+            };
+            let path = match rest.is_empty() {
+                true => disk_path.clone(),
+                false => disk_path.join(ProtobufPath::from(rest).as_path()),
+            };
+            if let Ok(metadata) = fs::metadata(&path) {
+                if metadata.is_file() {
+                    return Ok((path, metadata));
+                }
+            }
+        }
+        Err("File not found.")
+    }
 }
 
-impl Drop for SimpleErrorCollector {
-    fn drop(&mut self) {
-        unsafe { ffi::DeleteSimpleErrorCollector(self.as_ffi_mut_ptr_unpinned()) }
+/// Reports whether `name` is unchanged by `DiskSourceTree`'s path
+/// canonicalization and contains no `..` components, which
+/// `DiskSourceTree` requires of the files it opens.
+fn is_canonical_virtual_path(name: &[u8]) -> bool {
+    #[cfg(windows)]
+    if name.contains(&b'\\') {
+        return false;
     }
+    let last = name.split(|b| *b == b'/').count() - 1;
+    name.split(|b| *b == b'/')
+        .enumerate()
+        .all(|(i, part)| match part {
+            // Only a leading or trailing slash yields an empty component.
+            b"" => i == 0 || i == last,
+            b"." | b".." => false,
+            _ => true,
+        })
 }
 
-impl SimpleErrorCollector {
-    /// Creates a new simple error collector.
-    pub fn new() -> Pin<Box<SimpleErrorCollector>> {
-        let collector = ffi::NewSimpleErrorCollector();
-        unsafe { Self::from_ffi_owned(collector) }
+/// Reports whether `name` is absolute, in which case the empty virtual path
+/// does not match it.
+fn is_absolute_virtual_path(name: &[u8]) -> bool {
+    if name.starts_with(b"/") {
+        return true;
     }
-
-    unsafe_ffi_conversions!(ffi::SimpleErrorCollector);
+    // A drive letter followed by a separator, like `C:/`.
+    cfg!(any(windows, target_os = "cygwin"))
+        && name.len() >= 3
+        && name[0].is_ascii_alphabetic()
+        && name[1] == b':'
+        && (name[2] == b'/' || name[2] == b'\\')
 }
 
-impl<'a> Iterator for Pin<&'a mut SimpleErrorCollector> {
-    type Item = FileLoadError;
-
-    fn next(&mut self) -> Option<FileLoadError> {
-        self.as_mut().as_ffi_mut().Errors().pop().map(Into::into)
+impl Default for CompileServer {
+    fn default() -> CompileServer {
+        CompileServer::new()
     }
 }
 
-impl MultiFileErrorCollector for SimpleErrorCollector {}
-
-impl multi_file_error_collector::Sealed for SimpleErrorCollector {
-    fn upcast(&self) -> &ffi::MultiFileErrorCollector {
-        unsafe { mem::transmute(self) }
+/// Asks the [`CompileServer`] listening on the Unix socket at `socket_path`
+/// to compile the specified roots, returning the compiled file descriptor
+/// set.
+#[cfg(unix)]
+pub fn compile_remote<P>(
+    socket_path: &Path,
+    roots: &[P],
+) -> Result<Pin<Box<FileDescriptorSet>>, RemoteCompileError>
+where
+    P: AsRef<Path>,
+{
+    let mut stream = UnixStream::connect(socket_path)?;
+    let mut request = vec![];
+    for root in roots {
+        request.extend_from_slice(ProtobufPath::from(root.as_ref()).as_bytes());
+        request.push(b'\n');
     }
-
-    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MultiFileErrorCollector> {
-        unsafe { mem::transmute(self) }
+    stream.write_all(&request)?;
+    stream.shutdown(Shutdown::Write)?;
+    let mut response = vec![];
+    stream.read_to_end(&mut response)?;
+    match response.split_first() {
+        Some((0, encoded)) => {
+            let mut set = FileDescriptorSet::new();
+            set.as_mut().parse_from_bytes(encoded).map_err(|_| {
+                RemoteCompileError::Compile("malformed response from compile server".into())
+            })?;
+            Ok(set)
+        }
+        Some((_, message)) => Err(RemoteCompileError::Compile(
+            String::from_utf8_lossy(message).into_owned(),
+        )),
+        None => Err(RemoteCompileError::Compile(
+            "empty response from compile server".into(),
+        )),
     }
 }
 
-/// An implementation of `DescriptorDatabase` which loads files from a
-/// `SourceTree` and parses them.
+// SAFETY: `ParseFile` may be called from multiple threads at once.
+unsafe impl Sync for ffi::ParallelSourceTreeParser {}
+
+/// Parses .proto files from a [`SourceTree`] on several threads at once.
 ///
-/// Note: This class does not implement `FindFileContainingSymbol` or
-/// `FindFileContainingExtension`; these will always return false.
-pub struct SourceTreeDescriptorDatabase<'a> {
+/// Parsing is performed in the same way as by [`SourceTreeDescriptorDatabase`].
+/// The source tree itself is not thread-safe, so opening files is serialized,
+/// but the opened files are tokenized and parsed concurrently.
+pub struct ParallelSourceTreeParser<'a> {
     _opaque: PhantomPinned,
     _lifetime: PhantomData<&'a ()>,
 }
 
-impl<'a> Drop for SourceTreeDescriptorDatabase<'a> {
+impl<'a> Drop for ParallelSourceTreeParser<'a> {
     fn drop(&mut self) {
-        unsafe { ffi::DeleteSourceTreeDescriptorDatabase(self.as_ffi_mut_ptr_unpinned()) }
+        unsafe { ffi::DeleteParallelSourceTreeParser(self.as_ffi_mut_ptr_unpinned()) }
     }
 }
 
-impl<'a> SourceTreeDescriptorDatabase<'a> {
-    /// Constructs a new descriptor database for the provided source tree.
-    pub fn new(
-        source_tree: Pin<&'a mut dyn SourceTree>,
-    ) -> Pin<Box<SourceTreeDescriptorDatabase<'a>>> {
-        let db = unsafe { ffi::NewSourceTreeDescriptorDatabase(source_tree.upcast_mut_ptr()) };
-        unsafe { Self::from_ffi_owned(db) }
+impl<'a> ParallelSourceTreeParser<'a> {
+    /// Constructs a new parser for the provided source tree.
+    pub fn new(source_tree: Pin<&'a mut dyn SourceTree>) -> Pin<Box<ParallelSourceTreeParser<'a>>> {
+        let parser = unsafe { ffi::NewParallelSourceTreeParser(source_tree.upcast_mut_ptr()) };
+        unsafe { Self::from_ffi_owned(parser) }
     }
 
-    /// Instructs the source tree descriptor database to report any parse errors
-    /// to the given [`MultiFileErrorCollector`].
+    /// Instructs the parser to report any parse errors to the given
+    /// [`MultiFileErrorCollector`].
     ///
-    /// This should b ecalled before parsing.
+    /// Errors are reported in a deterministic order, regardless of the number
+    /// of threads. This should be called before parsing.
     pub fn record_errors_to(
         self: Pin<&mut Self>,
         error_collector: Pin<&'a mut dyn MultiFileErrorCollector>,
@@ -250,58 +1383,221 @@ impl<'a> SourceTreeDescriptorDatabase<'a> {
         }
     }
 
+    /// Controls whether large files may be split into chunks that are parsed
+    /// concurrently.
+    ///
+    /// When enabled, files that are parsed while there are fewer files to parse
+    /// than threads, such as a single large root file, are split along their
+    /// top-level definitions, and the chunks are parsed on all of the threads
+    /// given to `build_file_descriptor_set`. Only files larger than about 128 KiB that consist of a header
+    /// followed by top-level definitions are split. Split files lack source
+    /// code info, but are otherwise identical to the files that would be
+    /// parsed without splitting.
+    ///
+    /// Disabled by default.
+    pub fn set_split_large_files(self: Pin<&mut Self>, split: bool) {
+        self.as_ffi_mut().SetSplitLargeFiles(split)
+    }
+
     /// Builds a file descriptor set containing all file descriptor protos
-    /// reachable from the specified roots.
+    /// reachable from the specified roots, parsing up to `threads` files at
+    /// once.
+    ///
+    /// Files are discovered breadth first: all of the dependencies of the
+    /// files found so far are parsed concurrently before their own
+    /// dependencies are discovered. The resulting set, unlike the one built by
+    /// [`SourceTreeDescriptorDatabase::build_file_descriptor_set`], lists the
+    /// files in breadth-first order, which does not depend on the number of
+    /// threads.
     pub fn build_file_descriptor_set<P>(
+        self: Pin<&mut Self>,
+        roots: &[P],
+        threads: usize,
+    ) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
+    where
+        P: AsRef<Path>,
+    {
+        let span = trace::span!("build_file_descriptor_set", roots, files, threads);
+        span.record_u64("roots", || roots.len() as u64);
+        span.record_u64("threads", || threads as u64);
+        let out = self.collect_file_descriptor_set(roots, threads);
+        finish_build_span(span, &out);
+        out
+    }
+
+    fn collect_file_descriptor_set<P>(
         mut self: Pin<&mut Self>,
         roots: &[P],
+        threads: usize,
     ) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError>
     where
         P: AsRef<Path>,
     {
         let mut out = FileDescriptorSet::new();
         let mut seen = HashSet::new();
-        let mut stack = vec![];
+        let mut frontier = vec![];
         for root in roots {
-            let root = root.as_ref();
-            stack.push(self.as_mut().find_file_by_name(root)?);
-            seen.insert(ProtobufPath::from(root).as_bytes().to_vec());
+            let root = ProtobufPath::from(root.as_ref()).as_bytes().to_vec();
+            if seen.insert(root.clone()) {
+                frontier.push(root);
+            }
         }
-        while let Some(file) = stack.pop() {
-            out.as_mut().add_file().copy_from(&file);
-            for i in 0..file.dependency_size() {
-                let dep_path = ProtobufPath::from(file.dependency(i));
-                if !seen.contains(dep_path.as_bytes()) {
-                    let dep = self
-                        .as_mut()
-                        .find_file_by_name(dep_path.as_path().as_ref())?;
-                    stack.push(dep);
-                    seen.insert(dep_path.as_bytes().to_vec());
+        while !frontier.is_empty() {
+            let mut next = vec![];
+            let mut failed = false;
+            for (file, errors) in self.as_ref().get_ref().parse_files(&frontier, threads) {
+                self.as_mut().as_ffi_mut().RecordErrors(&errors);
+                let file = match file {
+                    Some(file) => file,
+                    None => {
+                        failed = true;
+                        continue;
+                    }
+                };
+                for i in 0..file.dependency_size() {
+                    let dep = file.dependency(i);
+                    if !seen.contains(dep) {
+                        seen.insert(dep.to_vec());
+                        next.push(dep.to_vec());
+                    }
                 }
+                out.as_mut().add_allocated_file(file);
             }
+            if failed {
+                return Err(OperationFailedError);
+            }
+            frontier = next;
         }
         Ok(out)
     }
 
-    unsafe_ffi_conversions!(ffi::SourceTreeDescriptorDatabase);
-}
+    /// Parses `filenames` on up to `threads` threads, returning the result and
+    /// errors for each file in order.
+    fn parse_files(
+        &self,
+        filenames: &[Vec<u8>],
+        threads: usize,
+    ) -> Vec<(
+        Option<Pin<Box<FileDescriptorProto>>>,
+        Vec<ffi::FileLoadError>,
+    )> {
+        let parser = self.as_ffi();
+        if parser.SplitLargeFiles() && filenames.len() < threads {
+            return filenames
+                .iter()
+                .map(|filename| self.parse_split_file(filename, threads))
+                .collect();
+        }
+        let next = AtomicUsize::new(0);
+        let mut results: Vec<_> = thread::scope(|s| {
+            let workers: Vec<_> = (0..threads.clamp(1, filenames.len()))
+                .map(|_| {
+                    s.spawn(|| {
+                        let mut results = vec![];
+                        loop {
+                            let i = next.fetch_add(1, Ordering::Relaxed);
+                            let filename = match filenames.get(i) {
+                                Some(filename) => ProtobufPath::from(&filename[..]),
+                                None => break,
+                            };
+                            let mut file = FileDescriptorProto::new();
+                            let mut errors = vec![];
+                            let ok = unsafe {
+                                parser.ParseFile(
+                                    filename.into(),
+                                    file.as_mut().as_ffi_mut_ptr(),
+                                    &mut errors,
+                                )
+                            };
+                            results.push((i, ok.then_some(file), errors));
+                        }
+                        results
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .flat_map(|worker| worker.join().expect("parser thread panicked"))
+                .collect()
+        });
+        results.sort_by_key(|(i, _, _)| *i);
+        results
+            .into_iter()
+            .map(|(_, file, errors)| (file, errors))
+            .collect()
+    }
 
-impl<'a> DescriptorDatabase for SourceTreeDescriptorDatabase<'a> {
-    fn find_file_by_name(
-        self: Pin<&mut Self>,
-        filename: &Path,
-    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
-        let mut fd = FileDescriptorProto::new();
-        let_cxx_string!(filename = ProtobufPath::from(filename).as_bytes());
-        if unsafe {
-            self.as_ffi_mut()
-                .FindFileByName(&filename, fd.as_mut().as_ffi_mut_ptr())
-        } {
-            Ok(fd)
-        } else {
-            Err(OperationFailedError)
+    /// Parses `filename` by splitting it into up to `threads` chunks that are
+    /// parsed concurrently.
+    fn parse_split_file(
+        &self,
+        filename: &[u8],
+        threads: usize,
+    ) -> (
+        Option<Pin<Box<FileDescriptorProto>>>,
+        Vec<ffi::FileLoadError>,
+    ) {
+        let mut contents = vec![];
+        let mut errors = vec![];
+        let name = ProtobufPath::from(filename);
+        if !self
+            .as_ffi()
+            .ReadFile(name.into(), &mut contents, &mut errors)
+        {
+            return (None, errors);
+        }
+        let mut header_end = 0;
+        let begins = ffi::SplitFileContents(&contents, threads, &mut header_end);
+        let ends = begins.iter().skip(1).copied().chain([contents.len()]);
+        let contents = &contents[..];
+        let chunks: Vec<_> = thread::scope(|s| {
+            let workers: Vec<_> = begins
+                .iter()
+                .zip(ends)
+                .map(|(&begin, end)| {
+                    s.spawn(move || {
+                        let mut chunk = FileDescriptorProto::new();
+                        let mut errors = vec![];
+                        let ok = unsafe {
+                            ffi::ParseFileChunk(
+                                ProtobufPath::from(filename).into(),
+                                contents,
+                                header_end,
+                                begin,
+                                end,
+                                chunk.as_mut().as_ffi_mut_ptr(),
+                                &mut errors,
+                            )
+                        };
+                        (ok.then_some(chunk), errors)
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .map(|worker| worker.join().expect("parser thread panicked"))
+                .collect()
+        });
+
+        let mut file: Option<Pin<Box<FileDescriptorProto>>> = None;
+        let mut failed = false;
+        for (chunk, chunk_errors) in chunks {
+            errors.extend(chunk_errors);
+            match (chunk, &mut file) {
+                (None, _) => failed = true,
+                (Some(chunk), None) => file = Some(chunk),
+                (Some(mut chunk), Some(file)) => {
+                    ffi::MergeFileChunk(file.as_mut().as_ffi_mut(), chunk.as_mut().as_ffi_mut())
+                }
+            }
+        }
+        match failed {
+            true => (None, errors),
+            false => (file, errors),
         }
     }
+
+    unsafe_ffi_conversions!(ffi::ParallelSourceTreeParser);
 }
 
 /// Abstract interface which represents a directory tree containing .proto
@@ -311,7 +1607,9 @@ impl<'a> DescriptorDatabase for SourceTreeDescriptorDatabase<'a> {
 /// statements. Most users will probably want to use the `DiskSourceTree`
 /// implementation.
 ///
-/// This trait is sealed and cannot be implemented outside of this crate.
+/// This trait is sealed and cannot be implemented outside of this crate. To
+/// provide files from Rust, implement [`CustomSourceTree`] and wrap it in a
+/// [`RustSourceTree`].
 pub trait SourceTree: source_tree::Sealed {
     /// Opens the given file and return a stream that reads it.
     ///
@@ -372,6 +1670,18 @@ impl VirtualSourceTree {
         self.as_ffi_mut().AddFile(filename.into(), contents)
     }
 
+    /// Adds a file to the source tree with the specified name and contents,
+    /// without copying the contents.
+    ///
+    /// The source tree holds a reference to `contents` for as long as the file
+    /// remains in the tree, so the same contents can be shared by several
+    /// trees, or retained by the caller, at no cost.
+    pub fn add_shared_file(self: Pin<&mut Self>, filename: &Path, contents: Arc<[u8]>) {
+        let filename = ProtobufPath::from(filename);
+        self.as_ffi_mut()
+            .AddSharedFile(filename.into(), Box::new(SharedBytes(contents)))
+    }
+
     unsafe_ffi_conversions!(ffi::VirtualSourceTree);
 }
 
@@ -467,10 +1777,210 @@ impl source_tree::Sealed for DiskSourceTree {
     }
 }
 
+/// A source of .proto files implemented in Rust.
+///
+/// Wrap an implementation in a [`RustSourceTree`] to use it wherever a
+/// [`SourceTree`] is required.
+pub trait CustomSourceTree {
+    /// Opens the given file and returns a stream that reads it.
+    ///
+    /// The filename is a path relative to the root of the source tree. The
+    /// returned stream may borrow from the source tree, e.g. to serve the
+    /// file's contents directly from memory with a
+    /// [`SliceInputStream`](crate::io::SliceInputStream).
+    fn open(
+        &self,
+        filename: &Path,
+    ) -> Result<Pin<Box<dyn ZeroCopyInputStream + '_>>, FileOpenError>;
+}
+
+/// An implementation of `SourceTree` which opens files with a
+/// [`CustomSourceTree`].
+pub struct RustSourceTree<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for RustSourceTree<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteRustSourceTree(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> RustSourceTree<'a> {
+    /// Creates a new source tree that opens files with `source_tree`.
+    pub fn new(source_tree: Box<dyn CustomSourceTree + 'a>) -> Pin<Box<RustSourceTree<'a>>> {
+        let tree = ffi::NewRustSourceTree(Box::new(SourceTreeAdaptor(source_tree)));
+        unsafe { Self::from_ffi_owned(tree) }
+    }
+
+    unsafe_ffi_conversions!(ffi::RustSourceTree);
+}
+
+impl<'a> SourceTree for RustSourceTree<'a> {}
+
+impl<'a> source_tree::Sealed for RustSourceTree<'a> {
+    fn upcast(&self) -> &ffi::SourceTree {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::SourceTree> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// An implementation of `SourceTree` which caches the results of opening files
+/// in another source tree.
+///
+/// The first time a file is opened, its contents are read into memory, or, if
+/// it cannot be opened, the error message is remembered. Later attempts to
+/// open the file are served from memory without consulting the underlying
+/// source tree. This is most useful in front of a [`DiskSourceTree`] with many
+/// mapped paths, where resolving each import may probe many locations on
+/// disk.
+///
+/// The cache is never invalidated automatically; call
+/// [`CachingSourceTree::clear`] if the underlying files may have changed.
+pub struct CachingSourceTree<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for CachingSourceTree<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCachingSourceTree(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> CachingSourceTree<'a> {
+    /// Creates a new source tree that caches the results of opening files in
+    /// `source_tree`.
+    pub fn new(source_tree: Pin<&'a mut dyn SourceTree>) -> Pin<Box<CachingSourceTree<'a>>> {
+        let tree = unsafe { ffi::NewCachingSourceTree(source_tree.upcast_mut_ptr()) };
+        unsafe { Self::from_ffi_owned(tree) }
+    }
+
+    /// Forgets the results of opening all files.
+    pub fn clear(self: Pin<&mut Self>) {
+        self.as_ffi_mut().Clear()
+    }
+
+    unsafe_ffi_conversions!(ffi::CachingSourceTree);
+}
+
+impl<'a> SourceTree for CachingSourceTree<'a> {}
+
+impl<'a> source_tree::Sealed for CachingSourceTree<'a> {
+    fn upcast(&self) -> &ffi::SourceTree {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::SourceTree> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// An implementation of `SourceTree` which memory maps files from locations on
+/// disk.
+///
+/// Paths are mapped to locations on disk exactly as with [`DiskSourceTree`],
+/// but opened files are mapped into memory and read in place, rather than
+/// copied through a buffer.
+///
+/// Mappings may be kept in a [`MappedFileCache`] shared by several trees, so
+/// that a file opened by several trees, or opened several times, is only
+/// mapped once.
+pub struct MmapSourceTree {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for MmapSourceTree {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMmapSourceTree(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl MmapSourceTree {
+    /// Creates a new memory-mapped source tree with its own mapping cache.
+    pub fn new() -> Pin<Box<MmapSourceTree>> {
+        let tree = ffi::NewMmapSourceTree();
+        unsafe { Self::from_ffi_owned(tree) }
+    }
+
+    /// Creates a new memory-mapped source tree that shares mappings through
+    /// `cache`.
+    ///
+    /// The tree keeps the cache's mappings alive; the cache itself may be
+    /// dropped before the tree.
+    pub fn with_cache(cache: &MappedFileCache) -> Pin<Box<MmapSourceTree>> {
+        let tree = ffi::NewMmapSourceTreeWithCache(cache.as_ffi());
+        unsafe { Self::from_ffi_owned(tree) }
+    }
+
+    /// Maps a path on disk to a location in the source tree.
+    ///
+    /// See [`DiskSourceTree::map_path`] for details.
+    pub fn map_path(self: Pin<&mut Self>, virtual_path: &Path, disk_path: &Path) {
+        let virtual_path = ProtobufPath::from(virtual_path);
+        let disk_path = ProtobufPath::from(disk_path);
+        self.as_ffi_mut()
+            .MapPath(virtual_path.into(), disk_path.into())
+    }
+
+    unsafe_ffi_conversions!(ffi::MmapSourceTree);
+}
+
+impl SourceTree for MmapSourceTree {}
+
+impl source_tree::Sealed for MmapSourceTree {
+    fn upcast(&self) -> &ffi::SourceTree {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::SourceTree> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A cache of memory-mapped files, shared by [`MmapSourceTree`]s.
+///
+/// Files are identified by their path on disk. A cached mapping is reused
+/// for as long as the file's size, modification time, and inode are unchanged,
+/// and is otherwise replaced by a new mapping. Mappings are never evicted, so
+/// they remain in memory until the cache and every tree that shares it are
+/// dropped.
+pub struct MappedFileCache {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for MappedFileCache {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMappedFileCache(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl MappedFileCache {
+    /// Creates a new, empty cache.
+    pub fn new() -> Pin<Box<MappedFileCache>> {
+        let cache = ffi::NewMappedFileCache();
+        unsafe { Self::from_ffi_owned(cache) }
+    }
+
+    unsafe_ffi_conversions!(ffi::MappedFileCache);
+}
+
 /// An error occurred while opening a file.
 #[derive(Debug, Clone, Eq, PartialEq, Hash)]
 pub struct FileOpenError(String);
 
+impl FileOpenError {
+    /// Creates an error with the given message, for use by implementations of
+    /// [`CustomSourceTree`].
+    pub fn new(message: impl Into<String>) -> FileOpenError {
+        FileOpenError(message.into())
+    }
+}
+
 impl fmt::Display for FileOpenError {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
         // The underlying error is descriptive enough in all cases to not
@@ -550,3 +2060,55 @@ impl fmt::Display for FileLoadError {
         write!(f, " {}: {}", self.severity, self.message)
     }
 }
+
+/// An error that occurred in [`CompileServer::compile`].
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub enum CompileError {
+    /// A file could not be found, read, or parsed.
+    Load(Vec<FileLoadError>),
+    /// The parsed files could not be built into descriptors.
+    Build(BuildFileSetError),
+}
+
+impl fmt::Display for CompileError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match self {
+            CompileError::Load(errors) => {
+                f.write_str("failed to load files")?;
+                for error in errors {
+                    write!(f, "\n{}", error)?;
+                }
+                Ok(())
+            }
+            CompileError::Build(e) => e.fmt(f),
+        }
+    }
+}
+
+impl Error for CompileError {}
+
+/// An error that occurred in [`compile_remote`].
+#[derive(Debug)]
+pub enum RemoteCompileError {
+    /// Communicating with the compile server failed.
+    Io(io::Error),
+    /// The compile server reported an error, described by the message.
+    Compile(String),
+}
+
+impl From<io::Error> for RemoteCompileError {
+    fn from(e: io::Error) -> RemoteCompileError {
+        RemoteCompileError::Io(e)
+    }
+}
+
+impl fmt::Display for RemoteCompileError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match self {
+            RemoteCompileError::Io(e) => write!(f, "communicating with compile server: {}", e),
+            RemoteCompileError::Compile(message) => f.write_str(message),
+        }
+    }
+}
+
+impl Error for RemoteCompileError {}
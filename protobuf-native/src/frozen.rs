@@ -0,0 +1,140 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Immutable messages with a cached encoding.
+//!
+//! A [`FrozenMessage`] owns a message that can no longer be modified, and
+//! the message's encoding, which is computed once, when the message is
+//! frozen. Serializing a frozen message returns the cached encoding, so a
+//! message that is sent many times, such as one fanned out to many
+//! subscribers, is only encoded once.
+//!
+//! A frozen message can also be embedded in a parent message's encoding
+//! without being re-encoded. The encoding of a message is a sequence of
+//! fields, and concatenating encodings merges the messages they encode, so
+//! appending a frozen message as a field to the encoding of its parent
+//! without that field, with [`FrozenMessage::append_as_field`], yields the
+//! encoding of the parent with the field set.
+//!
+//! # Examples
+//!
+//! ```
+//! use protobuf_native::MessageLite;
+//! use protobuf_native::frozen::FrozenMessage;
+//! # fn f(message: std::pin::Pin<Box<dyn MessageLite>>) -> Result<(), protobuf_native::OperationFailedError> {
+//!
+//! let frozen = FrozenMessage::freeze(message)?;
+//! // The cached encoding, computed by `freeze`.
+//! assert_eq!(frozen.encoded(), frozen.message().serialize()?);
+//!
+//! // The encoding of a parent message whose field 2 is the frozen message.
+//! let mut parent = vec![0x08, 0x01];
+//! frozen.append_as_field(2, &mut parent);
+//! # Ok(())
+//! # }
+//! ```
+
+use std::pin::Pin;
+use std::sync::Arc;
+
+use crate::wire::write_varint;
+use crate::{MessageLite, OperationFailedError};
+
+/// An immutable message with a cached encoding.
+///
+/// See the [module documentation](self) for details.
+pub struct FrozenMessage<M>
+where
+    M: MessageLite + ?Sized,
+{
+    message: Pin<Box<M>>,
+    encoded: Arc<[u8]>,
+}
+
+impl<M> FrozenMessage<M>
+where
+    M: MessageLite + ?Sized,
+{
+    /// Freezes `message`, encoding it.
+    ///
+    /// Returns an error if the message cannot be serialized, for example
+    /// because required fields are missing.
+    pub fn freeze(message: Pin<Box<M>>) -> Result<FrozenMessage<M>, OperationFailedError> {
+        let encoded = message.serialize()?.into();
+        Ok(FrozenMessage { message, encoded })
+    }
+
+    /// Like [`FrozenMessage::freeze`], but encodes the message
+    /// deterministically.
+    pub fn freeze_deterministic(
+        message: Pin<Box<M>>,
+    ) -> Result<FrozenMessage<M>, OperationFailedError> {
+        let encoded = message.serialize_deterministic()?.into();
+        Ok(FrozenMessage { message, encoded })
+    }
+
+    /// Returns the frozen message.
+    pub fn message(&self) -> &M {
+        &self.message
+    }
+
+    /// Returns the cached encoding of the message.
+    pub fn encoded(&self) -> &[u8] {
+        &self.encoded
+    }
+
+    /// Returns a shared reference to the cached encoding of the message,
+    /// which can outlive the frozen message.
+    pub fn shared(&self) -> Arc<[u8]> {
+        Arc::clone(&self.encoded)
+    }
+
+    /// Returns the cached encoding of the message as a [`bytes::Bytes`],
+    /// which shares the encoding rather than copying it.
+    ///
+    /// This method is only available if the `bytes` feature is enabled.
+    #[cfg(feature = "bytes")]
+    pub fn to_bytes(&self) -> bytes::Bytes {
+        bytes::Bytes::from_owner(self.shared())
+    }
+
+    /// Appends the cached encoding of the message to `output` as the
+    /// length-delimited field `number`, as it would be encoded in a parent
+    /// message whose field `number` is the frozen message.
+    ///
+    /// If `output` holds the encoding of a parent message in which field
+    /// `number` is not set, the result is the encoding of the parent message
+    /// with that field set to the frozen message, or, if the field is
+    /// repeated, with the frozen message appended to it.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `number` is not a valid field number.
+    pub fn append_as_field(&self, number: u32, output: &mut Vec<u8>) {
+        assert!(
+            (1..=536_870_911).contains(&number),
+            "invalid field number: {}",
+            number
+        );
+        write_varint(u64::from(number) << 3 | 2, output);
+        write_varint(self.encoded.len() as u64, output);
+        output.extend_from_slice(&self.encoded);
+    }
+
+    /// Unfreezes the message, discarding the cached encoding.
+    pub fn thaw(self) -> Pin<Box<M>> {
+        self.message
+    }
+}
@@ -16,18 +16,22 @@
 #[cfg(unix)]
 use std::ffi::OsStr;
 use std::fmt;
-use std::io::{Read, Write};
+use std::io::{self, BufRead, Read, Write};
 use std::marker::PhantomData;
-use std::mem::MaybeUninit;
+use std::mem::{self, MaybeUninit};
 use std::os::raw::{c_char, c_int, c_void};
 #[cfg(unix)]
 use std::os::unix::prelude::OsStrExt;
 use std::path::Path;
+use std::pin::Pin;
+use std::ptr;
+use std::sync::Arc;
 
 use cxx::kind::Trivial;
-use cxx::{type_id, ExternType};
+use cxx::{type_id, CxxString, ExternType};
 
-use crate::OperationFailedError;
+use crate::compiler::{CustomErrorCollector, CustomSourceTree, Location, Severity};
+use crate::{DescriptorDatabase, OperationFailedError};
 
 // Pollyfill C++ APIs that aren't yet in cxx.
 // See: https://github.com/dtolnay/cxx/pull/984
@@ -37,6 +41,7 @@ use crate::OperationFailedError;
 mod ffi {
     extern "Rust" {
         unsafe fn vec_u8_set_len(v: &mut Vec<u8>, new_len: usize);
+        fn vec_u8_reserve_exact(v: &mut Vec<u8>, new_cap: usize);
     }
 
     unsafe extern "C++" {
@@ -55,6 +60,17 @@ unsafe fn vec_u8_set_len(v: &mut Vec<u8>, new_len: usize) {
     v.set_len(new_len)
 }
 
+/// Grows the capacity of `v` to exactly `new_cap`, if it is not already at
+/// least that large.
+///
+/// Unlike `rust::Vec::reserve` on the C++ side, this does not apply the
+/// amortized growth policy of `Vec::reserve`.
+fn vec_u8_reserve_exact(v: &mut Vec<u8>, new_cap: usize) {
+    if new_cap > v.capacity() {
+        v.reserve_exact(new_cap - v.len())
+    }
+}
+
 #[derive(Debug, Copy, Clone)]
 #[repr(C)]
 pub struct StringView<'a> {
@@ -68,6 +84,12 @@ impl<'a> From<&'a str> for StringView<'a> {
     }
 }
 
+impl<'a> From<&'a [u8]> for StringView<'a> {
+    fn from(s: &'a [u8]) -> StringView<'a> {
+        ffi::string_view_from_bytes(s)
+    }
+}
+
 impl<'a> From<ProtobufPath<'a>> for StringView<'a> {
     fn from(path: ProtobufPath<'a>) -> StringView<'a> {
         ffi::string_view_from_bytes(path.as_bytes())
@@ -128,6 +150,67 @@ unsafe impl ExternType for CVoid {
     type Kind = Trivial;
 }
 
+// Error collector adaptor for C++.
+
+pub struct ErrorCollectorAdaptor<'a>(pub Box<dyn CustomErrorCollector + 'a>);
+
+impl ErrorCollectorAdaptor<'_> {
+    pub fn record(
+        &mut self,
+        filename: &[u8],
+        line: i32,
+        column: i32,
+        message: &[u8],
+        warning: bool,
+    ) {
+        let location = (line >= 0).then(|| Location {
+            line: i64::from(line) + 1,
+            column: i64::from(column) + 1,
+        });
+        let severity = match warning {
+            true => Severity::Warning,
+            false => Severity::Error,
+        };
+        self.0.record(
+            &String::from_utf8_lossy(filename),
+            location,
+            severity,
+            &String::from_utf8_lossy(message),
+        )
+    }
+}
+
+// Source tree adaptor for C++.
+
+pub struct SourceTreeAdaptor<'a>(pub Box<dyn CustomSourceTree + 'a>);
+
+impl SourceTreeAdaptor<'_> {
+    pub fn open(
+        &self,
+        filename: &[u8],
+        error: &mut String,
+    ) -> *mut crate::io::ffi::ZeroCopyInputStream {
+        let filename = ProtobufPath::from(filename);
+        match self.0.open(filename.as_path().as_ref()) {
+            Ok(stream) => crate::io::into_ffi_input_stream(stream),
+            Err(e) => {
+                *error = e.to_string();
+                ptr::null_mut()
+            }
+        }
+    }
+}
+
+// Bytes shared between Rust and C++.
+
+pub struct SharedBytes(pub Arc<[u8]>);
+
+impl SharedBytes {
+    pub fn as_slice(&self) -> &[u8] {
+        &self.0
+    }
+}
+
 // `Read` and `Write` adaptors for C++.
 
 pub struct ReadAdaptor<'a>(pub &'a mut dyn Read);
@@ -141,6 +224,168 @@ impl ReadAdaptor<'_> {
     }
 }
 
+pub struct BufReadAdaptor<'a> {
+    reader: Box<dyn BufRead + 'a>,
+    pending: usize,
+    byte_count: i64,
+}
+
+impl<'a> BufReadAdaptor<'a> {
+    pub fn new(reader: Box<dyn BufRead + 'a>) -> BufReadAdaptor<'a> {
+        BufReadAdaptor {
+            reader,
+            pending: 0,
+            byte_count: 0,
+        }
+    }
+
+    /// Consumes the bytes returned by the last call to `next` that were not
+    /// backed up.
+    fn consume_pending(&mut self) {
+        self.reader.consume(self.pending);
+        self.pending = 0;
+    }
+
+    pub fn next(&mut self) -> &[u8] {
+        self.consume_pending();
+        let available = loop {
+            match self.reader.fill_buf() {
+                Ok(buf) => break buf.len(),
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+                Err(_) => break 0,
+            }
+        };
+        if available == 0 {
+            // An empty buffer signals EOF or an I/O error.
+            return &[];
+        }
+        // The reader's buffer is already filled, so this call does not perform
+        // any I/O.
+        let buf = match self.reader.fill_buf() {
+            Ok(buf) => buf,
+            Err(_) => return &[],
+        };
+        let buf = &buf[..buf.len().min(c_int::MAX as usize)];
+        self.pending = buf.len();
+        self.byte_count += i64::try_from(buf.len()).expect("buffer size fits in i64");
+        buf
+    }
+
+    pub fn back_up(&mut self, count: usize) {
+        assert!(count <= self.pending, "cannot back up past start of buffer");
+        self.pending -= count;
+        self.byte_count -= i64::try_from(count).expect("count fits in i64");
+    }
+
+    pub fn skip(&mut self, mut count: usize) -> bool {
+        self.consume_pending();
+        while count > 0 {
+            let available = match self.reader.fill_buf() {
+                Ok(buf) => buf.len(),
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+                Err(_) => return false,
+            };
+            if available == 0 {
+                return false;
+            }
+            let n = available.min(count);
+            self.reader.consume(n);
+            self.byte_count += i64::try_from(n).expect("skip size fits in i64");
+            count -= n;
+        }
+        true
+    }
+
+    pub fn byte_count(&self) -> i64 {
+        self.byte_count
+    }
+}
+
+impl Drop for BufReadAdaptor<'_> {
+    fn drop(&mut self) {
+        // Leave the reader positioned just after the last byte that was
+        // actually read from the stream.
+        self.consume_pending();
+    }
+}
+
+pub struct DescriptorDatabaseAdaptor<'a>(pub Pin<&'a mut (dyn DescriptorDatabase + Send + 'a)>);
+
+impl DescriptorDatabaseAdaptor<'_> {
+    pub fn find_file_by_name(
+        &mut self,
+        filename: &CxxString,
+        output: Pin<&mut crate::ffi::FileDescriptorProto>,
+    ) -> bool {
+        let filename = ProtobufPath::from(filename.as_bytes());
+        match self
+            .0
+            .as_mut()
+            .find_file_by_name(filename.as_path().as_ref())
+        {
+            Ok(file) => {
+                output.CopyFrom(file.as_ffi());
+                true
+            }
+            Err(_) => false,
+        }
+    }
+
+    pub fn find_file_containing_symbol(
+        &mut self,
+        symbol_name: &CxxString,
+        output: Pin<&mut crate::ffi::FileDescriptorProto>,
+    ) -> bool {
+        let symbol_name = match symbol_name.to_str() {
+            Ok(symbol_name) => symbol_name,
+            Err(_) => return false,
+        };
+        match self.0.as_mut().find_file_containing_symbol(symbol_name) {
+            Ok(file) => {
+                output.CopyFrom(file.as_ffi());
+                true
+            }
+            Err(_) => false,
+        }
+    }
+
+    pub fn find_file_containing_extension(
+        &mut self,
+        containing_type: &CxxString,
+        field_number: i32,
+        output: Pin<&mut crate::ffi::FileDescriptorProto>,
+    ) -> bool {
+        let containing_type = match containing_type.to_str() {
+            Ok(containing_type) => containing_type,
+            Err(_) => return false,
+        };
+        match self
+            .0
+            .as_mut()
+            .find_file_containing_extension(containing_type, field_number)
+        {
+            Ok(file) => {
+                output.CopyFrom(file.as_ffi());
+                true
+            }
+            Err(_) => false,
+        }
+    }
+
+    pub fn find_all_file_names(&mut self, output: &mut Vec<String>) -> bool {
+        match self.0.as_mut().find_all_file_names() {
+            Ok(names) => {
+                output.extend(names.iter().map(|name| {
+                    String::from_utf8_lossy(ProtobufPath::from(name.as_path()).as_bytes())
+                        .into_owned()
+                }));
+                true
+            }
+            Err(_) => false,
+        }
+    }
+}
+
 pub struct WriteAdaptor<'a>(pub &'a mut dyn Write);
 
 impl WriteAdaptor<'_> {
@@ -149,6 +394,314 @@ impl WriteAdaptor<'_> {
     }
 }
 
+// Segmented input and output adaptors for C++.
+
+pub struct ChainReadAdaptor<'a> {
+    segments: Vec<&'a [u8]>,
+    index: usize,
+    offset: usize,
+    byte_count: i64,
+}
+
+impl<'a> ChainReadAdaptor<'a> {
+    pub fn new(segments: Vec<&'a [u8]>) -> ChainReadAdaptor<'a> {
+        ChainReadAdaptor {
+            segments,
+            index: 0,
+            offset: 0,
+            byte_count: 0,
+        }
+    }
+
+    /// Advances past any exhausted segments, returning the remainder of the
+    /// current segment, or `None` at the end of the chain.
+    fn current(&mut self) -> Option<&'a [u8]> {
+        while let Some(&segment) = self.segments.get(self.index) {
+            if self.offset < segment.len() {
+                return Some(&segment[self.offset..]);
+            }
+            self.index += 1;
+            self.offset = 0;
+        }
+        None
+    }
+
+    pub fn next(&mut self) -> &'a [u8] {
+        match self.current() {
+            // An empty buffer signals the end of the chain.
+            None => &[],
+            Some(chunk) => {
+                let chunk = &chunk[..chunk.len().min(c_int::MAX as usize)];
+                self.offset += chunk.len();
+                self.byte_count += i64::try_from(chunk.len()).expect("chunk size fits in i64");
+                chunk
+            }
+        }
+    }
+
+    pub fn back_up(&mut self, count: usize) {
+        assert!(count <= self.offset, "cannot back up past start of segment");
+        self.offset -= count;
+        self.byte_count -= i64::try_from(count).expect("count fits in i64");
+    }
+
+    pub fn skip(&mut self, mut count: usize) -> bool {
+        while count > 0 {
+            match self.current() {
+                None => return false,
+                Some(chunk) => {
+                    let n = chunk.len().min(count);
+                    self.offset += n;
+                    self.byte_count += i64::try_from(n).expect("skip size fits in i64");
+                    count -= n;
+                }
+            }
+        }
+        true
+    }
+
+    pub fn byte_count(&self) -> i64 {
+        self.byte_count
+    }
+}
+
+pub struct ChainWriteAdaptor<'a> {
+    segments: &'a mut Vec<Vec<u8>>,
+    segment_size: usize,
+    byte_count: i64,
+}
+
+impl<'a> ChainWriteAdaptor<'a> {
+    pub fn new(segments: &'a mut Vec<Vec<u8>>, segment_size: usize) -> ChainWriteAdaptor<'a> {
+        assert!(segment_size > 0, "segment size must be nonzero");
+        ChainWriteAdaptor {
+            segments,
+            segment_size: segment_size.min(c_int::MAX as usize),
+            byte_count: 0,
+        }
+    }
+
+    pub fn next(&mut self, size: &mut usize) -> *mut u8 {
+        if self
+            .segments
+            .last()
+            .map_or(true, |s| s.len() == s.capacity())
+        {
+            self.segments.push(Vec::with_capacity(self.segment_size));
+        }
+        let segment = self.segments.last_mut().unwrap();
+        let len = segment.len();
+        let spare = (segment.capacity() - len).min(c_int::MAX as usize);
+        // SAFETY: the C++ stream contract requires that the caller either
+        // initializes the returned buffer or backs up over the portion it did
+        // not initialize before the segments are observable again.
+        unsafe { segment.set_len(len + spare) };
+        self.byte_count += i64::try_from(spare).expect("segment size fits in i64");
+        *size = spare;
+        unsafe { segment.as_mut_ptr().add(len) }
+    }
+
+    pub fn back_up(&mut self, count: usize) {
+        let segment = self
+            .segments
+            .last_mut()
+            .expect("back_up called before next");
+        assert!(
+            count <= segment.len(),
+            "cannot back up past start of segment"
+        );
+        // SAFETY: we're only shrinking the vector.
+        unsafe { segment.set_len(segment.len() - count) };
+        self.byte_count -= i64::try_from(count).expect("count fits in i64");
+    }
+
+    pub fn byte_count(&self) -> i64 {
+        self.byte_count
+    }
+}
+
+// Adaptors for C++ streams over buffers that are read or written in
+// contiguous chunks, like `bytes::Buf` and `bytes::BufMut`.
+
+/// A source of bytes that is consumed in contiguous chunks.
+pub trait ChunkSource {
+    /// Returns the next contiguous chunk of bytes, or an empty slice at the
+    /// end of input.
+    fn chunk(&self) -> &[u8];
+
+    /// Consumes `count` bytes from the front of the source.
+    fn advance(&mut self, count: usize);
+}
+
+/// A sink that is filled by writing into contiguous chunks of spare capacity.
+pub trait ChunkSink {
+    /// Returns the next contiguous chunk of spare capacity, growing the sink if
+    /// necessary, or an empty slice if the sink is full.
+    fn chunk_mut(&mut self) -> &mut [MaybeUninit<u8>];
+
+    /// Marks the first `count` bytes of the spare capacity as written.
+    ///
+    /// # Safety
+    ///
+    /// The first `count` bytes of the chunk returned by the last call to
+    /// `chunk_mut` must have been initialized.
+    unsafe fn advance_mut(&mut self, count: usize);
+}
+
+#[cfg(feature = "bytes")]
+impl<B: bytes::Buf + ?Sized> ChunkSource for B {
+    fn chunk(&self) -> &[u8] {
+        bytes::Buf::chunk(self)
+    }
+
+    fn advance(&mut self, count: usize) {
+        bytes::Buf::advance(self, count)
+    }
+}
+
+#[cfg(feature = "bytes")]
+impl<B: bytes::BufMut + ?Sized> ChunkSink for B {
+    fn chunk_mut(&mut self) -> &mut [MaybeUninit<u8>] {
+        unsafe { bytes::BufMut::chunk_mut(self).as_uninit_slice_mut() }
+    }
+
+    unsafe fn advance_mut(&mut self, count: usize) {
+        bytes::BufMut::advance_mut(self, count)
+    }
+}
+
+/// Reads from a [`ChunkSource`] on behalf of a C++ stream.
+///
+/// The source is not advanced past a chunk until the next chunk is requested
+/// or the adaptor is dropped, so that the C++ stream can back up into it.
+#[cfg_attr(not(feature = "bytes"), allow(dead_code))]
+pub struct ChunkReadAdaptor<'a> {
+    source: Box<dyn ChunkSource + 'a>,
+    pending: usize,
+    byte_count: i64,
+}
+
+#[cfg_attr(not(feature = "bytes"), allow(dead_code))]
+impl<'a> ChunkReadAdaptor<'a> {
+    pub fn new(source: Box<dyn ChunkSource + 'a>) -> ChunkReadAdaptor<'a> {
+        ChunkReadAdaptor {
+            source,
+            pending: 0,
+            byte_count: 0,
+        }
+    }
+
+    fn consume(&mut self) {
+        let pending = mem::take(&mut self.pending);
+        self.source.advance(pending);
+    }
+
+    pub fn next(&mut self) -> &[u8] {
+        self.consume();
+        // An empty buffer signals the end of the source.
+        let chunk = self.source.chunk();
+        let chunk = &chunk[..chunk.len().min(c_int::MAX as usize)];
+        self.pending = chunk.len();
+        self.byte_count += i64::try_from(chunk.len()).expect("chunk size fits in i64");
+        chunk
+    }
+
+    pub fn back_up(&mut self, count: usize) {
+        assert!(count <= self.pending, "cannot back up past start of chunk");
+        self.pending -= count;
+        self.byte_count -= i64::try_from(count).expect("count fits in i64");
+    }
+
+    pub fn skip(&mut self, mut count: usize) -> bool {
+        self.consume();
+        while count > 0 {
+            let n = self.source.chunk().len().min(count);
+            if n == 0 {
+                return false;
+            }
+            self.source.advance(n);
+            self.byte_count += i64::try_from(n).expect("skip size fits in i64");
+            count -= n;
+        }
+        true
+    }
+
+    pub fn byte_count(&self) -> i64 {
+        self.byte_count
+    }
+}
+
+impl<'a> Drop for ChunkReadAdaptor<'a> {
+    fn drop(&mut self) {
+        self.consume();
+    }
+}
+
+/// Writes to a [`ChunkSink`] on behalf of a C++ stream.
+///
+/// A chunk is not committed to the sink until the next chunk is requested or
+/// the adaptor is dropped, so that the C++ stream can back up over the portion
+/// of it that it did not write.
+#[cfg_attr(not(feature = "bytes"), allow(dead_code))]
+pub struct ChunkWriteAdaptor<'a> {
+    sink: Box<dyn ChunkSink + 'a>,
+    pending: usize,
+    byte_count: i64,
+}
+
+#[cfg_attr(not(feature = "bytes"), allow(dead_code))]
+impl<'a> ChunkWriteAdaptor<'a> {
+    pub fn new(sink: Box<dyn ChunkSink + 'a>) -> ChunkWriteAdaptor<'a> {
+        ChunkWriteAdaptor {
+            sink,
+            pending: 0,
+            byte_count: 0,
+        }
+    }
+
+    fn commit(&mut self) {
+        let pending = mem::take(&mut self.pending);
+        // SAFETY: the C++ stream contract requires that the caller initialize
+        // the entire buffer returned by `next`, except for the portion it
+        // backs up over, before requesting another buffer or destroying the
+        // stream.
+        unsafe { self.sink.advance_mut(pending) };
+    }
+
+    pub fn next(&mut self, size: &mut usize) -> *mut u8 {
+        self.commit();
+        // An empty buffer signals that the sink is full.
+        let chunk = self.sink.chunk_mut();
+        let len = chunk.len().min(c_int::MAX as usize);
+        self.pending = len;
+        self.byte_count += i64::try_from(len).expect("chunk size fits in i64");
+        *size = len;
+        chunk.as_mut_ptr().cast()
+    }
+
+    pub fn back_up(&mut self, count: usize) {
+        assert!(count <= self.pending, "cannot back up past start of chunk");
+        self.pending -= count;
+        self.byte_count -= i64::try_from(count).expect("count fits in i64");
+    }
+
+    pub fn byte_count(&self) -> i64 {
+        self.byte_count
+    }
+}
+
+impl<'a> Drop for ChunkWriteAdaptor<'a> {
+    fn drop(&mut self) {
+        self.commit();
+    }
+}
+
+/// A Rust value that owns memory shared with a C++ `absl::Cord`.
+///
+/// The cord drops the value once no cord refers to its memory any longer,
+/// which may happen on any thread.
+pub struct CordExternal(pub Box<dyn AsRef<[u8]> + Send>);
+
 /// Extensions to [`Result`].
 pub trait ResultExt {
     /// Converts this result into a status boolean.
@@ -15,6 +15,26 @@
 
 #include "protobuf-native/src/io.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "absl/base/internal/endian.h"
+#include "absl/numeric/bits.h"
+#include "google/protobuf/varint_shuffle.h"
 #include "protobuf-native/src/internal.rs.h"
 #include "protobuf-native/src/io.rs.h"
 
@@ -25,8 +45,68 @@ using namespace google::protobuf::io;
 
 void DeleteZeroCopyInputStream(ZeroCopyInputStream* stream) { delete stream; }
 
-ReaderStream::ReaderStream(rust::Box<ReadAdaptor> adaptor)
-    : CopyingInputStreamAdaptor(new CopyingReaderStream(std::move(adaptor))) {
+namespace {
+
+// O_DIRECT requires buffers, file offsets, and transfer sizes to be aligned to
+// the logical block size of the file system, which is at most a page.
+constexpr int kDirectAlignment = 4096;
+
+#ifndef _WIN32
+
+int RoundUpToDirectAlignment(int size) {
+    if (size > INT_MAX - kDirectAlignment) {
+        return INT_MAX / kDirectAlignment * kDirectAlignment;
+    }
+    return (size + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+}
+
+bool IsDirect(int fd) {
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && (flags & O_DIRECT) != 0;
+#else
+    return false;
+#endif
+}
+
+// Enables or disables I/O that bypasses the page cache. On macOS, which lacks
+// O_DIRECT, F_NOCACHE has much the same effect, without the alignment
+// requirements.
+bool SetDirect(int fd, bool direct) {
+#if defined(O_DIRECT)
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    flags = direct ? flags | O_DIRECT : flags & ~O_DIRECT;
+    return fcntl(fd, F_SETFL, flags) == 0;
+#elif defined(F_NOCACHE)
+    return fcntl(fd, F_NOCACHE, direct ? 1 : 0) != -1;
+#else
+    if (direct) {
+        errno = ENOTSUP;
+        return false;
+    }
+    return true;
+#endif
+}
+
+uint8_t* NewAlignedBuffer(int size) {
+    void* buffer = nullptr;
+    int err = posix_memalign(&buffer, kDirectAlignment, size);
+    if (err != 0) {
+        errno = err;
+        return nullptr;
+    }
+    return static_cast<uint8_t*>(buffer);
+}
+
+#endif
+
+}  // namespace
+
+ReaderStream::ReaderStream(rust::Box<ReadAdaptor> adaptor, int block_size)
+    : CopyingInputStreamAdaptor(new CopyingReaderStream(std::move(adaptor)), block_size) {
     SetOwnsCopyingStream(true);
 }
 
@@ -37,20 +117,348 @@ int ReaderStream::CopyingReaderStream::Read(void* buffer, int size) {
     return adaptor_->read(rust::Slice<uint8_t>(static_cast<uint8_t*>(buffer), size));
 }
 
-ReaderStream* NewReaderStream(rust::Box<ReadAdaptor> adaptor) {
-    return new ReaderStream(std::move(adaptor));
+ReaderStream* NewReaderStream(rust::Box<ReadAdaptor> adaptor, int block_size) {
+    return new ReaderStream(std::move(adaptor), block_size);
 }
 
 void DeleteReaderStream(ReaderStream* stream) { delete stream; }
 
+BufReadStream::BufReadStream(rust::Box<BufReadAdaptor> adaptor) : adaptor_(std::move(adaptor)) {}
+
+bool BufReadStream::Next(const void** data, int* size) {
+    rust::Slice<const uint8_t> buf = adaptor_->next();
+    if (buf.empty()) {
+        return false;
+    }
+    *data = buf.data();
+    *size = buf.size();
+    return true;
+}
+
+void BufReadStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    adaptor_->back_up(count);
+}
+
+bool BufReadStream::Skip(int count) {
+    ABSL_CHECK_GE(count, 0);
+    return adaptor_->skip(count);
+}
+
+int64_t BufReadStream::ByteCount() const { return adaptor_->byte_count(); }
+
+BufReadStream* NewBufReadStream(rust::Box<BufReadAdaptor> adaptor) {
+    return new BufReadStream(std::move(adaptor));
+}
+
+void DeleteBufReadStream(BufReadStream* stream) { delete stream; }
+
 ArrayInputStream* NewArrayInputStream(const uint8_t* data, int size) {
     return new ArrayInputStream(data, size);
 }
 
 void DeleteArrayInputStream(ArrayInputStream* stream) { delete stream; }
 
-WriterStream::WriterStream(rust::Box<WriteAdaptor> adaptor)
-    : CopyingOutputStreamAdaptor(new CopyingWriterStream(std::move(adaptor))) {
+void ArrayInputStreamReset(ArrayInputStream& stream, const uint8_t* data, int size) {
+    // ArrayInputStream has no way to rewind, so destroy and reconstruct it in
+    // place to reuse its allocation.
+    stream.~ArrayInputStream();
+    new (&stream) ArrayInputStream(data, size);
+}
+
+MmapInputStream::MmapInputStream(void* data, size_t size)
+    : data_(data), size_(size), stream_(data, size) {}
+
+MmapInputStream::~MmapInputStream() {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+#endif
+}
+
+bool MmapInputStream::Next(const void** data, int* size) { return stream_.Next(data, size); }
+
+void MmapInputStream::BackUp(int count) { stream_.BackUp(count); }
+
+bool MmapInputStream::Skip(int count) { return stream_.Skip(count); }
+
+int64_t MmapInputStream::ByteCount() const { return stream_.ByteCount(); }
+
+rust::Slice<const uint8_t> MmapInputStream::Contents() const {
+    return rust::Slice<const uint8_t>(static_cast<const uint8_t*>(data_), size_);
+}
+
+MmapInputStream* NewMmapInputStream(int fd, size_t size) {
+#ifdef _WIN32
+    errno = ENOSYS;
+    return nullptr;
+#else
+    if (size > INT_MAX) {
+        errno = EFBIG;
+        return nullptr;
+    }
+    // Mapping a zero-length region is an error, but an empty file is not.
+    void* data = nullptr;
+    if (size > 0) {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+    }
+    return new MmapInputStream(data, size);
+#endif
+}
+
+void DeleteMmapInputStream(MmapInputStream* stream) { delete stream; }
+
+FdInputStream::FdInputStream(int fd, uint8_t* buffer, int block_size)
+    : fd_(fd),
+      buffer_(buffer),
+      block_size_(block_size),
+      buffer_used_(0),
+      position_(0),
+      bytes_read_(0),
+      errno_(0) {}
+
+FdInputStream::~FdInputStream() {
+#ifndef _WIN32
+    close(fd_);
+#endif
+    std::free(buffer_);
+}
+
+bool FdInputStream::Next(const void** data, int* size) {
+    if (position_ == buffer_used_ && !Fill()) {
+        return false;
+    }
+    *data = buffer_ + position_;
+    *size = buffer_used_ - position_;
+    position_ = buffer_used_;
+    return true;
+}
+
+void FdInputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    ABSL_CHECK_LE(count, position_);
+    position_ -= count;
+}
+
+bool FdInputStream::Skip(int count) {
+    ABSL_CHECK_GE(count, 0);
+    // Skipped bytes are read rather than seeked over, which keeps the file
+    // offset aligned for O_DIRECT and detects the end of the file.
+    while (count > buffer_used_ - position_) {
+        count -= buffer_used_ - position_;
+        position_ = buffer_used_;
+        if (!Fill()) {
+            return false;
+        }
+    }
+    position_ += count;
+    return true;
+}
+
+int64_t FdInputStream::ByteCount() const { return bytes_read_ - (buffer_used_ - position_); }
+
+int FdInputStream::GetErrno() const { return errno_; }
+
+bool FdInputStream::Fill() {
+#ifdef _WIN32
+    return false;
+#else
+    if (errno_ != 0) {
+        return false;
+    }
+    ssize_t n;
+    do {
+        n = read(fd_, buffer_, block_size_);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        if (n < 0) {
+            errno_ = errno;
+        }
+        return false;
+    }
+    buffer_used_ = n;
+    position_ = 0;
+    bytes_read_ += n;
+    return true;
+#endif
+}
+
+FdInputStream* NewFdInputStream(int fd, int block_size, bool sequential, bool direct) {
+#ifdef _WIN32
+    errno = ENOSYS;
+    return nullptr;
+#else
+    direct = direct || IsDirect(fd);
+    if (direct) {
+        if (!SetDirect(fd, true)) {
+            return nullptr;
+        }
+        block_size = RoundUpToDirectAlignment(block_size);
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (sequential) {
+        // Advice is only a hint; it fails harmlessly on pipes and sockets.
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#else
+    (void)sequential;
+#endif
+    uint8_t* buffer = NewAlignedBuffer(block_size);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    return new FdInputStream(fd, buffer, block_size);
+#endif
+}
+
+void DeleteFdInputStream(FdInputStream* stream) { delete stream; }
+
+ChainInputStream::ChainInputStream(rust::Box<ChainReadAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+bool ChainInputStream::Next(const void** data, int* size) {
+    rust::Slice<const uint8_t> chunk = adaptor_->next();
+    if (chunk.empty()) {
+        return false;
+    }
+    *data = chunk.data();
+    *size = chunk.size();
+    return true;
+}
+
+void ChainInputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    adaptor_->back_up(count);
+}
+
+bool ChainInputStream::Skip(int count) {
+    ABSL_CHECK_GE(count, 0);
+    return adaptor_->skip(count);
+}
+
+int64_t ChainInputStream::ByteCount() const { return adaptor_->byte_count(); }
+
+ChainInputStream* NewChainInputStream(rust::Box<ChainReadAdaptor> adaptor) {
+    return new ChainInputStream(std::move(adaptor));
+}
+
+void DeleteChainInputStream(ChainInputStream* stream) { delete stream; }
+
+ChunkInputStream::ChunkInputStream(rust::Box<ChunkReadAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+bool ChunkInputStream::Next(const void** data, int* size) {
+    rust::Slice<const uint8_t> chunk = adaptor_->next();
+    if (chunk.empty()) {
+        return false;
+    }
+    *data = chunk.data();
+    *size = chunk.size();
+    return true;
+}
+
+void ChunkInputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    adaptor_->back_up(count);
+}
+
+bool ChunkInputStream::Skip(int count) {
+    ABSL_CHECK_GE(count, 0);
+    return adaptor_->skip(count);
+}
+
+int64_t ChunkInputStream::ByteCount() const { return adaptor_->byte_count(); }
+
+ChunkInputStream* NewChunkInputStream(rust::Box<ChunkReadAdaptor> adaptor) {
+    return new ChunkInputStream(std::move(adaptor));
+}
+
+void DeleteChunkInputStream(ChunkInputStream* stream) { delete stream; }
+
+LimitingInputStream* NewLimitingInputStream(ZeroCopyInputStream* input, int64_t limit) {
+    return new LimitingInputStream(input, limit);
+}
+
+void DeleteLimitingInputStream(LimitingInputStream* stream) { delete stream; }
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+GzipInputStream* NewGzipInputStream(ZeroCopyInputStream* input, int format, int buffer_size) {
+    return new GzipInputStream(input, static_cast<GzipInputStream::Format>(format), buffer_size);
+}
+
+void DeleteGzipInputStream(GzipInputStream* stream) { delete stream; }
+
+rust::String GzipInputStreamZlibErrorMessage(const GzipInputStream& stream) {
+    const char* message = stream.ZlibErrorMessage();
+    return rust::String::lossy(message == nullptr ? "" : message);
+}
+#endif
+
+Crc32cInputStream::Crc32cInputStream(ZeroCopyInputStream* input)
+    : input_(input), crc_(0), pending_(nullptr), pending_size_(0) {}
+
+bool Crc32cInputStream::Next(const void** data, int* size) {
+    Commit();
+    if (!input_->Next(data, size)) {
+        return false;
+    }
+    pending_ = static_cast<const char*>(*data);
+    pending_size_ = *size;
+    return true;
+}
+
+void Crc32cInputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    ABSL_CHECK_LE(count, pending_size_);
+    input_->BackUp(count);
+    pending_size_ -= count;
+    Commit();
+}
+
+bool Crc32cInputStream::Skip(int count) {
+    // Skipped bytes must still be checksummed, so read them rather than
+    // skipping them in the underlying stream.
+    Commit();
+    while (count > 0) {
+        const void* data;
+        int size;
+        if (!input_->Next(&data, &size)) {
+            return false;
+        }
+        if (size > count) {
+            input_->BackUp(size - count);
+            size = count;
+        }
+        crc_ = absl::ExtendCrc32c(crc_, absl::string_view(static_cast<const char*>(data), size));
+        count -= size;
+    }
+    return true;
+}
+
+int64_t Crc32cInputStream::ByteCount() const { return input_->ByteCount(); }
+
+uint32_t Crc32cInputStream::Crc32c() const {
+    return static_cast<uint32_t>(
+        absl::ExtendCrc32c(crc_, absl::string_view(pending_, pending_size_)));
+}
+
+void Crc32cInputStream::Commit() {
+    crc_ = absl::ExtendCrc32c(crc_, absl::string_view(pending_, pending_size_));
+    pending_size_ = 0;
+}
+
+Crc32cInputStream* NewCrc32cInputStream(ZeroCopyInputStream* input) {
+    return new Crc32cInputStream(input);
+}
+
+void DeleteCrc32cInputStream(Crc32cInputStream* stream) { delete stream; }
+
+WriterStream::WriterStream(rust::Box<WriteAdaptor> adaptor, int block_size)
+    : CopyingOutputStreamAdaptor(new CopyingWriterStream(std::move(adaptor)), block_size) {
     SetOwnsCopyingStream(true);
 }
 
@@ -61,12 +469,134 @@ bool WriterStream::CopyingWriterStream::Write(const void* buffer, int size) {
     return adaptor_->write(rust::Slice<const uint8_t>(static_cast<const uint8_t*>(buffer), size));
 }
 
-WriterStream* NewWriterStream(rust::Box<WriteAdaptor> adaptor) {
-    return new WriterStream(std::move(adaptor));
+WriterStream* NewWriterStream(rust::Box<WriteAdaptor> adaptor, int block_size) {
+    return new WriterStream(std::move(adaptor), block_size);
 }
 
 void DeleteWriterStream(WriterStream* stream) { delete stream; }
 
+FdOutputStream::FdOutputStream(int fd, uint8_t* buffer, int block_size, bool direct)
+    : fd_(fd),
+      buffer_(buffer),
+      block_size_(block_size),
+      direct_(direct),
+      position_(0),
+      bytes_written_(0),
+      errno_(0) {}
+
+FdOutputStream::~FdOutputStream() {
+    Close();
+    std::free(buffer_);
+}
+
+bool FdOutputStream::Next(void** data, int* size) {
+    if (position_ == block_size_ && !Flush()) {
+        return false;
+    }
+    if (fd_ < 0 || errno_ != 0) {
+        return false;
+    }
+    *data = buffer_ + position_;
+    *size = block_size_ - position_;
+    position_ = block_size_;
+    return true;
+}
+
+void FdOutputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    ABSL_CHECK_LE(count, position_);
+    position_ -= count;
+}
+
+int64_t FdOutputStream::ByteCount() const { return bytes_written_ + position_; }
+
+bool FdOutputStream::Flush() {
+    if (fd_ < 0 || errno_ != 0) {
+        return false;
+    }
+    // With O_DIRECT, a partial block stays buffered until more bytes complete
+    // it or the stream is closed.
+    int size = direct_ ? position_ / kDirectAlignment * kDirectAlignment : position_;
+    if (!WriteAll(buffer_, size)) {
+        return false;
+    }
+    std::memmove(buffer_, buffer_ + size, position_ - size);
+    position_ -= size;
+    bytes_written_ += size;
+    return true;
+}
+
+bool FdOutputStream::Close() {
+#ifdef _WIN32
+    return false;
+#else
+    if (fd_ < 0) {
+        return errno_ == 0;
+    }
+    bool ok = Flush();
+    if (ok && position_ > 0) {
+        // The tail is not a whole block, so O_DIRECT cannot write it.
+        ok = SetDirect(fd_, false);
+        if (!ok) {
+            errno_ = errno;
+        }
+        ok = ok && WriteAll(buffer_, position_);
+        bytes_written_ += position_;
+        position_ = 0;
+    }
+    if (close(fd_) != 0 && ok) {
+        errno_ = errno;
+        ok = false;
+    }
+    fd_ = -1;
+    return ok;
+#endif
+}
+
+int FdOutputStream::GetErrno() const { return errno_; }
+
+bool FdOutputStream::WriteAll(const uint8_t* data, size_t size) {
+#ifdef _WIN32
+    return false;
+#else
+    while (size > 0) {
+        ssize_t n = write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            errno_ = errno;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+#endif
+}
+
+FdOutputStream* NewFdOutputStream(int fd, int block_size, bool direct) {
+#ifdef _WIN32
+    errno = ENOSYS;
+    return nullptr;
+#else
+    direct = direct || IsDirect(fd);
+    if (direct) {
+        if (!SetDirect(fd, true)) {
+            return nullptr;
+        }
+        block_size = RoundUpToDirectAlignment(block_size);
+    }
+    uint8_t* buffer = NewAlignedBuffer(block_size);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    return new FdOutputStream(fd, buffer, block_size, direct);
+#endif
+}
+
+void DeleteFdOutputStream(FdOutputStream* stream) { delete stream; }
+
 ArrayOutputStream* NewArrayOutputStream(uint8_t* data, int size) {
     return new ArrayOutputStream(data, size);
 }
@@ -74,13 +604,32 @@ ArrayOutputStream* NewArrayOutputStream(uint8_t* data, int size) {
 void DeleteArrayOutputStream(ArrayOutputStream* stream) { delete stream; }
 
 VecOutputStream::VecOutputStream(rust::Vec<uint8_t>& target)
-    : target_(target), start_position_(target.size()), position_(target.size()) {}
+    : VecOutputStream(target, 0, 0, 0) {}
+
+VecOutputStream::VecOutputStream(rust::Vec<uint8_t>& target, size_t size_hint,
+                                 size_t growth_increment, size_t max_growth)
+    : target_(target),
+      start_position_(target.size()),
+      position_(target.size()),
+      growth_increment_(growth_increment),
+      max_growth_(max_growth) {
+    if (size_hint > 0) {
+        vec_u8_reserve_exact(target_, start_position_ + size_hint);
+    }
+}
 
 VecOutputStream::~VecOutputStream() { vec_u8_set_len(target_, position_); }
 
 bool VecOutputStream::Next(void** data, int* size) {
     if (position_ == target_.capacity()) {
-        target_.reserve(std::max(position_ * 2, kMinimumSize));
+        size_t growth = growth_increment_;
+        if (growth == 0) {
+            growth = std::max(position_ * 2, kMinimumSize) - position_;
+        }
+        if (max_growth_ > 0) {
+            growth = std::min(growth, max_growth_);
+        }
+        vec_u8_reserve_exact(target_, position_ + growth);
     }
     *data = target_.data() + position_;
     *size = target_.capacity() - position_;
@@ -100,14 +649,492 @@ VecOutputStream* NewVecOutputStream(rust::Vec<uint8_t>& target) {
     return new VecOutputStream(target);
 }
 
+VecOutputStream* NewVecOutputStreamWithOptions(rust::Vec<uint8_t>& target, size_t size_hint,
+                                               size_t growth_increment, size_t max_growth) {
+    return new VecOutputStream(target, size_hint, growth_increment, max_growth);
+}
+
 void DeleteVecOutputStream(VecOutputStream* stream) { delete stream; }
 
+ChainOutputStream::ChainOutputStream(rust::Box<ChainWriteAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+bool ChainOutputStream::Next(void** data, int* size) {
+    size_t n;
+    *data = adaptor_->next(n);
+    *size = n;
+    return true;
+}
+
+void ChainOutputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    adaptor_->back_up(count);
+}
+
+int64_t ChainOutputStream::ByteCount() const { return adaptor_->byte_count(); }
+
+ChainOutputStream* NewChainOutputStream(rust::Box<ChainWriteAdaptor> adaptor) {
+    return new ChainOutputStream(std::move(adaptor));
+}
+
+void DeleteChainOutputStream(ChainOutputStream* stream) { delete stream; }
+
+ChunkOutputStream::ChunkOutputStream(rust::Box<ChunkWriteAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+bool ChunkOutputStream::Next(void** data, int* size) {
+    size_t n;
+    *data = adaptor_->next(n);
+    if (n == 0) {
+        return false;
+    }
+    *size = n;
+    return true;
+}
+
+void ChunkOutputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    adaptor_->back_up(count);
+}
+
+int64_t ChunkOutputStream::ByteCount() const { return adaptor_->byte_count(); }
+
+ChunkOutputStream* NewChunkOutputStream(rust::Box<ChunkWriteAdaptor> adaptor) {
+    return new ChunkOutputStream(std::move(adaptor));
+}
+
+void DeleteChunkOutputStream(ChunkOutputStream* stream) { delete stream; }
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+GzipOutputStream* NewGzipOutputStream(ZeroCopyOutputStream* output, int format, int buffer_size,
+                                      int compression_level) {
+    GzipOutputStream::Options options;
+    options.format = static_cast<GzipOutputStream::Format>(format);
+    if (buffer_size >= 0) {
+        options.buffer_size = buffer_size;
+    }
+    if (compression_level >= 0) {
+        options.compression_level = compression_level;
+    }
+    return new GzipOutputStream(output, options);
+}
+
+void DeleteGzipOutputStream(GzipOutputStream* stream) { delete stream; }
+
+rust::String GzipOutputStreamZlibErrorMessage(const GzipOutputStream& stream) {
+    const char* message = stream.ZlibErrorMessage();
+    return rust::String::lossy(message == nullptr ? "" : message);
+}
+
+namespace {
+
+// The most zlib is asked to process at once, as its lengths are `uInt`s.
+constexpr size_t kMaxZlibChunk = size_t{1} << 30;
+
+}  // namespace
+
+bool DeflateBlock(rust::Slice<const uint8_t> dictionary, rust::Slice<const uint8_t> input,
+                  int compression_level, rust::Vec<uint8_t>& output) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Negative window bits select raw deflate data, without a header or
+    // trailer, which the caller writes once for the whole stream.
+    if (deflateInit2(&stream, compression_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) !=
+        Z_OK) {
+        return false;
+    }
+    bool ok = true;
+    if (!dictionary.empty()) {
+        ok = deflateSetDictionary(&stream, dictionary.data(),
+                                  static_cast<uInt>(dictionary.size())) == Z_OK;
+    }
+    const uint8_t* next = input.data();
+    size_t remaining = input.size();
+    while (ok) {
+        uInt chunk = static_cast<uInt>(std::min(remaining, kMaxZlibChunk));
+        stream.next_in = const_cast<Bytef*>(next);
+        stream.avail_in = chunk;
+        next += chunk;
+        remaining -= chunk;
+        int flush = remaining == 0 ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        // deflate has finished with its input once it leaves output space
+        // unused.
+        do {
+            size_t size = output.size();
+            size_t space = deflateBound(&stream, stream.avail_in) + 16;
+            vec_u8_reserve_exact(output, size + space);
+            stream.next_out = output.data() + size;
+            stream.avail_out = static_cast<uInt>(space);
+            int result = deflate(&stream, flush);
+            vec_u8_set_len(output, size + space - stream.avail_out);
+            if (result != Z_OK && result != Z_BUF_ERROR) {
+                ok = false;
+                break;
+            }
+        } while (stream.avail_out == 0);
+        if (remaining == 0) {
+            break;
+        }
+    }
+    deflateEnd(&stream);
+    return ok;
+}
+
+uint32_t GzipChecksum(int format, rust::Slice<const uint8_t> data) {
+    bool gzip = format == GzipOutputStream::GZIP;
+    uLong check = gzip ? crc32(0, nullptr, 0) : adler32(0, nullptr, 0);
+    for (size_t i = 0; i < data.size(); i += kMaxZlibChunk) {
+        uInt len = static_cast<uInt>(std::min(data.size() - i, kMaxZlibChunk));
+        check = gzip ? crc32(check, data.data() + i, len) : adler32(check, data.data() + i, len);
+    }
+    return static_cast<uint32_t>(check);
+}
+
+uint32_t GzipCombineChecksums(int format, uint32_t first, uint32_t second, uint64_t second_len) {
+    z_off_t len = static_cast<z_off_t>(second_len);
+    uLong check = format == GzipOutputStream::GZIP ? crc32_combine(first, second, len)
+                                                   : adler32_combine(first, second, len);
+    return static_cast<uint32_t>(check);
+}
+#endif
+
+Crc32cOutputStream::Crc32cOutputStream(ZeroCopyOutputStream* output)
+    : output_(output), crc_(0), pending_(nullptr), pending_size_(0) {}
+
+bool Crc32cOutputStream::Next(void** data, int* size) {
+    Commit();
+    if (!output_->Next(data, size)) {
+        return false;
+    }
+    pending_ = static_cast<const char*>(*data);
+    pending_size_ = *size;
+    return true;
+}
+
+void Crc32cOutputStream::BackUp(int count) {
+    ABSL_CHECK_GE(count, 0);
+    ABSL_CHECK_LE(count, pending_size_);
+    output_->BackUp(count);
+    pending_size_ -= count;
+    Commit();
+}
+
+int64_t Crc32cOutputStream::ByteCount() const { return output_->ByteCount(); }
+
+uint32_t Crc32cOutputStream::Crc32c() const {
+    return static_cast<uint32_t>(
+        absl::ExtendCrc32c(crc_, absl::string_view(pending_, pending_size_)));
+}
+
+void Crc32cOutputStream::Commit() {
+    crc_ = absl::ExtendCrc32c(crc_, absl::string_view(pending_, pending_size_));
+    pending_size_ = 0;
+}
+
+Crc32cOutputStream* NewCrc32cOutputStream(ZeroCopyOutputStream* output) {
+    return new Crc32cOutputStream(output);
+}
+
+void DeleteCrc32cOutputStream(Crc32cOutputStream* stream) { delete stream; }
+
+absl::Cord* NewCord() { return new absl::Cord(); }
+
+void DeleteCord(absl::Cord* cord) { delete cord; }
+
+void CordAppend(absl::Cord& cord, rust::Slice<const uint8_t> data) {
+    cord.Append(absl::string_view(reinterpret_cast<const char*>(data.data()), data.size()));
+}
+
+void CordAppendCord(absl::Cord& cord, const absl::Cord& other) { cord.Append(other); }
+
+void CordAppendExternal(absl::Cord& cord, rust::Slice<const uint8_t> data,
+                        rust::Box<CordExternal> external) {
+    // The releaser owns the Rust value that owns `data`, and drops it when the
+    // last cord that shares the chunk is destroyed.
+    cord.Append(absl::MakeCordFromExternal(
+        absl::string_view(reinterpret_cast<const char*>(data.data()), data.size()),
+        [external = std::move(external)]() {}));
+}
+
+void CordChunks(const absl::Cord& cord, rust::Vec<CordChunk>& output) {
+    for (absl::string_view chunk : cord.Chunks()) {
+        output.push_back(CordChunk{
+            .data = reinterpret_cast<const uint8_t*>(chunk.data()),
+            .len = chunk.size(),
+        });
+    }
+}
+
+CordInputStream* NewCordInputStream(const absl::Cord& cord) { return new CordInputStream(&cord); }
+
+void DeleteCordInputStream(CordInputStream* stream) { delete stream; }
+
+CordOutputStream* NewCordOutputStream(size_t size_hint) { return new CordOutputStream(size_hint); }
+
+void DeleteCordOutputStream(CordOutputStream* stream) { delete stream; }
+
+absl::Cord* CordOutputStreamConsume(CordOutputStream& stream) {
+    return new absl::Cord(stream.Consume());
+}
+
 CodedInputStream* NewCodedInputStream(ZeroCopyInputStream* input) {
     return new CodedInputStream(input);
 }
 
+CodedInputStream* NewCodedInputStreamFromArray(const uint8_t* buffer, int size) {
+    return new CodedInputStream(buffer, size);
+}
+
 void DeleteCodedInputStream(CodedInputStream* stream) { delete stream; }
 
+void CodedInputStreamResetToArray(CodedInputStream& stream, const uint8_t* buffer, int size) {
+    stream.~CodedInputStream();
+    new (&stream) CodedInputStream(buffer, size);
+}
+
+CodedInputStream* ConstructCodedInputStream(uint8_t* storage, ZeroCopyInputStream* input) {
+    return new (storage) CodedInputStream(input);
+}
+
+CodedInputStream* ConstructCodedInputStreamFromArray(uint8_t* storage, const uint8_t* buffer,
+                                                     int size) {
+    return new (storage) CodedInputStream(buffer, size);
+}
+
+void DestroyCodedInputStream(CodedInputStream* stream) { stream->~CodedInputStream(); }
+
+bool CodedInputStreamSkipField(CodedInputStream& input, uint32_t tag) {
+    return google::protobuf::internal::WireFormatLite::SkipField(&input, tag);
+}
+
+bool CodedInputStreamSkipMessage(CodedInputStream& input) {
+    return google::protobuf::internal::WireFormatLite::SkipMessage(&input);
+}
+
+bool CodedInputStreamReadCord(CodedInputStream& input, absl::Cord& output, int size) {
+    return input.ReadCord(&output, size);
+}
+
+uint32_t CodedInputStreamReadTagWithCutoff(CodedInputStream& input, uint32_t cutoff,
+                                           bool& fast_path) {
+    std::pair<uint32_t, bool> result = input.ReadTagWithCutoff(cutoff);
+    fast_path = result.second;
+    return result.first;
+}
+
+uint32_t CodedInputStreamReadTagWithCutoffNoLastTag(CodedInputStream& input, uint32_t cutoff,
+                                                    bool& fast_path) {
+    std::pair<uint32_t, bool> result = input.ReadTagWithCutoffNoLastTag(cutoff);
+    fast_path = result.second;
+    return result.first;
+}
+
+namespace {
+
+// Decodes varints until the next `length` bytes of `input` are consumed,
+// storing the results in `out`, which must have room for `length` elements.
+// Returns the number of values decoded, or -1 on error.
+//
+// Whenever the current buffer holds at least one maximum-length varint, values
+// are decoded directly from the buffer: runs of single-byte varints eight bytes
+// at a time, and longer varints with the branch-light shift-mix parser that
+// protobuf's table-driven parser uses. Only varints that straddle a buffer
+// boundary fall back to `CodedInputStream::ReadVarint64`.
+template <typename VarintType, typename T, typename Decode>
+int ReadPackedVarints(CodedInputStream& input, int length, T* out, Decode decode) {
+    constexpr int kMaxVarintBytes = 10;
+    CodedInputStream::Limit limit = input.PushLimit(length);
+    int n = 0;
+    bool ok = true;
+    while (ok && input.BytesUntilLimit() > 0) {
+        const void* data;
+        int size;
+        if (input.GetDirectBufferPointer(&data, &size) && size >= kMaxVarintBytes) {
+            const char* start = static_cast<const char*>(data);
+            const char* end = start + size - kMaxVarintBytes;
+            const char* p = start;
+            while (p <= end) {
+                // Runs of single-byte varints, i.e. values below 128, are
+                // common in packed fields, so up to eight of them are found
+                // at once from the continuation bits of a 64-bit word.
+                uint64_t word = absl::little_endian::Load64(p);
+                uint64_t continuation = word & 0x8080808080808080;
+                int run = continuation == 0 ? 8 : absl::countr_zero(continuation) / 8;
+                for (int i = 0; i < run; i++) {
+                    out[n++] = decode(static_cast<uint8_t>(word >> (8 * i)));
+                }
+                p += run;
+                if (run == 8 || p > end) {
+                    continue;
+                }
+                int64_t value;
+                p = google::protobuf::internal::ShiftMixParseVarint<VarintType>(p, value);
+                if (p == nullptr) {
+                    ok = false;
+                    break;
+                }
+                out[n++] = decode(static_cast<uint64_t>(value));
+            }
+            if (ok) {
+                input.Skip(p - start);
+            }
+        } else {
+            uint64_t value;
+            ok = input.ReadVarint64(&value);
+            if (ok) {
+                out[n++] = decode(value);
+            }
+        }
+    }
+    input.PopLimit(limit);
+    return ok ? n : -1;
+}
+
+// Reads `length / sizeof(T)` little-endian values from `input` into `out`.
+// Returns the number of values read, or -1 on error.
+template <typename T>
+int ReadPackedFixed(CodedInputStream& input, int length, T* out) {
+    if (length % sizeof(T) != 0 || !input.ReadRaw(out, length)) {
+        return -1;
+    }
+    int n = length / sizeof(T);
+    for (int i = 0; i < n; i++) {
+        out[i] = absl::little_endian::ToHost(out[i]);
+    }
+    return n;
+}
+
+// Returns the total length of the varint encodings of `values`, each first
+// transformed by `encode`. Each length is computed by comparisons rather than
+// by counting leading zeros, so that the loop vectorizes.
+template <typename VarintType, typename T, typename Encode>
+size_t PackedVarintSize(const T* values, size_t n, Encode encode) {
+    size_t size = n;
+    for (size_t i = 0; i < n; i++) {
+        VarintType v = encode(values[i]);
+        for (size_t shift = 7; shift < 8 * sizeof(VarintType); shift += 7) {
+            size += (v >> shift) != 0;
+        }
+    }
+    return size;
+}
+
+// Writes `values`, each first transformed by `encode`, as a packed sequence of
+// varints preceded by its length.
+//
+// The length is computed in a single pass over the values before any are
+// written, and the values are then encoded directly into the stream's buffer:
+// blocks of eight values below 128 with a single store, and other values one
+// at a time.
+template <typename VarintType, typename T, typename Encode>
+void WritePackedVarints(CodedOutputStream& output, const T* values, size_t n, Encode encode) {
+    output.WriteVarint64(PackedVarintSize<VarintType>(values, n, encode));
+    EpsCopyOutputStream* stream = output.EpsCopy();
+    uint8_t* ptr = output.Cur();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        VarintType bits = 0;
+        uint64_t word = 0;
+        for (int j = 0; j < 8; j++) {
+            VarintType v = encode(values[i + j]);
+            bits |= v;
+            word |= static_cast<uint64_t>(v & 0xFF) << (8 * j);
+        }
+        if (bits < 0x80) {
+            ptr = stream->EnsureSpace(ptr);
+            absl::little_endian::Store64(ptr, word);
+            ptr += 8;
+            continue;
+        }
+        // `EnsureSpace` guarantees room for one maximum-length varint at a
+        // time, but not for eight of them.
+        for (int j = 0; j < 8; j++) {
+            ptr = stream->EnsureSpace(ptr);
+            ptr = CodedOutputStream::WriteVarint64ToArray(encode(values[i + j]), ptr);
+        }
+    }
+    for (; i < n; i++) {
+        ptr = stream->EnsureSpace(ptr);
+        ptr = CodedOutputStream::WriteVarint64ToArray(encode(values[i]), ptr);
+    }
+    output.SetCur(ptr);
+}
+
+}  // namespace
+
+int CodedInputStreamReadPackedVarint32(CodedInputStream& input, int length, uint32_t* out) {
+    return ReadPackedVarints<uint32_t>(input, length, out,
+                                       [](uint64_t v) { return static_cast<uint32_t>(v); });
+}
+
+int CodedInputStreamReadPackedVarint64(CodedInputStream& input, int length, uint64_t* out) {
+    return ReadPackedVarints<uint64_t>(input, length, out, [](uint64_t v) { return v; });
+}
+
+int CodedInputStreamReadPackedSInt32(CodedInputStream& input, int length, int32_t* out) {
+    return ReadPackedVarints<uint32_t>(input, length, out, [](uint64_t v) {
+        uint32_t n = static_cast<uint32_t>(v);
+        return static_cast<int32_t>((n >> 1) ^ (~(n & 1) + 1));
+    });
+}
+
+int CodedInputStreamReadPackedSInt64(CodedInputStream& input, int length, int64_t* out) {
+    return ReadPackedVarints<uint64_t>(input, length, out, [](uint64_t n) {
+        return static_cast<int64_t>((n >> 1) ^ (~(n & 1) + 1));
+    });
+}
+
+int CodedInputStreamReadPackedFixed32(CodedInputStream& input, int length, uint32_t* out) {
+    return ReadPackedFixed(input, length, out);
+}
+
+int CodedInputStreamReadPackedFixed64(CodedInputStream& input, int length, uint64_t* out) {
+    return ReadPackedFixed(input, length, out);
+}
+
+void CodedOutputStreamWritePackedVarint32(CodedOutputStream& output,
+                                          rust::Slice<const uint32_t> values) {
+    WritePackedVarints<uint32_t>(output, values.data(), values.size(),
+                                 [](uint32_t v) { return v; });
+}
+
+void CodedOutputStreamWritePackedVarint64(CodedOutputStream& output,
+                                          rust::Slice<const uint64_t> values) {
+    WritePackedVarints<uint64_t>(output, values.data(), values.size(),
+                                 [](uint64_t v) { return v; });
+}
+
+void CodedOutputStreamWritePackedInt32(CodedOutputStream& output,
+                                       rust::Slice<const int32_t> values) {
+    // Negative values are sign-extended, and so take ten bytes.
+    WritePackedVarints<uint64_t>(output, values.data(), values.size(),
+                                 [](int32_t v) { return static_cast<uint64_t>(int64_t{v}); });
+}
+
+void CodedOutputStreamWritePackedInt64(CodedOutputStream& output,
+                                       rust::Slice<const int64_t> values) {
+    WritePackedVarints<uint64_t>(output, values.data(), values.size(),
+                                 [](int64_t v) { return static_cast<uint64_t>(v); });
+}
+
+void CodedOutputStreamWritePackedSInt32(CodedOutputStream& output,
+                                        rust::Slice<const int32_t> values) {
+    WritePackedVarints<uint32_t>(output, values.data(), values.size(), [](int32_t v) {
+        return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    });
+}
+
+void CodedOutputStreamWritePackedSInt64(CodedOutputStream& output,
+                                        rust::Slice<const int64_t> values) {
+    WritePackedVarints<uint64_t>(output, values.data(), values.size(), [](int64_t v) {
+        return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+    });
+}
+
+CodedOutputStream* NewCodedOutputStream(ZeroCopyOutputStream* output) {
+    return new CodedOutputStream(output);
+}
+
 void DeleteCodedOutputStream(CodedOutputStream* stream) { delete stream; }
 
 }  // namespace io
@@ -17,10 +17,16 @@
 
 #include <memory>
 
+#include "absl/crc/crc32c.h"
+#include "absl/strings/cord.h"
 #include "google/protobuf/io/coded_stream.h"
+#ifdef PROTOBUF_NATIVE_ZLIB
+#include "google/protobuf/io/gzip_stream.h"
+#endif
 #include "google/protobuf/io/zero_copy_stream.h"
 #include "google/protobuf/io/zero_copy_stream_impl.h"
 #include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/wire_format_lite.h"
 #include "rust/cxx.h"
 
 namespace protobuf_native {
@@ -29,13 +35,20 @@ namespace io {
 using namespace google::protobuf::io;
 
 struct ReadAdaptor;
+struct BufReadAdaptor;
 struct WriteAdaptor;
+struct ChainReadAdaptor;
+struct ChainWriteAdaptor;
+struct ChunkReadAdaptor;
+struct ChunkWriteAdaptor;
+struct CordChunk;
+struct CordExternal;
 
 void DeleteZeroCopyInputStream(ZeroCopyInputStream*);
 
 class ReaderStream : public CopyingInputStreamAdaptor {
    public:
-    ReaderStream(rust::Box<ReadAdaptor> adaptor);
+    ReaderStream(rust::Box<ReadAdaptor> adaptor, int block_size);
 
    private:
     class CopyingReaderStream : public CopyingInputStream {
@@ -49,17 +62,154 @@ class ReaderStream : public CopyingInputStreamAdaptor {
     };
 };
 
-ReaderStream* NewReaderStream(rust::Box<ReadAdaptor> adaptor);
+ReaderStream* NewReaderStream(rust::Box<ReadAdaptor> adaptor, int block_size);
 void DeleteReaderStream(ReaderStream*);
 
+class BufReadStream : public ZeroCopyInputStream {
+   public:
+    BufReadStream(rust::Box<BufReadAdaptor> adaptor);
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override;
+
+   private:
+    rust::Box<BufReadAdaptor> adaptor_;
+};
+
+BufReadStream* NewBufReadStream(rust::Box<BufReadAdaptor> adaptor);
+void DeleteBufReadStream(BufReadStream*);
+
 ArrayInputStream* NewArrayInputStream(const uint8_t* data, int size);
 void DeleteArrayInputStream(ArrayInputStream*);
+void ArrayInputStreamReset(ArrayInputStream& stream, const uint8_t* data, int size);
+
+class MmapInputStream : public ZeroCopyInputStream {
+   public:
+    MmapInputStream(void* data, size_t size);
+    ~MmapInputStream() override;
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override;
+
+    rust::Slice<const uint8_t> Contents() const;
+
+   private:
+    void* data_;
+    size_t size_;
+    ArrayInputStream stream_;
+};
+
+MmapInputStream* NewMmapInputStream(int fd, size_t size);
+void DeleteMmapInputStream(MmapInputStream*);
+
+// Reads from a file descriptor, which it owns, into a buffer aligned for
+// O_DIRECT. Unlike FileInputStream, whose buffer comes from operator new[],
+// this can read from files opened with O_DIRECT, provided that the block
+// size is a multiple of the file system's block size.
+class FdInputStream : public ZeroCopyInputStream {
+   public:
+    FdInputStream(int fd, uint8_t* buffer, int block_size);
+    ~FdInputStream() override;
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override;
+
+    // Returns the errno of the read that failed, or zero.
+    int GetErrno() const;
+
+   private:
+    bool Fill();
+
+    int fd_;
+    uint8_t* buffer_;
+    int block_size_;
+    int buffer_used_;
+    int position_;
+    int64_t bytes_read_;
+    int errno_;
+};
+
+// Takes ownership of `fd` on success only.
+FdInputStream* NewFdInputStream(int fd, int block_size, bool sequential, bool direct);
+void DeleteFdInputStream(FdInputStream*);
+
+class ChainInputStream : public ZeroCopyInputStream {
+   public:
+    ChainInputStream(rust::Box<ChainReadAdaptor> adaptor);
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override;
+
+   private:
+    rust::Box<ChainReadAdaptor> adaptor_;
+};
+
+ChainInputStream* NewChainInputStream(rust::Box<ChainReadAdaptor> adaptor);
+void DeleteChainInputStream(ChainInputStream*);
+
+class ChunkInputStream : public ZeroCopyInputStream {
+   public:
+    ChunkInputStream(rust::Box<ChunkReadAdaptor> adaptor);
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override;
+
+   private:
+    rust::Box<ChunkReadAdaptor> adaptor_;
+};
+
+ChunkInputStream* NewChunkInputStream(rust::Box<ChunkReadAdaptor> adaptor);
+void DeleteChunkInputStream(ChunkInputStream*);
+
+LimitingInputStream* NewLimitingInputStream(ZeroCopyInputStream* input, int64_t limit);
+void DeleteLimitingInputStream(LimitingInputStream*);
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+GzipInputStream* NewGzipInputStream(ZeroCopyInputStream* input, int format, int buffer_size);
+void DeleteGzipInputStream(GzipInputStream*);
+rust::String GzipInputStreamZlibErrorMessage(const GzipInputStream& stream);
+#endif
+
+// Computes the CRC32C of the bytes read through it. A buffer returned by Next
+// counts as read unless it is backed up.
+class Crc32cInputStream : public ZeroCopyInputStream {
+   public:
+    Crc32cInputStream(ZeroCopyInputStream* input);
+
+    bool Next(const void** data, int* size) override;
+    void BackUp(int count) override;
+    bool Skip(int count) override;
+    int64_t ByteCount() const override;
+
+    uint32_t Crc32c() const;
+
+   private:
+    void Commit();
+
+    ZeroCopyInputStream* input_;
+    absl::crc32c_t crc_;
+    const char* pending_;
+    int pending_size_;
+};
+
+Crc32cInputStream* NewCrc32cInputStream(ZeroCopyInputStream* input);
+void DeleteCrc32cInputStream(Crc32cInputStream*);
 
 void DeleteZeroCopyOutputStream(ZeroCopyOutputStream*);
 
 class WriterStream : public CopyingOutputStreamAdaptor {
    public:
-    WriterStream(rust::Box<WriteAdaptor> adaptor);
+    WriterStream(rust::Box<WriteAdaptor> adaptor, int block_size);
 
    private:
     class CopyingWriterStream : public CopyingOutputStream {
@@ -73,15 +223,52 @@ class WriterStream : public CopyingOutputStreamAdaptor {
     };
 };
 
-WriterStream* NewWriterStream(rust::Box<WriteAdaptor> adaptor);
+WriterStream* NewWriterStream(rust::Box<WriteAdaptor> adaptor, int block_size);
 void DeleteWriterStream(WriterStream*);
 
+// Writes to a file descriptor, which it owns, from a buffer aligned for
+// O_DIRECT. Every write is of a whole number of blocks, except for the last,
+// which Close makes after clearing O_DIRECT from the descriptor.
+class FdOutputStream : public ZeroCopyOutputStream {
+   public:
+    FdOutputStream(int fd, uint8_t* buffer, int block_size, bool direct);
+    ~FdOutputStream() override;
+
+    bool Next(void** data, int* size) override;
+    void BackUp(int count) override;
+    int64_t ByteCount() const override;
+
+    // Writes the buffered bytes; with O_DIRECT, only whole blocks of them.
+    bool Flush();
+    // Writes every buffered byte and closes the descriptor.
+    bool Close();
+    // Returns the errno of the write or close that failed, or zero.
+    int GetErrno() const;
+
+   private:
+    bool WriteAll(const uint8_t* data, size_t size);
+
+    int fd_;
+    uint8_t* buffer_;
+    int block_size_;
+    bool direct_;
+    int position_;
+    int64_t bytes_written_;
+    int errno_;
+};
+
+// Takes ownership of `fd` on success only.
+FdOutputStream* NewFdOutputStream(int fd, int block_size, bool direct);
+void DeleteFdOutputStream(FdOutputStream*);
+
 ArrayOutputStream* NewArrayOutputStream(uint8_t* data, int size);
 void DeleteArrayOutputStream(ArrayOutputStream*);
 
 class VecOutputStream : public ZeroCopyOutputStream {
    public:
     VecOutputStream(rust::Vec<uint8_t>& target);
+    VecOutputStream(rust::Vec<uint8_t>& target, size_t size_hint, size_t growth_increment,
+                    size_t max_growth);
     ~VecOutputStream();
 
     bool Next(void** data, int* size) override;
@@ -94,15 +281,150 @@ class VecOutputStream : public ZeroCopyOutputStream {
     rust::Vec<uint8_t>& target_;
     size_t start_position_;
     size_t position_;
+    // The number of bytes by which to grow the vector, or zero to double its
+    // capacity.
+    size_t growth_increment_;
+    // The maximum number of bytes by which to grow the vector at once, or zero
+    // for no maximum.
+    size_t max_growth_;
 };
 
 VecOutputStream* NewVecOutputStream(rust::Vec<uint8_t>& target);
+VecOutputStream* NewVecOutputStreamWithOptions(rust::Vec<uint8_t>& target, size_t size_hint,
+                                               size_t growth_increment, size_t max_growth);
 void DeleteVecOutputStream(VecOutputStream*);
 
+class ChainOutputStream : public ZeroCopyOutputStream {
+   public:
+    ChainOutputStream(rust::Box<ChainWriteAdaptor> adaptor);
+
+    bool Next(void** data, int* size) override;
+    void BackUp(int count) override;
+    int64_t ByteCount() const override;
+
+   private:
+    rust::Box<ChainWriteAdaptor> adaptor_;
+};
+
+ChainOutputStream* NewChainOutputStream(rust::Box<ChainWriteAdaptor> adaptor);
+void DeleteChainOutputStream(ChainOutputStream*);
+
+class ChunkOutputStream : public ZeroCopyOutputStream {
+   public:
+    ChunkOutputStream(rust::Box<ChunkWriteAdaptor> adaptor);
+
+    bool Next(void** data, int* size) override;
+    void BackUp(int count) override;
+    int64_t ByteCount() const override;
+
+   private:
+    rust::Box<ChunkWriteAdaptor> adaptor_;
+};
+
+ChunkOutputStream* NewChunkOutputStream(rust::Box<ChunkWriteAdaptor> adaptor);
+void DeleteChunkOutputStream(ChunkOutputStream*);
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+GzipOutputStream* NewGzipOutputStream(ZeroCopyOutputStream* output, int format, int buffer_size,
+                                      int compression_level);
+void DeleteGzipOutputStream(GzipOutputStream*);
+rust::String GzipOutputStreamZlibErrorMessage(const GzipOutputStream& stream);
+
+// Compresses `input` as raw deflate data that continues from `dictionary`,
+// ending with a sync flush, so that the compressed blocks of consecutive
+// pieces of a stream can be concatenated. Appends the compressed data to
+// `output`.
+bool DeflateBlock(rust::Slice<const uint8_t> dictionary, rust::Slice<const uint8_t> input,
+                  int compression_level, rust::Vec<uint8_t>& output);
+// Computes the CRC-32, for the gzip format, or Adler-32, for the zlib format,
+// of `data`, and combines the checksums of consecutive pieces of a stream.
+uint32_t GzipChecksum(int format, rust::Slice<const uint8_t> data);
+uint32_t GzipCombineChecksums(int format, uint32_t first, uint32_t second, uint64_t second_len);
+#endif
+
+// Computes the CRC32C of the bytes written through it. A buffer returned by
+// Next counts as written unless it is backed up.
+class Crc32cOutputStream : public ZeroCopyOutputStream {
+   public:
+    Crc32cOutputStream(ZeroCopyOutputStream* output);
+
+    bool Next(void** data, int* size) override;
+    void BackUp(int count) override;
+    int64_t ByteCount() const override;
+
+    uint32_t Crc32c() const;
+
+   private:
+    void Commit();
+
+    ZeroCopyOutputStream* output_;
+    absl::crc32c_t crc_;
+    const char* pending_;
+    int pending_size_;
+};
+
+Crc32cOutputStream* NewCrc32cOutputStream(ZeroCopyOutputStream* output);
+void DeleteCrc32cOutputStream(Crc32cOutputStream*);
+
+absl::Cord* NewCord();
+void DeleteCord(absl::Cord* cord);
+void CordAppend(absl::Cord& cord, rust::Slice<const uint8_t> data);
+void CordAppendCord(absl::Cord& cord, const absl::Cord& other);
+void CordAppendExternal(absl::Cord& cord, rust::Slice<const uint8_t> data,
+                        rust::Box<CordExternal> external);
+void CordChunks(const absl::Cord& cord, rust::Vec<CordChunk>& output);
+
+CordInputStream* NewCordInputStream(const absl::Cord& cord);
+void DeleteCordInputStream(CordInputStream* stream);
+
+CordOutputStream* NewCordOutputStream(size_t size_hint);
+void DeleteCordOutputStream(CordOutputStream* stream);
+absl::Cord* CordOutputStreamConsume(CordOutputStream& stream);
+
 CodedInputStream* NewCodedInputStream(ZeroCopyInputStream* input);
+CodedInputStream* NewCodedInputStreamFromArray(const uint8_t* buffer, int size);
 void DeleteCodedInputStream(CodedInputStream*);
+void CodedInputStreamResetToArray(CodedInputStream& stream, const uint8_t* buffer, int size);
+
+// Storage for a CodedInputStream constructed in memory owned by Rust. Must be
+// kept in sync with `CodedInputStreamStorage` in io.rs.
+constexpr size_t kCodedInputStreamStorageSize = 96;
+constexpr size_t kCodedInputStreamStorageAlign = 8;
+static_assert(sizeof(CodedInputStream) <= kCodedInputStreamStorageSize, "");
+static_assert(alignof(CodedInputStream) <= kCodedInputStreamStorageAlign, "");
+
+CodedInputStream* ConstructCodedInputStream(uint8_t* storage, ZeroCopyInputStream* input);
+CodedInputStream* ConstructCodedInputStreamFromArray(uint8_t* storage, const uint8_t* buffer,
+                                                     int size);
+void DestroyCodedInputStream(CodedInputStream* stream);
+uint32_t CodedInputStreamReadTagWithCutoff(CodedInputStream& input, uint32_t cutoff,
+                                           bool& fast_path);
+uint32_t CodedInputStreamReadTagWithCutoffNoLastTag(CodedInputStream& input, uint32_t cutoff,
+                                                    bool& fast_path);
+bool CodedInputStreamSkipField(CodedInputStream& input, uint32_t tag);
+bool CodedInputStreamSkipMessage(CodedInputStream& input);
+bool CodedInputStreamReadCord(CodedInputStream& input, absl::Cord& output, int size);
+int CodedInputStreamReadPackedVarint32(CodedInputStream& input, int length, uint32_t* out);
+int CodedInputStreamReadPackedVarint64(CodedInputStream& input, int length, uint64_t* out);
+int CodedInputStreamReadPackedSInt32(CodedInputStream& input, int length, int32_t* out);
+int CodedInputStreamReadPackedSInt64(CodedInputStream& input, int length, int64_t* out);
+int CodedInputStreamReadPackedFixed32(CodedInputStream& input, int length, uint32_t* out);
+int CodedInputStreamReadPackedFixed64(CodedInputStream& input, int length, uint64_t* out);
 
+CodedOutputStream* NewCodedOutputStream(ZeroCopyOutputStream* output);
 void DeleteCodedOutputStream(CodedOutputStream*);
+void CodedOutputStreamWritePackedVarint32(CodedOutputStream& output,
+                                          rust::Slice<const uint32_t> values);
+void CodedOutputStreamWritePackedVarint64(CodedOutputStream& output,
+                                          rust::Slice<const uint64_t> values);
+void CodedOutputStreamWritePackedInt32(CodedOutputStream& output,
+                                       rust::Slice<const int32_t> values);
+void CodedOutputStreamWritePackedInt64(CodedOutputStream& output,
+                                       rust::Slice<const int64_t> values);
+void CodedOutputStreamWritePackedSInt32(CodedOutputStream& output,
+                                        rust::Slice<const int32_t> values);
+void CodedOutputStreamWritePackedSInt64(CodedOutputStream& output,
+                                        rust::Slice<const int64_t> values);
 
 }  // namespace io
 }  // namespace protobuf_native
@@ -73,6 +73,43 @@
 //! step, but the coded streams will handle buffering so at least it will be
 //! reasonably efficient.
 //
+//! # Compression
+//!
+//! `GzipInputStream` and `GzipOutputStream` decompress and compress gzip
+//! and zlib data incrementally, on top of any other zero-copy stream.
+//! `ParallelGzipWriter` compresses large outputs on several threads at once.
+//! They are only available if the `zlib` feature is enabled, as they link
+//! against the system zlib.
+//!
+//! Other codecs, such as zstd or LZ4, are not bundled with this crate, but
+//! any streaming decoder that implements [`Read`] can be adapted with
+//! [`ReaderStream`], and any streaming encoder that implements [`Write`] with
+//! [`WriterStream`]. `ReaderStream` hands the decoder the very buffer that it
+//! will return from [`ZeroCopyInputStream::next`], so decompressed data is
+//! written directly into the buffer the parser reads from, with no
+//! intermediate copy. Likewise `WriterStream` passes the serialized bytes to
+//! the encoder straight from the buffer the serializer wrote them into. Use
+//! [`ReaderStream::with_block_size`] to match the block size to the codec's
+//! preferred output size.
+//!
+//! ```ignore
+//! use std::fs::File;
+//! use protobuf_native::io::ReaderStream;
+//!
+//! let mut decoder = zstd::Decoder::new(File::open("records.zst")?)?;
+//! let mut input = ReaderStream::with_block_size(&mut decoder, 128 << 10);
+//! // Parse from `input`...
+//! ```
+//
+//! # Checksums
+//!
+//! [`Crc32cInputStream`] and [`Crc32cOutputStream`] compute the CRC32C of the
+//! data passing through them, using Abseil's hardware-accelerated
+//! implementation where available. Each buffer is checksummed as it is handed
+//! back to the stream, while it is still hot in cache, so a record can be
+//! verified while it is parsed, or checksummed while it is serialized, without
+//! a second pass over its bytes.
+//
 //! # Coded streams
 //!
 //! The [`CodedInputStream`] and [`CodedOutputStream`] classes, which wrap a
@@ -104,23 +141,74 @@
 //! for practicality we set a limit at 64 bits. The maximum encoded length of a
 //! number is thus 10 bytes.
 
-use std::io::{self, Read, Write};
+use std::borrow::Cow;
+#[cfg(feature = "zlib")]
+use std::collections::BTreeMap;
+use std::fs::File;
+use std::io::{self, BufRead, Read, Write};
 use std::marker::{PhantomData, PhantomPinned};
 use std::mem::{self, MaybeUninit};
+#[cfg(unix)]
+use std::os::unix::io::{AsRawFd, IntoRawFd, OwnedFd};
+use std::path::Path;
 use std::pin::Pin;
+use std::ptr;
 use std::slice;
-
-use crate::internal::{unsafe_ffi_conversions, BoolExt, CInt, CVoid, ReadAdaptor, WriteAdaptor};
-use crate::OperationFailedError;
+use std::sync::mpsc;
+#[cfg(feature = "zlib")]
+use std::sync::{Arc, Mutex};
+use std::thread;
+
+use crate::internal::{
+    unsafe_ffi_conversions, BoolExt, BufReadAdaptor, CInt, CVoid, ChainReadAdaptor,
+    ChainWriteAdaptor, ChunkReadAdaptor, ChunkWriteAdaptor, CordExternal, ReadAdaptor,
+    WriteAdaptor,
+};
+use crate::{MessageLite, OperationFailedError};
 
 #[cxx::bridge(namespace = "protobuf_native::io")]
 pub(crate) mod ffi {
+    struct CordChunk {
+        data: *const u8,
+        len: usize,
+    }
+
     extern "Rust" {
         type ReadAdaptor<'a>;
         fn read(self: &mut ReadAdaptor<'_>, buf: &mut [u8]) -> isize;
 
         type WriteAdaptor<'a>;
         fn write(self: &mut WriteAdaptor<'_>, buf: &[u8]) -> bool;
+
+        type BufReadAdaptor<'a>;
+        fn next(self: &mut BufReadAdaptor<'_>) -> &[u8];
+        fn back_up(self: &mut BufReadAdaptor<'_>, count: usize);
+        fn skip(self: &mut BufReadAdaptor<'_>, count: usize) -> bool;
+        fn byte_count(self: &BufReadAdaptor<'_>) -> i64;
+
+        type ChainReadAdaptor<'a>;
+        fn next(self: &mut ChainReadAdaptor<'_>) -> &[u8];
+        fn back_up(self: &mut ChainReadAdaptor<'_>, count: usize);
+        fn skip(self: &mut ChainReadAdaptor<'_>, count: usize) -> bool;
+        fn byte_count(self: &ChainReadAdaptor<'_>) -> i64;
+
+        type ChainWriteAdaptor<'a>;
+        fn next(self: &mut ChainWriteAdaptor<'_>, size: &mut usize) -> *mut u8;
+        fn back_up(self: &mut ChainWriteAdaptor<'_>, count: usize);
+        fn byte_count(self: &ChainWriteAdaptor<'_>) -> i64;
+
+        type ChunkReadAdaptor<'a>;
+        fn next(self: &mut ChunkReadAdaptor<'_>) -> &[u8];
+        fn back_up(self: &mut ChunkReadAdaptor<'_>, count: usize);
+        fn skip(self: &mut ChunkReadAdaptor<'_>, count: usize) -> bool;
+        fn byte_count(self: &ChunkReadAdaptor<'_>) -> i64;
+
+        type ChunkWriteAdaptor<'a>;
+        fn next(self: &mut ChunkWriteAdaptor<'_>, size: &mut usize) -> *mut u8;
+        fn back_up(self: &mut ChunkWriteAdaptor<'_>, count: usize);
+        fn byte_count(self: &ChunkWriteAdaptor<'_>) -> i64;
+
+        type CordExternal;
     }
     unsafe extern "C++" {
         include!("protobuf-native/src/internal.h");
@@ -145,13 +233,53 @@ pub(crate) mod ffi {
         fn ByteCount(self: &ZeroCopyInputStream) -> i64;
 
         type ReaderStream;
-        fn NewReaderStream(adaptor: Box<ReadAdaptor<'_>>) -> *mut ReaderStream;
+        fn NewReaderStream(adaptor: Box<ReadAdaptor<'_>>, block_size: CInt) -> *mut ReaderStream;
         unsafe fn DeleteReaderStream(stream: *mut ReaderStream);
 
+        type BufReadStream;
+        fn NewBufReadStream(adaptor: Box<BufReadAdaptor<'_>>) -> *mut BufReadStream;
+        unsafe fn DeleteBufReadStream(stream: *mut BufReadStream);
+
         #[namespace = "google::protobuf::io"]
         type ArrayInputStream;
         unsafe fn NewArrayInputStream(data: *const u8, size: CInt) -> *mut ArrayInputStream;
         unsafe fn DeleteArrayInputStream(stream: *mut ArrayInputStream);
+        unsafe fn ArrayInputStreamReset(
+            stream: Pin<&mut ArrayInputStream>,
+            data: *const u8,
+            size: CInt,
+        );
+
+        type MmapInputStream;
+        fn NewMmapInputStream(fd: CInt, size: usize) -> *mut MmapInputStream;
+        unsafe fn DeleteMmapInputStream(stream: *mut MmapInputStream);
+        fn Contents(self: &MmapInputStream) -> &[u8];
+
+        type FdInputStream;
+        fn NewFdInputStream(
+            fd: CInt,
+            block_size: CInt,
+            sequential: bool,
+            direct: bool,
+        ) -> *mut FdInputStream;
+        unsafe fn DeleteFdInputStream(stream: *mut FdInputStream);
+        fn GetErrno(self: &FdInputStream) -> CInt;
+
+        type ChainInputStream;
+        fn NewChainInputStream(adaptor: Box<ChainReadAdaptor<'_>>) -> *mut ChainInputStream;
+        unsafe fn DeleteChainInputStream(stream: *mut ChainInputStream);
+
+        type ChunkInputStream;
+        fn NewChunkInputStream(adaptor: Box<ChunkReadAdaptor<'_>>) -> *mut ChunkInputStream;
+        unsafe fn DeleteChunkInputStream(stream: *mut ChunkInputStream);
+
+        #[namespace = "google::protobuf::io"]
+        type LimitingInputStream;
+        unsafe fn NewLimitingInputStream(
+            input: *mut ZeroCopyInputStream,
+            limit: i64,
+        ) -> *mut LimitingInputStream;
+        unsafe fn DeleteLimitingInputStream(stream: *mut LimitingInputStream);
 
         #[namespace = "google::protobuf::io"]
         type ZeroCopyOutputStream;
@@ -164,9 +292,16 @@ pub(crate) mod ffi {
         fn ByteCount(self: &ZeroCopyOutputStream) -> i64;
 
         type WriterStream;
-        fn NewWriterStream(adaptor: Box<WriteAdaptor<'_>>) -> *mut WriterStream;
+        fn NewWriterStream(adaptor: Box<WriteAdaptor<'_>>, block_size: CInt) -> *mut WriterStream;
         unsafe fn DeleteWriterStream(stream: *mut WriterStream);
 
+        type FdOutputStream;
+        fn NewFdOutputStream(fd: CInt, block_size: CInt, direct: bool) -> *mut FdOutputStream;
+        unsafe fn DeleteFdOutputStream(stream: *mut FdOutputStream);
+        fn Flush(self: Pin<&mut FdOutputStream>) -> bool;
+        fn Close(self: Pin<&mut FdOutputStream>) -> bool;
+        fn GetErrno(self: &FdOutputStream) -> CInt;
+
         #[namespace = "google::protobuf::io"]
         type ArrayOutputStream;
         unsafe fn NewArrayOutputStream(data: *mut u8, size: CInt) -> *mut ArrayOutputStream;
@@ -174,26 +309,224 @@ pub(crate) mod ffi {
 
         type VecOutputStream;
         fn NewVecOutputStream(target: &mut Vec<u8>) -> *mut VecOutputStream;
+        fn NewVecOutputStreamWithOptions(
+            target: &mut Vec<u8>,
+            size_hint: usize,
+            growth_increment: usize,
+            max_growth: usize,
+        ) -> *mut VecOutputStream;
         unsafe fn DeleteVecOutputStream(stream: *mut VecOutputStream);
 
+        type ChainOutputStream;
+        fn NewChainOutputStream(adaptor: Box<ChainWriteAdaptor<'_>>) -> *mut ChainOutputStream;
+        unsafe fn DeleteChainOutputStream(stream: *mut ChainOutputStream);
+
+        type ChunkOutputStream;
+        fn NewChunkOutputStream(adaptor: Box<ChunkWriteAdaptor<'_>>) -> *mut ChunkOutputStream;
+        unsafe fn DeleteChunkOutputStream(stream: *mut ChunkOutputStream);
+
+        #[cfg(feature = "zlib")]
+        #[namespace = "google::protobuf::io"]
+        type GzipInputStream;
+        #[cfg(feature = "zlib")]
+        unsafe fn NewGzipInputStream(
+            input: *mut ZeroCopyInputStream,
+            format: CInt,
+            buffer_size: CInt,
+        ) -> *mut GzipInputStream;
+        #[cfg(feature = "zlib")]
+        unsafe fn DeleteGzipInputStream(stream: *mut GzipInputStream);
+        #[cfg(feature = "zlib")]
+        fn GzipInputStreamZlibErrorMessage(stream: &GzipInputStream) -> String;
+
+        type Crc32cInputStream;
+        unsafe fn NewCrc32cInputStream(input: *mut ZeroCopyInputStream) -> *mut Crc32cInputStream;
+        unsafe fn DeleteCrc32cInputStream(stream: *mut Crc32cInputStream);
+        fn Crc32c(self: &Crc32cInputStream) -> u32;
+
+        #[cfg(feature = "zlib")]
+        #[namespace = "google::protobuf::io"]
+        type GzipOutputStream;
+        #[cfg(feature = "zlib")]
+        unsafe fn NewGzipOutputStream(
+            output: *mut ZeroCopyOutputStream,
+            format: CInt,
+            buffer_size: CInt,
+            compression_level: CInt,
+        ) -> *mut GzipOutputStream;
+        #[cfg(feature = "zlib")]
+        unsafe fn DeleteGzipOutputStream(stream: *mut GzipOutputStream);
+        #[cfg(feature = "zlib")]
+        fn GzipOutputStreamZlibErrorMessage(stream: &GzipOutputStream) -> String;
+        #[cfg(feature = "zlib")]
+        fn Flush(self: Pin<&mut GzipOutputStream>) -> bool;
+        #[cfg(feature = "zlib")]
+        fn Close(self: Pin<&mut GzipOutputStream>) -> bool;
+
+        #[cfg(feature = "zlib")]
+        fn DeflateBlock(
+            dictionary: &[u8],
+            input: &[u8],
+            compression_level: CInt,
+            output: &mut Vec<u8>,
+        ) -> bool;
+        #[cfg(feature = "zlib")]
+        fn GzipChecksum(format: CInt, data: &[u8]) -> u32;
+        #[cfg(feature = "zlib")]
+        fn GzipCombineChecksums(format: CInt, first: u32, second: u32, second_len: u64) -> u32;
+
+        type Crc32cOutputStream;
+        unsafe fn NewCrc32cOutputStream(
+            output: *mut ZeroCopyOutputStream,
+        ) -> *mut Crc32cOutputStream;
+        unsafe fn DeleteCrc32cOutputStream(stream: *mut Crc32cOutputStream);
+        fn Crc32c(self: &Crc32cOutputStream) -> u32;
+
+        #[namespace = "absl"]
+        type Cord;
+        fn NewCord() -> *mut Cord;
+        unsafe fn DeleteCord(cord: *mut Cord);
+        fn size(self: &Cord) -> usize;
+        fn Clear(self: Pin<&mut Cord>);
+        fn CordAppend(cord: Pin<&mut Cord>, data: &[u8]);
+        fn CordAppendCord(cord: Pin<&mut Cord>, other: &Cord);
+        fn CordAppendExternal(cord: Pin<&mut Cord>, data: &[u8], external: Box<CordExternal>);
+        fn CordChunks(cord: &Cord, output: &mut Vec<CordChunk>);
+
+        #[namespace = "google::protobuf::io"]
+        type CordInputStream;
+        fn NewCordInputStream(cord: &Cord) -> *mut CordInputStream;
+        unsafe fn DeleteCordInputStream(stream: *mut CordInputStream);
+
+        #[namespace = "google::protobuf::io"]
+        type CordOutputStream;
+        fn NewCordOutputStream(size_hint: usize) -> *mut CordOutputStream;
+        unsafe fn DeleteCordOutputStream(stream: *mut CordOutputStream);
+        fn CordOutputStreamConsume(stream: Pin<&mut CordOutputStream>) -> *mut Cord;
+
         #[namespace = "google::protobuf::io"]
         type CodedInputStream;
         unsafe fn NewCodedInputStream(ptr: *mut ZeroCopyInputStream) -> *mut CodedInputStream;
+        unsafe fn NewCodedInputStreamFromArray(
+            buffer: *const u8,
+            size: CInt,
+        ) -> *mut CodedInputStream;
         unsafe fn DeleteCodedInputStream(stream: *mut CodedInputStream);
+        unsafe fn CodedInputStreamResetToArray(
+            stream: Pin<&mut CodedInputStream>,
+            buffer: *const u8,
+            size: CInt,
+        );
+        unsafe fn ConstructCodedInputStream(
+            storage: *mut u8,
+            input: *mut ZeroCopyInputStream,
+        ) -> *mut CodedInputStream;
+        unsafe fn ConstructCodedInputStreamFromArray(
+            storage: *mut u8,
+            buffer: *const u8,
+            size: CInt,
+        ) -> *mut CodedInputStream;
+        unsafe fn DestroyCodedInputStream(stream: *mut CodedInputStream);
         fn IsFlat(self: &CodedInputStream) -> bool;
+        fn Skip(self: Pin<&mut CodedInputStream>, count: CInt) -> bool;
+        unsafe fn GetDirectBufferPointer(
+            self: Pin<&mut CodedInputStream>,
+            data: *mut *const CVoid,
+            size: *mut CInt,
+        ) -> bool;
         unsafe fn ReadRaw(self: Pin<&mut CodedInputStream>, buffer: *mut CVoid, size: CInt)
             -> bool;
         unsafe fn ReadVarint32(self: Pin<&mut CodedInputStream>, value: *mut u32) -> bool;
         unsafe fn ReadVarint64(self: Pin<&mut CodedInputStream>, value: *mut u64) -> bool;
         fn ReadTag(self: Pin<&mut CodedInputStream>) -> u32;
         fn ReadTagNoLastTag(self: Pin<&mut CodedInputStream>) -> u32;
+        fn CodedInputStreamReadTagWithCutoff(
+            input: Pin<&mut CodedInputStream>,
+            cutoff: u32,
+            fast_path: &mut bool,
+        ) -> u32;
+        fn CodedInputStreamReadTagWithCutoffNoLastTag(
+            input: Pin<&mut CodedInputStream>,
+            cutoff: u32,
+            fast_path: &mut bool,
+        ) -> u32;
         fn LastTagWas(self: Pin<&mut CodedInputStream>, expected: u32) -> bool;
         fn ConsumedEntireMessage(self: Pin<&mut CodedInputStream>) -> bool;
+        fn CodedInputStreamSkipField(input: Pin<&mut CodedInputStream>, tag: u32) -> bool;
+        fn CodedInputStreamSkipMessage(input: Pin<&mut CodedInputStream>) -> bool;
         fn CurrentPosition(self: &CodedInputStream) -> CInt;
+        fn PushLimit(self: Pin<&mut CodedInputStream>, byte_limit: CInt) -> CInt;
+        fn PopLimit(self: Pin<&mut CodedInputStream>, limit: CInt);
+        fn BytesUntilLimit(self: &CodedInputStream) -> CInt;
+        fn SetTotalBytesLimit(self: Pin<&mut CodedInputStream>, total_bytes_limit: CInt);
+        fn BytesUntilTotalBytesLimit(self: &CodedInputStream) -> CInt;
+        fn SetRecursionLimit(self: Pin<&mut CodedInputStream>, limit: CInt);
+        fn CodedInputStreamReadCord(
+            input: Pin<&mut CodedInputStream>,
+            output: Pin<&mut Cord>,
+            size: CInt,
+        ) -> bool;
+        unsafe fn CodedInputStreamReadPackedVarint32(
+            input: Pin<&mut CodedInputStream>,
+            length: CInt,
+            out: *mut u32,
+        ) -> CInt;
+        unsafe fn CodedInputStreamReadPackedVarint64(
+            input: Pin<&mut CodedInputStream>,
+            length: CInt,
+            out: *mut u64,
+        ) -> CInt;
+        unsafe fn CodedInputStreamReadPackedSInt32(
+            input: Pin<&mut CodedInputStream>,
+            length: CInt,
+            out: *mut i32,
+        ) -> CInt;
+        unsafe fn CodedInputStreamReadPackedSInt64(
+            input: Pin<&mut CodedInputStream>,
+            length: CInt,
+            out: *mut i64,
+        ) -> CInt;
+        unsafe fn CodedInputStreamReadPackedFixed32(
+            input: Pin<&mut CodedInputStream>,
+            length: CInt,
+            out: *mut u32,
+        ) -> CInt;
+        unsafe fn CodedInputStreamReadPackedFixed64(
+            input: Pin<&mut CodedInputStream>,
+            length: CInt,
+            out: *mut u64,
+        ) -> CInt;
 
         #[namespace = "google::protobuf::io"]
         type CodedOutputStream;
+        unsafe fn NewCodedOutputStream(ptr: *mut ZeroCopyOutputStream) -> *mut CodedOutputStream;
         unsafe fn DeleteCodedOutputStream(stream: *mut CodedOutputStream);
+        fn CodedOutputStreamWritePackedVarint32(
+            output: Pin<&mut CodedOutputStream>,
+            values: &[u32],
+        );
+        fn CodedOutputStreamWritePackedVarint64(
+            output: Pin<&mut CodedOutputStream>,
+            values: &[u64],
+        );
+        fn CodedOutputStreamWritePackedInt32(output: Pin<&mut CodedOutputStream>, values: &[i32]);
+        fn CodedOutputStreamWritePackedInt64(output: Pin<&mut CodedOutputStream>, values: &[i64]);
+        fn CodedOutputStreamWritePackedSInt32(output: Pin<&mut CodedOutputStream>, values: &[i32]);
+        fn CodedOutputStreamWritePackedSInt64(output: Pin<&mut CodedOutputStream>, values: &[i64]);
+        fn HadError(self: Pin<&mut CodedOutputStream>) -> bool;
+        fn Trim(self: Pin<&mut CodedOutputStream>);
+        fn Skip(self: Pin<&mut CodedOutputStream>, count: CInt) -> bool;
+        unsafe fn WriteRaw(self: Pin<&mut CodedOutputStream>, buffer: *const CVoid, size: CInt);
+        fn WriteLittleEndian32(self: Pin<&mut CodedOutputStream>, value: u32);
+        fn WriteLittleEndian64(self: Pin<&mut CodedOutputStream>, value: u64);
+        fn WriteVarint32(self: Pin<&mut CodedOutputStream>, value: u32);
+        fn WriteVarint64(self: Pin<&mut CodedOutputStream>, value: u64);
+        fn WriteVarint32SignExtended(self: Pin<&mut CodedOutputStream>, value: i32);
+        fn WriteTag(self: Pin<&mut CodedOutputStream>, value: u32);
+        fn WriteCord(self: Pin<&mut CodedOutputStream>, cord: &Cord);
+        fn ByteCount(self: &CodedOutputStream) -> CInt;
+        fn SetSerializationDeterministic(self: Pin<&mut CodedOutputStream>, value: bool);
+        fn IsSerializationDeterministic(self: &CodedOutputStream) -> bool;
     }
 
     impl UniquePtr<ZeroCopyOutputStream> {}
@@ -298,6 +631,19 @@ mod zero_copy_input_stream {
     }
 }
 
+/// Releases ownership of `stream` to C++, which must delete it.
+pub(crate) fn into_ffi_input_stream(
+    mut stream: Pin<Box<dyn ZeroCopyInputStream + '_>>,
+) -> *mut ffi::ZeroCopyInputStream {
+    // Every implementor of `ZeroCopyInputStream` is a zero-sized handle to a
+    // C++ stream allocated with `new`, whose `Drop` implementation only
+    // deletes it. Forgetting the handle thus hands the stream, which C++ may
+    // delete through its virtual destructor, to the caller.
+    let ptr = unsafe { stream.as_mut().upcast_mut_ptr() };
+    mem::forget(stream);
+    ptr
+}
+
 /// Converts an [`Read`] implementor to a [`ZeroCopyInputStream`].
 pub struct ReaderStream<'a> {
     _opaque: PhantomPinned,
@@ -312,8 +658,28 @@ impl<'a> Drop for ReaderStream<'a> {
 
 impl<'a> ReaderStream<'a> {
     /// Creates a reader stream from the specified [`Read`] implementor.
+    ///
+    /// The stream reads from the reader in blocks of a default size, currently
+    /// 8 KiB.
     pub fn new(reader: &'a mut dyn Read) -> Pin<Box<ReaderStream<'a>>> {
-        let stream = ffi::NewReaderStream(Box::new(ReadAdaptor(reader)));
+        // A negative block size selects the default block size.
+        let stream = ffi::NewReaderStream(Box::new(ReadAdaptor(reader)), CInt(-1));
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Creates a reader stream from the specified [`Read`] implementor that
+    /// reads in blocks of `block_size` bytes.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block_size` is zero or is not representable as a C int.
+    pub fn with_block_size(
+        reader: &'a mut dyn Read,
+        block_size: usize,
+    ) -> Pin<Box<ReaderStream<'a>>> {
+        assert!(block_size > 0, "block size must be nonzero");
+        let block_size = CInt::expect_from(block_size);
+        let stream = ffi::NewReaderStream(Box::new(ReadAdaptor(reader)), block_size);
         unsafe { Self::from_ffi_owned(stream) }
     }
 
@@ -332,6 +698,233 @@ impl<'a> zero_copy_input_stream::Sealed for ReaderStream<'a> {
     }
 }
 
+/// Converts a [`BufRead`] implementor to a [`ZeroCopyInputStream`].
+///
+/// Unlike [`ReaderStream`], which copies data from the reader into an internal
+/// buffer, this stream returns the reader's own buffer (as returned by
+/// [`BufRead::fill_buf`]) directly from [`next`]. Bytes that are returned by
+/// `next` and not subsequently backed up are consumed from the reader.
+///
+/// When the stream is dropped, the underlying reader is left positioned
+/// immediately after the last byte read from the stream.
+///
+/// [`next`]: ZeroCopyInputStream::next
+pub struct BufReadStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for BufReadStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteBufReadStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> BufReadStream<'a> {
+    /// Creates a stream from the specified [`BufRead`] implementor.
+    pub fn new(reader: &'a mut dyn BufRead) -> Pin<Box<BufReadStream<'a>>> {
+        Self::owned(reader)
+    }
+
+    /// Creates a stream that owns the specified [`BufRead`] implementor.
+    fn owned<R>(reader: R) -> Pin<Box<BufReadStream<'a>>>
+    where
+        R: BufRead + 'a,
+    {
+        let stream = ffi::NewBufReadStream(Box::new(BufReadAdaptor::new(Box::new(reader))));
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::BufReadStream);
+}
+
+impl<'a> ZeroCopyInputStream for BufReadStream<'a> {}
+
+impl<'a> zero_copy_input_stream::Sealed for BufReadStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`BufRead`] implementor that reads ahead of its consumer on a background
+/// thread.
+///
+/// Blocks of up to `block_size` bytes are read from the underlying reader on a
+/// dedicated thread and queued, up to `depth` blocks at a time, so that I/O
+/// overlaps with whatever is consuming the data. Convert a `ReadAhead` into a
+/// [`BufReadStream`] with [`into_stream`] to feed the blocks to the parser
+/// without further copying.
+///
+/// The blocks may also be read ahead from another [`ZeroCopyInputStream`],
+/// such as a [`FileInputStream`], with [`from_stream`], so that one thread
+/// waits on the stream while another parses the blocks already read.
+///
+/// Blocks are recycled once consumed, so steady-state reading performs no
+/// allocation.
+///
+/// # Examples
+///
+/// ```no_run
+/// use std::fs::File;
+/// use protobuf_native::io::{BufReadStream, ReadAhead};
+///
+/// let f = File::open("myfile")?;
+/// let mut reader = ReadAhead::new(f, 1 << 20, 4);
+/// let mut input = BufReadStream::new(&mut reader);
+/// // Parse from `input`...
+/// # Ok::<_, std::io::Error>(())
+/// ```
+///
+/// [`into_stream`]: ReadAhead::into_stream
+/// [`from_stream`]: ReadAhead::from_stream
+pub struct ReadAhead {
+    blocks: mpsc::Receiver<io::Result<Vec<u8>>>,
+    recycle: mpsc::Sender<Vec<u8>>,
+    current: Vec<u8>,
+    pos: usize,
+    done: bool,
+}
+
+impl ReadAhead {
+    /// Creates a `ReadAhead` that reads blocks of up to `block_size` bytes
+    /// from `reader`, keeping at most `depth` blocks queued.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block_size` or `depth` is zero.
+    pub fn new<R>(mut reader: R, block_size: usize, depth: usize) -> ReadAhead
+    where
+        R: Read + Send + 'static,
+    {
+        ReadAhead::spawn(block_size, depth, move |block| loop {
+            match reader.read(block) {
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+                res => break res,
+            }
+        })
+    }
+
+    /// Creates a `ReadAhead` that copies blocks of up to `block_size` bytes
+    /// out of `stream`, keeping at most `depth` blocks queued.
+    ///
+    /// A zero-copy stream does not distinguish the end of its data from an
+    /// error, so an error ends the `ReadAhead` as if the data had ended.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block_size` or `depth` is zero.
+    pub fn from_stream<S>(mut stream: Pin<Box<S>>, block_size: usize, depth: usize) -> ReadAhead
+    where
+        S: ZeroCopyInputStream + Send + ?Sized + 'static,
+    {
+        ReadAhead::spawn(block_size, depth, move |block| {
+            let mut n = 0;
+            while n < block.len() {
+                let buf = match stream.as_mut().next() {
+                    Ok(buf) => buf,
+                    Err(_) => break,
+                };
+                let m = buf.len().min(block.len() - n);
+                block[n..n + m].copy_from_slice(&buf[..m]);
+                let rest = buf.len() - m;
+                if rest > 0 {
+                    stream.as_mut().back_up(rest);
+                }
+                n += m;
+            }
+            Ok(n)
+        })
+    }
+
+    /// Converts the `ReadAhead` into a stream that returns each block
+    /// directly from [`next`](ZeroCopyInputStream::next).
+    pub fn into_stream(self) -> Pin<Box<BufReadStream<'static>>> {
+        BufReadStream::owned(self)
+    }
+
+    /// Spawns the thread that fills blocks with `fill`, which returns the
+    /// number of bytes it filled, or zero at the end of the data.
+    fn spawn<F>(block_size: usize, depth: usize, mut fill: F) -> ReadAhead
+    where
+        F: FnMut(&mut [u8]) -> io::Result<usize> + Send + 'static,
+    {
+        assert!(block_size > 0, "block size must be nonzero");
+        assert!(depth > 0, "read-ahead depth must be nonzero");
+        let (block_tx, block_rx) = mpsc::sync_channel(depth);
+        let (recycle_tx, recycle_rx) = mpsc::channel::<Vec<u8>>();
+        thread::spawn(move || loop {
+            let mut block = recycle_rx.try_recv().unwrap_or_default();
+            block.resize(block_size, 0);
+            let msg = match fill(&mut block) {
+                Ok(0) => break,
+                Ok(n) => {
+                    block.truncate(n);
+                    Ok(block)
+                }
+                Err(e) => Err(e),
+            };
+            let failed = msg.is_err();
+            // The consumer hanging up is not an error; it just means nobody
+            // wants the rest of the data.
+            if block_tx.send(msg).is_err() || failed {
+                break;
+            }
+        });
+        ReadAhead {
+            blocks: block_rx,
+            recycle: recycle_tx,
+            current: Vec::new(),
+            pos: 0,
+            done: false,
+        }
+    }
+}
+
+impl Read for ReadAhead {
+    fn read(&mut self, buf: &mut [u8]) -> Result<usize, io::Error> {
+        let n = {
+            let data = self.fill_buf()?;
+            let n = data.len().min(buf.len());
+            buf[..n].copy_from_slice(&data[..n]);
+            n
+        };
+        self.consume(n);
+        Ok(n)
+    }
+}
+
+impl BufRead for ReadAhead {
+    fn fill_buf(&mut self) -> Result<&[u8], io::Error> {
+        if self.pos == self.current.len() && !self.done {
+            let block = match self.blocks.recv() {
+                Ok(Ok(block)) => block,
+                Ok(Err(e)) => {
+                    self.done = true;
+                    return Err(e);
+                }
+                Err(mpsc::RecvError) => {
+                    self.done = true;
+                    Vec::new()
+                }
+            };
+            let old = mem::replace(&mut self.current, block);
+            self.pos = 0;
+            // The reader thread may already have exited, in which case the
+            // block is simply dropped.
+            let _ = self.recycle.send(old);
+        }
+        Ok(&self.current[self.pos..])
+    }
+
+    fn consume(&mut self, amt: usize) {
+        self.pos = (self.pos + amt).min(self.current.len());
+    }
+}
+
 /// A [`ZeroCopyInputStream`] specialized for reading from byte slices.
 ///
 /// Using this type is more efficient than using a [`ReaderStream`] when the
@@ -349,12 +942,26 @@ impl<'a> Drop for SliceInputStream<'a> {
 
 impl<'a> SliceInputStream<'a> {
     /// Creates a new `SliceInputStream` from the provided byte slice.
-    pub fn new(slice: &[u8]) -> Pin<Box<SliceInputStream<'a>>> {
+    pub fn new(slice: &'a [u8]) -> Pin<Box<SliceInputStream<'a>>> {
         let size = CInt::expect_from(slice.len());
         let stream = unsafe { ffi::NewArrayInputStream(slice.as_ptr(), size) };
         unsafe { Self::from_ffi_owned(stream) }
     }
 
+    /// Reinitializes the stream to read from `slice`, as if it had been newly
+    /// created with [`SliceInputStream::new`].
+    ///
+    /// This allows one stream object to be reused to read from many
+    /// independent buffers without allocating a new stream for each.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the length of `slice` is not representable as a C int.
+    pub fn reset(self: Pin<&mut Self>, slice: &'a [u8]) {
+        let size = CInt::expect_from(slice.len());
+        unsafe { ffi::ArrayInputStreamReset(self.as_ffi_mut(), slice.as_ptr(), size) }
+    }
+
     unsafe_ffi_conversions!(ffi::ArrayInputStream);
 }
 
@@ -370,28 +977,77 @@ impl<'a> zero_copy_input_stream::Sealed for SliceInputStream<'a> {
     }
 }
 
-/// An arbitrary stream that implements [`ZeroCopyInputStream`].
+/// A [`ZeroCopyInputStream`] that reads from a memory-mapped file.
 ///
-/// This is like `Box<dyn ZeroCopyInputStream>` but it avoids additional virtual
-/// method calls on the Rust side of the FFI boundary.
-pub struct DynZeroCopyInputStream<'a> {
+/// The entire file is mapped into memory and returned as a single buffer from
+/// the first call to [`next`], so no data is copied. The mapped contents are
+/// also available directly via [`contents`]; parsing from that slice with
+/// [`CodedInputStream::from_slice`] or [`MessageLite::parse_from_bytes`] allows
+/// the parser to take its fastest, flat-buffer path.
+///
+/// The behavior is undefined if the file is modified while it is mapped.
+///
+/// Memory-mapped streams are currently only supported on Unix, and files must
+/// be smaller than 2 GiB.
+///
+/// [`next`]: ZeroCopyInputStream::next
+/// [`contents`]: MmapInputStream::contents
+/// [`MessageLite::parse_from_bytes`]: crate::MessageLite::parse_from_bytes
+pub struct MmapInputStream {
     _opaque: PhantomPinned,
-    lifetime_: PhantomData<&'a ()>,
 }
 
-impl<'a> Drop for DynZeroCopyInputStream<'a> {
+impl Drop for MmapInputStream {
     fn drop(&mut self) {
-        unsafe { ffi::DeleteZeroCopyInputStream(self.as_ffi_mut_ptr_unpinned()) }
+        unsafe { ffi::DeleteMmapInputStream(self.as_ffi_mut_ptr_unpinned()) }
     }
 }
 
-impl<'a> DynZeroCopyInputStream<'a> {
-    unsafe_ffi_conversions!(ffi::ZeroCopyInputStream);
+impl MmapInputStream {
+    /// Maps the file at the specified path into memory.
+    pub fn open<P>(path: P) -> Result<Pin<Box<MmapInputStream>>, io::Error>
+    where
+        P: AsRef<Path>,
+    {
+        Self::from_file(&File::open(path)?)
+    }
+
+    /// Maps the specified file into memory.
+    ///
+    /// The mapping remains valid after `file` is closed.
+    pub fn from_file(file: &File) -> Result<Pin<Box<MmapInputStream>>, io::Error> {
+        #[cfg(unix)]
+        {
+            let size = usize::try_from(file.metadata()?.len()).map_err(|_| {
+                io::Error::new(io::ErrorKind::InvalidInput, "file too large to map")
+            })?;
+            let stream = ffi::NewMmapInputStream(CInt(file.as_raw_fd()), size);
+            if stream.is_null() {
+                return Err(io::Error::last_os_error());
+            }
+            Ok(unsafe { Self::from_ffi_owned(stream) })
+        }
+        #[cfg(not(unix))]
+        {
+            let _ = file;
+            Err(io::Error::new(
+                io::ErrorKind::Unsupported,
+                "memory-mapped streams are not supported on this platform",
+            ))
+        }
+    }
+
+    /// Returns the entire contents of the mapped file.
+    pub fn contents(&self) -> &[u8] {
+        self.as_ffi().Contents()
+    }
+
+    unsafe_ffi_conversions!(ffi::MmapInputStream);
 }
 
-impl ZeroCopyInputStream for DynZeroCopyInputStream<'_> {}
+impl ZeroCopyInputStream for MmapInputStream {}
 
-impl zero_copy_input_stream::Sealed for DynZeroCopyInputStream<'_> {
+impl zero_copy_input_stream::Sealed for MmapInputStream {
     fn upcast(&self) -> &ffi::ZeroCopyInputStream {
         unsafe { mem::transmute(self) }
     }
@@ -401,125 +1057,1257 @@ impl zero_copy_input_stream::Sealed for DynZeroCopyInputStream<'_> {
     }
 }
 
-/// Abstract interface similar to an output stream but designed to minimize
-/// copying.
-///
-/// # Examples
+/// Options for a [`FileInputStream`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct FileInputOptions {
+    /// The number of bytes to read from the file at once. Defaults to 64 KiB.
+    ///
+    /// With [`direct`](Self::direct), the block size is rounded up to a
+    /// multiple of 4 KiB.
+    pub block_size: usize,
+    /// Whether to advise the kernel that the file will be read sequentially,
+    /// with `posix_fadvise(POSIX_FADV_SEQUENTIAL)`, so that it reads ahead
+    /// more aggressively. Defaults to false.
+    pub sequential: bool,
+    /// Whether to bypass the page cache, with `O_DIRECT`, so that a single
+    /// pass over a large file does not evict other files from the cache.
+    /// Defaults to false.
+    ///
+    /// Not every file system supports `O_DIRECT`; on those that do not,
+    /// creating the stream fails. On macOS, `F_NOCACHE` is used instead.
+    /// Files already opened with `O_DIRECT` are always read as if this
+    /// option were set.
+    pub direct: bool,
+}
+
+impl Default for FileInputOptions {
+    fn default() -> FileInputOptions {
+        FileInputOptions {
+            block_size: 64 << 10,
+            sequential: false,
+            direct: false,
+        }
+    }
+}
+
+/// A [`ZeroCopyInputStream`] that reads from a file descriptor.
 ///
-/// Copy the contents of infile to outfile, using plain [`Read`] for infile
-/// but a `ZeroCopyOutputStream` for outfile:
+/// The stream reads blocks of the file directly into a buffer that it hands
+/// to the parser, with neither a [`Read`] implementation nor an extra copy in
+/// between, and can bypass the page cache; see [`FileInputOptions`]. The
+/// stream owns the file descriptor and closes it when dropped.
 ///
-/// ```ignore
-/// use std::fs::File;
-/// use std::io::{self, Read, Write};
-/// use protobuf_native::io::{WriterStream, ZeroCopyOutputStream};
+/// File streams are only supported on Unix.
 ///
-/// let mut infile = File::open("infile")?;
-/// let mut outfile = File::create("outfile")?;
-/// let mut output = WriterStream::new(&mut outfile);
+/// # Examples
 ///
-/// while let Ok(buf) = output.next() {
-///     // Reading into uninitialized memory requires the unstable `ReadBuf` API.
-///     // See: https://rust-lang.github.io/rfcs/2930-read-buf.html
-///     let buf = ReadBuf::uninit(buf);
-///     infile.read_buf(buf)?;
-///     output.back_up(buf.remaining());
-///     if buf.filled().is_empty() {
-///         break;
-///     }
-/// }
+/// ```no_run
+/// use protobuf_native::io::{FileInputOptions, FileInputStream};
 ///
-/// # Ok::<_, io::Error>(())
+/// let options = FileInputOptions {
+///     sequential: true,
+///     direct: true,
+///     ..Default::default()
+/// };
+/// let mut input = FileInputStream::open("records.bin", &options)?;
+/// // Parse from `input`...
+/// # Ok::<_, std::io::Error>(())
 /// ```
-pub trait ZeroCopyOutputStream: zero_copy_output_stream::Sealed {
-    /// Obtains a buffer into which data can be written.
-    ///
-    /// Any data written into this buffer will eventually (maybe instantly,
-    /// maybe later on) be written to the output.
-    ///
-    /// # Safety
-    ///
-    /// If this function returns `Ok`, you **must** initialize the returned byte
-    /// slice before you either call `next` again or drop the slice. You can
-    /// choose to initialize only a portion of the byte slice by calling
-    /// [`back_up`].
+#[cfg(unix)]
+pub struct FileInputStream {
+    _opaque: PhantomPinned,
+}
+
+#[cfg(unix)]
+impl Drop for FileInputStream {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteFdInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(unix)]
+impl FileInputStream {
+    /// Opens the file at the specified path for reading.
     ///
-    /// This is a very unusual invariant to maintain in Rust.
+    /// # Panics
     ///
-    /// [`back_up`]: ZeroCopyOutputStream::back_up
-    unsafe fn next(self: Pin<&mut Self>) -> Result<&mut [MaybeUninit<u8>], OperationFailedError> {
-        let mut data = MaybeUninit::uninit();
-        let mut size = MaybeUninit::uninit();
-        self.upcast_mut()
-            .Next(data.as_mut_ptr(), size.as_mut_ptr())
-            .as_result()?;
-        let data = data.assume_init() as *mut MaybeUninit<u8>;
-        let size = size.assume_init().to_usize()?;
-        Ok(slice::from_raw_parts_mut(data, size))
+    /// Panics if the block size is zero or is not representable as a C int.
+    pub fn open<P>(
+        path: P,
+        options: &FileInputOptions,
+    ) -> Result<Pin<Box<FileInputStream>>, io::Error>
+    where
+        P: AsRef<Path>,
+    {
+        Self::from_fd(File::open(path)?.into(), options)
     }
 
-    /// Backs up a number of bytes, so that the end of the last buffer returned
-    /// by [`next`] is not actually written.
+    /// Creates a stream that reads from the specified file descriptor,
+    /// starting at its current offset.
     ///
-    /// This is needed when you finish writing all the data you want to write,
-    /// but the last buffer was bigger than you needed. You don't want to write
-    /// a bunch of garbage after the end of your data, so you use `back_up` to
-    /// back up.
+    /// # Panics
     ///
-    /// [`next`]: ZeroCopyOutputStream::next
-    fn back_up(self: Pin<&mut Self>, count: usize) {
-        // See comment in `ZeroCopyInputStream::back_up` for why we tolerate
-        // panics here.
-        let count = CInt::try_from(count).expect("count did not fit in a C int");
-        self.upcast_mut().BackUp(count)
+    /// Panics if the block size is zero or is not representable as a C int.
+    pub fn from_fd(
+        fd: OwnedFd,
+        options: &FileInputOptions,
+    ) -> Result<Pin<Box<FileInputStream>>, io::Error> {
+        assert!(options.block_size > 0, "block size must be nonzero");
+        let block_size = CInt::expect_from(options.block_size);
+        let stream = ffi::NewFdInputStream(
+            CInt(fd.as_raw_fd()),
+            block_size,
+            options.sequential,
+            options.direct,
+        );
+        if stream.is_null() {
+            return Err(io::Error::last_os_error());
+        }
+        // The stream now owns the file descriptor.
+        let _ = fd.into_raw_fd();
+        Ok(unsafe { Self::from_ffi_owned(stream) })
     }
 
-    /// Returns the total number of bytes written since this object was created.
-    fn byte_count(&self) -> i64 {
-        self.upcast().ByteCount()
+    /// Returns the error that ended the stream, if a read failed.
+    ///
+    /// [`next`](ZeroCopyInputStream::next) reports the end of the file and
+    /// read errors alike.
+    pub fn error(&self) -> Option<io::Error> {
+        match self.as_ffi().GetErrno() {
+            CInt(0) => None,
+            CInt(errno) => Some(io::Error::from_raw_os_error(errno)),
+        }
     }
+
+    unsafe_ffi_conversions!(ffi::FdInputStream);
 }
 
-mod zero_copy_output_stream {
-    use std::pin::Pin;
+#[cfg(unix)]
+impl ZeroCopyInputStream for FileInputStream {}
 
-    use crate::io::ffi;
+#[cfg(unix)]
+impl zero_copy_input_stream::Sealed for FileInputStream {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
 
-    pub trait Sealed {
-        fn upcast(&self) -> &ffi::ZeroCopyOutputStream;
-        fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream>;
-        unsafe fn upcast_mut_ptr(self: Pin<&mut Self>) -> *mut ffi::ZeroCopyOutputStream {
-            self.upcast_mut().get_unchecked_mut() as *mut _
-        }
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
     }
 }
 
-/// Converts an [`Write`] implementor to a [`ZeroCopyOutputStream`].
-pub struct WriterStream<'a> {
+/// A [`ZeroCopyInputStream`] that reads from a chain of non-contiguous byte
+/// slices.
+///
+/// Each call to [`next`] returns (the remainder of) one segment of the chain
+/// directly, without copying. This is useful for parsing messages that arrive
+/// fragmented across several buffers, e.g., network receive buffers, without
+/// first coalescing them.
+///
+/// [`next`]: ZeroCopyInputStream::next
+pub struct ChainInputStream<'a> {
     _opaque: PhantomPinned,
-    _lifetime: PhantomData<&'a mut ()>,
+    _lifetime: PhantomData<&'a ()>,
 }
 
-impl<'a> WriterStream<'a> {
-    /// Creates a writer stream from the specified [`Write`] implementor.
-    pub fn new(writer: &'a mut dyn Write) -> Pin<Box<WriterStream<'a>>> {
-        let stream = ffi::NewWriterStream(Box::new(WriteAdaptor(writer)));
-        unsafe { Self::from_ffi_owned(stream) }
+impl<'a> Drop for ChainInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteChainInputStream(self.as_ffi_mut_ptr_unpinned()) }
     }
-
-    unsafe_ffi_conversions!(ffi::WriterStream);
 }
 
-impl<'a> Drop for WriterStream<'a> {
-    fn drop(&mut self) {
-        unsafe { ffi::DeleteWriterStream(self.as_ffi_mut_ptr_unpinned()) }
+impl<'a> ChainInputStream<'a> {
+    /// Creates a new `ChainInputStream` that reads the provided segments in
+    /// order.
+    pub fn new<S>(segments: &'a [S]) -> Pin<Box<ChainInputStream<'a>>>
+    where
+        S: AsRef<[u8]>,
+    {
+        let segments = segments.iter().map(|s| s.as_ref()).collect();
+        let stream = ffi::NewChainInputStream(Box::new(ChainReadAdaptor::new(segments)));
+        unsafe { Self::from_ffi_owned(stream) }
     }
+
+    unsafe_ffi_conversions!(ffi::ChainInputStream);
 }
 
-impl<'a> ZeroCopyOutputStream for WriterStream<'a> {}
+impl<'a> ZeroCopyInputStream for ChainInputStream<'a> {}
 
-impl<'a> zero_copy_output_stream::Sealed for WriterStream<'a> {
-    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+impl<'a> zero_copy_input_stream::Sealed for ChainInputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`ZeroCopyInputStream`] that reads from a [`bytes::Buf`].
+///
+/// Each call to [`next`] returns (the remainder of) the buffer's current
+/// [`chunk`] directly, without copying or flattening a non-contiguous buffer.
+/// The buffer is advanced past the bytes consumed by the stream as the stream
+/// moves on to the next chunk and when the stream is dropped, so that
+/// afterwards the buffer is positioned immediately after the last byte read.
+///
+/// This type is only available if the `bytes` feature is enabled.
+///
+/// [`next`]: ZeroCopyInputStream::next
+/// [`chunk`]: bytes::Buf::chunk
+#[cfg(feature = "bytes")]
+pub struct BufInputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+#[cfg(feature = "bytes")]
+impl<'a> Drop for BufInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteChunkInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(feature = "bytes")]
+impl<'a> BufInputStream<'a> {
+    /// Creates a new `BufInputStream` that reads from `buf`.
+    pub fn new<B>(buf: &'a mut B) -> Pin<Box<BufInputStream<'a>>>
+    where
+        B: bytes::Buf + ?Sized,
+    {
+        let stream = ffi::NewChunkInputStream(Box::new(ChunkReadAdaptor::new(Box::new(buf))));
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::ChunkInputStream);
+}
+
+#[cfg(feature = "bytes")]
+impl<'a> ZeroCopyInputStream for BufInputStream<'a> {}
+
+#[cfg(feature = "bytes")]
+impl<'a> zero_copy_input_stream::Sealed for BufInputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`ZeroCopyInputStream`] that reads at most a fixed number of bytes from
+/// another `ZeroCopyInputStream`.
+///
+/// Buffers from the underlying stream are passed through without copying,
+/// truncated as necessary to respect the limit. When the `LimitingInputStream`
+/// is dropped, any bytes it obtained from the underlying stream beyond the
+/// limit are backed up, so that the underlying stream is positioned
+/// immediately after the limited region (or after the last byte read, if the
+/// region was not read in full).
+pub struct LimitingInputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for LimitingInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteLimitingInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> LimitingInputStream<'a> {
+    /// Creates a `LimitingInputStream` that reads at most `limit` bytes from
+    /// `input`.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `limit` is not representable as an `i64`.
+    pub fn new(
+        input: Pin<&'a mut dyn ZeroCopyInputStream>,
+        limit: usize,
+    ) -> Pin<Box<LimitingInputStream<'a>>> {
+        let limit = i64::try_from(limit).expect("limit not representable as i64");
+        let stream = unsafe { ffi::NewLimitingInputStream(input.upcast_mut_ptr(), limit) };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::LimitingInputStream);
+}
+
+impl<'a> ZeroCopyInputStream for LimitingInputStream<'a> {}
+
+impl<'a> zero_copy_input_stream::Sealed for LimitingInputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// An arbitrary stream that implements [`ZeroCopyInputStream`].
+///
+/// This is like `Box<dyn ZeroCopyInputStream>` but it avoids additional virtual
+/// method calls on the Rust side of the FFI boundary.
+pub struct DynZeroCopyInputStream<'a> {
+    _opaque: PhantomPinned,
+    lifetime_: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for DynZeroCopyInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteZeroCopyInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> DynZeroCopyInputStream<'a> {
+    unsafe_ffi_conversions!(ffi::ZeroCopyInputStream);
+}
+
+impl ZeroCopyInputStream for DynZeroCopyInputStream<'_> {}
+
+impl zero_copy_input_stream::Sealed for DynZeroCopyInputStream<'_> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// Abstract interface similar to an output stream but designed to minimize
+/// copying.
+///
+/// # Examples
+///
+/// Copy the contents of infile to outfile, using plain [`Read`] for infile
+/// but a `ZeroCopyOutputStream` for outfile:
+///
+/// ```ignore
+/// use std::fs::File;
+/// use std::io::{self, Read, Write};
+/// use protobuf_native::io::{WriterStream, ZeroCopyOutputStream};
+///
+/// let mut infile = File::open("infile")?;
+/// let mut outfile = File::create("outfile")?;
+/// let mut output = WriterStream::new(&mut outfile);
+///
+/// while let Ok(buf) = output.next() {
+///     // Reading into uninitialized memory requires the unstable `ReadBuf` API.
+///     // See: https://rust-lang.github.io/rfcs/2930-read-buf.html
+///     let buf = ReadBuf::uninit(buf);
+///     infile.read_buf(buf)?;
+///     output.back_up(buf.remaining());
+///     if buf.filled().is_empty() {
+///         break;
+///     }
+/// }
+///
+/// # Ok::<_, io::Error>(())
+/// ```
+pub trait ZeroCopyOutputStream: zero_copy_output_stream::Sealed {
+    /// Obtains a buffer into which data can be written.
+    ///
+    /// Any data written into this buffer will eventually (maybe instantly,
+    /// maybe later on) be written to the output.
+    ///
+    /// # Safety
+    ///
+    /// If this function returns `Ok`, you **must** initialize the returned byte
+    /// slice before you either call `next` again or drop the slice. You can
+    /// choose to initialize only a portion of the byte slice by calling
+    /// [`back_up`].
+    ///
+    /// This is a very unusual invariant to maintain in Rust.
+    ///
+    /// [`back_up`]: ZeroCopyOutputStream::back_up
+    unsafe fn next(self: Pin<&mut Self>) -> Result<&mut [MaybeUninit<u8>], OperationFailedError> {
+        let mut data = MaybeUninit::uninit();
+        let mut size = MaybeUninit::uninit();
+        self.upcast_mut()
+            .Next(data.as_mut_ptr(), size.as_mut_ptr())
+            .as_result()?;
+        let data = data.assume_init() as *mut MaybeUninit<u8>;
+        let size = size.assume_init().to_usize()?;
+        Ok(slice::from_raw_parts_mut(data, size))
+    }
+
+    /// Backs up a number of bytes, so that the end of the last buffer returned
+    /// by [`next`] is not actually written.
+    ///
+    /// This is needed when you finish writing all the data you want to write,
+    /// but the last buffer was bigger than you needed. You don't want to write
+    /// a bunch of garbage after the end of your data, so you use `back_up` to
+    /// back up.
+    ///
+    /// [`next`]: ZeroCopyOutputStream::next
+    fn back_up(self: Pin<&mut Self>, count: usize) {
+        // See comment in `ZeroCopyInputStream::back_up` for why we tolerate
+        // panics here.
+        let count = CInt::try_from(count).expect("count did not fit in a C int");
+        self.upcast_mut().BackUp(count)
+    }
+
+    /// Returns the total number of bytes written since this object was created.
+    fn byte_count(&self) -> i64 {
+        self.upcast().ByteCount()
+    }
+}
+
+mod zero_copy_output_stream {
+    use std::pin::Pin;
+
+    use crate::io::ffi;
+
+    pub trait Sealed {
+        fn upcast(&self) -> &ffi::ZeroCopyOutputStream;
+        fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream>;
+        unsafe fn upcast_mut_ptr(self: Pin<&mut Self>) -> *mut ffi::ZeroCopyOutputStream {
+            self.upcast_mut().get_unchecked_mut() as *mut _
+        }
+    }
+}
+
+/// Converts an [`Write`] implementor to a [`ZeroCopyOutputStream`].
+pub struct WriterStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a mut ()>,
+}
+
+impl<'a> WriterStream<'a> {
+    /// Creates a writer stream from the specified [`Write`] implementor.
+    ///
+    /// The stream writes to the writer in blocks of a default size, currently
+    /// 8 KiB.
+    pub fn new(writer: &'a mut dyn Write) -> Pin<Box<WriterStream<'a>>> {
+        // A negative block size selects the default block size.
+        let stream = ffi::NewWriterStream(Box::new(WriteAdaptor(writer)), CInt(-1));
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Creates a writer stream from the specified [`Write`] implementor that
+    /// writes in blocks of `block_size` bytes.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block_size` is zero or is not representable as a C int.
+    pub fn with_block_size(
+        writer: &'a mut dyn Write,
+        block_size: usize,
+    ) -> Pin<Box<WriterStream<'a>>> {
+        assert!(block_size > 0, "block size must be nonzero");
+        let block_size = CInt::expect_from(block_size);
+        let stream = ffi::NewWriterStream(Box::new(WriteAdaptor(writer)), block_size);
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::WriterStream);
+}
+
+impl<'a> Drop for WriterStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteWriterStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> ZeroCopyOutputStream for WriterStream<'a> {}
+
+impl<'a> zero_copy_output_stream::Sealed for WriterStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// Options for a [`FileOutputStream`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct FileOutputOptions {
+    /// The number of bytes to buffer before writing them to the file.
+    /// Defaults to 64 KiB.
+    ///
+    /// With [`direct`](Self::direct), the block size is rounded up to a
+    /// multiple of 4 KiB.
+    pub block_size: usize,
+    /// Whether to bypass the page cache, with `O_DIRECT`. Defaults to false.
+    ///
+    /// Whole blocks are written with `O_DIRECT`. The final partial block, if
+    /// any, is written after clearing `O_DIRECT` from the file descriptor
+    /// when the stream is closed. See [`FileInputOptions::direct`].
+    pub direct: bool,
+}
+
+impl Default for FileOutputOptions {
+    fn default() -> FileOutputOptions {
+        FileOutputOptions {
+            block_size: 64 << 10,
+            direct: false,
+        }
+    }
+}
+
+/// A [`ZeroCopyOutputStream`] that writes to a file descriptor.
+///
+/// The stream hands the serializer a buffer that it writes to the file
+/// descriptor directly, with neither a [`Write`] implementation nor an extra
+/// copy in between, and can bypass the page cache; see
+/// [`FileOutputOptions`]. The stream owns the file descriptor and closes it
+/// when dropped, ignoring any error; use [`close`] to observe errors.
+///
+/// File streams are only supported on Unix.
+///
+/// [`close`]: FileOutputStream::close
+#[cfg(unix)]
+pub struct FileOutputStream {
+    _opaque: PhantomPinned,
+}
+
+#[cfg(unix)]
+impl Drop for FileOutputStream {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteFdOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(unix)]
+impl FileOutputStream {
+    /// Creates or truncates the file at the specified path for writing.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the block size is zero or is not representable as a C int.
+    pub fn create<P>(
+        path: P,
+        options: &FileOutputOptions,
+    ) -> Result<Pin<Box<FileOutputStream>>, io::Error>
+    where
+        P: AsRef<Path>,
+    {
+        Self::from_fd(File::create(path)?.into(), options)
+    }
+
+    /// Creates a stream that writes to the specified file descriptor,
+    /// starting at its current offset.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the block size is zero or is not representable as a C int.
+    pub fn from_fd(
+        fd: OwnedFd,
+        options: &FileOutputOptions,
+    ) -> Result<Pin<Box<FileOutputStream>>, io::Error> {
+        assert!(options.block_size > 0, "block size must be nonzero");
+        let block_size = CInt::expect_from(options.block_size);
+        let stream = ffi::NewFdOutputStream(CInt(fd.as_raw_fd()), block_size, options.direct);
+        if stream.is_null() {
+            return Err(io::Error::last_os_error());
+        }
+        // The stream now owns the file descriptor.
+        let _ = fd.into_raw_fd();
+        Ok(unsafe { Self::from_ffi_owned(stream) })
+    }
+
+    /// Writes the buffered data to the file.
+    ///
+    /// With [`FileOutputOptions::direct`], a final partial block remains
+    /// buffered until it is completed or the stream is closed.
+    pub fn flush(mut self: Pin<&mut Self>) -> Result<(), io::Error> {
+        let ok = self.as_mut().as_ffi_mut().Flush();
+        self.result(ok)
+    }
+
+    /// Writes the buffered data to the file and closes the file descriptor.
+    ///
+    /// No further data may be written after calling this method.
+    pub fn close(mut self: Pin<&mut Self>) -> Result<(), io::Error> {
+        let ok = self.as_mut().as_ffi_mut().Close();
+        self.result(ok)
+    }
+
+    fn result(&self, ok: bool) -> Result<(), io::Error> {
+        match (ok, self.as_ffi().GetErrno()) {
+            (true, _) => Ok(()),
+            (false, CInt(0)) => Err(io::Error::new(
+                io::ErrorKind::Other,
+                "file output stream is closed",
+            )),
+            (false, CInt(errno)) => Err(io::Error::from_raw_os_error(errno)),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::FdOutputStream);
+}
+
+#[cfg(unix)]
+impl ZeroCopyOutputStream for FileOutputStream {}
+
+#[cfg(unix)]
+impl zero_copy_output_stream::Sealed for FileOutputStream {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`Write`] implementor that writes to its underlying writer on a
+/// background thread.
+///
+/// Written data is accumulated into blocks of `block_size` bytes, and each full
+/// block is handed to a dedicated thread to be written without waiting for the
+/// write to complete. At most `depth` blocks may be queued before writes to
+/// the `WriteBehind` block. Wrap a `WriteBehind` in a [`WriterStream`] to
+/// serialize messages while earlier output is still being written.
+///
+/// Errors from the underlying writer are reported by the next call to
+/// [`flush`] or [`into_inner`]. Dropping a `WriteBehind` waits for all queued
+/// data to be written but ignores any errors.
+///
+/// [`flush`]: Write::flush
+/// [`into_inner`]: WriteBehind::into_inner
+pub struct WriteBehind<W> {
+    requests: Option<mpsc::SyncSender<WriteBehindRequest>>,
+    recycle: mpsc::Receiver<Vec<u8>>,
+    thread: Option<thread::JoinHandle<io::Result<W>>>,
+    block: Vec<u8>,
+    block_size: usize,
+}
+
+enum WriteBehindRequest {
+    Write(Vec<u8>),
+    Flush(mpsc::SyncSender<io::Result<()>>),
+}
+
+impl<W> WriteBehind<W>
+where
+    W: Write + Send + 'static,
+{
+    /// Creates a `WriteBehind` that writes blocks of `block_size` bytes to
+    /// `writer`, keeping at most `depth` blocks queued.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block_size` or `depth` is zero.
+    pub fn new(mut writer: W, block_size: usize, depth: usize) -> WriteBehind<W> {
+        assert!(block_size > 0, "block size must be nonzero");
+        assert!(depth > 0, "write-behind depth must be nonzero");
+        let (request_tx, request_rx) = mpsc::sync_channel(depth);
+        let (recycle_tx, recycle_rx) = mpsc::channel();
+        let thread = thread::spawn(move || {
+            // After a failure, keep draining requests so that the writing side
+            // never blocks, and report the error to every flush.
+            let mut error = None;
+            for request in request_rx {
+                match request {
+                    WriteBehindRequest::Write(mut block) => {
+                        if error.is_none() {
+                            if let Err(e) = writer.write_all(&block) {
+                                error = Some(e);
+                            }
+                        }
+                        block.clear();
+                        let _ = recycle_tx.send(block);
+                    }
+                    WriteBehindRequest::Flush(reply) => {
+                        let res = match &error {
+                            Some(e) => Err(io::Error::new(e.kind(), e.to_string())),
+                            None => writer.flush(),
+                        };
+                        let _ = reply.send(res);
+                    }
+                }
+            }
+            match error {
+                Some(e) => Err(e),
+                None => writer.flush().map(|()| writer),
+            }
+        });
+        WriteBehind {
+            requests: Some(request_tx),
+            recycle: recycle_rx,
+            thread: Some(thread),
+            block: Vec::with_capacity(block_size),
+            block_size,
+        }
+    }
+
+    /// Writes all queued data, waits for the background thread to exit, and
+    /// returns the underlying writer.
+    pub fn into_inner(mut self) -> Result<W, io::Error> {
+        self.finish()
+    }
+
+    fn send_block(&mut self) -> Result<(), io::Error> {
+        if self.block.is_empty() {
+            return Ok(());
+        }
+        let next = self
+            .recycle
+            .try_recv()
+            .unwrap_or_else(|_| Vec::with_capacity(self.block_size));
+        let block = mem::replace(&mut self.block, next);
+        self.send(WriteBehindRequest::Write(block))
+    }
+
+    fn send(&mut self, request: WriteBehindRequest) -> Result<(), io::Error> {
+        let sent = match &self.requests {
+            Some(requests) => requests.send(request).is_ok(),
+            None => false,
+        };
+        match sent {
+            true => Ok(()),
+            false => Err(io::Error::new(
+                io::ErrorKind::BrokenPipe,
+                "write-behind thread exited",
+            )),
+        }
+    }
+
+    fn finish(&mut self) -> Result<W, io::Error> {
+        let res = self.send_block();
+        self.requests = None;
+        let thread = self.thread.take().expect("write-behind already finished");
+        let writer = match thread.join() {
+            Ok(writer) => writer,
+            Err(panic) => std::panic::resume_unwind(panic),
+        };
+        res.and(writer)
+    }
+}
+
+impl<W> Write for WriteBehind<W>
+where
+    W: Write + Send + 'static,
+{
+    fn write(&mut self, buf: &[u8]) -> Result<usize, io::Error> {
+        let n = buf.len().min(self.block_size - self.block.len());
+        self.block.extend_from_slice(&buf[..n]);
+        if self.block.len() == self.block_size {
+            self.send_block()?;
+        }
+        Ok(n)
+    }
+
+    fn flush(&mut self) -> Result<(), io::Error> {
+        self.send_block()?;
+        let (reply_tx, reply_rx) = mpsc::sync_channel(1);
+        self.send(WriteBehindRequest::Flush(reply_tx))?;
+        match reply_rx.recv() {
+            Ok(res) => res,
+            Err(mpsc::RecvError) => Err(io::Error::new(
+                io::ErrorKind::BrokenPipe,
+                "write-behind thread exited",
+            )),
+        }
+    }
+}
+
+impl<W> Drop for WriteBehind<W> {
+    fn drop(&mut self) {
+        if let Some(requests) = self.requests.take() {
+            if !self.block.is_empty() {
+                let block = mem::take(&mut self.block);
+                let _ = requests.send(WriteBehindRequest::Write(block));
+            }
+        }
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+/// A [`ZeroCopyOutputStream`] specialized for writing to byte slices.
+///
+/// Using this type is more efficient than using a [`WriterStream`] when the
+/// underlying writer is a type that exposes a simple mutable byte slice.
+pub struct SliceOutputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> SliceOutputStream<'a> {
+    /// Creates a new `SliceOutputStream` from the provided byte slice.
+    pub fn new(slice: &'a mut [u8]) -> Pin<Box<SliceOutputStream<'a>>> {
+        let size = CInt::expect_from(slice.len());
+        let stream = unsafe { ffi::NewArrayOutputStream(slice.as_mut_ptr(), size) };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::ArrayOutputStream);
+}
+
+impl<'a> Drop for SliceOutputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteArrayOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> ZeroCopyOutputStream for SliceOutputStream<'a> {}
+
+impl<'a> zero_copy_output_stream::Sealed for SliceOutputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// How a [`VecOutputStream`] grows its vector when it runs out of capacity.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum VecGrowth {
+    /// Double the capacity of the vector, with a minimum of 16 bytes.
+    Double,
+    /// Grow the capacity of the vector by a fixed number of bytes.
+    Increment(usize),
+}
+
+/// Options for a [`VecOutputStream`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct VecOutputOptions {
+    /// The expected number of bytes to be written, e.g. as computed by
+    /// [`MessageLite::byte_size`].
+    ///
+    /// If set, the vector's capacity is grown to fit this many bytes when the
+    /// stream is created, if it is not already large enough. When the hint is
+    /// accurate, serializing into the stream performs at most one allocation,
+    /// or none if the vector already has sufficient capacity.
+    pub size_hint: Option<usize>,
+    /// How to grow the vector when it runs out of capacity. Defaults to
+    /// [`VecGrowth::Double`].
+    pub growth: VecGrowth,
+    /// The maximum number of bytes by which to grow the vector at once.
+    /// Defaults to no maximum.
+    pub max_growth: Option<usize>,
+}
+
+impl Default for VecOutputOptions {
+    fn default() -> VecOutputOptions {
+        VecOutputOptions {
+            size_hint: None,
+            growth: VecGrowth::Double,
+            max_growth: None,
+        }
+    }
+}
+
+/// A [`ZeroCopyOutputStream`] specialized for writing to byte vectors.
+///
+/// Using this type is more efficient than using a [`WriterStream`] when the
+/// underlying writer is a byte vector.
+///
+/// The stream borrows the vector mutably for as long as it lives, so the
+/// vector cannot be read or dropped while the stream can still write to it:
+///
+/// ```compile_fail
+/// use protobuf_native::io::VecOutputStream;
+///
+/// let mut vec = vec![];
+/// let stream = VecOutputStream::new(&mut vec);
+/// drop(vec);
+/// drop(stream);
+/// ```
+pub struct VecOutputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> VecOutputStream<'a> {
+    /// Creates a new `VecOutputStream` from the provided byte vector.
+    pub fn new(vec: &'a mut Vec<u8>) -> Pin<Box<VecOutputStream<'a>>> {
+        let stream = ffi::NewVecOutputStream(vec);
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Creates a new `VecOutputStream` from the provided byte vector, reserving
+    /// capacity for `size_hint` bytes up front.
+    ///
+    /// See [`VecOutputOptions::size_hint`].
+    pub fn with_size_hint(vec: &'a mut Vec<u8>, size_hint: usize) -> Pin<Box<VecOutputStream<'a>>> {
+        VecOutputStream::with_options(
+            vec,
+            &VecOutputOptions {
+                size_hint: Some(size_hint),
+                ..Default::default()
+            },
+        )
+    }
+
+    /// Creates a new `VecOutputStream` from the provided byte vector with the
+    /// specified options.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `options.growth` is `VecGrowth::Increment(0)` or if
+    /// `options.max_growth` is `Some(0)`.
+    pub fn with_options(
+        vec: &'a mut Vec<u8>,
+        options: &VecOutputOptions,
+    ) -> Pin<Box<VecOutputStream<'a>>> {
+        let growth_increment = match options.growth {
+            VecGrowth::Double => 0,
+            VecGrowth::Increment(0) => panic!("VecOutputStream growth increment must be nonzero"),
+            VecGrowth::Increment(n) => n,
+        };
+        let max_growth = match options.max_growth {
+            None => 0,
+            Some(0) => panic!("VecOutputStream maximum growth must be nonzero"),
+            Some(n) => n,
+        };
+        let stream = ffi::NewVecOutputStreamWithOptions(
+            vec,
+            options.size_hint.unwrap_or(0),
+            growth_increment,
+            max_growth,
+        );
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::VecOutputStream);
+}
+
+impl<'a> Drop for VecOutputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteVecOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> ZeroCopyOutputStream for VecOutputStream<'a> {}
+
+impl<'a> zero_copy_output_stream::Sealed for VecOutputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`ZeroCopyOutputStream`] that writes to a chain of fixed-size byte
+/// vectors.
+///
+/// Unlike [`VecOutputStream`], which must reallocate and copy its output each
+/// time it grows, this stream never moves data that has already been written.
+/// When the last segment in the chain is full, a new segment with a capacity of
+/// `segment_size` bytes is appended to the chain. The resulting segments are
+/// suitable for vectored (scatter/gather) writes.
+///
+/// # Examples
+///
+/// ```
+/// use std::io::IoSlice;
+/// use protobuf_native::io::ChainOutputStream;
+///
+/// let mut segments = vec![];
+/// let mut output = ChainOutputStream::new(&mut segments, 64 << 10);
+/// // Serialize messages into `output`...
+/// drop(output);
+/// let slices: Vec<_> = segments.iter().map(|s| IoSlice::new(s)).collect();
+/// // Pass `slices` to `Write::write_vectored`...
+/// ```
+pub struct ChainOutputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a mut ()>,
+}
+
+impl<'a> ChainOutputStream<'a> {
+    /// Creates a new `ChainOutputStream` that appends to the provided chain of
+    /// segments.
+    ///
+    /// If the last segment in the chain has spare capacity, that capacity is
+    /// filled before any new segments are allocated.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `segment_size` is zero.
+    pub fn new(
+        segments: &'a mut Vec<Vec<u8>>,
+        segment_size: usize,
+    ) -> Pin<Box<ChainOutputStream<'a>>> {
+        let adaptor = ChainWriteAdaptor::new(segments, segment_size);
+        let stream = ffi::NewChainOutputStream(Box::new(adaptor));
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::ChainOutputStream);
+}
+
+impl<'a> Drop for ChainOutputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteChainOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> ZeroCopyOutputStream for ChainOutputStream<'a> {}
+
+impl<'a> zero_copy_output_stream::Sealed for ChainOutputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// The format of a compressed stream read by a [`GzipInputStream`].
+///
+/// This type is only available if the `zlib` feature is enabled.
+#[cfg(feature = "zlib")]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum GzipInputFormat {
+    /// Automatically detect a gzip header or a zlib stream.
+    Auto,
+    /// A gzip stream, which carries extra header data for file attributes.
+    Gzip,
+    /// A zlib stream.
+    Zlib,
+}
+
+#[cfg(feature = "zlib")]
+impl GzipInputFormat {
+    fn to_ffi(self) -> CInt {
+        match self {
+            GzipInputFormat::Auto => CInt(0),
+            GzipInputFormat::Gzip => CInt(1),
+            GzipInputFormat::Zlib => CInt(2),
+        }
+    }
+}
+
+/// A [`ZeroCopyInputStream`] that decompresses gzip or zlib data read from
+/// another `ZeroCopyInputStream`.
+///
+/// Decompression happens incrementally as the stream is read, so compressed
+/// input can be parsed without first being decompressed into a separate
+/// buffer.
+///
+/// This type is only available if the `zlib` feature is enabled.
+#[cfg(feature = "zlib")]
+pub struct GzipInputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+#[cfg(feature = "zlib")]
+impl<'a> Drop for GzipInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteGzipInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(feature = "zlib")]
+impl<'a> GzipInputStream<'a> {
+    /// Creates a `GzipInputStream` that decompresses data of the given format
+    /// from `input`.
+    pub fn new(
+        input: Pin<&'a mut dyn ZeroCopyInputStream>,
+        format: GzipInputFormat,
+    ) -> Pin<Box<GzipInputStream<'a>>> {
+        Self::new_inner(input, format, CInt(-1))
+    }
+
+    /// Creates a `GzipInputStream` that decompresses into an internal buffer
+    /// of `buffer_size` bytes, rather than the default of 64KiB.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `buffer_size` is zero or is not representable as a C int.
+    pub fn with_buffer_size(
+        input: Pin<&'a mut dyn ZeroCopyInputStream>,
+        format: GzipInputFormat,
+        buffer_size: usize,
+    ) -> Pin<Box<GzipInputStream<'a>>> {
+        assert!(buffer_size > 0, "buffer size must be nonzero");
+        Self::new_inner(input, format, CInt::expect_from(buffer_size))
+    }
+
+    fn new_inner(
+        input: Pin<&'a mut dyn ZeroCopyInputStream>,
+        format: GzipInputFormat,
+        buffer_size: CInt,
+    ) -> Pin<Box<GzipInputStream<'a>>> {
+        let stream = unsafe {
+            ffi::NewGzipInputStream(input.upcast_mut_ptr(), format.to_ffi(), buffer_size)
+        };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Returns the last error message reported by zlib, if any.
+    pub fn zlib_error_message(&self) -> Option<String> {
+        let message = ffi::GzipInputStreamZlibErrorMessage(self.as_ffi());
+        (!message.is_empty()).then_some(message)
+    }
+
+    unsafe_ffi_conversions!(ffi::GzipInputStream);
+}
+
+#[cfg(feature = "zlib")]
+impl<'a> ZeroCopyInputStream for GzipInputStream<'a> {}
+
+#[cfg(feature = "zlib")]
+impl<'a> zero_copy_input_stream::Sealed for GzipInputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`ZeroCopyInputStream`] that computes the CRC32C of the data it reads
+/// from another `ZeroCopyInputStream`.
+///
+/// Buffers from the underlying stream are passed through without copying.
+/// Every byte returned by [`next`](ZeroCopyInputStream::next) counts towards
+/// the checksum unless it is backed up, and so does every byte skipped, which
+/// is read rather than skipped in the underlying stream. Since a
+/// [`CodedInputStream`] backs up any bytes it buffered but did not consume when
+/// it is dropped, [`crc32c`](Crc32cInputStream::crc32c) covers exactly the
+/// parsed bytes once any coded stream over this stream has been dropped.
+pub struct Crc32cInputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for Crc32cInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCrc32cInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> Crc32cInputStream<'a> {
+    /// Creates a `Crc32cInputStream` that reads from `input`.
+    pub fn new(input: Pin<&'a mut dyn ZeroCopyInputStream>) -> Pin<Box<Crc32cInputStream<'a>>> {
+        let stream = unsafe { ffi::NewCrc32cInputStream(input.upcast_mut_ptr()) };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Returns the CRC32C of the bytes read so far.
+    pub fn crc32c(&self) -> u32 {
+        self.as_ffi().Crc32c()
+    }
+
+    unsafe_ffi_conversions!(ffi::Crc32cInputStream);
+}
+
+impl<'a> ZeroCopyInputStream for Crc32cInputStream<'a> {}
+
+impl<'a> zero_copy_input_stream::Sealed for Crc32cInputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// The format of a compressed stream written by a [`GzipOutputStream`].
+///
+/// This type is only available if the `zlib` feature is enabled.
+#[cfg(feature = "zlib")]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum GzipOutputFormat {
+    /// A gzip stream, which carries extra header data for file attributes.
+    Gzip,
+    /// A zlib stream.
+    Zlib,
+}
+
+#[cfg(feature = "zlib")]
+impl GzipOutputFormat {
+    fn to_ffi(self) -> CInt {
+        match self {
+            GzipOutputFormat::Gzip => CInt(1),
+            GzipOutputFormat::Zlib => CInt(2),
+        }
+    }
+}
+
+/// Options for a [`GzipOutputStream`] or a [`ParallelGzipWriter`].
+///
+/// This type is only available if the `zlib` feature is enabled.
+#[cfg(feature = "zlib")]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct GzipOptions {
+    /// The format of the compressed stream. Defaults to
+    /// [`GzipOutputFormat::Gzip`].
+    pub format: GzipOutputFormat,
+    /// The size of the internal compression buffer. Defaults to 64KiB.
+    pub buffer_size: Option<usize>,
+    /// A number between 0 and 9, where 0 is no compression and 9 is best
+    /// compression. Defaults to zlib's default compression level.
+    pub compression_level: Option<u32>,
+}
+
+#[cfg(feature = "zlib")]
+impl Default for GzipOptions {
+    fn default() -> GzipOptions {
+        GzipOptions {
+            format: GzipOutputFormat::Gzip,
+            buffer_size: None,
+            compression_level: None,
+        }
+    }
+}
+
+/// A [`ZeroCopyOutputStream`] that writes directly into the spare capacity of
+/// a [`bytes::BufMut`], such as a [`bytes::BytesMut`].
+///
+/// Each call to [`next`] returns the buffer's current [`chunk_mut`], which for
+/// growable buffers like `BytesMut` reserves additional capacity if the buffer
+/// is full. Bytes are committed to the buffer as the stream moves on to the
+/// next chunk and when the stream is dropped. If the buffer has a fixed
+/// capacity, writes fail once it is exhausted.
+///
+/// This type is only available if the `bytes` feature is enabled.
+///
+/// [`next`]: ZeroCopyOutputStream::next
+/// [`chunk_mut`]: bytes::BufMut::chunk_mut
+#[cfg(feature = "bytes")]
+pub struct BufMutOutputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+#[cfg(feature = "bytes")]
+impl<'a> Drop for BufMutOutputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteChunkOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(feature = "bytes")]
+impl<'a> BufMutOutputStream<'a> {
+    /// Creates a new `BufMutOutputStream` that writes to `buf`.
+    pub fn new<B>(buf: &'a mut B) -> Pin<Box<BufMutOutputStream<'a>>>
+    where
+        B: bytes::BufMut + ?Sized,
+    {
+        let stream = ffi::NewChunkOutputStream(Box::new(ChunkWriteAdaptor::new(Box::new(buf))));
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    unsafe_ffi_conversions!(ffi::ChunkOutputStream);
+}
+
+#[cfg(feature = "bytes")]
+impl<'a> ZeroCopyOutputStream for BufMutOutputStream<'a> {}
+
+#[cfg(feature = "bytes")]
+impl<'a> zero_copy_output_stream::Sealed for BufMutOutputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
         unsafe { mem::transmute(self) }
     }
 
@@ -528,35 +2316,460 @@ impl<'a> zero_copy_output_stream::Sealed for WriterStream<'a> {
     }
 }
 
-/// A [`ZeroCopyOutputStream`] specialized for writing to byte slices.
+/// A [`ZeroCopyOutputStream`] that compresses data with gzip or zlib and
+/// writes it to another `ZeroCopyOutputStream`.
 ///
-/// Using this type is more efficient than using a [`WriterStream`] when the
-/// underlying writer is a type that exposes a simple mutable byte slice.
-pub struct SliceOutputStream<'a> {
+/// The compressed stream is finished when the `GzipOutputStream` is dropped,
+/// or explicitly with [`close`], which also reports any error.
+///
+/// This type is only available if the `zlib` feature is enabled.
+///
+/// [`close`]: GzipOutputStream::close
+#[cfg(feature = "zlib")]
+pub struct GzipOutputStream<'a> {
     _opaque: PhantomPinned,
     _lifetime: PhantomData<&'a ()>,
 }
 
-impl<'a> SliceOutputStream<'a> {
-    /// Creates a new `SliceOutputStream` from the provided byte slice.
-    pub fn new(slice: &mut [u8]) -> Pin<Box<SliceOutputStream<'a>>> {
-        let size = CInt::expect_from(slice.len());
-        let stream = unsafe { ffi::NewArrayOutputStream(slice.as_mut_ptr(), size) };
+#[cfg(feature = "zlib")]
+impl<'a> Drop for GzipOutputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteGzipOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(feature = "zlib")]
+impl<'a> GzipOutputStream<'a> {
+    /// Creates a `GzipOutputStream` that writes a gzip stream to `output`
+    /// using the default options.
+    pub fn new(output: Pin<&'a mut dyn ZeroCopyOutputStream>) -> Pin<Box<GzipOutputStream<'a>>> {
+        Self::with_options(output, GzipOptions::default())
+    }
+
+    /// Creates a `GzipOutputStream` that writes to `output` using the given
+    /// options.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the buffer size is zero or not representable as a C int, or
+    /// if the compression level is greater than 9.
+    pub fn with_options(
+        output: Pin<&'a mut dyn ZeroCopyOutputStream>,
+        options: GzipOptions,
+    ) -> Pin<Box<GzipOutputStream<'a>>> {
+        let format = options.format.to_ffi();
+        let buffer_size = match options.buffer_size {
+            None => CInt(-1),
+            Some(size) => {
+                assert!(size > 0, "buffer size must be nonzero");
+                CInt::expect_from(size)
+            }
+        };
+        let compression_level = match options.compression_level {
+            None => CInt(-1),
+            Some(level) => {
+                assert!(level <= 9, "compression level must be between 0 and 9");
+                CInt::expect_from(level)
+            }
+        };
+        let stream = unsafe {
+            ffi::NewGzipOutputStream(
+                output.upcast_mut_ptr(),
+                format,
+                buffer_size,
+                compression_level,
+            )
+        };
         unsafe { Self::from_ffi_owned(stream) }
     }
 
-    unsafe_ffi_conversions!(ffi::ArrayOutputStream);
+    /// Flushes data written so far as compressed data to the underlying
+    /// stream.
+    ///
+    /// It is the caller's responsibility to flush the underlying stream if
+    /// necessary. Compression may be less efficient when stopping and
+    /// starting around flushes.
+    pub fn flush(self: Pin<&mut Self>) -> Result<(), OperationFailedError> {
+        self.as_ffi_mut().Flush().as_result()
+    }
+
+    /// Writes out all data and closes the compressed stream.
+    ///
+    /// No further data may be written after calling this method.
+    pub fn close(self: Pin<&mut Self>) -> Result<(), OperationFailedError> {
+        self.as_ffi_mut().Close().as_result()
+    }
+
+    /// Returns the last error message reported by zlib, if any.
+    pub fn zlib_error_message(&self) -> Option<String> {
+        let message = ffi::GzipOutputStreamZlibErrorMessage(self.as_ffi());
+        (!message.is_empty()).then_some(message)
+    }
+
+    unsafe_ffi_conversions!(ffi::GzipOutputStream);
 }
 
-impl<'a> Drop for SliceOutputStream<'a> {
+#[cfg(feature = "zlib")]
+impl<'a> ZeroCopyOutputStream for GzipOutputStream<'a> {}
+
+#[cfg(feature = "zlib")]
+impl<'a> zero_copy_output_stream::Sealed for GzipOutputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyOutputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// The default size of the blocks compressed by a [`ParallelGzipWriter`].
+#[cfg(feature = "zlib")]
+const PARALLEL_GZIP_BLOCK_SIZE: usize = 128 << 10;
+
+/// The size of the deflate window, and so the most that a block compressed
+/// by a [`ParallelGzipWriter`] can refer back into the preceding data.
+#[cfg(feature = "zlib")]
+const DEFLATE_WINDOW_SIZE: usize = 32 << 10;
+
+/// A [`Write`] implementor that compresses data with gzip or zlib on several
+/// threads at once.
+///
+/// Like [pigz], the writer splits the data into blocks of
+/// [`GzipOptions::buffer_size`] bytes, 128 KiB by default, and compresses
+/// each block independently on a pool of worker threads while it accumulates
+/// the next. Each block is compressed with the 32 KiB of data that precede it
+/// as a preset dictionary, so compression suffers little from the split, and
+/// ends on a byte boundary, so the compressed blocks are written out in order
+/// to form a single gzip member or zlib stream that any decompressor,
+/// including [`GzipInputStream`], can read.
+///
+/// Wrap a `ParallelGzipWriter` in a [`WriterStream`] to use it in place of a
+/// [`GzipOutputStream`], which compresses on the calling thread only. Each
+/// block costs a few bytes of output, so for small outputs a
+/// `GzipOutputStream` remains the better choice. As with a
+/// `GzipOutputStream`, [flushing](Write::flush) the writer ends the current
+/// block early, which may make compression less efficient.
+///
+/// The compressed stream is completed by [`finish`], which returns the
+/// underlying writer. Dropping a `ParallelGzipWriter` completes the stream
+/// but ignores any errors.
+///
+/// This type is only available if the `zlib` feature is enabled.
+///
+/// [pigz]: https://zlib.net/pigz/
+/// [`finish`]: ParallelGzipWriter::finish
+#[cfg(feature = "zlib")]
+pub struct ParallelGzipWriter<W>
+where
+    W: Write,
+{
+    writer: Option<W>,
+    jobs: Option<mpsc::Sender<GzipJob>>,
+    results: mpsc::Receiver<GzipBlock>,
+    workers: Vec<thread::JoinHandle<()>>,
+    format: GzipOutputFormat,
+    compression_level: Option<u32>,
+    block: Vec<u8>,
+    block_size: usize,
+    // The end of the data sent to the workers so far, up to a window's worth.
+    dictionary: Vec<u8>,
+    // Blocks that have been compressed but not yet written, because earlier
+    // blocks are still being compressed.
+    pending: BTreeMap<usize, GzipBlock>,
+    spare: Vec<Vec<u8>>,
+    sent: usize,
+    written: usize,
+    header_written: bool,
+    check: u32,
+    len: u64,
+}
+
+#[cfg(feature = "zlib")]
+struct GzipJob {
+    index: usize,
+    dictionary: Vec<u8>,
+    data: Vec<u8>,
+}
+
+#[cfg(feature = "zlib")]
+struct GzipBlock {
+    index: usize,
+    data: Vec<u8>,
+    compressed: Option<Vec<u8>>,
+    check: u32,
+}
+
+#[cfg(feature = "zlib")]
+impl<W> ParallelGzipWriter<W>
+where
+    W: Write,
+{
+    /// Creates a `ParallelGzipWriter` that writes compressed data to
+    /// `writer`, compressing on `threads` worker threads.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `threads` or the buffer size is zero, or if the compression
+    /// level is greater than 9.
+    pub fn new(writer: W, options: GzipOptions, threads: usize) -> ParallelGzipWriter<W> {
+        assert!(threads > 0, "thread count must be nonzero");
+        let block_size = options.buffer_size.unwrap_or(PARALLEL_GZIP_BLOCK_SIZE);
+        assert!(block_size > 0, "buffer size must be nonzero");
+        let compression_level = match options.compression_level {
+            None => CInt(-1),
+            Some(level) => {
+                assert!(level <= 9, "compression level must be between 0 and 9");
+                CInt::expect_from(level)
+            }
+        };
+        let format = options.format.to_ffi();
+        let (job_tx, job_rx) = mpsc::channel::<GzipJob>();
+        let (result_tx, result_rx) = mpsc::channel();
+        let job_rx = Arc::new(Mutex::new(job_rx));
+        let workers = (0..threads)
+            .map(|_| {
+                let jobs = Arc::clone(&job_rx);
+                let results = result_tx.clone();
+                thread::spawn(move || loop {
+                    let job = match jobs.lock().unwrap().recv() {
+                        Ok(job) => job,
+                        Err(mpsc::RecvError) => break,
+                    };
+                    let mut compressed = vec![];
+                    let ok = ffi::DeflateBlock(
+                        &job.dictionary,
+                        &job.data,
+                        compression_level,
+                        &mut compressed,
+                    );
+                    let block = GzipBlock {
+                        index: job.index,
+                        check: ffi::GzipChecksum(format, &job.data),
+                        data: job.data,
+                        compressed: ok.then_some(compressed),
+                    };
+                    if results.send(block).is_err() {
+                        break;
+                    }
+                })
+            })
+            .collect();
+        ParallelGzipWriter {
+            writer: Some(writer),
+            jobs: Some(job_tx),
+            results: result_rx,
+            workers,
+            format: options.format,
+            compression_level: options.compression_level,
+            block: Vec::with_capacity(block_size),
+            block_size,
+            dictionary: vec![],
+            pending: BTreeMap::new(),
+            spare: vec![],
+            sent: 0,
+            written: 0,
+            header_written: false,
+            check: ffi::GzipChecksum(format, &[]),
+            len: 0,
+        }
+    }
+
+    /// Compresses all remaining data, completes the compressed stream, and
+    /// returns the underlying writer.
+    pub fn finish(mut self) -> Result<W, io::Error> {
+        self.finish_stream()?;
+        Ok(self.writer.take().unwrap())
+    }
+
+    fn finish_stream(&mut self) -> Result<(), io::Error> {
+        self.write_blocks()?;
+        self.write_header()?;
+        let mut trailer = vec![];
+        // An empty final block, with fixed Huffman codes, ends the deflate
+        // data that the sync-flushed blocks leave open.
+        trailer.extend([0x03, 0x00]);
+        match self.format {
+            GzipOutputFormat::Gzip => {
+                trailer.extend(self.check.to_le_bytes());
+                trailer.extend((self.len as u32).to_le_bytes());
+            }
+            GzipOutputFormat::Zlib => trailer.extend(self.check.to_be_bytes()),
+        }
+        let writer = self.writer.as_mut().unwrap();
+        writer.write_all(&trailer)?;
+        writer.flush()
+    }
+
+    /// Sends the current block to be compressed, if it is not empty.
+    fn send_block(&mut self) -> Result<(), io::Error> {
+        if self.block.is_empty() {
+            return Ok(());
+        }
+        // Keep every worker busy, with the next blocks ready, but bound the
+        // memory held by blocks that cannot be written yet.
+        while self.sent - self.written >= 2 * self.workers.len() {
+            self.receive_block()?;
+        }
+        let next = self
+            .spare
+            .pop()
+            .unwrap_or_else(|| Vec::with_capacity(self.block_size));
+        let data = mem::replace(&mut self.block, next);
+        let keep = DEFLATE_WINDOW_SIZE.saturating_sub(data.len());
+        let mut dictionary = self.dictionary[self.dictionary.len().saturating_sub(keep)..].to_vec();
+        dictionary.extend_from_slice(&data[data.len().saturating_sub(DEFLATE_WINDOW_SIZE)..]);
+        let job = GzipJob {
+            index: self.sent,
+            dictionary: mem::replace(&mut self.dictionary, dictionary),
+            data,
+        };
+        let sent = match &self.jobs {
+            Some(jobs) => jobs.send(job).is_ok(),
+            None => false,
+        };
+        if !sent {
+            return Err(io::Error::new(
+                io::ErrorKind::BrokenPipe,
+                "compression threads exited",
+            ));
+        }
+        self.sent += 1;
+        Ok(())
+    }
+
+    /// Waits for a block to be compressed, then writes out every compressed
+    /// block that is next in order.
+    fn receive_block(&mut self) -> Result<(), io::Error> {
+        let block = self.results.recv().map_err(|mpsc::RecvError| {
+            io::Error::new(io::ErrorKind::BrokenPipe, "compression threads exited")
+        })?;
+        self.pending.insert(block.index, block);
+        while let Some(mut block) = self.pending.remove(&self.written) {
+            self.written += 1;
+            let compressed = block
+                .compressed
+                .take()
+                .ok_or_else(|| io::Error::new(io::ErrorKind::Other, "zlib failed to compress"))?;
+            self.write_header()?;
+            self.writer.as_mut().unwrap().write_all(&compressed)?;
+            let format = self.format.to_ffi();
+            let len = block.data.len() as u64;
+            self.check = ffi::GzipCombineChecksums(format, self.check, block.check, len);
+            self.len += len;
+            block.data.clear();
+            self.spare.push(block.data);
+        }
+        Ok(())
+    }
+
+    /// Sends the current block to be compressed and writes out every block
+    /// sent so far.
+    fn write_blocks(&mut self) -> Result<(), io::Error> {
+        self.send_block()?;
+        while self.written < self.sent {
+            self.receive_block()?;
+        }
+        Ok(())
+    }
+
+    fn write_header(&mut self) -> Result<(), io::Error> {
+        if self.header_written {
+            return Ok(());
+        }
+        self.header_written = true;
+        let header: &[u8] = match self.format {
+            // No file name or modification time; an unknown operating
+            // system.
+            GzipOutputFormat::Gzip => &[0x1f, 0x8b, 0x08, 0, 0, 0, 0, 0, 0, 0xff],
+            // A 32 KiB window, and the compression level hint that zlib
+            // itself would write.
+            GzipOutputFormat::Zlib => match self.compression_level {
+                Some(0 | 1) => &[0x78, 0x01],
+                Some(2..=5) => &[0x78, 0x5e],
+                Some(6) | None => &[0x78, 0x9c],
+                Some(_) => &[0x78, 0xda],
+            },
+        };
+        self.writer.as_mut().unwrap().write_all(header)
+    }
+}
+
+#[cfg(feature = "zlib")]
+impl<W> Write for ParallelGzipWriter<W>
+where
+    W: Write,
+{
+    fn write(&mut self, buf: &[u8]) -> Result<usize, io::Error> {
+        let n = buf.len().min(self.block_size - self.block.len());
+        self.block.extend_from_slice(&buf[..n]);
+        if self.block.len() == self.block_size {
+            self.send_block()?;
+        }
+        Ok(n)
+    }
+
+    fn flush(&mut self) -> Result<(), io::Error> {
+        self.write_blocks()?;
+        self.writer.as_mut().unwrap().flush()
+    }
+}
+
+#[cfg(feature = "zlib")]
+impl<W> Drop for ParallelGzipWriter<W>
+where
+    W: Write,
+{
     fn drop(&mut self) {
-        unsafe { ffi::DeleteArrayOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+        if self.writer.is_some() {
+            let _ = self.finish_stream();
+        }
+        self.jobs = None;
+        for worker in self.workers.drain(..) {
+            let _ = worker.join();
+        }
     }
 }
 
-impl<'a> ZeroCopyOutputStream for SliceOutputStream<'a> {}
+/// A [`ZeroCopyOutputStream`] that computes the CRC32C of the data it writes
+/// to another `ZeroCopyOutputStream`.
+///
+/// Buffers from the underlying stream are passed through without copying.
+/// Every byte of a buffer returned by [`next`](ZeroCopyOutputStream::next)
+/// counts towards the checksum unless it is backed up, so
+/// [`crc32c`](Crc32cOutputStream::crc32c) is only meaningful once the writer
+/// has backed up any part of its last buffer that it did not fill, as a
+/// [`CodedOutputStream`] does when it is dropped or
+/// [trimmed](CodedOutputStream::trim).
+pub struct Crc32cOutputStream<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
 
-impl<'a> zero_copy_output_stream::Sealed for SliceOutputStream<'a> {
+impl<'a> Drop for Crc32cOutputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCrc32cOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> Crc32cOutputStream<'a> {
+    /// Creates a `Crc32cOutputStream` that writes to `output`.
+    pub fn new(output: Pin<&'a mut dyn ZeroCopyOutputStream>) -> Pin<Box<Crc32cOutputStream<'a>>> {
+        let stream = unsafe { ffi::NewCrc32cOutputStream(output.upcast_mut_ptr()) };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Returns the CRC32C of the bytes written so far.
+    pub fn crc32c(&self) -> u32 {
+        self.as_ffi().Crc32c()
+    }
+
+    unsafe_ffi_conversions!(ffi::Crc32cOutputStream);
+}
+
+impl<'a> ZeroCopyOutputStream for Crc32cOutputStream<'a> {}
+
+impl<'a> zero_copy_output_stream::Sealed for Crc32cOutputStream<'a> {
     fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
         unsafe { mem::transmute(self) }
     }
@@ -566,34 +2779,185 @@ impl<'a> zero_copy_output_stream::Sealed for SliceOutputStream<'a> {
     }
 }
 
-/// A [`ZeroCopyOutputStream`] specialized for writing to byte vectors.
+/// A string of bytes stored as a tree of reference-counted chunks.
 ///
-/// Using this type is more efficient than using a [`WriterStream`] when the
-/// underlying writer is a byte vector.
-pub struct VecOutputStream<'a> {
+/// This is a binding to `absl::Cord`. Appending one cord to another shares the
+/// appended cord's chunks rather than copying them, and
+/// [`append_external`](Cord::append_external) makes a chunk of memory owned by
+/// a Rust value, such as a `Vec<u8>` or a `bytes::Bytes`, without copying it.
+/// Combined with a [`CordOutputStream`] and [`CodedOutputStream::write_cord`],
+/// this allows large payloads to be forwarded into serialized output by
+/// reference.
+pub struct Cord {
+    _opaque: PhantomPinned,
+}
+
+// SAFETY: a cord only shares chunks with other cords through atomic reference
+// counts, and the Rust values that own external chunks are required to be
+// `Send`.
+unsafe impl Send for Cord {}
+
+impl Drop for Cord {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCord(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Cord {
+    /// Creates an empty cord.
+    pub fn new() -> Pin<Box<Cord>> {
+        let cord = ffi::NewCord();
+        unsafe { Self::from_ffi_owned(cord) }
+    }
+
+    /// Returns the number of bytes in the cord.
+    pub fn len(&self) -> usize {
+        self.as_ffi().size()
+    }
+
+    /// Reports whether the cord is empty.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Removes all bytes from the cord.
+    pub fn clear(self: Pin<&mut Self>) {
+        self.as_ffi_mut().Clear()
+    }
+
+    /// Appends a copy of `data` to the cord.
+    pub fn append(self: Pin<&mut Self>, data: &[u8]) {
+        ffi::CordAppend(self.as_ffi_mut(), data)
+    }
+
+    /// Appends the contents of `other` to the cord, sharing its chunks.
+    pub fn append_cord(self: Pin<&mut Self>, other: &Cord) {
+        ffi::CordAppendCord(self.as_ffi_mut(), other.as_ffi())
+    }
+
+    /// Appends the bytes of `value` to the cord without copying them.
+    ///
+    /// The cord takes ownership of `value`, and drops it once the cord, and
+    /// every cord that has since shared its chunk, no longer refers to its
+    /// bytes. The slice returned by `value.as_ref()` must remain the same for
+    /// as long as `value` is alive.
+    pub fn append_external<T>(self: Pin<&mut Self>, value: T)
+    where
+        T: AsRef<[u8]> + Send + 'static,
+    {
+        let external = Box::new(CordExternal(Box::new(value)));
+        // The bytes are borrowed from the boxed value, which does not move
+        // again.
+        let data: *const [u8] = (*external.0).as_ref();
+        ffi::CordAppendExternal(self.as_ffi_mut(), unsafe { &*data }, external)
+    }
+
+    /// Returns the chunks that make up the cord, in order.
+    pub fn chunks(&self) -> Vec<&[u8]> {
+        let mut chunks = vec![];
+        ffi::CordChunks(self.as_ffi(), &mut chunks);
+        chunks
+            .into_iter()
+            .map(|c| unsafe { slice::from_raw_parts(c.data, c.len) })
+            .collect()
+    }
+
+    /// Copies the contents of the cord into a new vector.
+    pub fn to_vec(&self) -> Vec<u8> {
+        let mut vec = Vec::with_capacity(self.len());
+        for chunk in self.chunks() {
+            vec.extend_from_slice(chunk);
+        }
+        vec
+    }
+
+    unsafe_ffi_conversions!(ffi::Cord);
+}
+
+/// A [`ZeroCopyInputStream`] that reads the chunks of a [`Cord`].
+///
+/// Each chunk is returned without copying. A [`CodedInputStream`] that reads
+/// from a `CordInputStream` can share large runs of the input with another
+/// cord via [`CodedInputStream::read_cord`].
+pub struct CordInputStream<'a> {
     _opaque: PhantomPinned,
     _lifetime: PhantomData<&'a ()>,
 }
 
-impl<'a> VecOutputStream<'a> {
-    /// Creates a new `VecOutputStream` from the provided byte vector.
-    pub fn new(vec: &mut Vec<u8>) -> Pin<Box<VecOutputStream<'a>>> {
-        let stream = ffi::NewVecOutputStream(vec);
+impl<'a> Drop for CordInputStream<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCordInputStream(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> CordInputStream<'a> {
+    /// Creates a stream that reads the contents of `cord`.
+    pub fn new(cord: &'a Cord) -> Pin<Box<CordInputStream<'a>>> {
+        let stream = ffi::NewCordInputStream(cord.as_ffi());
         unsafe { Self::from_ffi_owned(stream) }
     }
 
-    unsafe_ffi_conversions!(ffi::VecOutputStream);
+    unsafe_ffi_conversions!(ffi::CordInputStream);
 }
 
-impl<'a> Drop for VecOutputStream<'a> {
+impl<'a> ZeroCopyInputStream for CordInputStream<'a> {}
+
+impl<'a> zero_copy_input_stream::Sealed for CordInputStream<'a> {
+    fn upcast(&self) -> &ffi::ZeroCopyInputStream {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::ZeroCopyInputStream> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// A [`ZeroCopyOutputStream`] that writes to a [`Cord`].
+///
+/// Data is written into buffers that become chunks of the cord, so the output
+/// is never reallocated or copied as it grows. A [`CodedOutputStream`] that
+/// writes to a `CordOutputStream` appends large cords passed to
+/// [`CodedOutputStream::write_cord`] by reference.
+pub struct CordOutputStream {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for CordOutputStream {
     fn drop(&mut self) {
-        unsafe { ffi::DeleteVecOutputStream(self.as_ffi_mut_ptr_unpinned()) }
+        unsafe { ffi::DeleteCordOutputStream(self.as_ffi_mut_ptr_unpinned()) }
     }
 }
 
-impl<'a> ZeroCopyOutputStream for VecOutputStream<'a> {}
+impl CordOutputStream {
+    /// Creates a stream that writes to a new cord.
+    pub fn new() -> Pin<Box<CordOutputStream>> {
+        CordOutputStream::with_size_hint(0)
+    }
 
-impl<'a> zero_copy_output_stream::Sealed for VecOutputStream<'a> {
+    /// Creates a stream that writes to a new cord, allocating its first
+    /// buffer to fit `size_hint` bytes, as computed by
+    /// [`MessageLite::byte_size`].
+    pub fn with_size_hint(size_hint: usize) -> Pin<Box<CordOutputStream>> {
+        let stream = ffi::NewCordOutputStream(size_hint);
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Returns the cord written so far, leaving the stream writing to a new,
+    /// empty cord.
+    ///
+    /// Any [`CodedOutputStream`] writing to the stream must be trimmed or
+    /// dropped first, so that the bytes it has buffered are in the cord.
+    pub fn consume(self: Pin<&mut Self>) -> Pin<Box<Cord>> {
+        let cord = ffi::CordOutputStreamConsume(self.as_ffi_mut());
+        unsafe { Cord::from_ffi_owned(cord) }
+    }
+
+    unsafe_ffi_conversions!(ffi::CordOutputStream);
+}
+
+impl ZeroCopyOutputStream for CordOutputStream {}
+
+impl zero_copy_output_stream::Sealed for CordOutputStream {
     fn upcast(&self) -> &ffi::ZeroCopyOutputStream {
         unsafe { mem::transmute(self) }
     }
@@ -631,10 +2995,129 @@ impl<'a> CodedInputStream<'a> {
         unsafe { Self::from_ffi_owned(stream) }
     }
 
-    /// Reports whether this coded input stream reads from a flat array instead
-    /// of a [`ZeroCopyInputStream`].
-    pub fn is_flat(&self) -> bool {
-        self.as_ffi().IsFlat()
+    /// Creates a `CodedInputStream` that reads directly from the given byte
+    /// slice.
+    ///
+    /// The resulting stream is flat (see [`is_flat`]), which allows decoding
+    /// to proceed without any buffer-boundary checks.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the length of `buffer` is not representable as a C int.
+    ///
+    /// [`is_flat`]: CodedInputStream::is_flat
+    pub fn from_slice(buffer: &'a [u8]) -> Pin<Box<CodedInputStream<'a>>> {
+        let size = CInt::expect_from(buffer.len());
+        let stream = unsafe { ffi::NewCodedInputStreamFromArray(buffer.as_ptr(), size) };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Reinitializes the stream to read directly from `buffer`, as if it had
+    /// been newly created with [`CodedInputStream::from_slice`].
+    ///
+    /// All state, including any limits, the last tag, and the total bytes and
+    /// recursion limits, is reset. If the stream was reading from a
+    /// [`ZeroCopyInputStream`], any buffered but unread data is first returned
+    /// to it.
+    ///
+    /// This allows one stream object to be reused to decode many independent
+    /// buffers without allocating a new stream for each.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the length of `buffer` is not representable as a C int.
+    pub fn reset(self: Pin<&mut Self>, buffer: &'a [u8]) {
+        let size = CInt::expect_from(buffer.len());
+        unsafe { ffi::CodedInputStreamResetToArray(self.as_ffi_mut(), buffer.as_ptr(), size) }
+    }
+
+    /// Reports whether this coded input stream reads from a flat array instead
+    /// of a [`ZeroCopyInputStream`].
+    pub fn is_flat(&self) -> bool {
+        self.as_ffi().IsFlat()
+    }
+
+    /// Skips a number of bytes.
+    ///
+    /// Returns an error if an underlying read error occurs or if the end of
+    /// the input is reached before `count` bytes are skipped.
+    pub fn skip(self: Pin<&mut Self>, count: usize) -> Result<(), OperationFailedError> {
+        let count = CInt::expect_from(count);
+        self.as_ffi_mut().Skip(count).as_result()
+    }
+
+    /// Reads `len` raw bytes, borrowing them from the underlying buffer when
+    /// possible.
+    ///
+    /// If the next `len` bytes are contiguous in the buffer currently held by
+    /// the stream, which is always the case for a flat stream (see
+    /// [`is_flat`]), the returned slice points directly into that buffer and
+    /// no bytes are copied. Otherwise the bytes span a chunk boundary of the
+    /// underlying [`ZeroCopyInputStream`] and are copied into a new vector.
+    ///
+    /// Returns an error if fewer than `len` bytes remain before the end of the
+    /// input or the current limit.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `len` is not representable as a C int.
+    ///
+    /// [`is_flat`]: CodedInputStream::is_flat
+    pub fn read_bytes_borrowed<'s>(
+        mut self: Pin<&'s mut Self>,
+        len: usize,
+    ) -> Result<Cow<'s, [u8]>, OperationFailedError> {
+        let size = CInt::expect_from(len);
+        if len == 0 {
+            return Ok(Cow::Borrowed(&[]));
+        }
+        let mut data = MaybeUninit::uninit();
+        let mut available = MaybeUninit::uninit();
+        unsafe {
+            // SAFETY: `data` and `available` are non-null, as required.
+            let ok = self
+                .as_mut()
+                .as_ffi_mut()
+                .GetDirectBufferPointer(data.as_mut_ptr(), available.as_mut_ptr());
+            if ok && available.assume_init().to_usize()? >= len {
+                // SAFETY: the buffer remains valid until the stream next
+                // refreshes its buffer, which cannot happen while `self` is
+                // mutably borrowed for `'s`. Skipping within the current buffer
+                // does not invalidate it.
+                let buf = slice::from_raw_parts(data.assume_init() as *const u8, len);
+                self.as_ffi_mut().Skip(size).as_result()?;
+                return Ok(Cow::Borrowed(buf));
+            }
+            let mut buf = Vec::with_capacity(len);
+            self.as_ffi_mut()
+                .ReadRaw(buf.as_mut_ptr() as *mut CVoid, size)
+                .as_result()?;
+            // SAFETY: `ReadRaw` has succeeded and so has initialized all `len`
+            // bytes.
+            buf.set_len(len);
+            Ok(Cow::Owned(buf))
+        }
+    }
+
+    /// Reads `len` raw bytes into `output`, replacing its contents.
+    ///
+    /// When the stream reads from a [`CordInputStream`] and `len` is large,
+    /// the bytes are not copied: `output` shares the chunks of the cord being
+    /// read.
+    ///
+    /// Returns an error if fewer than `len` bytes remain before the end of the
+    /// input or the current limit.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `len` is not representable as a C int.
+    pub fn read_cord(
+        self: Pin<&mut Self>,
+        output: Pin<&mut Cord>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        let size = CInt::expect_from(len);
+        ffi::CodedInputStreamReadCord(self.as_ffi_mut(), output.as_ffi_mut(), size).as_result()
     }
 
     /// Reads an unsigned integer with varint encoding, truncating to 32 bits.
@@ -683,14 +3166,55 @@ impl<'a> CodedInputStream<'a> {
     /// Like [`read_tag`], but does not update the last tag
     /// value.
     ///
-    /// [`read_tag`]: `CodedInputStream::read_tag`
+    /// [`read_tag`]: CodedInputStream::read_tag
     pub fn read_tag_no_last_tag(self: Pin<&mut Self>) -> Result<u32, OperationFailedError> {
-        match self.as_ffi_mut().ReadTag() {
+        match self.as_ffi_mut().ReadTagNoLastTag() {
             0 => Err(OperationFailedError), // 0 is error sentinel
             tag => Ok(tag),
         }
     }
 
+    /// Reads a tag, additionally reporting whether it is known to be no
+    /// greater than `cutoff`.
+    ///
+    /// This is usually faster than [`read_tag`] when `cutoff` is a constant,
+    /// and does particularly well for `cutoff >= 127`, as most tags can then be
+    /// decoded from a single byte. If the second element of the returned tuple
+    /// is true, the tag is known to be in `[1, cutoff]`; otherwise, the tag is
+    /// above `cutoff`. Also updates the last tag value, which can be checked
+    /// with [`last_tag_was`].
+    ///
+    /// [`read_tag`]: CodedInputStream::read_tag
+    /// [`last_tag_was`]: CodedInputStream::last_tag_was
+    pub fn read_tag_with_cutoff(
+        self: Pin<&mut Self>,
+        cutoff: u32,
+    ) -> Result<(u32, bool), OperationFailedError> {
+        let mut fast_path = false;
+        match ffi::CodedInputStreamReadTagWithCutoff(self.as_ffi_mut(), cutoff, &mut fast_path) {
+            0 => Err(OperationFailedError), // 0 is error sentinel
+            tag => Ok((tag, fast_path)),
+        }
+    }
+
+    /// Like [`read_tag_with_cutoff`], but does not update the last tag value.
+    ///
+    /// [`read_tag_with_cutoff`]: CodedInputStream::read_tag_with_cutoff
+    pub fn read_tag_with_cutoff_no_last_tag(
+        self: Pin<&mut Self>,
+        cutoff: u32,
+    ) -> Result<(u32, bool), OperationFailedError> {
+        let mut fast_path = false;
+        match ffi::CodedInputStreamReadTagWithCutoffNoLastTag(
+            self.as_ffi_mut(),
+            cutoff,
+            &mut fast_path,
+        ) {
+            0 => Err(OperationFailedError), // 0 is error sentinel
+            tag => Ok((tag, fast_path)),
+        }
+    }
+
     /// Reports whether the last call to [`read_tag`] or
     /// [`read_tag_with_cutoff`] returned the given value.
     ///
@@ -726,6 +3250,33 @@ impl<'a> CodedInputStream<'a> {
         self.as_ffi_mut().ConsumedEntireMessage()
     }
 
+    /// Skips the value of the field whose tag was just read.
+    ///
+    /// The value is skipped with [`skip`] where its length is known, which
+    /// does not copy any bytes, and a group is skipped along with its end-group
+    /// tag.
+    ///
+    /// Returns an error if the value is malformed or truncated, or if `tag` is
+    /// an end-group tag or has an invalid wire type.
+    ///
+    /// [`skip`]: CodedInputStream::skip
+    pub fn skip_field(self: Pin<&mut Self>, tag: u32) -> Result<(), OperationFailedError> {
+        ffi::CodedInputStreamSkipField(self.as_ffi_mut(), tag).as_result()
+    }
+
+    /// Skips fields until the end of the input, the current limit, or an
+    /// end-group tag.
+    ///
+    /// If skipping stops at an end-group tag, that tag is consumed and can be
+    /// checked with [`last_tag_was`].
+    ///
+    /// Returns an error if any of the skipped fields is malformed.
+    ///
+    /// [`last_tag_was`]: CodedInputStream::last_tag_was
+    pub fn skip_message(self: Pin<&mut Self>) -> Result<(), OperationFailedError> {
+        ffi::CodedInputStreamSkipMessage(self.as_ffi_mut()).as_result()
+    }
+
     /// Returns the stream's current position relative to the beginning of the
     /// input.
     pub fn current_position(&self) -> usize {
@@ -735,6 +3286,178 @@ impl<'a> CodedInputStream<'a> {
             .expect("stream position not representable as usize")
     }
 
+    /// Places a limit on the number of bytes that the stream may read, starting
+    /// from the current position.
+    ///
+    /// Once the stream hits this limit, it will act like the end of the input
+    /// has been reached until [`pop_limit`] is called with the returned
+    /// [`Limit`].
+    ///
+    /// As the names imply, the stream conceptually has a stack of limits. The
+    /// shortest limit on the stack is always enforced, even if it is not the
+    /// top limit.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `byte_limit` is not representable as a C int.
+    ///
+    /// [`pop_limit`]: CodedInputStream::pop_limit
+    pub fn push_limit(self: Pin<&mut Self>, byte_limit: usize) -> Limit {
+        Limit(self.as_ffi_mut().PushLimit(CInt::expect_from(byte_limit)))
+    }
+
+    /// Pops the last limit pushed by [`push_limit`].
+    ///
+    /// The `limit` must be the value returned by that call to `push_limit`.
+    ///
+    /// [`push_limit`]: CodedInputStream::push_limit
+    pub fn pop_limit(self: Pin<&mut Self>, limit: Limit) {
+        self.as_ffi_mut().PopLimit(limit.0)
+    }
+
+    /// Returns the number of bytes left until the nearest limit on the stack
+    /// is hit, or `None` if no limits are in place.
+    pub fn bytes_until_limit(&self) -> Option<usize> {
+        self.as_ffi().BytesUntilLimit().to_usize().ok()
+    }
+
+    /// Sets the maximum number of bytes that this `CodedInputStream` will read
+    /// before refusing to continue.
+    ///
+    /// The default limit is `i32::MAX` (~2GB). Setting a limit less than the
+    /// current read position is interpreted as a limit on the current
+    /// position.
+    ///
+    /// This is unrelated to [`push_limit`] and [`pop_limit`].
+    ///
+    /// # Panics
+    ///
+    /// Panics if `total_bytes_limit` is not representable as a C int.
+    ///
+    /// [`push_limit`]: CodedInputStream::push_limit
+    /// [`pop_limit`]: CodedInputStream::pop_limit
+    pub fn set_total_bytes_limit(self: Pin<&mut Self>, total_bytes_limit: usize) {
+        self.as_ffi_mut()
+            .SetTotalBytesLimit(CInt::expect_from(total_bytes_limit))
+    }
+
+    /// Returns the total bytes limit minus the current position, or `None` if
+    /// the total bytes limit is `i32::MAX`.
+    pub fn bytes_until_total_bytes_limit(&self) -> Option<usize> {
+        self.as_ffi().BytesUntilTotalBytesLimit().to_usize().ok()
+    }
+
+    /// Sets the maximum recursion depth when parsing embedded messages and
+    /// groups.
+    ///
+    /// The default is 100.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `limit` is not representable as a C int.
+    pub fn set_recursion_limit(self: Pin<&mut Self>, limit: usize) {
+        self.as_ffi_mut()
+            .SetRecursionLimit(CInt::expect_from(limit))
+    }
+
+    /// Decodes the next `len` bytes as a packed sequence of unsigned varints,
+    /// truncating each to 32 bits, and appends them to `out`.
+    ///
+    /// This is the encoding of a packed repeated `uint32` field. The entire
+    /// region is decoded in a single call, which is substantially faster than
+    /// calling [`read_varint32`] in a loop.
+    ///
+    /// If an error occurs, the contents of `out` are unspecified beyond its
+    /// original length.
+    ///
+    /// [`read_varint32`]: CodedInputStream::read_varint32
+    pub fn read_packed_varint32_into(
+        self: Pin<&mut Self>,
+        out: &mut Vec<u32>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        self.read_packed_into(out, len, len, ffi::CodedInputStreamReadPackedVarint32)
+    }
+
+    /// Like [`read_packed_varint32_into`], but decodes 64-bit varints.
+    ///
+    /// [`read_packed_varint32_into`]: CodedInputStream::read_packed_varint32_into
+    pub fn read_packed_varint64_into(
+        self: Pin<&mut Self>,
+        out: &mut Vec<u64>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        self.read_packed_into(out, len, len, ffi::CodedInputStreamReadPackedVarint64)
+    }
+
+    /// Like [`read_packed_varint32_into`], but decodes ZigZag-encoded signed
+    /// varints, as used by packed repeated `sint32` fields.
+    ///
+    /// [`read_packed_varint32_into`]: CodedInputStream::read_packed_varint32_into
+    pub fn read_packed_sint32_into(
+        self: Pin<&mut Self>,
+        out: &mut Vec<i32>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        self.read_packed_into(out, len, len, ffi::CodedInputStreamReadPackedSInt32)
+    }
+
+    /// Like [`read_packed_varint32_into`], but decodes ZigZag-encoded signed
+    /// 64-bit varints, as used by packed repeated `sint64` fields.
+    ///
+    /// [`read_packed_varint32_into`]: CodedInputStream::read_packed_varint32_into
+    pub fn read_packed_sint64_into(
+        self: Pin<&mut Self>,
+        out: &mut Vec<i64>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        self.read_packed_into(out, len, len, ffi::CodedInputStreamReadPackedSInt64)
+    }
+
+    /// Decodes the next `len` bytes as a packed sequence of little-endian
+    /// 32-bit integers and appends them to `out`.
+    ///
+    /// This is the encoding of a packed repeated `fixed32` field. Returns an
+    /// error if `len` is not a multiple of four.
+    pub fn read_packed_fixed32_into(
+        self: Pin<&mut Self>,
+        out: &mut Vec<u32>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        self.read_packed_into(out, len, len / 4, ffi::CodedInputStreamReadPackedFixed32)
+    }
+
+    /// Decodes the next `len` bytes as a packed sequence of little-endian
+    /// 64-bit integers and appends them to `out`.
+    ///
+    /// This is the encoding of a packed repeated `fixed64` field. Returns an
+    /// error if `len` is not a multiple of eight.
+    pub fn read_packed_fixed64_into(
+        self: Pin<&mut Self>,
+        out: &mut Vec<u64>,
+        len: usize,
+    ) -> Result<(), OperationFailedError> {
+        self.read_packed_into(out, len, len / 8, ffi::CodedInputStreamReadPackedFixed64)
+    }
+
+    fn read_packed_into<T>(
+        self: Pin<&mut Self>,
+        out: &mut Vec<T>,
+        len: usize,
+        max_count: usize,
+        read: unsafe fn(Pin<&mut ffi::CodedInputStream>, CInt, *mut T) -> CInt,
+    ) -> Result<(), OperationFailedError> {
+        let length = CInt::expect_from(len);
+        out.reserve(max_count);
+        // SAFETY: `read` writes at most `max_count` elements, for which space
+        // was reserved above, and returns the number of elements written.
+        unsafe {
+            let n = read(self.as_ffi_mut(), length, out.as_mut_ptr().add(out.len())).to_usize()?;
+            out.set_len(out.len() + n);
+        }
+        Ok(())
+    }
+
     unsafe_ffi_conversions!(ffi::CodedInputStream);
 }
 
@@ -754,6 +3477,137 @@ impl<'a> Read for Pin<&mut CodedInputStream<'a>> {
     }
 }
 
+/// Storage for a C++ `CodedInputStream`.
+///
+/// The size and alignment must be kept in sync with
+/// `kCodedInputStreamStorageSize` and `kCodedInputStreamStorageAlign` in
+/// io.h, which statically asserts that they are sufficient.
+#[repr(C, align(8))]
+struct CodedInputStreamStorage([MaybeUninit<u8>; 96]);
+
+/// A [`CodedInputStream`] that is constructed in place, without a heap
+/// allocation.
+///
+/// A [`CodedInputStream`] created with [`CodedInputStream::new`] or
+/// [`CodedInputStream::from_slice`] is allocated on the C++ heap. A
+/// `StackCodedInputStream` instead provides storage for the stream inline,
+/// typically on the stack, which avoids an allocation and deallocation for
+/// each short-lived parse.
+///
+/// The storage must be pinned before a stream can be constructed in it, e.g.
+/// with [`std::pin::pin!`]. Reinitializing a `StackCodedInputStream` destroys
+/// the previous stream, if any.
+///
+/// The stream in the storage is destroyed when the storage is dropped, so
+/// whatever it reads from must outlive the storage: declare the source, be
+/// it a byte slice or a [`ZeroCopyInputStream`], before the storage.
+///
+/// # Examples
+///
+/// ```
+/// use std::pin::pin;
+/// use protobuf_native::io::StackCodedInputStream;
+///
+/// let mut storage = pin!(StackCodedInputStream::new());
+/// let mut input = storage.as_mut().init_from_slice(&[0x96, 0x01]);
+/// assert_eq!(input.as_mut().read_varint32().unwrap(), 150);
+/// ```
+pub struct StackCodedInputStream<'a> {
+    storage: CodedInputStreamStorage,
+    stream: *mut ffi::CodedInputStream,
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> StackCodedInputStream<'a> {
+    /// Creates uninitialized storage for a `CodedInputStream`.
+    pub fn new() -> StackCodedInputStream<'a> {
+        StackCodedInputStream {
+            storage: CodedInputStreamStorage([MaybeUninit::uninit(); 96]),
+            stream: ptr::null_mut(),
+            _opaque: PhantomPinned,
+            _lifetime: PhantomData,
+        }
+    }
+
+    /// Constructs a `CodedInputStream` in this storage that reads from the
+    /// given [`ZeroCopyInputStream`].
+    ///
+    /// See [`CodedInputStream::new`].
+    pub fn init(
+        self: Pin<&mut Self>,
+        input: Pin<&'a mut dyn ZeroCopyInputStream>,
+    ) -> Pin<&mut CodedInputStream<'a>> {
+        // SAFETY: the storage is never moved out of `self`.
+        let this = unsafe { self.get_unchecked_mut() };
+        this.destroy();
+        this.stream =
+            unsafe { ffi::ConstructCodedInputStream(this.storage_ptr(), input.upcast_mut_ptr()) };
+        unsafe { CodedInputStream::from_ffi_mut(this.stream) }
+    }
+
+    /// Constructs a `CodedInputStream` in this storage that reads directly from
+    /// the given byte slice.
+    ///
+    /// See [`CodedInputStream::from_slice`].
+    ///
+    /// # Panics
+    ///
+    /// Panics if the length of `buffer` is not representable as a C int.
+    pub fn init_from_slice(
+        self: Pin<&mut Self>,
+        buffer: &'a [u8],
+    ) -> Pin<&mut CodedInputStream<'a>> {
+        let size = CInt::expect_from(buffer.len());
+        // SAFETY: the storage is never moved out of `self`.
+        let this = unsafe { self.get_unchecked_mut() };
+        this.destroy();
+        this.stream = unsafe {
+            ffi::ConstructCodedInputStreamFromArray(this.storage_ptr(), buffer.as_ptr(), size)
+        };
+        unsafe { CodedInputStream::from_ffi_mut(this.stream) }
+    }
+
+    /// Returns the stream most recently constructed in this storage, if any.
+    pub fn get(self: Pin<&mut Self>) -> Option<Pin<&mut CodedInputStream<'a>>> {
+        match self.stream.is_null() {
+            true => None,
+            false => Some(unsafe { CodedInputStream::from_ffi_mut(self.stream) }),
+        }
+    }
+
+    fn storage_ptr(&mut self) -> *mut u8 {
+        self.storage.0.as_mut_ptr() as *mut u8
+    }
+
+    fn destroy(&mut self) {
+        if !self.stream.is_null() {
+            unsafe { ffi::DestroyCodedInputStream(self.stream) };
+            self.stream = ptr::null_mut();
+        }
+    }
+}
+
+impl<'a> Default for StackCodedInputStream<'a> {
+    fn default() -> StackCodedInputStream<'a> {
+        StackCodedInputStream::new()
+    }
+}
+
+impl<'a> Drop for StackCodedInputStream<'a> {
+    fn drop(&mut self) {
+        self.destroy()
+    }
+}
+
+/// An opaque limit token returned by [`CodedInputStream::push_limit`].
+///
+/// Must be passed unchanged to the corresponding call to
+/// [`CodedInputStream::pop_limit`].
+#[derive(Debug)]
+#[must_use = "a pushed limit must be popped with `CodedInputStream::pop_limit`"]
+pub struct Limit(CInt);
+
 /// Type which encodes and writes binary data which is composed of varint-
 /// encoded integers and fixed-width pieces.
 ///
@@ -771,11 +3625,332 @@ pub struct CodedOutputStream<'a> {
 }
 
 impl<'a> CodedOutputStream<'a> {
+    /// Creates a `CodedOutputStream` that writes to the given
+    /// [`ZeroCopyOutputStream`].
+    ///
+    /// Any buffer space acquired from `output` but not written is returned to
+    /// it when the `CodedOutputStream` is dropped or [`trim`]med.
+    ///
+    /// [`trim`]: CodedOutputStream::trim
+    pub fn new(output: Pin<&'a mut dyn ZeroCopyOutputStream>) -> Pin<Box<CodedOutputStream<'a>>> {
+        let stream = unsafe { ffi::NewCodedOutputStream(output.upcast_mut_ptr()) };
+        unsafe { Self::from_ffi_owned(stream) }
+    }
+
+    /// Reports whether an I/O error has occurred on the underlying stream.
+    pub fn had_error(self: Pin<&mut Self>) -> bool {
+        self.as_ffi_mut().HadError()
+    }
+
+    /// Trims any unused space in the underlying buffer so that its size
+    /// matches the number of bytes written by this stream.
+    ///
+    /// The underlying buffer will automatically be trimmed when this stream is
+    /// dropped; this call is only necessary if the underlying buffer is
+    /// accessed *before* the stream is dropped.
+    pub fn trim(self: Pin<&mut Self>) {
+        self.as_ffi_mut().Trim()
+    }
+
+    /// Skips a number of bytes, leaving the bytes unmodified in the underlying
+    /// buffer.
+    ///
+    /// Returns an error if an underlying write error occurs.
+    pub fn skip(self: Pin<&mut Self>, count: usize) -> Result<(), OperationFailedError> {
+        let count = CInt::expect_from(count);
+        self.as_ffi_mut().Skip(count).as_result()
+    }
+
+    /// Writes raw bytes.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the length of `buf` is not representable as a C int.
+    pub fn write_raw(self: Pin<&mut Self>, buf: &[u8]) {
+        let size = CInt::expect_from(buf.len());
+        unsafe {
+            self.as_ffi_mut()
+                .WriteRaw(buf.as_ptr() as *const CVoid, size)
+        }
+    }
+
+    /// Writes a 32-bit little-endian integer.
+    pub fn write_little_endian32(self: Pin<&mut Self>, value: u32) {
+        self.as_ffi_mut().WriteLittleEndian32(value)
+    }
+
+    /// Writes a 64-bit little-endian integer.
+    pub fn write_little_endian64(self: Pin<&mut Self>, value: u64) {
+        self.as_ffi_mut().WriteLittleEndian64(value)
+    }
+
+    /// Writes an unsigned 32-bit integer with varint encoding.
+    pub fn write_varint32(self: Pin<&mut Self>, value: u32) {
+        self.as_ffi_mut().WriteVarint32(value)
+    }
+
+    /// Writes an unsigned 64-bit integer with varint encoding.
+    pub fn write_varint64(self: Pin<&mut Self>, value: u64) {
+        self.as_ffi_mut().WriteVarint64(value)
+    }
+
+    /// Writes a signed 32-bit integer with varint encoding.
+    ///
+    /// Negative values are sign-extended to 64 bits, and so always occupy ten
+    /// bytes. This is how `int32` fields are encoded.
+    pub fn write_varint32_sign_extended(self: Pin<&mut Self>, value: i32) {
+        self.as_ffi_mut().WriteVarint32SignExtended(value)
+    }
+
+    /// Writes `values` as a packed sequence of unsigned varints, preceded by
+    /// its length in bytes.
+    ///
+    /// This is the encoding of a packed repeated `uint32` field after its
+    /// tag. The length is computed in a single pass over the values, and runs
+    /// of small values are encoded eight at a time.
+    pub fn write_packed_varint32(self: Pin<&mut Self>, values: &[u32]) {
+        ffi::CodedOutputStreamWritePackedVarint32(self.as_ffi_mut(), values)
+    }
+
+    /// Like [`write_packed_varint32`], but writes 64-bit varints, as used by
+    /// packed repeated `uint64` fields.
+    ///
+    /// [`write_packed_varint32`]: CodedOutputStream::write_packed_varint32
+    pub fn write_packed_varint64(self: Pin<&mut Self>, values: &[u64]) {
+        ffi::CodedOutputStreamWritePackedVarint64(self.as_ffi_mut(), values)
+    }
+
+    /// Like [`write_packed_varint32`], but writes sign-extended signed
+    /// varints, as used by packed repeated `int32` fields.
+    ///
+    /// [`write_packed_varint32`]: CodedOutputStream::write_packed_varint32
+    pub fn write_packed_int32(self: Pin<&mut Self>, values: &[i32]) {
+        ffi::CodedOutputStreamWritePackedInt32(self.as_ffi_mut(), values)
+    }
+
+    /// Like [`write_packed_varint32`], but writes signed 64-bit varints, as
+    /// used by packed repeated `int64` fields.
+    ///
+    /// [`write_packed_varint32`]: CodedOutputStream::write_packed_varint32
+    pub fn write_packed_int64(self: Pin<&mut Self>, values: &[i64]) {
+        ffi::CodedOutputStreamWritePackedInt64(self.as_ffi_mut(), values)
+    }
+
+    /// Like [`write_packed_varint32`], but writes ZigZag-encoded signed
+    /// varints, as used by packed repeated `sint32` fields.
+    ///
+    /// [`write_packed_varint32`]: CodedOutputStream::write_packed_varint32
+    pub fn write_packed_sint32(self: Pin<&mut Self>, values: &[i32]) {
+        ffi::CodedOutputStreamWritePackedSInt32(self.as_ffi_mut(), values)
+    }
+
+    /// Like [`write_packed_varint32`], but writes ZigZag-encoded signed
+    /// 64-bit varints, as used by packed repeated `sint64` fields.
+    ///
+    /// [`write_packed_varint32`]: CodedOutputStream::write_packed_varint32
+    pub fn write_packed_sint64(self: Pin<&mut Self>, values: &[i64]) {
+        ffi::CodedOutputStreamWritePackedSInt64(self.as_ffi_mut(), values)
+    }
+
+    /// Writes a tag.
+    ///
+    /// This is equivalent to [`write_varint32`], but is used when writing
+    /// field tags.
+    ///
+    /// [`write_varint32`]: CodedOutputStream::write_varint32
+    pub fn write_tag(self: Pin<&mut Self>, value: u32) {
+        self.as_ffi_mut().WriteTag(value)
+    }
+
+    /// Writes the contents of a [`Cord`].
+    ///
+    /// When the stream writes to a [`CordOutputStream`] and the cord is large,
+    /// its chunks are appended to the output by reference rather than copied.
+    pub fn write_cord(self: Pin<&mut Self>, cord: &Cord) {
+        self.as_ffi_mut().WriteCord(cord.as_ffi())
+    }
+
+    /// Returns the total number of bytes written since this object was
+    /// created.
+    pub fn byte_count(&self) -> usize {
+        self.as_ffi()
+            .ByteCount()
+            .to_usize()
+            .expect("byte count not representable as usize")
+    }
+
+    /// Sets whether maps are serialized in a deterministic order by messages
+    /// written to this stream.
+    pub fn set_serialization_deterministic(self: Pin<&mut Self>, value: bool) {
+        self.as_ffi_mut().SetSerializationDeterministic(value)
+    }
+
+    /// Reports whether serialization to this stream is deterministic.
+    pub fn is_serialization_deterministic(&self) -> bool {
+        self.as_ffi().IsSerializationDeterministic()
+    }
+
     unsafe_ffi_conversions!(ffi::CodedOutputStream);
 }
 
+impl<'a> Write for Pin<&mut CodedOutputStream<'a>> {
+    fn write(&mut self, buf: &[u8]) -> Result<usize, io::Error> {
+        let size = CInt::try_from(buf.len()).map_err(|_| {
+            io::Error::new(
+                io::ErrorKind::InvalidInput,
+                "buffer exceeds size of a C int",
+            )
+        })?;
+        unsafe {
+            self.as_mut()
+                .as_ffi_mut()
+                .WriteRaw(buf.as_ptr() as *const CVoid, size)
+        };
+        match self.as_mut().had_error() {
+            true => Err(io::Error::new(io::ErrorKind::Other, "write failed")),
+            false => Ok(buf.len()),
+        }
+    }
+
+    fn flush(&mut self) -> Result<(), io::Error> {
+        self.as_mut().trim();
+        Ok(())
+    }
+}
+
 impl<'a> Drop for CodedOutputStream<'a> {
     fn drop(&mut self) {
         unsafe { ffi::DeleteCodedOutputStream(self.as_ffi_mut_ptr_unpinned()) }
     }
 }
+
+/// Reads a sequence of length-delimited messages from a
+/// [`ZeroCopyInputStream`].
+///
+/// Each record is a varint-encoded length followed by a message of that
+/// length, as written by [`DelimitedWriter`] or
+/// [`MessageLite::serialize_delimited_to_zero_copy_stream`].
+///
+/// A single [`CodedInputStream`] and a single message instance are reused
+/// across records. The message is cleared before each record is parsed, which
+/// retains any memory it has already allocated.
+///
+/// # Examples
+///
+/// ```no_run
+/// use std::fs::File;
+/// use protobuf_native::MessageLite;
+/// use protobuf_native::io::{DelimitedReader, ReaderStream};
+/// # fn f(template: &dyn MessageLite) -> Result<(), Box<dyn std::error::Error>> {
+///
+/// let mut f = File::open("records.bin")?;
+/// let mut input = ReaderStream::new(&mut f);
+/// let mut reader = DelimitedReader::new(input.as_mut(), template.new());
+/// while let Some(message) = reader.read_next()? {
+///     println!("{} bytes", message.byte_size());
+/// }
+/// # Ok(())
+/// # }
+/// ```
+///
+/// [`MessageLite::serialize_delimited_to_zero_copy_stream`]: crate::MessageLite::serialize_delimited_to_zero_copy_stream
+pub struct DelimitedReader<'a, M>
+where
+    M: MessageLite + ?Sized,
+{
+    input: *mut ffi::ZeroCopyInputStream,
+    coded: Option<Pin<Box<CodedInputStream<'a>>>>,
+    message: Pin<Box<M>>,
+}
+
+impl<'a, M> DelimitedReader<'a, M>
+where
+    M: MessageLite + ?Sized,
+{
+    /// The position after which the `CodedInputStream` is recreated, to stay
+    /// well clear of its `i32::MAX` total bytes limit on long streams.
+    const RESET_POSITION: usize = 64 << 20;
+
+    /// Creates a `DelimitedReader` that reads records from `input` into
+    /// `message`.
+    pub fn new(
+        input: Pin<&'a mut dyn ZeroCopyInputStream>,
+        message: Pin<Box<M>>,
+    ) -> DelimitedReader<'a, M> {
+        DelimitedReader {
+            input: unsafe { input.upcast_mut_ptr() },
+            coded: None,
+            message,
+        }
+    }
+
+    /// Reads the next record.
+    ///
+    /// Returns `Ok(None)` at a clean end of input, or an error if the input
+    /// ends in the middle of a record or a record cannot be parsed.
+    pub fn read_next(&mut self) -> Result<Option<Pin<&mut M>>, OperationFailedError> {
+        if let Some(coded) = &self.coded {
+            if coded.current_position() >= Self::RESET_POSITION {
+                // Dropping the stream returns any buffered but unread bytes to
+                // the underlying input.
+                self.coded = None;
+            }
+        }
+        let input = self.input;
+        let coded = self.coded.get_or_insert_with(|| {
+            // SAFETY: `input` is borrowed mutably for `'a`, and at most one
+            // `CodedInputStream` over it is alive at a time.
+            unsafe { CodedInputStream::from_ffi_owned(ffi::NewCodedInputStream(input)) }
+        });
+        self.message.as_mut().clear();
+        match self
+            .message
+            .as_mut()
+            .parse_delimited_from_coded_stream(coded.as_mut())?
+        {
+            true => Ok(Some(self.message.as_mut())),
+            false => Ok(None),
+        }
+    }
+
+    /// Consumes the reader, returning the message instance.
+    pub fn into_message(self) -> Pin<Box<M>> {
+        self.message
+    }
+}
+
+/// Writes a sequence of length-delimited messages to a
+/// [`ZeroCopyOutputStream`].
+///
+/// The output can be read back with [`DelimitedReader`]. A single
+/// [`CodedOutputStream`] is used for all records.
+pub struct DelimitedWriter<'a> {
+    coded: Pin<Box<CodedOutputStream<'a>>>,
+}
+
+impl<'a> DelimitedWriter<'a> {
+    /// Creates a `DelimitedWriter` that writes records to `output`.
+    pub fn new(output: Pin<&'a mut dyn ZeroCopyOutputStream>) -> DelimitedWriter<'a> {
+        DelimitedWriter {
+            coded: CodedOutputStream::new(output),
+        }
+    }
+
+    /// Writes `message` as a single length-delimited record.
+    ///
+    /// All required fields must be set.
+    pub fn write<M>(&mut self, message: &M) -> Result<(), OperationFailedError>
+    where
+        M: MessageLite + ?Sized,
+    {
+        message.serialize_delimited_to_coded_stream(self.coded.as_mut())
+    }
+
+    /// Returns any unused buffer space to the underlying stream, so that it
+    /// contains exactly the records written so far.
+    ///
+    /// This happens automatically when the writer is dropped.
+    pub fn flush(&mut self) {
+        self.coded.as_mut().trim()
+    }
+}
@@ -0,0 +1,138 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/json.h"
+
+#include <string>
+
+#include "absl/status/status.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/json/json.h"
+#include "google/protobuf/util/type_resolver_util.h"
+#include "protobuf-native/src/io.h"
+#include "protobuf-native/src/json.rs.h"
+
+namespace protobuf_native {
+namespace json {
+
+using google::protobuf::io::ArrayInputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::json::JsonStringToMessage;
+using google::protobuf::json::MessageToJsonString;
+
+namespace {
+
+google::protobuf::json::PrintOptions ToPrintOptions(const PrintOptions& options) {
+    google::protobuf::json::PrintOptions out;
+    out.add_whitespace = options.add_whitespace;
+    out.always_print_fields_with_no_presence = options.always_print_fields_with_no_presence;
+    out.always_print_enums_as_ints = options.always_print_enums_as_ints;
+    out.preserve_proto_field_names = options.preserve_proto_field_names;
+    out.unquote_int64_if_possible = options.unquote_int64_if_possible;
+    return out;
+}
+
+google::protobuf::json::ParseOptions ToParseOptions(const ParseOptions& options) {
+    google::protobuf::json::ParseOptions out;
+    out.ignore_unknown_fields = options.ignore_unknown_fields;
+    out.case_insensitive_enum_parsing = options.case_insensitive_enum_parsing;
+    return out;
+}
+
+bool CheckStatus(const absl::Status& status, rust::String& error) {
+    if (!status.ok()) {
+        error = rust::String::lossy(std::string(status.message()));
+    }
+    return status.ok();
+}
+
+}  // namespace
+
+TypeResolver* NewTypeResolverForDescriptorPool(absl::string_view url_prefix,
+                                               const DescriptorPool& pool) {
+    return util::NewTypeResolverForDescriptorPool(url_prefix, &pool);
+}
+
+void DeleteTypeResolver(TypeResolver* resolver) { delete resolver; }
+
+bool MessageToJson(const Message& message, const PrintOptions& options, rust::String& output,
+                   rust::String& error) {
+    std::string json;
+    if (!CheckStatus(MessageToJsonString(message, &json, ToPrintOptions(options)), error)) {
+        return false;
+    }
+    output = rust::String::lossy(json);
+    return true;
+}
+
+bool JsonToMessage(absl::string_view input, Message& message, const ParseOptions& options,
+                   rust::String& error) {
+    return CheckStatus(JsonStringToMessage(input, &message, ToParseOptions(options)), error);
+}
+
+// The resolvers created by NewTypeResolverForDescriptorPool have no mutable
+// state, so they may be shared, although their methods are not const.
+
+bool BinaryToJson(const TypeResolver& resolver, absl::string_view type_url,
+                  rust::Slice<const uint8_t> input, const PrintOptions& options,
+                  rust::String& output, rust::String& error) {
+    std::string json;
+    absl::Status status;
+    {
+        ArrayInputStream binary_input(input.data(), input.size());
+        StringOutputStream json_output(&json);
+        status = google::protobuf::json::BinaryToJsonStream(
+            const_cast<TypeResolver*>(&resolver), std::string(type_url), &binary_input,
+            &json_output, ToPrintOptions(options));
+    }
+    if (!CheckStatus(status, error)) {
+        return false;
+    }
+    output = rust::String::lossy(json);
+    return true;
+}
+
+bool JsonToBinary(const TypeResolver& resolver, absl::string_view type_url,
+                  absl::string_view input, const ParseOptions& options,
+                  rust::Vec<uint8_t>& output, rust::String& error) {
+    ArrayInputStream json_input(input.data(), input.size());
+    io::VecOutputStream binary_output(output);
+    absl::Status status =
+        google::protobuf::json::JsonToBinaryStream(const_cast<TypeResolver*>(&resolver),
+                                                   std::string(type_url), &json_input,
+                                                   &binary_output, ToParseOptions(options));
+    return CheckStatus(status, error);
+}
+
+bool BinaryToJsonStream(const TypeResolver& resolver, absl::string_view type_url,
+                        io::ZeroCopyInputStream* input, io::ZeroCopyOutputStream* output,
+                        const PrintOptions& options, rust::String& error) {
+    absl::Status status = google::protobuf::json::BinaryToJsonStream(
+        const_cast<TypeResolver*>(&resolver), std::string(type_url), input, output,
+        ToPrintOptions(options));
+    return CheckStatus(status, error);
+}
+
+bool JsonToBinaryStream(const TypeResolver& resolver, absl::string_view type_url,
+                        io::ZeroCopyInputStream* input, io::ZeroCopyOutputStream* output,
+                        const ParseOptions& options, rust::String& error) {
+    absl::Status status = google::protobuf::json::JsonToBinaryStream(
+        const_cast<TypeResolver*>(&resolver), std::string(type_url), input, output,
+        ToParseOptions(options));
+    return CheckStatus(status, error);
+}
+
+}  // namespace json
+}  // namespace protobuf_native
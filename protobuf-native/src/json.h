@@ -0,0 +1,56 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "absl/strings/string_view.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/util/type_resolver.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace json {
+
+using namespace google::protobuf;
+using google::protobuf::util::TypeResolver;
+
+struct ParseOptions;
+struct PrintOptions;
+
+TypeResolver* NewTypeResolverForDescriptorPool(absl::string_view url_prefix,
+                                               const DescriptorPool& pool);
+void DeleteTypeResolver(TypeResolver* resolver);
+
+bool MessageToJson(const Message& message, const PrintOptions& options, rust::String& output,
+                   rust::String& error);
+bool JsonToMessage(absl::string_view input, Message& message, const ParseOptions& options,
+                   rust::String& error);
+bool BinaryToJson(const TypeResolver& resolver, absl::string_view type_url,
+                  rust::Slice<const uint8_t> input, const PrintOptions& options,
+                  rust::String& output, rust::String& error);
+bool JsonToBinary(const TypeResolver& resolver, absl::string_view type_url,
+                  absl::string_view input, const ParseOptions& options,
+                  rust::Vec<uint8_t>& output, rust::String& error);
+bool BinaryToJsonStream(const TypeResolver& resolver, absl::string_view type_url,
+                        io::ZeroCopyInputStream* input, io::ZeroCopyOutputStream* output,
+                        const PrintOptions& options, rust::String& error);
+bool JsonToBinaryStream(const TypeResolver& resolver, absl::string_view type_url,
+                        io::ZeroCopyInputStream* input, io::ZeroCopyOutputStream* output,
+                        const ParseOptions& options, rust::String& error);
+
+}  // namespace json
+}  // namespace protobuf_native
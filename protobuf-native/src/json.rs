@@ -0,0 +1,360 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Conversion between protocol buffers and JSON.
+//!
+//! Messages are converted according to the [JSON mapping] for protocol
+//! buffers. A message can be printed as or parsed from JSON directly with
+//! [`message_to_json`] and [`json_to_message`]. The wire format of a message
+//! can also be transcoded to and from JSON without parsing it into a message,
+//! with [`binary_to_json`] and [`json_to_binary`], given a [`TypeResolver`]
+//! for the message's type. [`binary_to_json_stream`] and
+//! [`json_to_binary_stream`] do the same between zero-copy streams.
+//!
+//! [JSON mapping]: https://protobuf.dev/programming-guides/proto3/#json
+
+use std::error::Error;
+use std::fmt;
+use std::marker::{PhantomData, PhantomPinned};
+use std::mem;
+use std::pin::Pin;
+
+use crate::internal::unsafe_ffi_conversions;
+use crate::io::{ZeroCopyInputStream, ZeroCopyOutputStream};
+use crate::{private, DescriptorPool, Message};
+
+#[cxx::bridge(namespace = "protobuf_native::json")]
+pub(crate) mod ffi {
+    struct PrintOptions {
+        add_whitespace: bool,
+        always_print_fields_with_no_presence: bool,
+        always_print_enums_as_ints: bool,
+        preserve_proto_field_names: bool,
+        unquote_int64_if_possible: bool,
+    }
+
+    struct ParseOptions {
+        ignore_unknown_fields: bool,
+        case_insensitive_enum_parsing: bool,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/json.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "absl"]
+        type string_view<'a> = crate::internal::StringView<'a>;
+
+        #[namespace = "google::protobuf"]
+        type DescriptorPool = crate::ffi::DescriptorPool;
+
+        #[namespace = "google::protobuf"]
+        type Message = crate::ffi::Message;
+
+        #[namespace = "google::protobuf::io"]
+        type ZeroCopyInputStream = crate::io::ffi::ZeroCopyInputStream;
+
+        #[namespace = "google::protobuf::io"]
+        type ZeroCopyOutputStream = crate::io::ffi::ZeroCopyOutputStream;
+
+        #[namespace = "google::protobuf::util"]
+        type TypeResolver;
+        fn NewTypeResolverForDescriptorPool(
+            url_prefix: string_view,
+            pool: &DescriptorPool,
+        ) -> *mut TypeResolver;
+        unsafe fn DeleteTypeResolver(resolver: *mut TypeResolver);
+
+        fn MessageToJson(
+            message: &Message,
+            options: &PrintOptions,
+            output: &mut String,
+            error: &mut String,
+        ) -> bool;
+        fn JsonToMessage(
+            input: string_view,
+            message: Pin<&mut Message>,
+            options: &ParseOptions,
+            error: &mut String,
+        ) -> bool;
+        fn BinaryToJson(
+            resolver: &TypeResolver,
+            type_url: string_view,
+            input: &[u8],
+            options: &PrintOptions,
+            output: &mut String,
+            error: &mut String,
+        ) -> bool;
+        fn JsonToBinary(
+            resolver: &TypeResolver,
+            type_url: string_view,
+            input: string_view,
+            options: &ParseOptions,
+            output: &mut Vec<u8>,
+            error: &mut String,
+        ) -> bool;
+        unsafe fn BinaryToJsonStream(
+            resolver: &TypeResolver,
+            type_url: string_view,
+            input: *mut ZeroCopyInputStream,
+            output: *mut ZeroCopyOutputStream,
+            options: &PrintOptions,
+            error: &mut String,
+        ) -> bool;
+        unsafe fn JsonToBinaryStream(
+            resolver: &TypeResolver,
+            type_url: string_view,
+            input: *mut ZeroCopyInputStream,
+            output: *mut ZeroCopyOutputStream,
+            options: &ParseOptions,
+            error: &mut String,
+        ) -> bool;
+    }
+}
+
+/// Options that control how messages are printed as JSON.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct PrintOptions {
+    /// Whether to add spaces, line breaks and indentation to make the output
+    /// easy to read.
+    pub add_whitespace: bool,
+    /// Whether to print fields which do not support presence even when they
+    /// would otherwise be omitted, namely implicit presence fields set to
+    /// their zero value, and empty lists and maps.
+    pub always_print_fields_with_no_presence: bool,
+    /// Whether to print enums as integers rather than as strings.
+    pub always_print_enums_as_ints: bool,
+    /// Whether to use the field names from the .proto file rather than their
+    /// lowerCamelCase JSON names.
+    pub preserve_proto_field_names: bool,
+    /// Whether to print int64 values that can be represented exactly as a
+    /// double without quotes.
+    pub unquote_int64_if_possible: bool,
+}
+
+impl From<&PrintOptions> for ffi::PrintOptions {
+    fn from(options: &PrintOptions) -> ffi::PrintOptions {
+        ffi::PrintOptions {
+            add_whitespace: options.add_whitespace,
+            always_print_fields_with_no_presence: options.always_print_fields_with_no_presence,
+            always_print_enums_as_ints: options.always_print_enums_as_ints,
+            preserve_proto_field_names: options.preserve_proto_field_names,
+            unquote_int64_if_possible: options.unquote_int64_if_possible,
+        }
+    }
+}
+
+/// Options that control how JSON is parsed into messages.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct ParseOptions {
+    /// Whether to ignore JSON fields that are not fields of the message,
+    /// rather than failing.
+    pub ignore_unknown_fields: bool,
+    /// Whether to retry parsing an enum value that does not match any value in
+    /// upper case. This option exists only to preserve legacy behavior.
+    pub case_insensitive_enum_parsing: bool,
+}
+
+impl From<&ParseOptions> for ffi::ParseOptions {
+    fn from(options: &ParseOptions) -> ffi::ParseOptions {
+        ffi::ParseOptions {
+            ignore_unknown_fields: options.ignore_unknown_fields,
+            case_insensitive_enum_parsing: options.case_insensitive_enum_parsing,
+        }
+    }
+}
+
+/// Resolves type URLs to the message types of a [`DescriptorPool`], for use
+/// when transcoding between the wire format and JSON.
+///
+/// Creating a type resolver is comparatively expensive, so a single resolver
+/// should be created for each pool and reused for every conversion.
+pub struct TypeResolver<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for TypeResolver<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteTypeResolver(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> TypeResolver<'a> {
+    /// The prefix of the type URLs resolved by [`TypeResolver::new`].
+    pub const DEFAULT_URL_PREFIX: &'static str = "type.googleapis.com";
+
+    /// Creates a resolver for the message types in `pool`, whose type URLs
+    /// are of the form `type.googleapis.com/package.Message`.
+    pub fn new(pool: &'a DescriptorPool) -> Pin<Box<TypeResolver<'a>>> {
+        TypeResolver::with_url_prefix(TypeResolver::DEFAULT_URL_PREFIX, pool)
+    }
+
+    /// Creates a resolver for the message types in `pool`, whose type URLs
+    /// are of the form `{url_prefix}/package.Message`.
+    pub fn with_url_prefix(
+        url_prefix: &str,
+        pool: &'a DescriptorPool,
+    ) -> Pin<Box<TypeResolver<'a>>> {
+        let resolver = ffi::NewTypeResolverForDescriptorPool(url_prefix.into(), pool.as_ffi());
+        unsafe { Self::from_ffi_owned(resolver) }
+    }
+
+    unsafe_ffi_conversions!(ffi::TypeResolver);
+}
+
+/// Prints `message` as JSON.
+pub fn message_to_json(message: &dyn Message, options: &PrintOptions) -> Result<String, JsonError> {
+    let message: &ffi::Message = unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+    let mut output = String::new();
+    let mut error = String::new();
+    match ffi::MessageToJson(message, &options.into(), &mut output, &mut error) {
+        true => Ok(output),
+        false => Err(JsonError(error)),
+    }
+}
+
+/// Parses JSON into `message`.
+///
+/// Fields present in the JSON replace those in `message`.
+pub fn json_to_message(
+    input: &str,
+    message: Pin<&mut dyn Message>,
+    options: &ParseOptions,
+) -> Result<(), JsonError> {
+    let message: Pin<&mut ffi::Message> =
+        unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) };
+    let mut error = String::new();
+    match ffi::JsonToMessage(input.into(), message, &options.into(), &mut error) {
+        true => Ok(()),
+        false => Err(JsonError(error)),
+    }
+}
+
+/// Converts an encoded message of the type identified by `type_url` to JSON.
+pub fn binary_to_json(
+    resolver: &TypeResolver,
+    type_url: &str,
+    input: &[u8],
+    options: &PrintOptions,
+) -> Result<String, JsonError> {
+    let mut output = String::new();
+    let mut error = String::new();
+    match ffi::BinaryToJson(
+        resolver.as_ffi(),
+        type_url.into(),
+        input,
+        &options.into(),
+        &mut output,
+        &mut error,
+    ) {
+        true => Ok(output),
+        false => Err(JsonError(error)),
+    }
+}
+
+/// Converts JSON to an encoded message of the type identified by `type_url`.
+pub fn json_to_binary(
+    resolver: &TypeResolver,
+    type_url: &str,
+    input: &str,
+    options: &ParseOptions,
+) -> Result<Vec<u8>, JsonError> {
+    let mut output = vec![];
+    let mut error = String::new();
+    match ffi::JsonToBinary(
+        resolver.as_ffi(),
+        type_url.into(),
+        input.into(),
+        &options.into(),
+        &mut output,
+        &mut error,
+    ) {
+        true => Ok(output),
+        false => Err(JsonError(error)),
+    }
+}
+
+/// Transcodes an encoded message of the type identified by `type_url` from
+/// `input` to JSON written to `output`.
+///
+/// Unlike [`binary_to_json`], neither the message nor the JSON is held in
+/// memory in its entirety, so this is suitable for large payloads. If an error
+/// occurs, a prefix of the JSON may already have been written to `output`.
+pub fn binary_to_json_stream(
+    resolver: &TypeResolver,
+    type_url: &str,
+    input: Pin<&mut dyn ZeroCopyInputStream>,
+    output: Pin<&mut dyn ZeroCopyOutputStream>,
+    options: &PrintOptions,
+) -> Result<(), JsonError> {
+    let mut error = String::new();
+    let ok = unsafe {
+        ffi::BinaryToJsonStream(
+            resolver.as_ffi(),
+            type_url.into(),
+            input.upcast_mut_ptr(),
+            output.upcast_mut_ptr(),
+            &options.into(),
+            &mut error,
+        )
+    };
+    match ok {
+        true => Ok(()),
+        false => Err(JsonError(error)),
+    }
+}
+
+/// Transcodes JSON read from `input` to an encoded message of the type
+/// identified by `type_url` written to `output`.
+///
+/// Unlike [`json_to_binary`], neither the JSON nor the message is held in
+/// memory in its entirety, so this is suitable for large payloads. If an error
+/// occurs, a prefix of the message may already have been written to `output`.
+pub fn json_to_binary_stream(
+    resolver: &TypeResolver,
+    type_url: &str,
+    input: Pin<&mut dyn ZeroCopyInputStream>,
+    output: Pin<&mut dyn ZeroCopyOutputStream>,
+    options: &ParseOptions,
+) -> Result<(), JsonError> {
+    let mut error = String::new();
+    let ok = unsafe {
+        ffi::JsonToBinaryStream(
+            resolver.as_ffi(),
+            type_url.into(),
+            input.upcast_mut_ptr(),
+            output.upcast_mut_ptr(),
+            &options.into(),
+            &mut error,
+        )
+    };
+    match ok {
+        true => Ok(()),
+        false => Err(JsonError(error)),
+    }
+}
+
+/// An error that occurred while converting between protocol buffers and JSON.
+#[derive(Debug, Clone, Eq, PartialEq, Hash)]
+pub struct JsonError(pub(crate) String);
+
+impl fmt::Display for JsonError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.write_str(&self.0)
+    }
+}
+
+impl Error for JsonError {}
@@ -15,30 +15,2167 @@
 
 #include "protobuf-native/src/lib.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <deque>
+#include <typeinfo>
+
+#include "absl/base/attributes.h"
+#include "absl/base/internal/endian.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/log/absl_check.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/util/field_mask_util.h"
+#include "google/protobuf/wire_format.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "protobuf-native/src/internal.rs.h"
+#include "protobuf-native/src/lib.rs.h"
+
 using namespace google::protobuf;
 
 namespace protobuf_native {
 
+// A field mask compiled against a message type. Fields mapped to null are
+// retained in their entirety; fields mapped to a subtree are retained only in
+// part.
+struct FieldMaskTree {
+    absl::flat_hash_map<int, std::unique_ptr<FieldMaskTree>> fields;
+};
+
+namespace {
+
+using google::protobuf::internal::InternalFeatureHelper;
+using google::protobuf::internal::WireFormat;
+using google::protobuf::internal::WireFormatLite;
+namespace cpp = google::protobuf::internal::cpp;
+
+// The databases backing the pools created by NewDescriptorPoolWithDatabase,
+// which must outlive their pools. DescriptorPool does not take ownership of
+// its database, and cannot be subclassed to do so, as its destructor is not
+// virtual.
+absl::Mutex pool_databases_mutex(absl::kConstInit);
+absl::flat_hash_map<const DescriptorPool*, std::unique_ptr<RustDescriptorDatabase>>&
+PoolDatabases() {
+    static auto* databases =
+        new absl::flat_hash_map<const DescriptorPool*, std::unique_ptr<RustDescriptorDatabase>>();
+    return *databases;
+}
+
+// The underlays of the pools created by NewDescriptorPoolWithUnderlay, which
+// DescriptorPool does not expose.
+absl::Mutex pool_underlays_mutex(absl::kConstInit);
+absl::flat_hash_map<const DescriptorPool*, const DescriptorPool*>& PoolUnderlays() {
+    static auto* underlays =
+        new absl::flat_hash_map<const DescriptorPool*, const DescriptorPool*>();
+    return *underlays;
+}
+
+// Reports whether the underlay of `pool`, if any, contains a file named like
+// `file`, which then need not be built in `pool` itself.
+bool UnderlayProvidesFile(const DescriptorPool& pool, const FileDescriptorProto& file) {
+    const DescriptorPool* underlay;
+    {
+        absl::MutexLock lock(&pool_underlays_mutex);
+        auto it = PoolUnderlays().find(&pool);
+        if (it == PoolUnderlays().end()) {
+            return false;
+        }
+        underlay = it->second;
+    }
+    return underlay->FindFileByName(file.name()) != nullptr;
+}
+
+// Returns the compiled form of the mask for the message type, or null if
+// the mask contains a path that is invalid for the message type.
+//
+// Compiled masks are cached for the life of the process, keyed by the message
+// type and the paths in the mask, so that the paths are resolved to field
+// numbers only once.
+const FieldMaskTree* CompileFieldMask(const Descriptor* descriptor, const FieldMask& mask) {
+    ABSL_CONST_INIT static absl::Mutex mutex(absl::kConstInit);
+    static auto* cache =
+        new absl::flat_hash_map<std::pair<const Descriptor*, std::string>,
+                                std::unique_ptr<const FieldMaskTree>>();
+
+    // The full name guards against a stale entry for a descriptor that has
+    // since been freed and whose address has been reused.
+    std::string paths = descriptor->full_name() + ":" + util::FieldMaskUtil::ToString(mask);
+    absl::MutexLock lock(&mutex);
+    auto it = cache->find(std::make_pair(descriptor, paths));
+    if (it != cache->end()) {
+        return it->second.get();
+    }
+
+    FieldMask canonical;
+    util::FieldMaskUtil::ToCanonicalForm(mask, &canonical);
+    auto tree = std::make_unique<FieldMaskTree>();
+    std::vector<const FieldDescriptor*> fields;
+    for (const std::string& path : canonical.paths()) {
+        if (!util::FieldMaskUtil::GetFieldDescriptors(descriptor, path, &fields)) {
+            return nullptr;
+        }
+        FieldMaskTree* node = tree.get();
+        for (size_t i = 0; i + 1 < fields.size(); ++i) {
+            std::unique_ptr<FieldMaskTree>& child = node->fields[fields[i]->number()];
+            if (child == nullptr) {
+                child = std::make_unique<FieldMaskTree>();
+            }
+            node = child.get();
+        }
+        node->fields[fields.back()->number()] = nullptr;
+    }
+    const FieldMaskTree* compiled = tree.get();
+    cache->emplace(std::make_pair(descriptor, std::move(paths)), std::move(tree));
+    return compiled;
+}
+
+void AppendVarint32(std::string& output, uint32_t value) {
+    uint8_t buffer[5];
+    uint8_t* end = io::CodedOutputStream::WriteVarint32ToArray(value, buffer);
+    output.append(reinterpret_cast<const char*>(buffer), end - buffer);
+}
+
+// Copies the fields of the message in `input` that are selected by `tree` to
+// `output`, in wire format. Fields that are not selected are skipped without
+// being decoded.
+bool FilterMessage(io::CodedInputStream& input, const uint8_t* data, const FieldMaskTree& tree,
+                   int end_group, std::string& output) {
+    while (true) {
+        int start = input.CurrentPosition();
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return end_group == 0 && input.ConsumedEntireMessage();
+        }
+        int number = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType wire_type = WireFormatLite::GetTagWireType(tag);
+        if (wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+            return end_group != 0 && number == end_group;
+        }
+
+        auto it = tree.fields.find(number);
+        if (it == tree.fields.end() || it->second == nullptr) {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+            if (it != tree.fields.end()) {
+                output.append(reinterpret_cast<const char*>(data) + start,
+                              input.CurrentPosition() - start);
+            }
+        } else if (wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            int length;
+            if (!input.ReadVarintSizeAsInt(&length)) {
+                return false;
+            }
+            std::pair<io::CodedInputStream::Limit, int> limit =
+                input.IncrementRecursionDepthAndPushLimit(length);
+            std::string submessage;
+            if (limit.second < 0 || !FilterMessage(input, data, *it->second, 0, submessage) ||
+                !input.DecrementRecursionDepthAndPopLimit(limit.first)) {
+                return false;
+            }
+            AppendVarint32(output, tag);
+            AppendVarint32(output, submessage.size());
+            output.append(submessage);
+        } else if (wire_type == WireFormatLite::WIRETYPE_START_GROUP) {
+            AppendVarint32(output, tag);
+            if (!input.IncrementRecursionDepth() ||
+                !FilterMessage(input, data, *it->second, number, output)) {
+                return false;
+            }
+            input.DecrementRecursionDepth();
+            AppendVarint32(output,
+                           WireFormatLite::MakeTag(number, WireFormatLite::WIRETYPE_END_GROUP));
+        } else if (!WireFormatLite::SkipField(&input, tag)) {
+            // A scalar with the number of a message field is an unknown field,
+            // which is discarded like any other field outside the mask.
+            return false;
+        }
+    }
+}
+
+bool MergeFromBytesWithTree(Message& message, rust::Slice<const uint8_t> data,
+                            const FieldMaskTree& tree) {
+    if (data.size() > INT_MAX) {
+        return false;
+    }
+    io::CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    std::string filtered;
+    if (!FilterMessage(input, data.data(), tree, 0, filtered)) {
+        return false;
+    }
+    // Required fields outside the mask are necessarily missing, so the
+    // result is not checked for initialization.
+    io::CodedInputStream filtered_input(reinterpret_cast<const uint8_t*>(filtered.data()),
+                                        static_cast<int>(filtered.size()));
+    return message.MergePartialFromCodedStream(&filtered_input) &&
+           filtered_input.ConsumedEntireMessage();
+}
+
+// Copies the fields of the message of type `descriptor` in `input` to
+// `output`, in wire format, without decoding them. Fields with numbers that
+// are neither declared by the type nor in one of its extension ranges are
+// unknown fields. If `unknown` is null, they are discarded, including those of
+// submessages. Otherwise they are appended to `unknown`, and submessages are
+// copied as is, unknown fields and all.
+bool FilterUnknownFields(io::CodedInputStream& input, const uint8_t* data,
+                         const Descriptor& descriptor, int end_group, std::string& output,
+                         std::string* unknown) {
+    while (true) {
+        int start = input.CurrentPosition();
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return end_group == 0 && input.ConsumedEntireMessage();
+        }
+        int number = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType wire_type = WireFormatLite::GetTagWireType(tag);
+        if (wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+            return end_group != 0 && number == end_group;
+        }
+
+        const FieldDescriptor* field = descriptor.FindFieldByNumber(number);
+        bool recurse = unknown == nullptr && field != nullptr;
+        if (recurse && field->type() == FieldDescriptor::TYPE_MESSAGE &&
+            wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            int length;
+            if (!input.ReadVarintSizeAsInt(&length)) {
+                return false;
+            }
+            std::pair<io::CodedInputStream::Limit, int> limit =
+                input.IncrementRecursionDepthAndPushLimit(length);
+            std::string submessage;
+            if (limit.second < 0 ||
+                !FilterUnknownFields(input, data, *field->message_type(), 0, submessage,
+                                     nullptr) ||
+                !input.DecrementRecursionDepthAndPopLimit(limit.first)) {
+                return false;
+            }
+            AppendVarint32(output, tag);
+            AppendVarint32(output, submessage.size());
+            output.append(submessage);
+        } else if (recurse && field->type() == FieldDescriptor::TYPE_GROUP &&
+                   wire_type == WireFormatLite::WIRETYPE_START_GROUP) {
+            AppendVarint32(output, tag);
+            if (!input.IncrementRecursionDepth() ||
+                !FilterUnknownFields(input, data, *field->message_type(), number, output,
+                                     nullptr)) {
+                return false;
+            }
+            input.DecrementRecursionDepth();
+            AppendVarint32(output,
+                           WireFormatLite::MakeTag(number, WireFormatLite::WIRETYPE_END_GROUP));
+        } else {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+            std::string* target =
+                field != nullptr || descriptor.IsExtensionNumber(number) ? &output : unknown;
+            if (target != nullptr) {
+                target->append(reinterpret_cast<const char*>(data) + start,
+                               input.CurrentPosition() - start);
+            }
+        }
+    }
+}
+
+bool MergeFromBytesFilteringUnknownFields(Message& message, rust::Slice<const uint8_t> data,
+                                          std::string* unknown) {
+    if (data.size() > INT_MAX) {
+        return false;
+    }
+    io::CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    std::string filtered;
+    if (!FilterUnknownFields(input, data.data(), *message.GetDescriptor(), 0, filtered,
+                             unknown)) {
+        return false;
+    }
+    return message.MergeFromString(filtered);
+}
+
+// Merges the fields of `source` that are selected by `tree` into
+// `destination`, with the semantics of FieldMaskUtil::MergeMessageTo.
+void MergeMessageWithTree(const Message& source, const FieldMaskTree& tree,
+                          bool replace_message_fields, bool replace_repeated_fields,
+                          Message& destination) {
+    const Descriptor* descriptor = source.GetDescriptor();
+    const Reflection* source_reflection = source.GetReflection();
+    const Reflection* destination_reflection = destination.GetReflection();
+    for (const auto& entry : tree.fields) {
+        const FieldDescriptor* field = descriptor->FindFieldByNumber(entry.first);
+        if (entry.second != nullptr) {
+            // Only singular message fields have subtrees.
+            MergeMessageWithTree(source_reflection->GetMessage(source, field), *entry.second,
+                                 replace_message_fields, replace_repeated_fields,
+                                 *destination_reflection->MutableMessage(&destination, field));
+        } else if (field->is_repeated()) {
+            if (replace_repeated_fields) {
+                destination_reflection->ClearField(&destination, field);
+            }
+            int size = source_reflection->FieldSize(source, field);
+            for (int i = 0; i < size; ++i) {
+                switch (field->cpp_type()) {
+#define COPY_REPEATED_VALUE(TYPE, Name)                                                           \
+    case FieldDescriptor::CPPTYPE_##TYPE:                                                         \
+        destination_reflection->Add##Name(&destination, field,                                    \
+                                          source_reflection->GetRepeated##Name(source, field, i)); \
+        break;
+                    COPY_REPEATED_VALUE(BOOL, Bool)
+                    COPY_REPEATED_VALUE(INT32, Int32)
+                    COPY_REPEATED_VALUE(INT64, Int64)
+                    COPY_REPEATED_VALUE(UINT32, UInt32)
+                    COPY_REPEATED_VALUE(UINT64, UInt64)
+                    COPY_REPEATED_VALUE(FLOAT, Float)
+                    COPY_REPEATED_VALUE(DOUBLE, Double)
+                    COPY_REPEATED_VALUE(ENUM, Enum)
+                    COPY_REPEATED_VALUE(STRING, String)
+#undef COPY_REPEATED_VALUE
+                    case FieldDescriptor::CPPTYPE_MESSAGE:
+                        destination_reflection->AddMessage(&destination, field)
+                            ->MergeFrom(source_reflection->GetRepeatedMessage(source, field, i));
+                        break;
+                }
+            }
+        } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+            if (replace_message_fields) {
+                destination_reflection->ClearField(&destination, field);
+            }
+            if (source_reflection->HasField(source, field)) {
+                destination_reflection->MutableMessage(&destination, field)
+                    ->MergeFrom(source_reflection->GetMessage(source, field));
+            }
+        } else if (!source_reflection->HasField(source, field)) {
+            destination_reflection->ClearField(&destination, field);
+        } else {
+            switch (field->cpp_type()) {
+#define COPY_VALUE(TYPE, Name)                                                        \
+    case FieldDescriptor::CPPTYPE_##TYPE:                                             \
+        destination_reflection->Set##Name(&destination, field,                        \
+                                          source_reflection->Get##Name(source, field)); \
+        break;
+                COPY_VALUE(BOOL, Bool)
+                COPY_VALUE(INT32, Int32)
+                COPY_VALUE(INT64, Int64)
+                COPY_VALUE(UINT32, UInt32)
+                COPY_VALUE(UINT64, UInt64)
+                COPY_VALUE(FLOAT, Float)
+                COPY_VALUE(DOUBLE, Double)
+                COPY_VALUE(ENUM, Enum)
+                COPY_VALUE(STRING, String)
+#undef COPY_VALUE
+                case FieldDescriptor::CPPTYPE_MESSAGE:
+                    break;
+            }
+        }
+    }
+}
+
+// Clears the fields of `message` that are not selected by `tree`, with the
+// semantics of FieldMaskUtil::TrimMessage. Returns whether any field was
+// cleared.
+bool TrimMessageWithTree(const FieldMaskTree& tree, Message& message) {
+    const Descriptor* descriptor = message.GetDescriptor();
+    const Reflection* reflection = message.GetReflection();
+    bool modified = false;
+    for (int i = 0; i < descriptor->field_count(); ++i) {
+        const FieldDescriptor* field = descriptor->field(i);
+        auto it = tree.fields.find(field->number());
+        if (it == tree.fields.end()) {
+            modified |= field->is_repeated() ? reflection->FieldSize(message, field) != 0
+                                             : reflection->HasField(message, field);
+            reflection->ClearField(&message, field);
+        } else if (it->second != nullptr && reflection->HasField(message, field)) {
+            modified |=
+                TrimMessageWithTree(*it->second, *reflection->MutableMessage(&message, field));
+        }
+    }
+    return modified;
+}
+
+}  // namespace
+
+Arena* NewArena() { return new Arena(); }
+
+Arena* NewArenaWithOptions(size_t start_block_size, size_t max_block_size, uint8_t* initial_block,
+                           size_t initial_block_size, void* block_alloc, void* block_dealloc) {
+    ArenaOptions options;
+    options.start_block_size = start_block_size;
+    options.max_block_size = max_block_size;
+    options.initial_block = reinterpret_cast<char*>(initial_block);
+    options.initial_block_size = initial_block_size;
+    options.block_alloc = reinterpret_cast<void* (*)(size_t)>(block_alloc);
+    options.block_dealloc = reinterpret_cast<void (*)(void*, size_t)>(block_dealloc);
+    return new Arena(options);
+}
+
+size_t ArenaOptionsDefaultStartBlockSize() { return ArenaOptions().start_block_size; }
+
+size_t ArenaOptionsDefaultMaxBlockSize() { return ArenaOptions().max_block_size; }
+
+void DeleteArena(Arena* arena) { delete arena; }
+
 MessageLite* NewMessageLite(const MessageLite& message) { return message.New(); }
 
+MessageLite* NewMessageLiteInArena(const MessageLite& message, Arena* arena) {
+    return message.New(arena);
+}
+
 void DeleteMessageLite(MessageLite* message) { delete message; }
 
+Message* NewMessage(const Message& message) { return message.New(); }
+
+Message* NewMessageInArena(const Message& message, Arena* arena) { return message.New(arena); }
+
+void DeleteMessage(Message* message) { delete message; }
+
+bool MessageMergeFromBytesWithMask(Message& message, rust::Slice<const uint8_t> data,
+                                   const FieldMask& mask) {
+    const FieldMaskTree* tree = CompileFieldMask(message.GetDescriptor(), mask);
+    return tree != nullptr && MergeFromBytesWithTree(message, data, *tree);
+}
+
+rust::Slice<const uint8_t> MessageGetStringField(const Message& message,
+                                                 const FieldDescriptor& field, int index,
+                                                 bool& ok) {
+    // The value of a cord field is only available as a copy.
+    ok = field.containing_type() == message.GetDescriptor() &&
+         field.cpp_type() == FieldDescriptor::CPPTYPE_STRING &&
+         cpp::EffectiveStringCType(&field) != FieldOptions::CORD;
+    if (!ok) {
+        return {};
+    }
+    const Reflection* reflection = message.GetReflection();
+    const std::string* value;
+    if (!field.is_repeated()) {
+        value = &reflection->GetStringReference(message, &field, nullptr);
+    } else if (index >= 0 && index < reflection->FieldSize(message, &field)) {
+        value = &reflection->GetRepeatedStringReference(message, &field, index, nullptr);
+    } else {
+        ok = false;
+        return {};
+    }
+    return {reinterpret_cast<const uint8_t*>(value->data()), value->size()};
+}
+
+namespace {
+
+// `GetRepeatedField` and friends are deprecated in favor of
+// `RepeatedFieldRef`, which only offers access to one element at a time.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// Returns the storage of a repeated scalar field of `message`, through
+// `mutable_message` if it is set, in which case it must be `message`.
+template <typename T>
+ScalarArray RepeatedFieldArray(const Message& message, Message* mutable_message,
+                               const FieldDescriptor& field) {
+    const Reflection* reflection = message.GetReflection();
+    if (mutable_message != nullptr) {
+        RepeatedField<T>* values = reflection->MutableRepeatedField<T>(mutable_message, &field);
+        return ScalarArray{values->mutable_data(), static_cast<size_t>(values->size())};
+    }
+    const RepeatedField<T>& values = reflection->GetRepeatedField<T>(message, &field);
+    return ScalarArray{const_cast<T*>(values.data()), static_cast<size_t>(values.size())};
+}
+
+const RepeatedPtrField<std::string>& RepeatedStringField(const Message& message,
+                                                         const FieldDescriptor& field) {
+    return message.GetReflection()->GetRepeatedPtrField<std::string>(message, &field);
+}
+
+const RepeatedPtrField<Message>& RepeatedMessageField(const Message& message,
+                                                     const FieldDescriptor& field) {
+    return message.GetReflection()->GetRepeatedPtrField<Message>(message, &field);
+}
+
+#pragma GCC diagnostic pop
+
+ScalarArray RepeatedScalarField(const Message& message, Message* mutable_message,
+                                const FieldDescriptor& field, bool& ok) {
+    ok = field.containing_type() == message.GetDescriptor() && field.is_repeated();
+    if (!ok) {
+        return {};
+    }
+    switch (field.cpp_type()) {
+        case FieldDescriptor::CPPTYPE_INT32:
+        case FieldDescriptor::CPPTYPE_ENUM:
+            // Enums are stored as `int`s, which reflection lets us access as
+            // `int32_t`s.
+            return RepeatedFieldArray<int32_t>(message, mutable_message, field);
+        case FieldDescriptor::CPPTYPE_INT64:
+            return RepeatedFieldArray<int64_t>(message, mutable_message, field);
+        case FieldDescriptor::CPPTYPE_UINT32:
+            return RepeatedFieldArray<uint32_t>(message, mutable_message, field);
+        case FieldDescriptor::CPPTYPE_UINT64:
+            return RepeatedFieldArray<uint64_t>(message, mutable_message, field);
+        case FieldDescriptor::CPPTYPE_FLOAT:
+            return RepeatedFieldArray<float>(message, mutable_message, field);
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+            return RepeatedFieldArray<double>(message, mutable_message, field);
+        case FieldDescriptor::CPPTYPE_BOOL:
+            return RepeatedFieldArray<bool>(message, mutable_message, field);
+        default:
+            ok = false;
+            return {};
+    }
+}
+
+}  // namespace
+
+ScalarArray MessageGetRepeatedScalarField(const Message& message, const FieldDescriptor& field,
+                                          bool& ok) {
+    return RepeatedScalarField(message, nullptr, field, ok);
+}
+
+ScalarArray MessageMutableRepeatedScalarField(Message& message, const FieldDescriptor& field,
+                                              bool& ok) {
+    return RepeatedScalarField(message, &message, field, ok);
+}
+
+PointerArray MessageGetRepeatedStringField(const Message& message, const FieldDescriptor& field,
+                                           bool& ok) {
+    // As in `MessageGetStringField`, a cord field is not stored as
+    // `std::string`s.
+    ok = field.containing_type() == message.GetDescriptor() && field.is_repeated() &&
+         field.cpp_type() == FieldDescriptor::CPPTYPE_STRING &&
+         cpp::EffectiveStringCType(&field) != FieldOptions::CORD;
+    if (!ok) {
+        return {};
+    }
+    const RepeatedPtrField<std::string>& values = RepeatedStringField(message, field);
+    return PointerArray{values.data(), static_cast<size_t>(values.size())};
+}
+
+struct FieldWalker {
+    std::vector<const FieldDescriptor*> fields;
+    std::vector<VisitedField> visited;
+    // Copies of the values of cord fields, which are not stored as
+    // `std::string`s, and the pointer arrays of repeated cord fields.
+    std::deque<std::string> strings;
+    std::deque<std::vector<const std::string*>> string_pointers;
+};
+
+FieldWalker* NewFieldWalker() { return new FieldWalker(); }
+
+void DeleteFieldWalker(FieldWalker* walker) { delete walker; }
+
+rust::Slice<const VisitedField> FieldWalkerWalk(FieldWalker& walker, const Message& message) {
+    walker.fields.clear();
+    walker.visited.clear();
+    walker.strings.clear();
+    walker.string_pointers.clear();
+    const Reflection* reflection = message.GetReflection();
+    // `ListFields` finds the set fields from the message's has-bits, without
+    // inspecting the fields that have them.
+    reflection->ListFields(message, &walker.fields);
+    for (const FieldDescriptor* field : walker.fields) {
+        VisitedField visited{field, 0, nullptr, 0};
+        bool cord = field->cpp_type() == FieldDescriptor::CPPTYPE_STRING &&
+                    cpp::EffectiveStringCType(field) == FieldOptions::CORD;
+        if (field->is_repeated()) {
+            switch (field->cpp_type()) {
+                case FieldDescriptor::CPPTYPE_STRING: {
+                    if (cord) {
+                        walker.string_pointers.emplace_back();
+                        std::vector<const std::string*>& pointers = walker.string_pointers.back();
+                        int size = reflection->FieldSize(message, field);
+                        for (int i = 0; i < size; ++i) {
+                            walker.strings.push_back(
+                                reflection->GetRepeatedString(message, field, i));
+                            pointers.push_back(&walker.strings.back());
+                        }
+                        visited.data = pointers.data();
+                        visited.len = pointers.size();
+                    } else {
+                        const RepeatedPtrField<std::string>& values =
+                            RepeatedStringField(message, *field);
+                        visited.data = values.data();
+                        visited.len = values.size();
+                    }
+                    break;
+                }
+                case FieldDescriptor::CPPTYPE_MESSAGE: {
+                    const RepeatedPtrField<Message>& values = RepeatedMessageField(message, *field);
+                    visited.data = values.data();
+                    visited.len = values.size();
+                    break;
+                }
+                default: {
+                    bool ok;
+                    ScalarArray array = RepeatedScalarField(message, nullptr, *field, ok);
+                    visited.data = array.data;
+                    visited.len = array.len;
+                    break;
+                }
+            }
+        } else {
+            switch (field->cpp_type()) {
+                case FieldDescriptor::CPPTYPE_INT32:
+                    visited.bits = static_cast<uint32_t>(reflection->GetInt32(message, field));
+                    break;
+                case FieldDescriptor::CPPTYPE_INT64:
+                    visited.bits = static_cast<uint64_t>(reflection->GetInt64(message, field));
+                    break;
+                case FieldDescriptor::CPPTYPE_UINT32:
+                    visited.bits = reflection->GetUInt32(message, field);
+                    break;
+                case FieldDescriptor::CPPTYPE_UINT64:
+                    visited.bits = reflection->GetUInt64(message, field);
+                    break;
+                case FieldDescriptor::CPPTYPE_DOUBLE: {
+                    double value = reflection->GetDouble(message, field);
+                    std::memcpy(&visited.bits, &value, sizeof(value));
+                    break;
+                }
+                case FieldDescriptor::CPPTYPE_FLOAT: {
+                    float value = reflection->GetFloat(message, field);
+                    uint32_t bits;
+                    std::memcpy(&bits, &value, sizeof(value));
+                    visited.bits = bits;
+                    break;
+                }
+                case FieldDescriptor::CPPTYPE_BOOL:
+                    visited.bits = reflection->GetBool(message, field);
+                    break;
+                case FieldDescriptor::CPPTYPE_ENUM:
+                    visited.bits =
+                        static_cast<uint32_t>(reflection->GetEnumValue(message, field));
+                    break;
+                case FieldDescriptor::CPPTYPE_STRING: {
+                    std::string* scratch = nullptr;
+                    if (cord) {
+                        walker.strings.emplace_back();
+                        scratch = &walker.strings.back();
+                    }
+                    const std::string& value =
+                        reflection->GetStringReference(message, field, scratch);
+                    visited.data = value.data();
+                    visited.len = value.size();
+                    break;
+                }
+                case FieldDescriptor::CPPTYPE_MESSAGE:
+                    visited.data = &reflection->GetMessage(message, field);
+                    break;
+            }
+        }
+        walker.visited.push_back(visited);
+    }
+    return {walker.visited.data(), walker.visited.size()};
+}
+
+bool MessageMergeFromBytesAliasing(Message& message, rust::Slice<const uint8_t> data,
+                                   rust::Slice<const int32_t> numbers,
+                                   rust::Vec<AliasedRange>& output) {
+    for (int32_t number : numbers) {
+        const FieldDescriptor* field = message.GetDescriptor()->FindFieldByNumber(number);
+        if (field == nullptr || field->type() != FieldDescriptor::TYPE_BYTES) {
+            return false;
+        }
+    }
+    if (data.size() > INT_MAX) {
+        return false;
+    }
+
+    // The input is split into runs of fields around the aliased values. Each
+    // run is merged into the message as is, so nothing but the aliased values
+    // is decoded twice, and they are not copied at all.
+    io::CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    int run_start = 0;
+    auto merge_run = [&](int run_end) {
+        io::CodedInputStream run(data.data() + run_start, run_end - run_start);
+        return message.MergePartialFromCodedStream(&run) && run.ConsumedEntireMessage();
+    };
+    while (true) {
+        int start = input.CurrentPosition();
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            if (!input.ConsumedEntireMessage() || !merge_run(start)) {
+                return false;
+            }
+            break;
+        }
+        int number = WireFormatLite::GetTagFieldNumber(tag);
+        if (WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED &&
+            std::find(numbers.begin(), numbers.end(), number) != numbers.end()) {
+            int length;
+            if (!input.ReadVarintSizeAsInt(&length)) {
+                return false;
+            }
+            int offset = input.CurrentPosition();
+            if (!input.Skip(length) || !merge_run(start)) {
+                return false;
+            }
+            run_start = input.CurrentPosition();
+            output.push_back(AliasedRange{
+                .number = number,
+                .offset = static_cast<size_t>(offset),
+                .len = static_cast<size_t>(length),
+            });
+        } else if (!WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+    }
+    return message.IsInitialized();
+}
+
+bool MessageMergeFromBytesDiscardingUnknownFields(Message& message,
+                                                  rust::Slice<const uint8_t> data) {
+    return MergeFromBytesFilteringUnknownFields(message, data, nullptr);
+}
+
+bool MessageMergeFromBytesWithRawUnknownFields(Message& message, rust::Slice<const uint8_t> data,
+                                               rust::Vec<uint8_t>& unknown) {
+    std::string fields;
+    if (!MergeFromBytesFilteringUnknownFields(message, data, &fields)) {
+        return false;
+    }
+    size_t old_size = unknown.size();
+    unknown.reserve(old_size + fields.size());
+    memcpy(unknown.data() + old_size, fields.data(), fields.size());
+    vec_u8_set_len(unknown, old_size + fields.size());
+    return true;
+}
+
+namespace {
+
+bool IsRepeatedMessageField(const Message& message, const FieldDescriptor& field) {
+    const Descriptor* descriptor = message.GetDescriptor();
+    return field.containing_type() == descriptor && field.is_repeated() &&
+           field.type() == FieldDescriptor::TYPE_MESSAGE &&
+           !descriptor->options().message_set_wire_format();
+}
+
+}  // namespace
+
+bool MessageRepeatedMessageFieldSize(const Message& message, const FieldDescriptor& field,
+                                     size_t& size) {
+    if (!IsRepeatedMessageField(message, field)) {
+        return false;
+    }
+    size = message.GetReflection()->FieldSize(message, &field);
+    return true;
+}
+
+bool MessageRepeatedMessageSizes(const Message& message, const FieldDescriptor& field, int begin,
+                                 rust::Slice<size_t> sizes) {
+    const Reflection* reflection = message.GetReflection();
+    size_t tag_size = io::CodedOutputStream::VarintSize32(
+        WireFormatLite::MakeTag(field.number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED));
+    for (size_t i = 0; i < sizes.size(); i++) {
+        const Message& element =
+            reflection->GetRepeatedMessage(message, &field, begin + static_cast<int>(i));
+        // Caches the size of the element, and of its submessages, for
+        // `MessageSerializeRepeatedMessages`.
+        size_t size = element.ByteSizeLong();
+        if (size > INT_MAX) {
+            return false;
+        }
+        sizes[i] = tag_size + io::CodedOutputStream::VarintSize32(static_cast<uint32_t>(size)) +
+                   size;
+        if (sizes[i] > INT_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MessageSerializeRepeatedMessages(const Message& message, const FieldDescriptor& field,
+                                      int begin, int count, bool deterministic, uint8_t* target,
+                                      size_t size) {
+    const Reflection* reflection = message.GetReflection();
+    uint32_t tag =
+        WireFormatLite::MakeTag(field.number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+    io::ArrayOutputStream stream(target, static_cast<int>(size));
+    io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(deterministic);
+    for (int i = begin; i < begin + count; i++) {
+        const Message& element = reflection->GetRepeatedMessage(message, &field, i);
+        coded.WriteTag(tag);
+        coded.WriteVarint32(static_cast<uint32_t>(element.GetCachedSize()));
+        element.SerializeWithCachedSizes(&coded);
+    }
+    coded.Trim();
+    return !coded.HadError() && static_cast<size_t>(coded.ByteCount()) == size;
+}
+
+bool MessageAppendFieldsExceptToVec(const Message& message, const FieldDescriptor& excluded,
+                                    bool deterministic, rust::Vec<uint8_t>& output) {
+    const Reflection* reflection = message.GetReflection();
+    std::vector<const FieldDescriptor*> fields;
+    reflection->ListFields(message, &fields);
+    fields.erase(std::remove(fields.begin(), fields.end(), &excluded), fields.end());
+    const UnknownFieldSet& unknown_fields = reflection->GetUnknownFields(message);
+    size_t byte_size = WireFormat::ComputeUnknownFieldsSize(unknown_fields);
+    for (const FieldDescriptor* field : fields) {
+        byte_size += WireFormat::FieldByteSize(field, message);
+    }
+    if (byte_size > INT_MAX) {
+        return false;
+    }
+    size_t old_size = output.size();
+    output.reserve(old_size + byte_size);
+    io::ArrayOutputStream stream(output.data() + old_size, static_cast<int>(byte_size));
+    io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(deterministic);
+    for (const FieldDescriptor* field : fields) {
+        WireFormat::SerializeFieldWithCachedSizes(field, message, &coded);
+    }
+    WireFormat::SerializeUnknownFields(unknown_fields, &coded);
+    coded.Trim();
+    if (coded.HadError() || static_cast<size_t>(coded.ByteCount()) != byte_size) {
+        return false;
+    }
+    vec_u8_set_len(output, old_size + byte_size);
+    return true;
+}
+
+namespace {
+
+// Appends `size` bytes to `output` by calling `serialize` with a stream over
+// its spare capacity.
+template <typename F>
+bool AppendSerialized(rust::Vec<uint8_t>& output, size_t size, bool deterministic, F serialize) {
+    if (size == 0) {
+        return true;
+    }
+    if (size > INT_MAX) {
+        return false;
+    }
+    size_t old_size = output.size();
+    output.reserve(old_size + size);
+    io::ArrayOutputStream stream(output.data() + old_size, static_cast<int>(size));
+    io::CodedOutputStream coded(&stream);
+    coded.SetSerializationDeterministic(deterministic);
+    serialize(coded);
+    coded.Trim();
+    if (coded.HadError() || static_cast<size_t>(coded.ByteCount()) != size) {
+        return false;
+    }
+    vec_u8_set_len(output, old_size + size);
+    return true;
+}
+
+}  // namespace
+
+ChunkedSerializer::ChunkedSerializer(const Message& message, bool deterministic)
+    : message(message), deterministic(deterministic) {
+    message.GetReflection()->ListFields(message, &fields);
+}
+
+ChunkedSerializer* NewChunkedSerializer(const Message& message, bool deterministic) {
+    if (!message.IsInitialized()) {
+        return nullptr;
+    }
+    // Caches the sizes of the message's submessages, which the elements of
+    // repeated message fields are encoded with.
+    message.ByteSizeLong();
+    return new ChunkedSerializer(message, deterministic);
+}
+
+void DeleteChunkedSerializer(ChunkedSerializer* serializer) { delete serializer; }
+
+bool ChunkedSerializerNext(ChunkedSerializer& serializer, size_t target,
+                           rust::Vec<uint8_t>& output, bool& done) {
+    const Message& message = serializer.message;
+    const Reflection* reflection = message.GetReflection();
+    bool message_set = message.GetDescriptor()->options().message_set_wire_format();
+    while (output.size() < target && !serializer.done) {
+        bool ok;
+        if (serializer.field == serializer.fields.size()) {
+            const UnknownFieldSet& unknown_fields = reflection->GetUnknownFields(message);
+            size_t size = message_set
+                              ? WireFormat::ComputeUnknownMessageSetItemsSize(unknown_fields)
+                              : WireFormat::ComputeUnknownFieldsSize(unknown_fields);
+            auto serialize = [&](io::CodedOutputStream& coded) {
+                if (message_set) {
+                    WireFormat::SerializeUnknownMessageSetItems(unknown_fields, &coded);
+                } else {
+                    WireFormat::SerializeUnknownFields(unknown_fields, &coded);
+                }
+            };
+            ok = AppendSerialized(output, size, serializer.deterministic, serialize);
+            serializer.done = true;
+        } else if (IsRepeatedMessageField(message, *serializer.fields[serializer.field]) &&
+                   !serializer.fields[serializer.field]->is_map()) {
+            // Encode one element at a time. Map fields are encoded whole, so
+            // that deterministic serialization can order their entries.
+            const FieldDescriptor* field = serializer.fields[serializer.field];
+            const Message& element =
+                reflection->GetRepeatedMessage(message, field, serializer.element);
+            uint32_t tag =
+                WireFormatLite::MakeTag(field->number(), WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+            uint32_t element_size = static_cast<uint32_t>(element.GetCachedSize());
+            size_t size = io::CodedOutputStream::VarintSize32(tag) +
+                          io::CodedOutputStream::VarintSize32(element_size) + element_size;
+            auto serialize = [&](io::CodedOutputStream& coded) {
+                coded.WriteTag(tag);
+                coded.WriteVarint32(element_size);
+                element.SerializeWithCachedSizes(&coded);
+            };
+            ok = AppendSerialized(output, size, serializer.deterministic, serialize);
+            if (++serializer.element == reflection->FieldSize(message, field)) {
+                serializer.field++;
+                serializer.element = 0;
+            }
+        } else {
+            const FieldDescriptor* field = serializer.fields[serializer.field];
+            bool item = message_set && field->is_extension();
+            size_t size = item ? WireFormat::MessageSetItemByteSize(field, message)
+                               : WireFormat::FieldByteSize(field, message);
+            auto serialize = [&](io::CodedOutputStream& coded) {
+                if (item) {
+                    WireFormat::SerializeMessageSetItemWithCachedSizes(field, message, &coded);
+                } else {
+                    WireFormat::SerializeFieldWithCachedSizes(field, message, &coded);
+                }
+            };
+            ok = AppendSerialized(output, size, serializer.deterministic, serialize);
+            serializer.field++;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    done = serializer.done;
+    return true;
+}
+
+bool MessageMergeFromBytesSplitting(Message& message, const FieldDescriptor& field,
+                                    rust::Slice<const uint8_t> data, size_t& first,
+                                    rust::Vec<ByteRange>& elements) {
+    if (!IsRepeatedMessageField(message, field)) {
+        return false;
+    }
+
+    // Only the headers of the elements of `field` are read here; the runs of
+    // other fields between them are merged into the message as is. Positions
+    // are tracked outside of the coded streams, which are limited to 2 GiB,
+    // so the input as a whole may be larger than that.
+    const uint8_t* begin = data.data();
+    size_t size = data.size();
+    size_t position = 0;
+    size_t run_start = 0;
+    auto merge_run = [&](size_t run_end) {
+        io::CodedInputStream run(begin + run_start, static_cast<int>(run_end - run_start));
+        return message.MergePartialFromCodedStream(&run) && run.ConsumedEntireMessage();
+    };
+    while (position < size) {
+        io::CodedInputStream input(begin + position,
+                                   static_cast<int>(std::min<size_t>(size - position, INT_MAX)));
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return false;
+        }
+        if (WireFormatLite::GetTagFieldNumber(tag) == field.number() &&
+            WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            int length;
+            if (!input.ReadVarintSizeAsInt(&length)) {
+                return false;
+            }
+            size_t offset = position + input.CurrentPosition();
+            if (size - offset < static_cast<size_t>(length) || !merge_run(position)) {
+                return false;
+            }
+            elements.push_back(ByteRange{
+                .offset = offset,
+                .len = static_cast<size_t>(length),
+            });
+            position = run_start = offset + length;
+        } else {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+            size_t end = position + input.CurrentPosition();
+            if (end - run_start > INT_MAX) {
+                if (!merge_run(position)) {
+                    return false;
+                }
+                run_start = position;
+            }
+            position = end;
+        }
+    }
+    if (!merge_run(position) || !message.IsInitialized()) {
+        return false;
+    }
+
+    // The elements are allocated here, in the message's arena if it has one,
+    // so that they can be filled in concurrently without touching the
+    // repeated field itself.
+    const Reflection* reflection = message.GetReflection();
+    first = reflection->FieldSize(message, &field);
+    if (first + elements.size() > INT_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < elements.size(); i++) {
+        reflection->AddMessage(&message, &field);
+    }
+    return true;
+}
+
+bool MessageParseRepeatedMessages(Message* message, const FieldDescriptor& field, size_t first,
+                                  rust::Slice<const uint8_t> data,
+                                  rust::Slice<const ByteRange> elements) {
+    const Reflection* reflection = message->GetReflection();
+    for (size_t i = 0; i < elements.size(); i++) {
+        Message* element =
+            reflection->MutableRepeatedMessage(message, &field, static_cast<int>(first + i));
+        if (!element->ParseFromArray(data.data() + elements[i].offset,
+                                     static_cast<int>(elements[i].len))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t MessageLiteSpaceUsedEstimate(const MessageLite& message) {
+    if (const Message* full = dynamic_cast<const Message*>(&message)) {
+        return full->SpaceUsedLong();
+    }
+    // Without reflection the in-memory layout is unknown, so fall back to the
+    // serialized size plus the fixed part common to every message object.
+    return message.ByteSizeLong() + sizeof(MessageLite);
+}
+
+rust::String MessageLiteTypeName(const MessageLite& message) {
+    return rust::String(message.GetTypeName());
+}
+
+bool MessageLiteAppendToVec(const MessageLite& message, rust::Vec<uint8_t>& output,
+                            bool deterministic) {
+    size_t old_size = output.size();
+    size_t byte_size = message.ByteSizeLong();
+    if (byte_size > INT_MAX) {
+        return false;
+    }
+    // `ByteSizeLong` has cached the size of every submessage, so the message
+    // can be encoded in a single pass directly into the vector's spare
+    // capacity.
+    output.reserve(old_size + byte_size);
+    uint8_t* target = output.data() + old_size;
+    if (deterministic) {
+        // `SerializeWithCachedSizesToArray` always uses the default
+        // determinism, so go through a coded stream over the spare capacity
+        // instead. The stream's single buffer still covers the entire output.
+        io::ArrayOutputStream stream(target, static_cast<int>(byte_size));
+        io::CodedOutputStream coded(&stream);
+        coded.SetSerializationDeterministic(true);
+        message.SerializeWithCachedSizes(&coded);
+        coded.Trim();
+        if (coded.HadError()) {
+            return false;
+        }
+    } else {
+        message.SerializeWithCachedSizesToArray(target);
+    }
+    vec_u8_set_len(output, old_size + byte_size);
+    return true;
+}
+
+bool MessageLiteAppendBatchToVec(rust::Slice<const MessageLiteRef> messages, bool delimited,
+                                 rust::Vec<uint8_t>& output) {
+    size_t old_size = output.size();
+    size_t total_size = 0;
+    for (const MessageLiteRef& ref : messages) {
+        size_t byte_size = ref.message.ByteSizeLong();
+        if (byte_size > INT_MAX) {
+            return false;
+        }
+        if (delimited) {
+            total_size += io::CodedOutputStream::VarintSize32(static_cast<uint32_t>(byte_size));
+        }
+        total_size += byte_size;
+    }
+    // Every message's size is now cached, so each can be encoded in a single
+    // pass directly into the vector's spare capacity.
+    output.reserve(old_size + total_size);
+    uint8_t* target = output.data() + old_size;
+    for (const MessageLiteRef& ref : messages) {
+        if (delimited) {
+            target = io::CodedOutputStream::WriteVarint32ToArray(
+                static_cast<uint32_t>(ref.message.GetCachedSize()), target);
+        }
+        target = ref.message.SerializeWithCachedSizesToArray(target);
+    }
+    vec_u8_set_len(output, old_size + total_size);
+    return true;
+}
+
+bool MessageLiteParseDelimitedBatch(const MessageLite& prototype, Arena* arena,
+                                    rust::Slice<const uint8_t> data,
+                                    rust::Vec<MessageLitePtr>& output) {
+    if (data.size() > INT_MAX) {
+        return false;
+    }
+    int size = static_cast<int>(data.size());
+    io::CodedInputStream input(data.data(), size);
+    while (input.CurrentPosition() < size) {
+        // The message is owned by the arena, even if parsing fails.
+        MessageLite* message = prototype.New(arena);
+        if (!util::ParseDelimitedFromCodedStream(message, &input, nullptr)) {
+            return false;
+        }
+        output.push_back(MessageLitePtr{message});
+    }
+    return true;
+}
+
+bool MessageLiteParseDelimitedFromCodedStream(MessageLite* message, io::CodedInputStream* input,
+                                              bool* clean_eof) {
+    *clean_eof = false;
+    int start = input->CurrentPosition();
+    uint32_t size;
+    if (!input->ReadVarint32(&size)) {
+        *clean_eof = input->CurrentPosition() == start;
+        return false;
+    }
+    if (size > INT_MAX) {
+        return false;
+    }
+    int position_after_size = input->CurrentPosition();
+    io::CodedInputStream::Limit limit = input->PushLimit(static_cast<int>(size));
+    bool ok = message->MergeFromCodedStream(input) && input->ConsumedEntireMessage() &&
+              input->CurrentPosition() - position_after_size == static_cast<int>(size);
+    input->PopLimit(limit);
+    return ok;
+}
+
+namespace {
+
+// Reports whether `a` and `b` are of the same message type. Merging messages of
+// different types aborts, so this must be checked first. Swapping additionally
+// requires the same reflection; see SameReflection.
+bool SameMessageType(const MessageLite& a, const MessageLite& b) {
+    if (typeid(a) != typeid(b)) {
+        return false;
+    }
+    // Dynamic messages of every type share one C++ class.
+    const Message* message = dynamic_cast<const Message*>(&a);
+    return message == nullptr ||
+           message->GetDescriptor() == static_cast<const Message&>(b).GetDescriptor();
+}
+
+// Reports whether `a` and `b` are of the same message type and share their
+// reflection, as swapping requires. A dynamic message of a generated type, or
+// of a type from another DynamicMessageFactory, has the descriptor of the
+// message it mirrors but its own reflection, and swapping the two aborts.
+bool SameReflection(const Message& a, const Message& b) {
+    return SameMessageType(a, b) && a.GetReflection() == b.GetReflection();
+}
+
+}  // namespace
+
+bool MessageLiteCopyFrom(MessageLite& to, const MessageLite& from) {
+    if (!SameMessageType(to, from)) {
+        return false;
+    }
+    to.Clear();
+    to.CheckTypeAndMergeFrom(from);
+    return true;
+}
+
+bool MessageLiteMergeFrom(MessageLite& to, const MessageLite& from) {
+    if (!SameMessageType(to, from)) {
+        return false;
+    }
+    to.CheckTypeAndMergeFrom(from);
+    return true;
+}
+
+bool MessageSwap(Message& a, Message& b) {
+    if (!SameReflection(a, b)) {
+        return false;
+    }
+    a.GetReflection()->Swap(&a, &b);
+    return true;
+}
+
+bool MessageUnsafeArenaSwap(Message& a, Message& b) {
+    if (!SameReflection(a, b) || a.GetArena() != b.GetArena()) {
+        return false;
+    }
+    a.GetReflection()->UnsafeArenaSwap(&a, &b);
+    return true;
+}
+
+bool MessageAddAllocatedMessage(Message& message, const FieldDescriptor& field, Message* element) {
+    // Only a message on the same arena can be added without a copy. Messages
+    // on the heap are owned by their Rust handle, so are never added.
+    if (!IsRepeatedMessageField(message, field) ||
+        element->GetDescriptor() != field.message_type() || element->GetArena() == nullptr ||
+        element->GetArena() != message.GetArena()) {
+        return false;
+    }
+    message.GetReflection()->UnsafeArenaAddAllocatedMessage(&message, &field, element);
+    return true;
+}
+
+RustDescriptorDatabase::RustDescriptorDatabase(rust::Box<DescriptorDatabaseAdaptor> adaptor)
+    : adaptor_(std::move(adaptor)) {}
+
+bool RustDescriptorDatabase::FindFileByName(const std::string& filename,
+                                            FileDescriptorProto* output) {
+    return adaptor_->find_file_by_name(filename, *output);
+}
+
+bool RustDescriptorDatabase::FindFileContainingSymbol(const std::string& symbol_name,
+                                                      FileDescriptorProto* output) {
+    return adaptor_->find_file_containing_symbol(symbol_name, *output);
+}
+
+bool RustDescriptorDatabase::FindFileContainingExtension(const std::string& containing_type,
+                                                         int field_number,
+                                                         FileDescriptorProto* output) {
+    return adaptor_->find_file_containing_extension(containing_type, field_number, *output);
+}
+
+bool RustDescriptorDatabase::FindAllFileNames(std::vector<std::string>* output) {
+    rust::Vec<rust::String> names;
+    if (!adaptor_->find_all_file_names(names)) {
+        return false;
+    }
+    output->reserve(output->size() + names.size());
+    for (const rust::String& name : names) {
+        output->emplace_back(name);
+    }
+    return true;
+}
+
+DescriptorDatabase* NewRustDescriptorDatabase(rust::Box<DescriptorDatabaseAdaptor> adaptor) {
+    return new RustDescriptorDatabase(std::move(adaptor));
+}
+
+bool DescriptorDatabaseFindAllFileNames(DescriptorDatabase& database,
+                                        rust::Vec<rust::String>& output) {
+    std::vector<std::string> names;
+    if (!database.FindAllFileNames(&names)) {
+        return false;
+    }
+    output.reserve(output.size() + names.size());
+    for (const std::string& name : names) {
+        output.push_back(name);
+    }
+    return true;
+}
+
+namespace {
+
+std::vector<DescriptorDatabase*> DescriptorDatabasePointers(
+    const std::vector<std::unique_ptr<DescriptorDatabase>>& databases) {
+    std::vector<DescriptorDatabase*> pointers;
+    pointers.reserve(databases.size());
+    for (const auto& database : databases) {
+        pointers.push_back(database.get());
+    }
+    return pointers;
+}
+
+}  // namespace
+
+OwningMergedDescriptorDatabase::OwningMergedDescriptorDatabase(
+    std::vector<std::unique_ptr<DescriptorDatabase>> sources)
+    : MergedDescriptorDatabase(DescriptorDatabasePointers(sources)),
+      sources_(std::move(sources)) {}
+
+MergedDescriptorDatabase* NewMergedDescriptorDatabase(
+    rust::Slice<const DescriptorDatabasePtr> sources) {
+    std::vector<std::unique_ptr<DescriptorDatabase>> owned;
+    owned.reserve(sources.size());
+    for (const DescriptorDatabasePtr& source : sources) {
+        owned.emplace_back(source.database);
+    }
+    return new OwningMergedDescriptorDatabase(std::move(owned));
+}
+
+void DeleteMergedDescriptorDatabase(MergedDescriptorDatabase* database) { delete database; }
+
+EncodedDescriptorDatabase* NewEncodedDescriptorDatabase() {
+    return new EncodedDescriptorDatabase();
+}
+
+void DeleteEncodedDescriptorDatabase(EncodedDescriptorDatabase* database) { delete database; }
+
 DescriptorPool* NewDescriptorPool() { return new DescriptorPool(); }
 
-void DeleteDescriptorPool(DescriptorPool* pool) { delete pool; }
+DescriptorPool* NewDescriptorPoolWithDatabase(rust::Box<DescriptorDatabaseAdaptor> adaptor) {
+    auto database = std::make_unique<RustDescriptorDatabase>(std::move(adaptor));
+    auto* pool = new DescriptorPool(database.get());
+    absl::MutexLock lock(&pool_databases_mutex);
+    bool inserted = PoolDatabases().emplace(pool, std::move(database)).second;
+    ABSL_CHECK(inserted) << "descriptor pool registered twice";
+    return pool;
+}
+
+DescriptorPool* NewDescriptorPoolWithUnderlay(const DescriptorPool& underlay) {
+    auto* pool = new DescriptorPool(&underlay);
+    absl::MutexLock lock(&pool_underlays_mutex);
+    bool inserted = PoolUnderlays().emplace(pool, &underlay).second;
+    ABSL_CHECK(inserted) << "descriptor pool registered twice";
+    return pool;
+}
+
+const DescriptorPool& GeneratedDescriptorPool() { return *DescriptorPool::generated_pool(); }
+
+void DeleteDescriptorPool(DescriptorPool* pool) {
+    // Unregister the pool before freeing it: once freed, its address may be
+    // handed to a pool created on another thread, whose entries the late
+    // removal of this pool's would then clobber. The database must still
+    // outlive the pool, so it is destroyed only on return.
+    {
+        absl::MutexLock lock(&pool_underlays_mutex);
+        PoolUnderlays().erase(pool);
+    }
+    std::unique_ptr<RustDescriptorDatabase> database;
+    {
+        absl::MutexLock lock(&pool_databases_mutex);
+        auto node = PoolDatabases().extract(pool);
+        if (!node.empty()) {
+            database = std::move(node.mapped());
+        }
+    }
+    delete pool;
+}
+
+bool DescriptorPoolHasDatabase(const DescriptorPool& pool) {
+    absl::MutexLock lock(&pool_databases_mutex);
+    return PoolDatabases().contains(&pool);
+}
+
+namespace {
+
+// Estimates the memory that the descriptors of a file take up, by category.
+class MemoryUsageCounter {
+   public:
+    explicit MemoryUsageCounter(DescriptorMemoryUsage& usage) : usage_(usage) {}
+
+    void File(const FileDescriptor& file) {
+        usage_.descriptors += sizeof(FileDescriptor);
+        Name(file.name());
+        Name(file.package());
+        Options(file.options());
+        Features(file);
+        for (int i = 0; i < file.dependency_count(); i++) {
+            Name(file.dependency(i)->name());
+        }
+        for (int i = 0; i < file.message_type_count(); i++) {
+            MessageType(*file.message_type(i));
+        }
+        for (int i = 0; i < file.enum_type_count(); i++) {
+            EnumType(*file.enum_type(i));
+        }
+        for (int i = 0; i < file.extension_count(); i++) {
+            Field(*file.extension(i));
+        }
+        for (int i = 0; i < file.service_count(); i++) {
+            const ServiceDescriptor& service = *file.service(i);
+            Common(service);
+            for (int j = 0; j < service.method_count(); j++) {
+                Common(*service.method(j));
+            }
+        }
+        FileDescriptorProto proto;
+        file.CopySourceCodeInfoTo(&proto);
+        if (proto.has_source_code_info()) {
+            usage_.source_code_info += proto.source_code_info().SpaceUsedLong();
+        }
+    }
+
+   private:
+    void MessageType(const Descriptor& message) {
+        Common(message);
+        for (int i = 0; i < message.field_count(); i++) {
+            Field(*message.field(i));
+        }
+        for (int i = 0; i < message.oneof_decl_count(); i++) {
+            Common(*message.oneof_decl(i));
+        }
+        for (int i = 0; i < message.nested_type_count(); i++) {
+            MessageType(*message.nested_type(i));
+        }
+        for (int i = 0; i < message.enum_type_count(); i++) {
+            EnumType(*message.enum_type(i));
+        }
+        for (int i = 0; i < message.extension_count(); i++) {
+            Field(*message.extension(i));
+        }
+        for (int i = 0; i < message.extension_range_count(); i++) {
+            const Descriptor::ExtensionRange& range = *message.extension_range(i);
+            usage_.descriptors += sizeof(range);
+            Options(range.options());
+            Features(range);
+        }
+        usage_.descriptors += message.reserved_range_count() * sizeof(Descriptor::ReservedRange);
+        for (int i = 0; i < message.reserved_name_count(); i++) {
+            Name(message.reserved_name(i));
+        }
+    }
+
+    void EnumType(const EnumDescriptor& enum_type) {
+        Common(enum_type);
+        for (int i = 0; i < enum_type.value_count(); i++) {
+            Common(*enum_type.value(i));
+        }
+    }
+
+    void Field(const FieldDescriptor& field) {
+        Common(field);
+        if (field.has_json_name()) {
+            Name(field.json_name());
+        }
+        if (field.has_default_value() && field.cpp_type() == FieldDescriptor::CPPTYPE_STRING) {
+            Name(field.default_value_string());
+        }
+    }
+
+    template <typename DescriptorT>
+    void Common(const DescriptorT& descriptor) {
+        usage_.descriptors += sizeof(DescriptorT);
+        Name(descriptor.name());
+        Name(descriptor.full_name());
+        Options(descriptor.options());
+        Features(descriptor);
+    }
+
+    // Strings short enough for the small-string optimization take up no
+    // space beyond the string object, which is counted with its descriptor.
+    void Name(const std::string& name) {
+        if (name.capacity() >= sizeof(std::string)) {
+            usage_.names += name.capacity() + 1;
+        }
+    }
+
+    template <typename OptionsT>
+    void Options(const OptionsT& options) {
+        // Descriptors without options share the default instance.
+        if (&options != &OptionsT::default_instance()) {
+            usage_.options += options.SpaceUsedLong();
+        }
+    }
+
+    // Resolved feature sets are deduplicated across the pool, so each is
+    // counted once.
+    template <typename DescriptorT>
+    void Features(const DescriptorT& descriptor) {
+        const FeatureSet& features = InternalFeatureHelper::GetFeatures(descriptor);
+        if (&features != &FeatureSet::default_instance() &&
+            seen_features_.insert(&features).second) {
+            usage_.features += features.SpaceUsedLong();
+        }
+    }
+
+    DescriptorMemoryUsage& usage_;
+    absl::flat_hash_set<const FeatureSet*> seen_features_;
+};
+
+}  // namespace
+
+DescriptorMemoryUsage FileDescriptorMemoryUsage(const FileDescriptor& file) {
+    DescriptorMemoryUsage usage{};
+    MemoryUsageCounter(usage).File(file);
+    return usage;
+}
+
+namespace {
+
+class BuildFileErrorCollector : public DescriptorPool::ErrorCollector {
+   public:
+    BuildFileErrorCollector(rust::Vec<BuildFileError>& errors) : errors_(errors) {}
+
+    void RecordError(absl::string_view filename, absl::string_view element_name,
+                     const Message* descriptor, ErrorLocation location,
+                     absl::string_view message) override {
+        errors_.push_back(
+            BuildFileError{.filename = rust::String(filename.data(), filename.size()),
+                           .element_name = rust::String(element_name.data(), element_name.size()),
+                           .message = rust::String(message.data(), message.size())});
+    }
+
+   private:
+    rust::Vec<BuildFileError>& errors_;
+};
+
+// Returns the indexes of the files in `set`, ordered such that every file
+// comes after the files in the set that it depends on. The files of a
+// dependency cycle are returned in an arbitrary order.
+std::vector<int> DependencyOrder(const FileDescriptorSet& set) {
+    absl::flat_hash_map<absl::string_view, int> indexes;
+    for (int i = 0; i < set.file_size(); i++) {
+        indexes.emplace(set.file(i).name(), i);
+    }
+
+    std::vector<bool> visited(set.file_size());
+    std::vector<int> order;
+    order.reserve(set.file_size());
+    // Each frame holds the index of a file and of its next dependency to visit.
+    std::vector<std::pair<int, int>> stack;
+    for (int root = 0; root < set.file_size(); root++) {
+        if (visited[root]) continue;
+        visited[root] = true;
+        stack.emplace_back(root, 0);
+        while (!stack.empty()) {
+            auto& frame = stack.back();
+            const FileDescriptorProto& file = set.file(frame.first);
+            if (frame.second == file.dependency_size()) {
+                order.push_back(frame.first);
+                stack.pop_back();
+                continue;
+            }
+            auto it = indexes.find(file.dependency(frame.second++));
+            if (it != indexes.end() && !visited[it->second]) {
+                visited[it->second] = true;
+                stack.emplace_back(it->second, 0);
+            }
+        }
+    }
+    return order;
+}
+
+}  // namespace
+
+namespace {
+
+bool IsExtensionName(const UninterpretedOption& option) {
+    for (const UninterpretedOption::NamePart& part : option.name()) {
+        if (part.is_extension()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Removes the custom options from every options message within `message`:
+// those that are still uninterpreted, as in the output of the parser, and
+// those that were already interpreted, which are extensions or, if their
+// definitions are not linked in, unknown fields.
+void StripCustomOptions(Message& message) {
+    const Descriptor* descriptor = message.GetDescriptor();
+    const Reflection* reflection = message.GetReflection();
+    const FieldDescriptor* uninterpreted = descriptor->FindFieldByName("uninterpreted_option");
+    bool options = descriptor->file() == FileDescriptorProto::descriptor()->file() &&
+                   uninterpreted != nullptr;
+    if (options) {
+        reflection->MutableUnknownFields(&message)->Clear();
+        int kept = 0;
+        int count = reflection->FieldSize(message, uninterpreted);
+        for (int i = 0; i < count; i++) {
+            const auto& option = static_cast<const UninterpretedOption&>(
+                reflection->GetRepeatedMessage(message, uninterpreted, i));
+            if (!IsExtensionName(option)) {
+                reflection->SwapElements(&message, uninterpreted, i, kept++);
+            }
+        }
+        while (kept < reflection->FieldSize(message, uninterpreted)) {
+            reflection->RemoveLast(&message, uninterpreted);
+        }
+    }
+    std::vector<const FieldDescriptor*> fields;
+    reflection->ListFields(message, &fields);
+    for (const FieldDescriptor* field : fields) {
+        if (options && field->is_extension()) {
+            reflection->ClearField(&message, field);
+        } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+            if (field->is_repeated()) {
+                for (int i = 0; i < reflection->FieldSize(message, field); i++) {
+                    StripCustomOptions(*reflection->MutableRepeatedMessage(&message, field, i));
+                }
+            } else {
+                StripCustomOptions(*reflection->MutableMessage(&message, field));
+            }
+        }
+    }
+}
+
+// Builds `file` in `pool`, first dropping the parts of it that `options` do
+// not retain.
+const FileDescriptor* BuildFileWithOptions(DescriptorPool& pool, const FileDescriptorProto& file,
+                                           const BuildOptions& options,
+                                           BuildFileErrorCollector& collector) {
+    if (options.retain_source_code_info && options.retain_custom_options) {
+        return pool.BuildFileCollectingErrors(file, &collector);
+    }
+    FileDescriptorProto compact = file;
+    if (!options.retain_source_code_info) {
+        compact.clear_source_code_info();
+    }
+    if (!options.retain_custom_options) {
+        StripCustomOptions(compact);
+    }
+    return pool.BuildFileCollectingErrors(compact, &collector);
+}
+
+}  // namespace
+
+bool DescriptorPoolBuildFileSet(DescriptorPool& pool, const FileDescriptorSet& set,
+                                const BuildOptions& options, rust::Vec<BuildFileError>& errors) {
+    BuildFileErrorCollector collector(errors);
+    bool ok = true;
+    for (int i : DependencyOrder(set)) {
+        if (UnderlayProvidesFile(pool, set.file(i))) {
+            continue;
+        }
+        if (BuildFileWithOptions(pool, set.file(i), options, collector) == nullptr) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+namespace {
+
+// The layout of a descriptor pool image, all integers little-endian:
+//
+//     magic      "PNDP"
+//     u32        format version
+//     u32        GOOGLE_PROTOBUF_VERSION of the writer
+//     u32        number of files
+//     u32 * n    length of each serialized FileDescriptorProto
+//     ...        the serialized files, in dependency order
+//     u64        FNV-1a hash of all the preceding bytes
+//
+// Files are located by offsets alone, so an image can be used in place from
+// wherever it is loaded or mapped.
+constexpr char kImageMagic[4] = {'P', 'N', 'D', 'P'};
+constexpr uint32_t kImageFormatVersion = 1;
+constexpr size_t kImageHeaderSize = sizeof(kImageMagic) + 3 * sizeof(uint32_t);
+
+uint64_t ImageChecksum(const uint8_t* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    return hash;
+}
+
+}  // namespace
+
+bool DescriptorPoolImageEncode(const FileDescriptorSet& set, rust::Vec<uint8_t>& output) {
+    std::vector<int> order = DependencyOrder(set);
+    size_t size = kImageHeaderSize + order.size() * sizeof(uint32_t) + sizeof(uint64_t);
+    for (int i : order) {
+        size_t file_size = set.file(i).ByteSizeLong();
+        if (file_size > INT_MAX) {
+            return false;
+        }
+        size += file_size;
+    }
+    output.clear();
+    output.reserve(size);
+    uint8_t* start = output.data();
+    uint8_t* p = start;
+    std::memcpy(p, kImageMagic, sizeof(kImageMagic));
+    absl::little_endian::Store32(p + 4, kImageFormatVersion);
+    absl::little_endian::Store32(p + 8, GOOGLE_PROTOBUF_VERSION);
+    absl::little_endian::Store32(p + 12, static_cast<uint32_t>(order.size()));
+    p += kImageHeaderSize;
+    uint8_t* data = p + order.size() * sizeof(uint32_t);
+    for (int i : order) {
+        const FileDescriptorProto& file = set.file(i);
+        absl::little_endian::Store32(p, static_cast<uint32_t>(file.GetCachedSize()));
+        p += sizeof(uint32_t);
+        data = file.SerializeWithCachedSizesToArray(data);
+    }
+    absl::little_endian::Store64(data, ImageChecksum(start, size - sizeof(uint64_t)));
+    vec_u8_set_len(output, size);
+    return true;
+}
+
+bool DescriptorPoolImageFiles(rust::Slice<const uint8_t> image, rust::Vec<ByteRange>& files) {
+    const uint8_t* data = image.data();
+    size_t size = image.size();
+    if (size < kImageHeaderSize + sizeof(uint64_t) ||
+        std::memcmp(data, kImageMagic, sizeof(kImageMagic)) != 0 ||
+        absl::little_endian::Load32(data + 4) != kImageFormatVersion ||
+        absl::little_endian::Load32(data + 8) != GOOGLE_PROTOBUF_VERSION) {
+        return false;
+    }
+    size_t body_size = size - sizeof(uint64_t);
+    if (absl::little_endian::Load64(data + body_size) != ImageChecksum(data, body_size)) {
+        return false;
+    }
+    size_t count = absl::little_endian::Load32(data + 12);
+    if (count > (body_size - kImageHeaderSize) / sizeof(uint32_t)) {
+        return false;
+    }
+    size_t offset = kImageHeaderSize + count * sizeof(uint32_t);
+    files.clear();
+    files.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        size_t len = absl::little_endian::Load32(data + kImageHeaderSize + i * sizeof(uint32_t));
+        if (len > body_size - offset) {
+            return false;
+        }
+        files.push_back(ByteRange{.offset = offset, .len = len});
+        offset += len;
+    }
+    return offset == body_size;
+}
+
+bool DescriptorPoolBuildImage(DescriptorPool& pool, rust::Slice<const uint8_t> image,
+                              rust::Slice<const ByteRange> files, const BuildOptions& options,
+                              rust::Vec<BuildFileError>& errors) {
+    BuildFileErrorCollector collector(errors);
+    FileDescriptorProto proto;
+    bool ok = true;
+    // The files are already in dependency order, so each can be built as soon
+    // as it is parsed.
+    for (const ByteRange& range : files) {
+        if (!proto.ParseFromArray(image.data() + range.offset, static_cast<int>(range.len))) {
+            errors.push_back(BuildFileError{
+                .filename = "",
+                .element_name = "",
+                .message = "malformed FileDescriptorProto in descriptor pool image",
+            });
+            ok = false;
+            continue;
+        }
+        if (UnderlayProvidesFile(pool, proto)) {
+            continue;
+        }
+        if (BuildFileWithOptions(pool, proto, options, collector) == nullptr) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+namespace {
+
+template <typename T>
+PointerArray RepeatedPtrFieldPointers(const RepeatedPtrField<T>& field) {
+    return PointerArray{field.data(), static_cast<size_t>(field.size())};
+}
+
+}  // namespace
 
 FileDescriptorSet* NewFileDescriptorSet() { return new FileDescriptorSet(); }
 
 void DeleteFileDescriptorSet(FileDescriptorSet* set) { delete set; }
 
+void FileDescriptorSetAddAllocatedFile(FileDescriptorSet& set, FileDescriptorProto* file) {
+    set.mutable_file()->AddAllocated(file);
+}
+
+void FileDescriptorSetCopyFiles(FileDescriptorSet& set,
+                                rust::Slice<const FileDescriptorProtoRef> files) {
+    RepeatedPtrField<FileDescriptorProto>& out = *set.mutable_file();
+    out.Reserve(out.size() + static_cast<int>(files.size()));
+    for (const FileDescriptorProtoRef& ref : files) {
+        out.Add()->CopyFrom(ref.file);
+    }
+}
+
+PointerArray FileDescriptorSetFiles(const FileDescriptorSet& set) {
+    return RepeatedPtrFieldPointers(set.file());
+}
+
 FileDescriptorProto* NewFileDescriptorProto() { return new FileDescriptorProto(); }
 
 void DeleteFileDescriptorProto(FileDescriptorProto* proto) { delete proto; }
 
+PointerArray FileDescriptorProtoDependencies(const FileDescriptorProto& proto) {
+    return RepeatedPtrFieldPointers(proto.dependency());
+}
+
+PointerArray FileDescriptorProtoMessageTypes(const FileDescriptorProto& proto) {
+    return RepeatedPtrFieldPointers(proto.message_type());
+}
+
+void FileDescriptorProtoSourceLocations(const FileDescriptorProto& proto,
+                                        rust::Vec<SourceLocationEntry>& locations) {
+    const SourceCodeInfo& info = proto.source_code_info();
+    locations.reserve(static_cast<size_t>(info.location_size()));
+    for (const SourceCodeInfo::Location& location : info.location()) {
+        locations.push_back(SourceLocationEntry{
+            ScalarArray{const_cast<int32_t*>(location.path().data()),
+                        static_cast<size_t>(location.path_size())},
+            ScalarArray{const_cast<int32_t*>(location.span().data()),
+                        static_cast<size_t>(location.span_size())},
+            &location.leading_comments(),
+            &location.trailing_comments(),
+            RepeatedPtrFieldPointers(location.leading_detached_comments()),
+        });
+    }
+}
+
+FieldMask* NewFieldMask() { return new FieldMask(); }
+
+void DeleteFieldMask(FieldMask* mask) { delete mask; }
+
+void FieldMaskAddPath(FieldMask& mask, absl::string_view path) { mask.add_paths(path); }
+
+CompiledFieldMask* NewCompiledFieldMask(const Descriptor& descriptor, const FieldMask& mask) {
+    const FieldMaskTree* tree = CompileFieldMask(&descriptor, mask);
+    if (tree == nullptr) {
+        return nullptr;
+    }
+    return new CompiledFieldMask{.descriptor = &descriptor, .tree = tree};
+}
+
+void DeleteCompiledFieldMask(CompiledFieldMask* mask) { delete mask; }
+
+bool CompiledFieldMaskMergeFromBytes(const CompiledFieldMask& mask, Message& message,
+                                     rust::Slice<const uint8_t> data) {
+    return message.GetDescriptor() == mask.descriptor &&
+           MergeFromBytesWithTree(message, data, *mask.tree);
+}
+
+bool CompiledFieldMaskMergeMessageTo(const CompiledFieldMask& mask, const Message& source,
+                                     Message& destination, bool replace_message_fields,
+                                     bool replace_repeated_fields) {
+    if (source.GetDescriptor() != mask.descriptor ||
+        destination.GetDescriptor() != mask.descriptor) {
+        return false;
+    }
+    MergeMessageWithTree(source, *mask.tree, replace_message_fields, replace_repeated_fields,
+                         destination);
+    return true;
+}
+
+bool CompiledFieldMaskTrimMessage(const CompiledFieldMask& mask, Message& message,
+                                  bool& modified) {
+    if (message.GetDescriptor() != mask.descriptor) {
+        return false;
+    }
+    modified = TrimMessageWithTree(*mask.tree, message);
+    return true;
+}
+
 DescriptorProto* NewDescriptorProto() { return new DescriptorProto(); }
 
 void DeleteDescriptorProto(DescriptorProto* proto) { delete proto; }
 
 void DeleteFileDescriptor(FileDescriptor* descriptor) { delete descriptor; }
 
+int FieldDescriptorType(const FieldDescriptor& field) { return field.type(); }
+
+DynamicMessageFactory* NewDynamicMessageFactory() { return new DynamicMessageFactory(); }
+
+void DeleteDynamicMessageFactory(DynamicMessageFactory* factory) { delete factory; }
+
+namespace {
+
+// Removes the extensions declared within `message` and its nested types, which
+// would otherwise be declared a second time by the view.
+void ClearExtensions(DescriptorProto& message) {
+    message.clear_extension();
+    for (DescriptorProto& nested : *message.mutable_nested_type()) {
+        ClearExtensions(nested);
+    }
+}
+
+// Returns a name for the synthetic oneof of a proto3 optional field that does
+// not collide with any field or oneof of `message`, as protoc would choose.
+std::string SyntheticOneofName(const DescriptorProto& message, const std::string& field_name) {
+    auto taken = [&](const std::string& name) {
+        for (const FieldDescriptorProto& field : message.field()) {
+            if (field.name() == name) {
+                return true;
+            }
+        }
+        for (const OneofDescriptorProto& oneof : message.oneof_decl()) {
+            if (oneof.name() == name) {
+                return true;
+            }
+        }
+        return false;
+    };
+    std::string name = absl::StrCat("_", field_name);
+    while (taken(name)) {
+        name.insert(0, "X");
+    }
+    return name;
+}
+
+// Redeclares the `i`th field of `message`, a submessage field, as a bytes
+// field. The wire format of the two is identical, but a bytes field in proto3
+// or with implicit presence does not track whether it is set, so the field is
+// given explicit presence to round-trip empty submessages.
+void RedeclareAsBytes(DescriptorProto& message, int i, const std::string& syntax) {
+    FieldDescriptorProto& field = *message.mutable_field(i);
+    field.set_type(FieldDescriptorProto::TYPE_BYTES);
+    field.clear_type_name();
+    if (field.has_options()) {
+        FieldOptions& options = *field.mutable_options();
+        options.clear_lazy();
+        options.clear_unverified_lazy();
+        if (options.has_features()) {
+            options.mutable_features()->clear_message_encoding();
+        }
+    }
+    if (field.label() == FieldDescriptorProto::LABEL_REPEATED || field.has_oneof_index()) {
+        return;
+    }
+    if (syntax == "proto3") {
+        field.set_proto3_optional(true);
+        field.set_oneof_index(message.oneof_decl_size());
+        message.add_oneof_decl()->set_name(SyntheticOneofName(message, field.name()));
+    } else if (syntax == "editions" && !field.options().features().has_field_presence()) {
+        field.mutable_options()->mutable_features()->set_field_presence(FeatureSet::EXPLICIT);
+    }
+}
+
+// Describes a file that declares the view of `descriptor`. The view has the
+// same name as the original type, in a package prefixed with
+// `protobuf_native.lazy`, and imports everything the original's file does, so
+// every type it refers to resolves to the original in the underlay.
+FileDescriptorProto LazyViewFile(const Descriptor& descriptor) {
+    const FileDescriptor* file = descriptor.file();
+    FileDescriptorProto proto;
+    file->CopyHeadingTo(&proto);
+    proto.set_name(absl::StrCat("protobuf_native/lazy/", descriptor.full_name(), ".proto"));
+    std::string package = "protobuf_native.lazy";
+    if (descriptor.full_name().size() > descriptor.name().size()) {
+        absl::StrAppend(&package, ".", descriptor.full_name().substr(
+            0, descriptor.full_name().size() - descriptor.name().size() - 1));
+    }
+    proto.set_package(package);
+    proto.add_dependency(file->name());
+    for (int i = 0; i < file->dependency_count(); ++i) {
+        proto.add_dependency(file->dependency(i)->name());
+    }
+
+    DescriptorProto& message = *proto.add_message_type();
+    descriptor.CopyTo(&message);
+    ClearExtensions(message);
+    for (int i = 0; i < descriptor.field_count(); ++i) {
+        message.mutable_field(i)->set_json_name(descriptor.field(i)->json_name());
+        if (descriptor.field(i)->type() == FieldDescriptor::TYPE_MESSAGE) {
+            RedeclareAsBytes(message, i, proto.syntax());
+        }
+    }
+    return proto;
+}
+
+}  // namespace
+
+LazyView::LazyView(const Descriptor& original)
+    : original(&original), pool(original.file()->pool()), descriptor(nullptr) {}
+
+LazyView* NewLazyView(const Descriptor& descriptor) {
+    auto view = std::make_unique<LazyView>(descriptor);
+    const FileDescriptor* file = view->pool.BuildFile(LazyViewFile(descriptor));
+    if (file == nullptr) {
+        return nullptr;
+    }
+    view->descriptor = file->message_type(0);
+    return view.release();
+}
+
+void DeleteLazyView(LazyView* view) { delete view; }
+
+const Descriptor& LazyViewDescriptor(const LazyView& view) { return *view.descriptor; }
+
+bool LazyViewParseField(const LazyView& view, const Message& message, const FieldDescriptor& field,
+                        int index, Message& output) {
+    if (message.GetDescriptor() != view.descriptor || field.containing_type() != view.descriptor) {
+        return false;
+    }
+    const FieldDescriptor* original = view.original->FindFieldByNumber(field.number());
+    if (original == nullptr || original->type() != FieldDescriptor::TYPE_MESSAGE ||
+        output.GetDescriptor() != original->message_type()) {
+        return false;
+    }
+    const Reflection* reflection = message.GetReflection();
+    std::string scratch;
+    if (!field.is_repeated()) {
+        return output.ParseFromString(reflection->GetStringReference(message, &field, &scratch));
+    }
+    if (index < 0 || index >= reflection->FieldSize(message, &field)) {
+        return false;
+    }
+    return output.ParseFromString(
+        reflection->GetRepeatedStringReference(message, &field, index, &scratch));
+}
+
+FieldAccessor* NewFieldAccessor(const FieldDescriptor& field) {
+    if (field.is_repeated() || field.cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+        return nullptr;
+    }
+    return new FieldAccessor{
+        .field = &field,
+        .containing_type = field.containing_type(),
+        .cpp_type = field.cpp_type(),
+    };
+}
+
+void DeleteFieldAccessor(FieldAccessor* accessor) { delete accessor; }
+
+bool FieldAccessorHas(const FieldAccessor& accessor, const Message& message, bool& ok) {
+    ok = message.GetDescriptor() == accessor.containing_type;
+    return ok && message.GetReflection()->HasField(message, accessor.field);
+}
+
+int64_t FieldAccessorGetInt64(const FieldAccessor& accessor, const Message& message, bool& ok) {
+    ok = message.GetDescriptor() == accessor.containing_type;
+    if (ok) {
+        const Reflection* reflection = message.GetReflection();
+        switch (accessor.cpp_type) {
+            case FieldDescriptor::CPPTYPE_INT32:
+                return reflection->GetInt32(message, accessor.field);
+            case FieldDescriptor::CPPTYPE_INT64:
+                return reflection->GetInt64(message, accessor.field);
+            case FieldDescriptor::CPPTYPE_ENUM:
+                return reflection->GetEnumValue(message, accessor.field);
+            default:
+                break;
+        }
+    }
+    ok = false;
+    return 0;
+}
+
+uint64_t FieldAccessorGetUInt64(const FieldAccessor& accessor, const Message& message, bool& ok) {
+    ok = message.GetDescriptor() == accessor.containing_type;
+    if (ok) {
+        const Reflection* reflection = message.GetReflection();
+        switch (accessor.cpp_type) {
+            case FieldDescriptor::CPPTYPE_UINT32:
+                return reflection->GetUInt32(message, accessor.field);
+            case FieldDescriptor::CPPTYPE_UINT64:
+                return reflection->GetUInt64(message, accessor.field);
+            default:
+                break;
+        }
+    }
+    ok = false;
+    return 0;
+}
+
+double FieldAccessorGetDouble(const FieldAccessor& accessor, const Message& message, bool& ok) {
+    ok = message.GetDescriptor() == accessor.containing_type;
+    if (ok) {
+        const Reflection* reflection = message.GetReflection();
+        switch (accessor.cpp_type) {
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                return reflection->GetFloat(message, accessor.field);
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                return reflection->GetDouble(message, accessor.field);
+            default:
+                break;
+        }
+    }
+    ok = false;
+    return 0;
+}
+
+bool FieldAccessorGetBool(const FieldAccessor& accessor, const Message& message, bool& ok) {
+    ok = message.GetDescriptor() == accessor.containing_type &&
+         accessor.cpp_type == FieldDescriptor::CPPTYPE_BOOL;
+    return ok && message.GetReflection()->GetBool(message, accessor.field);
+}
+
+rust::Slice<const uint8_t> FieldAccessorGetBytes(const FieldAccessor& accessor,
+                                                 const Message& message, bool& ok) {
+    // As in `MessageGetStringField`, a cord field has no contiguous value to
+    // borrow.
+    ok = message.GetDescriptor() == accessor.containing_type &&
+         accessor.cpp_type == FieldDescriptor::CPPTYPE_STRING &&
+         cpp::EffectiveStringCType(accessor.field) != FieldOptions::CORD;
+    if (!ok) {
+        return {};
+    }
+    const std::string& value =
+        message.GetReflection()->GetStringReference(message, accessor.field, nullptr);
+    return {reinterpret_cast<const uint8_t*>(value.data()), value.size()};
+}
+
+bool FieldAccessorSetInt64(const FieldAccessor& accessor, Message& message, int64_t value) {
+    if (message.GetDescriptor() != accessor.containing_type) {
+        return false;
+    }
+    const Reflection* reflection = message.GetReflection();
+    switch (accessor.cpp_type) {
+        case FieldDescriptor::CPPTYPE_INT64:
+            reflection->SetInt64(&message, accessor.field, value);
+            return true;
+        case FieldDescriptor::CPPTYPE_INT32:
+            if (value < INT32_MIN || value > INT32_MAX) {
+                return false;
+            }
+            reflection->SetInt32(&message, accessor.field, static_cast<int32_t>(value));
+            return true;
+        case FieldDescriptor::CPPTYPE_ENUM:
+            // A closed enum field cannot hold a value that is not declared.
+            if (value < INT32_MIN || value > INT32_MAX ||
+                (accessor.field->enum_type()->is_closed() &&
+                 accessor.field->enum_type()->FindValueByNumber(static_cast<int>(value)) ==
+                     nullptr)) {
+                return false;
+            }
+            reflection->SetEnumValue(&message, accessor.field, static_cast<int>(value));
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool FieldAccessorSetUInt64(const FieldAccessor& accessor, Message& message, uint64_t value) {
+    if (message.GetDescriptor() != accessor.containing_type) {
+        return false;
+    }
+    const Reflection* reflection = message.GetReflection();
+    switch (accessor.cpp_type) {
+        case FieldDescriptor::CPPTYPE_UINT64:
+            reflection->SetUInt64(&message, accessor.field, value);
+            return true;
+        case FieldDescriptor::CPPTYPE_UINT32:
+            if (value > UINT32_MAX) {
+                return false;
+            }
+            reflection->SetUInt32(&message, accessor.field, static_cast<uint32_t>(value));
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool FieldAccessorSetDouble(const FieldAccessor& accessor, Message& message, double value) {
+    if (message.GetDescriptor() != accessor.containing_type) {
+        return false;
+    }
+    const Reflection* reflection = message.GetReflection();
+    switch (accessor.cpp_type) {
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+            reflection->SetDouble(&message, accessor.field, value);
+            return true;
+        case FieldDescriptor::CPPTYPE_FLOAT:
+            reflection->SetFloat(&message, accessor.field, static_cast<float>(value));
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool FieldAccessorSetBool(const FieldAccessor& accessor, Message& message, bool value) {
+    if (message.GetDescriptor() != accessor.containing_type ||
+        accessor.cpp_type != FieldDescriptor::CPPTYPE_BOOL) {
+        return false;
+    }
+    message.GetReflection()->SetBool(&message, accessor.field, value);
+    return true;
+}
+
+bool FieldAccessorSetBytes(const FieldAccessor& accessor, Message& message,
+                           rust::Slice<const uint8_t> value) {
+    if (message.GetDescriptor() != accessor.containing_type ||
+        accessor.cpp_type != FieldDescriptor::CPPTYPE_STRING) {
+        return false;
+    }
+    message.GetReflection()->SetString(
+        &message, accessor.field,
+        std::string(reinterpret_cast<const char*>(value.data()), value.size()));
+    return true;
+}
+
+bool FieldAccessorClear(const FieldAccessor& accessor, Message& message) {
+    if (message.GetDescriptor() != accessor.containing_type) {
+        return false;
+    }
+    message.GetReflection()->ClearField(&message, accessor.field);
+    return true;
+}
+
 }  // namespace protobuf_native
@@ -16,29 +16,272 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
+#include "google/protobuf/arena.h"
 #include "google/protobuf/descriptor.h"
 #include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/descriptor_database.h"
+#include "google/protobuf/dynamic_message.h"
+#include "google/protobuf/field_mask.pb.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "rust/cxx.h"
 
 using namespace google::protobuf;
 
 namespace protobuf_native {
 
+struct AliasedRange;
+struct BuildFileError;
+struct BuildOptions;
+struct ByteRange;
+struct DescriptorDatabaseAdaptor;
+struct DescriptorDatabasePtr;
+struct DescriptorMemoryUsage;
+struct FileDescriptorProtoRef;
+struct MessageLitePtr;
+struct MessageLiteRef;
+struct PointerArray;
+struct ScalarArray;
+struct SourceLocationEntry;
+struct VisitedField;
+
+Arena* NewArena();
+Arena* NewArenaWithOptions(size_t start_block_size, size_t max_block_size, uint8_t* initial_block,
+                           size_t initial_block_size, void* block_alloc, void* block_dealloc);
+size_t ArenaOptionsDefaultStartBlockSize();
+size_t ArenaOptionsDefaultMaxBlockSize();
+void DeleteArena(Arena*);
+
 MessageLite* NewMessageLite(const MessageLite& message);
+MessageLite* NewMessageLiteInArena(const MessageLite& message, Arena* arena);
 void DeleteMessageLite(MessageLite*);
 
+Message* NewMessage(const Message& message);
+Message* NewMessageInArena(const Message& message, Arena* arena);
+void DeleteMessage(Message*);
+bool MessageMergeFromBytesWithMask(Message& message, rust::Slice<const uint8_t> data,
+                                   const FieldMask& mask);
+rust::Slice<const uint8_t> MessageGetStringField(const Message& message,
+                                                 const FieldDescriptor& field, int index,
+                                                 bool& ok);
+ScalarArray MessageGetRepeatedScalarField(const Message& message, const FieldDescriptor& field,
+                                          bool& ok);
+ScalarArray MessageMutableRepeatedScalarField(Message& message, const FieldDescriptor& field,
+                                              bool& ok);
+PointerArray MessageGetRepeatedStringField(const Message& message, const FieldDescriptor& field,
+                                           bool& ok);
+
+// Lists the set fields of one message at a time, with their values, for a
+// visitor in Rust to consume in a single call.
+struct FieldWalker;
+
+FieldWalker* NewFieldWalker();
+void DeleteFieldWalker(FieldWalker* walker);
+rust::Slice<const VisitedField> FieldWalkerWalk(FieldWalker& walker, const Message& message);
+
+bool MessageMergeFromBytesAliasing(Message& message, rust::Slice<const uint8_t> data,
+                                   rust::Slice<const int32_t> numbers,
+                                   rust::Vec<AliasedRange>& output);
+bool MessageMergeFromBytesDiscardingUnknownFields(Message& message,
+                                                  rust::Slice<const uint8_t> data);
+bool MessageMergeFromBytesWithRawUnknownFields(Message& message, rust::Slice<const uint8_t> data,
+                                               rust::Vec<uint8_t>& unknown);
+
+bool MessageRepeatedMessageFieldSize(const Message& message, const FieldDescriptor& field,
+                                     size_t& size);
+bool MessageRepeatedMessageSizes(const Message& message, const FieldDescriptor& field, int begin,
+                                 rust::Slice<size_t> sizes);
+bool MessageSerializeRepeatedMessages(const Message& message, const FieldDescriptor& field,
+                                      int begin, int count, bool deterministic, uint8_t* target,
+                                      size_t size);
+bool MessageAppendFieldsExceptToVec(const Message& message, const FieldDescriptor& excluded,
+                                    bool deterministic, rust::Vec<uint8_t>& output);
+bool MessageMergeFromBytesSplitting(Message& message, const FieldDescriptor& field,
+                                    rust::Slice<const uint8_t> data, size_t& first,
+                                    rust::Vec<ByteRange>& elements);
+
+// A serialization of a message that is produced a step at a time, each step
+// encoding one field, or one element of a repeated message field.
+struct ChunkedSerializer {
+    ChunkedSerializer(const Message& message, bool deterministic);
+
+    const Message& message;
+    bool deterministic;
+    std::vector<const FieldDescriptor*> fields;
+    // The next field to encode, and the next element if it is a repeated
+    // message field.
+    size_t field = 0;
+    int element = 0;
+    bool done = false;
+};
+
+ChunkedSerializer* NewChunkedSerializer(const Message& message, bool deterministic);
+void DeleteChunkedSerializer(ChunkedSerializer* serializer);
+bool ChunkedSerializerNext(ChunkedSerializer& serializer, size_t target,
+                           rust::Vec<uint8_t>& output, bool& done);
+bool MessageParseRepeatedMessages(Message* message, const FieldDescriptor& field, size_t first,
+                                  rust::Slice<const uint8_t> data,
+                                  rust::Slice<const ByteRange> elements);
+
+size_t MessageLiteSpaceUsedEstimate(const MessageLite& message);
+rust::String MessageLiteTypeName(const MessageLite& message);
+bool MessageLiteAppendToVec(const MessageLite& message, rust::Vec<uint8_t>& output,
+                            bool deterministic);
+bool MessageLiteAppendBatchToVec(rust::Slice<const MessageLiteRef> messages, bool delimited,
+                                 rust::Vec<uint8_t>& output);
+bool MessageLiteParseDelimitedBatch(const MessageLite& prototype, Arena* arena,
+                                    rust::Slice<const uint8_t> data,
+                                    rust::Vec<MessageLitePtr>& output);
+// Like util::ParseDelimitedFromCodedStream, but pops the limit it pushes for
+// the message even if parsing fails, so that it does not bound later reads
+// from `input`.
+bool MessageLiteParseDelimitedFromCodedStream(MessageLite* message, io::CodedInputStream* input,
+                                              bool* clean_eof);
+bool MessageLiteCopyFrom(MessageLite& to, const MessageLite& from);
+bool MessageLiteMergeFrom(MessageLite& to, const MessageLite& from);
+bool MessageSwap(Message& a, Message& b);
+bool MessageUnsafeArenaSwap(Message& a, Message& b);
+bool MessageAddAllocatedMessage(Message& message, const FieldDescriptor& field, Message* element);
+
+class RustDescriptorDatabase : public DescriptorDatabase {
+   public:
+    RustDescriptorDatabase(rust::Box<DescriptorDatabaseAdaptor> adaptor);
+
+    bool FindFileByName(const std::string& filename, FileDescriptorProto* output) override;
+    bool FindFileContainingSymbol(const std::string& symbol_name,
+                                  FileDescriptorProto* output) override;
+    bool FindFileContainingExtension(const std::string& containing_type, int field_number,
+                                     FileDescriptorProto* output) override;
+    bool FindAllFileNames(std::vector<std::string>* output) override;
+
+   private:
+    rust::Box<DescriptorDatabaseAdaptor> adaptor_;
+};
+
+DescriptorDatabase* NewRustDescriptorDatabase(rust::Box<DescriptorDatabaseAdaptor> adaptor);
+bool DescriptorDatabaseFindAllFileNames(DescriptorDatabase& database,
+                                        rust::Vec<rust::String>& output);
+
+// A MergedDescriptorDatabase that owns its sources.
+class OwningMergedDescriptorDatabase : public MergedDescriptorDatabase {
+   public:
+    OwningMergedDescriptorDatabase(std::vector<std::unique_ptr<DescriptorDatabase>> sources);
+
+   private:
+    std::vector<std::unique_ptr<DescriptorDatabase>> sources_;
+};
+
+MergedDescriptorDatabase* NewMergedDescriptorDatabase(
+    rust::Slice<const DescriptorDatabasePtr> sources);
+void DeleteMergedDescriptorDatabase(MergedDescriptorDatabase* database);
+
+EncodedDescriptorDatabase* NewEncodedDescriptorDatabase();
+void DeleteEncodedDescriptorDatabase(EncodedDescriptorDatabase* database);
+
 DescriptorPool* NewDescriptorPool();
+DescriptorPool* NewDescriptorPoolWithDatabase(rust::Box<DescriptorDatabaseAdaptor> adaptor);
+DescriptorPool* NewDescriptorPoolWithUnderlay(const DescriptorPool& underlay);
+const DescriptorPool& GeneratedDescriptorPool();
 void DeleteDescriptorPool(DescriptorPool*);
+bool DescriptorPoolHasDatabase(const DescriptorPool& pool);
+bool DescriptorPoolBuildFileSet(DescriptorPool& pool, const FileDescriptorSet& set,
+                                const BuildOptions& options, rust::Vec<BuildFileError>& errors);
+bool DescriptorPoolImageEncode(const FileDescriptorSet& set, rust::Vec<uint8_t>& output);
+bool DescriptorPoolImageFiles(rust::Slice<const uint8_t> image, rust::Vec<ByteRange>& files);
+bool DescriptorPoolBuildImage(DescriptorPool& pool, rust::Slice<const uint8_t> image,
+                              rust::Slice<const ByteRange> files, const BuildOptions& options,
+                              rust::Vec<BuildFileError>& errors);
+DescriptorMemoryUsage FileDescriptorMemoryUsage(const FileDescriptor& file);
 
 FileDescriptorSet* NewFileDescriptorSet();
 void DeleteFileDescriptorSet(FileDescriptorSet* set);
+void FileDescriptorSetAddAllocatedFile(FileDescriptorSet& set, FileDescriptorProto* file);
+void FileDescriptorSetCopyFiles(FileDescriptorSet& set,
+                                rust::Slice<const FileDescriptorProtoRef> files);
+PointerArray FileDescriptorSetFiles(const FileDescriptorSet& set);
 
 FileDescriptorProto* NewFileDescriptorProto();
 void DeleteFileDescriptorProto(FileDescriptorProto*);
+PointerArray FileDescriptorProtoDependencies(const FileDescriptorProto& proto);
+PointerArray FileDescriptorProtoMessageTypes(const FileDescriptorProto& proto);
+void FileDescriptorProtoSourceLocations(const FileDescriptorProto& proto,
+                                        rust::Vec<SourceLocationEntry>& locations);
+
+FieldMask* NewFieldMask();
+void DeleteFieldMask(FieldMask* mask);
+void FieldMaskAddPath(FieldMask& mask, absl::string_view path);
+
+struct FieldMaskTree;
+
+// A field mask compiled against a message type. The tree is owned by the
+// process-wide cache of compiled masks, so it outlives every compiled mask.
+struct CompiledFieldMask {
+    const Descriptor* descriptor;
+    const FieldMaskTree* tree;
+};
+
+CompiledFieldMask* NewCompiledFieldMask(const Descriptor& descriptor, const FieldMask& mask);
+void DeleteCompiledFieldMask(CompiledFieldMask* mask);
+bool CompiledFieldMaskMergeFromBytes(const CompiledFieldMask& mask, Message& message,
+                                     rust::Slice<const uint8_t> data);
+bool CompiledFieldMaskMergeMessageTo(const CompiledFieldMask& mask, const Message& source,
+                                     Message& destination, bool replace_message_fields,
+                                     bool replace_repeated_fields);
+bool CompiledFieldMaskTrimMessage(const CompiledFieldMask& mask, Message& message,
+                                  bool& modified);
 
 DescriptorProto* NewDescriptorProto();
 void DeleteDescriptorProto(DescriptorProto* proto);
 
 void DeleteFileDescriptor(FileDescriptor*);
 
+int FieldDescriptorType(const FieldDescriptor& field);
+
+DynamicMessageFactory* NewDynamicMessageFactory();
+void DeleteDynamicMessageFactory(DynamicMessageFactory*);
+
+// A view of a message type in which every submessage field is redeclared as a
+// bytes field, so that parsing into a message of the view's type keeps each
+// encoded submessage as raw bytes. The view's descriptor lives in a pool of
+// its own that uses the original type's pool as an underlay.
+struct LazyView {
+    LazyView(const Descriptor& original);
+
+    const Descriptor* original;
+    DescriptorPool pool;
+    const Descriptor* descriptor;
+};
+
+LazyView* NewLazyView(const Descriptor& descriptor);
+void DeleteLazyView(LazyView* view);
+const Descriptor& LazyViewDescriptor(const LazyView& view);
+bool LazyViewParseField(const LazyView& view, const Message& message, const FieldDescriptor& field,
+                        int index, Message& output);
+
+// A singular scalar field resolved once, so that it can be read and written in
+// many messages of its containing type with a single call per access.
+struct FieldAccessor {
+    const FieldDescriptor* field;
+    const Descriptor* containing_type;
+    FieldDescriptor::CppType cpp_type;
+};
+
+FieldAccessor* NewFieldAccessor(const FieldDescriptor& field);
+void DeleteFieldAccessor(FieldAccessor* accessor);
+bool FieldAccessorHas(const FieldAccessor& accessor, const Message& message, bool& ok);
+int64_t FieldAccessorGetInt64(const FieldAccessor& accessor, const Message& message, bool& ok);
+uint64_t FieldAccessorGetUInt64(const FieldAccessor& accessor, const Message& message, bool& ok);
+double FieldAccessorGetDouble(const FieldAccessor& accessor, const Message& message, bool& ok);
+bool FieldAccessorGetBool(const FieldAccessor& accessor, const Message& message, bool& ok);
+rust::Slice<const uint8_t> FieldAccessorGetBytes(const FieldAccessor& accessor,
+                                                 const Message& message, bool& ok);
+bool FieldAccessorSetInt64(const FieldAccessor& accessor, Message& message, int64_t value);
+bool FieldAccessorSetUInt64(const FieldAccessor& accessor, Message& message, uint64_t value);
+bool FieldAccessorSetDouble(const FieldAccessor& accessor, Message& message, double value);
+bool FieldAccessorSetBool(const FieldAccessor& accessor, Message& message, bool value);
+bool FieldAccessorSetBytes(const FieldAccessor& accessor, Message& message,
+                           rust::Slice<const uint8_t> value);
+bool FieldAccessorClear(const FieldAccessor& accessor, Message& message);
+
 }  // namespace protobuf_native
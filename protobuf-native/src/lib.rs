@@ -46,24 +46,168 @@
 //! [Materialize]: https://materialize.com
 //! [Protocol Buffers]: https://github.com/google/protobuf
 
+use std::collections::hash_map::Entry;
+use std::collections::HashMap;
 use std::error::Error;
 use std::fmt;
+use std::hash::{BuildHasherDefault, Hasher};
 use std::io::Write;
-use std::marker::PhantomPinned;
-use std::mem;
-use std::path::Path;
+use std::iter::Sum;
+use std::marker::{PhantomData, PhantomPinned};
+use std::mem::{self, MaybeUninit};
+use std::ops::{Add, Deref};
+use std::os::raw::{c_int, c_void};
+use std::path::{Path, PathBuf};
 use std::pin::Pin;
+use std::ptr;
+use std::slice;
+use std::sync::{Arc, OnceLock};
+use std::thread;
 
-use crate::internal::{unsafe_ffi_conversions, BoolExt, CInt};
-use crate::io::{CodedInputStream, CodedOutputStream, WriterStream, ZeroCopyOutputStream};
+use cxx::{let_cxx_string, CxxString};
 
+use crate::internal::{
+    unsafe_ffi_conversions, BoolExt, CInt, CVoid, DescriptorDatabaseAdaptor, ProtobufPath,
+};
+use crate::io::{
+    CodedInputStream, CodedOutputStream, WriterStream, ZeroCopyInputStream, ZeroCopyOutputStream,
+};
+
+#[cfg(feature = "rust-alloc")]
+mod alloc;
+pub mod any;
+#[cfg(feature = "arenaz")]
+pub mod arenaz;
+#[cfg(feature = "bench")]
+#[doc(hidden)]
+pub mod bench;
+#[cfg(feature = "tokio-util")]
+pub mod codec;
+pub mod columnar;
+pub mod compat;
 pub mod compiler;
+pub mod frozen;
 pub mod io;
+pub mod json;
+pub mod metrics;
+pub mod numa;
+pub mod pool;
+pub mod profile;
+#[cfg(feature = "protoc")]
+pub mod protoc;
+pub mod record;
+pub mod sample;
+#[cfg(feature = "serde_json")]
+pub mod struct_value;
+pub mod text_format;
+pub mod time_util;
+#[cfg(feature = "upb")]
+pub mod upb;
+pub mod util;
+pub mod wire;
 
 mod internal;
+mod trace;
 
 #[cxx::bridge(namespace = "protobuf_native")]
 pub(crate) mod ffi {
+    struct MessageLiteRef<'a> {
+        message: &'a MessageLite,
+    }
+
+    struct MessageLitePtr {
+        message: *mut MessageLite,
+    }
+
+    struct FileDescriptorProtoRef<'a> {
+        file: &'a FileDescriptorProto,
+    }
+
+    struct DescriptorDatabasePtr {
+        database: *mut DescriptorDatabase,
+    }
+
+    struct AliasedRange {
+        number: i32,
+        offset: usize,
+        len: usize,
+    }
+
+    struct ByteRange {
+        offset: usize,
+        len: usize,
+    }
+
+    #[derive(Clone, Copy)]
+    struct PointerArray {
+        data: *const CVoid,
+        len: usize,
+    }
+
+    #[derive(Clone, Copy)]
+    struct ScalarArray {
+        data: *mut CVoid,
+        len: usize,
+    }
+
+    struct SourceLocationEntry {
+        path: ScalarArray,
+        span: ScalarArray,
+        leading_comments: *const CxxString,
+        trailing_comments: *const CxxString,
+        leading_detached_comments: PointerArray,
+    }
+
+    struct VisitedField {
+        field: *const FieldDescriptor,
+        bits: u64,
+        data: *const CVoid,
+        len: usize,
+    }
+
+    struct BuildFileError {
+        filename: String,
+        element_name: String,
+        message: String,
+    }
+
+    struct BuildOptions {
+        retain_source_code_info: bool,
+        retain_custom_options: bool,
+    }
+
+    struct DescriptorMemoryUsage {
+        descriptors: usize,
+        names: usize,
+        options: usize,
+        source_code_info: usize,
+        features: usize,
+    }
+
+    extern "Rust" {
+        type DescriptorDatabaseAdaptor<'a>;
+        fn find_file_by_name(
+            self: &mut DescriptorDatabaseAdaptor<'_>,
+            filename: &CxxString,
+            output: Pin<&mut FileDescriptorProto>,
+        ) -> bool;
+        fn find_file_containing_symbol(
+            self: &mut DescriptorDatabaseAdaptor<'_>,
+            symbol_name: &CxxString,
+            output: Pin<&mut FileDescriptorProto>,
+        ) -> bool;
+        fn find_file_containing_extension(
+            self: &mut DescriptorDatabaseAdaptor<'_>,
+            containing_type: &CxxString,
+            field_number: i32,
+            output: Pin<&mut FileDescriptorProto>,
+        ) -> bool;
+        fn find_all_file_names(
+            self: &mut DescriptorDatabaseAdaptor<'_>,
+            output: &mut Vec<String>,
+        ) -> bool;
+    }
+
     unsafe extern "C++" {
         include!("protobuf-native/src/internal.h");
         include!("protobuf-native/src/lib.h");
@@ -71,6 +215,15 @@ pub(crate) mod ffi {
         #[namespace = "protobuf_native::internal"]
         type CInt = crate::internal::CInt;
 
+        #[namespace = "protobuf_native::internal"]
+        type CVoid = crate::internal::CVoid;
+
+        #[namespace = "absl"]
+        type string_view<'a> = crate::internal::StringView<'a>;
+
+        #[namespace = "google::protobuf::io"]
+        type ZeroCopyInputStream = crate::io::ffi::ZeroCopyInputStream;
+
         #[namespace = "google::protobuf::io"]
         type ZeroCopyOutputStream = crate::io::ffi::ZeroCopyOutputStream;
 
@@ -80,44 +233,423 @@ pub(crate) mod ffi {
         #[namespace = "google::protobuf::io"]
         type CodedOutputStream = crate::io::ffi::CodedOutputStream;
 
+        #[namespace = "google::protobuf"]
+        type Arena;
+
+        fn NewArena() -> *mut Arena;
+        unsafe fn NewArenaWithOptions(
+            start_block_size: usize,
+            max_block_size: usize,
+            initial_block: *mut u8,
+            initial_block_size: usize,
+            block_alloc: *mut CVoid,
+            block_dealloc: *mut CVoid,
+        ) -> *mut Arena;
+        fn ArenaOptionsDefaultStartBlockSize() -> usize;
+        fn ArenaOptionsDefaultMaxBlockSize() -> usize;
+        unsafe fn DeleteArena(arena: *mut Arena);
+        fn SpaceAllocated(self: &Arena) -> u64;
+        fn SpaceUsed(self: &Arena) -> u64;
+        fn Reset(self: Pin<&mut Arena>) -> u64;
+
         #[namespace = "google::protobuf"]
         type MessageLite;
 
         fn NewMessageLite(message: &MessageLite) -> *mut MessageLite;
+        unsafe fn NewMessageLiteInArena(
+            message: &MessageLite,
+            arena: *mut Arena,
+        ) -> *mut MessageLite;
         unsafe fn DeleteMessageLite(message: *mut MessageLite);
+        fn MessageLiteSpaceUsedEstimate(message: &MessageLite) -> usize;
+        fn MessageLiteTypeName(message: &MessageLite) -> String;
+        fn MessageLiteAppendToVec(
+            message: &MessageLite,
+            output: &mut Vec<u8>,
+            deterministic: bool,
+        ) -> bool;
+        fn MessageLiteAppendBatchToVec(
+            messages: &[MessageLiteRef],
+            delimited: bool,
+            output: &mut Vec<u8>,
+        ) -> bool;
+        unsafe fn MessageLiteParseDelimitedBatch(
+            prototype: &MessageLite,
+            arena: *mut Arena,
+            data: &[u8],
+            output: &mut Vec<MessageLitePtr>,
+        ) -> bool;
+        fn MessageLiteCopyFrom(to: Pin<&mut MessageLite>, from: &MessageLite) -> bool;
+        fn MessageLiteMergeFrom(to: Pin<&mut MessageLite>, from: &MessageLite) -> bool;
         fn Clear(self: Pin<&mut MessageLite>);
         fn IsInitialized(self: &MessageLite) -> bool;
+        fn ParseFromString(self: Pin<&mut MessageLite>, data: string_view) -> bool;
+        fn ParsePartialFromString(self: Pin<&mut MessageLite>, data: string_view) -> bool;
+        fn MergeFromString(self: Pin<&mut MessageLite>, data: string_view) -> bool;
         unsafe fn MergeFromCodedStream(
             self: Pin<&mut MessageLite>,
             input: *mut CodedInputStream,
         ) -> bool;
-        unsafe fn SerializeToCodedStream(
+        unsafe fn MergePartialFromCodedStream(
+            self: Pin<&mut MessageLite>,
+            input: *mut CodedInputStream,
+        ) -> bool;
+        unsafe fn ParsePartialFromCodedStream(
+            self: Pin<&mut MessageLite>,
+            input: *mut CodedInputStream,
+        ) -> bool;
+        unsafe fn ParsePartialFromZeroCopyStream(
+            self: Pin<&mut MessageLite>,
+            input: *mut ZeroCopyInputStream,
+        ) -> bool;
+        unsafe fn SerializePartialToCodedStream(
             self: &MessageLite,
             output: *mut CodedOutputStream,
         ) -> bool;
-        unsafe fn SerializeToZeroCopyStream(
+        unsafe fn SerializePartialToZeroCopyStream(
             self: &MessageLite,
             output: *mut ZeroCopyOutputStream,
         ) -> bool;
         fn ByteSizeLong(self: &MessageLite) -> usize;
+        fn GetCachedSize(self: &MessageLite) -> CInt;
+        unsafe fn SerializeWithCachedSizes(self: &MessageLite, output: *mut CodedOutputStream);
+        unsafe fn SerializeWithCachedSizesToArray(self: &MessageLite, target: *mut u8) -> *mut u8;
+
+        #[namespace = "google::protobuf::util"]
+        unsafe fn SerializeDelimitedToZeroCopyStream(
+            message: &MessageLite,
+            output: *mut ZeroCopyOutputStream,
+        ) -> bool;
+        #[namespace = "google::protobuf::util"]
+        unsafe fn SerializeDelimitedToCodedStream(
+            message: &MessageLite,
+            output: *mut CodedOutputStream,
+        ) -> bool;
+        #[namespace = "google::protobuf::util"]
+        unsafe fn ParseDelimitedFromZeroCopyStream(
+            message: *mut MessageLite,
+            input: *mut ZeroCopyInputStream,
+            clean_eof: *mut bool,
+        ) -> bool;
+        unsafe fn MessageLiteParseDelimitedFromCodedStream(
+            message: *mut MessageLite,
+            input: *mut CodedInputStream,
+            clean_eof: *mut bool,
+        ) -> bool;
 
         #[namespace = "google::protobuf"]
         type Message;
+        fn NewMessage(message: &Message) -> *mut Message;
+        unsafe fn NewMessageInArena(message: &Message, arena: *mut Arena) -> *mut Message;
+        unsafe fn DeleteMessage(message: *mut Message);
+        fn SpaceUsedLong(self: &Message) -> usize;
+        fn MessageSwap(a: Pin<&mut Message>, b: Pin<&mut Message>) -> bool;
+        fn MessageUnsafeArenaSwap(a: Pin<&mut Message>, b: Pin<&mut Message>) -> bool;
+        unsafe fn MessageAddAllocatedMessage(
+            message: Pin<&mut Message>,
+            field: &FieldDescriptor,
+            element: *mut Message,
+        ) -> bool;
+        fn MessageMergeFromBytesWithMask(
+            message: Pin<&mut Message>,
+            data: &[u8],
+            mask: &FieldMask,
+        ) -> bool;
+        fn MessageGetStringField<'a>(
+            message: &'a Message,
+            field: &FieldDescriptor,
+            index: CInt,
+            ok: &mut bool,
+        ) -> &'a [u8];
+        fn MessageGetRepeatedScalarField(
+            message: &Message,
+            field: &FieldDescriptor,
+            ok: &mut bool,
+        ) -> ScalarArray;
+        fn MessageMutableRepeatedScalarField(
+            message: Pin<&mut Message>,
+            field: &FieldDescriptor,
+            ok: &mut bool,
+        ) -> ScalarArray;
+        fn MessageGetRepeatedStringField(
+            message: &Message,
+            field: &FieldDescriptor,
+            ok: &mut bool,
+        ) -> PointerArray;
+        fn MessageMergeFromBytesAliasing(
+            message: Pin<&mut Message>,
+            data: &[u8],
+            numbers: &[i32],
+            output: &mut Vec<AliasedRange>,
+        ) -> bool;
+        fn MessageRepeatedMessageFieldSize(
+            message: &Message,
+            field: &FieldDescriptor,
+            size: &mut usize,
+        ) -> bool;
+        fn MessageRepeatedMessageSizes(
+            message: &Message,
+            field: &FieldDescriptor,
+            begin: CInt,
+            sizes: &mut [usize],
+        ) -> bool;
+        unsafe fn MessageSerializeRepeatedMessages(
+            message: &Message,
+            field: &FieldDescriptor,
+            begin: CInt,
+            count: CInt,
+            deterministic: bool,
+            target: *mut u8,
+            size: usize,
+        ) -> bool;
+        fn MessageAppendFieldsExceptToVec(
+            message: &Message,
+            excluded: &FieldDescriptor,
+            deterministic: bool,
+            output: &mut Vec<u8>,
+        ) -> bool;
+        fn MessageMergeFromBytesSplitting(
+            message: Pin<&mut Message>,
+            field: &FieldDescriptor,
+            data: &[u8],
+            first: &mut usize,
+            elements: &mut Vec<ByteRange>,
+        ) -> bool;
+        unsafe fn MessageParseRepeatedMessages(
+            message: *mut Message,
+            field: &FieldDescriptor,
+            first: usize,
+            data: &[u8],
+            elements: &[ByteRange],
+        ) -> bool;
+
+        type FieldWalker;
+        fn NewFieldWalker() -> *mut FieldWalker;
+        unsafe fn DeleteFieldWalker(walker: *mut FieldWalker);
+        fn FieldWalkerWalk<'a>(
+            walker: Pin<&'a mut FieldWalker>,
+            message: &'a Message,
+        ) -> &'a [VisitedField];
+
+        type ChunkedSerializer;
+        fn NewChunkedSerializer(message: &Message, deterministic: bool) -> *mut ChunkedSerializer;
+        unsafe fn DeleteChunkedSerializer(serializer: *mut ChunkedSerializer);
+        fn ChunkedSerializerNext(
+            serializer: Pin<&mut ChunkedSerializer>,
+            target: usize,
+            output: &mut Vec<u8>,
+            done: &mut bool,
+        ) -> bool;
+        fn MessageMergeFromBytesDiscardingUnknownFields(
+            message: Pin<&mut Message>,
+            data: &[u8],
+        ) -> bool;
+        fn MessageMergeFromBytesWithRawUnknownFields(
+            message: Pin<&mut Message>,
+            data: &[u8],
+            unknown: &mut Vec<u8>,
+        ) -> bool;
 
         #[namespace = "google::protobuf"]
         type FileDescriptor;
 
         unsafe fn DeleteFileDescriptor(proto: *mut FileDescriptor);
+        fn name(self: &FileDescriptor) -> &CxxString;
+        fn message_type_count(self: &FileDescriptor) -> CInt;
+        fn message_type(self: &FileDescriptor, index: CInt) -> *const Descriptor;
+        unsafe fn CopyTo(self: &FileDescriptor, proto: *mut FileDescriptorProto);
+        unsafe fn CopySourceCodeInfoTo(self: &FileDescriptor, proto: *mut FileDescriptorProto);
+        fn FileDescriptorMemoryUsage(file: &FileDescriptor) -> DescriptorMemoryUsage;
+
+        #[namespace = "google::protobuf"]
+        type Descriptor;
+
+        fn name(self: &Descriptor) -> &CxxString;
+        fn full_name(self: &Descriptor) -> &CxxString;
+        fn field_count(self: &Descriptor) -> CInt;
+        fn field(self: &Descriptor, index: CInt) -> *const FieldDescriptor;
+        fn FindFieldByName(self: &Descriptor, name: string_view) -> *const FieldDescriptor;
+        fn FindFieldByNumber(self: &Descriptor, number: CInt) -> *const FieldDescriptor;
+        fn nested_type_count(self: &Descriptor) -> CInt;
+        fn nested_type(self: &Descriptor, index: CInt) -> *const Descriptor;
+
+        #[namespace = "google::protobuf"]
+        type FieldDescriptor;
+
+        fn name(self: &FieldDescriptor) -> &CxxString;
+        fn full_name(self: &FieldDescriptor) -> &CxxString;
+        fn number(self: &FieldDescriptor) -> CInt;
+        fn index(self: &FieldDescriptor) -> CInt;
+        fn is_repeated(self: &FieldDescriptor) -> bool;
+        fn is_required(self: &FieldDescriptor) -> bool;
+        fn is_extension(self: &FieldDescriptor) -> bool;
+        fn requires_utf8_validation(self: &FieldDescriptor) -> bool;
+        fn has_presence(self: &FieldDescriptor) -> bool;
+        fn containing_type(self: &FieldDescriptor) -> *const Descriptor;
+        fn message_type(self: &FieldDescriptor) -> *const Descriptor;
+        fn FieldDescriptorType(field: &FieldDescriptor) -> CInt;
+
+        #[namespace = "google::protobuf"]
+        type EncodedDescriptorDatabase;
+
+        fn NewEncodedDescriptorDatabase() -> *mut EncodedDescriptorDatabase;
+        unsafe fn DeleteEncodedDescriptorDatabase(database: *mut EncodedDescriptorDatabase);
+        unsafe fn Add(
+            self: Pin<&mut EncodedDescriptorDatabase>,
+            encoded_file_descriptor: *const CVoid,
+            size: CInt,
+        ) -> bool;
+        unsafe fn AddCopy(
+            self: Pin<&mut EncodedDescriptorDatabase>,
+            encoded_file_descriptor: *const CVoid,
+            size: CInt,
+        ) -> bool;
+
+        #[namespace = "google::protobuf"]
+        type MergedDescriptorDatabase;
+
+        unsafe fn NewMergedDescriptorDatabase(
+            sources: &[DescriptorDatabasePtr],
+        ) -> *mut MergedDescriptorDatabase;
+        unsafe fn DeleteMergedDescriptorDatabase(database: *mut MergedDescriptorDatabase);
+
+        #[namespace = "google::protobuf"]
+        type DescriptorDatabase;
+
+        fn NewRustDescriptorDatabase(
+            adaptor: Box<DescriptorDatabaseAdaptor<'_>>,
+        ) -> *mut DescriptorDatabase;
+        unsafe fn FindFileByName(
+            self: Pin<&mut DescriptorDatabase>,
+            filename: &CxxString,
+            output: *mut FileDescriptorProto,
+        ) -> bool;
+        unsafe fn FindFileContainingSymbol(
+            self: Pin<&mut DescriptorDatabase>,
+            symbol_name: &CxxString,
+            output: *mut FileDescriptorProto,
+        ) -> bool;
+        unsafe fn FindFileContainingExtension(
+            self: Pin<&mut DescriptorDatabase>,
+            containing_type: &CxxString,
+            field_number: CInt,
+            output: *mut FileDescriptorProto,
+        ) -> bool;
+        fn DescriptorDatabaseFindAllFileNames(
+            database: Pin<&mut DescriptorDatabase>,
+            output: &mut Vec<String>,
+        ) -> bool;
 
         #[namespace = "google::protobuf"]
         type DescriptorPool;
 
         fn NewDescriptorPool() -> *mut DescriptorPool;
+        fn NewDescriptorPoolWithDatabase(
+            adaptor: Box<DescriptorDatabaseAdaptor<'_>>,
+        ) -> *mut DescriptorPool;
+        fn NewDescriptorPoolWithUnderlay(underlay: &DescriptorPool) -> *mut DescriptorPool;
+        fn GeneratedDescriptorPool() -> &'static DescriptorPool;
         unsafe fn DeleteDescriptorPool(proto: *mut DescriptorPool);
+        fn DescriptorPoolHasDatabase(pool: &DescriptorPool) -> bool;
+        fn DescriptorPoolBuildFileSet(
+            pool: Pin<&mut DescriptorPool>,
+            set: &FileDescriptorSet,
+            options: &BuildOptions,
+            errors: &mut Vec<BuildFileError>,
+        ) -> bool;
+        fn DescriptorPoolImageEncode(set: &FileDescriptorSet, output: &mut Vec<u8>) -> bool;
+        fn DescriptorPoolImageFiles(image: &[u8], files: &mut Vec<ByteRange>) -> bool;
+        fn DescriptorPoolBuildImage(
+            pool: Pin<&mut DescriptorPool>,
+            image: &[u8],
+            files: &[ByteRange],
+            options: &BuildOptions,
+            errors: &mut Vec<BuildFileError>,
+        ) -> bool;
         fn BuildFile(
             self: Pin<&mut DescriptorPool>,
             proto: &FileDescriptorProto,
         ) -> *const FileDescriptor;
+        fn FindFileByName(self: &DescriptorPool, name: string_view) -> *const FileDescriptor;
+        fn FindFileContainingSymbol(
+            self: &DescriptorPool,
+            symbol_name: string_view,
+        ) -> *const FileDescriptor;
+        fn FindMessageTypeByName(self: &DescriptorPool, name: string_view) -> *const Descriptor;
+
+        #[namespace = "google::protobuf"]
+        type DynamicMessageFactory;
+
+        fn NewDynamicMessageFactory() -> *mut DynamicMessageFactory;
+        unsafe fn DeleteDynamicMessageFactory(factory: *mut DynamicMessageFactory);
+        unsafe fn GetPrototype(
+            self: Pin<&mut DynamicMessageFactory>,
+            descriptor: *const Descriptor,
+        ) -> *const Message;
+
+        type LazyView;
+
+        fn NewLazyView(descriptor: &Descriptor) -> *mut LazyView;
+        unsafe fn DeleteLazyView(view: *mut LazyView);
+        fn LazyViewDescriptor(view: &LazyView) -> &Descriptor;
+        fn LazyViewParseField(
+            view: &LazyView,
+            message: &Message,
+            field: &FieldDescriptor,
+            index: CInt,
+            output: Pin<&mut Message>,
+        ) -> bool;
+
+        type FieldAccessor;
+
+        fn NewFieldAccessor(field: &FieldDescriptor) -> *mut FieldAccessor;
+        unsafe fn DeleteFieldAccessor(accessor: *mut FieldAccessor);
+        fn FieldAccessorHas(accessor: &FieldAccessor, message: &Message, ok: &mut bool) -> bool;
+        fn FieldAccessorGetInt64(accessor: &FieldAccessor, message: &Message, ok: &mut bool)
+            -> i64;
+        fn FieldAccessorGetUInt64(
+            accessor: &FieldAccessor,
+            message: &Message,
+            ok: &mut bool,
+        ) -> u64;
+        fn FieldAccessorGetDouble(
+            accessor: &FieldAccessor,
+            message: &Message,
+            ok: &mut bool,
+        ) -> f64;
+        fn FieldAccessorGetBool(accessor: &FieldAccessor, message: &Message, ok: &mut bool)
+            -> bool;
+        fn FieldAccessorGetBytes<'a>(
+            accessor: &FieldAccessor,
+            message: &'a Message,
+            ok: &mut bool,
+        ) -> &'a [u8];
+        fn FieldAccessorSetInt64(
+            accessor: &FieldAccessor,
+            message: Pin<&mut Message>,
+            value: i64,
+        ) -> bool;
+        fn FieldAccessorSetUInt64(
+            accessor: &FieldAccessor,
+            message: Pin<&mut Message>,
+            value: u64,
+        ) -> bool;
+        fn FieldAccessorSetDouble(
+            accessor: &FieldAccessor,
+            message: Pin<&mut Message>,
+            value: f64,
+        ) -> bool;
+        fn FieldAccessorSetBool(
+            accessor: &FieldAccessor,
+            message: Pin<&mut Message>,
+            value: bool,
+        ) -> bool;
+        fn FieldAccessorSetBytes(
+            accessor: &FieldAccessor,
+            message: Pin<&mut Message>,
+            value: &[u8],
+        ) -> bool;
+        fn FieldAccessorClear(accessor: &FieldAccessor, message: Pin<&mut Message>) -> bool;
 
         #[namespace = "google::protobuf"]
         type FileDescriptorSet;
@@ -129,6 +661,15 @@ pub(crate) mod ffi {
         fn file(self: &FileDescriptorSet, i: CInt) -> &FileDescriptorProto;
         fn mutable_file(self: Pin<&mut FileDescriptorSet>, i: CInt) -> *mut FileDescriptorProto;
         fn add_file(self: Pin<&mut FileDescriptorSet>) -> *mut FileDescriptorProto;
+        fn FileDescriptorSetFiles(set: &FileDescriptorSet) -> PointerArray;
+        fn FileDescriptorSetCopyFiles(
+            set: Pin<&mut FileDescriptorSet>,
+            files: &[FileDescriptorProtoRef],
+        );
+        unsafe fn FileDescriptorSetAddAllocatedFile(
+            set: Pin<&mut FileDescriptorSet>,
+            file: *mut FileDescriptorProto,
+        );
 
         #[namespace = "google::protobuf"]
         type FileDescriptorProto;
@@ -137,10 +678,53 @@ pub(crate) mod ffi {
         unsafe fn DeleteFileDescriptorProto(proto: *mut FileDescriptorProto);
         fn CopyFrom(self: Pin<&mut FileDescriptorProto>, from: &FileDescriptorProto);
         fn MergeFrom(self: Pin<&mut FileDescriptorProto>, from: &FileDescriptorProto);
+        fn name(self: &FileDescriptorProto) -> &CxxString;
         fn dependency_size(self: &FileDescriptorProto) -> CInt;
         fn dependency(self: &FileDescriptorProto, i: CInt) -> &CxxString;
         fn message_type_size(self: &FileDescriptorProto) -> CInt;
         fn message_type(self: &FileDescriptorProto, i: CInt) -> &DescriptorProto;
+        fn FileDescriptorProtoDependencies(proto: &FileDescriptorProto) -> PointerArray;
+        fn FileDescriptorProtoMessageTypes(proto: &FileDescriptorProto) -> PointerArray;
+        fn FileDescriptorProtoSourceLocations(
+            proto: &FileDescriptorProto,
+            locations: &mut Vec<SourceLocationEntry>,
+        );
+        fn has_source_code_info(self: &FileDescriptorProto) -> bool;
+        fn clear_source_code_info(self: Pin<&mut FileDescriptorProto>);
+
+        #[namespace = "google::protobuf"]
+        type FieldMask;
+
+        fn NewFieldMask() -> *mut FieldMask;
+        unsafe fn DeleteFieldMask(mask: *mut FieldMask);
+        fn paths_size(self: &FieldMask) -> CInt;
+        fn paths(self: &FieldMask, i: CInt) -> &CxxString;
+        fn clear_paths(self: Pin<&mut FieldMask>);
+        fn FieldMaskAddPath(mask: Pin<&mut FieldMask>, path: string_view);
+
+        type CompiledFieldMask;
+        fn NewCompiledFieldMask(
+            descriptor: &Descriptor,
+            mask: &FieldMask,
+        ) -> *mut CompiledFieldMask;
+        unsafe fn DeleteCompiledFieldMask(mask: *mut CompiledFieldMask);
+        fn CompiledFieldMaskMergeFromBytes(
+            mask: &CompiledFieldMask,
+            message: Pin<&mut Message>,
+            data: &[u8],
+        ) -> bool;
+        fn CompiledFieldMaskMergeMessageTo(
+            mask: &CompiledFieldMask,
+            source: &Message,
+            destination: Pin<&mut Message>,
+            replace_message_fields: bool,
+            replace_repeated_fields: bool,
+        ) -> bool;
+        fn CompiledFieldMaskTrimMessage(
+            mask: &CompiledFieldMask,
+            message: Pin<&mut Message>,
+            modified: &mut bool,
+        ) -> bool;
 
         #[namespace = "google::protobuf"]
         type DescriptorProto;
@@ -165,6 +749,14 @@ mod private {
     pub trait Message {}
 }
 
+// Used by the wrappers generated by `protoc::CodeGenerator::rust_wrappers`,
+// which live in other crates. Not public API.
+#[doc(hidden)]
+pub mod __private {
+    pub use super::ffi::{Message as FfiMessage, MessageLite as FfiMessageLite};
+    pub use super::private::{Message, MessageLite};
+}
+
 /// Abstract interface for a database of descriptors.
 ///
 /// This is useful if you want to create a [`DescriptorPool`] which loads
@@ -179,6 +771,264 @@ pub trait DescriptorDatabase {
         self: Pin<&mut Self>,
         filename: &Path,
     ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError>;
+
+    /// Finds the file that declares the given fully-qualified symbol name.
+    ///
+    /// The default implementation always fails, in which case a
+    /// [`DescriptorPool`] backed by the database can only find symbols in
+    /// files that have already been loaded by name.
+    fn find_file_containing_symbol(
+        self: Pin<&mut Self>,
+        symbol_name: &str,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        let _ = symbol_name;
+        Err(OperationFailedError)
+    }
+
+    /// Finds the file that declares the extension of `containing_type` with
+    /// the given field number.
+    ///
+    /// The default implementation always fails.
+    fn find_file_containing_extension(
+        self: Pin<&mut Self>,
+        containing_type: &str,
+        field_number: i32,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        let _ = (containing_type, field_number);
+        Err(OperationFailedError)
+    }
+
+    /// Returns the names of all files in the database.
+    ///
+    /// The default implementation always fails, indicating that the database
+    /// does not support enumeration.
+    fn find_all_file_names(self: Pin<&mut Self>) -> Result<Vec<PathBuf>, OperationFailedError> {
+        Err(OperationFailedError)
+    }
+}
+
+// Implementations of the `DescriptorDatabase` methods for bindings to C++
+// subclasses of `DescriptorDatabase`.
+
+fn cxx_find_file_by_name(
+    database: Pin<&mut ffi::DescriptorDatabase>,
+    filename: &Path,
+) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+    let mut fd = FileDescriptorProto::new();
+    let_cxx_string!(filename = ProtobufPath::from(filename).as_bytes());
+    unsafe {
+        database
+            .FindFileByName(&filename, fd.as_mut().as_ffi_mut_ptr())
+            .as_result()?;
+    }
+    Ok(fd)
+}
+
+fn cxx_find_file_containing_symbol(
+    database: Pin<&mut ffi::DescriptorDatabase>,
+    symbol_name: &str,
+) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+    let mut fd = FileDescriptorProto::new();
+    let_cxx_string!(symbol_name = symbol_name);
+    unsafe {
+        database
+            .FindFileContainingSymbol(&symbol_name, fd.as_mut().as_ffi_mut_ptr())
+            .as_result()?;
+    }
+    Ok(fd)
+}
+
+fn cxx_find_file_containing_extension(
+    database: Pin<&mut ffi::DescriptorDatabase>,
+    containing_type: &str,
+    field_number: i32,
+) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+    let mut fd = FileDescriptorProto::new();
+    let_cxx_string!(containing_type = containing_type);
+    unsafe {
+        database
+            .FindFileContainingExtension(
+                &containing_type,
+                CInt(field_number),
+                fd.as_mut().as_ffi_mut_ptr(),
+            )
+            .as_result()?;
+    }
+    Ok(fd)
+}
+
+fn cxx_find_all_file_names(
+    database: Pin<&mut ffi::DescriptorDatabase>,
+) -> Result<Vec<PathBuf>, OperationFailedError> {
+    let mut names = vec![];
+    ffi::DescriptorDatabaseFindAllFileNames(database, &mut names).as_result()?;
+    Ok(names
+        .iter()
+        .map(|name| {
+            ProtobufPath::from(name.as_bytes())
+                .as_path()
+                .as_ref()
+                .to_path_buf()
+        })
+        .collect())
+}
+
+/// A [`DescriptorDatabase`] that stores serialized `FileDescriptorProto`s.
+///
+/// Files are indexed by name and by the symbols they declare when they are
+/// added, but are only parsed when they are looked up. A large registry of
+/// files held as serialized bytes occupies far less memory than the same
+/// files held as [`FileDescriptorProto`]s, and is typically used to back a
+/// lazily loading [`DescriptorPool`].
+pub struct EncodedDescriptorDatabase<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for EncodedDescriptorDatabase<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteEncodedDescriptorDatabase(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> EncodedDescriptorDatabase<'a> {
+    /// Creates a new, empty database.
+    pub fn new() -> Pin<Box<EncodedDescriptorDatabase<'a>>> {
+        let database = ffi::NewEncodedDescriptorDatabase();
+        unsafe { Self::from_ffi_owned(database) }
+    }
+
+    /// Adds a serialized `FileDescriptorProto` to the database, without
+    /// copying it.
+    ///
+    /// Returns an error if the file could not be indexed, or if it conflicts
+    /// with a file already in the database.
+    pub fn add(self: Pin<&mut Self>, encoded_file: &'a [u8]) -> Result<(), OperationFailedError> {
+        let size = CInt::try_from(encoded_file.len()).map_err(|_| OperationFailedError)?;
+        unsafe {
+            self.as_ffi_mut()
+                .Add(encoded_file.as_ptr() as *const CVoid, size)
+                .as_result()
+        }
+    }
+
+    /// Like [`EncodedDescriptorDatabase::add`], but copies the serialized
+    /// file into the database.
+    pub fn add_copy(self: Pin<&mut Self>, encoded_file: &[u8]) -> Result<(), OperationFailedError> {
+        let size = CInt::try_from(encoded_file.len()).map_err(|_| OperationFailedError)?;
+        unsafe {
+            self.as_ffi_mut()
+                .AddCopy(encoded_file.as_ptr() as *const CVoid, size)
+                .as_result()
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::EncodedDescriptorDatabase);
+}
+
+impl<'a> EncodedDescriptorDatabase<'a> {
+    fn upcast_database(self: Pin<&mut Self>) -> Pin<&mut ffi::DescriptorDatabase> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+impl<'a> DescriptorDatabase for EncodedDescriptorDatabase<'a> {
+    fn find_file_by_name(
+        self: Pin<&mut Self>,
+        filename: &Path,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        cxx_find_file_by_name(self.upcast_database(), filename)
+    }
+
+    fn find_file_containing_symbol(
+        self: Pin<&mut Self>,
+        symbol_name: &str,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        cxx_find_file_containing_symbol(self.upcast_database(), symbol_name)
+    }
+
+    fn find_file_containing_extension(
+        self: Pin<&mut Self>,
+        containing_type: &str,
+        field_number: i32,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        cxx_find_file_containing_extension(self.upcast_database(), containing_type, field_number)
+    }
+
+    fn find_all_file_names(self: Pin<&mut Self>) -> Result<Vec<PathBuf>, OperationFailedError> {
+        cxx_find_all_file_names(self.upcast_database())
+    }
+}
+
+/// A [`DescriptorDatabase`] that layers several other databases.
+///
+/// Each lookup tries the sources in order and returns the first result.
+/// Symbol and extension lookups skip a file found in one source if an
+/// earlier source contains a different file of the same name, so that earlier
+/// sources override later ones. The list of all file names concatenates the
+/// lists of every source that supports enumeration.
+pub struct MergedDescriptorDatabase<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for MergedDescriptorDatabase<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMergedDescriptorDatabase(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> MergedDescriptorDatabase<'a> {
+    /// Creates a database that merges `sources`, in order of precedence.
+    pub fn new(
+        sources: Vec<Pin<&'a mut (dyn DescriptorDatabase + Send + 'a)>>,
+    ) -> Pin<Box<MergedDescriptorDatabase<'a>>> {
+        let sources: Vec<_> = sources
+            .into_iter()
+            .map(|source| ffi::DescriptorDatabasePtr {
+                database: ffi::NewRustDescriptorDatabase(Box::new(DescriptorDatabaseAdaptor(
+                    source,
+                ))),
+            })
+            .collect();
+        // SAFETY: the merged database takes ownership of the sources.
+        let database = unsafe { ffi::NewMergedDescriptorDatabase(&sources) };
+        unsafe { Self::from_ffi_owned(database) }
+    }
+
+    fn upcast_database(self: Pin<&mut Self>) -> Pin<&mut ffi::DescriptorDatabase> {
+        unsafe { mem::transmute(self) }
+    }
+
+    unsafe_ffi_conversions!(ffi::MergedDescriptorDatabase);
+}
+
+impl<'a> DescriptorDatabase for MergedDescriptorDatabase<'a> {
+    fn find_file_by_name(
+        self: Pin<&mut Self>,
+        filename: &Path,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        cxx_find_file_by_name(self.upcast_database(), filename)
+    }
+
+    fn find_file_containing_symbol(
+        self: Pin<&mut Self>,
+        symbol_name: &str,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        cxx_find_file_containing_symbol(self.upcast_database(), symbol_name)
+    }
+
+    fn find_file_containing_extension(
+        self: Pin<&mut Self>,
+        containing_type: &str,
+        field_number: i32,
+    ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+        cxx_find_file_containing_extension(self.upcast_database(), containing_type, field_number)
+    }
+
+    fn find_all_file_names(self: Pin<&mut Self>) -> Result<Vec<PathBuf>, OperationFailedError> {
+        cxx_find_all_file_names(self.upcast_database())
+    }
 }
 
 /// Describes a whole .proto file.
@@ -191,6 +1041,62 @@ pub struct FileDescriptor {
 }
 
 impl FileDescriptor {
+    /// Returns the name of the file, relative to the root of the source tree.
+    pub fn name(&self) -> &[u8] {
+        self.as_ffi().name().as_bytes()
+    }
+
+    /// Returns the number of top-level message types defined in this file.
+    pub fn message_type_count(&self) -> usize {
+        self.as_ffi().message_type_count().expect_usize()
+    }
+
+    /// Returns the `i`th top-level message type defined in this file.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `i` is out of bounds.
+    pub fn message_type(&self, i: usize) -> &Descriptor {
+        if i >= self.message_type_count() {
+            panic!(
+                "index out of bounds: the length is {} but the index is {}",
+                self.message_type_count(),
+                i
+            );
+        }
+        let descriptor = self.as_ffi().message_type(CInt::expect_from(i));
+        unsafe { Descriptor::from_ffi_ptr(descriptor) }
+    }
+
+    /// Writes this file's definition into `proto`, which must be empty,
+    /// without its source code info.
+    pub fn copy_to(&self, proto: Pin<&mut FileDescriptorProto>) {
+        unsafe { self.as_ffi().CopyTo(proto.as_ffi_mut_ptr()) }
+    }
+
+    /// Writes this file's source code info into the `source_code_info`
+    /// field of `proto`.
+    ///
+    /// The file only has source code info if the pool that built it was
+    /// given it.
+    pub fn copy_source_code_info_to(&self, proto: Pin<&mut FileDescriptorProto>) {
+        unsafe { self.as_ffi().CopySourceCodeInfoTo(proto.as_ffi_mut_ptr()) }
+    }
+
+    /// Returns an index of the source locations of this file's elements,
+    /// which is built on the first lookup.
+    pub fn source_code_index(&self) -> SourceCodeIndex<'_> {
+        SourceCodeIndex::new(SourceCodeIndexSource::File(self))
+    }
+
+    /// Estimates the memory that the descriptors of this file take up in
+    /// their pool.
+    ///
+    /// Sum the usage of every file in a pool for the usage of the pool.
+    pub fn memory_usage(&self) -> MemoryUsage {
+        ffi::FileDescriptorMemoryUsage(self.as_ffi()).into()
+    }
+
     unsafe_ffi_conversions!(ffi::FileDescriptor);
 }
 
@@ -224,22 +1130,80 @@ impl Drop for FileDescriptor {
 ///
 /// You can also search for descriptors within a `DescriptorPool` by name, and
 /// extensions by number.
-pub struct DescriptorPool {
+///
+/// A pool may also be backed by a [`DescriptorDatabase`], in which case files
+/// are loaded from the database and built on demand, the first time they, or
+/// a symbol they declare, are looked up. See [`DescriptorPool::with_database`].
+///
+/// Lookups may be performed concurrently from multiple threads. To share a
+/// pool between threads, convert it into a [`SharedDescriptorPool`] with
+/// [`DescriptorPool::into_shared`].
+pub struct DescriptorPool<'a> {
     _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
 }
 
-impl Drop for DescriptorPool {
+// SAFETY: the C++ `DescriptorPool` permits lookups from multiple threads at
+// once; only `BuildFile`, which requires a mutable reference, does not. When
+// the pool is backed by a database, lookups that load files from the database
+// hold the pool's mutex, so the database, which must be `Send`, is only ever
+// called by one thread at a time.
+unsafe impl<'a> Send for DescriptorPool<'a> {}
+unsafe impl<'a> Sync for DescriptorPool<'a> {}
+
+impl<'a> Drop for DescriptorPool<'a> {
     fn drop(&mut self) {
         unsafe { ffi::DeleteDescriptorPool(self.as_ffi_mut_ptr_unpinned()) }
     }
 }
 
-impl DescriptorPool {
-    pub fn new() -> Pin<Box<DescriptorPool>> {
+impl<'a> DescriptorPool<'a> {
+    pub fn new() -> Pin<Box<DescriptorPool<'a>>> {
         let pool = ffi::NewDescriptorPool();
         unsafe { Self::from_ffi_owned(pool) }
     }
 
+    /// Creates a pool that loads files from `database` as they are needed.
+    ///
+    /// Rather than building every file in a large database up front, the pool
+    /// calls [`DescriptorDatabase::find_file_by_name`] the first time a file is
+    /// looked up by name, and
+    /// [`DescriptorDatabase::find_file_containing_symbol`] the first time an
+    /// unknown symbol is looked up, and builds only the returned file and its
+    /// dependencies.
+    ///
+    /// Files cannot be added to the pool with [`DescriptorPool::build_file`].
+    pub fn with_database(
+        database: Pin<&'a mut (dyn DescriptorDatabase + Send + 'a)>,
+    ) -> Pin<Box<DescriptorPool<'a>>> {
+        let adaptor = Box::new(DescriptorDatabaseAdaptor(database));
+        let pool = ffi::NewDescriptorPoolWithDatabase(adaptor);
+        unsafe { Self::from_ffi_owned(pool) }
+    }
+
+    /// Creates a pool layered over `underlay`.
+    ///
+    /// Lookups in the new pool fall back to `underlay`, and files built in
+    /// the new pool may depend on files in `underlay`. Files that `underlay`
+    /// contains are not built again by [`DescriptorPool::build_file_set`] or
+    /// [`DescriptorPool::build_image`], so pools layered over
+    /// [`DescriptorPool::generated`] share a single copy of descriptor.proto
+    /// and the well-known types.
+    pub fn with_underlay(underlay: &'a DescriptorPool<'_>) -> Pin<Box<DescriptorPool<'a>>> {
+        let pool = ffi::NewDescriptorPoolWithUnderlay(underlay.as_ffi());
+        unsafe { Self::from_ffi_owned(pool) }
+    }
+
+    /// Returns the pool of the files compiled into libprotobuf, which are
+    /// descriptor.proto and the well-known types, like
+    /// `google/protobuf/timestamp.proto`.
+    ///
+    /// Files are built in the generated pool the first time they are looked
+    /// up.
+    pub fn generated() -> &'static DescriptorPool<'static> {
+        DescriptorPool::from_ffi_ref(ffi::GeneratedDescriptorPool())
+    }
+
     /// Converts the `FileDescriptorProto` to real descriptors and places them
     /// in this descriptor pool.
     ///
@@ -247,185 +1211,3150 @@ impl DescriptorPool {
     /// resulting [`FileDescriptor`], or `None` if there were problems with the
     /// input (e.g. the message was invalid, or dependencies were missing).
     /// Details about the errors are written to the error log.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the pool is backed by a [`DescriptorDatabase`].
     pub fn build_file(self: Pin<&mut Self>, proto: &FileDescriptorProto) -> &FileDescriptor {
+        if ffi::DescriptorPoolHasDatabase(self.as_ref().get_ref().as_ffi()) {
+            panic!("cannot build files in a DescriptorPool backed by a DescriptorDatabase");
+        }
+        let span = trace::span!("build_file", file);
+        span.record_str("file", || String::from_utf8_lossy(proto.name()).into());
         let file = self.as_ffi_mut().BuildFile(proto.as_ffi());
+        span.finish_ok(!file.is_null());
         unsafe { FileDescriptor::from_ffi_ptr(file) }
     }
 
+    /// Converts every `FileDescriptorProto` in `set` to real descriptors and
+    /// places them in this descriptor pool.
+    ///
+    /// Unlike with [`DescriptorPool::build_file`], the files in the set may
+    /// appear in any order: each file is built after the files in the set that
+    /// it depends on. Dependencies outside of the set must already be in the
+    /// pool. A file that fails to build does not prevent the remaining files
+    /// from being built, though files that depend on it will fail too. The
+    /// errors for every file that failed are returned together. Files that
+    /// the pool's underlay contains are skipped; see
+    /// [`DescriptorPool::with_underlay`].
+    ///
+    /// # Panics
+    ///
+    /// Panics if the pool is backed by a [`DescriptorDatabase`].
+    pub fn build_file_set(
+        self: Pin<&mut Self>,
+        set: &FileDescriptorSet,
+    ) -> Result<(), BuildFileSetError> {
+        self.build_file_set_with_options(set, &BuildOptions::default())
+    }
+
+    /// Like [`DescriptorPool::build_file_set`], but drops the parts of each
+    /// file that `options` do not retain before building it.
+    pub fn build_file_set_with_options(
+        self: Pin<&mut Self>,
+        set: &FileDescriptorSet,
+        options: &BuildOptions,
+    ) -> Result<(), BuildFileSetError> {
+        if ffi::DescriptorPoolHasDatabase(self.as_ref().get_ref().as_ffi()) {
+            panic!("cannot build files in a DescriptorPool backed by a DescriptorDatabase");
+        }
+        let mut errors = vec![];
+        match ffi::DescriptorPoolBuildFileSet(
+            self.as_ffi_mut(),
+            set.as_ffi(),
+            &options.to_ffi(),
+            &mut errors,
+        ) {
+            true => Ok(()),
+            false => Err(BuildFileSetError {
+                errors: errors.into_iter().map(BuildFileError::from).collect(),
+            }),
+        }
+    }
+
+    /// Builds every file in `image` and places the resulting descriptors in
+    /// this pool.
+    ///
+    /// This is equivalent to [`DescriptorPool::build_file_set`] with the set
+    /// from which the image was encoded, but skips ordering the files by their
+    /// dependencies, which the image records. As there, files that the pool's
+    /// underlay contains are skipped.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the pool is backed by a [`DescriptorDatabase`].
+    pub fn build_image(
+        self: Pin<&mut Self>,
+        image: &DescriptorPoolImage,
+    ) -> Result<(), BuildFileSetError> {
+        self.build_image_with_options(image, &BuildOptions::default())
+    }
+
+    /// Like [`DescriptorPool::build_image`], but drops the parts of each file
+    /// that `options` do not retain before building it.
+    pub fn build_image_with_options(
+        self: Pin<&mut Self>,
+        image: &DescriptorPoolImage,
+        options: &BuildOptions,
+    ) -> Result<(), BuildFileSetError> {
+        if ffi::DescriptorPoolHasDatabase(self.as_ref().get_ref().as_ffi()) {
+            panic!("cannot build files in a DescriptorPool backed by a DescriptorDatabase");
+        }
+        let mut errors = vec![];
+        match ffi::DescriptorPoolBuildImage(
+            self.as_ffi_mut(),
+            image.image,
+            &image.files,
+            &options.to_ffi(),
+            &mut errors,
+        ) {
+            true => Ok(()),
+            false => Err(BuildFileSetError {
+                errors: errors.into_iter().map(BuildFileError::from).collect(),
+            }),
+        }
+    }
+
+    /// Finds a file by its name.
+    ///
+    /// Returns `None` if no such file exists in the pool or, if the pool is
+    /// backed by a database, could not be loaded from the database.
+    pub fn find_file_by_name(&self, filename: &Path) -> Option<&FileDescriptor> {
+        let file = self
+            .as_ffi()
+            .FindFileByName(ProtobufPath::from(filename).into());
+        match file.is_null() {
+            true => None,
+            false => Some(unsafe { FileDescriptor::from_ffi_ptr(file) }),
+        }
+    }
+
+    /// Finds the file that declares the given fully-qualified symbol name.
+    ///
+    /// Returns `None` if no such symbol exists in the pool or, if the pool is
+    /// backed by a database, could not be loaded from the database.
+    pub fn find_file_containing_symbol(&self, symbol_name: &str) -> Option<&FileDescriptor> {
+        let file = self.as_ffi().FindFileContainingSymbol(symbol_name.into());
+        match file.is_null() {
+            true => None,
+            false => Some(unsafe { FileDescriptor::from_ffi_ptr(file) }),
+        }
+    }
+
+    /// Finds a message type by its fully-qualified name, e.g.
+    /// `google.protobuf.FileDescriptorProto`.
+    ///
+    /// Returns `None` if no such message type exists in the pool.
+    pub fn find_message_type_by_name(&self, name: &str) -> Option<&Descriptor> {
+        let descriptor = self.as_ffi().FindMessageTypeByName(name.into());
+        match descriptor.is_null() {
+            true => None,
+            false => Some(unsafe { Descriptor::from_ffi_ptr(descriptor) }),
+        }
+    }
+
+    /// Converts the pool into a reference-counted handle that can be cloned
+    /// and sent to other threads for concurrent lookups.
+    ///
+    /// No more files can be added to the pool once it is shared.
+    pub fn into_shared(self: Pin<Box<Self>>) -> SharedDescriptorPool<'a> {
+        SharedDescriptorPool(Arc::new(self))
+    }
+
     unsafe_ffi_conversions!(ffi::DescriptorPool);
 }
 
-/// Describes a type of protocol message, or a particular group within a
-/// message.
+/// Options that control which parts of a file a [`DescriptorPool`] retains
+/// when building it.
 ///
-/// To obtain the `Descriptor` for a given message object, call
-/// [`Message::get_descriptor`]. Generated message classes also have a static
-/// method called `descriptor` which returns the type's descriptor. Use
-/// [`DescriptorPool`] to construct your own descriptors.
-pub struct Descriptor {}
+/// Dropping parts that are not needed shrinks the pool, as reported by
+/// [`FileDescriptor::memory_usage`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct BuildOptions {
+    /// Whether to retain source code info, the locations and comments of the
+    /// file's definitions, if the file includes it.
+    pub retain_source_code_info: bool,
+    /// Whether to retain custom options, i.e. extensions of the options
+    /// messages in descriptor.proto.
+    ///
+    /// The standard options, which can change how messages are parsed and
+    /// serialized, are always retained.
+    pub retain_custom_options: bool,
+}
 
-/// Interface to light weight protocol messages.
+impl Default for BuildOptions {
+    fn default() -> BuildOptions {
+        BuildOptions {
+            retain_source_code_info: true,
+            retain_custom_options: true,
+        }
+    }
+}
+
+impl BuildOptions {
+    /// Returns options that drop everything that is not needed to parse and
+    /// serialize messages.
+    pub fn compact() -> BuildOptions {
+        BuildOptions {
+            retain_source_code_info: false,
+            retain_custom_options: false,
+        }
+    }
+
+    fn to_ffi(&self) -> ffi::BuildOptions {
+        ffi::BuildOptions {
+            retain_source_code_info: self.retain_source_code_info,
+            retain_custom_options: self.retain_custom_options,
+        }
+    }
+}
+
+/// An estimate of the memory that descriptors take up, by category, in
+/// bytes.
 ///
-/// This interface is implemented by all protocol message objects.  Non-lite
-/// messages additionally implement the [`Message`] interface, which is a
-/// subclass of `MessageLite`. Use `MessageLite` instead when you only need the
-/// subset of features which it supports -- namely, nothing that uses
-/// descriptors or reflection. You can instruct the protocol compiler to
-/// generate classes which implement only `MessageLite`, not the full `Message`
-/// interface, by adding the following line to the .proto file:
+/// Returned by [`FileDescriptor::memory_usage`]. Usages can be summed to
+/// estimate the usage of several files.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct MemoryUsage {
+    /// The descriptor objects themselves.
+    pub descriptors: usize,
+    /// Names, full names and other strings, beyond their string objects.
+    pub names: usize,
+    /// Options messages.
+    pub options: usize,
+    /// Source code info.
+    pub source_code_info: usize,
+    /// Resolved feature sets, which the pool shares between descriptors that
+    /// resolve to the same features, so summing across files may count a set
+    /// more than once.
+    pub features: usize,
+}
+
+impl MemoryUsage {
+    /// Returns the total of every category.
+    pub fn total(&self) -> usize {
+        self.descriptors + self.names + self.options + self.source_code_info + self.features
+    }
+}
+
+impl From<ffi::DescriptorMemoryUsage> for MemoryUsage {
+    fn from(usage: ffi::DescriptorMemoryUsage) -> MemoryUsage {
+        MemoryUsage {
+            descriptors: usage.descriptors,
+            names: usage.names,
+            options: usage.options,
+            source_code_info: usage.source_code_info,
+            features: usage.features,
+        }
+    }
+}
+
+impl Add for MemoryUsage {
+    type Output = MemoryUsage;
+
+    fn add(self, other: MemoryUsage) -> MemoryUsage {
+        MemoryUsage {
+            descriptors: self.descriptors + other.descriptors,
+            names: self.names + other.names,
+            options: self.options + other.options,
+            source_code_info: self.source_code_info + other.source_code_info,
+            features: self.features + other.features,
+        }
+    }
+}
+
+impl Sum for MemoryUsage {
+    fn sum<I: Iterator<Item = MemoryUsage>>(iter: I) -> MemoryUsage {
+        iter.fold(MemoryUsage::default(), Add::add)
+    }
+}
+
+/// A compact, position-independent image of a set of files, from which a
+/// [`DescriptorPool`] can be restored quickly at startup.
 ///
-/// ```proto
-/// option optimize_for = LITE_RUNTIME;
-/// ```
+/// An image holds the serialized files of a [`FileDescriptorSet`] in
+/// dependency order, behind a header that records the version of libprotobuf
+/// that wrote it and followed by a checksum. It refers to its contents by
+/// offset alone, so it can be used in place wherever it is loaded from, e.g.
+/// a memory-mapped file.
 ///
-/// This is particularly useful on resource-constrained systems where the full
-/// protocol buffers runtime library is too big.
+/// libprotobuf cannot restore a pool's cross-linked tables without building
+/// them, so an image is fastest to start up from when used to back a lazily
+/// building pool with [`DescriptorPoolImage::database`]: the pool then builds
+/// only the files that are actually looked up, on first use. To build every
+/// file up front instead, use [`DescriptorPool::build_image`].
+pub struct DescriptorPoolImage<'a> {
+    image: &'a [u8],
+    files: Vec<ffi::ByteRange>,
+}
+
+impl<'a> DescriptorPoolImage<'a> {
+    /// Encodes the files in `set` as an image.
+    ///
+    /// Returns an error if a file is too large to serialize.
+    pub fn encode(set: &FileDescriptorSet) -> Result<Vec<u8>, OperationFailedError> {
+        let mut output = vec![];
+        ffi::DescriptorPoolImageEncode(set.as_ffi(), &mut output).as_result()?;
+        Ok(output)
+    }
+
+    /// Validates an image previously returned by
+    /// [`DescriptorPoolImage::encode`], without copying it.
+    ///
+    /// Returns an error if the image is truncated or corrupt, or was encoded
+    /// by a different version of libprotobuf.
+    pub fn open(image: &'a [u8]) -> Result<DescriptorPoolImage<'a>, OperationFailedError> {
+        let mut files = vec![];
+        ffi::DescriptorPoolImageFiles(image, &mut files).as_result()?;
+        Ok(DescriptorPoolImage { image, files })
+    }
+
+    /// Returns the number of files in the image.
+    pub fn file_count(&self) -> usize {
+        self.files.len()
+    }
+
+    /// Returns the serialized `FileDescriptorProto`s in the image, in
+    /// dependency order.
+    pub fn files(&self) -> impl Iterator<Item = &'a [u8]> + '_ {
+        let image = self.image;
+        self.files
+            .iter()
+            .map(move |range| &image[range.offset..range.offset + range.len])
+    }
+
+    /// Returns a database of the files in the image that borrows them from
+    /// the image, for use with [`DescriptorPool::with_database`].
+    ///
+    /// Returns an error if the files cannot be indexed, as when two files
+    /// define the same symbol.
+    pub fn database(
+        &self,
+    ) -> Result<Pin<Box<EncodedDescriptorDatabase<'a>>>, OperationFailedError> {
+        let mut database = EncodedDescriptorDatabase::new();
+        for file in self.files() {
+            database.as_mut().add(file)?;
+        }
+        Ok(database)
+    }
+}
+
+/// A reference-counted, thread-safe handle to a [`DescriptorPool`].
 ///
-/// Note that on non-constrained systems (e.g. servers) when you need to link in
-/// lots of protocol definitions, a better way to reduce total code footprint is
-/// to use `optimize_for = CODE_SIZE`. This will make the generated code smaller
-/// while still supporting all the same features (at the expense of speed).
-/// `optimize_for = LITE_RUNTIME` is best when you only have a small number of
-/// message types linked into your binary, in which case the size of the
-/// protocol buffers runtime itself is the biggest problem.
+/// Cloning the handle is cheap and does not copy the pool. All of the pool's
+/// lookup methods are available through [`Deref`], and the descriptors they
+/// return may be used from any thread for as long as the handle is alive.
 ///
-/// Users must not derive from this class. Only the protocol compiler and the
-/// internal library are allowed to create subclasses.
-pub trait MessageLite: private::MessageLite {
-    /// Constructs a new instance of the same type.
-    fn new(&self) -> Pin<Box<dyn MessageLite>> {
-        unsafe { DynMessageLite::from_ffi_owned(ffi::NewMessageLite(self.upcast())) }
+/// Create a handle with [`DescriptorPool::into_shared`].
+#[derive(Clone)]
+pub struct SharedDescriptorPool<'a>(Arc<Pin<Box<DescriptorPool<'a>>>>);
+
+impl<'a> Deref for SharedDescriptorPool<'a> {
+    type Target = DescriptorPool<'a>;
+
+    fn deref(&self) -> &DescriptorPool<'a> {
+        &self.0
     }
+}
 
-    /// Clears all fields of the message and set them to their default values.
+/// Describes a type of protocol message, or a particular group within a
+/// message.
+///
+/// Use [`DescriptorPool`] to construct your own descriptors, and
+/// [`DynamicMessageFactory`] to construct messages of the described type.
+pub struct Descriptor {
+    _opaque: PhantomPinned,
+}
+
+impl Descriptor {
+    /// Returns the name of the message type, not including its scope.
+    pub fn name(&self) -> &[u8] {
+        self.as_ffi().name().as_bytes()
+    }
+
+    /// Returns the fully-qualified name of the message type, scope delimited
+    /// by periods.
+    pub fn full_name(&self) -> &[u8] {
+        self.as_ffi().full_name().as_bytes()
+    }
+
+    /// Returns the number of fields in the message type.
+    pub fn field_count(&self) -> usize {
+        self.as_ffi().field_count().expect_usize()
+    }
+
+    /// Returns the `i`th field, in the order in which the fields are declared.
     ///
-    /// This method avoids freeing memory, assuming that any memory allocated to
-    /// hold parts of the message will be needed again to hold the next message.
-    /// If you actually want to free the memory used by a `MessageLite`, you
-    /// must drop it.
-    fn clear(self: Pin<&mut Self>) {
-        self.upcast_mut().Clear()
+    /// # Panics
+    ///
+    /// Panics if `i` is out of bounds.
+    pub fn field(&self, i: usize) -> &FieldDescriptor {
+        if i >= self.field_count() {
+            panic!(
+                "index out of bounds: the length is {} but the index is {}",
+                self.field_count(),
+                i
+            );
+        }
+        let field = self.as_ffi().field(CInt::expect_from(i));
+        unsafe { FieldDescriptor::from_ffi_ptr(field) }
     }
 
-    /// Quickly checks if all required fields have been set.
-    fn is_initialized(&self) -> bool {
-        self.upcast().IsInitialized()
+    /// Returns the number of message types nested within this message type.
+    pub fn nested_type_count(&self) -> usize {
+        self.as_ffi().nested_type_count().expect_usize()
     }
 
-    /// Reads a protocol buffer from the stream and merges it into this message.
+    /// Returns the `i`th message type nested within this message type.
     ///
-    /// Singular fields read from the what is already in the message and
-    /// repeated fields are appended to those already present.
+    /// # Panics
     ///
-    /// It is the responsibility of the caller to call input->LastTagWas() (for
-    /// groups) or input->ConsumedEntireMessage() (for non-groups) after this
-    /// returns to verify that the message's end was delimited correctly.
-    fn merge_from_coded_stream(
-        self: Pin<&mut Self>,
-        input: Pin<&mut CodedInputStream>,
-    ) -> Result<(), OperationFailedError> {
-        unsafe {
-            self.upcast_mut()
-                .MergeFromCodedStream(input.as_ffi_mut_ptr())
-                .as_result()
+    /// Panics if `i` is out of bounds.
+    pub fn nested_type(&self, i: usize) -> &Descriptor {
+        if i >= self.nested_type_count() {
+            panic!(
+                "index out of bounds: the length is {} but the index is {}",
+                self.nested_type_count(),
+                i
+            );
+        }
+        let descriptor = self.as_ffi().nested_type(CInt::expect_from(i));
+        unsafe { Descriptor::from_ffi_ptr(descriptor) }
+    }
+
+    /// Looks up a field by name, returning `None` if no such field exists.
+    ///
+    /// Each call crosses into C++ and hashes the name. When looking up many
+    /// fields of the same message type, build a [`FieldIndex`] with
+    /// [`Descriptor::field_index`] instead.
+    pub fn find_field_by_name(&self, name: &str) -> Option<&FieldDescriptor> {
+        let field = self.as_ffi().FindFieldByName(name.into());
+        match field.is_null() {
+            true => None,
+            false => Some(unsafe { FieldDescriptor::from_ffi_ptr(field) }),
+        }
+    }
+
+    /// Looks up a field by number, returning `None` if no such field exists.
+    pub fn find_field_by_number(&self, number: i32) -> Option<&FieldDescriptor> {
+        let field = self.as_ffi().FindFieldByNumber(CInt(number));
+        match field.is_null() {
+            true => None,
+            false => Some(unsafe { FieldDescriptor::from_ffi_ptr(field) }),
+        }
+    }
+
+    /// Builds an index of the fields of the message type by name and number.
+    pub fn field_index(&self) -> FieldIndex<'_> {
+        let mut by_name = HashMap::with_capacity(self.field_count());
+        let mut by_number = HashMap::with_capacity(self.field_count());
+        for i in 0..self.field_count() {
+            let field = self.field(i);
+            by_name.insert(field.name(), field);
+            by_number.insert(field.number(), field);
+        }
+        FieldIndex { by_name, by_number }
+    }
+
+    /// Builds a [`LazyView`] of the message type, in which submessage fields
+    /// are kept as raw bytes.
+    ///
+    /// Returns an error if the view cannot be declared, which can only happen
+    /// if its declaration conflicts with a symbol in this type's pool.
+    pub fn lazy_view(&self) -> Result<Pin<Box<LazyView<'_>>>, OperationFailedError> {
+        let view = ffi::NewLazyView(self.as_ffi());
+        match view.is_null() {
+            true => Err(OperationFailedError),
+            false => Ok(unsafe { LazyView::from_ffi_owned(view) }),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::Descriptor);
+}
+
+/// An index of the fields of a message type, built by
+/// [`Descriptor::field_index`].
+///
+/// Lookups through the index are answered entirely in Rust, without crossing
+/// into C++ or hashing a `std::string`.
+#[derive(Clone)]
+pub struct FieldIndex<'a> {
+    by_name: HashMap<&'a [u8], &'a FieldDescriptor>,
+    by_number: HashMap<i32, &'a FieldDescriptor>,
+}
+
+impl<'a> FieldIndex<'a> {
+    /// Looks up a field by name, returning `None` if no such field exists.
+    pub fn find_field_by_name(&self, name: &str) -> Option<&'a FieldDescriptor> {
+        self.by_name.get(name.as_bytes()).copied()
+    }
+
+    /// Looks up a field by number, returning `None` if no such field exists.
+    pub fn find_field_by_number(&self, number: i32) -> Option<&'a FieldDescriptor> {
+        self.by_number.get(&number).copied()
+    }
+}
+
+/// Dense integer ids for the message types and fields of a set of files.
+///
+/// Message types are numbered from zero in the order in which they are
+/// declared, with each message's nested types following it, and fields are
+/// numbered from zero in the order of their message types and then in
+/// declaration order. Per-type or per-field state, like caches, metrics or
+/// handlers, can then be kept in a `Vec` indexed by id rather than in a map
+/// keyed by name. Resolving a descriptor to its id hashes only the
+/// descriptor's address, and resolving an id to its descriptor is an array
+/// load.
+///
+/// Extensions are not fields of the message types they extend, and are not
+/// assigned ids.
+#[derive(Clone)]
+pub struct DescriptorIndex<'a> {
+    messages: Vec<&'a Descriptor>,
+    // The id of the first field of each message type.
+    field_offsets: Vec<usize>,
+    fields: Vec<&'a FieldDescriptor>,
+    message_ids: HashMap<usize, usize, BuildHasherDefault<AddressHasher>>,
+    message_ids_by_name: HashMap<&'a [u8], usize>,
+}
+
+impl<'a> DescriptorIndex<'a> {
+    /// Assigns ids to the message types and fields of `files`.
+    pub fn new<I>(files: I) -> DescriptorIndex<'a>
+    where
+        I: IntoIterator<Item = &'a FileDescriptor>,
+    {
+        let mut index = DescriptorIndex {
+            messages: vec![],
+            field_offsets: vec![],
+            fields: vec![],
+            message_ids: HashMap::default(),
+            message_ids_by_name: HashMap::new(),
+        };
+        for file in files {
+            for i in 0..file.message_type_count() {
+                index.add_message(file.message_type(i));
+            }
+        }
+        index
+    }
+
+    fn add_message(&mut self, message: &'a Descriptor) {
+        let id = self.messages.len();
+        self.messages.push(message);
+        self.field_offsets.push(self.fields.len());
+        self.message_ids.insert(message as *const _ as usize, id);
+        self.message_ids_by_name.insert(message.full_name(), id);
+        for i in 0..message.field_count() {
+            self.fields.push(message.field(i));
+        }
+        for i in 0..message.nested_type_count() {
+            self.add_message(message.nested_type(i));
+        }
+    }
+
+    /// Returns the number of message types in the index.
+    pub fn message_count(&self) -> usize {
+        self.messages.len()
+    }
+
+    /// Returns the message type with the given id.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `id` is out of bounds.
+    pub fn message(&self, id: usize) -> &'a Descriptor {
+        self.messages[id]
+    }
+
+    /// Returns the id of `message`, or `None` if it is not in the index.
+    pub fn message_id(&self, message: &Descriptor) -> Option<usize> {
+        self.message_ids
+            .get(&(message as *const _ as usize))
+            .copied()
+    }
+
+    /// Returns the id of the message type with the given fully-qualified
+    /// name, or `None` if there is no such message type in the index.
+    pub fn find_message_id_by_name(&self, full_name: &str) -> Option<usize> {
+        self.message_ids_by_name.get(full_name.as_bytes()).copied()
+    }
+
+    /// Returns the number of fields in the index.
+    pub fn field_count(&self) -> usize {
+        self.fields.len()
+    }
+
+    /// Returns the field with the given id.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `id` is out of bounds.
+    pub fn field(&self, id: usize) -> &'a FieldDescriptor {
+        self.fields[id]
+    }
+
+    /// Returns the id of `field`, or `None` if it is an extension or its
+    /// containing type is not in the index.
+    pub fn field_id(&self, field: &FieldDescriptor) -> Option<usize> {
+        if field.is_extension() {
+            return None;
+        }
+        let message = self.message_id(field.containing_type())?;
+        Some(self.field_offsets[message] + field.index())
+    }
+}
+
+/// A hasher for the addresses that key [`DescriptorIndex`], which are
+/// already unique and need only be mixed, not hashed with SipHash.
+#[derive(Default)]
+struct AddressHasher(u64);
+
+impl Hasher for AddressHasher {
+    fn write(&mut self, bytes: &[u8]) {
+        for &b in bytes {
+            self.0 = (self.0.rotate_left(8) ^ u64::from(b)).wrapping_mul(0x9e37_79b9_7f4a_7c15);
+        }
+    }
+
+    fn write_usize(&mut self, n: usize) {
+        self.0 = (n as u64).wrapping_mul(0x9e37_79b9_7f4a_7c15);
+    }
+
+    fn finish(&self) -> u64 {
+        // Fold the well-mixed high bits into the low bits, which pick the
+        // bucket.
+        self.0 ^ (self.0 >> 32)
+    }
+}
+
+/// The declared type of a field.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum FieldType {
+    /// `double`.
+    Double,
+    /// `float`.
+    Float,
+    /// `int64`.
+    Int64,
+    /// `uint64`.
+    UInt64,
+    /// `int32`.
+    Int32,
+    /// `fixed64`.
+    Fixed64,
+    /// `fixed32`.
+    Fixed32,
+    /// `bool`.
+    Bool,
+    /// `string`.
+    String,
+    /// A group, which is a deprecated way to nest a message.
+    Group,
+    /// A nested message.
+    Message,
+    /// `bytes`.
+    Bytes,
+    /// `uint32`.
+    UInt32,
+    /// An enum.
+    Enum,
+    /// `sfixed32`.
+    SFixed32,
+    /// `sfixed64`.
+    SFixed64,
+    /// `sint32`.
+    SInt32,
+    /// `sint64`.
+    SInt64,
+}
+
+/// Describes a single field of a message.
+pub struct FieldDescriptor {
+    _opaque: PhantomPinned,
+}
+
+impl FieldDescriptor {
+    /// Returns the name of the field within its message.
+    pub fn name(&self) -> &[u8] {
+        self.as_ffi().name().as_bytes()
+    }
+
+    /// Returns the fully-qualified name of the field.
+    pub fn full_name(&self) -> &[u8] {
+        self.as_ffi().full_name().as_bytes()
+    }
+
+    /// Returns the declared tag number of the field.
+    pub fn number(&self) -> i32 {
+        self.as_ffi().number().0
+    }
+
+    /// Returns the index of the field within its message, such that
+    /// `field.containing_type().field(field.index())` is `field`.
+    pub fn index(&self) -> usize {
+        self.as_ffi().index().expect_usize()
+    }
+
+    /// Returns the declared type of the field.
+    pub fn field_type(&self) -> FieldType {
+        match ffi::FieldDescriptorType(self.as_ffi()).0 {
+            1 => FieldType::Double,
+            2 => FieldType::Float,
+            3 => FieldType::Int64,
+            4 => FieldType::UInt64,
+            5 => FieldType::Int32,
+            6 => FieldType::Fixed64,
+            7 => FieldType::Fixed32,
+            8 => FieldType::Bool,
+            9 => FieldType::String,
+            10 => FieldType::Group,
+            11 => FieldType::Message,
+            12 => FieldType::Bytes,
+            13 => FieldType::UInt32,
+            14 => FieldType::Enum,
+            15 => FieldType::SFixed32,
+            16 => FieldType::SFixed64,
+            17 => FieldType::SInt32,
+            18 => FieldType::SInt64,
+            n => unreachable!("unknown field type {}", n),
         }
     }
 
-    /// Writes a protocol buffer of this message to the given output.
-    ///
-    /// All required fields must be set.
-    fn serialize_to_coded_stream(
-        &self,
-        output: Pin<&mut CodedOutputStream>,
-    ) -> Result<(), OperationFailedError> {
-        unsafe {
-            self.upcast()
-                .SerializeToCodedStream(output.as_ffi_mut_ptr())
-                .as_result()
-        }
+    /// Reports whether the field is repeated.
+    pub fn is_repeated(&self) -> bool {
+        self.as_ffi().is_repeated()
+    }
+
+    /// Reports whether the field is required.
+    pub fn is_required(&self) -> bool {
+        self.as_ffi().is_required()
+    }
+
+    /// Reports whether the field is an extension.
+    pub fn is_extension(&self) -> bool {
+        self.as_ffi().is_extension()
+    }
+
+    /// Reports whether the field distinguishes between unpopulated and
+    /// default values.
+    pub fn has_presence(&self) -> bool {
+        self.as_ffi().has_presence()
+    }
+
+    /// Reports whether the field is a string field whose values must be
+    /// valid UTF-8 when parsed.
+    pub fn requires_utf8_validation(&self) -> bool {
+        self.as_ffi().requires_utf8_validation()
+    }
+
+    /// Returns the message type of which this field is a member.
+    pub fn containing_type(&self) -> &Descriptor {
+        unsafe { Descriptor::from_ffi_ptr(self.as_ffi().containing_type()) }
+    }
+
+    /// Returns the type of the field, if the field is a message or group
+    /// field.
+    pub fn message_type(&self) -> Option<&Descriptor> {
+        let descriptor = self.as_ffi().message_type();
+        match descriptor.is_null() {
+            true => None,
+            false => Some(unsafe { Descriptor::from_ffi_ptr(descriptor) }),
+        }
+    }
+
+    /// Resolves a [`FieldAccessor`] for the field, which must be a singular
+    /// field that is not a message field.
+    pub fn accessor(&self) -> Result<Pin<Box<FieldAccessor<'_>>>, OperationFailedError> {
+        let accessor = ffi::NewFieldAccessor(self.as_ffi());
+        match accessor.is_null() {
+            true => Err(OperationFailedError),
+            false => Ok(unsafe { FieldAccessor::from_ffi_owned(accessor) }),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::FieldDescriptor);
+}
+
+/// Reads and writes a singular scalar field in messages of its containing
+/// type.
+///
+/// The field's type is resolved once, when the accessor is built with
+/// [`FieldDescriptor::accessor`], so each access is a single call into the
+/// message's reflection. This makes accessors suitable for reading the same
+/// few fields from many messages whose type is only known at runtime.
+///
+/// Values are read and written in the widest type of their kind: `i64` for
+/// signed integer and enum fields, `u64` for unsigned integer fields, `f64`
+/// for floating point fields, and byte slices for `string` and `bytes`
+/// fields. Each method returns an error if the message is not of the field's
+/// containing type or if the field is not of the method's kind.
+pub struct FieldAccessor<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for FieldAccessor<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteFieldAccessor(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> FieldAccessor<'a> {
+    /// Reports whether the field is set in `message`.
+    ///
+    /// For a field without presence, this reports whether the field has a
+    /// value other than its default.
+    pub fn has(&self, message: &dyn Message) -> Result<bool, OperationFailedError> {
+        let mut ok = false;
+        let has = ffi::FieldAccessorHas(self.as_ffi(), accessed(message), &mut ok);
+        ok.as_result()?;
+        Ok(has)
+    }
+
+    /// Returns the value of a signed integer or enum field.
+    pub fn get_i64(&self, message: &dyn Message) -> Result<i64, OperationFailedError> {
+        let mut ok = false;
+        let value = ffi::FieldAccessorGetInt64(self.as_ffi(), accessed(message), &mut ok);
+        ok.as_result()?;
+        Ok(value)
+    }
+
+    /// Returns the value of an unsigned integer field.
+    pub fn get_u64(&self, message: &dyn Message) -> Result<u64, OperationFailedError> {
+        let mut ok = false;
+        let value = ffi::FieldAccessorGetUInt64(self.as_ffi(), accessed(message), &mut ok);
+        ok.as_result()?;
+        Ok(value)
+    }
+
+    /// Returns the value of a floating point field.
+    pub fn get_f64(&self, message: &dyn Message) -> Result<f64, OperationFailedError> {
+        let mut ok = false;
+        let value = ffi::FieldAccessorGetDouble(self.as_ffi(), accessed(message), &mut ok);
+        ok.as_result()?;
+        Ok(value)
+    }
+
+    /// Returns the value of a boolean field.
+    pub fn get_bool(&self, message: &dyn Message) -> Result<bool, OperationFailedError> {
+        let mut ok = false;
+        let value = ffi::FieldAccessorGetBool(self.as_ffi(), accessed(message), &mut ok);
+        ok.as_result()?;
+        Ok(value)
+    }
+
+    /// Returns the value of a `string` or `bytes` field, borrowed from the
+    /// message's own storage.
+    ///
+    /// Returns an error if the field is a `bytes` field with `ctype = CORD`.
+    pub fn get_bytes<'m>(
+        &self,
+        message: &'m dyn Message,
+    ) -> Result<&'m [u8], OperationFailedError> {
+        let mut ok = false;
+        let value = ffi::FieldAccessorGetBytes(self.as_ffi(), accessed(message), &mut ok);
+        ok.as_result()?;
+        Ok(value)
+    }
+
+    /// Sets the value of a signed integer or enum field.
+    ///
+    /// Returns an error if `value` is out of range for the field, or is not
+    /// a value of a closed enum.
+    pub fn set_i64(
+        &self,
+        message: Pin<&mut dyn Message>,
+        value: i64,
+    ) -> Result<(), OperationFailedError> {
+        ffi::FieldAccessorSetInt64(self.as_ffi(), accessed_mut(message), value).as_result()
+    }
+
+    /// Sets the value of an unsigned integer field.
+    ///
+    /// Returns an error if `value` is out of range for the field.
+    pub fn set_u64(
+        &self,
+        message: Pin<&mut dyn Message>,
+        value: u64,
+    ) -> Result<(), OperationFailedError> {
+        ffi::FieldAccessorSetUInt64(self.as_ffi(), accessed_mut(message), value).as_result()
+    }
+
+    /// Sets the value of a floating point field, rounding `value` if the
+    /// field is a `float` field.
+    pub fn set_f64(
+        &self,
+        message: Pin<&mut dyn Message>,
+        value: f64,
+    ) -> Result<(), OperationFailedError> {
+        ffi::FieldAccessorSetDouble(self.as_ffi(), accessed_mut(message), value).as_result()
+    }
+
+    /// Sets the value of a boolean field.
+    pub fn set_bool(
+        &self,
+        message: Pin<&mut dyn Message>,
+        value: bool,
+    ) -> Result<(), OperationFailedError> {
+        ffi::FieldAccessorSetBool(self.as_ffi(), accessed_mut(message), value).as_result()
+    }
+
+    /// Sets the value of a `string` or `bytes` field.
+    ///
+    /// The value of a `string` field is not validated as UTF-8 here, but a
+    /// message with an invalid value fails to serialize.
+    pub fn set_bytes(
+        &self,
+        message: Pin<&mut dyn Message>,
+        value: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        ffi::FieldAccessorSetBytes(self.as_ffi(), accessed_mut(message), value).as_result()
+    }
+
+    /// Clears the field in `message`.
+    pub fn clear(&self, message: Pin<&mut dyn Message>) -> Result<(), OperationFailedError> {
+        ffi::FieldAccessorClear(self.as_ffi(), accessed_mut(message)).as_result()
+    }
+
+    unsafe_ffi_conversions!(ffi::FieldAccessor);
+}
+
+fn accessed(message: &dyn Message) -> &ffi::Message {
+    unsafe { mem::transmute(private::MessageLite::upcast(message)) }
+}
+
+fn accessed_mut(message: Pin<&mut dyn Message>) -> Pin<&mut ffi::Message> {
+    unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) }
+}
+
+/// Constructs messages of types that are only known at runtime.
+///
+/// Given a [`Descriptor`], which may have been built at runtime by a
+/// [`DescriptorPool`], a `DynamicMessageFactory` provides a prototype message
+/// whose layout is computed from the descriptor. New messages of that type are
+/// constructed with [`MessageLite::new`] or [`MessageLite::new_in`] on the
+/// prototype, and can be parsed, serialized, and so on like any other
+/// message.
+///
+/// The factory caches the prototype for each descriptor, so repeated calls to
+/// [`get_prototype`] with the same descriptor are cheap and do not recompute
+/// the message layout.
+///
+/// The descriptors passed to the factory must outlive it, and messages
+/// constructed from its prototypes must be dropped before the factory is.
+///
+/// [`get_prototype`]: DynamicMessageFactory::get_prototype
+pub struct DynamicMessageFactory<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for DynamicMessageFactory<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteDynamicMessageFactory(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> DynamicMessageFactory<'a> {
+    /// Creates a new `DynamicMessageFactory`.
+    pub fn new() -> Pin<Box<DynamicMessageFactory<'a>>> {
+        let factory = ffi::NewDynamicMessageFactory();
+        unsafe { Self::from_ffi_owned(factory) }
+    }
+
+    /// Returns the prototype message for the given message type.
+    ///
+    /// The prototype is owned by the factory. Use [`MessageLite::new`] or
+    /// [`MessageLite::new_in`] to construct mutable messages of the same type.
+    pub fn get_prototype(self: Pin<&mut Self>, descriptor: &'a Descriptor) -> &dyn Message {
+        unsafe {
+            let prototype = self.as_ffi_mut().GetPrototype(descriptor.as_ffi());
+            DynMessage::from_ffi_ptr(prototype)
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::DynamicMessageFactory);
+}
+
+/// A view of a message type in which every submessage field is kept as raw
+/// bytes, built by [`Descriptor::lazy_view`].
+///
+/// The view's [`descriptor`] declares the same fields as the original type,
+/// except that each non-group message field, including each map field, is
+/// declared as a `bytes` field with the same number and presence. Messages of
+/// the view's type, constructed with a [`DynamicMessageFactory`], are wire
+/// compatible with messages of the original type: parsing one copies each
+/// encoded submessage without decoding it, and serializing one writes those
+/// bytes back verbatim. This makes the view suitable for routing on the
+/// top-level fields of an envelope while forwarding its payloads unchanged.
+///
+/// A submessage is decoded only if it is asked for, with
+/// [`LazyView::parse_field`] or [`LazyView::parse_repeated_field`]. As the
+/// submessage is not validated until then, a malformed payload in an otherwise
+/// valid message is not detected by parsing the message.
+///
+/// [`descriptor`]: LazyView::descriptor
+pub struct LazyView<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for LazyView<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteLazyView(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> LazyView<'a> {
+    /// Returns the descriptor of the view's message type.
+    pub fn descriptor(&self) -> &Descriptor {
+        Descriptor::from_ffi_ref(ffi::LazyViewDescriptor(self.as_ffi()))
+    }
+
+    /// Parses the submessage stored in the singular field `field` of
+    /// `message` into `output`.
+    ///
+    /// `message` must be of the view's type and `field` must be one of its
+    /// fields, while `output` must be of the type the field has in the original
+    /// message type. Parsing an unset field clears `output`.
+    ///
+    /// Returns an error if the bytes are not a valid encoding of `output`'s
+    /// type, or if the messages or field are not of the expected types.
+    pub fn parse_field(
+        &self,
+        message: &dyn Message,
+        field: &FieldDescriptor,
+        output: Pin<&mut dyn Message>,
+    ) -> Result<(), OperationFailedError> {
+        self.parse_field_inner(message, field, CInt(0), output)
+    }
+
+    /// Like [`LazyView::parse_field`], but parses the `index`th element of the
+    /// repeated field `field`.
+    ///
+    /// Returns an error if `index` is out of bounds.
+    pub fn parse_repeated_field(
+        &self,
+        message: &dyn Message,
+        field: &FieldDescriptor,
+        index: usize,
+        output: Pin<&mut dyn Message>,
+    ) -> Result<(), OperationFailedError> {
+        let index = CInt::try_from(index).map_err(|_| OperationFailedError)?;
+        self.parse_field_inner(message, field, index, output)
+    }
+
+    fn parse_field_inner(
+        &self,
+        message: &dyn Message,
+        field: &FieldDescriptor,
+        index: CInt,
+        output: Pin<&mut dyn Message>,
+    ) -> Result<(), OperationFailedError> {
+        let message: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+        let output: Pin<&mut ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(output)) };
+        ffi::LazyViewParseField(self.as_ffi(), message, field.as_ffi(), index, output).as_result()
+    }
+
+    unsafe_ffi_conversions!(ffi::LazyView);
+}
+
+/// Arena allocator.
+///
+/// Arena allocation replaces ordinary (heap-based) allocation with new/delete,
+/// and improves performance by aggregating allocations into larger blocks and
+/// freeing allocations all at once. Protocol messages are allocated on an arena
+/// by using [`MessageLite::new_in`], and are automatically freed when the arena
+/// is dropped.
+///
+/// This is a thread-safe implementation: multiple threads may allocate from the
+/// arena concurrently. An `Arena` is `Sync`, so threads can share a reference
+/// to one, for instance to parse the elements of a repeated field concurrently
+/// with [`Message::new_message_in`] and then add them to their parent with
+/// [`Message::add_allocated_message`].
+pub struct Arena<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a mut [MaybeUninit<u8>]>,
+}
+
+impl<'a> Drop for Arena<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteArena(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Arena<'static> {
+    /// Creates a new arena with default options, tuned for average use cases.
+    pub fn new() -> Pin<Box<Arena<'static>>> {
+        let arena = ffi::NewArena();
+        unsafe { Self::from_ffi_owned(arena) }
+    }
+}
+
+impl<'a> Arena<'a> {
+    /// Creates a new arena with the specified options.
+    pub fn with_options(options: ArenaOptions<'a>) -> Pin<Box<Arena<'a>>> {
+        let (initial_block, initial_block_size) = match options.initial_block {
+            None => (ptr::null_mut(), 0),
+            Some(block) => {
+                // The arena requires that the initial block be 8-byte aligned.
+                let offset = block.as_ptr().align_offset(8).min(block.len());
+                let block = &mut block[offset..];
+                (block.as_mut_ptr() as *mut u8, block.len())
+            }
+        };
+        let block_alloc = match options.block_alloc {
+            None => ptr::null_mut(),
+            Some(f) => f as *mut CVoid,
+        };
+        let block_dealloc = match options.block_dealloc {
+            None => ptr::null_mut(),
+            Some(f) => f as *mut CVoid,
+        };
+        let arena = unsafe {
+            ffi::NewArenaWithOptions(
+                options.start_block_size,
+                options.max_block_size,
+                initial_block,
+                initial_block_size,
+                block_alloc,
+                block_dealloc,
+            )
+        };
+        unsafe { Self::from_ffi_owned(arena) }
+    }
+
+    /// Returns the total space allocated by the arena, which is the sum of the
+    /// sizes of the underlying blocks.
+    ///
+    /// This is an approximation intended for monitoring. The exact value is an
+    /// implementation detail that depends on the arena's growth policy.
+    pub fn space_allocated(&self) -> u64 {
+        self.as_ffi().SpaceAllocated()
+    }
+
+    /// Returns the total space used by the arena.
+    ///
+    /// Similar to [`space_allocated`] but does not include free space and block
+    /// overhead. This is a best-effort estimate and may inaccurately calculate
+    /// space used by other threads allocating from the arena concurrently.
+    ///
+    /// [`space_allocated`]: Arena::space_allocated
+    pub fn space_used(&self) -> u64 {
+        self.as_ffi().SpaceUsed()
+    }
+
+    /// Frees all objects allocated on this arena so that it can be reused.
+    ///
+    /// The first block of the arena is retained, so that subsequent allocations
+    /// do not need to return to the system allocator. Returns the total space
+    /// that was allocated by the arena before the reset.
+    pub fn reset(self: Pin<&mut Self>) -> u64 {
+        self.as_ffi_mut().Reset()
+    }
+
+    unsafe_ffi_conversions!(ffi::Arena);
+}
+
+/// A message constructed on an [`Arena`] by [`Message::new_message_in`].
+///
+/// The handle is the only reference to the message, so that the message can
+/// be handed to [`Message::add_allocated_message`] without aliasing. The
+/// message is freed with its arena, not when the handle is dropped. Handles
+/// are `Send`, so messages can be allocated and parsed on worker threads that
+/// share the arena, and then collected on one thread.
+pub struct ArenaMessage<'a>(Pin<&'a mut dyn Message>);
+
+impl<'a> ArenaMessage<'a> {
+    /// Returns a mutable reference to the message.
+    pub fn as_mut(&mut self) -> Pin<&mut dyn Message> {
+        self.0.as_mut()
+    }
+}
+
+impl<'a> Deref for ArenaMessage<'a> {
+    type Target = dyn Message + 'a;
+
+    fn deref(&self) -> &(dyn Message + 'a) {
+        &*self.0
+    }
+}
+
+/// Options that control the block-allocation behavior of an [`Arena`].
+#[derive(Debug)]
+pub struct ArenaOptions<'a> {
+    /// The size of the first block requested from the system allocator.
+    ///
+    /// Subsequent block sizes will increase in a geometric series up to
+    /// `max_block_size`.
+    pub start_block_size: usize,
+    /// The maximum block size requested from the system allocator (unless an
+    /// individual arena allocation request occurs with a size larger than
+    /// this maximum).
+    ///
+    /// Requested block sizes increase up to this value, then remain here.
+    pub max_block_size: usize,
+    /// An initial block of memory for the arena to use, if any.
+    ///
+    /// The block is borrowed for the lifetime of the arena. The caller retains
+    /// ownership of the block after the arena is dropped. The start of the
+    /// block may be skipped to satisfy the arena's alignment requirements.
+    pub initial_block: Option<&'a mut [MaybeUninit<u8>]>,
+    block_alloc: Option<unsafe extern "C" fn(usize) -> *mut c_void>,
+    block_dealloc: Option<unsafe extern "C" fn(*mut c_void, usize)>,
+}
+
+impl<'a> ArenaOptions<'a> {
+    /// Sets the functions the arena uses to allocate and free memory blocks.
+    ///
+    /// By default, blocks are allocated with `malloc` and freed with `free`.
+    ///
+    /// # Safety
+    ///
+    /// `block_alloc` must behave like `malloc`, returning a pointer to a
+    /// block of at least the requested size that is suitably aligned for any
+    /// type. `block_dealloc` must accept every block returned by `block_alloc`
+    /// along with the size that was requested for that block.
+    pub unsafe fn set_block_allocator(
+        &mut self,
+        block_alloc: unsafe extern "C" fn(usize) -> *mut c_void,
+        block_dealloc: unsafe extern "C" fn(*mut c_void, usize),
+    ) {
+        self.block_alloc = Some(block_alloc);
+        self.block_dealloc = Some(block_dealloc);
+    }
+
+    /// Allocates the arena's blocks on the NUMA node of the thread that
+    /// allocates each block, and caches freed blocks on their node for reuse.
+    ///
+    /// See the [`numa`] module.
+    pub fn set_numa_block_allocator(&mut self) {
+        self.block_alloc = Some(numa::block_alloc);
+        self.block_dealloc = Some(numa::block_dealloc);
+    }
+
+    /// Like [`set_numa_block_allocator`](Self::set_numa_block_allocator),
+    /// but backs the arena's blocks with huge pages.
+    ///
+    /// As each block occupies a whole number of huge pages, this also raises
+    /// `start_block_size` and `max_block_size` to at least
+    /// [`numa::huge_page_block_size`].
+    ///
+    /// See the [`numa`] module.
+    pub fn set_huge_page_block_allocator(&mut self) {
+        let block_size = numa::huge_page_block_size();
+        self.start_block_size = self.start_block_size.max(block_size);
+        self.max_block_size = self.max_block_size.max(block_size);
+        self.block_alloc = Some(numa::huge_page_block_alloc);
+        self.block_dealloc = Some(numa::huge_page_block_dealloc);
+    }
+}
+
+impl<'a> Default for ArenaOptions<'a> {
+    fn default() -> ArenaOptions<'a> {
+        ArenaOptions {
+            start_block_size: ffi::ArenaOptionsDefaultStartBlockSize(),
+            max_block_size: ffi::ArenaOptionsDefaultMaxBlockSize(),
+            initial_block: None,
+            block_alloc: None,
+            block_dealloc: None,
+        }
+    }
+}
+
+/// Interface to light weight protocol messages.
+///
+/// This interface is implemented by all protocol message objects.  Non-lite
+/// messages additionally implement the [`Message`] interface, which is a
+/// subclass of `MessageLite`. Use `MessageLite` instead when you only need the
+/// subset of features which it supports -- namely, nothing that uses
+/// descriptors or reflection. You can instruct the protocol compiler to
+/// generate classes which implement only `MessageLite`, not the full `Message`
+/// interface, by adding the following line to the .proto file:
+///
+/// ```proto
+/// option optimize_for = LITE_RUNTIME;
+/// ```
+///
+/// This is particularly useful on resource-constrained systems where the full
+/// protocol buffers runtime library is too big.
+///
+/// Note that on non-constrained systems (e.g. servers) when you need to link in
+/// lots of protocol definitions, a better way to reduce total code footprint is
+/// to use `optimize_for = CODE_SIZE`. This will make the generated code smaller
+/// while still supporting all the same features (at the expense of speed).
+/// `optimize_for = LITE_RUNTIME` is best when you only have a small number of
+/// message types linked into your binary, in which case the size of the
+/// protocol buffers runtime itself is the biggest problem.
+///
+/// Users must not derive from this class. Only the protocol compiler and the
+/// internal library are allowed to create subclasses.
+///
+/// # Thread safety
+///
+/// Messages are thread compatible: a message may be moved to another thread,
+/// and may be read from several threads at once, as long as no thread
+/// modifies it concurrently. Hence every message, and so every
+/// `Pin<Box<dyn MessageLite>>` and `Pin<Box<dyn Message>>`, is `Send` and
+/// `Sync`. A message parsed on one thread can be handed off to another for
+/// processing, and a message wrapped in an [`Arc`] can be shared read-only
+/// between threads. Messages allocated on an [`Arena`] borrow the arena, which
+/// is itself thread safe.
+pub trait MessageLite: private::MessageLite + Send + Sync {
+    /// Constructs a new instance of the same type.
+    fn new(&self) -> Pin<Box<dyn MessageLite>> {
+        unsafe { DynMessageLite::from_ffi_owned(ffi::NewMessageLite(self.upcast())) }
+    }
+
+    /// Constructs a new instance of the same type on the given arena.
+    ///
+    /// The new message is owned by the arena and is freed, along with every
+    /// other object allocated on the arena, when the arena is dropped. No
+    /// destructor is run for the message itself.
+    fn new_in<'a>(&self, arena: &'a Arena<'_>) -> Pin<&'a mut dyn MessageLite> {
+        // SAFETY: arenas are internally synchronized, so allocating from a
+        // shared reference to an arena is sound.
+        let arena = arena.as_ffi() as *const ffi::Arena as *mut ffi::Arena;
+        unsafe {
+            let message = ffi::NewMessageLiteInArena(self.upcast(), arena);
+            DynMessageLite::from_ffi_mut(message)
+        }
+    }
+
+    /// Clears all fields of the message and set them to their default values.
+    ///
+    /// This method avoids freeing memory, assuming that any memory allocated to
+    /// hold parts of the message will be needed again to hold the next message.
+    /// If you actually want to free the memory used by a `MessageLite`, you
+    /// must drop it.
+    fn clear(self: Pin<&mut Self>) {
+        self.upcast_mut().Clear()
+    }
+
+    /// Makes this message into a copy of `from`.
+    ///
+    /// The fields are copied directly, which is much cheaper than serializing
+    /// `from` and parsing the result into this message.
+    ///
+    /// Returns an error if `from` is not of the same type as this message.
+    fn copy_from(self: Pin<&mut Self>, from: &dyn MessageLite) -> Result<(), OperationFailedError> {
+        ffi::MessageLiteCopyFrom(self.upcast_mut(), from.upcast()).as_result()
+    }
+
+    /// Merges the fields of `from` into this message.
+    ///
+    /// Singular fields set in `from` overwrite those in this message and
+    /// repeated fields are appended to those already present, exactly as if
+    /// the serialized form of `from` were passed to
+    /// [`MessageLite::merge_from_bytes`].
+    ///
+    /// Returns an error if `from` is not of the same type as this message.
+    fn merge_from(
+        self: Pin<&mut Self>,
+        from: &dyn MessageLite,
+    ) -> Result<(), OperationFailedError> {
+        ffi::MessageLiteMergeFrom(self.upcast_mut(), from.upcast()).as_result()
+    }
+
+    /// Quickly checks if all required fields have been set.
+    fn is_initialized(&self) -> bool {
+        self.upcast().IsInitialized()
+    }
+
+    /// Parses a protocol buffer contained in a byte slice, replacing the
+    /// current contents of this message.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer or if any
+    /// required fields are missing.
+    ///
+    /// Decoding from a byte slice is considerably cheaper than constructing a
+    /// [`SliceInputStream`] and [`CodedInputStream`], as it needs no
+    /// intermediate stream objects and the parser can take its flat-buffer
+    /// fast path.
+    ///
+    /// [`SliceInputStream`]: crate::io::SliceInputStream
+    fn parse_from_bytes(self: Pin<&mut Self>, data: &[u8]) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("parse_from_bytes", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let ok = self.upcast_mut().ParseFromString(data.into());
+        timer.finish_parse(data, ok);
+        span.finish(ok, || data.len());
+        ok.as_result()
+    }
+
+    /// Like [`parse_from_bytes`], but describes why parsing failed.
+    ///
+    /// The returned [`ParseError`] is classified on the failing path alone,
+    /// so callers need not parse the input again to find out what was wrong
+    /// with it. Parsing costs the same as with `parse_from_bytes`; only when
+    /// it fails is the input scanned once more, without a schema and without
+    /// allocating, to locate the malformed bytes. Unlike `parse_from_bytes`,
+    /// this does not log anything when required fields are missing.
+    ///
+    /// [`parse_from_bytes`]: MessageLite::parse_from_bytes
+    fn parse_from_bytes_detailed(mut self: Pin<&mut Self>, data: &[u8]) -> Result<(), ParseError> {
+        let span = trace::message_span!("parse_from_bytes_detailed", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let parsed = self
+            .as_mut()
+            .upcast_mut()
+            .ParsePartialFromString(data.into());
+        let ok = parsed && self.upcast().IsInitialized();
+        timer.finish_parse(data, ok);
+        span.finish(ok, || data.len());
+        match (ok, parsed) {
+            (true, _) => Ok(()),
+            (false, true) => Err(ParseError {
+                kind: ParseErrorKind::MissingRequired,
+                offset: data.len(),
+                number: 0,
+            }),
+            (false, false) => Err(ParseError::diagnose(data)),
+        }
+    }
+
+    /// Like [`parse_from_bytes`], but accepts messages that are missing
+    /// required fields.
+    ///
+    /// [`parse_from_bytes`]: MessageLite::parse_from_bytes
+    fn parse_partial_from_bytes(
+        self: Pin<&mut Self>,
+        data: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("parse_partial_from_bytes", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let ok = self.upcast_mut().ParsePartialFromString(data.into());
+        timer.finish_parse(data, ok);
+        span.finish(ok, || data.len());
+        ok.as_result()
+    }
+
+    /// Parses a protocol buffer contained in a byte slice and merges it into
+    /// this message.
+    ///
+    /// Singular fields read from the input overwrite what is already in the
+    /// message and repeated fields are appended to those already present.
+    fn merge_from_bytes(self: Pin<&mut Self>, data: &[u8]) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("merge_from_bytes", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let ok = self.upcast_mut().MergeFromString(data.into());
+        timer.finish_parse(data, ok);
+        span.finish(ok, || data.len());
+        ok.as_result()
+    }
+
+    /// Reads a protocol buffer from the stream and merges it into this message.
+    ///
+    /// Singular fields read from the what is already in the message and
+    /// repeated fields are appended to those already present.
+    ///
+    /// It is the responsibility of the caller to call input->LastTagWas() (for
+    /// groups) or input->ConsumedEntireMessage() (for non-groups) after this
+    /// returns to verify that the message's end was delimited correctly.
+    fn merge_from_coded_stream(
+        self: Pin<&mut Self>,
+        mut input: Pin<&mut CodedInputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("merge_from_coded_stream", self.upcast());
+        let start = span.is_enabled().then(|| input.current_position());
+        let ok = unsafe {
+            self.upcast_mut()
+                .MergeFromCodedStream(input.as_mut().as_ffi_mut_ptr())
+        };
+        span.finish(ok, || input.current_position() - start.unwrap_or(0));
+        ok.as_result()
+    }
+
+    /// Like [`merge_from_bytes`], but accepts messages that are missing
+    /// required fields.
+    ///
+    /// This skips the recursive [`is_initialized`] check after parsing, which
+    /// is worthwhile for trusted input with deeply nested required fields.
+    ///
+    /// [`merge_from_bytes`]: MessageLite::merge_from_bytes
+    /// [`is_initialized`]: MessageLite::is_initialized
+    fn merge_partial_from_bytes(
+        self: Pin<&mut Self>,
+        data: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("merge_partial_from_bytes", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let mut input = CodedInputStream::from_slice(data);
+        let ok = self.merge_partial_from_coded_stream(input.as_mut()).is_ok()
+            && input.as_mut().consumed_entire_message();
+        timer.finish_parse(data, ok);
+        span.finish(ok, || data.len());
+        ok.as_result()
+    }
+
+    /// Like [`merge_from_coded_stream`], but accepts messages that are missing
+    /// required fields.
+    ///
+    /// [`merge_from_coded_stream`]: MessageLite::merge_from_coded_stream
+    fn merge_partial_from_coded_stream(
+        self: Pin<&mut Self>,
+        mut input: Pin<&mut CodedInputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("merge_partial_from_coded_stream", self.upcast());
+        let start = span.is_enabled().then(|| input.current_position());
+        let ok = unsafe {
+            self.upcast_mut()
+                .MergePartialFromCodedStream(input.as_mut().as_ffi_mut_ptr())
+        };
+        span.finish(ok, || input.current_position() - start.unwrap_or(0));
+        ok.as_result()
+    }
+
+    /// Clears the message, then reads a protocol buffer from the stream into
+    /// it, accepting messages that are missing required fields.
+    ///
+    /// Unlike [`merge_partial_from_coded_stream`], this verifies that the
+    /// entire input was consumed.
+    ///
+    /// [`merge_partial_from_coded_stream`]: MessageLite::merge_partial_from_coded_stream
+    fn parse_partial_from_coded_stream(
+        self: Pin<&mut Self>,
+        mut input: Pin<&mut CodedInputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("parse_partial_from_coded_stream", self.upcast());
+        let start = span.is_enabled().then(|| input.current_position());
+        let ok = unsafe {
+            self.upcast_mut()
+                .ParsePartialFromCodedStream(input.as_mut().as_ffi_mut_ptr())
+        };
+        span.finish(ok, || input.current_position() - start.unwrap_or(0));
+        ok.as_result()
+    }
+
+    /// Clears the message, then reads a protocol buffer from the zero-copy
+    /// stream into it, accepting messages that are missing required fields.
+    fn parse_partial_from_zero_copy_stream(
+        self: Pin<&mut Self>,
+        input: Pin<&mut dyn ZeroCopyInputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("parse_partial_from_zero_copy_stream", self.upcast());
+        let ok = unsafe {
+            self.upcast_mut()
+                .ParsePartialFromZeroCopyStream(input.upcast_mut_ptr())
+        };
+        span.finish_ok(ok);
+        ok.as_result()
+    }
+
+    /// Writes a protocol buffer of this message to the given output.
+    ///
+    /// Returns an error, without writing anything, if any required fields
+    /// are missing.
+    fn serialize_to_coded_stream(
+        &self,
+        output: Pin<&mut CodedOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_to_coded_stream", self.upcast());
+        // libprotobuf only checks for missing required fields in debug builds,
+        // where it aborts, so check here and skip its check.
+        let ok = self.is_initialized()
+            && unsafe {
+                self.upcast()
+                    .SerializePartialToCodedStream(output.as_ffi_mut_ptr())
+            };
+        span.finish(ok, || self.cached_size());
+        ok.as_result()
+    }
+
+    /// Writes the message to the given zero-copy output stream.
+    ///
+    /// Returns an error, without writing anything, if any required fields
+    /// are missing.
+    fn serialize_to_zero_copy_stream(
+        &self,
+        output: Pin<&mut dyn ZeroCopyOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_to_zero_copy_stream", self.upcast());
+        // As in `serialize_to_coded_stream`.
+        let ok = self.is_initialized()
+            && unsafe {
+                self.upcast()
+                    .SerializePartialToZeroCopyStream(output.upcast_mut_ptr())
+            };
+        span.finish(ok, || self.cached_size());
+        ok.as_result()
+    }
+
+    /// Like [`serialize_to_coded_stream`], but allows missing required fields.
+    ///
+    /// [`serialize_to_coded_stream`]: MessageLite::serialize_to_coded_stream
+    fn serialize_partial_to_coded_stream(
+        &self,
+        output: Pin<&mut CodedOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_partial_to_coded_stream", self.upcast());
+        let ok = unsafe {
+            self.upcast()
+                .SerializePartialToCodedStream(output.as_ffi_mut_ptr())
+        };
+        span.finish(ok, || self.cached_size());
+        ok.as_result()
+    }
+
+    /// Like [`serialize_to_zero_copy_stream`], but allows missing required
+    /// fields.
+    ///
+    /// [`serialize_to_zero_copy_stream`]: MessageLite::serialize_to_zero_copy_stream
+    fn serialize_partial_to_zero_copy_stream(
+        &self,
+        output: Pin<&mut dyn ZeroCopyOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_partial_to_zero_copy_stream", self.upcast());
+        let ok = unsafe {
+            self.upcast()
+                .SerializePartialToZeroCopyStream(output.upcast_mut_ptr())
+        };
+        span.finish(ok, || self.cached_size());
+        ok.as_result()
+    }
+
+    /// Writes the size of the message as a varint followed by the message
+    /// itself to the given zero-copy output stream.
+    ///
+    /// This is the framing expected by [`parse_delimited_from_coded_stream`]
+    /// and [`DelimitedReader`].
+    ///
+    /// [`parse_delimited_from_coded_stream`]: MessageLite::parse_delimited_from_coded_stream
+    /// [`DelimitedReader`]: crate::io::DelimitedReader
+    fn serialize_delimited_to_zero_copy_stream(
+        &self,
+        output: Pin<&mut dyn ZeroCopyOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_delimited_to_zero_copy_stream", self.upcast());
+        let ok = unsafe {
+            ffi::SerializeDelimitedToZeroCopyStream(self.upcast(), output.upcast_mut_ptr())
+        };
+        span.finish(ok, || self.cached_size());
+        ok.as_result()
+    }
+
+    /// Like [`serialize_delimited_to_zero_copy_stream`], but writes to a
+    /// [`CodedOutputStream`].
+    ///
+    /// [`serialize_delimited_to_zero_copy_stream`]: MessageLite::serialize_delimited_to_zero_copy_stream
+    fn serialize_delimited_to_coded_stream(
+        &self,
+        output: Pin<&mut CodedOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_delimited_to_coded_stream", self.upcast());
+        let ok =
+            unsafe { ffi::SerializeDelimitedToCodedStream(self.upcast(), output.as_ffi_mut_ptr()) };
+        span.finish(ok, || self.cached_size());
+        ok.as_result()
+    }
+
+    /// Reads a varint-encoded size followed by a message of that size from
+    /// the given stream and merges the message into this message.
+    ///
+    /// Returns `Ok(true)` if a message was read and `Ok(false)` if the stream
+    /// was already at a clean end of input, i.e., no bytes could be read before
+    /// reaching EOF.
+    ///
+    /// Like [`merge_from_coded_stream`], this merges into the existing contents
+    /// of the message; call [`clear`] first to replace them instead.
+    ///
+    /// [`merge_from_coded_stream`]: MessageLite::merge_from_coded_stream
+    /// [`clear`]: MessageLite::clear
+    fn parse_delimited_from_coded_stream(
+        self: Pin<&mut Self>,
+        mut input: Pin<&mut CodedInputStream>,
+    ) -> Result<bool, OperationFailedError> {
+        let span = trace::message_span!("parse_delimited_from_coded_stream", self.upcast());
+        let start = span.is_enabled().then(|| input.current_position());
+        let mut clean_eof = false;
+        let ok = unsafe {
+            ffi::MessageLiteParseDelimitedFromCodedStream(
+                self.upcast_mut().get_unchecked_mut(),
+                input.as_mut().as_ffi_mut_ptr(),
+                &mut clean_eof,
+            )
+        };
+        span.finish(ok, || input.current_position() - start.unwrap_or(0));
+        match (ok, clean_eof) {
+            (true, _) => Ok(true),
+            (false, true) => Ok(false),
+            (false, false) => Err(OperationFailedError),
+        }
+    }
+
+    /// Like [`parse_delimited_from_coded_stream`], but reads from a
+    /// [`ZeroCopyInputStream`].
+    ///
+    /// [`parse_delimited_from_coded_stream`]: MessageLite::parse_delimited_from_coded_stream
+    fn parse_delimited_from_zero_copy_stream(
+        self: Pin<&mut Self>,
+        input: Pin<&mut dyn ZeroCopyInputStream>,
+    ) -> Result<bool, OperationFailedError> {
+        let span = trace::message_span!("parse_delimited_from_zero_copy_stream", self.upcast());
+        let mut clean_eof = false;
+        let ok = unsafe {
+            ffi::ParseDelimitedFromZeroCopyStream(
+                self.upcast_mut().get_unchecked_mut(),
+                input.upcast_mut_ptr(),
+                &mut clean_eof,
+            )
+        };
+        span.finish_ok(ok);
+        match (ok, clean_eof) {
+            (true, _) => Ok(true),
+            (false, true) => Ok(false),
+            (false, false) => Err(OperationFailedError),
+        }
+    }
+
+    /// Writes the message to the given [`Write`] implementor.
+    ///
+    /// All required fields must be set.
+    fn serialize_to_writer(&self, output: &mut dyn Write) -> Result<(), OperationFailedError> {
+        self.serialize_to_zero_copy_stream(WriterStream::new(output).as_mut())
+    }
+
+    /// Serializes the message to a byte vector.
+    ///
+    /// All required fields must be set.
+    fn serialize(&self) -> Result<Vec<u8>, OperationFailedError> {
+        let mut output = vec![];
+        self.serialize_into(&mut output)?;
+        Ok(output)
+    }
+
+    /// Serializes the message, appending the encoded bytes to `output`.
+    ///
+    /// Space for the encoded message is reserved up front using the computed
+    /// size of the message, and the message is then encoded directly into the
+    /// vector's spare capacity without any intermediate buffering.
+    ///
+    /// All required fields must be set.
+    fn serialize_into(&self, output: &mut Vec<u8>) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_into", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let old_len = output.len();
+        let ok = ffi::MessageLiteAppendToVec(self.upcast(), output, false);
+        timer.finish_serialize(&output[old_len..], ok);
+        span.finish(ok, || output.len() - old_len);
+        ok.as_result()
+    }
+
+    /// Serializes the message to a byte vector deterministically.
+    ///
+    /// Deterministic serialization guarantees that, for a given binary, equal
+    /// messages are always serialized to the same bytes. In particular, map
+    /// entries are emitted in sorted key order. This makes the output suitable
+    /// for content hashing, e.g. to deduplicate cache entries.
+    ///
+    /// Deterministic serialization is not canonical across languages or
+    /// across versions of the protobuf library, and it is slower than
+    /// ordinary serialization for messages that contain maps.
+    ///
+    /// To serialize deterministically to a [`CodedOutputStream`], use
+    /// [`CodedOutputStream::set_serialization_deterministic`].
+    ///
+    /// All required fields must be set.
+    fn serialize_deterministic(&self) -> Result<Vec<u8>, OperationFailedError> {
+        let mut output = vec![];
+        self.serialize_deterministic_into(&mut output)?;
+        Ok(output)
+    }
+
+    /// Like [`serialize_into`], but serializes the message deterministically.
+    ///
+    /// See [`serialize_deterministic`] for details.
+    ///
+    /// [`serialize_into`]: MessageLite::serialize_into
+    /// [`serialize_deterministic`]: MessageLite::serialize_deterministic
+    fn serialize_deterministic_into(
+        &self,
+        output: &mut Vec<u8>,
+    ) -> Result<(), OperationFailedError> {
+        let span = trace::message_span!("serialize_deterministic_into", self.upcast());
+        let timer = metrics::Timer::start(self.upcast());
+        let old_len = output.len();
+        let ok = ffi::MessageLiteAppendToVec(self.upcast(), output, true);
+        timer.finish_serialize(&output[old_len..], ok);
+        span.finish(ok, || output.len() - old_len);
+        ok.as_result()
+    }
+
+    /// Serializes the message, appending the encoded bytes to `output`.
+    ///
+    /// Space for the encoded message is reserved up front using the computed
+    /// size of the message, and the message is then encoded directly into the
+    /// buffer's spare capacity without any intermediate buffering.
+    ///
+    /// All required fields must be set.
+    ///
+    /// This method is only available if the `bytes` feature is enabled.
+    #[cfg(feature = "bytes")]
+    fn serialize_to_bytes_mut(
+        &self,
+        output: &mut bytes::BytesMut,
+    ) -> Result<(), OperationFailedError> {
+        output.reserve(self.byte_size());
+        self.serialize_to_zero_copy_stream(io::BufMutOutputStream::new(output).as_mut())
+    }
+
+    /// Parses a protocol buffer from a [`bytes::Buf`] and merges it into this
+    /// message.
+    ///
+    /// The buffer is read chunk by chunk without first being flattened into a
+    /// contiguous slice. The entire buffer is consumed on success.
+    ///
+    /// Singular fields read from the input overwrite what is already in the
+    /// message and repeated fields are appended to those already present.
+    ///
+    /// This method is only available if the `bytes` feature is enabled.
+    #[cfg(feature = "bytes")]
+    fn merge_from_buf(
+        self: Pin<&mut Self>,
+        input: &mut dyn bytes::Buf,
+    ) -> Result<(), OperationFailedError> {
+        let mut stream = io::BufInputStream::new(input);
+        let mut input = CodedInputStream::new(stream.as_mut());
+        self.merge_from_coded_stream(input.as_mut())?;
+        input.as_mut().consumed_entire_message().as_result()
+    }
+
+    /// Serializes the message into the front of `output`, returning the
+    /// initialized portion of `output` that contains the encoded message.
+    ///
+    /// Like [`byte_size`], this recomputes and caches the size of the message
+    /// and all of its submessages, then encodes the message directly into
+    /// `output` with no intermediate stream. Returns an error if `output` is
+    /// too small to hold the encoded message.
+    ///
+    /// All required fields must be set.
+    ///
+    /// [`byte_size`]: MessageLite::byte_size
+    fn serialize_to_uninit_slice<'o>(
+        &self,
+        output: &'o mut [MaybeUninit<u8>],
+    ) -> Result<&'o mut [u8], OperationFailedError> {
+        let size = self.byte_size();
+        if size > output.len() || size > c_int::MAX as usize {
+            return Err(OperationFailedError);
+        }
+        // SAFETY: `byte_size` has just cached the size of the message and all
+        // of its submessages, and `output` has room for that many bytes.
+        unsafe { Ok(self.serialize_with_cached_sizes_to_uninit_slice(output)) }
+    }
+
+    /// Like [`serialize_to_uninit_slice`], but uses the sizes cached by the
+    /// last call to [`byte_size`] rather than recomputing them.
+    ///
+    /// This allows computing the sizes of a batch of messages, allocating a
+    /// single contiguous output region, and then encoding each message in
+    /// place without traversing it twice.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `output` is smaller than the cached size of the message.
+    ///
+    /// # Safety
+    ///
+    /// Neither the message nor any of its submessages may have been modified
+    /// since the last call to [`byte_size`] on this message.
+    ///
+    /// [`serialize_to_uninit_slice`]: MessageLite::serialize_to_uninit_slice
+    /// [`byte_size`]: MessageLite::byte_size
+    unsafe fn serialize_with_cached_sizes_to_uninit_slice<'o>(
+        &self,
+        output: &'o mut [MaybeUninit<u8>],
+    ) -> &'o mut [u8] {
+        let size = self.upcast().GetCachedSize().expect_usize();
+        assert!(
+            size <= output.len(),
+            "output too small for serialized message"
+        );
+        let target = output.as_mut_ptr().cast::<u8>();
+        self.upcast().SerializeWithCachedSizesToArray(target);
+        slice::from_raw_parts_mut(target, size)
+    }
+
+    /// Computes the serialized size of the message.
+    ///
+    /// This recursively calls `byte_size` on all embedded messages. The
+    /// computation is generally linear in the number of the fields defined for
+    /// the proto.
+    fn byte_size(&self) -> usize {
+        self.upcast().ByteSizeLong()
+    }
+
+    /// Estimates the number of bytes of memory used by the message, including
+    /// the message object itself.
+    ///
+    /// If the message supports reflection, this is exactly
+    /// [`Message::space_used`]. Otherwise the in-memory layout of the message
+    /// is unknown, and the estimate is its serialized size plus a small fixed
+    /// overhead, which undercounts messages with many strings, submessages, or
+    /// map entries.
+    fn space_used_estimate(&self) -> usize {
+        ffi::MessageLiteSpaceUsedEstimate(self.upcast())
+    }
+
+    /// Returns the serialized size of the message as computed by the last call
+    /// to [`byte_size`], without recomputing it.
+    ///
+    /// The result is unspecified if [`byte_size`] has never been called on
+    /// this message or if the message has since been modified.
+    ///
+    /// [`byte_size`]: MessageLite::byte_size
+    fn cached_size(&self) -> usize {
+        self.upcast().GetCachedSize().expect_usize()
+    }
+
+    /// Writes the message to the given coded stream using the sizes cached by
+    /// the last call to [`byte_size`], rather than recomputing them.
+    ///
+    /// This is useful when the size has already been computed, e.g. to write
+    /// a length prefix, as it avoids traversing the message a second time. If
+    /// the message or any of its submessages has been modified since the last
+    /// call to [`byte_size`], the output will be corrupt. Check
+    /// [`CodedOutputStream::had_error`] to detect write errors.
+    ///
+    /// [`byte_size`]: MessageLite::byte_size
+    fn serialize_with_cached_sizes(&self, output: Pin<&mut CodedOutputStream>) {
+        unsafe {
+            self.upcast()
+                .SerializeWithCachedSizes(output.as_ffi_mut_ptr())
+        }
+    }
+
+    /// Like [`serialize_into`], but uses the sizes cached by the last call to
+    /// [`byte_size`] rather than recomputing them.
+    ///
+    /// # Safety
+    ///
+    /// Neither the message nor any of its submessages may have been modified
+    /// since the last call to [`byte_size`] on this message.
+    ///
+    /// [`serialize_into`]: MessageLite::serialize_into
+    /// [`byte_size`]: MessageLite::byte_size
+    unsafe fn serialize_with_cached_sizes_into(&self, output: &mut Vec<u8>) {
+        let len = output.len();
+        output.reserve(self.cached_size());
+        let size = self
+            .serialize_with_cached_sizes_to_uninit_slice(output.spare_capacity_mut())
+            .len();
+        output.set_len(len + size);
+    }
+}
+
+/// Serializes a batch of messages into a single byte vector.
+///
+/// If `delimited` is true, each message is preceded by its size as a varint,
+/// which is the framing expected by
+/// [`MessageLite::parse_delimited_from_coded_stream`] and
+/// [`DelimitedReader`](crate::io::DelimitedReader). Otherwise the encoded
+/// messages are simply concatenated.
+///
+/// The sizes of all messages are computed up front and the output is
+/// allocated once. Each message is then encoded directly into the output with
+/// no intermediate stream, and the whole batch crosses the FFI boundary only
+/// once. This is considerably faster than serializing many small messages one
+/// at a time.
+///
+/// All required fields must be set.
+pub fn serialize_batch(
+    messages: &[&dyn MessageLite],
+    delimited: bool,
+) -> Result<Vec<u8>, OperationFailedError> {
+    let mut output = vec![];
+    serialize_batch_into(messages, delimited, &mut output)?;
+    Ok(output)
+}
+
+/// Like [`serialize_batch`], but appends the encoded messages to `output`.
+pub fn serialize_batch_into(
+    messages: &[&dyn MessageLite],
+    delimited: bool,
+    output: &mut Vec<u8>,
+) -> Result<(), OperationFailedError> {
+    let messages: Vec<_> = messages
+        .iter()
+        .map(|m| ffi::MessageLiteRef {
+            message: private::MessageLite::upcast(*m),
+        })
+        .collect();
+    ffi::MessageLiteAppendBatchToVec(&messages, delimited, output).as_result()
+}
+
+/// Parses a buffer of length-delimited messages, as written by
+/// [`serialize_batch`] with `delimited` set, allocating each message on
+/// `arena`.
+///
+/// Each message is a new instance of the same type as `prototype`. The entire
+/// buffer is decoded in a single FFI call, without constructing a stream per
+/// message.
+///
+/// Returns an error if any record is malformed or truncated, or if `data` is
+/// larger than 2GiB. Messages parsed before the error remain allocated on the
+/// arena until it is dropped or reset.
+pub fn parse_delimited_batch<'a>(
+    data: &[u8],
+    prototype: &dyn MessageLite,
+    arena: &'a Arena<'_>,
+) -> Result<Vec<Pin<&'a mut dyn MessageLite>>, OperationFailedError> {
+    // SAFETY: arenas are internally synchronized, so allocating from a shared
+    // reference to an arena is sound.
+    let arena = arena.as_ffi() as *const ffi::Arena as *mut ffi::Arena;
+    let mut messages = vec![];
+    unsafe {
+        ffi::MessageLiteParseDelimitedBatch(
+            private::MessageLite::upcast(prototype),
+            arena,
+            data,
+            &mut messages,
+        )
+        .as_result()?;
+    }
+    Ok(messages
+        .into_iter()
+        .map(|m| unsafe { DynMessageLite::from_ffi_mut(m.message) as Pin<&mut dyn MessageLite> })
+        .collect())
+}
+
+struct DynMessageLite {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for DynMessageLite {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMessageLite(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl DynMessageLite {
+    unsafe_ffi_conversions!(ffi::MessageLite);
+}
+
+impl MessageLite for DynMessageLite {}
+
+impl private::MessageLite for DynMessageLite {
+    fn upcast(&self) -> &ffi::MessageLite {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MessageLite> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+/// Abstract interface for protocol messages.
+///
+/// See also `MessageLite`, which contains most every-day operations.  `Message`
+/// adds descriptors and reflection on top of that.
+///
+/// The methods of this class that have default implementations have default
+/// implementations based on reflection. Message classes which are optimized for
+/// speed will want to override these with faster implementations, but classes
+/// optimized for code size may be happy with keeping them.  See the
+/// optimize_for option in descriptor.proto.
+///
+/// Users must not derive from this class. Only the protocol compiler and the
+/// internal library are allowed to create subclasses.
+pub trait Message: private::Message + MessageLite {
+    /// Constructs a new instance of the same type.
+    ///
+    /// Unlike [`MessageLite::new`], the returned message retains access to
+    /// the reflection-based functionality of `Message`.
+    fn new_message(&self) -> Pin<Box<dyn Message>> {
+        unsafe {
+            let message: &ffi::Message = mem::transmute(self.upcast());
+            DynMessage::from_ffi_owned(ffi::NewMessage(message))
+        }
+    }
+
+    /// Constructs a new instance of the same type on the given arena.
+    ///
+    /// Unlike [`MessageLite::new_in`], the returned message retains access to
+    /// the reflection-based functionality of `Message`, and can be added to a
+    /// repeated field of another message on the same arena with
+    /// [`Message::add_allocated_message`].
+    fn new_message_in<'a>(&self, arena: &'a Arena<'_>) -> ArenaMessage<'a> {
+        // SAFETY: arenas are internally synchronized, so allocating from a
+        // shared reference to an arena is sound.
+        let arena = arena.as_ffi() as *const ffi::Arena as *mut ffi::Arena;
+        unsafe {
+            let message: &ffi::Message = mem::transmute(self.upcast());
+            ArenaMessage(DynMessage::from_ffi_mut(ffi::NewMessageInArena(
+                message, arena,
+            )))
+        }
+    }
+
+    /// Computes the number of bytes of memory used by the message, including
+    /// the message object itself.
+    ///
+    /// Unlike [`MessageLite::byte_size`], this accounts for the allocated
+    /// capacity of strings, repeated fields, and maps, so it is suitable for
+    /// bounding the memory held by a cache of parsed messages. It walks the
+    /// message with reflection and is considerably slower than `byte_size`.
+    fn space_used(&self) -> usize {
+        let message: &ffi::Message = unsafe { mem::transmute(self.upcast()) };
+        message.SpaceUsedLong()
+    }
+
+    /// Swaps the contents of this message with those of `other`.
+    ///
+    /// When both messages live on the same arena, or both live on the heap,
+    /// this swaps their internal pointers without copying any fields. When
+    /// they live on different arenas, the contents are deep copied instead.
+    ///
+    /// Returns an error if `other` is not of the same type as this message.
+    fn swap(
+        self: Pin<&mut Self>,
+        other: Pin<&mut dyn Message>,
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        ffi::MessageSwap(message, accessed_mut(other)).as_result()
+    }
+
+    /// Like [`Message::swap`], but never falls back to a deep copy.
+    ///
+    /// Returns an error if `other` is not of the same type as this message or
+    /// if the messages do not live on the same arena.
+    fn unsafe_arena_swap(
+        self: Pin<&mut Self>,
+        other: Pin<&mut dyn Message>,
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        ffi::MessageUnsafeArenaSwap(message, accessed_mut(other)).as_result()
+    }
+
+    /// Appends `element` to the repeated message field `field` without
+    /// copying it.
+    ///
+    /// The message takes ownership of `element`, which must live on the same
+    /// arena as this message. Together with [`Message::new_message_in`], this
+    /// lets several threads parse the elements of a repeated field into one
+    /// arena concurrently, after which the elements are added to their parent
+    /// on a single thread.
+    ///
+    /// Returns an error if `field` is not a repeated message field of this
+    /// message's type, if `element` is not of the field's type, or if
+    /// `element` does not live on this message's arena. The element is then
+    /// left to be freed with its arena.
+    fn add_allocated_message(
+        self: Pin<&mut Self>,
+        field: &FieldDescriptor,
+        element: ArenaMessage<'_>,
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        let element = unsafe { accessed_mut(element.0).get_unchecked_mut() as *mut ffi::Message };
+        unsafe { ffi::MessageAddAllocatedMessage(message, field.as_ffi(), element) }.as_result()
+    }
+
+    /// Parses a protocol buffer contained in a byte slice, merging only the
+    /// fields selected by `mask` into this message.
+    ///
+    /// Fields outside the mask are skipped without being decoded, and are
+    /// discarded rather than stored as unknown fields, so this is much
+    /// cheaper than parsing the whole message when only a few of its fields
+    /// are needed. The mask is resolved against this message's type once and
+    /// cached for subsequent calls with the same type and mask.
+    ///
+    /// Required fields are not checked, since those outside the mask are
+    /// necessarily missing.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer or if the
+    /// mask contains a path that is not valid for this message's type.
+    fn merge_from_bytes_with_mask(
+        self: Pin<&mut Self>,
+        data: &[u8],
+        mask: &FieldMask,
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        ffi::MessageMergeFromBytesWithMask(message, data, mask.as_ffi()).as_result()
+    }
+
+    /// Returns the value of the singular `string` or `bytes` field `field`.
+    ///
+    /// The returned slice borrows the message's own storage for the field, so
+    /// no copy is made. An unset field yields its default value.
+    ///
+    /// Returns an error if `field` is not a `string` or `bytes` field of this
+    /// message's type, or is a `bytes` field with `ctype = CORD`, whose value
+    /// is not stored contiguously.
+    fn string_field(&self, field: &FieldDescriptor) -> Result<&[u8], OperationFailedError> {
+        if field.is_repeated() {
+            return Err(OperationFailedError);
+        }
+        string_field_inner(self, field, CInt(0))
+    }
+
+    /// Like [`Message::string_field`], but returns the `index`th element of
+    /// the repeated field `field`.
+    ///
+    /// Returns an error if `index` is out of bounds.
+    fn repeated_string_field(
+        &self,
+        field: &FieldDescriptor,
+        index: usize,
+    ) -> Result<&[u8], OperationFailedError> {
+        if !field.is_repeated() {
+            return Err(OperationFailedError);
+        }
+        let index = CInt::try_from(index).map_err(|_| OperationFailedError)?;
+        string_field_inner(self, field, index)
+    }
+
+    /// Returns the elements of the repeated numeric, `bool` or enum field
+    /// `field`.
+    ///
+    /// The returned slice borrows the field's contiguous storage in the
+    /// message, so the elements are neither copied nor fetched one at a time,
+    /// and can be handed to vectorized code directly. The variant of the
+    /// result is determined by the type of the field: `sint32`, `sfixed32`
+    /// and enum fields are [`RepeatedScalars::Int32`], `fixed32` fields are
+    /// [`RepeatedScalars::UInt32`], and so on.
+    ///
+    /// Returns an error if `field` is not a repeated field of this message's
+    /// type, or is of a `string`, `bytes` or message type.
+    fn repeated_scalar_field(
+        &self,
+        field: &FieldDescriptor,
+    ) -> Result<RepeatedScalars<'_>, OperationFailedError> {
+        let message: &ffi::Message = unsafe { mem::transmute(self.upcast()) };
+        let mut ok = false;
+        let array = ffi::MessageGetRepeatedScalarField(message, field.as_ffi(), &mut ok);
+        ok.as_result()?;
+        Ok(unsafe { RepeatedScalars::from_ffi(field.field_type(), array) })
+    }
+
+    /// Like [`Message::repeated_scalar_field`], but allows the elements to be
+    /// modified in place.
+    ///
+    /// The number of elements cannot be changed through the returned slice.
+    fn repeated_scalar_field_mut(
+        self: Pin<&mut Self>,
+        field: &FieldDescriptor,
+    ) -> Result<RepeatedScalarsMut<'_>, OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        let mut ok = false;
+        let array = ffi::MessageMutableRepeatedScalarField(message, field.as_ffi(), &mut ok);
+        ok.as_result()?;
+        Ok(unsafe { RepeatedScalarsMut::from_ffi(field.field_type(), array) })
+    }
+
+    /// Returns an iterator over the elements of the repeated `string` or
+    /// `bytes` field `field`.
+    ///
+    /// The iterator walks the field's array of element pointers directly and
+    /// yields slices of the message's own storage, without copying the
+    /// elements or calling into `libprotobuf` for each of them.
+    ///
+    /// Returns an error if `field` is not a repeated `string` or `bytes`
+    /// field of this message's type, or is a `bytes` field with
+    /// `ctype = CORD`.
+    fn repeated_string_field_iter(
+        &self,
+        field: &FieldDescriptor,
+    ) -> Result<RepeatedStrings<'_>, OperationFailedError> {
+        let message: &ffi::Message = unsafe { mem::transmute(self.upcast()) };
+        let mut ok = false;
+        let array = ffi::MessageGetRepeatedStringField(message, field.as_ffi(), &mut ok);
+        ok.as_result()?;
+        Ok(RepeatedStrings(unsafe { pointer_array(array) }.iter()))
+    }
+
+    /// Parses a protocol buffer contained in a byte slice and merges it into
+    /// this message, except for the values of the `bytes` fields in `fields`,
+    /// which are returned as slices of `data` instead.
+    ///
+    /// The values of the aliased fields are neither copied nor stored in the
+    /// message, which is left as if they were absent from the input. They are
+    /// returned in the order in which they appear, so the value of a singular
+    /// field is the last one returned for its number. The other fields are
+    /// parsed as usual.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer, if the
+    /// message is missing required fields, or if any of `fields` is not a
+    /// `bytes` field of this message's type.
+    fn merge_from_bytes_aliasing<'a>(
+        self: Pin<&mut Self>,
+        data: &'a [u8],
+        fields: &[&FieldDescriptor],
+    ) -> Result<Vec<AliasedField<'a>>, OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        let numbers: Vec<i32> = fields.iter().map(|f| f.number()).collect();
+        let mut ranges = vec![];
+        ffi::MessageMergeFromBytesAliasing(message, data, &numbers, &mut ranges).as_result()?;
+        Ok(ranges
+            .into_iter()
+            .map(|r| AliasedField {
+                number: r.number,
+                value: &data[r.offset..r.offset + r.len],
+            })
+            .collect())
+    }
+
+    /// Parses a protocol buffer contained in a byte slice and merges it into
+    /// this message, discarding any unknown fields.
+    ///
+    /// Unknown fields, here and in submessages, are skipped without being
+    /// decoded, rather than being stored in the message's `UnknownFieldSet`.
+    /// Fields in an extension range of their message are not considered
+    /// unknown.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer or if the
+    /// message is missing required fields.
+    fn merge_from_bytes_discarding_unknown_fields(
+        self: Pin<&mut Self>,
+        data: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        ffi::MessageMergeFromBytesDiscardingUnknownFields(message, data).as_result()
+    }
+
+    /// Parses a protocol buffer contained in a byte slice and merges it into
+    /// this message, appending the message's unknown fields to `unknown` in
+    /// wire format.
+    ///
+    /// The unknown fields are copied verbatim, as a single contiguous range of
+    /// bytes, without being decoded or stored in the message's
+    /// `UnknownFieldSet`. Since fields may appear in any order, appending
+    /// `unknown` to the serialized message re-emits them unchanged. Only the
+    /// message's own unknown fields are split off; those of submessages are
+    /// parsed as usual. Fields in an extension range of the message are not
+    /// considered unknown.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer or if the
+    /// message is missing required fields.
+    fn merge_from_bytes_with_raw_unknown_fields(
+        self: Pin<&mut Self>,
+        data: &[u8],
+        unknown: &mut Vec<u8>,
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        ffi::MessageMergeFromBytesWithRawUnknownFields(message, data, unknown).as_result()
+    }
+
+    /// Parses a protocol buffer contained in a byte slice and merges it into
+    /// this message, parsing the elements of the large repeated message field
+    /// `field` on up to `threads` threads.
+    ///
+    /// The input is first scanned for the boundaries of the elements of
+    /// `field`, without decoding them, while the other fields are merged on
+    /// the calling thread. The elements are then allocated, in the message's
+    /// arena if it has one, and parsed concurrently. They are appended to
+    /// `field` in the order in which they appear in the input.
+    ///
+    /// Unlike [`MessageLite::merge_from_bytes`], the input may exceed 2 GiB,
+    /// though each element of `field` must be smaller than that.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer, if the
+    /// message is missing required fields, or if `field` is not a repeated
+    /// message field of this message's type.
+    fn merge_from_bytes_parallel(
+        self: Pin<&mut Self>,
+        data: &[u8],
+        field: &FieldDescriptor,
+        threads: usize,
+    ) -> Result<(), OperationFailedError> {
+        let mut message: Pin<&mut ffi::Message> = unsafe { mem::transmute(self.upcast_mut()) };
+        let mut first = 0;
+        let mut elements = vec![];
+        ffi::MessageMergeFromBytesSplitting(
+            message.as_mut(),
+            field.as_ffi(),
+            data,
+            &mut first,
+            &mut elements,
+        )
+        .as_result()?;
+        let parser = ParallelParser {
+            message: unsafe { message.get_unchecked_mut() },
+            field,
+        };
+        let threads = threads.clamp(1, elements.len().max(1));
+        let chunk_len = ((elements.len() + threads - 1) / threads).max(1);
+        let ok = thread::scope(|s| {
+            let parser = &parser;
+            let workers: Vec<_> = elements
+                .chunks(chunk_len)
+                .enumerate()
+                .map(|(i, elements)| {
+                    s.spawn(move || unsafe {
+                        ffi::MessageParseRepeatedMessages(
+                            parser.message,
+                            parser.field.as_ffi(),
+                            first + i * chunk_len,
+                            data,
+                            elements,
+                        )
+                    })
+                })
+                .collect();
+            workers.into_iter().fold(true, |ok, worker| {
+                worker.join().expect("parser thread panicked") && ok
+            })
+        });
+        ok.as_result()
+    }
+
+    /// Serializes the message to a byte vector, encoding the elements of the
+    /// large repeated message field `field` on up to `threads` threads.
+    ///
+    /// The encoded sizes of the elements are computed concurrently, and the
+    /// elements are then encoded concurrently into disjoint ranges of the
+    /// output, which is allocated once. The other fields are encoded on the
+    /// calling thread and precede the elements of `field` in the output,
+    /// which is therefore not byte-for-byte identical to the output of
+    /// [`MessageLite::serialize`], but parses to the same message.
+    ///
+    /// This is only worthwhile when `field` accounts for most of a large
+    /// message. Unlike [`MessageLite::serialize`], the output may exceed 2 GiB,
+    /// though each element of `field` must be smaller than that.
+    ///
+    /// All required fields must be set.
+    ///
+    /// Returns an error if `field` is not a repeated message field of this
+    /// message's type or if the message uses the MessageSet wire format.
+    fn serialize_parallel(
+        &self,
+        field: &FieldDescriptor,
+        threads: usize,
+    ) -> Result<Vec<u8>, OperationFailedError> {
+        serialize_parallel_inner(self, field, threads, false)
+    }
+
+    /// Like [`Message::serialize_parallel`], but serializes the message
+    /// deterministically.
+    ///
+    /// See [`MessageLite::serialize_deterministic`] for details.
+    fn serialize_parallel_deterministic(
+        &self,
+        field: &FieldDescriptor,
+        threads: usize,
+    ) -> Result<Vec<u8>, OperationFailedError> {
+        serialize_parallel_inner(self, field, threads, true)
+    }
+
+    /// Returns an iterator over the encoding of the message in chunks of
+    /// `chunk_len` bytes.
+    ///
+    /// The message is encoded as the chunks are consumed, a field or an
+    /// element of a repeated message field at a time, so a large message can
+    /// be written out with memory bounded by the chunk length and the size of
+    /// its largest such piece, rather than by the size of the message. As
+    /// chunks are only produced on demand, an async writer that pulls them
+    /// one at a time, such as a `Stream` adapted from the iterator, is subject
+    /// to backpressure. Every chunk but the last is exactly `chunk_len` bytes
+    /// long.
+    ///
+    /// The output parses to the same message as the output of
+    /// [`MessageLite::serialize`], though its fields may appear in another
+    /// order. The message may not be modified until the iterator is dropped.
+    ///
+    /// Returns an error if required fields are missing.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `chunk_len` is zero.
+    fn serialize_chunks(
+        &self,
+        chunk_len: usize,
+    ) -> Result<SerializedChunks<'_>, OperationFailedError> {
+        SerializedChunks::new(self, chunk_len, false)
+    }
+
+    /// Like [`Message::serialize_chunks`], but serializes the message
+    /// deterministically.
+    ///
+    /// See [`MessageLite::serialize_deterministic`] for details.
+    fn serialize_chunks_deterministic(
+        &self,
+        chunk_len: usize,
+    ) -> Result<SerializedChunks<'_>, OperationFailedError> {
+        SerializedChunks::new(self, chunk_len, true)
+    }
+}
+
+/// The state shared by the threads of [`Message::merge_from_bytes_parallel`].
+struct ParallelParser<'a> {
+    message: *mut ffi::Message,
+    field: &'a FieldDescriptor,
+}
+
+// SAFETY: each thread only parses into a disjoint set of elements of `field`,
+// which were allocated before the threads were started.
+unsafe impl<'a> Sync for ParallelParser<'a> {}
+
+/// The state shared by the threads of [`Message::serialize_parallel`].
+struct ParallelSerializer<'a> {
+    message: &'a ffi::Message,
+    field: &'a FieldDescriptor,
+    deterministic: bool,
+    target: *mut u8,
+}
+
+// SAFETY: the threads only read the message, except for caching the sizes of
+// the elements of `field`, and each thread touches a disjoint set of elements
+// and a disjoint range of `target`.
+unsafe impl<'a> Sync for ParallelSerializer<'a> {}
+
+fn serialize_parallel_inner<M>(
+    message: &M,
+    field: &FieldDescriptor,
+    threads: usize,
+    deterministic: bool,
+) -> Result<Vec<u8>, OperationFailedError>
+where
+    M: Message + ?Sized,
+{
+    let message: &ffi::Message = unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+    let mut len = 0;
+    ffi::MessageRepeatedMessageFieldSize(message, field.as_ffi(), &mut len).as_result()?;
+    let threads = threads.clamp(1, len.max(1));
+    let mut serializer = ParallelSerializer {
+        message,
+        field,
+        deterministic,
+        target: ptr::null_mut(),
+    };
+
+    // Compute the encoded size of every element, which also caches the sizes
+    // that the encoding pass relies on.
+    let mut sizes = vec![0; len];
+    let chunk_len = ((len + threads - 1) / threads).max(1);
+    let ok = thread::scope(|s| {
+        let serializer = &serializer;
+        let workers: Vec<_> = sizes
+            .chunks_mut(chunk_len)
+            .enumerate()
+            .map(|(i, sizes)| {
+                s.spawn(move || {
+                    ffi::MessageRepeatedMessageSizes(
+                        serializer.message,
+                        serializer.field.as_ffi(),
+                        CInt::expect_from(i * chunk_len),
+                        sizes,
+                    )
+                })
+            })
+            .collect();
+        workers.into_iter().fold(true, |ok, worker| {
+            worker.join().expect("serializer thread panicked") && ok
+        })
+    });
+    ok.as_result()?;
+
+    // Split the elements into contiguous ranges of roughly equal encoded
+    // size, each of which fits in a single output stream.
+    let total: usize = sizes.iter().sum();
+    let target_len = ((total + threads - 1) / threads).clamp(1, c_int::MAX as usize);
+    let mut ranges = vec![];
+    let (mut begin, mut offset, mut range_len) = (0, 0, 0);
+    for (i, &size) in sizes.iter().enumerate() {
+        if range_len > 0 && (range_len >= target_len || range_len + size > c_int::MAX as usize) {
+            ranges.push((begin, i, offset, range_len));
+            begin = i;
+            offset += range_len;
+            range_len = 0;
+        }
+        range_len += size;
+    }
+    if range_len > 0 {
+        ranges.push((begin, len, offset, range_len));
+    }
+
+    let mut output = vec![];
+    ffi::MessageAppendFieldsExceptToVec(message, field.as_ffi(), deterministic, &mut output)
+        .as_result()?;
+    let prefix_len = output.len();
+    output.reserve(total);
+    serializer.target = unsafe { output.as_mut_ptr().add(prefix_len) };
+    let ok = thread::scope(|s| {
+        let serializer = &serializer;
+        let workers: Vec<_> = ranges
+            .iter()
+            .map(|&(begin, end, offset, range_len)| {
+                s.spawn(move || unsafe {
+                    ffi::MessageSerializeRepeatedMessages(
+                        serializer.message,
+                        serializer.field.as_ffi(),
+                        CInt::expect_from(begin),
+                        CInt::expect_from(end - begin),
+                        serializer.deterministic,
+                        serializer.target.add(offset),
+                        range_len,
+                    )
+                })
+            })
+            .collect();
+        workers.into_iter().fold(true, |ok, worker| {
+            worker.join().expect("serializer thread panicked") && ok
+        })
+    });
+    ok.as_result()?;
+    unsafe { output.set_len(prefix_len + total) };
+    Ok(output)
+}
+
+/// An iterator over the encoding of a message in chunks.
+///
+/// Returned by [`Message::serialize_chunks`]. After an error, the iterator
+/// returns `None`.
+pub struct SerializedChunks<'a> {
+    serializer: *mut ffi::ChunkedSerializer,
+    chunk_len: usize,
+    // The encoded bytes not yet returned begin at `offset`.
+    buffer: Vec<u8>,
+    offset: usize,
+    done: bool,
+    _message: PhantomData<&'a ffi::Message>,
+}
+
+// SAFETY: the serializer only reads the message, which is `Sync`, besides
+// caching the sizes of its submessages, which the borrow of the message by
+// the iterator prevents anything else from doing concurrently.
+unsafe impl Send for SerializedChunks<'_> {}
+
+impl<'a> SerializedChunks<'a> {
+    fn new<M>(
+        message: &'a M,
+        chunk_len: usize,
+        deterministic: bool,
+    ) -> Result<SerializedChunks<'a>, OperationFailedError>
+    where
+        M: Message + ?Sized,
+    {
+        assert!(chunk_len > 0, "chunk length must be positive");
+        let message: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+        let serializer = ffi::NewChunkedSerializer(message, deterministic);
+        if serializer.is_null() {
+            return Err(OperationFailedError);
+        }
+        Ok(SerializedChunks {
+            serializer,
+            chunk_len,
+            buffer: vec![],
+            offset: 0,
+            done: false,
+            _message: PhantomData,
+        })
+    }
+}
+
+impl Drop for SerializedChunks<'_> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteChunkedSerializer(self.serializer) }
+    }
+}
+
+impl Iterator for SerializedChunks<'_> {
+    type Item = Result<Vec<u8>, OperationFailedError>;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        if self.buffer.len() - self.offset < self.chunk_len && !self.done {
+            // Only the tail of the buffer, which is shorter than a chunk, is
+            // moved to make room for more.
+            self.buffer.drain(..self.offset);
+            self.offset = 0;
+            let serializer = unsafe { Pin::new_unchecked(&mut *self.serializer) };
+            let ok = ffi::ChunkedSerializerNext(
+                serializer,
+                self.chunk_len,
+                &mut self.buffer,
+                &mut self.done,
+            );
+            if !ok {
+                self.done = true;
+                self.buffer.clear();
+                return Some(Err(OperationFailedError));
+            }
+        }
+        if self.offset == self.buffer.len() {
+            return None;
+        }
+        let end = self.buffer.len().min(self.offset + self.chunk_len);
+        let chunk = self.buffer[self.offset..end].to_vec();
+        self.offset = end;
+        Some(Ok(chunk))
+    }
+}
+
+/// The value of a field that was not copied into a message by
+/// [`Message::merge_from_bytes_aliasing`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct AliasedField<'a> {
+    /// The number of the field.
+    pub number: i32,
+    /// The value of the field, which borrows the input.
+    pub value: &'a [u8],
+}
+
+fn string_field_inner<'a, M>(
+    message: &'a M,
+    field: &FieldDescriptor,
+    index: CInt,
+) -> Result<&'a [u8], OperationFailedError>
+where
+    M: Message + ?Sized,
+{
+    let message: &ffi::Message = unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+    let mut ok = false;
+    let value = ffi::MessageGetStringField(message, field.as_ffi(), index, &mut ok);
+    ok.as_result()?;
+    Ok(value)
+}
+
+struct DynMessage {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for DynMessage {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMessage(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl DynMessage {
+    unsafe_ffi_conversions!(ffi::Message);
+}
+
+impl MessageLite for DynMessage {}
+
+impl private::MessageLite for DynMessage {
+    fn upcast(&self) -> &ffi::MessageLite {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MessageLite> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+impl Message for DynMessage {}
+impl private::Message for DynMessage {}
+
+/// The elements of a repeated numeric, `bool` or enum field, borrowed from a
+/// message by [`Message::repeated_scalar_field`].
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum RepeatedScalars<'a> {
+    /// The elements of an `int32`, `sint32`, `sfixed32` or enum field.
+    Int32(&'a [i32]),
+    /// The elements of an `int64`, `sint64` or `sfixed64` field.
+    Int64(&'a [i64]),
+    /// The elements of a `uint32` or `fixed32` field.
+    UInt32(&'a [u32]),
+    /// The elements of a `uint64` or `fixed64` field.
+    UInt64(&'a [u64]),
+    /// The elements of a `float` field.
+    Float(&'a [f32]),
+    /// The elements of a `double` field.
+    Double(&'a [f64]),
+    /// The elements of a `bool` field.
+    Bool(&'a [bool]),
+}
+
+impl<'a> RepeatedScalars<'a> {
+    /// # Safety
+    ///
+    /// `array` must describe the storage of a repeated field of type
+    /// `field_type` that lives at least as long as `'a` and is not modified
+    /// during `'a`.
+    unsafe fn from_ffi(field_type: FieldType, array: ffi::ScalarArray) -> RepeatedScalars<'a> {
+        match field_type {
+            FieldType::Int32 | FieldType::SInt32 | FieldType::SFixed32 | FieldType::Enum => {
+                RepeatedScalars::Int32(scalar_array(array))
+            }
+            FieldType::Int64 | FieldType::SInt64 | FieldType::SFixed64 => {
+                RepeatedScalars::Int64(scalar_array(array))
+            }
+            FieldType::UInt32 | FieldType::Fixed32 => RepeatedScalars::UInt32(scalar_array(array)),
+            FieldType::UInt64 | FieldType::Fixed64 => RepeatedScalars::UInt64(scalar_array(array)),
+            FieldType::Float => RepeatedScalars::Float(scalar_array(array)),
+            FieldType::Double => RepeatedScalars::Double(scalar_array(array)),
+            FieldType::Bool => RepeatedScalars::Bool(scalar_array(array)),
+            _ => unreachable!("not a scalar field type: {:?}", field_type),
+        }
+    }
+
+    /// Returns the number of elements.
+    pub fn len(&self) -> usize {
+        match self {
+            RepeatedScalars::Int32(values) => values.len(),
+            RepeatedScalars::Int64(values) => values.len(),
+            RepeatedScalars::UInt32(values) => values.len(),
+            RepeatedScalars::UInt64(values) => values.len(),
+            RepeatedScalars::Float(values) => values.len(),
+            RepeatedScalars::Double(values) => values.len(),
+            RepeatedScalars::Bool(values) => values.len(),
+        }
+    }
+
+    /// Reports whether there are no elements.
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+}
+
+/// The elements of a repeated numeric, `bool` or enum field, mutably borrowed
+/// from a message by [`Message::repeated_scalar_field_mut`].
+#[derive(Debug, PartialEq)]
+pub enum RepeatedScalarsMut<'a> {
+    /// The elements of an `int32`, `sint32`, `sfixed32` or enum field.
+    Int32(&'a mut [i32]),
+    /// The elements of an `int64`, `sint64` or `sfixed64` field.
+    Int64(&'a mut [i64]),
+    /// The elements of a `uint32` or `fixed32` field.
+    UInt32(&'a mut [u32]),
+    /// The elements of a `uint64` or `fixed64` field.
+    UInt64(&'a mut [u64]),
+    /// The elements of a `float` field.
+    Float(&'a mut [f32]),
+    /// The elements of a `double` field.
+    Double(&'a mut [f64]),
+    /// The elements of a `bool` field.
+    Bool(&'a mut [bool]),
+}
+
+impl<'a> RepeatedScalarsMut<'a> {
+    /// # Safety
+    ///
+    /// `array` must describe the storage of a repeated field of type
+    /// `field_type` that lives at least as long as `'a` and is not otherwise
+    /// accessed during `'a`.
+    unsafe fn from_ffi(field_type: FieldType, array: ffi::ScalarArray) -> RepeatedScalarsMut<'a> {
+        match field_type {
+            FieldType::Int32 | FieldType::SInt32 | FieldType::SFixed32 | FieldType::Enum => {
+                RepeatedScalarsMut::Int32(scalar_array_mut(array))
+            }
+            FieldType::Int64 | FieldType::SInt64 | FieldType::SFixed64 => {
+                RepeatedScalarsMut::Int64(scalar_array_mut(array))
+            }
+            FieldType::UInt32 | FieldType::Fixed32 => {
+                RepeatedScalarsMut::UInt32(scalar_array_mut(array))
+            }
+            FieldType::UInt64 | FieldType::Fixed64 => {
+                RepeatedScalarsMut::UInt64(scalar_array_mut(array))
+            }
+            FieldType::Float => RepeatedScalarsMut::Float(scalar_array_mut(array)),
+            FieldType::Double => RepeatedScalarsMut::Double(scalar_array_mut(array)),
+            FieldType::Bool => RepeatedScalarsMut::Bool(scalar_array_mut(array)),
+            _ => unreachable!("not a scalar field type: {:?}", field_type),
+        }
+    }
+}
+
+/// Views the storage of a C++ `RepeatedField` as a slice.
+///
+/// # Safety
+///
+/// `array` must describe the storage of a repeated field whose elements are
+/// `T`s that live at least as long as `'a` and are not modified during `'a`.
+unsafe fn scalar_array<'a, T>(array: ffi::ScalarArray) -> &'a [T] {
+    if array.len == 0 {
+        return &[];
+    }
+    slice::from_raw_parts(array.data.cast(), array.len)
+}
+
+/// Like [`scalar_array`], but views the storage as a mutable slice.
+///
+/// # Safety
+///
+/// As for [`scalar_array`], and the elements must not be otherwise accessed
+/// during `'a`.
+unsafe fn scalar_array_mut<'a, T>(array: ffi::ScalarArray) -> &'a mut [T] {
+    if array.len == 0 {
+        return &mut [];
+    }
+    slice::from_raw_parts_mut(array.data.cast(), array.len)
+}
+
+/// An iterator over the elements of a repeated `string` or `bytes` field,
+/// returned by [`Message::repeated_string_field_iter`].
+#[derive(Debug, Clone)]
+pub struct RepeatedStrings<'a>(slice::Iter<'a, &'a CxxString>);
+
+impl<'a> Iterator for RepeatedStrings<'a> {
+    type Item = &'a [u8];
+
+    fn next(&mut self) -> Option<&'a [u8]> {
+        self.0.next().map(|value| value.as_bytes())
+    }
+
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.0.size_hint()
+    }
+}
+
+impl<'a> DoubleEndedIterator for RepeatedStrings<'a> {
+    fn next_back(&mut self) -> Option<&'a [u8]> {
+        self.0.next_back().map(|value| value.as_bytes())
+    }
+}
+
+impl<'a> ExactSizeIterator for RepeatedStrings<'a> {}
+
+/// Views the element pointers of a C++ `RepeatedPtrField` as a slice of
+/// references.
+///
+/// # Safety
+///
+/// `array` must describe the pointer array of a repeated field whose elements
+/// are `T`s that live at least as long as `'a` and are not modified during
+/// `'a`.
+unsafe fn pointer_array<'a, T>(array: ffi::PointerArray) -> &'a [&'a T] {
+    if array.len == 0 {
+        return &[];
+    }
+    slice::from_raw_parts(array.data.cast(), array.len)
+}
+
+/// An iterator over the elements of a repeated message field, visited by a
+/// [`FieldWalker`].
+#[derive(Clone)]
+pub struct RepeatedMessages<'a>(slice::Iter<'a, &'a DynMessage>);
+
+impl<'a> Iterator for RepeatedMessages<'a> {
+    type Item = &'a dyn Message;
+
+    fn next(&mut self) -> Option<&'a dyn Message> {
+        self.0.next().map(|message| *message as &dyn Message)
     }
 
-    /// Writes the message to the given zero-copy output stream.
-    ///
-    /// All required fields must be set.
-    fn serialize_to_zero_copy_stream(
-        &self,
-        output: Pin<&mut dyn ZeroCopyOutputStream>,
-    ) -> Result<(), OperationFailedError> {
-        unsafe {
-            self.upcast()
-                .SerializeToZeroCopyStream(output.upcast_mut_ptr())
-                .as_result()
-        }
+    fn size_hint(&self) -> (usize, Option<usize>) {
+        self.0.size_hint()
     }
+}
 
-    /// Writes the message to the given [`Write`] implementor.
-    ///
-    /// All required fields must be set.
-    fn serialize_to_writer(&self, output: &mut dyn Write) -> Result<(), OperationFailedError> {
-        self.serialize_to_zero_copy_stream(WriterStream::new(output).as_mut())
+impl<'a> DoubleEndedIterator for RepeatedMessages<'a> {
+    fn next_back(&mut self) -> Option<&'a dyn Message> {
+        self.0.next_back().map(|message| *message as &dyn Message)
     }
+}
 
-    /// Serializes the message to a byte vector.
+impl<'a> ExactSizeIterator for RepeatedMessages<'a> {}
+
+/// The value of a set field, passed to a [`FieldVisitor`] by a
+/// [`FieldWalker`].
+///
+/// The values of `string`, `bytes`, message and repeated fields borrow the
+/// message's own storage, except for those of `bytes` fields with
+/// `ctype = CORD`, which are copied.
+#[derive(Clone)]
+pub enum FieldValue<'a> {
+    /// The value of an `int32`, `sint32` or `sfixed32` field.
+    Int32(i32),
+    /// The value of an `int64`, `sint64` or `sfixed64` field.
+    Int64(i64),
+    /// The value of a `uint32` or `fixed32` field.
+    UInt32(u32),
+    /// The value of a `uint64` or `fixed64` field.
+    UInt64(u64),
+    /// The value of a `float` field.
+    Float(f32),
+    /// The value of a `double` field.
+    Double(f64),
+    /// The value of a `bool` field.
+    Bool(bool),
+    /// The number of the value of an enum field.
+    Enum(i32),
+    /// The value of a `string` or `bytes` field.
+    Bytes(&'a [u8]),
+    /// The value of a message or group field.
+    Message(&'a dyn Message),
+    /// The elements of a repeated numeric, `bool` or enum field.
+    RepeatedScalars(RepeatedScalars<'a>),
+    /// The elements of a repeated `string` or `bytes` field.
+    RepeatedBytes(RepeatedStrings<'a>),
+    /// The elements of a repeated message or group field.
+    RepeatedMessages(RepeatedMessages<'a>),
+}
+
+impl<'a> FieldValue<'a> {
+    /// # Safety
     ///
-    /// All required fields must be set.
-    fn serialize(&self) -> Result<Vec<u8>, OperationFailedError> {
-        let mut output = vec![];
-        self.serialize_to_writer(&mut output)?;
-        Ok(output)
+    /// `visited` must have been produced by a walk of a message that lives
+    /// at least as long as `'a` and is not modified during `'a`, and by a
+    /// walker that is neither dropped nor reused during `'a` if `field` is a
+    /// `bytes` field with `ctype = CORD`.
+    unsafe fn from_ffi(field: &FieldDescriptor, visited: &ffi::VisitedField) -> FieldValue<'a> {
+        let field_type = field.field_type();
+        if field.is_repeated() {
+            let array = ffi::PointerArray {
+                data: visited.data,
+                len: visited.len,
+            };
+            return match field_type {
+                FieldType::String | FieldType::Bytes => {
+                    FieldValue::RepeatedBytes(RepeatedStrings(pointer_array(array).iter()))
+                }
+                FieldType::Message | FieldType::Group => {
+                    FieldValue::RepeatedMessages(RepeatedMessages(pointer_array(array).iter()))
+                }
+                _ => {
+                    let array = ffi::ScalarArray {
+                        data: visited.data as *mut CVoid,
+                        len: visited.len,
+                    };
+                    FieldValue::RepeatedScalars(RepeatedScalars::from_ffi(field_type, array))
+                }
+            };
+        }
+        let bits = visited.bits;
+        match field_type {
+            FieldType::Int32 | FieldType::SInt32 | FieldType::SFixed32 => {
+                FieldValue::Int32(bits as u32 as i32)
+            }
+            FieldType::Int64 | FieldType::SInt64 | FieldType::SFixed64 => {
+                FieldValue::Int64(bits as i64)
+            }
+            FieldType::UInt32 | FieldType::Fixed32 => FieldValue::UInt32(bits as u32),
+            FieldType::UInt64 | FieldType::Fixed64 => FieldValue::UInt64(bits),
+            FieldType::Float => FieldValue::Float(f32::from_bits(bits as u32)),
+            FieldType::Double => FieldValue::Double(f64::from_bits(bits)),
+            FieldType::Bool => FieldValue::Bool(bits != 0),
+            FieldType::Enum => FieldValue::Enum(bits as u32 as i32),
+            FieldType::String | FieldType::Bytes => FieldValue::Bytes(if visited.len == 0 {
+                &[]
+            } else {
+                slice::from_raw_parts(visited.data.cast(), visited.len)
+            }),
+            FieldType::Message | FieldType::Group => {
+                FieldValue::Message(DynMessage::from_ffi_ptr(visited.data.cast()))
+            }
+        }
     }
+}
 
-    /// Computes the serialized size of the message.
+/// A visitor of the set fields of a message, called by a [`FieldWalker`].
+pub trait FieldVisitor {
+    /// Visits the set field `field`, whose value is `value`.
     ///
-    /// This recursively calls `byte_size` on all embedded messages. The
-    /// computation is generally linear in the number of the fields defined for
-    /// the proto.
-    fn byte_size(&self) -> usize {
-        self.upcast().ByteSizeLong()
-    }
+    /// If `field` is a message or group field, returning `true` causes the
+    /// walker to visit the set fields of its value, or of each of its
+    /// elements in turn, before it moves on to the next field. The return
+    /// value is ignored for other fields.
+    fn visit(&mut self, field: &FieldDescriptor, value: FieldValue<'_>) -> bool;
 }
 
-struct DynMessageLite {
-    _opaque: PhantomPinned,
+/// Walks the set fields of messages, passing their values to a
+/// [`FieldVisitor`].
+///
+/// The walker lists the set fields of each message, and fetches all of their
+/// values, in a single call into `libprotobuf`, rather than one call to list
+/// the fields followed by one to fetch each value. The buffers that hold the
+/// lists are kept between walks, so reusing a walker for many messages of
+/// the same shape does not allocate.
+///
+/// # Examples
+///
+/// ```
+/// use protobuf_native::{FieldDescriptor, FieldValue, FieldVisitor, FieldWalker};
+///
+/// struct Count(usize);
+///
+/// impl FieldVisitor for Count {
+///     fn visit(&mut self, _: &FieldDescriptor, _: FieldValue<'_>) -> bool {
+///         self.0 += 1;
+///         true
+///     }
+/// }
+///
+/// # fn count(message: &dyn protobuf_native::Message) -> usize {
+/// let mut walker = FieldWalker::new();
+/// let mut count = Count(0);
+/// walker.walk(message, &mut count);
+/// count.0
+/// # }
+/// ```
+pub struct FieldWalker {
+    // One walker per level of nesting, as a walker's buffers hold the values
+    // of the fields of its message until the visitor has seen all of them.
+    levels: Vec<*mut ffi::FieldWalker>,
 }
 
-impl Drop for DynMessageLite {
-    fn drop(&mut self) {
-        unsafe { ffi::DeleteMessageLite(self.as_ffi_mut_ptr_unpinned()) }
+// SAFETY: the walkers at each level are only accessed through `&mut self`.
+unsafe impl Send for FieldWalker {}
+
+impl Default for FieldWalker {
+    fn default() -> FieldWalker {
+        FieldWalker::new()
     }
 }
 
-impl DynMessageLite {
-    unsafe_ffi_conversions!(ffi::MessageLite);
+impl Drop for FieldWalker {
+    fn drop(&mut self) {
+        for walker in &self.levels {
+            unsafe { ffi::DeleteFieldWalker(*walker) }
+        }
+    }
 }
 
-impl MessageLite for DynMessageLite {}
+impl FieldWalker {
+    /// Creates a new field walker.
+    pub fn new() -> FieldWalker {
+        FieldWalker { levels: vec![] }
+    }
 
-impl private::MessageLite for DynMessageLite {
-    fn upcast(&self) -> &ffi::MessageLite {
-        unsafe { mem::transmute(self) }
+    /// Visits the set fields of `message` with `visitor`, in the order of
+    /// their numbers, followed by its set extensions.
+    ///
+    /// Fields are set if they are present in the message, or, for repeated
+    /// fields, if they are not empty. Unknown fields are not visited.
+    pub fn walk<M, V>(&mut self, message: &M, visitor: &mut V)
+    where
+        M: Message + ?Sized,
+        V: FieldVisitor + ?Sized,
+    {
+        let message: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+        self.walk_level(0, message, visitor);
     }
 
-    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MessageLite> {
-        unsafe { mem::transmute(self) }
+    fn walk_level<V>(&mut self, depth: usize, message: &ffi::Message, visitor: &mut V)
+    where
+        V: FieldVisitor + ?Sized,
+    {
+        if depth == self.levels.len() {
+            self.levels.push(ffi::NewFieldWalker());
+        }
+        // The walker at this level is not touched by the walks of the
+        // submessages, which use the deeper levels, so its buffers stay
+        // valid until this loop ends.
+        let walker = unsafe { Pin::new_unchecked(&mut *self.levels[depth]) };
+        for visited in ffi::FieldWalkerWalk(walker, message) {
+            let field = unsafe { FieldDescriptor::from_ffi_ptr(visited.field) };
+            let value = unsafe { FieldValue::from_ffi(field, visited) };
+            let submessages = match &value {
+                FieldValue::Message(_) | FieldValue::RepeatedMessages(_) => Some(value.clone()),
+                _ => None,
+            };
+            if !visitor.visit(field, value) {
+                continue;
+            }
+            match submessages {
+                Some(FieldValue::Message(submessage)) => {
+                    let submessage: &ffi::Message =
+                        unsafe { mem::transmute(private::MessageLite::upcast(submessage)) };
+                    self.walk_level(depth + 1, submessage, visitor);
+                }
+                Some(FieldValue::RepeatedMessages(submessages)) => {
+                    for submessage in submessages {
+                        let submessage: &ffi::Message =
+                            unsafe { mem::transmute(private::MessageLite::upcast(submessage)) };
+                        self.walk_level(depth + 1, submessage, visitor);
+                    }
+                }
+                _ => (),
+            }
+        }
     }
 }
 
-/// Abstract interface for protocol messages.
-///
-/// See also `MessageLite`, which contains most every-day operations.  `Message`
-/// adds descriptors and reflection on top of that.
-///
-/// The methods of this class that have default implementations have default
-/// implementations based on reflection. Message classes which are optimized for
-/// speed will want to override these with faster implementations, but classes
-/// optimized for code size may be happy with keeping them.  See the
-/// optimize_for option in descriptor.proto.
-///
-/// Users must not derive from this class. Only the protocol compiler and the
-/// internal library are allowed to create subclasses.
-pub trait Message: private::Message + MessageLite {}
-
 /// The protocol compiler can output a file descriptor set containing the .proto
 /// files it parses.
 pub struct FileDescriptorSet {
@@ -461,6 +4390,14 @@ impl FileDescriptorSet {
         FileDescriptorProto::from_ffi_ref(file)
     }
 
+    /// Returns references to all of the file descriptors.
+    ///
+    /// Unlike repeated calls to [`FileDescriptorSet::file`], this fetches
+    /// every reference with a single call into C++.
+    pub fn files(&self) -> &[&FileDescriptorProto] {
+        unsafe { pointer_array(ffi::FileDescriptorSetFiles(self.as_ffi())) }
+    }
+
     /// Returns a mutable reference to the `i`th file descriptor.
     pub fn file_mut(self: Pin<&mut Self>, i: usize) -> Pin<&mut FileDescriptorProto> {
         let file = self.as_ffi_mut().mutable_file(CInt::expect_from(i));
@@ -473,6 +4410,64 @@ impl FileDescriptorSet {
         unsafe { FileDescriptorProto::from_ffi_mut(file) }
     }
 
+    /// Adds `file` to the end of the file descriptors without copying it.
+    pub fn add_allocated_file(self: Pin<&mut Self>, mut file: Pin<Box<FileDescriptorProto>>) {
+        // The set takes ownership of the C++ object, which the handle's `Drop`
+        // implementation would otherwise delete.
+        let ptr = file.as_mut().as_ffi_mut_ptr();
+        mem::forget(file);
+        unsafe { ffi::FileDescriptorSetAddAllocatedFile(self.as_ffi_mut(), ptr) }
+    }
+
+    /// Combines `sets` into a new set that holds one copy of each file, in
+    /// the order in which the files first appear.
+    ///
+    /// Files are identified by name. When a name appears more than once, the
+    /// duplicates are compared with [`compat::file_fingerprint`] rather than
+    /// field by field, and are not copied. Only the files whose names appear
+    /// in more than one set are fingerprinted. As the fingerprint ignores
+    /// source code info, duplicates whose comments differ are accepted, and
+    /// the first is kept.
+    ///
+    /// Returns an error if two files with the same name have different
+    /// fingerprints.
+    pub fn merge_dedup(
+        sets: &[&FileDescriptorSet],
+    ) -> Result<Pin<Box<FileDescriptorSet>>, MergeConflictError> {
+        // The first file with each name, the index of its set, and its
+        // fingerprint, once computed.
+        let mut seen: HashMap<&[u8], (&FileDescriptorProto, usize, Option<u64>)> = HashMap::new();
+        let mut unique = vec![];
+        for (i, set) in sets.iter().enumerate() {
+            for &file in set.files() {
+                let (first, first_set, fingerprint) = match seen.entry(file.name()) {
+                    Entry::Vacant(entry) => {
+                        entry.insert((file, i, None));
+                        unique.push(ffi::FileDescriptorProtoRef {
+                            file: file.as_ffi(),
+                        });
+                        continue;
+                    }
+                    Entry::Occupied(entry) => entry.into_mut(),
+                };
+                if ptr::eq(*first, file) {
+                    continue;
+                }
+                let expected = *fingerprint.get_or_insert_with(|| compat::file_fingerprint(first));
+                if compat::file_fingerprint(file) != expected {
+                    return Err(MergeConflictError {
+                        filename: String::from_utf8_lossy(file.name()).into_owned(),
+                        first_set: *first_set,
+                        conflicting_set: i,
+                    });
+                }
+            }
+        }
+        let mut out = FileDescriptorSet::new();
+        ffi::FileDescriptorSetCopyFiles(out.as_mut().as_ffi_mut(), &unique);
+        Ok(out)
+    }
+
     unsafe_ffi_conversions!(ffi::FileDescriptorSet);
 }
 
@@ -491,6 +4486,180 @@ impl private::MessageLite for FileDescriptorSet {
 impl Message for FileDescriptorSet {}
 impl private::Message for FileDescriptorSet {}
 
+/// A set of symbolic field paths, like `f.a` or `f.b.d`, that selects a subset
+/// of the fields of a message.
+///
+/// Paths are compiled against a message type by
+/// [`Message::merge_from_bytes_with_mask`], or ahead of time by
+/// [`FieldMask::compile`].
+pub struct FieldMask {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for FieldMask {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteFieldMask(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl FieldMask {
+    /// Creates a new, empty field mask.
+    pub fn new() -> Pin<Box<FieldMask>> {
+        let mask = ffi::NewFieldMask();
+        unsafe { Self::from_ffi_owned(mask) }
+    }
+
+    /// Returns the number of paths in the field mask.
+    pub fn paths_size(&self) -> usize {
+        self.as_ffi().paths_size().expect_usize()
+    }
+
+    /// Returns the `i`th path in the field mask.
+    pub fn path(&self, i: usize) -> &[u8] {
+        if i >= self.paths_size() {
+            panic!(
+                "index out of bounds: the length is {} but the index is {}",
+                self.paths_size(),
+                i
+            );
+        }
+        self.as_ffi().paths(CInt::expect_from(i)).as_bytes()
+    }
+
+    /// Adds a path to the field mask.
+    pub fn add_path(self: Pin<&mut Self>, path: &str) {
+        ffi::FieldMaskAddPath(self.as_ffi_mut(), path.into())
+    }
+
+    /// Removes all paths from the field mask.
+    pub fn clear_paths(self: Pin<&mut Self>) {
+        self.as_ffi_mut().clear_paths()
+    }
+
+    /// Resolves the paths in the field mask against the message type
+    /// described by `descriptor`.
+    ///
+    /// Returns an error if the mask contains a path that is not valid for the
+    /// message type.
+    pub fn compile<'a>(
+        &self,
+        descriptor: &'a Descriptor,
+    ) -> Result<Pin<Box<CompiledFieldMask<'a>>>, OperationFailedError> {
+        let mask = ffi::NewCompiledFieldMask(descriptor.as_ffi(), self.as_ffi());
+        match mask.is_null() {
+            true => Err(OperationFailedError),
+            false => Ok(unsafe { CompiledFieldMask::from_ffi_owned(mask) }),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::FieldMask);
+}
+
+impl MessageLite for FieldMask {}
+
+impl private::MessageLite for FieldMask {
+    fn upcast(&self) -> &ffi::MessageLite {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut ffi::MessageLite> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+impl Message for FieldMask {}
+impl private::Message for FieldMask {}
+
+/// Options that control how [`CompiledFieldMask::merge_message_to`] merges
+/// the selected fields.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct MergeOptions {
+    /// Whether to replace singular message fields in the destination, rather
+    /// than merging into them.
+    pub replace_message_fields: bool,
+    /// Whether to replace repeated fields in the destination, rather than
+    /// appending to them.
+    pub replace_repeated_fields: bool,
+}
+
+/// A [`FieldMask`] whose paths have been resolved against a message type.
+///
+/// The paths are resolved to field numbers once, when the mask is compiled,
+/// so applying a compiled mask performs no lookups by name. A compiled mask
+/// can only be applied to messages of the type it was compiled against.
+pub struct CompiledFieldMask<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for CompiledFieldMask<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCompiledFieldMask(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> CompiledFieldMask<'a> {
+    /// Like [`Message::merge_from_bytes_with_mask`], but with a mask that is
+    /// already compiled.
+    ///
+    /// Returns an error if the input is not a valid protocol buffer or if
+    /// `message` is not of the type the mask was compiled against.
+    pub fn merge_from_bytes(
+        &self,
+        message: Pin<&mut dyn Message>,
+        data: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        let message: Pin<&mut ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) };
+        ffi::CompiledFieldMaskMergeFromBytes(self.as_ffi(), message, data).as_result()
+    }
+
+    /// Merges the fields of `source` that are selected by the mask into
+    /// `destination`.
+    ///
+    /// A selected singular field that is not set in `source` is cleared in
+    /// `destination`. Selected repeated fields are appended to and selected
+    /// message fields are merged into, unless `options` say otherwise.
+    ///
+    /// Returns an error if either message is not of the type the mask was
+    /// compiled against.
+    pub fn merge_message_to(
+        &self,
+        source: &dyn Message,
+        destination: Pin<&mut dyn Message>,
+        options: &MergeOptions,
+    ) -> Result<(), OperationFailedError> {
+        let source: &ffi::Message = unsafe { mem::transmute(private::MessageLite::upcast(source)) };
+        let destination: Pin<&mut ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(destination)) };
+        ffi::CompiledFieldMaskMergeMessageTo(
+            self.as_ffi(),
+            source,
+            destination,
+            options.replace_message_fields,
+            options.replace_repeated_fields,
+        )
+        .as_result()
+    }
+
+    /// Clears the fields of `message` that are not selected by the mask.
+    ///
+    /// Returns whether any field was cleared, or an error if `message` is not
+    /// of the type the mask was compiled against.
+    pub fn trim_message(
+        &self,
+        message: Pin<&mut dyn Message>,
+    ) -> Result<bool, OperationFailedError> {
+        let message: Pin<&mut ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) };
+        let mut modified = false;
+        ffi::CompiledFieldMaskTrimMessage(self.as_ffi(), message, &mut modified).as_result()?;
+        Ok(modified)
+    }
+
+    unsafe_ffi_conversions!(ffi::CompiledFieldMask);
+}
+
 /// Describes a complete .proto file.
 pub struct FileDescriptorProto {
     _opaque: PhantomPinned,
@@ -515,6 +4684,11 @@ impl FileDescriptorProto {
         self.as_ffi_mut().MergeFrom(from.as_ffi())
     }
 
+    /// Returns the name of the file, relative to the root of the source tree.
+    pub fn name(&self) -> &[u8] {
+        self.as_ffi().name().as_bytes()
+    }
+
     /// Returns the number of entries in the `dependency` field.
     pub fn dependency_size(&self) -> usize {
         self.as_ffi().dependency_size().expect_usize()
@@ -532,6 +4706,15 @@ impl FileDescriptorProto {
         self.as_ffi().dependency(CInt::expect_from(i)).as_bytes()
     }
 
+    /// Returns an iterator over the entries in the `dependency` field.
+    ///
+    /// The entries are fetched with a single call into C++.
+    pub fn dependencies(&self) -> impl ExactSizeIterator<Item = &[u8]> {
+        let deps: &[&CxxString] =
+            unsafe { pointer_array(ffi::FileDescriptorProtoDependencies(self.as_ffi())) };
+        deps.iter().map(|dep| dep.as_bytes())
+    }
+
     /// Returns the number of entries in the `message_type` field.
     pub fn message_type_size(&self) -> usize {
         self.as_ffi().message_type_size().expect_usize()
@@ -549,6 +4732,29 @@ impl FileDescriptorProto {
         DescriptorProto::from_ffi_ref(self.as_ffi().message_type(CInt::expect_from(i)))
     }
 
+    /// Returns references to all of the entries in the `message_type` field.
+    ///
+    /// The references are fetched with a single call into C++.
+    pub fn message_types(&self) -> &[&DescriptorProto] {
+        unsafe { pointer_array(ffi::FileDescriptorProtoMessageTypes(self.as_ffi())) }
+    }
+
+    /// Reports whether the `source_code_info` field is set.
+    pub fn has_source_code_info(&self) -> bool {
+        self.as_ffi().has_source_code_info()
+    }
+
+    /// Clears the `source_code_info` field.
+    pub fn clear_source_code_info(self: Pin<&mut Self>) {
+        self.as_ffi_mut().clear_source_code_info()
+    }
+
+    /// Returns an index of the locations in the `source_code_info` field,
+    /// which is built on the first lookup.
+    pub fn source_code_index(&self) -> SourceCodeIndex<'_> {
+        SourceCodeIndex::new(SourceCodeIndexSource::Proto(self))
+    }
+
     unsafe_ffi_conversions!(ffi::FileDescriptorProto);
 }
 
@@ -573,6 +4779,129 @@ impl private::MessageLite for FileDescriptorProto {
 impl Message for FileDescriptorProto {}
 impl private::Message for FileDescriptorProto {}
 
+/// The location of an element of a .proto file, and the comments attached to
+/// it.
+///
+/// Lines and columns are numbered from zero.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct SourceLocation {
+    /// The line on which the element starts.
+    pub start_line: i32,
+    /// The column at which the element starts.
+    pub start_column: i32,
+    /// The line on which the element ends.
+    pub end_line: i32,
+    /// The column just past the end of the element.
+    pub end_column: i32,
+    /// The comment directly before the element, if any.
+    pub leading_comments: String,
+    /// The comment directly after the element, if any.
+    pub trailing_comments: String,
+    /// The comments before the element that are separated from it, and from
+    /// each other, by blank lines.
+    pub leading_detached_comments: Vec<String>,
+}
+
+/// An index of the locations in the source code info of a file, keyed by the
+/// path of the element that each describes.
+///
+/// The source code info of a file is a flat list of locations, so finding
+/// the location of one element means scanning all of them. The index is
+/// built by a single pass over the list, on the first lookup, after which
+/// each lookup is a hash table probe in Rust.
+///
+/// A path is a sequence of field numbers and indices that leads from the
+/// `FileDescriptorProto` to the element. For example, `[4, 0, 2, 1]` is the
+/// path of the second field (`field` is field 2 of `DescriptorProto`) of the
+/// first message type (`message_type` is field 4 of `FileDescriptorProto`).
+/// If several locations have the same path, the first is indexed.
+pub struct SourceCodeIndex<'a> {
+    source: SourceCodeIndexSource<'a>,
+    locations: OnceLock<HashMap<Box<[i32]>, SourceLocation>>,
+}
+
+enum SourceCodeIndexSource<'a> {
+    Proto(&'a FileDescriptorProto),
+    File(&'a FileDescriptor),
+}
+
+impl<'a> SourceCodeIndex<'a> {
+    fn new(source: SourceCodeIndexSource<'a>) -> SourceCodeIndex<'a> {
+        SourceCodeIndex {
+            source,
+            locations: OnceLock::new(),
+        }
+    }
+
+    /// Returns the location of the element with the given path, or `None`
+    /// if the file has no location with a valid span for it.
+    pub fn get(&self, path: &[i32]) -> Option<&SourceLocation> {
+        self.locations().get(path)
+    }
+
+    /// Returns the number of indexed locations.
+    pub fn len(&self) -> usize {
+        self.locations().len()
+    }
+
+    /// Reports whether no locations are indexed.
+    pub fn is_empty(&self) -> bool {
+        self.locations().is_empty()
+    }
+
+    fn locations(&self) -> &HashMap<Box<[i32]>, SourceLocation> {
+        self.locations.get_or_init(|| match self.source {
+            SourceCodeIndexSource::Proto(proto) => index_source_locations(proto),
+            SourceCodeIndexSource::File(file) => {
+                let mut proto = FileDescriptorProto::new();
+                file.copy_source_code_info_to(proto.as_mut());
+                index_source_locations(&proto)
+            }
+        })
+    }
+}
+
+fn index_source_locations(proto: &FileDescriptorProto) -> HashMap<Box<[i32]>, SourceLocation> {
+    let mut entries = vec![];
+    ffi::FileDescriptorProtoSourceLocations(proto.as_ffi(), &mut entries);
+    let mut locations = HashMap::with_capacity(entries.len());
+    for entry in &entries {
+        // SAFETY: the entries point into `proto`, which is borrowed for the
+        // duration of the loop.
+        let (path, span, leading, trailing, detached) = unsafe {
+            (
+                scalar_array::<i32>(entry.path),
+                scalar_array::<i32>(entry.span),
+                &*entry.leading_comments,
+                &*entry.trailing_comments,
+                pointer_array::<CxxString>(entry.leading_detached_comments),
+            )
+        };
+        // As in `FileDescriptor::GetSourceLocation`, a span has three
+        // elements if the element starts and ends on the same line.
+        let (start_line, start_column, end_line, end_column) = match *span {
+            [line, start, end] => (line, start, line, end),
+            [start_line, start, end_line, end] => (start_line, start, end_line, end),
+            _ => continue,
+        };
+        locations
+            .entry(path.into())
+            .or_insert_with(|| SourceLocation {
+                start_line,
+                start_column,
+                end_line,
+                end_column,
+                leading_comments: leading.to_string_lossy().into_owned(),
+                trailing_comments: trailing.to_string_lossy().into_owned(),
+                leading_detached_comments: detached
+                    .iter()
+                    .map(|comment| comment.to_string_lossy().into_owned())
+                    .collect(),
+            });
+    }
+    locations
+}
+
 /// Describes a message type.
 pub struct DescriptorProto {
     _opaque: PhantomPinned,
@@ -628,3 +4957,183 @@ impl fmt::Display for OperationFailedError {
 }
 
 impl Error for OperationFailedError {}
+
+/// An error from [`MessageLite::parse_from_bytes_detailed`].
+///
+/// The error is a few words that are filled in without formatting any
+/// message, so that classifying errors stays cheap even when most inputs
+/// fail to parse.
+#[derive(Debug, Clone, Copy, Eq, PartialEq, Hash)]
+pub struct ParseError {
+    /// What is wrong with the input.
+    pub kind: ParseErrorKind,
+    /// The offset in the input at which the error was found.
+    ///
+    /// Missing required fields are reported at the end of the input, and
+    /// errors of kind [`ParseErrorKind::Rejected`] at offset zero.
+    pub offset: usize,
+    /// The number of the top-level field in which the error was found, or
+    /// zero if it is not known.
+    pub number: u32,
+}
+
+/// The kind of a [`ParseError`].
+#[derive(Debug, Clone, Copy, Eq, PartialEq, Hash)]
+pub enum ParseErrorKind {
+    /// A tag has field number zero, an invalid wire type, or does not fit in
+    /// 32 bits.
+    InvalidTag,
+    /// A varint is longer than ten bytes.
+    InvalidVarint,
+    /// A length prefix exceeds the limit on the size of a message.
+    InvalidLength,
+    /// The input ends within a field or an unclosed group.
+    Truncated,
+    /// A group is closed with the wrong field number, or without having been
+    /// opened.
+    UnmatchedEndGroup,
+    /// Groups nest more deeply than the recursion limit.
+    TooDeep,
+    /// The input is well formed, but a required field is missing.
+    MissingRequired,
+    /// The input is well formed at the top level, but the parser rejected
+    /// it, for example because a nested message is malformed or a string
+    /// holds invalid UTF-8.
+    Rejected,
+}
+
+impl ParseError {
+    fn diagnose(data: &[u8]) -> ParseError {
+        use wire::ValidationErrorKind as V;
+        let (err, number) = match wire::find_structural_error(data) {
+            Some(found) => found,
+            None => {
+                return ParseError {
+                    kind: ParseErrorKind::Rejected,
+                    offset: 0,
+                    number: 0,
+                }
+            }
+        };
+        let kind = match err.kind {
+            V::InvalidTag => ParseErrorKind::InvalidTag,
+            V::InvalidVarint => ParseErrorKind::InvalidVarint,
+            V::InvalidLength => ParseErrorKind::InvalidLength,
+            V::Truncated => ParseErrorKind::Truncated,
+            V::UnmatchedEndGroup => ParseErrorKind::UnmatchedEndGroup,
+            V::TooDeep => ParseErrorKind::TooDeep,
+            V::InvalidPackedField { .. } | V::InvalidUtf8 { .. } | V::MissingRequired { .. } => {
+                ParseErrorKind::Rejected
+            }
+        };
+        ParseError {
+            kind,
+            offset: err.offset,
+            number,
+        }
+    }
+}
+
+impl fmt::Display for ParseError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.write_str(match self.kind {
+            ParseErrorKind::InvalidTag => "invalid tag",
+            ParseErrorKind::InvalidVarint => "invalid varint",
+            ParseErrorKind::InvalidLength => "invalid length",
+            ParseErrorKind::Truncated => "truncated message",
+            ParseErrorKind::UnmatchedEndGroup => "unmatched end group",
+            ParseErrorKind::TooDeep => "message nested too deeply",
+            ParseErrorKind::MissingRequired => "missing required fields",
+            ParseErrorKind::Rejected => "message rejected by parser",
+        })?;
+        write!(f, " at offset {}", self.offset)?;
+        if self.number != 0 {
+            write!(f, " in field {}", self.number)?;
+        }
+        Ok(())
+    }
+}
+
+impl Error for ParseError {}
+
+impl From<ParseError> for OperationFailedError {
+    fn from(_: ParseError) -> OperationFailedError {
+        OperationFailedError
+    }
+}
+
+/// An error that occurred while building a file in a [`DescriptorPool`].
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct BuildFileError {
+    /// The name of the file which failed to build.
+    pub filename: String,
+    /// The fully-qualified name of the erroneous element.
+    pub element_name: String,
+    /// A message describing the cause of the error.
+    pub message: String,
+}
+
+impl From<ffi::BuildFileError> for BuildFileError {
+    fn from(ffi: ffi::BuildFileError) -> BuildFileError {
+        BuildFileError {
+            filename: ffi.filename,
+            element_name: ffi.element_name,
+            message: ffi.message,
+        }
+    }
+}
+
+impl fmt::Display for BuildFileError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(
+            f,
+            "{}: {}: {}",
+            self.filename, self.element_name, self.message
+        )
+    }
+}
+
+impl Error for BuildFileError {}
+
+/// The errors that occurred in [`DescriptorPool::build_file_set`].
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct BuildFileSetError {
+    /// The errors, in the order in which they occurred.
+    pub errors: Vec<BuildFileError>,
+}
+
+impl fmt::Display for BuildFileSetError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.write_str("failed to build file set")?;
+        for error in &self.errors {
+            write!(f, "\n{}", error)?;
+        }
+        Ok(())
+    }
+}
+
+impl Error for BuildFileSetError {}
+
+/// Two different files with the same name were found by
+/// [`FileDescriptorSet::merge_dedup`].
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct MergeConflictError {
+    /// The name of the file.
+    pub filename: String,
+    /// The index of the set in which the file first appeared.
+    pub first_set: usize,
+    /// The index of the set with the conflicting file.
+    pub conflicting_set: usize,
+}
+
+impl fmt::Display for MergeConflictError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        write!(
+            f,
+            "{}: file in set {} differs from the one in set {}",
+            self.filename, self.conflicting_set, self.first_set
+        )
+    }
+}
+
+impl Error for MergeConflictError {}
@@ -0,0 +1,248 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Parse and serialization metrics.
+//!
+//! When enabled with [`set_enabled`], the byte-oriented parse and
+//! serialization methods of [`MessageLite`] count the calls, failures and
+//! bytes for each message type, keyed by the type's full name, and record the
+//! latency of each call in a histogram. The metrics are kept in a global
+//! registry, which [`snapshot`] reads in a form that maps directly onto
+//! Prometheus counters and histograms.
+//!
+//! The instrumented methods are [`MessageLite::parse_from_bytes`],
+//! [`MessageLite::parse_partial_from_bytes`], [`MessageLite::merge_from_bytes`],
+//! [`MessageLite::merge_partial_from_bytes`], [`MessageLite::serialize_into`]
+//! and [`MessageLite::serialize_deterministic_into`], along with the methods
+//! implemented in terms of them, like [`MessageLite::serialize`]. Methods that
+//! read from or write to streams are not instrumented, as the number of bytes
+//! they process is not known up front.
+//!
+//! Metrics are disabled by default. While disabled, each instrumented call
+//! costs a single relaxed atomic load, plus another to check whether a
+//! [`sample`](crate::sample) capture is active; while enabled, each call also
+//! looks up the message's type name in the registry.
+
+use std::collections::BTreeMap;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, RwLock};
+use std::time::{Duration, Instant};
+
+#[cfg(doc)]
+use crate::MessageLite;
+use crate::{ffi, sample};
+
+/// The number of buckets in a latency [`Histogram`], not counting the
+/// overflow bucket.
+const NUM_BUCKETS: usize = 21;
+
+/// The inclusive upper bounds of the buckets of a latency [`Histogram`]: one
+/// microsecond, doubling up to about one second.
+pub const LATENCY_BUCKETS: [Duration; NUM_BUCKETS] = {
+    let mut buckets = [Duration::ZERO; NUM_BUCKETS];
+    let mut i = 0;
+    while i < NUM_BUCKETS {
+        buckets[i] = Duration::from_micros(1 << i);
+        i += 1;
+    }
+    buckets
+};
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static REGISTRY: RwLock<BTreeMap<String, Arc<TypeMetrics>>> = RwLock::new(BTreeMap::new());
+
+/// Enables or disables the collection of metrics.
+///
+/// Disabling collection retains the metrics collected so far.
+pub fn set_enabled(enabled: bool) {
+    ENABLED.store(enabled, Ordering::Relaxed);
+}
+
+/// Reports whether metrics are being collected.
+pub fn is_enabled() -> bool {
+    ENABLED.load(Ordering::Relaxed)
+}
+
+/// Returns the metrics collected so far for every message type that has been
+/// parsed or serialized, ordered by type name.
+pub fn snapshot() -> Vec<MessageMetrics> {
+    let registry = REGISTRY.read().expect("metrics registry poisoned");
+    registry
+        .iter()
+        .map(|(type_name, metrics)| MessageMetrics {
+            type_name: type_name.clone(),
+            parse: metrics.parse.snapshot(),
+            serialize: metrics.serialize.snapshot(),
+        })
+        .collect()
+}
+
+/// Discards the metrics collected so far.
+pub fn reset() {
+    REGISTRY.write().expect("metrics registry poisoned").clear();
+}
+
+/// The metrics for one message type.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct MessageMetrics {
+    /// The full name of the message type, like `package.Message`.
+    pub type_name: String,
+    /// The metrics for parsing messages of the type.
+    pub parse: OperationMetrics,
+    /// The metrics for serializing messages of the type.
+    pub serialize: OperationMetrics,
+}
+
+/// The metrics for one kind of operation on one message type.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct OperationMetrics {
+    /// The number of calls.
+    pub calls: u64,
+    /// The number of calls that failed.
+    pub errors: u64,
+    /// The number of bytes processed: the size of the input of every parse,
+    /// and the size of the output of every successful serialization.
+    pub bytes: u64,
+    /// The latencies of the calls.
+    pub latency: Histogram,
+}
+
+/// A histogram of latencies.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Histogram {
+    /// The number of latencies in each bucket.
+    ///
+    /// Bucket `i` counts the latencies no greater than `LATENCY_BUCKETS[i]`
+    /// and greater than the bound of the previous bucket. The final bucket,
+    /// at index `LATENCY_BUCKETS.len()`, counts the latencies greater than
+    /// every bound. Prometheus histograms are cumulative, so exporters should
+    /// sum the counts of the buckets up to each bound.
+    pub counts: Vec<u64>,
+    /// The sum of the latencies.
+    pub sum: Duration,
+}
+
+impl Histogram {
+    /// Returns the number of latencies in the histogram.
+    pub fn count(&self) -> u64 {
+        self.counts.iter().sum()
+    }
+}
+
+#[derive(Default)]
+struct TypeMetrics {
+    parse: OperationCounters,
+    serialize: OperationCounters,
+}
+
+#[derive(Default)]
+struct OperationCounters {
+    calls: AtomicU64,
+    errors: AtomicU64,
+    bytes: AtomicU64,
+    latency_nanos: AtomicU64,
+    buckets: [AtomicU64; NUM_BUCKETS + 1],
+}
+
+impl OperationCounters {
+    fn record(&self, bytes: usize, ok: bool, latency: Duration) {
+        self.calls.fetch_add(1, Ordering::Relaxed);
+        if !ok {
+            self.errors.fetch_add(1, Ordering::Relaxed);
+        }
+        self.bytes.fetch_add(bytes as u64, Ordering::Relaxed);
+        self.latency_nanos.fetch_add(
+            u64::try_from(latency.as_nanos()).unwrap_or(u64::MAX),
+            Ordering::Relaxed,
+        );
+        let bucket = LATENCY_BUCKETS.partition_point(|bound| *bound < latency);
+        self.buckets[bucket].fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn snapshot(&self) -> OperationMetrics {
+        OperationMetrics {
+            calls: self.calls.load(Ordering::Relaxed),
+            errors: self.errors.load(Ordering::Relaxed),
+            bytes: self.bytes.load(Ordering::Relaxed),
+            latency: Histogram {
+                counts: self
+                    .buckets
+                    .iter()
+                    .map(|count| count.load(Ordering::Relaxed))
+                    .collect(),
+                sum: Duration::from_nanos(self.latency_nanos.load(Ordering::Relaxed)),
+            },
+        }
+    }
+}
+
+/// Times an instrumented call, if metrics are enabled, and samples it, if a
+/// [`Capture`](crate::sample::Capture) is active.
+pub(crate) struct Timer {
+    metrics: Option<(Arc<TypeMetrics>, Instant)>,
+    sample: Option<sample::Sample>,
+}
+
+impl Timer {
+    pub(crate) fn start(message: &ffi::MessageLite) -> Timer {
+        let sample = sample::Sample::start(message);
+        if !is_enabled() {
+            return Timer {
+                metrics: None,
+                sample,
+            };
+        }
+        let type_name = match &sample {
+            Some(sample) => sample.type_name().to_owned(),
+            None => ffi::MessageLiteTypeName(message),
+        };
+        let metrics = REGISTRY
+            .read()
+            .expect("metrics registry poisoned")
+            .get(&type_name)
+            .cloned();
+        let metrics = match metrics {
+            Some(metrics) => metrics,
+            None => REGISTRY
+                .write()
+                .expect("metrics registry poisoned")
+                .entry(type_name)
+                .or_default()
+                .clone(),
+        };
+        Timer {
+            metrics: Some((metrics, Instant::now())),
+            sample,
+        }
+    }
+
+    pub(crate) fn finish_parse(self, data: &[u8], ok: bool) {
+        if let Some((metrics, start)) = self.metrics {
+            metrics.parse.record(data.len(), ok, start.elapsed());
+        }
+        if let Some(sample) = self.sample {
+            sample.finish(sample::Operation::Parse, data, ok);
+        }
+    }
+
+    pub(crate) fn finish_serialize(self, output: &[u8], ok: bool) {
+        if let Some((metrics, start)) = self.metrics {
+            metrics.serialize.record(output.len(), ok, start.elapsed());
+        }
+        if let Some(sample) = self.sample {
+            sample.finish(sample::Operation::Serialize, output, ok);
+        }
+    }
+}
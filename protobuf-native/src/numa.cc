@@ -0,0 +1,317 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/numa.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "protobuf-native/src/numa.rs.h"
+
+namespace protobuf_native {
+namespace numa {
+
+namespace {
+
+// Nodes beyond this are treated as node 0.
+constexpr uint32_t kMaxNodes = 64;
+
+// Every block is preceded by a header that records its node. The header is
+// as large as the strictest fundamental alignment, so that the block is as
+// aligned as memory from malloc.
+struct alignas(alignof(std::max_align_t)) BlockHeader {
+    uint32_t node;
+};
+
+constexpr size_t kHeaderSize = sizeof(BlockHeader);
+
+// Huge page blocks are cached apart from other blocks of the same mapped
+// size, which is a multiple of the page size, by setting the low bit of their
+// key.
+size_t CacheKey(size_t mapped, bool huge) { return mapped | static_cast<size_t>(huge); }
+
+size_t KeyMappedSize(size_t key) { return key & ~static_cast<size_t>(1); }
+
+// The freed blocks of one node, by mapped size.
+struct NodeCache {
+    std::mutex mu;
+    std::unordered_map<size_t, std::vector<BlockHeader*>> blocks;
+    size_t bytes = 0;
+};
+
+// Leaked, so that arenas may free blocks during static destruction.
+NodeCache* const caches = new NodeCache[kMaxNodes];
+
+std::atomic<size_t> cache_limit{64 << 20};
+
+#ifdef __linux__
+
+size_t PageSize() {
+    static const size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page_size;
+}
+
+size_t ReadHugePageSize() {
+    size_t size = 0;
+    int fd = open("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        char buf[32];
+        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        for (ssize_t i = 0; i < n && buf[i] >= '0' && buf[i] <= '9'; ++i) {
+            size = size * 10 + static_cast<size_t>(buf[i] - '0');
+        }
+    }
+    // Anything but a power of two larger than a page is not to be trusted.
+    if (size <= PageSize() || (size & (size - 1)) != 0) {
+        size = 2 << 20;
+    }
+    return size;
+}
+
+// The size of the mapping that holds a block of `size` bytes.
+size_t MappedSize(size_t size, bool huge) {
+    size_t unit = huge ? HugePageSize() : PageSize();
+    return (size + kHeaderSize + unit - 1) / unit * unit;
+}
+
+void BindToNode(void* p, size_t mapped, uint32_t node) {
+    if (NodeCount() > 1) {
+        // Prefer the node, but fall back to others when it is out of memory,
+        // as the default policy would. Binding fails harmlessly on kernels
+        // without NUMA support.
+        constexpr int kMpolPreferred = 1;
+        unsigned long mask[kMaxNodes / (8 * sizeof(unsigned long))] = {};
+        mask[node / (8 * sizeof(unsigned long))] = 1ul << (node % (8 * sizeof(unsigned long)));
+        syscall(SYS_mbind, p, mapped, kMpolPreferred, mask, kMaxNodes + 1, 0);
+    }
+}
+
+// Cleared once a hugetlbfs mapping fails, after which huge page blocks are
+// backed by transparent huge pages only.
+std::atomic<bool> hugetlb_available{true};
+
+void* MapHugePages(size_t mapped) {
+#ifdef MAP_HUGETLB
+    if (hugetlb_available.load(std::memory_order_relaxed)) {
+        // Ask for pages of the transparent huge page size explicitly, in case
+        // the default hugetlbfs page size differs.
+        constexpr int kMapHugeShift = 26;
+        int log2 = __builtin_ctzl(HugePageSize());
+        void* p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (log2 << kMapHugeShift), -1,
+                       0);
+        if (p != MAP_FAILED) {
+            return p;
+        }
+        hugetlb_available.store(false, std::memory_order_relaxed);
+    }
+#endif
+    // Over-allocate so that a huge-page-aligned range can be cut from the
+    // mapping, as the kernel only backs aligned ranges with huge pages.
+    size_t huge_page_size = HugePageSize();
+    size_t padded = mapped + huge_page_size;
+    void* p = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(p);
+    uintptr_t aligned = (start + huge_page_size - 1) & ~(huge_page_size - 1);
+    if (aligned > start) {
+        munmap(p, aligned - start);
+    }
+    uintptr_t end = aligned + mapped;
+    if (end < start + padded) {
+        munmap(reinterpret_cast<void*>(end), start + padded - end);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void*>(aligned), mapped, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void*>(aligned);
+}
+
+BlockHeader* MapBlock(size_t mapped, uint32_t node, bool huge) {
+    void* p;
+    if (huge) {
+        p = MapHugePages(mapped);
+        if (p == nullptr) {
+            return nullptr;
+        }
+    } else {
+        p = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+    }
+    BindToNode(p, mapped, node);
+    return static_cast<BlockHeader*>(p);
+}
+
+void UnmapBlock(BlockHeader* header, size_t mapped) { munmap(header, mapped); }
+
+#else
+
+size_t MappedSize(size_t size, bool /* huge */) { return size + kHeaderSize; }
+
+BlockHeader* MapBlock(size_t mapped, uint32_t /* node */, bool /* huge */) {
+    return static_cast<BlockHeader*>(std::malloc(mapped));
+}
+
+void UnmapBlock(BlockHeader* header, size_t /* mapped */) { std::free(header); }
+
+#endif
+
+uint32_t CountNodes() {
+#ifdef __linux__
+    DIR* dir = opendir("/sys/devices/system/node");
+    if (dir == nullptr) {
+        return 1;
+    }
+    uint32_t count = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        const char* name = entry->d_name;
+        if (name[0] == 'n' && name[1] == 'o' && name[2] == 'd' && name[3] == 'e' &&
+            name[4] >= '0' && name[4] <= '9') {
+            ++count;
+        }
+    }
+    closedir(dir);
+    return count == 0 ? 1 : count;
+#else
+    return 1;
+#endif
+}
+
+CVoid* AllocBlock(size_t size, bool huge) {
+    size_t mapped = MappedSize(size, huge);
+    size_t key = CacheKey(mapped, huge);
+    uint32_t node = CurrentNode();
+    NodeCache& cache = caches[node];
+    BlockHeader* header = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(cache.mu);
+        auto it = cache.blocks.find(key);
+        if (it != cache.blocks.end() && !it->second.empty()) {
+            header = it->second.back();
+            it->second.pop_back();
+            cache.bytes -= mapped;
+        }
+    }
+    if (header == nullptr) {
+        header = MapBlock(mapped, node, huge);
+        if (header == nullptr) {
+            return nullptr;
+        }
+        header->node = node;
+    }
+    return reinterpret_cast<char*>(header) + kHeaderSize;
+}
+
+void DeallocBlock(CVoid* block, size_t size, bool huge) {
+    size_t mapped = MappedSize(size, huge);
+    BlockHeader* header =
+        reinterpret_cast<BlockHeader*>(static_cast<char*>(block) - kHeaderSize);
+    NodeCache& cache = caches[header->node];
+    {
+        std::lock_guard<std::mutex> lock(cache.mu);
+        if (cache.bytes + mapped <= cache_limit.load(std::memory_order_relaxed)) {
+            cache.blocks[CacheKey(mapped, huge)].push_back(header);
+            cache.bytes += mapped;
+            return;
+        }
+    }
+    UnmapBlock(header, mapped);
+}
+
+}  // namespace
+
+uint32_t CurrentNode() {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < kMaxNodes) {
+        return node;
+    }
+#endif
+    return 0;
+}
+
+uint32_t NodeCount() {
+    static const uint32_t count = CountNodes();
+    return count;
+}
+
+size_t HugePageSize() {
+#ifdef __linux__
+    static const size_t size = ReadHugePageSize();
+    return size;
+#else
+    return 2 << 20;
+#endif
+}
+
+size_t HugePageBlockSize() { return HugePageSize() - kHeaderSize; }
+
+CVoid* NumaBlockAlloc(size_t size) { return AllocBlock(size, false); }
+
+void NumaBlockDealloc(CVoid* block, size_t size) { DeallocBlock(block, size, false); }
+
+CVoid* HugePageBlockAlloc(size_t size) { return AllocBlock(size, true); }
+
+void HugePageBlockDealloc(CVoid* block, size_t size) { DeallocBlock(block, size, true); }
+
+void SetNumaBlockCacheLimit(size_t bytes) {
+    cache_limit.store(bytes, std::memory_order_relaxed);
+}
+
+size_t NumaBlockCacheSize(uint32_t node) {
+    if (node >= kMaxNodes) {
+        return 0;
+    }
+    NodeCache& cache = caches[node];
+    std::lock_guard<std::mutex> lock(cache.mu);
+    return cache.bytes;
+}
+
+void TrimNumaBlockCache() {
+    for (uint32_t node = 0; node < kMaxNodes; ++node) {
+        NodeCache& cache = caches[node];
+        std::unordered_map<size_t, std::vector<BlockHeader*>> blocks;
+        {
+            std::lock_guard<std::mutex> lock(cache.mu);
+            blocks.swap(cache.blocks);
+            cache.bytes = 0;
+        }
+        for (auto& entry : blocks) {
+            for (BlockHeader* header : entry.second) {
+                UnmapBlock(header, KeyMappedSize(entry.first));
+            }
+        }
+    }
+}
+
+}  // namespace numa
+}  // namespace protobuf_native
@@ -0,0 +1,66 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "protobuf-native/src/internal.h"
+
+namespace protobuf_native {
+namespace numa {
+
+using internal::CVoid;
+
+// Returns the NUMA node of the CPU the calling thread is running on, or 0 if
+// it cannot be determined.
+uint32_t CurrentNode();
+
+// Returns the number of NUMA nodes, or 1 if it cannot be determined.
+uint32_t NodeCount();
+
+// Arena block allocation functions, for `ArenaOptions::block_alloc` and
+// `block_dealloc`. Blocks are placed on the node of the allocating thread,
+// and freed blocks are cached on their node for reuse by later allocations
+// of the same size on that node.
+CVoid* NumaBlockAlloc(size_t size);
+void NumaBlockDealloc(CVoid* block, size_t size);
+
+// Returns the size of a transparent huge page, usually 2 MiB.
+size_t HugePageSize();
+
+// Returns the largest block that fits in a single huge page.
+size_t HugePageBlockSize();
+
+// Like `NumaBlockAlloc` and `NumaBlockDealloc`, but blocks are backed by
+// huge pages: from hugetlbfs while its pool has pages, and otherwise by
+// huge-page-aligned mappings advised to use transparent huge pages. Blocks
+// are rounded up to a whole number of huge pages.
+CVoid* HugePageBlockAlloc(size_t size);
+void HugePageBlockDealloc(CVoid* block, size_t size);
+
+// Limits the bytes of freed blocks cached on each node. Blocks beyond the
+// limit are returned to the operating system.
+void SetNumaBlockCacheLimit(size_t bytes);
+
+// Returns the bytes of freed blocks cached on `node`.
+size_t NumaBlockCacheSize(uint32_t node);
+
+// Returns every cached block to the operating system.
+void TrimNumaBlockCache();
+
+}  // namespace numa
+}  // namespace protobuf_native
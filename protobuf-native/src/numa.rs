@@ -0,0 +1,138 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! NUMA-local allocation of arena blocks.
+//!
+//! On machines with several NUMA nodes, memory on a remote node is slower to
+//! reach than memory on the node of the CPU that accesses it. An arena whose
+//! options enable [`ArenaOptions::set_numa_block_allocator`] places each of
+//! its blocks on the node of the thread that allocates the block, which is
+//! the thread that first fills it, and so usually the thread that reads it.
+//! [`ArenaPool`] hands out such arenas.
+//!
+//! Freed blocks are cached on their node, up to a [limit](set_cache_limit)
+//! per node, and reused by later allocations of blocks of the same size on
+//! that node. As blocks are allocated from the operating system a page at a
+//! time, arenas that use this allocator should start with blocks much larger
+//! than the arena's default.
+//!
+//! Blocks are placed on Linux only. Elsewhere, and on machines with a single
+//! node, the allocator still caches blocks, but does not place them.
+//!
+//! # Huge pages
+//!
+//! Arenas that hold gigabytes of decoded messages suffer TLB misses when
+//! their blocks are backed by ordinary pages.
+//! [`ArenaOptions::set_huge_page_block_allocator`] selects a variant of the
+//! allocator whose blocks are backed by [huge pages](huge_page_size), taken
+//! from the hugetlbfs pool while it has pages to spare, and otherwise from
+//! mappings aligned to and advised to use transparent huge pages. Huge page
+//! blocks are placed and cached like other blocks, but each occupies a whole
+//! number of huge pages, so arenas should use blocks of
+//! [`huge_page_block_size`] bytes, or a multiple thereof.
+//!
+//! [`ArenaOptions::set_numa_block_allocator`]: crate::ArenaOptions::set_numa_block_allocator
+//! [`ArenaOptions::set_huge_page_block_allocator`]: crate::ArenaOptions::set_huge_page_block_allocator
+//! [`ArenaPool`]: crate::pool::ArenaPool
+
+use std::os::raw::c_void;
+
+#[cxx::bridge(namespace = "protobuf_native::numa")]
+pub(crate) mod ffi {
+    unsafe extern "C++" {
+        include!("protobuf-native/src/numa.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "protobuf_native::internal"]
+        type CVoid = crate::internal::CVoid;
+
+        fn CurrentNode() -> u32;
+        fn NodeCount() -> u32;
+        fn NumaBlockAlloc(size: usize) -> *mut CVoid;
+        unsafe fn NumaBlockDealloc(block: *mut CVoid, size: usize);
+        fn HugePageSize() -> usize;
+        fn HugePageBlockSize() -> usize;
+        fn HugePageBlockAlloc(size: usize) -> *mut CVoid;
+        unsafe fn HugePageBlockDealloc(block: *mut CVoid, size: usize);
+        fn SetNumaBlockCacheLimit(bytes: usize);
+        fn NumaBlockCacheSize(node: u32) -> usize;
+        fn TrimNumaBlockCache();
+    }
+}
+
+/// Returns the NUMA node of the CPU that the calling thread is running on,
+/// or 0 if it cannot be determined.
+///
+/// The thread may migrate to another node at any time, unless its CPU
+/// affinity confines it to one node.
+pub fn current_node() -> usize {
+    ffi::CurrentNode() as usize
+}
+
+/// Returns the number of NUMA nodes in the machine, or 1 if it cannot be
+/// determined.
+pub fn node_count() -> usize {
+    ffi::NodeCount() as usize
+}
+
+/// Returns the size of a huge page, usually 2 MiB.
+pub fn huge_page_size() -> usize {
+    ffi::HugePageSize()
+}
+
+/// Returns the size of the largest arena block that fits in a single huge
+/// page, which is slightly less than [`huge_page_size`].
+pub fn huge_page_block_size() -> usize {
+    ffi::HugePageBlockSize()
+}
+
+/// Limits the bytes of freed blocks cached on each node.
+///
+/// Blocks freed once a node's cache is full are returned to the operating
+/// system. The default limit is 64 MiB. Lowering the limit does not shrink
+/// the caches; use [`trim_cache`] for that.
+pub fn set_cache_limit(bytes: usize) {
+    ffi::SetNumaBlockCacheLimit(bytes)
+}
+
+/// Returns the bytes of freed blocks, including huge page blocks, cached on
+/// `node`.
+pub fn cache_size(node: usize) -> usize {
+    match u32::try_from(node) {
+        Ok(node) => ffi::NumaBlockCacheSize(node),
+        Err(_) => 0,
+    }
+}
+
+/// Returns every cached block, on every node, to the operating system.
+pub fn trim_cache() {
+    ffi::TrimNumaBlockCache()
+}
+
+pub(crate) unsafe extern "C" fn block_alloc(size: usize) -> *mut c_void {
+    ffi::NumaBlockAlloc(size).cast()
+}
+
+pub(crate) unsafe extern "C" fn block_dealloc(block: *mut c_void, size: usize) {
+    ffi::NumaBlockDealloc(block.cast(), size)
+}
+
+pub(crate) unsafe extern "C" fn huge_page_block_alloc(size: usize) -> *mut c_void {
+    ffi::HugePageBlockAlloc(size).cast()
+}
+
+pub(crate) unsafe extern "C" fn huge_page_block_dealloc(block: *mut c_void, size: usize) {
+    ffi::HugePageBlockDealloc(block.cast(), size)
+}
@@ -0,0 +1,321 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Pools of reusable messages.
+//!
+//! [`MessageLite::clear`] resets a message's fields without freeing the
+//! memory that holds them, so a cleared message that is parsed into again can
+//! reuse the capacity of its strings and repeated fields rather than
+//! allocating them anew. A [`MessagePool`] exploits this by handing out
+//! cleared instances of a prototype and taking them back when they are
+//! dropped, which is well suited to request handlers that parse one message
+//! of the same type per request.
+//!
+//! Likewise, an [`ArenaPool`] hands out arenas and resets them when they are
+//! returned, so that their first block is reused. Its arenas allocate their
+//! blocks on the NUMA node of the allocating thread, as described in the
+//! [`numa`](crate::numa) module.
+
+use std::cell::RefCell;
+use std::fmt;
+use std::ops::Deref;
+use std::pin::Pin;
+
+use crate::{Arena, ArenaOptions, MessageLite};
+
+/// Options that control which messages a [`MessagePool`] retains.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct MessagePoolOptions {
+    /// The maximum number of idle messages the pool retains.
+    ///
+    /// Messages returned to a pool that already holds this many idle messages
+    /// are freed.
+    pub max_retained: usize,
+    /// The maximum memory, as reported by
+    /// [`MessageLite::space_used_estimate`], that a cleared message may use
+    /// and still be retained.
+    ///
+    /// This keeps a single unusually large message from pinning its memory
+    /// in the pool indefinitely.
+    pub max_space_used: usize,
+}
+
+impl Default for MessagePoolOptions {
+    fn default() -> MessagePoolOptions {
+        MessagePoolOptions {
+            max_retained: 64,
+            max_space_used: 1 << 20,
+        }
+    }
+}
+
+/// A pool of cleared messages of a single type.
+///
+/// Messages are constructed from the prototype with [`MessageLite::new`] when
+/// the pool is empty. The pool is not `Sync`; use one pool per thread.
+pub struct MessagePool<'a> {
+    prototype: &'a dyn MessageLite,
+    options: MessagePoolOptions,
+    idle: RefCell<Vec<Pin<Box<dyn MessageLite>>>>,
+}
+
+impl<'a> MessagePool<'a> {
+    /// Creates a pool of messages of the same type as `prototype` with the
+    /// default options.
+    pub fn new(prototype: &'a dyn MessageLite) -> MessagePool<'a> {
+        MessagePool::with_options(prototype, MessagePoolOptions::default())
+    }
+
+    /// Creates a pool of messages of the same type as `prototype` with the
+    /// given options.
+    pub fn with_options(
+        prototype: &'a dyn MessageLite,
+        options: MessagePoolOptions,
+    ) -> MessagePool<'a> {
+        MessagePool {
+            prototype,
+            options,
+            idle: RefCell::new(vec![]),
+        }
+    }
+
+    /// Takes a cleared message from the pool, constructing a new one if the
+    /// pool is empty.
+    ///
+    /// The message returns to the pool when the [`PooledMessage`] is dropped.
+    pub fn get(&self) -> PooledMessage<'_> {
+        let message = self
+            .idle
+            .borrow_mut()
+            .pop()
+            .unwrap_or_else(|| self.prototype.new());
+        PooledMessage {
+            pool: self,
+            message: Some(message),
+        }
+    }
+
+    /// Returns the number of idle messages held by the pool.
+    pub fn idle_count(&self) -> usize {
+        self.idle.borrow().len()
+    }
+
+    /// Frees all idle messages held by the pool.
+    pub fn shrink(&self) {
+        self.idle.borrow_mut().clear();
+    }
+
+    fn put(&self, mut message: Pin<Box<dyn MessageLite>>) {
+        message.as_mut().clear();
+        let mut idle = self.idle.borrow_mut();
+        if idle.len() < self.options.max_retained
+            && message.space_used_estimate() <= self.options.max_space_used
+        {
+            idle.push(message);
+        }
+    }
+}
+
+impl fmt::Debug for MessagePool<'_> {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("MessagePool")
+            .field("options", &self.options)
+            .field("idle_count", &self.idle_count())
+            .finish_non_exhaustive()
+    }
+}
+
+/// A message borrowed from a [`MessagePool`].
+///
+/// The message is cleared and returned to its pool when dropped.
+pub struct PooledMessage<'a> {
+    pool: &'a MessagePool<'a>,
+    message: Option<Pin<Box<dyn MessageLite>>>,
+}
+
+impl PooledMessage<'_> {
+    /// Returns a mutable reference to the message.
+    pub fn as_mut(&mut self) -> Pin<&mut dyn MessageLite> {
+        self.message.as_mut().unwrap().as_mut()
+    }
+
+    /// Takes ownership of the message, so that it is not returned to the
+    /// pool.
+    pub fn detach(mut self) -> Pin<Box<dyn MessageLite>> {
+        self.message.take().unwrap()
+    }
+}
+
+impl Deref for PooledMessage<'_> {
+    type Target = dyn MessageLite;
+
+    fn deref(&self) -> &dyn MessageLite {
+        &**self.message.as_ref().unwrap()
+    }
+}
+
+impl Drop for PooledMessage<'_> {
+    fn drop(&mut self) {
+        if let Some(message) = self.message.take() {
+            self.pool.put(message);
+        }
+    }
+}
+
+/// Options for the arenas of an [`ArenaPool`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ArenaPoolOptions {
+    /// The maximum number of idle arenas the pool retains.
+    ///
+    /// Arenas returned to a pool that already holds this many idle arenas
+    /// are freed, and their blocks cached by the NUMA block allocator.
+    pub max_retained: usize,
+    /// The size of the first block of each arena.
+    pub start_block_size: usize,
+    /// The maximum size of the blocks of each arena.
+    pub max_block_size: usize,
+    /// Whether to back the blocks of each arena with huge pages.
+    ///
+    /// See [`ArenaOptions::set_huge_page_block_allocator`].
+    pub huge_pages: bool,
+}
+
+impl Default for ArenaPoolOptions {
+    fn default() -> ArenaPoolOptions {
+        ArenaPoolOptions {
+            max_retained: 8,
+            start_block_size: 64 << 10,
+            max_block_size: 1 << 20,
+            huge_pages: false,
+        }
+    }
+}
+
+/// A pool of arenas whose blocks are allocated on the NUMA node of the thread
+/// that allocates them.
+///
+/// Arenas are created when the pool is empty, with options that enable
+/// [`ArenaOptions::set_numa_block_allocator`]. An arena returns to the pool
+/// when the [`PooledArena`] is dropped, and is reset, which frees every
+/// block but the first. The pool is not `Sync`; use one pool per thread, so
+/// that each thread reuses arenas whose first blocks are on its node.
+pub struct ArenaPool {
+    options: ArenaPoolOptions,
+    idle: RefCell<Vec<Pin<Box<Arena<'static>>>>>,
+}
+
+impl ArenaPool {
+    /// Creates a pool of arenas with the default options.
+    pub fn new() -> ArenaPool {
+        ArenaPool::with_options(ArenaPoolOptions::default())
+    }
+
+    /// Creates a pool of arenas with the given options.
+    pub fn with_options(options: ArenaPoolOptions) -> ArenaPool {
+        ArenaPool {
+            options,
+            idle: RefCell::new(vec![]),
+        }
+    }
+
+    /// Takes an empty arena from the pool, creating a new one if the pool is
+    /// empty.
+    ///
+    /// The arena returns to the pool when the [`PooledArena`] is dropped.
+    pub fn get(&self) -> PooledArena<'_> {
+        let arena = self.idle.borrow_mut().pop().unwrap_or_else(|| {
+            let mut options = ArenaOptions {
+                start_block_size: self.options.start_block_size,
+                max_block_size: self.options.max_block_size,
+                ..Default::default()
+            };
+            if self.options.huge_pages {
+                options.set_huge_page_block_allocator();
+            } else {
+                options.set_numa_block_allocator();
+            }
+            Arena::with_options(options)
+        });
+        PooledArena {
+            pool: self,
+            arena: Some(arena),
+        }
+    }
+
+    /// Returns the number of idle arenas held by the pool.
+    pub fn idle_count(&self) -> usize {
+        self.idle.borrow().len()
+    }
+
+    /// Frees all idle arenas held by the pool.
+    pub fn shrink(&self) {
+        self.idle.borrow_mut().clear();
+    }
+
+    fn put(&self, mut arena: Pin<Box<Arena<'static>>>) {
+        arena.as_mut().reset();
+        let mut idle = self.idle.borrow_mut();
+        if idle.len() < self.options.max_retained {
+            idle.push(arena);
+        }
+    }
+}
+
+impl Default for ArenaPool {
+    fn default() -> ArenaPool {
+        ArenaPool::new()
+    }
+}
+
+impl fmt::Debug for ArenaPool {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.debug_struct("ArenaPool")
+            .field("options", &self.options)
+            .field("idle_count", &self.idle_count())
+            .finish_non_exhaustive()
+    }
+}
+
+/// An arena borrowed from an [`ArenaPool`].
+///
+/// Messages allocated on the arena borrow it, so they are freed before the
+/// arena is reset and returned to its pool on drop.
+pub struct PooledArena<'a> {
+    pool: &'a ArenaPool,
+    arena: Option<Pin<Box<Arena<'static>>>>,
+}
+
+impl PooledArena<'_> {
+    /// Takes ownership of the arena, so that it is not returned to the pool.
+    pub fn detach(mut self) -> Pin<Box<Arena<'static>>> {
+        self.arena.take().unwrap()
+    }
+}
+
+impl Deref for PooledArena<'_> {
+    type Target = Arena<'static>;
+
+    fn deref(&self) -> &Arena<'static> {
+        self.arena.as_ref().unwrap()
+    }
+}
+
+impl Drop for PooledArena<'_> {
+    fn drop(&mut self) {
+        if let Some(arena) = self.arena.take() {
+            self.pool.put(arena);
+        }
+    }
+}
@@ -0,0 +1,161 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/profile.h"
+
+#include <climits>
+#include <deque>
+
+#include "absl/container/flat_hash_set.h"
+#include "google/protobuf/wire_format_lite.h"
+#include "protobuf-native/src/profile.rs.h"
+
+namespace protobuf_native {
+namespace profile {
+
+using google::protobuf::internal::WireFormatLite;
+using google::protobuf::io::CodedInputStream;
+
+FieldProfiler::FieldProfiler(const Descriptor* descriptor, uint32_t sample_rate)
+    : descriptor_(descriptor), sample_rate_(sample_rate == 0 ? 1 : sample_rate) {
+    absl::flat_hash_set<const Descriptor*> seen = {descriptor};
+    std::deque<const Descriptor*> queue = {descriptor};
+    while (!queue.empty()) {
+        const Descriptor* message = queue.front();
+        queue.pop_front();
+        for (int i = 0; i < message->field_count(); ++i) {
+            const FieldDescriptor* field = message->field(i);
+            fields_.push_back(field);
+            const Descriptor* child = field->message_type();
+            if (child != nullptr && seen.insert(child).second) {
+                queue.push_back(child);
+            }
+        }
+    }
+}
+
+bool FieldProfiler::Record(rust::Slice<const uint8_t> data) const {
+    // Only one in every `sample_rate_` messages is decoded; the rest cost a
+    // single atomic increment.
+    if (messages_.fetch_add(1, std::memory_order_relaxed) % sample_rate_ != 0) {
+        return true;
+    }
+    if (data.size() > INT_MAX) {
+        return false;
+    }
+    CounterMap counters;
+    CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    if (!Scan(input, descriptor_, 0, counters)) {
+        return false;
+    }
+    absl::MutexLock lock(&mu_);
+    ++samples_;
+    for (const auto& entry : counters) {
+        Counters& total = counters_[entry.first];
+        total.occurrences += entry.second.occurrences;
+        total.bytes += entry.second.bytes;
+    }
+    return true;
+}
+
+bool FieldProfiler::Scan(CodedInputStream& input, const Descriptor* descriptor, int end_group,
+                         CounterMap& counters) {
+    while (true) {
+        int start = input.CurrentPosition();
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return end_group == 0 && input.ConsumedEntireMessage();
+        }
+        int number = WireFormatLite::GetTagFieldNumber(tag);
+        WireFormatLite::WireType wire_type = WireFormatLite::GetTagWireType(tag);
+        if (wire_type == WireFormatLite::WIRETYPE_END_GROUP) {
+            return end_group != 0 && number == end_group;
+        }
+
+        // Unknown fields, and fields with an unexpected wire type, are
+        // skipped without being counted.
+        const FieldDescriptor* field = descriptor->FindFieldByNumber(number);
+        if (field == nullptr) {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+            continue;
+        }
+        if (field->type() == FieldDescriptor::TYPE_GROUP &&
+            wire_type == WireFormatLite::WIRETYPE_START_GROUP) {
+            if (!input.IncrementRecursionDepth() ||
+                !Scan(input, field->message_type(), number, counters)) {
+                return false;
+            }
+            input.DecrementRecursionDepth();
+        } else if (field->type() == FieldDescriptor::TYPE_MESSAGE &&
+                   wire_type == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            int length;
+            if (!input.ReadVarintSizeAsInt(&length)) {
+                return false;
+            }
+            std::pair<CodedInputStream::Limit, int> limit =
+                input.IncrementRecursionDepthAndPushLimit(length);
+            if (limit.second < 0 || !Scan(input, field->message_type(), 0, counters) ||
+                !input.DecrementRecursionDepthAndPopLimit(limit.first)) {
+                return false;
+            }
+        } else if (!WireFormatLite::SkipField(&input, tag)) {
+            return false;
+        }
+        Counters& field_counters = counters[field];
+        ++field_counters.occurrences;
+        field_counters.bytes += input.CurrentPosition() - start;
+    }
+}
+
+uint64_t FieldProfiler::Messages() const { return messages_.load(std::memory_order_relaxed); }
+
+uint64_t FieldProfiler::Samples() const {
+    absl::MutexLock lock(&mu_);
+    return samples_;
+}
+
+rust::Vec<FieldStats> FieldProfiler::Stats() const {
+    absl::MutexLock lock(&mu_);
+    rust::Vec<FieldStats> stats;
+    stats.reserve(fields_.size());
+    for (const FieldDescriptor* field : fields_) {
+        auto it = counters_.find(field);
+        Counters counters = it == counters_.end() ? Counters() : it->second;
+        stats.push_back(FieldStats{
+            .full_name = rust::String(field->full_name().data(), field->full_name().size()),
+            .occurrences = counters.occurrences,
+            .bytes = counters.bytes,
+        });
+    }
+    return stats;
+}
+
+void FieldProfiler::Reset() {
+    absl::MutexLock lock(&mu_);
+    messages_.store(0, std::memory_order_relaxed);
+    samples_ = 0;
+    counters_.clear();
+}
+
+FieldProfiler* NewFieldProfiler(const Descriptor* descriptor, uint32_t sample_rate) {
+    return new FieldProfiler(descriptor, sample_rate);
+}
+
+void DeleteFieldProfiler(FieldProfiler* profiler) { delete profiler; }
+
+}  // namespace profile
+}  // namespace protobuf_native
@@ -0,0 +1,73 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace profile {
+
+using namespace google::protobuf;
+
+struct FieldStats;
+
+// Counts how often each field of a message type, and of the message types
+// reachable from it, occurs in a sample of encoded messages.
+class FieldProfiler {
+   public:
+    FieldProfiler(const Descriptor* descriptor, uint32_t sample_rate);
+
+    bool Record(rust::Slice<const uint8_t> data) const;
+    uint64_t Messages() const;
+    uint64_t Samples() const;
+    rust::Vec<FieldStats> Stats() const;
+    void Reset();
+
+   private:
+    struct Counters {
+        uint64_t occurrences = 0;
+        uint64_t bytes = 0;
+    };
+
+    using CounterMap = absl::flat_hash_map<const FieldDescriptor*, Counters>;
+
+    static bool Scan(google::protobuf::io::CodedInputStream& input, const Descriptor* descriptor,
+                     int end_group, CounterMap& counters);
+
+    const Descriptor* descriptor_;
+    uint32_t sample_rate_;
+    // Every field reachable from `descriptor_`, in breadth-first order.
+    std::vector<const FieldDescriptor*> fields_;
+    mutable std::atomic<uint64_t> messages_{0};
+    mutable absl::Mutex mu_;
+    mutable uint64_t samples_ ABSL_GUARDED_BY(mu_) = 0;
+    mutable CounterMap counters_ ABSL_GUARDED_BY(mu_);
+};
+
+FieldProfiler* NewFieldProfiler(const Descriptor* descriptor, uint32_t sample_rate);
+void DeleteFieldProfiler(FieldProfiler*);
+
+}  // namespace profile
+}  // namespace protobuf_native
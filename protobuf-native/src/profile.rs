@@ -0,0 +1,155 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Sampling of field usage in encoded messages.
+//!
+//! A [`FieldProfiler`] decodes one in every N encoded messages of a type that
+//! it is shown, and counts how often each field of the type, and of the
+//! message types reachable from it, occurs on the wire and how many bytes it
+//! takes up. Fields that never occur in production traffic are candidates for
+//! removal from the schema, while the fields that occur most often are the
+//! ones worth assigning the smallest field numbers, which the parser
+//! dispatches on most cheaply.
+
+use std::marker::{PhantomData, PhantomPinned};
+use std::pin::Pin;
+
+use crate::internal::{unsafe_ffi_conversions, BoolExt};
+use crate::{Descriptor, OperationFailedError};
+
+#[cxx::bridge(namespace = "protobuf_native::profile")]
+pub(crate) mod ffi {
+    struct FieldStats {
+        full_name: String,
+        occurrences: u64,
+        bytes: u64,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/profile.h");
+
+        #[namespace = "google::protobuf"]
+        type Descriptor = crate::ffi::Descriptor;
+
+        type FieldProfiler;
+        unsafe fn NewFieldProfiler(
+            descriptor: *const Descriptor,
+            sample_rate: u32,
+        ) -> *mut FieldProfiler;
+        unsafe fn DeleteFieldProfiler(profiler: *mut FieldProfiler);
+        fn Record(self: &FieldProfiler, data: &[u8]) -> bool;
+        fn Messages(self: &FieldProfiler) -> u64;
+        fn Samples(self: &FieldProfiler) -> u64;
+        fn Stats(self: &FieldProfiler) -> Vec<FieldStats>;
+        fn Reset(self: Pin<&mut FieldProfiler>);
+    }
+}
+
+/// Usage statistics for one field, as collected by a [`FieldProfiler`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct FieldStats {
+    /// The fully-qualified name of the field, like `package.Message.field`.
+    pub full_name: String,
+    /// The number of times the field occurred in the sampled messages.
+    ///
+    /// Each element of an unpacked repeated field counts as one occurrence,
+    /// while a packed repeated field counts once per run of elements.
+    pub occurrences: u64,
+    /// The number of encoded bytes taken up by the field's occurrences,
+    /// including their tags.
+    pub bytes: u64,
+}
+
+impl From<ffi::FieldStats> for FieldStats {
+    fn from(stats: ffi::FieldStats) -> FieldStats {
+        FieldStats {
+            full_name: stats.full_name,
+            occurrences: stats.occurrences,
+            bytes: stats.bytes,
+        }
+    }
+}
+
+/// Counts the occurrences of fields in a sample of encoded messages.
+///
+/// The profiler may be shared between threads. Messages that are not sampled
+/// cost a single atomic increment to record, so a profiler with a large
+/// enough sample rate can be left enabled on a production path.
+pub struct FieldProfiler<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for FieldProfiler<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteFieldProfiler(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> FieldProfiler<'a> {
+    /// Creates a new profiler for messages of the specified type that decodes
+    /// one in every `sample_rate` messages it is shown.
+    ///
+    /// A sample rate of zero is treated as one, sampling every message.
+    pub fn new(descriptor: &'a Descriptor, sample_rate: u32) -> Pin<Box<FieldProfiler<'a>>> {
+        let profiler = unsafe { ffi::NewFieldProfiler(descriptor.as_ffi(), sample_rate) };
+        unsafe { Self::from_ffi_owned(profiler) }
+    }
+
+    /// Shows the profiler an encoded message of its type.
+    ///
+    /// Unknown fields, and fields encoded with an unexpected wire type, are
+    /// skipped without being counted.
+    ///
+    /// Returns an error, without counting any of its fields, if the message
+    /// is sampled and is not a valid protocol buffer.
+    pub fn record(&self, data: &[u8]) -> Result<(), OperationFailedError> {
+        self.as_ffi().Record(data).as_result()
+    }
+
+    /// Returns the number of messages shown to the profiler.
+    pub fn messages(&self) -> u64 {
+        self.as_ffi().Messages()
+    }
+
+    /// Returns the number of valid messages that were sampled.
+    pub fn samples(&self) -> u64 {
+        self.as_ffi().Samples()
+    }
+
+    /// Returns the statistics for every field of the profiler's message type
+    /// and of the message types reachable from it, in breadth-first order.
+    ///
+    /// Fields that never occurred in the sampled messages are included, with
+    /// zero occurrences.
+    pub fn stats(&self) -> Vec<FieldStats> {
+        self.as_ffi()
+            .Stats()
+            .into_iter()
+            .map(FieldStats::from)
+            .collect()
+    }
+
+    /// Resets all counters to zero.
+    pub fn reset(self: Pin<&mut Self>) {
+        self.as_ffi_mut().Reset()
+    }
+
+    unsafe_ffi_conversions!(ffi::FieldProfiler);
+}
+
+// SAFETY: the profiler synchronizes access to its counters internally.
+unsafe impl<'a> Send for FieldProfiler<'a> {}
+unsafe impl<'a> Sync for FieldProfiler<'a> {}
@@ -0,0 +1,1220 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "protobuf-native/src/protoc.h"
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/log/absl_check.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/str_split.h"
+#include "google/protobuf/compiler/cpp/generator.h"
+#include "google/protobuf/compiler/cpp/helpers.h"
+#include "google/protobuf/compiler/csharp/csharp_generator.h"
+#include "google/protobuf/compiler/java/generator.h"
+#include "google/protobuf/compiler/java/kotlin_generator.h"
+#include "google/protobuf/compiler/objectivec/generator.h"
+#include "google/protobuf/compiler/php/php_generator.h"
+#include "google/protobuf/compiler/python/generator.h"
+#include "google/protobuf/compiler/python/pyi_generator.h"
+#include "google/protobuf/compiler/ruby/ruby_generator.h"
+#include "google/protobuf/compiler/rust/generator.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "protobuf-native/src/internal.rs.h"
+#include "protobuf-native/src/protoc.rs.h"
+
+namespace protobuf_native {
+namespace protoc {
+
+using google::protobuf::Descriptor;
+using google::protobuf::Edition;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::FileOptions;
+using google::protobuf::compiler::GeneratorContext;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+
+namespace compiler = google::protobuf::compiler;
+
+CodeGenerator* NewCodeGenerator(int language) {
+    switch (language) {
+        case 0:
+            return new compiler::cpp::CppGenerator();
+        case 1:
+            return new compiler::csharp::Generator();
+        case 2:
+            return new compiler::java::JavaGenerator();
+        case 3:
+            return new compiler::java::KotlinGenerator();
+        case 4:
+            return new compiler::objectivec::ObjectiveCGenerator();
+        case 5:
+            return new compiler::php::Generator();
+        case 6:
+            return new compiler::python::Generator();
+        case 7:
+            return new compiler::python::PyiGenerator();
+        case 8:
+            return new compiler::ruby::Generator();
+        case 9:
+            return new compiler::rust::RustGenerator();
+        default:
+            return nullptr;
+    }
+}
+
+void DeleteCodeGenerator(CodeGenerator* generator) { delete generator; }
+
+namespace {
+
+// Collects the files that a code generator writes in memory. Insertion points
+// refer to files written by other invocations, which an in-memory context
+// cannot see, so they are reported as an error.
+class MemoryGeneratorContext : public GeneratorContext {
+   public:
+    MemoryGeneratorContext(std::vector<const FileDescriptor*> files) : files_(std::move(files)) {}
+
+    ZeroCopyOutputStream* Open(const std::string& filename) override {
+        auto inserted = outputs_.emplace(filename, std::string());
+        if (!inserted.second && error_.empty()) {
+            error_ = absl::StrCat(filename, ": Tried to write the same file twice.");
+        }
+        inserted.first->second.clear();
+        return new StringOutputStream(&inserted.first->second);
+    }
+
+    ZeroCopyOutputStream* OpenForInsert(const std::string& filename,
+                                        const std::string& insertion_point) override {
+        if (error_.empty()) {
+            error_ = absl::StrCat(filename, ": Insertion point \"", insertion_point,
+                                  "\" cannot be written in memory.");
+        }
+        discarded_.clear();
+        return new StringOutputStream(&discarded_);
+    }
+
+    void ListParsedFiles(std::vector<const FileDescriptor*>* output) override { *output = files_; }
+
+    const std::map<std::string, std::string>& outputs() const { return outputs_; }
+    const std::string& error() const { return error_; }
+
+   private:
+    std::vector<const FileDescriptor*> files_;
+    std::map<std::string, std::string> outputs_;
+    std::string discarded_;
+    std::string error_;
+};
+
+bool Generate(const CodeGenerator& generator, const std::vector<const FileDescriptor*>& parsed,
+              const std::vector<const FileDescriptor*>& files, rust::Str parameter,
+              rust::Vec<GeneratedFile>& output, rust::String& error) {
+    MemoryGeneratorContext context(parsed);
+    std::string message;
+    bool ok = generator.GenerateAll(files, std::string(parameter), &context, &message);
+    if (ok && !context.error().empty()) {
+        ok = false;
+        message = context.error();
+    }
+    if (!ok) {
+        error = rust::String::lossy(message.empty() ? "code generator failed" : message);
+        return false;
+    }
+    output.reserve(output.size() + context.outputs().size());
+    for (const auto& file : context.outputs()) {
+        GeneratedFile generated;
+        generated.name = rust::String::lossy(file.first);
+        generated.contents.reserve(file.second.size());
+        memcpy(generated.contents.data(), file.second.data(), file.second.size());
+        vec_u8_set_len(generated.contents, file.second.size());
+        output.push_back(std::move(generated));
+    }
+    return true;
+}
+
+}  // namespace
+
+bool CodeGeneratorGenerate(const CodeGenerator& generator, const FileDescriptor* const* files,
+                           size_t len, rust::Str parameter, rust::Vec<GeneratedFile>& output,
+                           rust::String& error) {
+    std::vector<const FileDescriptor*> parsed(files, files + len);
+    return Generate(generator, parsed, parsed, parameter, output, error);
+}
+
+bool CodeGeneratorGenerateFile(const CodeGenerator& generator, const FileDescriptor* const* files,
+                               size_t len, size_t index, rust::Str parameter,
+                               rust::Vec<GeneratedFile>& output, rust::String& error) {
+    std::vector<const FileDescriptor*> parsed(files, files + len);
+    return Generate(generator, parsed, {parsed[index]}, parameter, output, error);
+}
+
+namespace {
+
+// The symbols of the C++ functions that the Rust wrappers of a message call
+// are named after the message and field, with underscores and dots escaped,
+// so that distinct names never collide.
+std::string Mangle(absl::string_view name) {
+    std::string mangled;
+    for (char c : name) {
+        switch (c) {
+            case '_':
+                mangled += "_u";
+                break;
+            case '.':
+                mangled += "_d";
+                break;
+            default:
+                mangled += c;
+        }
+    }
+    return mangled;
+}
+
+std::string Symbol(const Descriptor* message, absl::string_view op,
+                   const FieldDescriptor* field = nullptr) {
+    std::string symbol = absl::StrCat("protobuf_native_", Mangle(message->full_name()), "__", op);
+    if (field != nullptr) {
+        absl::StrAppend(&symbol, "__", Mangle(field->name()));
+    }
+    return symbol;
+}
+
+// Escapes `name` if it is a Rust keyword.
+std::string RustIdent(absl::string_view name) {
+    static const absl::flat_hash_set<absl::string_view>* keywords =
+        new absl::flat_hash_set<absl::string_view>({
+            "abstract", "as",     "async",   "await",  "become", "box",    "break",
+            "const",    "continue", "do",    "dyn",    "else",   "enum",   "extern",
+            "false",    "final",  "fn",      "for",    "gen",    "if",     "impl",
+            "in",       "let",    "loop",    "macro",  "match",  "mod",    "move",
+            "mut",      "override", "priv",  "pub",    "ref",    "return", "static",
+            "struct",   "trait",  "true",    "try",    "type",   "typeof", "unsafe",
+            "unsized",  "use",    "virtual", "where",  "while",  "yield",
+        });
+    if (name == "self" || name == "super" || name == "crate" || name == "Self") {
+        return absl::StrCat(name, "_");
+    }
+    if (keywords->contains(name)) {
+        return absl::StrCat("r#", name);
+    }
+    return std::string(name);
+}
+
+// The name of the wrapper of `message` in the module of its package, which is
+// the message's name qualified by the names of the messages it is nested in,
+// joined with underscores, as for the C++ class.
+std::string RustTypeName(const Descriptor* message) {
+    absl::string_view name = message->full_name();
+    const std::string& package = message->file()->package();
+    if (!package.empty()) {
+        name.remove_prefix(package.size() + 1);
+    }
+    return RustIdent(absl::StrReplaceAll(name, {{".", "_"}}));
+}
+
+std::vector<std::string> PackageModules(const FileDescriptor* file) {
+    std::vector<std::string> modules;
+    if (!file->package().empty()) {
+        for (absl::string_view segment : absl::StrSplit(file->package(), '.')) {
+            modules.push_back(RustIdent(segment));
+        }
+    }
+    return modules;
+}
+
+// The path to the wrapper of `message` from the module of the package of
+// `from`.
+std::string RustTypePath(const FileDescriptor* from, const Descriptor* message) {
+    std::string path;
+    for (size_t i = 0; i < PackageModules(from).size(); i++) {
+        path += "super::";
+    }
+    for (const std::string& module : PackageModules(message->file())) {
+        absl::StrAppend(&path, module, "::");
+    }
+    return absl::StrCat(path, RustTypeName(message));
+}
+
+struct ScalarType {
+    const char* cpp;
+    const char* rust;
+};
+
+ScalarType ScalarTypeOf(const FieldDescriptor* field) {
+    switch (field->cpp_type()) {
+        case FieldDescriptor::CPPTYPE_INT32:
+            return {"std::int32_t", "i32"};
+        case FieldDescriptor::CPPTYPE_INT64:
+            return {"std::int64_t", "i64"};
+        case FieldDescriptor::CPPTYPE_UINT32:
+            return {"std::uint32_t", "u32"};
+        case FieldDescriptor::CPPTYPE_UINT64:
+            return {"std::uint64_t", "u64"};
+        case FieldDescriptor::CPPTYPE_FLOAT:
+            return {"float", "f32"};
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+            return {"double", "f64"};
+        case FieldDescriptor::CPPTYPE_BOOL:
+            return {"bool", "bool"};
+        case FieldDescriptor::CPPTYPE_ENUM:
+            return {"int", "i32"};
+        default:
+            return {nullptr, nullptr};
+    }
+}
+
+void CollectMessages(const Descriptor* message, std::vector<const Descriptor*>& output) {
+    if (message->options().map_entry()) {
+        return;
+    }
+    output.push_back(message);
+    for (int i = 0; i < message->nested_type_count(); i++) {
+        CollectMessages(message->nested_type(i), output);
+    }
+}
+
+std::vector<const Descriptor*> FileMessages(const FileDescriptor* file) {
+    std::vector<const Descriptor*> messages;
+    for (int i = 0; i < file->message_type_count(); i++) {
+        CollectMessages(file->message_type(i), messages);
+    }
+    return messages;
+}
+
+using Vars = std::map<std::string, std::string>;
+
+// Copies output directly into the buffers of a ZeroCopyOutputStream, which
+// for the streams of protoc's generator contexts grow geometrically, so that
+// large outputs are written in few large chunks.
+class ChunkWriter {
+   public:
+    explicit ChunkWriter(ZeroCopyOutputStream* output) : output_(output) {}
+
+    ~ChunkWriter() {
+        if (size_ > 0) {
+            output_->BackUp(size_);
+        }
+    }
+
+    void Write(absl::string_view data) {
+        while (!data.empty()) {
+            if (size_ == 0) {
+                void* buffer;
+                if (!output_->Next(&buffer, &size_)) {
+                    size_ = 0;
+                    return;
+                }
+                buffer_ = static_cast<char*>(buffer);
+                continue;
+            }
+            size_t n = std::min(data.size(), static_cast<size_t>(size_));
+            memcpy(buffer_, data.data(), n);
+            buffer_ += n;
+            size_ -= static_cast<int>(n);
+            data.remove_prefix(n);
+        }
+    }
+
+   private:
+    ZeroCopyOutputStream* output_;
+    char* buffer_ = nullptr;
+    int size_ = 0;
+};
+
+// Text with `$name$` variables, as for io::Printer, that is parsed once, when
+// the template is constructed, and then expanded for every message or field
+// without being scanned again. `$$` is a literal `$`.
+class Template {
+   public:
+    // `indent` is prepended to every nonempty line of `text`.
+    explicit Template(absl::string_view text, absl::string_view indent = "") {
+        std::string indented;
+        bool line_start = true;
+        for (char c : text) {
+            if (line_start && c != '\n') {
+                absl::StrAppend(&indented, indent);
+            }
+            indented += c;
+            line_start = c == '\n';
+        }
+        std::vector<std::string> pieces = absl::StrSplit(indented, '$');
+        ABSL_CHECK(pieces.size() % 2 == 1) << "unterminated variable in template: " << text;
+        for (size_t i = 0; i < pieces.size(); i++) {
+            if (i % 2 == 0) {
+                literal_ += pieces[i];
+            } else if (pieces[i].empty()) {
+                literal_ += '$';
+            } else {
+                segments_.push_back({std::move(literal_), std::move(pieces[i])});
+                literal_.clear();
+            }
+        }
+    }
+
+    void Expand(ChunkWriter& out, const Vars& vars) const {
+        for (const Segment& segment : segments_) {
+            out.Write(segment.literal);
+            auto value = vars.find(segment.variable);
+            ABSL_CHECK(value != vars.end()) << "undefined variable: " << segment.variable;
+            out.Write(value->second);
+        }
+        out.Write(literal_);
+    }
+
+   private:
+    struct Segment {
+        std::string literal;
+        std::string variable;
+    };
+
+    // The template is the literal and variable of each segment, in order,
+    // followed by the literal text after the last variable.
+    std::vector<Segment> segments_;
+    std::string literal_;
+};
+
+// The indentation of the members of extern blocks and impls.
+constexpr absl::string_view kIndent = "    ";
+
+// Generates typed Rust wrappers for the C++ classes generated by protoc's C++
+// generator, with accessors that call the generated C++ accessors through a
+// C++ file of `extern "C"` functions. See `CodeGenerator::rust_wrappers` in
+// protoc.rs.
+class RustWrapperGenerator : public CodeGenerator {
+   public:
+    uint64_t GetSupportedFeatures() const override {
+        return FEATURE_PROTO3_OPTIONAL | FEATURE_SUPPORTS_EDITIONS;
+    }
+
+    // The wrappers call the accessors generated by the C++ generator, and so
+    // support the editions that it supports.
+    Edition GetMinimumEdition() const override { return Edition::EDITION_PROTO2; }
+    Edition GetMaximumEdition() const override { return Edition::EDITION_2023; }
+
+    bool Generate(const FileDescriptor* file, const std::string& parameter,
+                  GeneratorContext* context, std::string* error) const override {
+        return GenerateAll({file}, parameter, context, error);
+    }
+
+    bool GenerateAll(const std::vector<const FileDescriptor*>& files, const std::string& parameter,
+                     GeneratorContext* context, std::string* error) const override {
+        if (!parameter.empty()) {
+            *error = absl::StrCat("Unknown generator option: ", parameter);
+            return false;
+        }
+        std::vector<const FileDescriptor*> parsed;
+        context->ListParsedFiles(&parsed);
+        absl::flat_hash_set<const Descriptor*> wrapped;
+        for (const FileDescriptor* file : parsed) {
+            for (const Descriptor* message : FileMessages(file)) {
+                wrapped.insert(message);
+            }
+        }
+        for (const FileDescriptor* file : files) {
+            GenerateShim(file, wrapped, context);
+            GenerateWrappers(file, wrapped, context);
+        }
+        // The index is written once, by whichever invocation generates the
+        // first parsed file, so that generating files separately yields the
+        // same output as generating them together.
+        if (!parsed.empty() && std::find(files.begin(), files.end(), parsed[0]) != files.end()) {
+            GenerateIndex(parsed, context);
+        }
+        return true;
+    }
+
+   private:
+    static bool IsWrapped(const FieldDescriptor* field,
+                          const absl::flat_hash_set<const Descriptor*>& wrapped) {
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                return compiler::cpp::IsString(field);
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                return !field->is_map() && wrapped.contains(field->message_type());
+            default:
+                return true;
+        }
+    }
+
+    static Vars FieldVars(const Descriptor* message, const FieldDescriptor* field) {
+        Vars vars = {
+            {"class", compiler::cpp::QualifiedClassName(message)},
+            {"field", compiler::cpp::FieldName(field)},
+            {"name", field->name()},
+            {"getter", RustIdent(field->name())},
+            {"full_name", field->full_name()},
+            {"get", Symbol(message, "get", field)},
+            {"set", Symbol(message, "set", field)},
+            {"has", Symbol(message, "has", field)},
+            {"clear", Symbol(message, "clear", field)},
+            {"mutable", Symbol(message, "mutable", field)},
+            {"add", Symbol(message, "add", field)},
+            {"size", Symbol(message, "size", field)},
+        };
+        ScalarType scalar = ScalarTypeOf(field);
+        if (scalar.cpp != nullptr) {
+            vars["cpp_type"] = scalar.cpp;
+            vars["rust_type"] = scalar.rust;
+        }
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+            vars["enum"] = compiler::cpp::QualifiedClassName(field->enum_type());
+        }
+        if (field->cpp_type() == FieldDescriptor::CPPTYPE_MESSAGE) {
+            vars["sub_class"] = compiler::cpp::QualifiedClassName(field->message_type());
+            vars["sub_type"] = RustTypePath(message->file(), field->message_type());
+        }
+        return vars;
+    }
+
+    static bool IsClosedEnum(const FieldDescriptor* field) {
+        return field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM &&
+               field->enum_type()->is_closed();
+    }
+
+    static void GenerateShim(const FileDescriptor* file,
+                             const absl::flat_hash_set<const Descriptor*>& wrapped,
+                             GeneratorContext* context) {
+        std::string base = compiler::StripProto(file->name());
+        std::unique_ptr<ZeroCopyOutputStream> output(context->Open(base + ".pb.rs.cc"));
+        ChunkWriter out(output.get());
+        static const Template* const kShimHeader = new Template(
+            "// Generated by protobuf-native from $file$. DO NOT EDIT.\n"
+            "//\n"
+            "// The C++ side of the Rust wrappers in $base$.pb.rs.\n"
+            "\n"
+            "#include <cstddef>\n"
+            "#include <cstdint>\n"
+            "\n"
+            "#include \"$base$.pb.h\"\n"
+            "\n"
+            "extern \"C\" {\n");
+        kShimHeader->Expand(out, {{"file", file->name()}, {"base", base}});
+        for (const Descriptor* message : FileMessages(file)) {
+            Vars vars = {
+                {"class", compiler::cpp::QualifiedClassName(message)},
+                {"new", Symbol(message, "new")},
+                {"delete", Symbol(message, "delete")},
+            };
+            static const Template* const kShimMessage = new Template(
+                "\n"
+                "$class$* $new$() { return new $class$(); }\n"
+                "void $delete$($class$* message) { delete message; }\n");
+            kShimMessage->Expand(out, vars);
+            for (int i = 0; i < message->field_count(); i++) {
+                const FieldDescriptor* field = message->field(i);
+                if (IsWrapped(field, wrapped)) {
+                    GenerateFieldShim(out, message, field);
+                }
+            }
+        }
+        out.Write("\n}  // extern \"C\"\n");
+    }
+
+    static void GenerateFieldShim(ChunkWriter& out, const Descriptor* message,
+                                  const FieldDescriptor* field) {
+        Vars vars = FieldVars(message, field);
+        vars["verb"] = field->is_repeated() ? "add" : "set";
+        vars["store"] = field->is_repeated() ? vars["add"] : vars["set"];
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                if (field->is_repeated()) {
+                    static const Template* const kShimRepeatedString = new Template(
+                        "std::size_t $size$(const $class$* m) { return m->$field$_size(); }\n"
+                        "const std::uint8_t* $get$(const $class$* m, std::size_t i, "
+                        "std::size_t* len) {\n"
+                        "  const std::string& s = m->$field$(static_cast<int>(i));\n"
+                        "  *len = s.size();\n"
+                        "  return reinterpret_cast<const std::uint8_t*>(s.data());\n"
+                        "}\n"
+                        "void $add$($class$* m, const std::uint8_t* data, std::size_t len) {\n"
+                        "  m->add_$field$()->assign(reinterpret_cast<const char*>(data), len);\n"
+                        "}\n");
+                    kShimRepeatedString->Expand(out, vars);
+                } else {
+                    static const Template* const kShimString = new Template(
+                        "const std::uint8_t* $get$(const $class$* m, std::size_t* len) {\n"
+                        "  const std::string& s = m->$field$();\n"
+                        "  *len = s.size();\n"
+                        "  return reinterpret_cast<const std::uint8_t*>(s.data());\n"
+                        "}\n"
+                        "void $set$($class$* m, const std::uint8_t* data, std::size_t len) {\n"
+                        "  m->mutable_$field$()->assign(reinterpret_cast<const char*>(data), "
+                        "len);\n"
+                        "}\n");
+                    kShimString->Expand(out, vars);
+                }
+                break;
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                if (field->is_repeated()) {
+                    static const Template* const kShimRepeatedMessage = new Template(
+                        "std::size_t $size$(const $class$* m) { return m->$field$_size(); }\n"
+                        "const $sub_class$* $get$(const $class$* m, std::size_t i) {\n"
+                        "  return &m->$field$(static_cast<int>(i));\n"
+                        "}\n"
+                        "$sub_class$* $mutable$($class$* m, std::size_t i) {\n"
+                        "  return m->mutable_$field$(static_cast<int>(i));\n"
+                        "}\n"
+                        "$sub_class$* $add$($class$* m) { return m->add_$field$(); }\n");
+                    kShimRepeatedMessage->Expand(out, vars);
+                } else {
+                    static const Template* const kShimMessageField = new Template(
+                        "const $sub_class$* $get$(const $class$* m) { return &m->$field$(); }\n"
+                        "$sub_class$* $mutable$($class$* m) { return m->mutable_$field$(); }\n");
+                    kShimMessageField->Expand(out, vars);
+                }
+                break;
+            default:
+                if (field->is_repeated()) {
+                    static const Template* const kShimRepeatedScalar = new Template(
+                        "const $cpp_type$* $get$(const $class$* m, std::size_t* len) {\n"
+                        "  *len = m->$field$_size();\n"
+                        "  return reinterpret_cast<const $cpp_type$*>(m->$field$().data());\n"
+                        "}\n");
+                    kShimRepeatedScalar->Expand(out, vars);
+                } else {
+                    static const Template* const kShimScalar = new Template(
+                        "$cpp_type$ $get$(const $class$* m) { return m->$field$(); }\n");
+                    kShimScalar->Expand(out, vars);
+                }
+                if (IsClosedEnum(field)) {
+                    static const Template* const kShimClosedEnumStore = new Template(
+                        "bool $store$($class$* m, int v) {\n"
+                        "  if (!$enum$_IsValid(v)) return false;\n"
+                        "  m->$verb$_$field$(static_cast<$enum$>(v));\n"
+                        "  return true;\n"
+                        "}\n");
+                    kShimClosedEnumStore->Expand(out, vars);
+                } else if (field->cpp_type() == FieldDescriptor::CPPTYPE_ENUM) {
+                    static const Template* const kShimEnumStore = new Template(
+                        "void $store$($class$* m, int v) {\n"
+                        "  m->$verb$_$field$(static_cast<$enum$>(v));\n"
+                        "}\n");
+                    kShimEnumStore->Expand(out, vars);
+                } else {
+                    static const Template* const kShimScalarStore = new Template(
+                        "void $store$($class$* m, $cpp_type$ v) { m->$verb$_$field$(v); }\n");
+                    kShimScalarStore->Expand(out, vars);
+                }
+        }
+        if (field->has_presence()) {
+            static const Template* const kShimHas = new Template(
+                "bool $has$(const $class$* m) { return m->has_$field$(); }\n");
+            kShimHas->Expand(out, vars);
+        }
+        static const Template* const kShimClear = new Template(
+            "void $clear$($class$* m) { m->clear_$field$(); }\n");
+        kShimClear->Expand(out, vars);
+    }
+
+    static void GenerateWrappers(const FileDescriptor* file,
+                                 const absl::flat_hash_set<const Descriptor*>& wrapped,
+                                 GeneratorContext* context) {
+        std::string base = compiler::StripProto(file->name());
+        std::unique_ptr<ZeroCopyOutputStream> output(context->Open(base + ".pb.rs"));
+        ChunkWriter out(output.get());
+        out.Write(absl::StrCat("// Generated by protobuf-native from ", file->name(),
+                               ". DO NOT EDIT.\n"));
+        bool lite = file->options().optimize_for() == FileOptions::LITE_RUNTIME;
+        for (const Descriptor* message : FileMessages(file)) {
+            Vars vars = {
+                {"type", RustTypeName(message)},
+                {"full_name", message->full_name()},
+                {"new", Symbol(message, "new")},
+                {"delete", Symbol(message, "delete")},
+            };
+            static const Template* const kMessage = new Template(
+                "\n"
+                "/// The generated C++ class of the message `$full_name$`.\n"
+                "#[allow(non_camel_case_types)]\n"
+                "pub struct $type$ {\n"
+                "    _opaque: ::std::marker::PhantomPinned,\n"
+                "}\n"
+                "\n"
+                "#[allow(improper_ctypes)]\n"
+                "extern \"C\" {\n"
+                "    fn $new$() -> *mut $type$;\n"
+                "    fn $delete$(m: *mut $type$);\n");
+            kMessage->Expand(out, vars);
+            std::vector<const FieldDescriptor*> fields;
+            for (int i = 0; i < message->field_count(); i++) {
+                if (IsWrapped(message->field(i), wrapped)) {
+                    fields.push_back(message->field(i));
+                }
+            }
+            for (const FieldDescriptor* field : fields) {
+                GenerateFieldDeclarations(out, message, field);
+            }
+            static const Template* const kMessageImpl = new Template(
+                "}\n"
+                "\n"
+                "impl $type$ {\n"
+                "    /// Creates a new, empty message.\n"
+                "    pub fn new() -> ::std::pin::Pin<::std::boxed::Box<$type$>> {\n"
+                "        unsafe { ::std::pin::Pin::new_unchecked("
+                "::std::boxed::Box::from_raw($new$())) }\n"
+                "    }\n");
+            kMessageImpl->Expand(out, vars);
+            for (const FieldDescriptor* field : fields) {
+                GenerateFieldAccessors(out, message, field);
+            }
+            static const Template* const kMessageTraits = new Template(
+                "}\n"
+                "\n"
+                "impl ::std::ops::Drop for $type$ {\n"
+                "    fn drop(&mut self) {\n"
+                "        unsafe { $delete$(self) }\n"
+                "    }\n"
+                "}\n"
+                "\n"
+                "impl ::protobuf_native::MessageLite for $type$ {}\n"
+                "\n"
+                "impl ::protobuf_native::__private::MessageLite for $type$ {\n"
+                "    fn upcast(&self) -> &::protobuf_native::__private::FfiMessageLite {\n"
+                "        unsafe { ::std::mem::transmute(self) }\n"
+                "    }\n"
+                "\n"
+                "    fn upcast_mut(\n"
+                "        self: ::std::pin::Pin<&mut Self>,\n"
+                "    ) -> ::std::pin::Pin<&mut ::protobuf_native::__private::FfiMessageLite> {\n"
+                "        unsafe { ::std::mem::transmute(self) }\n"
+                "    }\n"
+                "}\n");
+            kMessageTraits->Expand(out, vars);
+            if (!lite) {
+                static const Template* const kMessageReflection = new Template(
+                    "\n"
+                    "impl ::protobuf_native::Message for $type$ {}\n"
+                    "impl ::protobuf_native::__private::Message for $type$ {}\n");
+                kMessageReflection->Expand(out, vars);
+            }
+        }
+    }
+
+    static void GenerateFieldDeclarations(ChunkWriter& out, const Descriptor* message,
+                                          const FieldDescriptor* field) {
+        Vars vars = FieldVars(message, field);
+        vars["type"] = RustTypeName(message);
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                if (field->is_repeated()) {
+                    static const Template* const kDeclRepeatedString = new Template(
+                        "fn $size$(m: *const $type$) -> usize;\n"
+                        "fn $get$(m: *const $type$, i: usize, len: *mut usize) -> *const "
+                        "u8;\n"
+                        "fn $add$(m: *mut $type$, data: *const u8, len: usize);\n", kIndent);
+                    kDeclRepeatedString->Expand(out, vars);
+                } else {
+                    static const Template* const kDeclString = new Template(
+                        "fn $get$(m: *const $type$, len: *mut usize) -> *const u8;\n"
+                        "fn $set$(m: *mut $type$, data: *const u8, len: usize);\n", kIndent);
+                    kDeclString->Expand(out, vars);
+                }
+                break;
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                if (field->is_repeated()) {
+                    static const Template* const kDeclRepeatedMessage = new Template(
+                        "fn $size$(m: *const $type$) -> usize;\n"
+                        "fn $get$(m: *const $type$, i: usize) -> *const $sub_type$;\n"
+                        "fn $mutable$(m: *mut $type$, i: usize) -> *mut $sub_type$;\n"
+                        "fn $add$(m: *mut $type$) -> *mut $sub_type$;\n", kIndent);
+                    kDeclRepeatedMessage->Expand(out, vars);
+                } else {
+                    static const Template* const kDeclMessage = new Template(
+                        "fn $get$(m: *const $type$) -> *const $sub_type$;\n"
+                        "fn $mutable$(m: *mut $type$) -> *mut $sub_type$;\n", kIndent);
+                    kDeclMessage->Expand(out, vars);
+                }
+                break;
+            default:
+                vars["result"] = IsClosedEnum(field) ? " -> bool" : "";
+                if (field->is_repeated()) {
+                    static const Template* const kDeclRepeatedScalar = new Template(
+                        "fn $get$(m: *const $type$, len: *mut usize) -> *const "
+                        "$rust_type$;\n"
+                        "fn $add$(m: *mut $type$, v: $rust_type$)$result$;\n", kIndent);
+                    kDeclRepeatedScalar->Expand(out, vars);
+                } else {
+                    static const Template* const kDeclScalar = new Template(
+                        "fn $get$(m: *const $type$) -> $rust_type$;\n"
+                        "fn $set$(m: *mut $type$, v: $rust_type$)$result$;\n", kIndent);
+                    kDeclScalar->Expand(out, vars);
+                }
+        }
+        if (field->has_presence()) {
+            static const Template* const kDeclHas = new Template(
+                "fn $has$(m: *const $type$) -> bool;\n", kIndent);
+            kDeclHas->Expand(out, vars);
+        }
+        static const Template* const kDeclClear = new Template(
+            "fn $clear$(m: *mut $type$);\n", kIndent);
+        kDeclClear->Expand(out, vars);
+    }
+
+    static void GenerateFieldAccessors(ChunkWriter& out, const Descriptor* message,
+                                       const FieldDescriptor* field) {
+        Vars vars = FieldVars(message, field);
+        vars["set_name"] = RustIdent(absl::StrCat("set_", field->name()));
+        vars["has_name"] = RustIdent(absl::StrCat("has_", field->name()));
+        vars["clear_name"] = RustIdent(absl::StrCat("clear_", field->name()));
+        vars["mut_name"] = RustIdent(absl::StrCat(field->name(), "_mut"));
+        vars["add_name"] = RustIdent(absl::StrCat("add_", field->name()));
+        vars["len_name"] = RustIdent(absl::StrCat(field->name(), "_len"));
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_STRING:
+                if (field->is_repeated()) {
+                    static const Template* const kRepeatedString = new Template(
+                        "\n"
+                        "/// Returns the number of elements of `$name$`.\n"
+                        "pub fn $len_name$(&self) -> usize {\n"
+                        "    unsafe { $size$(self) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Returns the element of `$name$` at index `i`.\n"
+                        "pub fn $getter$(&self, i: usize) -> &[u8] {\n"
+                        "    let len = self.$len_name$();\n"
+                        "    if i >= len {\n"
+                        "        panic!(\"index out of bounds: the length is {} but the index "
+                        "is {}\", len, i);\n"
+                        "    }\n"
+                        "    let mut len = 0;\n"
+                        "    unsafe { ::std::slice::from_raw_parts($get$(self, i, &mut len), len) "
+                        "}\n"
+                        "}\n"
+                        "\n"
+                        "/// Appends an element to `$name$`.\n"
+                        "pub fn $add_name$(self: ::std::pin::Pin<&mut Self>, v: &[u8]) {\n"
+                        "    unsafe { $add$(self.get_unchecked_mut(), v.as_ptr(), v.len()) }\n"
+                        "}\n", kIndent);
+                    kRepeatedString->Expand(out, vars);
+                } else {
+                    static const Template* const kString = new Template(
+                        "\n"
+                        "/// Returns the value of `$name$`.\n"
+                        "pub fn $getter$(&self) -> &[u8] {\n"
+                        "    let mut len = 0;\n"
+                        "    unsafe { ::std::slice::from_raw_parts($get$(self, &mut len), len) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Sets the value of `$name$`.\n"
+                        "pub fn $set_name$(self: ::std::pin::Pin<&mut Self>, v: &[u8]) {\n"
+                        "    unsafe { $set$(self.get_unchecked_mut(), v.as_ptr(), v.len()) }\n"
+                        "}\n", kIndent);
+                    kString->Expand(out, vars);
+                }
+                break;
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                if (field->is_repeated()) {
+                    static const Template* const kRepeatedMessage = new Template(
+                        "\n"
+                        "/// Returns the number of elements of `$name$`.\n"
+                        "pub fn $len_name$(&self) -> usize {\n"
+                        "    unsafe { $size$(self) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Returns the element of `$name$` at index `i`.\n"
+                        "pub fn $getter$(&self, i: usize) -> &$sub_type$ {\n"
+                        "    let len = self.$len_name$();\n"
+                        "    if i >= len {\n"
+                        "        panic!(\"index out of bounds: the length is {} but the index "
+                        "is {}\", len, i);\n"
+                        "    }\n"
+                        "    unsafe { &*$get$(self, i) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Returns a mutable reference to the element of `$name$` at index `i`.\n"
+                        "pub fn $mut_name$(\n"
+                        "    self: ::std::pin::Pin<&mut Self>,\n"
+                        "    i: usize,\n"
+                        ") -> ::std::pin::Pin<&mut $sub_type$> {\n"
+                        "    let len = self.$len_name$();\n"
+                        "    if i >= len {\n"
+                        "        panic!(\"index out of bounds: the length is {} but the index "
+                        "is {}\", len, i);\n"
+                        "    }\n"
+                        "    unsafe { ::std::pin::Pin::new_unchecked(&mut *$mutable$("
+                        "self.get_unchecked_mut(), i)) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Appends a new, empty element to `$name$` and returns it.\n"
+                        "pub fn $add_name$(self: ::std::pin::Pin<&mut Self>) -> "
+                        "::std::pin::Pin<&mut $sub_type$> {\n"
+                        "    unsafe { ::std::pin::Pin::new_unchecked(&mut *$add$("
+                        "self.get_unchecked_mut())) }\n"
+                        "}\n", kIndent);
+                    kRepeatedMessage->Expand(out, vars);
+                } else {
+                    static const Template* const kMessageField = new Template(
+                        "\n"
+                        "/// Returns the value of `$name$`, or the default instance if it is "
+                        "unset.\n"
+                        "pub fn $getter$(&self) -> &$sub_type$ {\n"
+                        "    unsafe { &*$get$(self) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Returns a mutable reference to `$name$`, setting it if it is unset.\n"
+                        "pub fn $mut_name$(self: ::std::pin::Pin<&mut Self>) -> "
+                        "::std::pin::Pin<&mut $sub_type$> {\n"
+                        "    unsafe { ::std::pin::Pin::new_unchecked(&mut *$mutable$("
+                        "self.get_unchecked_mut())) }\n"
+                        "}\n", kIndent);
+                    kMessageField->Expand(out, vars);
+                }
+                break;
+            default:
+                if (field->is_repeated()) {
+                    static const Template* const kRepeatedScalar = new Template(
+                        "\n"
+                        "/// Returns the elements of `$name$`.\n"
+                        "pub fn $getter$(&self) -> &[$rust_type$] {\n"
+                        "    let mut len = 0;\n"
+                        "    let data = unsafe { $get$(self, &mut len) };\n"
+                        "    if len == 0 {\n"
+                        "        return &[];\n"
+                        "    }\n"
+                        "    unsafe { ::std::slice::from_raw_parts(data, len) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Appends an element to `$name$`.\n", kIndent);
+                    kRepeatedScalar->Expand(out, vars);
+                    GenerateScalarSetter(out, vars, field, "add_name", "add");
+                } else {
+                    static const Template* const kScalar = new Template(
+                        "\n"
+                        "/// Returns the value of `$name$`.\n"
+                        "pub fn $getter$(&self) -> $rust_type$ {\n"
+                        "    unsafe { $get$(self) }\n"
+                        "}\n"
+                        "\n"
+                        "/// Sets the value of `$name$`.\n", kIndent);
+                    kScalar->Expand(out, vars);
+                    GenerateScalarSetter(out, vars, field, "set_name", "set");
+                }
+        }
+        if (field->has_presence()) {
+            static const Template* const kHas = new Template(
+                "\n"
+                "/// Reports whether `$name$` is set.\n"
+                "pub fn $has_name$(&self) -> bool {\n"
+                "    unsafe { $has$(self) }\n"
+                "}\n", kIndent);
+            kHas->Expand(out, vars);
+        }
+        static const Template* const kClear = new Template(
+            "\n"
+            "/// Clears `$name$`.\n"
+            "pub fn $clear_name$(self: ::std::pin::Pin<&mut Self>) {\n"
+            "    unsafe { $clear$(self.get_unchecked_mut()) }\n"
+            "}\n", kIndent);
+        kClear->Expand(out, vars);
+    }
+
+    // Closed enums reject unknown values, which the shim reports rather than
+    // storing, so that the Rust wrapper can panic like the C++ accessor's
+    // debug check.
+    static void GenerateScalarSetter(ChunkWriter& out, Vars vars, const FieldDescriptor* field,
+                                     const std::string& name, const std::string& symbol) {
+        vars["method"] = vars[name];
+        vars["symbol"] = vars[symbol];
+        if (IsClosedEnum(field)) {
+            static const Template* const kClosedEnumSetter = new Template(
+                "///\n"
+                "/// # Panics\n"
+                "///\n"
+                "/// Panics if `v` is not a value of the enum.\n"
+                "pub fn $method$(self: ::std::pin::Pin<&mut Self>, v: $rust_type$) {\n"
+                "    if !unsafe { $symbol$(self.get_unchecked_mut(), v) } {\n"
+                "        panic!(\"invalid value {} for closed enum field "
+                "$full_name$\", v);\n"
+                "    }\n"
+                "}\n", kIndent);
+            kClosedEnumSetter->Expand(out, vars);
+        } else {
+            static const Template* const kSetter = new Template(
+                "pub fn $method$(self: ::std::pin::Pin<&mut Self>, v: $rust_type$) {\n"
+                "    unsafe { $symbol$(self.get_unchecked_mut(), v) }\n"
+                "}\n", kIndent);
+            kSetter->Expand(out, vars);
+        }
+    }
+
+    static void GenerateIndex(const std::vector<const FileDescriptor*>& files,
+                              GeneratorContext* context) {
+        // Group the files by package, so that each package is one module.
+        std::map<std::vector<std::string>, std::vector<std::string>> packages;
+        for (const FileDescriptor* file : files) {
+            packages[PackageModules(file)].push_back(compiler::StripProto(file->name()) + ".pb.rs");
+        }
+        std::unique_ptr<ZeroCopyOutputStream> output(context->Open("protobuf_native.rs"));
+        ChunkWriter out(output.get());
+        out.Write("// Generated by protobuf-native. DO NOT EDIT.\n\n");
+        std::vector<std::string> open;
+        for (const auto& package : packages) {
+            const std::vector<std::string>& modules = package.first;
+            size_t common = 0;
+            while (common < open.size() && common < modules.size() &&
+                   open[common] == modules[common]) {
+                common++;
+            }
+            for (; open.size() > common; open.pop_back()) {
+                out.Write(absl::StrCat(std::string(4 * (open.size() - 1), ' '), "}\n"));
+            }
+            for (; open.size() < modules.size(); open.push_back(modules[open.size()])) {
+                std::string indent(4 * open.size(), ' ');
+                out.Write(absl::StrCat(indent, "#[allow(non_snake_case)]\n", indent, "pub mod ",
+                                       modules[open.size()], " {\n"));
+            }
+            for (const std::string& include : package.second) {
+                out.Write(absl::StrCat(std::string(4 * open.size(), ' '), "include!(\"", include,
+                                       "\");\n"));
+            }
+        }
+        for (; !open.empty(); open.pop_back()) {
+            out.Write(absl::StrCat(std::string(4 * (open.size() - 1), ' '), "}\n"));
+        }
+    }
+};
+
+}  // namespace
+
+CodeGenerator* NewRustWrapperGenerator() { return new RustWrapperGenerator(); }
+
+Protoc::Protoc() {
+    struct Registration {
+        const char* flag_name;
+        const char* option_flag_name;
+        int language;
+        const char* help_text;
+    };
+    // As registered by protoc's main.
+    static const Registration kGenerators[] = {
+        {"--cpp_out", "--cpp_opt", 0, "Generate C++ header and source."},
+        {"--csharp_out", "--csharp_opt", 1, "Generate C# source file."},
+        {"--java_out", "--java_opt", 2, "Generate Java source file."},
+        {"--kotlin_out", "--kotlin_opt", 3, "Generate Kotlin file."},
+        {"--objc_out", "--objc_opt", 4, "Generate Objective-C header and source."},
+        {"--php_out", "--php_opt", 5, "Generate PHP source file."},
+        {"--python_out", "--python_opt", 6, "Generate Python source file."},
+        {"--pyi_out", nullptr, 7, "Generate python pyi stub."},
+        {"--ruby_out", "--ruby_opt", 8, "Generate Ruby source file."},
+        {"--rust_out", "--rust_opt", 9, "Generate Rust sources."},
+    };
+    for (const Registration& registration : kGenerators) {
+        generators_.emplace_back(NewCodeGenerator(registration.language));
+        if (registration.option_flag_name == nullptr) {
+            cli_.RegisterGenerator(registration.flag_name, generators_.back().get(),
+                                   registration.help_text);
+        } else {
+            cli_.RegisterGenerator(registration.flag_name, registration.option_flag_name,
+                                   generators_.back().get(), registration.help_text);
+        }
+    }
+}
+
+void Protoc::AllowPlugins(rust::Str exe_name_prefix) {
+    cli_.AllowPlugins(std::string(exe_name_prefix));
+}
+
+int Protoc::Run(rust::Slice<const uint8_t> args) {
+    std::vector<const char*> argv = {"protoc"};
+    const char* data = reinterpret_cast<const char*>(args.data());
+    for (size_t i = 0; i < args.size(); i += strlen(data + i) + 1) {
+        argv.push_back(data + i);
+    }
+    return cli_.Run(static_cast<int>(argv.size()), argv.data());
+}
+
+Protoc* NewProtoc() { return new Protoc(); }
+
+void DeleteProtoc(Protoc* protoc) { delete protoc; }
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+namespace {
+
+// January 1, 1980 as a DOS date, as written by compiler::ZipWriter.
+constexpr uint16_t kDosEpoch = 1 << 5 | 1;
+
+// Entry names are UTF-8, as Rust strings are.
+constexpr uint16_t kUtf8Flag = 1 << 11;
+
+constexpr uint16_t kStored = 0;
+constexpr uint16_t kDeflated = 8;
+
+// zlib counts bytes in unsigned ints, so longer inputs are fed to it in
+// chunks.
+constexpr size_t kZlibChunk = 1 << 30;
+
+void WriteShort(CodedOutputStream& output, uint16_t value) {
+    uint8_t bytes[2] = {static_cast<uint8_t>(value), static_cast<uint8_t>(value >> 8)};
+    output.WriteRaw(bytes, 2);
+}
+
+uint16_t VersionNeeded(uint16_t method) { return method == kDeflated ? 20 : 10; }
+
+// Deflates `contents` into `output`, or fails if the output would not be
+// smaller than the input, which is then stored instead.
+bool Deflate(rust::Slice<const uint8_t> contents, int level, rust::Vec<uint8_t>& output) {
+    z_stream stream = {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    output.reserve(contents.size());
+    const uint8_t* in = contents.data();
+    size_t in_left = contents.size();
+    stream.next_out = output.data();
+    size_t out_left = contents.size();
+    int result;
+    do {
+        if (stream.avail_in == 0) {
+            size_t chunk = std::min(in_left, kZlibChunk);
+            stream.next_in = const_cast<Bytef*>(in);
+            stream.avail_in = static_cast<uInt>(chunk);
+            in += chunk;
+            in_left -= chunk;
+        }
+        if (stream.avail_out == 0) {
+            size_t chunk = std::min(out_left, kZlibChunk);
+            if (chunk == 0) {
+                break;
+            }
+            stream.avail_out = static_cast<uInt>(chunk);
+            out_left -= chunk;
+        }
+        result = deflate(&stream, in_left == 0 ? Z_FINISH : Z_NO_FLUSH);
+    } while (result == Z_OK || result == Z_BUF_ERROR);
+    size_t out_len = contents.size() - out_left - stream.avail_out;
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        return false;
+    }
+    vec_u8_set_len(output, out_len);
+    return true;
+}
+
+}  // namespace
+
+void CompressZipEntry(rust::Slice<const uint8_t> contents, int level, ZipEntry& entry) {
+    uLong crc = crc32(0, nullptr, 0);
+    for (size_t i = 0; i < contents.size(); i += kZlibChunk) {
+        size_t len = std::min(contents.size() - i, kZlibChunk);
+        crc = crc32(crc, contents.data() + i, static_cast<uInt>(len));
+    }
+    entry.crc32 = static_cast<uint32_t>(crc);
+    entry.size = contents.size();
+    entry.data.clear();
+    if (level != 0 && !contents.empty() && Deflate(contents, level, entry.data)) {
+        entry.method = kDeflated;
+        return;
+    }
+    entry.method = kStored;
+    entry.data.clear();
+    entry.data.reserve(contents.size());
+    memcpy(entry.data.data(), contents.data(), contents.size());
+    vec_u8_set_len(entry.data, contents.size());
+}
+
+bool ZipWriter::Write(const ZipEntry& entry) {
+    uint64_t offset = output_->ByteCount();
+    if (files_.size() >= UINT16_MAX || entry.name.size() > UINT16_MAX || offset > UINT32_MAX ||
+        entry.size > UINT32_MAX || entry.data.size() > UINT32_MAX) {
+        return false;
+    }
+    FileInfo info;
+    info.name = std::string(entry.name);
+    info.method = entry.method;
+    info.crc32 = entry.crc32;
+    info.compressed_size = static_cast<uint32_t>(entry.data.size());
+    info.size = static_cast<uint32_t>(entry.size);
+    info.offset = static_cast<uint32_t>(offset);
+
+    CodedOutputStream output(output_);
+    output.WriteLittleEndian32(0x04034b50);                    // magic
+    WriteShort(output, VersionNeeded(info.method));            // version needed to extract
+    WriteShort(output, kUtf8Flag);                             // flags
+    WriteShort(output, info.method);                           // compression method
+    WriteShort(output, 0);                                     // last modified time
+    WriteShort(output, kDosEpoch);                             // last modified date
+    output.WriteLittleEndian32(info.crc32);                    // crc-32
+    output.WriteLittleEndian32(info.compressed_size);          // compressed size
+    output.WriteLittleEndian32(info.size);                     // uncompressed size
+    WriteShort(output, info.name.size());                      // file name length
+    WriteShort(output, 0);                                     // extra field length
+    output.WriteString(info.name);                             // file name
+    output.WriteRaw(entry.data.data(), info.compressed_size);  // file data
+    files_.push_back(std::move(info));
+    return !output.HadError();
+}
+
+bool ZipWriter::Finish() {
+    uint64_t dir_offset = output_->ByteCount();
+    if (dir_offset > UINT32_MAX) {
+        return false;
+    }
+
+    CodedOutputStream output(output_);
+    for (const FileInfo& info : files_) {
+        output.WriteLittleEndian32(0x02014b50);            // magic
+        WriteShort(output, VersionNeeded(info.method));    // version made by
+        WriteShort(output, VersionNeeded(info.method));    // version needed to extract
+        WriteShort(output, kUtf8Flag);                     // flags
+        WriteShort(output, info.method);                   // compression method
+        WriteShort(output, 0);                             // last modified time
+        WriteShort(output, kDosEpoch);                     // last modified date
+        output.WriteLittleEndian32(info.crc32);            // crc-32
+        output.WriteLittleEndian32(info.compressed_size);  // compressed size
+        output.WriteLittleEndian32(info.size);             // uncompressed size
+        WriteShort(output, info.name.size());              // file name length
+        WriteShort(output, 0);                             // extra field length
+        WriteShort(output, 0);                             // file comment length
+        WriteShort(output, 0);                             // starting disk number
+        WriteShort(output, 0);                             // internal file attributes
+        output.WriteLittleEndian32(0);                     // external file attributes
+        output.WriteLittleEndian32(info.offset);           // local header offset
+        output.WriteString(info.name);                     // file name
+    }
+    uint64_t dir_len = output.ByteCount();
+    if (dir_len > UINT32_MAX) {
+        return false;
+    }
+
+    output.WriteLittleEndian32(0x06054b50);                         // magic
+    WriteShort(output, 0);                                          // disk number
+    WriteShort(output, 0);                                          // disk with central directory
+    WriteShort(output, files_.size());                              // entries on this disk
+    WriteShort(output, files_.size());                              // entries in total
+    output.WriteLittleEndian32(static_cast<uint32_t>(dir_len));     // central directory size
+    output.WriteLittleEndian32(static_cast<uint32_t>(dir_offset));  // central directory offset
+    WriteShort(output, 0);                                          // comment length
+    return !output.HadError();
+}
+
+ZipWriter* NewZipWriter(ZeroCopyOutputStream* output, int level) {
+    return new ZipWriter(output, level);
+}
+
+void DeleteZipWriter(ZipWriter* writer) { delete writer; }
+#endif
+
+}  // namespace protoc
+}  // namespace protobuf_native
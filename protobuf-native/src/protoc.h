@@ -0,0 +1,118 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/compiler/code_generator.h"
+#include "google/protobuf/compiler/command_line_interface.h"
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace protoc {
+
+using google::protobuf::FileDescriptor;
+using google::protobuf::compiler::CodeGenerator;
+using google::protobuf::compiler::CommandLineInterface;
+using google::protobuf::io::ZeroCopyOutputStream;
+
+struct GeneratedFile;
+
+// The code generators built into protoc, in the order of the `Language` enum
+// in protoc.rs.
+CodeGenerator* NewCodeGenerator(int language);
+void DeleteCodeGenerator(CodeGenerator* generator);
+CodeGenerator* NewRustWrapperGenerator();
+bool CodeGeneratorGenerate(const CodeGenerator& generator, const FileDescriptor* const* files,
+                           size_t len, rust::Str parameter, rust::Vec<GeneratedFile>& output,
+                           rust::String& error);
+// Like CodeGeneratorGenerate, but generates code only for `files[index]`,
+// while listing all of `files` as parsed, as they would be by protoc.
+bool CodeGeneratorGenerateFile(const CodeGenerator& generator, const FileDescriptor* const* files,
+                               size_t len, size_t index, rust::Str parameter,
+                               rust::Vec<GeneratedFile>& output, rust::String& error);
+
+// A CommandLineInterface with every built-in code generator registered under
+// the same flags as in protoc.
+class Protoc {
+   public:
+    Protoc();
+
+    void AllowPlugins(rust::Str exe_name_prefix);
+    // Runs protoc with `args`, each terminated by a NUL byte, excluding the
+    // program name.
+    int Run(rust::Slice<const uint8_t> args);
+
+   private:
+    CommandLineInterface cli_;
+    std::vector<std::unique_ptr<CodeGenerator>> generators_;
+};
+
+Protoc* NewProtoc();
+void DeleteProtoc(Protoc* protoc);
+
+#ifdef PROTOBUF_NATIVE_ZLIB
+struct ZipEntry;
+
+// Compresses `contents` with raw deflate at `level`, from 0 to 9 or -1 for
+// zlib's default, for an entry of a zip archive. Stores `contents` as is if
+// `level` is 0 or compression does not make it smaller. May run on any
+// thread.
+void CompressZipEntry(rust::Slice<const uint8_t> contents, int level, ZipEntry& entry);
+
+// Writes a zip archive to a ZeroCopyOutputStream one entry at a time, as
+// compiler::ZipWriter does, but with entries that CompressZipEntry has
+// already compressed. Only the names and offsets of the entries are kept in
+// memory, for the central directory. Archives that need ZIP64 extensions,
+// with over 65535 entries or 4 GiB of data, cannot be written.
+class ZipWriter {
+   public:
+    // `level` is the compression level of the entries, which the writer
+    // only records for the caller of CompressZipEntry.
+    ZipWriter(ZeroCopyOutputStream* output, int level) : output_(output), level_(level) {}
+
+    int CompressionLevel() const { return level_; }
+    bool Write(const ZipEntry& entry);
+    // Writes the central directory. No entries may be written afterwards.
+    bool Finish();
+
+   private:
+    struct FileInfo {
+        std::string name;
+        uint16_t method;
+        uint32_t crc32;
+        uint32_t compressed_size;
+        uint32_t size;
+        uint32_t offset;
+    };
+
+    ZeroCopyOutputStream* output_;
+    int level_;
+    std::vector<FileInfo> files_;
+};
+
+ZipWriter* NewZipWriter(ZeroCopyOutputStream* output, int level);
+void DeleteZipWriter(ZipWriter* writer);
+#endif
+
+}  // namespace protoc
+}  // namespace protobuf_native
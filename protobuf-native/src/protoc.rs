@@ -0,0 +1,721 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! In-process code generation with protoc's code generators.
+//!
+//! Running protoc once per invocation from a build script pays for process
+//! startup and for parsing every input and imported file each time. With this
+//! module, a build script can instead parse its files once, into a
+//! [`DescriptorPool`](crate::DescriptorPool) backed by a
+//! [`SourceTreeDescriptorDatabase`](crate::compiler::SourceTreeDescriptorDatabase),
+//! say, and run any number of [`CodeGenerator`]s over the resulting
+//! [`FileDescriptor`]s. Generated files are collected in memory and written by
+//! [`GeneratedFile::write_to`], which leaves files whose contents have not
+//! changed untouched.
+//! `CodeGenerator::generate_zip` instead streams the generated files into a
+//! compressed zip archive through a `ZipWriter`, for bundles too large to
+//! hold in memory; both are only available if the `zlib` feature is also
+//! enabled.
+//!
+//! ```ignore
+//! use protobuf_native::compiler::{DiskSourceTree, SourceTreeDescriptorDatabase};
+//! use protobuf_native::protoc::{CodeGenerator, Language};
+//! use protobuf_native::DescriptorPool;
+//!
+//! let mut source_tree = DiskSourceTree::new();
+//! source_tree.as_mut().map_path("", "proto");
+//! let mut database = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+//! let pool = DescriptorPool::with_database(database.as_mut());
+//! let files = [pool.find_file_by_name("foo.proto".as_ref()).unwrap()];
+//! let out_dir = std::env::var_os("OUT_DIR").unwrap();
+//! for language in [Language::Cpp, Language::Python] {
+//!     for file in CodeGenerator::new(language).generate(&files, "")? {
+//!         file.write_to(out_dir.as_ref())?;
+//!     }
+//! }
+//! ```
+//!
+//! [`CommandLineInterface`] runs protoc itself in-process, parsing its
+//! arguments exactly as the protoc binary does.
+//!
+//! Files that use editions are generated with the feature defaults of the pool
+//! that contains them, rather than with defaults computed for the generator's
+//! language features as protoc does.
+//!
+//! # Typed wrappers
+//!
+//! [`CodeGenerator::rust_wrappers`] generates Rust types for the C++ classes
+//! that [`Language::Cpp`] generates, with an accessor for every field that
+//! calls the generated C++ accessor directly, with no reflection. A build
+//! script generates both, compiles the C++ with the [`cc`] crate against the
+//! headers at [`include`], and includes the generated Rust:
+//!
+//! ```ignore
+//! // build.rs
+//! let out_dir = PathBuf::from(env::var_os("OUT_DIR").unwrap());
+//! let mut files = CodeGenerator::new(Language::Cpp).generate(&descriptors, "")?;
+//! files.extend(CodeGenerator::rust_wrappers().generate(&descriptors, "")?);
+//! protoc::write_files(&files, &out_dir, 4)?;
+//! let mut build = cc::Build::new();
+//! build.cpp(true).std("c++14").include(&out_dir).include(protoc::include());
+//! for file in &files {
+//!     if file.name.ends_with(".cc") {
+//!         build.file(out_dir.join(&file.name));
+//!     }
+//! }
+//! build.compile("protos");
+//!
+//! // lib.rs
+//! include!(concat!(env!("OUT_DIR"), "/protobuf_native.rs"));
+//! ```
+//!
+//! Each package becomes a module, so the message `foo.bar.Baz` is
+//! `foo::bar::Baz`, and a nested message `Baz.Qux` is `Baz_Qux`, as in C++.
+//! The wrappers implement [`MessageLite`](crate::MessageLite), and, unless the
+//! file is optimized for the lite runtime, [`Message`](crate::Message), so
+//! they can be serialized, parsed and inspected with reflection like any
+//! other message. Map fields, and string fields whose C++ type is not
+//! `std::string`, have no accessors.
+//!
+//! [`cc`]: https://docs.rs/cc
+//!
+//! This module is only available if the `protoc` feature is enabled.
+
+#[cfg(feature = "zlib")]
+use std::collections::{BTreeMap, HashSet};
+use std::error::Error;
+use std::ffi::OsStr;
+use std::fmt;
+use std::fs;
+use std::io;
+#[cfg(feature = "zlib")]
+use std::marker::PhantomData;
+use std::marker::PhantomPinned;
+use std::path::{Path, PathBuf};
+use std::pin::Pin;
+use std::sync::atomic::{AtomicUsize, Ordering};
+#[cfg(feature = "zlib")]
+use std::sync::mpsc;
+use std::thread;
+
+#[cfg(feature = "zlib")]
+use crate::internal::BoolExt;
+use crate::internal::{unsafe_ffi_conversions, CInt, ProtobufPath};
+#[cfg(feature = "zlib")]
+use crate::io::ZeroCopyOutputStream;
+use crate::{FileDescriptor, OperationFailedError};
+
+#[cxx::bridge(namespace = "protobuf_native::protoc")]
+pub(crate) mod ffi {
+    struct GeneratedFile {
+        name: String,
+        contents: Vec<u8>,
+    }
+
+    #[cfg(feature = "zlib")]
+    struct ZipEntry {
+        name: String,
+        method: u16,
+        crc32: u32,
+        size: u64,
+        data: Vec<u8>,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/protoc.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "protobuf_native::internal"]
+        type CInt = crate::internal::CInt;
+
+        #[namespace = "google::protobuf"]
+        type FileDescriptor = crate::ffi::FileDescriptor;
+
+        #[cfg(feature = "zlib")]
+        #[namespace = "google::protobuf::io"]
+        type ZeroCopyOutputStream = crate::io::ffi::ZeroCopyOutputStream;
+
+        #[namespace = "google::protobuf::compiler"]
+        type CodeGenerator;
+        fn NewCodeGenerator(language: CInt) -> *mut CodeGenerator;
+        unsafe fn DeleteCodeGenerator(generator: *mut CodeGenerator);
+        fn NewRustWrapperGenerator() -> *mut CodeGenerator;
+        unsafe fn CodeGeneratorGenerate(
+            generator: &CodeGenerator,
+            files: *const *const FileDescriptor,
+            len: usize,
+            parameter: &str,
+            output: &mut Vec<GeneratedFile>,
+            error: &mut String,
+        ) -> bool;
+        unsafe fn CodeGeneratorGenerateFile(
+            generator: &CodeGenerator,
+            files: *const *const FileDescriptor,
+            len: usize,
+            index: usize,
+            parameter: &str,
+            output: &mut Vec<GeneratedFile>,
+            error: &mut String,
+        ) -> bool;
+
+        type Protoc;
+        fn NewProtoc() -> *mut Protoc;
+        unsafe fn DeleteProtoc(protoc: *mut Protoc);
+        fn AllowPlugins(self: Pin<&mut Protoc>, exe_name_prefix: &str);
+        fn Run(self: Pin<&mut Protoc>, args: &[u8]) -> CInt;
+
+        #[cfg(feature = "zlib")]
+        fn CompressZipEntry(contents: &[u8], level: CInt, entry: &mut ZipEntry);
+
+        #[cfg(feature = "zlib")]
+        type ZipWriter;
+        #[cfg(feature = "zlib")]
+        unsafe fn NewZipWriter(output: *mut ZeroCopyOutputStream, level: CInt) -> *mut ZipWriter;
+        #[cfg(feature = "zlib")]
+        unsafe fn DeleteZipWriter(writer: *mut ZipWriter);
+        #[cfg(feature = "zlib")]
+        fn CompressionLevel(self: &ZipWriter) -> CInt;
+        #[cfg(feature = "zlib")]
+        fn Write(self: Pin<&mut ZipWriter>, entry: &ZipEntry) -> bool;
+        #[cfg(feature = "zlib")]
+        fn Finish(self: Pin<&mut ZipWriter>) -> bool;
+    }
+}
+
+/// The languages of the code generators built into protoc.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum Language {
+    /// C++, as generated by `--cpp_out`.
+    Cpp,
+    /// C#, as generated by `--csharp_out`.
+    CSharp,
+    /// Java, as generated by `--java_out`.
+    Java,
+    /// Kotlin, as generated by `--kotlin_out`.
+    Kotlin,
+    /// Objective-C, as generated by `--objc_out`.
+    ObjectiveC,
+    /// PHP, as generated by `--php_out`.
+    Php,
+    /// Python, as generated by `--python_out`.
+    Python,
+    /// Python type stubs, as generated by `--pyi_out`.
+    Pyi,
+    /// Ruby, as generated by `--ruby_out`.
+    Ruby,
+    /// Rust, for the official protobuf crate, as generated by `--rust_out`.
+    Rust,
+}
+
+/// Returns the directory that contains the headers of libprotobuf, against
+/// which the C++ code generated by [`Language::Cpp`] compiles.
+pub fn include() -> PathBuf {
+    protobuf_src::include()
+}
+
+/// A code generator.
+pub struct CodeGenerator {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for CodeGenerator {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteCodeGenerator(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl CodeGenerator {
+    /// Creates the code generator for `language`.
+    pub fn new(language: Language) -> Pin<Box<CodeGenerator>> {
+        let language = match language {
+            Language::Cpp => 0,
+            Language::CSharp => 1,
+            Language::Java => 2,
+            Language::Kotlin => 3,
+            Language::ObjectiveC => 4,
+            Language::Php => 5,
+            Language::Python => 6,
+            Language::Pyi => 7,
+            Language::Ruby => 8,
+            Language::Rust => 9,
+        };
+        let generator = ffi::NewCodeGenerator(CInt(language));
+        unsafe { Self::from_ffi_owned(generator) }
+    }
+
+    /// Creates the code generator for typed Rust wrappers around the C++
+    /// classes generated by [`Language::Cpp`].
+    ///
+    /// For each file `foo.proto`, the generator writes `foo.pb.rs`, which
+    /// defines the wrappers, and `foo.pb.rs.cc`, which defines the C++
+    /// functions that they call. It also writes `protobuf_native.rs`, which
+    /// includes every `.pb.rs` file in a module for its package. Fields of
+    /// message types are only accessible if code is generated for the file
+    /// that defines the type. The generator takes no parameter. See the
+    /// [module documentation](self) for how a build script uses it.
+    pub fn rust_wrappers() -> Pin<Box<CodeGenerator>> {
+        let generator = ffi::NewRustWrapperGenerator();
+        unsafe { Self::from_ffi_owned(generator) }
+    }
+
+    /// Generates code for `files`, as protoc does for the files named on its
+    /// command line, and returns the generated files.
+    ///
+    /// `parameter` is the generator's parameter, a comma-separated list of
+    /// options, as passed to protoc in `--<lang>_opt` or before the colon in
+    /// `--<lang>_out`. The files that `files` import must be in the same pool,
+    /// but need not be included in `files` unless code is to be generated for
+    /// them too.
+    ///
+    /// Returns an error if the generator reports one, or if it writes to an
+    /// insertion point, which is only possible when the file it inserts into
+    /// is written by a separate invocation to a shared output directory.
+    pub fn generate(
+        &self,
+        files: &[&FileDescriptor],
+        parameter: &str,
+    ) -> Result<Vec<GeneratedFile>, GenerateError> {
+        let mut output = vec![];
+        let mut error = String::new();
+        let ok = unsafe {
+            ffi::CodeGeneratorGenerate(
+                self.as_ffi(),
+                files.as_ptr().cast(),
+                files.len(),
+                parameter,
+                &mut output,
+                &mut error,
+            )
+        };
+        match ok {
+            true => Ok(output.into_iter().map(GeneratedFile::from).collect()),
+            false => Err(GenerateError(error)),
+        }
+    }
+
+    /// Like [`CodeGenerator::generate`], but generates code for each of
+    /// `files` separately, on up to `threads` threads.
+    ///
+    /// Files are handed out to the threads one at a time, so that a few large
+    /// files do not hold up the rest. The generated files are returned sorted
+    /// by name, as by `generate`. If code generation fails for several files,
+    /// the error for the first of them in `files` is returned.
+    ///
+    /// The output is the same as that of `generate` as long as the generator
+    /// generates each file independently of the others, as the built-in
+    /// generators do. Every invocation still sees all of `files` as the files
+    /// being generated. The Python generator serializes its invocations
+    /// internally and so gains nothing from more threads.
+    ///
+    /// # Panics
+    ///
+    /// Panics if a code generator thread panics.
+    pub fn generate_parallel(
+        &self,
+        files: &[&FileDescriptor],
+        parameter: &str,
+        threads: usize,
+    ) -> Result<Vec<GeneratedFile>, GenerateError> {
+        let threads = threads.clamp(1, files.len().max(1));
+        let next = AtomicUsize::new(0);
+        let mut results: Vec<_> = thread::scope(|s| {
+            let workers: Vec<_> = (0..threads)
+                .map(|_| {
+                    s.spawn(|| {
+                        let mut results = vec![];
+                        loop {
+                            let i = next.fetch_add(1, Ordering::Relaxed);
+                            if i >= files.len() {
+                                break results;
+                            }
+                            results.push((i, self.generate_file(files, i, parameter)));
+                        }
+                    })
+                })
+                .collect();
+            workers
+                .into_iter()
+                .flat_map(|worker| worker.join().expect("code generator thread panicked"))
+                .collect()
+        });
+        results.sort_by_key(|(i, _)| *i);
+
+        let mut generated = vec![];
+        for (_, result) in results {
+            let output = result.map_err(GenerateError)?;
+            generated.extend(output.into_iter().map(GeneratedFile::from));
+        }
+        generated.sort_by(|a, b| a.name.cmp(&b.name));
+        if let Some(pair) = generated
+            .windows(2)
+            .find(|pair| pair[0].name == pair[1].name)
+        {
+            return Err(GenerateError::duplicate(&pair[0].name));
+        }
+        Ok(generated)
+    }
+
+    /// Like [`CodeGenerator::generate_parallel`], but compresses the
+    /// generated files and writes them to `zip` rather than returning them.
+    ///
+    /// The files generated for each of `files` are written, in order of name,
+    /// as soon as code has been generated for it and for every file that
+    /// precedes it in `files`, and are then released, so that only the output
+    /// for a few files at a time is held in memory. The entries are
+    /// compressed on the code generator threads.
+    ///
+    /// If code generation or writing fails, the files generated for the files
+    /// that precede the failing one are already written to `zip`. The archive
+    /// is not finished, so that further files can be added to it; see
+    /// [`ZipWriter::finish`].
+    ///
+    /// This method is only available if the `zlib` feature is enabled.
+    ///
+    /// # Panics
+    ///
+    /// Panics if a code generator thread panics.
+    #[cfg(feature = "zlib")]
+    pub fn generate_zip(
+        &self,
+        files: &[&FileDescriptor],
+        parameter: &str,
+        threads: usize,
+        mut zip: Pin<&mut ZipWriter>,
+    ) -> Result<(), GenerateError> {
+        let threads = threads.clamp(1, files.len().max(1));
+        let level = zip.as_ffi().CompressionLevel();
+        let next = AtomicUsize::new(0);
+        // Bounding the channel stops the threads from running ahead of a
+        // slow output stream.
+        let (sender, receiver) = mpsc::sync_channel(threads);
+        thread::scope(|s| {
+            for _ in 0..threads {
+                let sender = sender.clone();
+                let next = &next;
+                s.spawn(move || loop {
+                    let i = next.fetch_add(1, Ordering::Relaxed);
+                    if i >= files.len() {
+                        break;
+                    }
+                    let entries = self.generate_file(files, i, parameter).map(|output| {
+                        output
+                            .iter()
+                            .map(|file| compress_zip_entry(&file.name, &file.contents, level))
+                            .collect::<Vec<_>>()
+                    });
+                    // The receiver is only dropped once writing has failed.
+                    if sender.send((i, entries)).is_err() {
+                        break;
+                    }
+                });
+            }
+            drop(sender);
+
+            let mut pending = BTreeMap::new();
+            let mut names = HashSet::new();
+            let mut written = 0;
+            for (i, entries) in receiver {
+                pending.insert(i, entries);
+                while let Some(entries) = pending.remove(&written) {
+                    written += 1;
+                    for entry in entries.map_err(GenerateError)? {
+                        if !names.insert(entry.name.clone()) {
+                            return Err(GenerateError::duplicate(&entry.name));
+                        }
+                        if !zip.as_mut().as_ffi_mut().Write(&entry) {
+                            return Err(GenerateError(format!(
+                                "{}: Failed to write to the zip archive.",
+                                entry.name
+                            )));
+                        }
+                    }
+                }
+            }
+            Ok(())
+        })
+    }
+
+    fn generate_file(
+        &self,
+        files: &[&FileDescriptor],
+        index: usize,
+        parameter: &str,
+    ) -> Result<Vec<ffi::GeneratedFile>, String> {
+        let mut output = vec![];
+        let mut error = String::new();
+        let ok = unsafe {
+            ffi::CodeGeneratorGenerateFile(
+                self.as_ffi(),
+                files.as_ptr().cast(),
+                files.len(),
+                index,
+                parameter,
+                &mut output,
+                &mut error,
+            )
+        };
+        match ok {
+            true => Ok(output),
+            false => Err(error),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::CodeGenerator);
+}
+
+/// Writes files to a zip archive, as protoc does for an output location
+/// whose name ends in `.zip`, but with compressed entries.
+///
+/// Each entry is written to the underlying stream as soon as it is added, so
+/// that only the name and offset of each entry are held in memory. The
+/// archive is complete once [`finish`](ZipWriter::finish) writes its central
+/// directory. Entries are compressed with raw deflate, and stored as is if
+/// compression does not make them smaller. Archives that would need ZIP64
+/// extensions, with more than 65,534 entries or more than 4 GiB of data,
+/// cannot be written.
+///
+/// This type is only available if the `zlib` feature is enabled.
+#[cfg(feature = "zlib")]
+pub struct ZipWriter<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+#[cfg(feature = "zlib")]
+impl<'a> Drop for ZipWriter<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteZipWriter(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+#[cfg(feature = "zlib")]
+impl<'a> ZipWriter<'a> {
+    /// Creates a `ZipWriter` that writes to `output` with zlib's default
+    /// compression level.
+    pub fn new(output: Pin<&'a mut dyn ZeroCopyOutputStream>) -> Pin<Box<ZipWriter<'a>>> {
+        Self::with_level(output, CInt(-1))
+    }
+
+    /// Creates a `ZipWriter` that writes to `output` with the given
+    /// compression level, from 0, which stores entries uncompressed, to 9.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `level` is greater than 9.
+    pub fn with_compression_level(
+        output: Pin<&'a mut dyn ZeroCopyOutputStream>,
+        level: u32,
+    ) -> Pin<Box<ZipWriter<'a>>> {
+        assert!(level <= 9, "compression level must be between 0 and 9");
+        Self::with_level(output, CInt::expect_from(level))
+    }
+
+    fn with_level(
+        output: Pin<&'a mut dyn ZeroCopyOutputStream>,
+        level: CInt,
+    ) -> Pin<Box<ZipWriter<'a>>> {
+        let writer = unsafe { ffi::NewZipWriter(output.upcast_mut_ptr(), level) };
+        unsafe { Self::from_ffi_owned(writer) }
+    }
+
+    /// Compresses `contents` and writes it to the archive as the file `name`.
+    ///
+    /// Returns an error if the underlying stream fails, or if the archive
+    /// would need ZIP64 extensions.
+    pub fn write(
+        self: Pin<&mut Self>,
+        name: &str,
+        contents: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        let entry = compress_zip_entry(name, contents, self.as_ffi().CompressionLevel());
+        self.as_ffi_mut().Write(&entry).as_result()
+    }
+
+    /// Writes the central directory, which completes the archive.
+    ///
+    /// No further files may be written after calling this method. It is the
+    /// caller's responsibility to flush the underlying stream if necessary.
+    pub fn finish(self: Pin<&mut Self>) -> Result<(), OperationFailedError> {
+        self.as_ffi_mut().Finish().as_result()
+    }
+
+    unsafe_ffi_conversions!(ffi::ZipWriter);
+}
+
+#[cfg(feature = "zlib")]
+fn compress_zip_entry(name: &str, contents: &[u8], level: CInt) -> ffi::ZipEntry {
+    let mut entry = ffi::ZipEntry {
+        name: name.into(),
+        method: 0,
+        crc32: 0,
+        size: 0,
+        data: vec![],
+    };
+    ffi::CompressZipEntry(contents, level, &mut entry);
+    entry
+}
+
+/// A file written by a [`CodeGenerator`].
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct GeneratedFile {
+    /// The path of the file, relative to the output directory.
+    pub name: String,
+    /// The contents of the file.
+    pub contents: Vec<u8>,
+}
+
+impl GeneratedFile {
+    /// Writes the file to its path relative to `dir`, creating any missing
+    /// parent directories.
+    ///
+    /// The file is not written if it already exists with the same contents,
+    /// so that its modification time, which build systems use to decide what
+    /// to rebuild, only changes along with the generated code.
+    pub fn write_to(&self, dir: &Path) -> Result<(), io::Error> {
+        let path = dir.join(&self.name);
+        if fs::read(&path).map_or(false, |contents| contents == self.contents) {
+            return Ok(());
+        }
+        if let Some(parent) = path.parent() {
+            fs::create_dir_all(parent)?;
+        }
+        fs::write(&path, &self.contents)
+    }
+}
+
+/// Writes each of `files` to its path relative to `dir`, as by
+/// [`GeneratedFile::write_to`], on up to `threads` threads.
+///
+/// If several files fail to be written, one of the errors is returned.
+///
+/// # Panics
+///
+/// Panics if a writer thread panics.
+pub fn write_files(files: &[GeneratedFile], dir: &Path, threads: usize) -> Result<(), io::Error> {
+    let threads = threads.clamp(1, files.len().max(1));
+    let next = AtomicUsize::new(0);
+    thread::scope(|s| {
+        let workers: Vec<_> = (0..threads)
+            .map(|_| {
+                s.spawn(|| -> Result<(), io::Error> {
+                    loop {
+                        let i = next.fetch_add(1, Ordering::Relaxed);
+                        match files.get(i) {
+                            Some(file) => file.write_to(dir)?,
+                            None => return Ok(()),
+                        }
+                    }
+                })
+            })
+            .collect();
+        workers.into_iter().fold(Ok(()), |result, worker| {
+            let worker_result = worker.join().expect("writer thread panicked");
+            result.and(worker_result)
+        })
+    })
+}
+
+impl From<ffi::GeneratedFile> for GeneratedFile {
+    fn from(ffi: ffi::GeneratedFile) -> GeneratedFile {
+        GeneratedFile {
+            name: ffi.name,
+            contents: ffi.contents,
+        }
+    }
+}
+
+/// An error reported by a [`CodeGenerator`].
+#[derive(Debug, Clone, Eq, PartialEq, Hash)]
+pub struct GenerateError(String);
+
+impl fmt::Display for GenerateError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.write_str(&self.0)
+    }
+}
+
+impl Error for GenerateError {}
+
+impl GenerateError {
+    fn duplicate(name: &str) -> GenerateError {
+        GenerateError(format!("{name}: Tried to write the same file twice."))
+    }
+}
+
+/// protoc's command-line interface, with every built-in code generator
+/// registered under the same flags as in the protoc binary.
+///
+/// Each [`run`](CommandLineInterface::run) parses its input files from
+/// scratch. To parse files once for many generators, use [`CodeGenerator`]
+/// directly, or pass several output flags to a single run, as with protoc.
+pub struct CommandLineInterface {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for CommandLineInterface {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteProtoc(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl CommandLineInterface {
+    /// Creates a new command-line interface.
+    ///
+    /// Plugins are not allowed until [`allow_plugins`] is called.
+    ///
+    /// [`allow_plugins`]: CommandLineInterface::allow_plugins
+    pub fn new() -> Pin<Box<CommandLineInterface>> {
+        let protoc = ffi::NewProtoc();
+        unsafe { Self::from_ffi_owned(protoc) }
+    }
+
+    /// Allows output flags for which no generator is registered to be handled
+    /// by plugins, found in the `PATH` as executables whose names start with
+    /// `exe_name_prefix`, as protoc does with the prefix `protoc-`.
+    ///
+    /// Plugins named with `--plugin` are allowed regardless.
+    pub fn allow_plugins(self: Pin<&mut Self>, exe_name_prefix: &str) {
+        self.as_ffi_mut().AllowPlugins(exe_name_prefix)
+    }
+
+    /// Runs protoc with the given arguments, not including the program name.
+    ///
+    /// Errors are printed to standard error, as by the protoc binary, and
+    /// reported only by the returned result.
+    ///
+    /// # Panics
+    ///
+    /// Panics if an argument contains a NUL byte.
+    pub fn run<I, S>(self: Pin<&mut Self>, args: I) -> Result<(), OperationFailedError>
+    where
+        I: IntoIterator<Item = S>,
+        S: AsRef<OsStr>,
+    {
+        let mut buf = vec![];
+        for arg in args {
+            let arg = ProtobufPath::from(Path::new(arg.as_ref()));
+            let arg = arg.as_bytes();
+            assert!(!arg.contains(&0), "argument contains a NUL byte");
+            buf.extend(arg);
+            buf.push(0);
+        }
+        match self.as_ffi_mut().Run(&buf) {
+            CInt(0) => Ok(()),
+            _ => Err(OperationFailedError),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::Protoc);
+}
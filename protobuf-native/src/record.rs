@@ -0,0 +1,658 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Indexed files of records.
+//!
+//! A record file stores a sequence of messages in blocks, each of which holds
+//! the length-delimited encodings of consecutive records and may be
+//! compressed. A footer at the end of the file indexes the blocks by offset
+//! and record count, and optionally by the range of keys that the writer
+//! associated with their records. Unlike a plain stream of delimited
+//! messages, which can only be read sequentially from its start, a record
+//! file can therefore be split across threads by block, read from any record
+//! on, and filtered by key without decompressing the blocks it skips.
+//!
+//! [`RecordWriter`] writes a record file to any [`Write`] implementor and
+//! [`RecordReader`] reads one from a byte slice, such as the contents of a
+//! [`MmapInputStream`]. A `RecordReader` is `Sync`, so the blocks of a file
+//! can be read concurrently through a shared reference.
+//!
+//! # Format
+//!
+//! A file begins with the magic bytes `PBRF`, a version byte of 1 and a byte
+//! that identifies the compression of the blocks: 0 for none and 1 for zlib.
+//! Zlib compressed files can only be written and read with the `zlib`
+//! feature enabled.
+//! The blocks follow. The index comes after the last block and consists of
+//! the number of blocks as a varint and an entry per block: the compressed
+//! length of the block and the number of records in it as varints, and a byte
+//! that is 1 if the block has a key range, in which case the smallest and
+//! largest key follow, each as a varint length and the key's bytes. The file
+//! ends with the offset of the index as a little-endian 64-bit integer and
+//! the magic bytes again.
+//!
+//! # Examples
+//!
+//! ```
+//! use protobuf_native::MessageLite;
+//! use protobuf_native::record::{RecordReader, RecordWriter, RecordWriterOptions};
+//! # fn f(message: &dyn MessageLite) -> Result<(), protobuf_native::OperationFailedError> {
+//!
+//! let mut writer = RecordWriter::new(vec![], RecordWriterOptions::default())?;
+//! for _ in 0..3 {
+//!     writer.append(message)?;
+//! }
+//! let file = writer.finish()?;
+//!
+//! let reader = RecordReader::new(&file)?;
+//! assert_eq!(reader.record_count(), 3);
+//! for block in 0..reader.blocks().len() {
+//!     reader.read_block(block, message, |record, message| {
+//!         println!("record {}: {} bytes", record, message.byte_size());
+//!     })?;
+//! }
+//! # Ok(())
+//! # }
+//! ```
+//!
+//! [`MmapInputStream`]: crate::io::MmapInputStream
+
+use std::io::Write;
+use std::mem::MaybeUninit;
+use std::ops::Range;
+use std::pin::Pin;
+
+use crate::io::{CodedInputStream, CodedOutputStream};
+#[cfg(feature = "zlib")]
+use crate::io::{
+    GzipInputFormat, GzipInputStream, GzipOptions, GzipOutputFormat, GzipOutputStream,
+    SliceInputStream, VecOutputStream,
+};
+use crate::{MessageLite, OperationFailedError};
+
+const MAGIC: &[u8; 4] = b"PBRF";
+const VERSION: u8 = 1;
+const HEADER_LEN: usize = 6;
+const FOOTER_LEN: usize = 12;
+
+/// The compression applied to the blocks of a record file.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum RecordCompression {
+    /// The blocks are stored uncompressed.
+    None,
+    /// The blocks are compressed as zlib streams.
+    ///
+    /// This variant is only available if the `zlib` feature is enabled.
+    #[cfg(feature = "zlib")]
+    Zlib,
+}
+
+impl Default for RecordCompression {
+    /// Returns `RecordCompression::Zlib` if the `zlib` feature is enabled,
+    /// and [`RecordCompression::None`] otherwise.
+    fn default() -> RecordCompression {
+        #[cfg(feature = "zlib")]
+        return RecordCompression::Zlib;
+        #[cfg(not(feature = "zlib"))]
+        return RecordCompression::None;
+    }
+}
+
+/// Options for a [`RecordWriter`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct RecordWriterOptions {
+    /// The uncompressed size after which a block is finished. Defaults to
+    /// 64KiB.
+    ///
+    /// Smaller blocks allow finer-grained seeking and splitting at the cost
+    /// of a larger index and, when compressing, a worse compression ratio.
+    pub block_size: usize,
+    /// The compression applied to the blocks. Defaults to
+    /// `RecordCompression::Zlib` if the `zlib` feature is enabled, and
+    /// to [`RecordCompression::None`] otherwise.
+    pub compression: RecordCompression,
+    /// A number between 0 and 9, where 0 is no compression and 9 is best
+    /// compression. Defaults to zlib's default compression level.
+    pub compression_level: Option<u32>,
+}
+
+impl Default for RecordWriterOptions {
+    fn default() -> RecordWriterOptions {
+        RecordWriterOptions {
+            block_size: 64 << 10,
+            compression: RecordCompression::default(),
+            compression_level: None,
+        }
+    }
+}
+
+/// A block of a record file, as described by the file's index.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub struct BlockInfo {
+    /// The offset of the block in the file.
+    pub offset: u64,
+    /// The length of the block in the file, after compression.
+    pub len: u64,
+    /// The index of the first record in the block within the file.
+    pub first_record: u64,
+    /// The number of records in the block.
+    pub record_count: u64,
+    /// The smallest and largest key of the records in the block, if every
+    /// record in the block was appended with a key.
+    pub key_range: Option<(Vec<u8>, Vec<u8>)>,
+}
+
+impl BlockInfo {
+    /// Returns the indices of the records in the block.
+    pub fn records(&self) -> Range<u64> {
+        self.first_record..self.first_record + self.record_count
+    }
+
+    /// Reports whether the block may contain a record with the given key.
+    ///
+    /// Blocks without a key range may contain any key.
+    pub fn may_contain_key(&self, key: &[u8]) -> bool {
+        match &self.key_range {
+            Some((first, last)) => &first[..] <= key && key <= &last[..],
+            None => true,
+        }
+    }
+}
+
+/// Writes a record file.
+///
+/// Records are buffered until their block is full, at which point the block
+/// is compressed and written to the output. The file is only complete once
+/// [`finish`] has written its index; a writer that is dropped without being
+/// finished leaves a file that [`RecordReader`] rejects.
+///
+/// [`finish`]: RecordWriter::finish
+pub struct RecordWriter<W>
+where
+    W: Write,
+{
+    output: W,
+    options: RecordWriterOptions,
+    // The length-delimited records of the current block.
+    block: Vec<u8>,
+    block_records: u64,
+    block_keys: Option<(Vec<u8>, Vec<u8>)>,
+    block_unkeyed: bool,
+    // A reusable buffer for the compressed block.
+    #[cfg(feature = "zlib")]
+    compressed: Vec<u8>,
+    offset: u64,
+    record_count: u64,
+    index: Vec<BlockInfo>,
+}
+
+impl<W> RecordWriter<W>
+where
+    W: Write,
+{
+    /// Creates a writer that writes a record file to `output`.
+    ///
+    /// Returns an error if the header of the file cannot be written.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the block size is zero or if the compression level is
+    /// greater than 9.
+    pub fn new(
+        mut output: W,
+        options: RecordWriterOptions,
+    ) -> Result<RecordWriter<W>, OperationFailedError> {
+        assert!(options.block_size > 0, "block size must be nonzero");
+        if let Some(level) = options.compression_level {
+            assert!(level <= 9, "compression level must be between 0 and 9");
+        }
+        let compression = match options.compression {
+            RecordCompression::None => 0,
+            #[cfg(feature = "zlib")]
+            RecordCompression::Zlib => 1,
+        };
+        let mut header = MAGIC.to_vec();
+        header.extend([VERSION, compression]);
+        output
+            .write_all(&header)
+            .map_err(|_| OperationFailedError)?;
+        Ok(RecordWriter {
+            output,
+            options,
+            block: vec![],
+            block_records: 0,
+            block_keys: None,
+            block_unkeyed: false,
+            #[cfg(feature = "zlib")]
+            compressed: vec![],
+            offset: HEADER_LEN as u64,
+            record_count: 0,
+            index: vec![],
+        })
+    }
+
+    /// Appends a record.
+    ///
+    /// All required fields must be set.
+    pub fn append(&mut self, message: &dyn MessageLite) -> Result<(), OperationFailedError> {
+        self.append_record(message)?;
+        self.block_unkeyed = true;
+        self.end_record()
+    }
+
+    /// Appends a record with an associated key, which contributes to the key
+    /// range of its block.
+    ///
+    /// Appending records in key order keeps the key ranges of the blocks
+    /// disjoint, so that a reader looking for a key needs to read at most a
+    /// few blocks.
+    ///
+    /// All required fields must be set.
+    pub fn append_with_key(
+        &mut self,
+        message: &dyn MessageLite,
+        key: &[u8],
+    ) -> Result<(), OperationFailedError> {
+        self.append_record(message)?;
+        match &mut self.block_keys {
+            None => self.block_keys = Some((key.to_vec(), key.to_vec())),
+            Some((first, last)) => {
+                if key < &first[..] {
+                    *first = key.to_vec();
+                } else if key > &last[..] {
+                    *last = key.to_vec();
+                }
+            }
+        }
+        self.end_record()
+    }
+
+    /// Returns the number of records appended so far.
+    pub fn record_count(&self) -> u64 {
+        self.record_count
+    }
+
+    /// Writes any buffered records and the index, and returns the output.
+    pub fn finish(mut self) -> Result<W, OperationFailedError> {
+        self.finish_block()?;
+        let mut index = vec![];
+        write_varint(self.index.len() as u64, &mut index);
+        for block in &self.index {
+            write_varint(block.len, &mut index);
+            write_varint(block.record_count, &mut index);
+            match &block.key_range {
+                None => index.push(0),
+                Some((first, last)) => {
+                    index.push(1);
+                    for key in [first, last] {
+                        write_varint(key.len() as u64, &mut index);
+                        index.extend_from_slice(key);
+                    }
+                }
+            }
+        }
+        index.extend_from_slice(&self.offset.to_le_bytes());
+        index.extend_from_slice(MAGIC);
+        self.output
+            .write_all(&index)
+            .and_then(|()| self.output.flush())
+            .map_err(|_| OperationFailedError)?;
+        Ok(self.output)
+    }
+
+    fn append_record(&mut self, message: &dyn MessageLite) -> Result<(), OperationFailedError> {
+        if !message.is_initialized() {
+            return Err(OperationFailedError);
+        }
+        let len = message.byte_size();
+        if len > i32::MAX as usize {
+            return Err(OperationFailedError);
+        }
+        write_varint(len as u64, &mut self.block);
+        self.block.reserve(len);
+        // SAFETY: `byte_size` has just cached the sizes of the message and its
+        // submessages, which cannot be modified while it is borrowed, and the
+        // block has room for `len` more bytes.
+        unsafe {
+            let spare: &mut [MaybeUninit<u8>] = self.block.spare_capacity_mut();
+            message.serialize_with_cached_sizes_to_uninit_slice(spare);
+            self.block.set_len(self.block.len() + len);
+        }
+        Ok(())
+    }
+
+    fn end_record(&mut self) -> Result<(), OperationFailedError> {
+        self.block_records += 1;
+        self.record_count += 1;
+        if self.block.len() >= self.options.block_size {
+            self.finish_block()?;
+        }
+        Ok(())
+    }
+
+    fn finish_block(&mut self) -> Result<(), OperationFailedError> {
+        if self.block_records == 0 {
+            return Ok(());
+        }
+        let data = match self.options.compression {
+            RecordCompression::None => &self.block,
+            #[cfg(feature = "zlib")]
+            RecordCompression::Zlib => {
+                self.compressed.clear();
+                let mut output = VecOutputStream::new(&mut self.compressed);
+                let options = GzipOptions {
+                    format: GzipOutputFormat::Zlib,
+                    compression_level: self.options.compression_level,
+                    ..Default::default()
+                };
+                let mut gzip = GzipOutputStream::with_options(output.as_mut(), options);
+                let mut coded = CodedOutputStream::new(gzip.as_mut());
+                coded.as_mut().write_raw(&self.block);
+                coded.as_mut().trim();
+                if coded.as_mut().had_error() {
+                    return Err(OperationFailedError);
+                }
+                drop(coded);
+                gzip.as_mut().close()?;
+                drop(gzip);
+                drop(output);
+                &self.compressed
+            }
+        };
+        self.output
+            .write_all(data)
+            .map_err(|_| OperationFailedError)?;
+        let unkeyed = self.block_unkeyed;
+        self.index.push(BlockInfo {
+            offset: self.offset,
+            len: data.len() as u64,
+            first_record: self.record_count - self.block_records,
+            record_count: self.block_records,
+            key_range: self.block_keys.take().filter(|_| !unkeyed),
+        });
+        self.offset += data.len() as u64;
+        self.block.clear();
+        self.block_records = 0;
+        self.block_unkeyed = false;
+        Ok(())
+    }
+}
+
+/// Reads a record file from a byte slice.
+#[derive(Debug, Clone)]
+pub struct RecordReader<'a> {
+    data: &'a [u8],
+    compression: RecordCompression,
+    blocks: Vec<BlockInfo>,
+    record_count: u64,
+}
+
+impl<'a> RecordReader<'a> {
+    /// Opens the record file whose contents are `data`, reading its index.
+    ///
+    /// Returns an error if `data` is not a complete record file.
+    pub fn new(data: &'a [u8]) -> Result<RecordReader<'a>, OperationFailedError> {
+        if data.len() < HEADER_LEN + FOOTER_LEN
+            || &data[..4] != MAGIC
+            || data[4] != VERSION
+            || &data[data.len() - 4..] != MAGIC
+        {
+            return Err(OperationFailedError);
+        }
+        let compression = match data[5] {
+            0 => RecordCompression::None,
+            #[cfg(feature = "zlib")]
+            1 => RecordCompression::Zlib,
+            _ => return Err(OperationFailedError),
+        };
+        let footer = &data[data.len() - FOOTER_LEN..];
+        let index_offset = u64::from_le_bytes(footer[..8].try_into().unwrap());
+        let index_end = data.len() - FOOTER_LEN;
+        let mut index = match usize::try_from(index_offset) {
+            Ok(offset) if (HEADER_LEN..=index_end).contains(&offset) => &data[offset..index_end],
+            _ => return Err(OperationFailedError),
+        };
+
+        let block_count = read_varint(&mut index)?;
+        let mut blocks = vec![];
+        let (mut offset, mut record_count) = (HEADER_LEN as u64, 0u64);
+        for _ in 0..block_count {
+            let len = read_varint(&mut index)?;
+            let block_records = read_varint(&mut index)?;
+            let key_range = match read_bytes(&mut index, 1)? {
+                [0] => None,
+                [1] => {
+                    let first = read_key(&mut index)?;
+                    Some((first, read_key(&mut index)?))
+                }
+                _ => return Err(OperationFailedError),
+            };
+            blocks.push(BlockInfo {
+                offset,
+                len,
+                first_record: record_count,
+                record_count: block_records,
+                key_range,
+            });
+            offset = offset.checked_add(len).ok_or(OperationFailedError)?;
+            record_count = record_count
+                .checked_add(block_records)
+                .ok_or(OperationFailedError)?;
+        }
+        if offset != index_offset || !index.is_empty() {
+            return Err(OperationFailedError);
+        }
+        Ok(RecordReader {
+            data,
+            compression,
+            blocks,
+            record_count,
+        })
+    }
+
+    /// Returns the compression of the file's blocks.
+    pub fn compression(&self) -> RecordCompression {
+        self.compression
+    }
+
+    /// Returns the blocks of the file.
+    pub fn blocks(&self) -> &[BlockInfo] {
+        &self.blocks
+    }
+
+    /// Returns the number of records in the file.
+    pub fn record_count(&self) -> u64 {
+        self.record_count
+    }
+
+    /// Returns the index of the block that contains the given record, if the
+    /// file has that many records.
+    pub fn find_block(&self, record: u64) -> Option<usize> {
+        if record >= self.record_count {
+            return None;
+        }
+        // Empty blocks are never written, so exactly one block contains the
+        // record.
+        Some(
+            self.blocks
+                .partition_point(|block| block.first_record + block.record_count <= record),
+        )
+    }
+
+    /// Splits the blocks of the file into at most `parts` contiguous ranges
+    /// of roughly equal length, for instance to read them on that many
+    /// threads.
+    pub fn partition(&self, parts: usize) -> Vec<Range<usize>> {
+        let total: u64 = self.blocks.iter().map(|block| block.len).sum();
+        let target = total / parts.max(1) as u64;
+        let mut ranges = vec![];
+        let (mut begin, mut len) = (0, 0);
+        for (i, block) in self.blocks.iter().enumerate() {
+            len += block.len;
+            if len > target {
+                ranges.push(begin..i + 1);
+                begin = i + 1;
+                len = 0;
+            }
+        }
+        if begin < self.blocks.len() {
+            ranges.push(begin..self.blocks.len());
+        }
+        ranges
+    }
+
+    /// Reads the records of a block, calling `f` with the index and contents
+    /// of each in turn.
+    ///
+    /// Each record is parsed into the same new instance of the same type as
+    /// `prototype`, which is cleared between records.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block` is out of bounds.
+    pub fn read_block<F>(
+        &self,
+        block: usize,
+        prototype: &dyn MessageLite,
+        mut f: F,
+    ) -> Result<(), OperationFailedError>
+    where
+        F: FnMut(u64, &dyn MessageLite),
+    {
+        let info = self.block(block);
+        let mut message = prototype.new();
+        self.with_block(info, |mut input| {
+            for record in info.records() {
+                message.as_mut().clear();
+                if !message
+                    .as_mut()
+                    .parse_delimited_from_coded_stream(input.as_mut())?
+                {
+                    return Err(OperationFailedError);
+                }
+                f(record, &*message);
+            }
+            Ok(())
+        })
+    }
+
+    /// Like [`RecordReader::read_block`], but calls `f` with the encoding of
+    /// each record rather than parsing it.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block` is out of bounds.
+    pub fn read_block_raw<F>(&self, block: usize, mut f: F) -> Result<(), OperationFailedError>
+    where
+        F: FnMut(u64, &[u8]),
+    {
+        let info = self.block(block);
+        self.with_block(info, |mut input| {
+            for record in info.records() {
+                let len = input.as_mut().read_varint32()?;
+                f(record, &input.as_mut().read_bytes_borrowed(len as usize)?);
+            }
+            Ok(())
+        })
+    }
+
+    /// Reads a single record into `message`, replacing its contents.
+    ///
+    /// Only the block that contains the record is decompressed, and the
+    /// records that precede it in the block are skipped without being parsed.
+    ///
+    /// Returns an error if the file has no such record.
+    pub fn read_record(
+        &self,
+        record: u64,
+        mut message: Pin<&mut dyn MessageLite>,
+    ) -> Result<(), OperationFailedError> {
+        let info = self.block(self.find_block(record).ok_or(OperationFailedError)?);
+        self.with_block(info, |mut input| {
+            for _ in info.first_record..record {
+                let len = input.as_mut().read_varint32()?;
+                input.as_mut().skip(len as usize)?;
+            }
+            message.as_mut().clear();
+            match message.parse_delimited_from_coded_stream(input)? {
+                true => Ok(()),
+                false => Err(OperationFailedError),
+            }
+        })
+    }
+
+    fn block(&self, block: usize) -> &BlockInfo {
+        match self.blocks.get(block) {
+            Some(info) => info,
+            None => panic!(
+                "index out of bounds: the length is {} but the index is {}",
+                self.blocks.len(),
+                block
+            ),
+        }
+    }
+
+    fn with_block<F, R>(&self, info: &BlockInfo, f: F) -> Result<R, OperationFailedError>
+    where
+        F: FnOnce(Pin<&mut CodedInputStream>) -> Result<R, OperationFailedError>,
+    {
+        // The index was validated to lie within the file.
+        let data = &self.data[info.offset as usize..(info.offset + info.len) as usize];
+        match self.compression {
+            RecordCompression::None => f(CodedInputStream::from_slice(data).as_mut()),
+            #[cfg(feature = "zlib")]
+            RecordCompression::Zlib => {
+                let mut input = SliceInputStream::new(data);
+                let mut gzip = GzipInputStream::new(input.as_mut(), GzipInputFormat::Zlib);
+                let mut coded = CodedInputStream::new(gzip.as_mut());
+                f(coded.as_mut())
+            }
+        }
+    }
+}
+
+fn write_varint(mut value: u64, output: &mut Vec<u8>) {
+    while value >= 0x80 {
+        output.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    output.push(value as u8);
+}
+
+fn read_varint(input: &mut &[u8]) -> Result<u64, OperationFailedError> {
+    let mut value = 0;
+    for (i, &b) in input.iter().take(10).enumerate() {
+        value |= u64::from(b & 0x7f) << (7 * i);
+        if b < 0x80 {
+            *input = &input[i + 1..];
+            return Ok(value);
+        }
+    }
+    Err(OperationFailedError)
+}
+
+fn read_bytes<'a>(input: &mut &'a [u8], len: usize) -> Result<&'a [u8], OperationFailedError> {
+    if input.len() < len {
+        return Err(OperationFailedError);
+    }
+    let (bytes, rest) = input.split_at(len);
+    *input = rest;
+    Ok(bytes)
+}
+
+fn read_key(input: &mut &[u8]) -> Result<Vec<u8>, OperationFailedError> {
+    let len = usize::try_from(read_varint(input)?).map_err(|_| OperationFailedError)?;
+    Ok(read_bytes(input, len)?.to_vec())
+}
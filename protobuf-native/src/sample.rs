@@ -0,0 +1,456 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Capture and replay of sampled production traffic.
+//!
+//! While a [`Capture`] is active, a sample of the calls to the methods of
+//! [`MessageLite`] that are instrumented for [`metrics`](crate::metrics) have
+//! their input, when parsing, or their output, when serializing, appended to
+//! a [record file](crate::record). Each sample is stored as a
+//! `google.protobuf.Any` whose type URL names the message type, keyed by the
+//! type's full name.
+//!
+//! [`load`] reads the samples back, grouped by type, and [`replay`] runs them
+//! through the parse, serialize and JSON paths and reports how long each
+//! took, so that a benchmark can be driven by the messages a process actually
+//! handles rather than by synthetic ones. The `replay` benchmark of this
+//! crate does the same under Criterion.
+//!
+//! No capture is active by default. While none is, each instrumented call
+//! costs a single relaxed atomic load; while one is, each call also counts
+//! towards the sampling rate in a thread-local counter, and only the sampled
+//! calls look up the message's type name or take a lock.
+//!
+//! # Examples
+//!
+//! ```no_run
+//! use std::fs::File;
+//! use std::io::BufWriter;
+//!
+//! use protobuf_native::record::{RecordWriter, RecordWriterOptions};
+//! use protobuf_native::sample::{Capture, CaptureOptions};
+//! # fn f() -> Result<(), protobuf_native::OperationFailedError> {
+//!
+//! let file = BufWriter::new(File::create("samples.pbrf").unwrap());
+//! let writer = RecordWriter::new(file, RecordWriterOptions::default())?;
+//! let capture = Capture::start(writer, CaptureOptions::default())?;
+//! // ... handle traffic ...
+//! capture.finish()?;
+//! # Ok(())
+//! # }
+//! ```
+//!
+//! [`MessageLite`]: crate::MessageLite
+
+use std::cell::Cell;
+use std::collections::{BTreeMap, HashMap};
+use std::io::Write;
+use std::str;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, RwLock};
+use std::time::{Duration, Instant};
+
+use crate::any::{Any, AnyResolver, DEFAULT_TYPE_URL_PREFIX};
+use crate::json::{self, PrintOptions};
+use crate::record::{RecordReader, RecordWriter};
+use crate::{ffi, MessageLite, OperationFailedError};
+
+static CAPTURING: AtomicBool = AtomicBool::new(false);
+static SAMPLE_RATE: AtomicU64 = AtomicU64::new(1);
+static SINK: RwLock<Option<Arc<dyn Sink>>> = RwLock::new(None);
+
+thread_local! {
+    /// The instrumented calls on this thread since the last sampled one.
+    static CALLS: Cell<u64> = Cell::new(0);
+}
+
+/// Options for a [`Capture`].
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct CaptureOptions {
+    /// Samples one in every `sample_rate` instrumented calls on each thread.
+    /// Defaults to 100.
+    pub sample_rate: u32,
+    /// The most samples to capture of each message type. Defaults to 1,000.
+    pub max_samples_per_type: u64,
+    /// The full names of the message types to capture, like
+    /// `package.Message`. If empty, the default, every type is captured.
+    pub types: Vec<String>,
+    /// Whether to capture the input of parses. Defaults to true.
+    pub parse: bool,
+    /// Whether to capture the output of serializations. Defaults to true.
+    pub serialize: bool,
+}
+
+impl Default for CaptureOptions {
+    fn default() -> CaptureOptions {
+        CaptureOptions {
+            sample_rate: 100,
+            max_samples_per_type: 1_000,
+            types: vec![],
+            parse: true,
+            serialize: true,
+        }
+    }
+}
+
+/// An active capture of sampled traffic.
+///
+/// Only one capture may be active at a time. The capture stops when it is
+/// finished or dropped; dropping it leaves the record file unfinished.
+///
+/// See the [module documentation](self) for details.
+pub struct Capture<W>
+where
+    W: Write + Send + 'static,
+{
+    sink: Arc<CaptureSink<W>>,
+}
+
+impl<W> Capture<W>
+where
+    W: Write + Send + 'static,
+{
+    /// Starts capturing samples into `writer`.
+    ///
+    /// Returns an error if another capture is already active.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the sample rate is zero.
+    pub fn start(
+        writer: RecordWriter<W>,
+        options: CaptureOptions,
+    ) -> Result<Capture<W>, OperationFailedError> {
+        assert!(options.sample_rate > 0, "sample rate must be nonzero");
+        let mut active = SINK.write().expect("sample sink poisoned");
+        if active.is_some() {
+            return Err(OperationFailedError);
+        }
+        SAMPLE_RATE.store(u64::from(options.sample_rate), Ordering::Relaxed);
+        let sink = Arc::new(CaptureSink {
+            options,
+            state: Mutex::new(CaptureState {
+                writer: Some(writer),
+                counts: HashMap::new(),
+                failed: false,
+            }),
+        });
+        *active = Some(sink.clone());
+        CAPTURING.store(true, Ordering::Relaxed);
+        Ok(Capture { sink })
+    }
+
+    /// Returns the number of samples captured so far.
+    pub fn sample_count(&self) -> u64 {
+        let state = self.sink.state.lock().expect("sample capture poisoned");
+        state.counts.values().sum()
+    }
+
+    /// Stops capturing, writes any buffered samples and the index of the
+    /// record file, and returns the output.
+    ///
+    /// Returns an error if any sample could not be written.
+    pub fn finish(self) -> Result<W, OperationFailedError> {
+        self.stop();
+        let mut state = self.sink.state.lock().expect("sample capture poisoned");
+        let writer = state.writer.take().expect("capture finished twice");
+        match state.failed {
+            false => writer.finish(),
+            true => Err(OperationFailedError),
+        }
+    }
+
+    fn stop(&self) {
+        let mut active = SINK.write().expect("sample sink poisoned");
+        let ours = Arc::as_ptr(&self.sink) as *const ();
+        if active
+            .as_ref()
+            .map(|active| Arc::as_ptr(active) as *const ())
+            == Some(ours)
+        {
+            CAPTURING.store(false, Ordering::Relaxed);
+            *active = None;
+        }
+    }
+}
+
+impl<W> Drop for Capture<W>
+where
+    W: Write + Send + 'static,
+{
+    fn drop(&mut self) {
+        self.stop();
+    }
+}
+
+trait Sink: Send + Sync {
+    fn record(&self, operation: Operation, type_name: &str, data: &[u8]);
+}
+
+struct CaptureSink<W>
+where
+    W: Write,
+{
+    options: CaptureOptions,
+    state: Mutex<CaptureState<W>>,
+}
+
+struct CaptureState<W>
+where
+    W: Write,
+{
+    // `None` once the capture has finished. Samples taken by calls that were
+    // in flight when it finished are discarded.
+    writer: Option<RecordWriter<W>>,
+    counts: HashMap<String, u64>,
+    failed: bool,
+}
+
+impl<W> Sink for CaptureSink<W>
+where
+    W: Write + Send,
+{
+    fn record(&self, operation: Operation, type_name: &str, data: &[u8]) {
+        let options = &self.options;
+        let wanted = match operation {
+            Operation::Parse => options.parse,
+            Operation::Serialize => options.serialize,
+        };
+        if !wanted || (!options.types.is_empty() && !options.types.iter().any(|t| t == type_name)) {
+            return;
+        }
+        let mut state = self.state.lock().expect("sample capture poisoned");
+        let CaptureState {
+            writer,
+            counts,
+            failed,
+        } = &mut *state;
+        let writer = match writer {
+            Some(writer) if !*failed => writer,
+            _ => return,
+        };
+        let count = match counts.get_mut(type_name) {
+            Some(count) => count,
+            None => counts.entry(type_name.to_owned()).or_default(),
+        };
+        if *count >= options.max_samples_per_type {
+            return;
+        }
+        // Appending serializes the `Any` with a method that is not
+        // instrumented, so recording a sample cannot recurse into the sink.
+        let mut any = Any::new();
+        any.as_mut()
+            .set_type_url(&format!("{}{}", DEFAULT_TYPE_URL_PREFIX, type_name));
+        any.as_mut().set_value(data);
+        match writer.append_with_key(&*any, type_name.as_bytes()) {
+            Ok(()) => *count += 1,
+            Err(OperationFailedError) => *failed = true,
+        }
+    }
+}
+
+/// The kind of an instrumented call.
+#[derive(Clone, Copy)]
+pub(crate) enum Operation {
+    Parse,
+    Serialize,
+}
+
+/// A call that has been chosen to be sampled.
+pub(crate) struct Sample {
+    sink: Arc<dyn Sink>,
+    type_name: String,
+}
+
+impl Sample {
+    /// Decides whether to sample a call on `message`.
+    #[inline]
+    pub(crate) fn start(message: &ffi::MessageLite) -> Option<Sample> {
+        if !CAPTURING.load(Ordering::Relaxed) {
+            return None;
+        }
+        Sample::start_slow(message)
+    }
+
+    #[cold]
+    fn start_slow(message: &ffi::MessageLite) -> Option<Sample> {
+        let rate = SAMPLE_RATE.load(Ordering::Relaxed);
+        let sampled = CALLS.with(|calls| {
+            let n = calls.get() + 1;
+            calls.set(if n >= rate { 0 } else { n });
+            n >= rate
+        });
+        if !sampled {
+            return None;
+        }
+        let sink = SINK.read().expect("sample sink poisoned").clone()?;
+        Some(Sample {
+            sink,
+            type_name: ffi::MessageLiteTypeName(message),
+        })
+    }
+
+    pub(crate) fn type_name(&self) -> &str {
+        &self.type_name
+    }
+
+    /// Records `data`, the input or output of the call, if the call
+    /// succeeded.
+    pub(crate) fn finish(self, operation: Operation, data: &[u8], ok: bool) {
+        if ok {
+            self.sink.record(operation, &self.type_name, data);
+        }
+    }
+}
+
+/// The captured samples of one message type.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct TypeSamples {
+    /// The type URL of the samples, like
+    /// `type.googleapis.com/package.Message`.
+    pub type_url: String,
+    /// The encoded messages, in the order in which they were captured.
+    pub samples: Vec<Vec<u8>>,
+}
+
+impl TypeSamples {
+    /// Returns the total size of the samples, in bytes.
+    pub fn bytes(&self) -> u64 {
+        self.samples.iter().map(|s| s.len() as u64).sum()
+    }
+}
+
+/// Reads the samples in a record file written by a [`Capture`], grouped by
+/// type and ordered by type URL.
+///
+/// Returns an error if any record is not a valid `google.protobuf.Any`.
+pub fn load(reader: &RecordReader) -> Result<Vec<TypeSamples>, OperationFailedError> {
+    let mut types: BTreeMap<String, Vec<Vec<u8>>> = BTreeMap::new();
+    let mut any = Any::new();
+    let mut result = Ok(());
+    for block in 0..reader.blocks().len() {
+        reader.read_block_raw(block, |_, record| {
+            if result.is_err() {
+                return;
+            }
+            any.as_mut().clear();
+            result = any.as_mut().parse_from_bytes(record).and_then(|()| {
+                let type_url = str::from_utf8(any.type_url()).map_err(|_| OperationFailedError)?;
+                let samples = match types.get_mut(type_url) {
+                    Some(samples) => samples,
+                    None => types.entry(type_url.to_owned()).or_default(),
+                };
+                samples.push(any.value().to_vec());
+                Ok(())
+            });
+        })?;
+        result?;
+    }
+    Ok(types
+        .into_iter()
+        .map(|(type_url, samples)| TypeSamples { type_url, samples })
+        .collect())
+}
+
+/// Options for [`replay`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct ReplayOptions {
+    /// The number of passes over the samples of each type. Defaults to 1.
+    pub iterations: u32,
+    /// Whether to also print each sample as JSON. Defaults to true.
+    pub json: bool,
+}
+
+impl Default for ReplayOptions {
+    fn default() -> ReplayOptions {
+        ReplayOptions {
+            iterations: 1,
+            json: true,
+        }
+    }
+}
+
+/// The time taken to replay the samples of one message type.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct ReplayReport {
+    /// The type URL of the samples.
+    pub type_url: String,
+    /// The number of samples replayed in each pass.
+    pub samples: usize,
+    /// The total size of the samples replayed in each pass, in bytes.
+    pub bytes: u64,
+    /// The time spent parsing, over all passes.
+    pub parse: Duration,
+    /// The time spent serializing, over all passes.
+    pub serialize: Duration,
+    /// The time spent printing JSON, over all passes, if enabled.
+    pub json: Option<Duration>,
+}
+
+/// Replays `samples`, as returned by [`load`], through the parse, serialize
+/// and JSON paths, resolving their types with `resolver`.
+///
+/// Each sample is parsed into a message that is reused for every sample of
+/// its type, the message is serialized into a reused buffer, and, if
+/// enabled, printed as JSON with the default [`PrintOptions`]. Each step is
+/// timed separately.
+///
+/// Returns an error if a type URL does not resolve, or if a sample cannot be
+/// parsed, serialized or printed.
+pub fn replay(
+    samples: &[TypeSamples],
+    resolver: &AnyResolver,
+    options: &ReplayOptions,
+) -> Result<Vec<ReplayReport>, OperationFailedError> {
+    let print_options = PrintOptions::default();
+    let mut reports = vec![];
+    for type_samples in samples {
+        let resolved = resolver
+            .resolve(type_samples.type_url.as_bytes())
+            .ok_or(OperationFailedError)?;
+        let mut message = resolved.prototype.new_message();
+        let mut output = vec![];
+        let mut report = ReplayReport {
+            type_url: type_samples.type_url.clone(),
+            samples: type_samples.samples.len(),
+            bytes: type_samples.bytes(),
+            parse: Duration::ZERO,
+            serialize: Duration::ZERO,
+            json: options.json.then_some(Duration::ZERO),
+        };
+        for _ in 0..options.iterations {
+            for sample in &type_samples.samples {
+                let start = Instant::now();
+                message.as_mut().clear();
+                message.as_mut().parse_from_bytes(sample)?;
+                report.parse += start.elapsed();
+
+                let start = Instant::now();
+                output.clear();
+                message.serialize_into(&mut output)?;
+                report.serialize += start.elapsed();
+
+                if let Some(elapsed) = &mut report.json {
+                    let start = Instant::now();
+                    json::message_to_json(&*message, &print_options)
+                        .map_err(|_| OperationFailedError)?;
+                    *elapsed += start.elapsed();
+                }
+            }
+        }
+        reports.push(report);
+    }
+    Ok(reports)
+}
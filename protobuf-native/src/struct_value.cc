@@ -0,0 +1,187 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/struct_value.h"
+
+#include "protobuf-native/src/struct_value.rs.h"
+
+namespace protobuf_native {
+namespace struct_value {
+
+namespace {
+
+const uint8_t* Bytes(const std::string& s) { return reinterpret_cast<const uint8_t*>(s.data()); }
+
+// Appends the tokens of `value`, keyed by `key` if it is a field of a
+// struct, in preorder. Returns the number of tokens appended.
+size_t AppendValue(const Value& value, const std::string* key, rust::Vec<ValueToken>& tokens);
+
+size_t AppendStruct(const Struct& s, const std::string* key, rust::Vec<ValueToken>& tokens) {
+    size_t index = tokens.size();
+    tokens.push_back(ValueToken{ValueKind::Struct, false, 0, nullptr, 0, nullptr, 0,
+                                static_cast<size_t>(s.fields_size()), 1});
+    if (key != nullptr) {
+        tokens[index].key = Bytes(*key);
+        tokens[index].key_len = key->size();
+    }
+    size_t size = 1;
+    for (const auto& field : s.fields()) {
+        size += AppendValue(field.second, &field.first, tokens);
+    }
+    tokens[index].size = size;
+    return size;
+}
+
+size_t AppendValue(const Value& value, const std::string* key, rust::Vec<ValueToken>& tokens) {
+    if (value.kind_case() == Value::kStructValue) {
+        return AppendStruct(value.struct_value(), key, tokens);
+    }
+    size_t index = tokens.size();
+    tokens.push_back(ValueToken{ValueKind::Null, false, 0, nullptr, 0, nullptr, 0, 0, 1});
+    ValueToken& token = tokens[index];
+    if (key != nullptr) {
+        token.key = Bytes(*key);
+        token.key_len = key->size();
+    }
+    switch (value.kind_case()) {
+        case Value::kNumberValue:
+            token.kind = ValueKind::Number;
+            token.number = value.number_value();
+            break;
+        case Value::kStringValue:
+            token.kind = ValueKind::String;
+            token.string = Bytes(value.string_value());
+            token.string_len = value.string_value().size();
+            break;
+        case Value::kBoolValue:
+            token.kind = ValueKind::Bool;
+            token.boolean = value.bool_value();
+            break;
+        case Value::kListValue: {
+            const ListValue& list = value.list_value();
+            token.kind = ValueKind::List;
+            token.len = static_cast<size_t>(list.values_size());
+            size_t size = 1;
+            for (const Value& element : list.values()) {
+                size += AppendValue(element, nullptr, tokens);
+            }
+            // `token` may have been invalidated by the appends.
+            tokens[index].size = size;
+            return size;
+        }
+        default:
+            // A null value, or a value with no kind set, which the JSON
+            // mapping also prints as null.
+            break;
+    }
+    return 1;
+}
+
+absl::string_view Key(const ValueToken& token) {
+    return absl::string_view(reinterpret_cast<const char*>(token.key), token.key_len);
+}
+
+// Sets `value` from the tokens starting at `*pos`, advancing `*pos` past
+// them. Returns false if the tokens are malformed.
+bool BuildValue(Value& value, rust::Slice<const ValueToken> tokens, size_t* pos);
+
+bool BuildStruct(Struct& s, rust::Slice<const ValueToken> tokens, size_t* pos) {
+    const ValueToken& token = tokens[(*pos)++];
+    auto& fields = *s.mutable_fields();
+    for (size_t i = 0; i < token.len; i++) {
+        if (*pos >= tokens.size()) {
+            return false;
+        }
+        if (!BuildValue(fields[std::string(Key(tokens[*pos]))], tokens, pos)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BuildValue(Value& value, rust::Slice<const ValueToken> tokens, size_t* pos) {
+    const ValueToken& token = tokens[*pos];
+    switch (token.kind) {
+        case ValueKind::Null:
+            value.set_null_value(NULL_VALUE);
+            break;
+        case ValueKind::Number:
+            value.set_number_value(token.number);
+            break;
+        case ValueKind::String:
+            value.set_string_value(absl::string_view(
+                reinterpret_cast<const char*>(token.string), token.string_len));
+            break;
+        case ValueKind::Bool:
+            value.set_bool_value(token.boolean);
+            break;
+        case ValueKind::Struct:
+            return BuildStruct(*value.mutable_struct_value(), tokens, pos);
+        case ValueKind::List: {
+            ListValue& list = *value.mutable_list_value();
+            list.mutable_values()->Reserve(static_cast<int>(token.len));
+            (*pos)++;
+            for (size_t i = 0; i < token.len; i++) {
+                if (*pos >= tokens.size() || !BuildValue(*list.add_values(), tokens, pos)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+    (*pos)++;
+    return true;
+}
+
+}  // namespace
+
+Struct* NewStruct() { return new Struct(); }
+
+void DeleteStruct(Struct* s) { delete s; }
+
+Value* NewValue() { return new Value(); }
+
+void DeleteValue(Value* value) { delete value; }
+
+void StructToTokens(const Struct& s, rust::Vec<ValueToken>& tokens) {
+    AppendStruct(s, nullptr, tokens);
+}
+
+void ValueToTokens(const Value& value, rust::Vec<ValueToken>& tokens) {
+    AppendValue(value, nullptr, tokens);
+}
+
+bool StructFromTokens(Struct& s, rust::Slice<const ValueToken> tokens) {
+    s.Clear();
+    size_t pos = 0;
+    if (tokens.empty() || tokens[0].kind != ValueKind::Struct) {
+        return false;
+    }
+    return BuildStruct(s, tokens, &pos) && pos == tokens.size();
+}
+
+bool ValueFromTokens(Value& value, rust::Slice<const ValueToken> tokens) {
+    value.Clear();
+    size_t pos = 0;
+    if (tokens.empty()) {
+        return false;
+    }
+    return BuildValue(value, tokens, &pos) && pos == tokens.size();
+}
+
+}  // namespace struct_value
+}  // namespace protobuf_native
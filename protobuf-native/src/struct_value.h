@@ -0,0 +1,39 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "google/protobuf/struct.pb.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace struct_value {
+
+using namespace google::protobuf;
+
+struct ValueToken;
+
+Struct* NewStruct();
+void DeleteStruct(Struct* s);
+Value* NewValue();
+void DeleteValue(Value* value);
+
+void StructToTokens(const Struct& s, rust::Vec<ValueToken>& tokens);
+void ValueToTokens(const Value& value, rust::Vec<ValueToken>& tokens);
+bool StructFromTokens(Struct& s, rust::Slice<const ValueToken> tokens);
+bool ValueFromTokens(Value& value, rust::Slice<const ValueToken> tokens);
+
+}  // namespace struct_value
+}  // namespace protobuf_native
@@ -0,0 +1,428 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Conversion between `google.protobuf.Struct` and `serde_json`.
+//!
+//! A [`Struct`] holds dynamic JSON data as a protocol buffer message: a map
+//! from strings to [`Value`]s, each of which is null, a number, a string, a
+//! boolean, a nested struct or a list of values. This module converts
+//! structs and values to and from [`serde_json::Value`]s, and serializes
+//! them with any [`serde::Serializer`], without printing or parsing JSON
+//! text.
+//!
+//! Each conversion crosses into C++ once. Converting from a message, C++
+//! walks the message and records every value, in order, in a flat array
+//! whose strings point into the message; Rust then builds the
+//! `serde_json::Value`, or drives the serializer, from that array.
+//! Converting to a message works in reverse, with an array whose strings
+//! point into the `serde_json::Value`.
+//!
+//! As in the [JSON mapping], whole numbers are converted to JSON integers,
+//! and numbers that are not finite, which JSON cannot represent, to null.
+//! JSON integers too large for a double lose precision.
+//!
+//! This module is only available if the `serde_json` feature is enabled.
+//!
+//! [JSON mapping]: https://protobuf.dev/programming-guides/proto3/#json
+//!
+//! # Examples
+//!
+//! ```
+//! use protobuf_native::struct_value::Struct;
+//! use serde_json::json;
+//!
+//! let config = json!({"name": "db", "replicas": 3, "tags": ["a", "b"]});
+//! let s = Struct::from_json(config.as_object().unwrap());
+//! assert_eq!(serde_json::Value::Object(s.to_json()), config);
+//! assert_eq!(serde_json::to_value(&*s)?, config);
+//! # Ok::<_, serde_json::Error>(())
+//! ```
+
+use std::borrow::Cow;
+use std::marker::PhantomPinned;
+use std::mem;
+use std::pin::Pin;
+use std::ptr;
+use std::slice;
+
+use serde::ser::{SerializeMap, SerializeSeq};
+use serde::{Serialize, Serializer};
+
+use crate::internal::unsafe_ffi_conversions;
+use crate::{private, Message, MessageLite};
+
+#[cxx::bridge(namespace = "protobuf_native::struct_value")]
+pub(crate) mod ffi {
+    #[repr(u8)]
+    enum ValueKind {
+        Null,
+        Number,
+        String,
+        Bool,
+        Struct,
+        List,
+    }
+
+    /// A value in the preorder walk of a struct or value.
+    struct ValueToken {
+        kind: ValueKind,
+        boolean: bool,
+        number: f64,
+        /// The key of the value, if it is a field of a struct.
+        key: *const u8,
+        key_len: usize,
+        string: *const u8,
+        string_len: usize,
+        /// The number of fields of a struct, or elements of a list.
+        len: usize,
+        /// The number of tokens for the value, including those of its fields
+        /// or elements, which follow it.
+        size: usize,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/struct_value.h");
+
+        #[namespace = "google::protobuf"]
+        type Struct;
+        #[namespace = "google::protobuf"]
+        type Value;
+
+        fn NewStruct() -> *mut Struct;
+        unsafe fn DeleteStruct(s: *mut Struct);
+        fn NewValue() -> *mut Value;
+        unsafe fn DeleteValue(value: *mut Value);
+
+        fn StructToTokens(s: &Struct, tokens: &mut Vec<ValueToken>);
+        fn ValueToTokens(value: &Value, tokens: &mut Vec<ValueToken>);
+        unsafe fn StructFromTokens(s: Pin<&mut Struct>, tokens: &[ValueToken]) -> bool;
+        unsafe fn ValueFromTokens(value: Pin<&mut Value>, tokens: &[ValueToken]) -> bool;
+    }
+}
+
+/// A `google.protobuf.Struct`: a map from strings to [`Value`]s, which
+/// represents a JSON object.
+pub struct Struct {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for Struct {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteStruct(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Struct {
+    /// Creates a new empty struct.
+    pub fn new() -> Pin<Box<Struct>> {
+        let s = ffi::NewStruct();
+        unsafe { Self::from_ffi_owned(s) }
+    }
+
+    /// Creates a struct with the contents of `object`.
+    pub fn from_json(object: &serde_json::Map<String, serde_json::Value>) -> Pin<Box<Struct>> {
+        let mut s = Struct::new();
+        s.as_mut().set_json(object);
+        s
+    }
+
+    /// Replaces the contents of this struct with those of `object`.
+    pub fn set_json(self: Pin<&mut Self>, object: &serde_json::Map<String, serde_json::Value>) {
+        let mut tokens = vec![];
+        push_object(None, object, &mut tokens);
+        // SAFETY: the tokens were built by `push_object`, and their strings
+        // point into `object`, which outlives the call.
+        let ok = unsafe { ffi::StructFromTokens(self.as_ffi_mut(), &tokens) };
+        assert!(ok, "malformed struct tokens");
+    }
+
+    /// Converts this struct to a JSON object.
+    pub fn to_json(&self) -> serde_json::Map<String, serde_json::Value> {
+        let mut tokens = vec![];
+        ffi::StructToTokens(self.as_ffi(), &mut tokens);
+        match token_to_json(&tokens) {
+            serde_json::Value::Object(object) => object,
+            _ => unreachable!("struct converted to a non-object"),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::Struct);
+}
+
+impl Serialize for Struct {
+    fn serialize<S>(&self, serializer: S) -> Result<S::Ok, S::Error>
+    where
+        S: Serializer,
+    {
+        let mut tokens = vec![];
+        ffi::StructToTokens(self.as_ffi(), &mut tokens);
+        Tokens(&tokens).serialize(serializer)
+    }
+}
+
+impl MessageLite for Struct {}
+
+impl private::MessageLite for Struct {
+    fn upcast(&self) -> &crate::ffi::MessageLite {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut crate::ffi::MessageLite> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+impl Message for Struct {}
+impl private::Message for Struct {}
+
+/// A `google.protobuf.Value`: a null, a number, a string, a boolean, a
+/// [`Struct`] or a list of values, which represents a JSON value.
+pub struct Value {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for Value {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteValue(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Value {
+    /// Creates a new value with no kind set, which converts to JSON null.
+    pub fn new() -> Pin<Box<Value>> {
+        let value = ffi::NewValue();
+        unsafe { Self::from_ffi_owned(value) }
+    }
+
+    /// Creates a value with the contents of `value`.
+    pub fn from_json(value: &serde_json::Value) -> Pin<Box<Value>> {
+        let mut v = Value::new();
+        v.as_mut().set_json(value);
+        v
+    }
+
+    /// Replaces the contents of this value with those of `value`.
+    pub fn set_json(self: Pin<&mut Self>, value: &serde_json::Value) {
+        let mut tokens = vec![];
+        push_value(None, value, &mut tokens);
+        // SAFETY: the tokens were built by `push_value`, and their strings
+        // point into `value`, which outlives the call.
+        let ok = unsafe { ffi::ValueFromTokens(self.as_ffi_mut(), &tokens) };
+        assert!(ok, "malformed value tokens");
+    }
+
+    /// Converts this value to a JSON value.
+    pub fn to_json(&self) -> serde_json::Value {
+        let mut tokens = vec![];
+        ffi::ValueToTokens(self.as_ffi(), &mut tokens);
+        token_to_json(&tokens)
+    }
+
+    unsafe_ffi_conversions!(ffi::Value);
+}
+
+impl Serialize for Value {
+    fn serialize<S>(&self, serializer: S) -> Result<S::Ok, S::Error>
+    where
+        S: Serializer,
+    {
+        let mut tokens = vec![];
+        ffi::ValueToTokens(self.as_ffi(), &mut tokens);
+        Tokens(&tokens).serialize(serializer)
+    }
+}
+
+impl MessageLite for Value {}
+
+impl private::MessageLite for Value {
+    fn upcast(&self) -> &crate::ffi::MessageLite {
+        unsafe { mem::transmute(self) }
+    }
+
+    fn upcast_mut(self: Pin<&mut Self>) -> Pin<&mut crate::ffi::MessageLite> {
+        unsafe { mem::transmute(self) }
+    }
+}
+
+impl Message for Value {}
+impl private::Message for Value {}
+
+/// The largest magnitude below which every whole double is exactly
+/// representable as an integer, 2^53.
+const MAX_SAFE_INTEGER: f64 = 9_007_199_254_740_992.0;
+
+/// Returns `number` as an integer if it is whole and exactly representable.
+fn as_integer(number: f64) -> Option<i64> {
+    (number.fract() == 0.0 && number.abs() < MAX_SAFE_INTEGER).then(|| number as i64)
+}
+
+/// Returns the `len` bytes at `ptr`, which may be null if `len` is zero.
+///
+/// # Safety
+///
+/// The bytes must be valid for `'a`.
+unsafe fn token_bytes<'a>(ptr: *const u8, len: usize) -> &'a [u8] {
+    match len {
+        0 => &[],
+        _ => slice::from_raw_parts(ptr, len),
+    }
+}
+
+// The tokens passed to these functions are only ever those that a struct or
+// value has just converted itself to, while it is still borrowed, so their
+// strings are valid.
+
+fn token_key(token: &ffi::ValueToken) -> Cow<'_, str> {
+    // SAFETY: see above.
+    String::from_utf8_lossy(unsafe { token_bytes(token.key, token.key_len) })
+}
+
+fn token_string(token: &ffi::ValueToken) -> Cow<'_, str> {
+    // SAFETY: see above.
+    String::from_utf8_lossy(unsafe { token_bytes(token.string, token.string_len) })
+}
+
+/// Iterates over the subtrees of the fields or elements of the struct or
+/// list at the start of `tokens`.
+fn children(tokens: &[ffi::ValueToken]) -> impl Iterator<Item = &[ffi::ValueToken]> {
+    let mut rest = &tokens[1..tokens[0].size];
+    (0..tokens[0].len).map(move |_| {
+        let (child, tail) = rest.split_at(rest[0].size);
+        rest = tail;
+        child
+    })
+}
+
+/// Converts the value at the start of `tokens` to a JSON value.
+fn token_to_json(tokens: &[ffi::ValueToken]) -> serde_json::Value {
+    let token = &tokens[0];
+    match token.kind {
+        ffi::ValueKind::Number => match as_integer(token.number) {
+            Some(n) => serde_json::Value::from(n),
+            None => serde_json::Number::from_f64(token.number)
+                .map_or(serde_json::Value::Null, serde_json::Value::Number),
+        },
+        ffi::ValueKind::String => serde_json::Value::String(token_string(token).into_owned()),
+        ffi::ValueKind::Bool => serde_json::Value::Bool(token.boolean),
+        ffi::ValueKind::Struct => serde_json::Value::Object(
+            children(tokens)
+                .map(|child| (token_key(&child[0]).into_owned(), token_to_json(child)))
+                .collect(),
+        ),
+        ffi::ValueKind::List => {
+            serde_json::Value::Array(children(tokens).map(token_to_json).collect())
+        }
+        _ => serde_json::Value::Null,
+    }
+}
+
+/// Serializes the value at the start of a slice of tokens.
+struct Tokens<'a>(&'a [ffi::ValueToken]);
+
+impl Serialize for Tokens<'_> {
+    fn serialize<S>(&self, serializer: S) -> Result<S::Ok, S::Error>
+    where
+        S: Serializer,
+    {
+        let token = &self.0[0];
+        match token.kind {
+            ffi::ValueKind::Number => match as_integer(token.number) {
+                Some(n) => serializer.serialize_i64(n),
+                None => serializer.serialize_f64(token.number),
+            },
+            ffi::ValueKind::String => serializer.serialize_str(&token_string(token)),
+            ffi::ValueKind::Bool => serializer.serialize_bool(token.boolean),
+            ffi::ValueKind::Struct => {
+                let mut map = serializer.serialize_map(Some(token.len))?;
+                for child in children(self.0) {
+                    map.serialize_entry(&token_key(&child[0]), &Tokens(child))?;
+                }
+                map.end()
+            }
+            ffi::ValueKind::List => {
+                let mut seq = serializer.serialize_seq(Some(token.len))?;
+                for child in children(self.0) {
+                    seq.serialize_element(&Tokens(child))?;
+                }
+                seq.end()
+            }
+            _ => serializer.serialize_unit(),
+        }
+    }
+}
+
+fn new_token(kind: ffi::ValueKind, key: Option<&str>) -> ffi::ValueToken {
+    let key = key.unwrap_or_default();
+    ffi::ValueToken {
+        kind,
+        boolean: false,
+        number: 0.0,
+        key: key.as_ptr(),
+        key_len: key.len(),
+        string: ptr::null(),
+        string_len: 0,
+        len: 0,
+        size: 1,
+    }
+}
+
+/// Appends the tokens of `object`, keyed by `key`, to `tokens`.
+fn push_object(
+    key: Option<&str>,
+    object: &serde_json::Map<String, serde_json::Value>,
+    tokens: &mut Vec<ffi::ValueToken>,
+) {
+    let index = tokens.len();
+    tokens.push(ffi::ValueToken {
+        len: object.len(),
+        ..new_token(ffi::ValueKind::Struct, key)
+    });
+    for (key, value) in object {
+        push_value(Some(key), value, tokens);
+    }
+    tokens[index].size = tokens.len() - index;
+}
+
+/// Appends the tokens of `value`, keyed by `key`, to `tokens`.
+fn push_value(key: Option<&str>, value: &serde_json::Value, tokens: &mut Vec<ffi::ValueToken>) {
+    match value {
+        serde_json::Value::Null => tokens.push(new_token(ffi::ValueKind::Null, key)),
+        serde_json::Value::Bool(b) => tokens.push(ffi::ValueToken {
+            boolean: *b,
+            ..new_token(ffi::ValueKind::Bool, key)
+        }),
+        serde_json::Value::Number(n) => tokens.push(ffi::ValueToken {
+            number: n.as_f64().unwrap_or(f64::NAN),
+            ..new_token(ffi::ValueKind::Number, key)
+        }),
+        serde_json::Value::String(s) => tokens.push(ffi::ValueToken {
+            string: s.as_ptr(),
+            string_len: s.len(),
+            ..new_token(ffi::ValueKind::String, key)
+        }),
+        serde_json::Value::Array(elements) => {
+            let index = tokens.len();
+            tokens.push(ffi::ValueToken {
+                len: elements.len(),
+                ..new_token(ffi::ValueKind::List, key)
+            });
+            for element in elements {
+                push_value(None, element, tokens);
+            }
+            tokens[index].size = tokens.len() - index;
+        }
+        serde_json::Value::Object(object) => push_object(key, object, tokens),
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/text_format.h"
+
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "google/protobuf/io/tokenizer.h"
+
+namespace protobuf_native {
+namespace text_format {
+
+namespace {
+
+// Records the first error reported by a parser, rather than logging every
+// error as the parser does by default.
+class FirstErrorCollector : public io::ErrorCollector {
+   public:
+    FirstErrorCollector(rust::String& error) : error_(error) {}
+
+    void RecordError(int line, io::ColumnNumber column, absl::string_view message) override {
+        if (!has_error_) {
+            // Lines and columns are zero-based, or -1 if the error does not
+            // relate to a particular location.
+            error_ = rust::String::lossy(
+                line < 0 ? std::string(message)
+                         : absl::StrFormat("%d:%d: %s", line + 1, column + 1, message));
+            has_error_ = true;
+        }
+    }
+
+   private:
+    rust::String& error_;
+    bool has_error_ = false;
+};
+
+}  // namespace
+
+Printer* NewPrinter() { return new Printer(); }
+
+void DeletePrinter(Printer* printer) { delete printer; }
+
+Parser* NewParser() { return new Parser(); }
+
+void DeleteParser(Parser* parser) { delete parser; }
+
+bool ParserParse(Parser& parser, io::ZeroCopyInputStream* input, Message& message,
+                 rust::String& error) {
+    FirstErrorCollector errors(error);
+    parser.RecordErrorsTo(&errors);
+    bool ok = parser.Parse(input, &message);
+    parser.RecordErrorsTo(nullptr);
+    return ok;
+}
+
+bool ParserMerge(Parser& parser, io::ZeroCopyInputStream* input, Message& message,
+                 rust::String& error) {
+    FirstErrorCollector errors(error);
+    parser.RecordErrorsTo(&errors);
+    bool ok = parser.Merge(input, &message);
+    parser.RecordErrorsTo(nullptr);
+    return ok;
+}
+
+}  // namespace text_format
+}  // namespace protobuf_native
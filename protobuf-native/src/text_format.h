@@ -0,0 +1,43 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "absl/strings/string_view.h"
+#include "google/protobuf/io/zero_copy_stream.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/text_format.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace text_format {
+
+using namespace google::protobuf;
+
+using Printer = TextFormat::Printer;
+using Parser = TextFormat::Parser;
+
+Printer* NewPrinter();
+void DeletePrinter(Printer* printer);
+
+Parser* NewParser();
+void DeleteParser(Parser* parser);
+bool ParserParse(Parser& parser, io::ZeroCopyInputStream* input, Message& message,
+                 rust::String& error);
+bool ParserMerge(Parser& parser, io::ZeroCopyInputStream* input, Message& message,
+                 rust::String& error);
+
+}  // namespace text_format
+}  // namespace protobuf_native
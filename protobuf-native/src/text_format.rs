@@ -0,0 +1,365 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Conversion between protocol buffers and the text format.
+//!
+//! The text format is a human-readable representation of messages, commonly
+//! used for configuration and test data. A [`Printer`] writes messages in the
+//! text format and a [`Parser`] reads them. Both can be configured once and
+//! reused for any number of messages, and both operate directly on zero-copy
+//! streams.
+
+use std::error::Error;
+use std::fmt;
+use std::marker::PhantomPinned;
+use std::mem;
+use std::pin::Pin;
+
+use crate::internal::{unsafe_ffi_conversions, BoolExt, CInt};
+use crate::io::{SliceInputStream, VecOutputStream, ZeroCopyInputStream, ZeroCopyOutputStream};
+use crate::{private, Message, OperationFailedError};
+
+#[cxx::bridge(namespace = "protobuf_native::text_format")]
+pub(crate) mod ffi {
+    unsafe extern "C++" {
+        include!("protobuf-native/src/text_format.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "protobuf_native::internal"]
+        type CInt = crate::internal::CInt;
+
+        #[namespace = "google::protobuf"]
+        type Message = crate::ffi::Message;
+
+        #[namespace = "google::protobuf::io"]
+        type ZeroCopyInputStream = crate::io::ffi::ZeroCopyInputStream;
+
+        #[namespace = "google::protobuf::io"]
+        type ZeroCopyOutputStream = crate::io::ffi::ZeroCopyOutputStream;
+
+        type Printer;
+        fn NewPrinter() -> *mut Printer;
+        unsafe fn DeletePrinter(printer: *mut Printer);
+        unsafe fn Print(
+            self: &Printer,
+            message: &Message,
+            output: *mut ZeroCopyOutputStream,
+        ) -> bool;
+        fn SetInitialIndentLevel(self: Pin<&mut Printer>, indent_level: CInt);
+        fn SetSingleLineMode(self: Pin<&mut Printer>, single_line_mode: bool);
+        fn SetUseFieldNumber(self: Pin<&mut Printer>, use_field_number: bool);
+        fn SetUseShortRepeatedPrimitives(self: Pin<&mut Printer>, use_short: bool);
+        fn SetUseUtf8StringEscaping(self: Pin<&mut Printer>, as_utf8: bool);
+        fn SetHideUnknownFields(self: Pin<&mut Printer>, hide: bool);
+        fn SetPrintMessageFieldsInIndexOrder(self: Pin<&mut Printer>, in_index_order: bool);
+        fn SetExpandAny(self: Pin<&mut Printer>, expand: bool);
+        fn SetTruncateStringFieldLongerThan(self: Pin<&mut Printer>, truncate: i64);
+
+        type Parser;
+        fn NewParser() -> *mut Parser;
+        unsafe fn DeleteParser(parser: *mut Parser);
+        unsafe fn ParserParse(
+            parser: Pin<&mut Parser>,
+            input: *mut ZeroCopyInputStream,
+            message: Pin<&mut Message>,
+            error: &mut String,
+        ) -> bool;
+        unsafe fn ParserMerge(
+            parser: Pin<&mut Parser>,
+            input: *mut ZeroCopyInputStream,
+            message: Pin<&mut Message>,
+            error: &mut String,
+        ) -> bool;
+        fn AllowPartialMessage(self: Pin<&mut Parser>, allow: bool);
+        fn AllowCaseInsensitiveField(self: Pin<&mut Parser>, allow: bool);
+        fn AllowUnknownExtension(self: Pin<&mut Parser>, allow: bool);
+        fn AllowUnknownField(self: Pin<&mut Parser>, allow: bool);
+        fn AllowFieldNumber(self: Pin<&mut Parser>, allow: bool);
+        fn SetRecursionLimit(self: Pin<&mut Parser>, limit: CInt);
+    }
+}
+
+/// Prints messages in the text format.
+///
+/// A printer holds only its configuration, so a single printer can be
+/// configured once and used to print any number of messages.
+pub struct Printer {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for Printer {
+    fn drop(&mut self) {
+        unsafe { ffi::DeletePrinter(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Printer {
+    /// Creates a printer with the default configuration.
+    pub fn new() -> Pin<Box<Printer>> {
+        let printer = ffi::NewPrinter();
+        unsafe { Self::from_ffi_owned(printer) }
+    }
+
+    /// Writes `message` in the text format to `output`.
+    pub fn print(
+        &self,
+        message: &dyn Message,
+        output: Pin<&mut dyn ZeroCopyOutputStream>,
+    ) -> Result<(), OperationFailedError> {
+        let message: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+        unsafe {
+            self.as_ffi()
+                .Print(message, output.upcast_mut_ptr())
+                .as_result()
+        }
+    }
+
+    /// Prints `message` in the text format to a string.
+    ///
+    /// Any bytes in the output that are not valid UTF-8 are replaced with
+    /// U+FFFD REPLACEMENT CHARACTER. Such bytes are only printed if UTF-8
+    /// string escaping is enabled and a string field contains invalid UTF-8.
+    pub fn print_to_string(&self, message: &dyn Message) -> Result<String, OperationFailedError> {
+        let mut output = vec![];
+        self.print(message, VecOutputStream::new(&mut output).as_mut())?;
+        match String::from_utf8(output) {
+            Ok(output) => Ok(output),
+            Err(e) => Ok(String::from_utf8_lossy(e.as_bytes()).into_owned()),
+        }
+    }
+
+    /// Sets the number of levels by which to indent the top-level fields.
+    ///
+    /// The default is zero.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `indent_level` is not representable as a C int.
+    pub fn set_initial_indent_level(self: Pin<&mut Self>, indent_level: usize) {
+        self.as_ffi_mut()
+            .SetInitialIndentLevel(CInt::expect_from(indent_level))
+    }
+
+    /// Sets whether to print the message on a single line, with fields
+    /// separated by spaces rather than newlines.
+    pub fn set_single_line_mode(self: Pin<&mut Self>, single_line_mode: bool) {
+        self.as_ffi_mut().SetSingleLineMode(single_line_mode)
+    }
+
+    /// Sets whether to print field numbers rather than field names.
+    pub fn set_use_field_number(self: Pin<&mut Self>, use_field_number: bool) {
+        self.as_ffi_mut().SetUseFieldNumber(use_field_number)
+    }
+
+    /// Sets whether to print repeated primitive fields as a single list, as in
+    /// `f: [1, 2, 3]`, rather than repeating the field name for each element.
+    pub fn set_use_short_repeated_primitives(self: Pin<&mut Self>, use_short: bool) {
+        self.as_ffi_mut().SetUseShortRepeatedPrimitives(use_short)
+    }
+
+    /// Sets whether to print UTF-8 in string fields as is, rather than
+    /// escaping every non-ASCII byte.
+    pub fn set_use_utf8_string_escaping(self: Pin<&mut Self>, as_utf8: bool) {
+        self.as_ffi_mut().SetUseUtf8StringEscaping(as_utf8)
+    }
+
+    /// Sets whether to omit unknown fields from the output.
+    pub fn set_hide_unknown_fields(self: Pin<&mut Self>, hide: bool) {
+        self.as_ffi_mut().SetHideUnknownFields(hide)
+    }
+
+    /// Sets whether to print fields in the order they are declared in the
+    /// .proto file, rather than in field number order.
+    pub fn set_print_message_fields_in_index_order(self: Pin<&mut Self>, in_index_order: bool) {
+        self.as_ffi_mut()
+            .SetPrintMessageFieldsInIndexOrder(in_index_order)
+    }
+
+    /// Sets whether to print the contents of `google.protobuf.Any` messages
+    /// whose type can be found, rather than their encoded bytes.
+    pub fn set_expand_any(self: Pin<&mut Self>, expand: bool) {
+        self.as_ffi_mut().SetExpandAny(expand)
+    }
+
+    /// Sets the length beyond which string fields are truncated when printed,
+    /// or zero not to truncate them.
+    ///
+    /// The default is zero. Truncated output cannot be parsed back into an
+    /// identical message.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `truncate` is not representable as an `i64`.
+    pub fn set_truncate_string_field_longer_than(self: Pin<&mut Self>, truncate: usize) {
+        let truncate = i64::try_from(truncate).expect("truncation length too large");
+        self.as_ffi_mut().SetTruncateStringFieldLongerThan(truncate)
+    }
+
+    unsafe_ffi_conversions!(ffi::Printer);
+}
+
+/// Parses messages from the text format.
+///
+/// A parser holds only its configuration, so a single parser can be
+/// configured once and used to parse any number of messages.
+pub struct Parser {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for Parser {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteParser(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Parser {
+    /// Creates a parser with the default configuration.
+    pub fn new() -> Pin<Box<Parser>> {
+        let parser = ffi::NewParser();
+        unsafe { Self::from_ffi_owned(parser) }
+    }
+
+    /// Clears `message`, then parses the text format read from `input` into
+    /// it.
+    pub fn parse(
+        self: Pin<&mut Self>,
+        input: Pin<&mut dyn ZeroCopyInputStream>,
+        message: Pin<&mut dyn Message>,
+    ) -> Result<(), TextFormatError> {
+        let message: Pin<&mut ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) };
+        let mut error = String::new();
+        let ok = unsafe {
+            ffi::ParserParse(
+                self.as_ffi_mut(),
+                input.upcast_mut_ptr(),
+                message,
+                &mut error,
+            )
+        };
+        TextFormatError::check(ok, error)
+    }
+
+    /// Like [`Parser::parse`], but parses from a string.
+    pub fn parse_from_str(
+        self: Pin<&mut Self>,
+        input: &str,
+        message: Pin<&mut dyn Message>,
+    ) -> Result<(), TextFormatError> {
+        self.parse(SliceInputStream::new(input.as_bytes()).as_mut(), message)
+    }
+
+    /// Parses the text format read from `input` into `message`.
+    ///
+    /// Singular fields present in the input replace those in `message`, while
+    /// repeated fields are appended to, as with
+    /// [`MessageLite::merge_from_bytes`](crate::MessageLite::merge_from_bytes).
+    pub fn merge(
+        self: Pin<&mut Self>,
+        input: Pin<&mut dyn ZeroCopyInputStream>,
+        message: Pin<&mut dyn Message>,
+    ) -> Result<(), TextFormatError> {
+        let message: Pin<&mut ffi::Message> =
+            unsafe { mem::transmute(private::MessageLite::upcast_mut(message)) };
+        let mut error = String::new();
+        let ok = unsafe {
+            ffi::ParserMerge(
+                self.as_ffi_mut(),
+                input.upcast_mut_ptr(),
+                message,
+                &mut error,
+            )
+        };
+        TextFormatError::check(ok, error)
+    }
+
+    /// Like [`Parser::merge`], but parses from a string.
+    pub fn merge_from_str(
+        self: Pin<&mut Self>,
+        input: &str,
+        message: Pin<&mut dyn Message>,
+    ) -> Result<(), TextFormatError> {
+        self.merge(SliceInputStream::new(input.as_bytes()).as_mut(), message)
+    }
+
+    /// Sets whether to accept messages that are missing required fields.
+    pub fn allow_partial_message(self: Pin<&mut Self>, allow: bool) {
+        self.as_ffi_mut().AllowPartialMessage(allow)
+    }
+
+    /// Sets whether to match field names case insensitively.
+    pub fn allow_case_insensitive_field(self: Pin<&mut Self>, allow: bool) {
+        self.as_ffi_mut().AllowCaseInsensitiveField(allow)
+    }
+
+    /// Sets whether to skip extensions that cannot be found, rather than
+    /// failing.
+    pub fn allow_unknown_extension(self: Pin<&mut Self>, allow: bool) {
+        self.as_ffi_mut().AllowUnknownExtension(allow)
+    }
+
+    /// Sets whether to skip fields that are not fields of the message, rather
+    /// than failing.
+    ///
+    /// Skipping unknown fields can hide typos in field names, so this should
+    /// be used with care.
+    pub fn allow_unknown_field(self: Pin<&mut Self>, allow: bool) {
+        self.as_ffi_mut().AllowUnknownField(allow)
+    }
+
+    /// Sets whether to accept field numbers in place of field names.
+    pub fn allow_field_number(self: Pin<&mut Self>, allow: bool) {
+        self.as_ffi_mut().AllowFieldNumber(allow)
+    }
+
+    /// Sets the maximum depth of nested messages to parse.
+    ///
+    /// The default is 100.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `limit` is not representable as a C int.
+    pub fn set_recursion_limit(self: Pin<&mut Self>, limit: usize) {
+        self.as_ffi_mut()
+            .SetRecursionLimit(CInt::expect_from(limit))
+    }
+
+    unsafe_ffi_conversions!(ffi::Parser);
+}
+
+/// An error that occurred while parsing the text format.
+#[derive(Debug, Clone, Eq, PartialEq, Hash)]
+pub struct TextFormatError(String);
+
+impl TextFormatError {
+    fn check(ok: bool, error: String) -> Result<(), TextFormatError> {
+        match (ok, error) {
+            (true, _) => Ok(()),
+            (false, error) if error.is_empty() => {
+                Err(TextFormatError("failed to parse text format".into()))
+            }
+            (false, error) => Err(TextFormatError(error)),
+        }
+    }
+}
+
+impl fmt::Display for TextFormatError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        f.write_str(&self.0)
+    }
+}
+
+impl Error for TextFormatError {}
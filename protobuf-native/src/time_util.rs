@@ -0,0 +1,311 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Batch conversions of timestamps and durations.
+//!
+//! [`Timestamp`] and [`Duration`] have the layout of the fields of the
+//! `google.protobuf.Timestamp` and `google.protobuf.Duration` well-known
+//! types. The functions in this module convert whole slices of them to and
+//! from nanosecond counts, and format timestamps as RFC 3339 strings, with
+//! the same results as the corresponding functions of libprotobuf's
+//! `util::TimeUtil`.
+//!
+//! The conversions are implemented in Rust rather than by calling into
+//! `TimeUtil`, which would cross into C++ once per value. The loops over the
+//! slices do not branch on the values they convert: an invalid or
+//! unrepresentable value is only reported once the whole slice has been
+//! converted.
+//!
+//! # Examples
+//!
+//! ```
+//! use protobuf_native::time_util::{self, Timestamp};
+//!
+//! let timestamps = [
+//!     Timestamp { seconds: 0, nanos: 0 },
+//!     Timestamp { seconds: 1, nanos: 500_000_000 },
+//! ];
+//! let mut nanos = [0; 2];
+//! time_util::timestamps_to_nanos(&timestamps, &mut nanos)?;
+//! assert_eq!(nanos, [0, 1_500_000_000]);
+//!
+//! let mut s = String::new();
+//! time_util::format_timestamp(&timestamps[1], &mut s)?;
+//! assert_eq!(s, "1970-01-01T00:00:01.500Z");
+//! # Ok::<_, protobuf_native::OperationFailedError>(())
+//! ```
+
+use std::str;
+
+use crate::OperationFailedError;
+
+const NANOS_PER_SECOND: i64 = 1_000_000_000;
+const SECONDS_PER_DAY: i64 = 86_400;
+
+/// The earliest valid timestamp, 0001-01-01T00:00:00Z, in seconds.
+const TIMESTAMP_MIN_SECONDS: i64 = -62_135_596_800;
+
+/// The latest valid timestamp, 9999-12-31T23:59:59Z, in seconds.
+const TIMESTAMP_MAX_SECONDS: i64 = 253_402_300_799;
+
+/// The longest valid duration, about 10,000 years, in seconds.
+const DURATION_MAX_SECONDS: i64 = 315_576_000_000;
+
+/// The length of the longest RFC 3339 string produced by
+/// [`format_timestamp`].
+const MAX_RFC3339_LEN: usize = "0001-01-01T00:00:00.000000000Z".len();
+
+/// A point in time, independent of any time zone or calendar, like a
+/// `google.protobuf.Timestamp`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct Timestamp {
+    /// The seconds since the Unix epoch, 1970-01-01T00:00:00Z.
+    ///
+    /// Must be from 0001-01-01T00:00:00Z to 9999-12-31T23:59:59Z inclusive.
+    pub seconds: i64,
+    /// The non-negative fraction of a second, in nanoseconds.
+    ///
+    /// Must be from 0 to 999,999,999 inclusive. Negative timestamps with a
+    /// fraction count the nanoseconds forward from the preceding second.
+    pub nanos: i32,
+}
+
+impl Timestamp {
+    /// Reports whether the timestamp is within the valid range.
+    pub fn is_valid(&self) -> bool {
+        (TIMESTAMP_MIN_SECONDS..=TIMESTAMP_MAX_SECONDS).contains(&self.seconds)
+            && (0..NANOS_PER_SECOND as i32).contains(&self.nanos)
+    }
+}
+
+/// A signed span of time, like a `google.protobuf.Duration`.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq, PartialOrd, Ord, Hash)]
+pub struct Duration {
+    /// The whole seconds of the span.
+    ///
+    /// Must be from -315,576,000,000 to 315,576,000,000 inclusive.
+    pub seconds: i64,
+    /// The fraction of a second, in nanoseconds.
+    ///
+    /// Must be from -999,999,999 to 999,999,999 inclusive, and must not have
+    /// the opposite sign of `seconds`.
+    pub nanos: i32,
+}
+
+impl Duration {
+    /// Reports whether the duration is within the valid range.
+    pub fn is_valid(&self) -> bool {
+        (-DURATION_MAX_SECONDS..=DURATION_MAX_SECONDS).contains(&self.seconds)
+            && (-(NANOS_PER_SECOND as i32) + 1..NANOS_PER_SECOND as i32).contains(&self.nanos)
+            && !(self.seconds < 0 && self.nanos > 0 || self.seconds > 0 && self.nanos < 0)
+    }
+}
+
+/// Converts each timestamp in `timestamps` to nanoseconds since the Unix
+/// epoch, storing the results in the corresponding elements of `nanos`.
+///
+/// Returns an error if any of the timestamps is invalid, or outside the
+/// range of an `i64` count of nanoseconds, which spans from September 1677
+/// to April 2262. The contents of `nanos` are unspecified after an error.
+///
+/// # Panics
+///
+/// Panics if the slices have different lengths.
+pub fn timestamps_to_nanos(
+    timestamps: &[Timestamp],
+    nanos: &mut [i64],
+) -> Result<(), OperationFailedError> {
+    assert_eq!(
+        timestamps.len(),
+        nanos.len(),
+        "timestamps and nanos have different lengths"
+    );
+    let mut failed = false;
+    for (timestamp, nanos) in timestamps.iter().zip(nanos) {
+        let (value, overflow) = to_nanos(timestamp.seconds, timestamp.nanos);
+        failed |= overflow | !timestamp.is_valid();
+        *nanos = value;
+    }
+    match failed {
+        false => Ok(()),
+        true => Err(OperationFailedError),
+    }
+}
+
+/// Converts each count of nanoseconds since the Unix epoch in `nanos` to a
+/// timestamp, storing the results in the corresponding elements of
+/// `timestamps`.
+///
+/// Every `i64` count of nanoseconds is a valid timestamp.
+///
+/// # Panics
+///
+/// Panics if the slices have different lengths.
+pub fn nanos_to_timestamps(nanos: &[i64], timestamps: &mut [Timestamp]) {
+    assert_eq!(
+        nanos.len(),
+        timestamps.len(),
+        "nanos and timestamps have different lengths"
+    );
+    for (nanos, timestamp) in nanos.iter().zip(timestamps) {
+        *timestamp = Timestamp {
+            seconds: nanos.div_euclid(NANOS_PER_SECOND),
+            nanos: nanos.rem_euclid(NANOS_PER_SECOND) as i32,
+        };
+    }
+}
+
+/// Converts each duration in `durations` to nanoseconds, storing the results
+/// in the corresponding elements of `nanos`.
+///
+/// Returns an error if any of the durations is invalid, or outside the range
+/// of an `i64` count of nanoseconds, which spans about 292 years in either
+/// direction. The contents of `nanos` are unspecified after an error.
+///
+/// # Panics
+///
+/// Panics if the slices have different lengths.
+pub fn durations_to_nanos(
+    durations: &[Duration],
+    nanos: &mut [i64],
+) -> Result<(), OperationFailedError> {
+    assert_eq!(
+        durations.len(),
+        nanos.len(),
+        "durations and nanos have different lengths"
+    );
+    let mut failed = false;
+    for (duration, nanos) in durations.iter().zip(nanos) {
+        let (value, overflow) = to_nanos(duration.seconds, duration.nanos);
+        failed |= overflow | !duration.is_valid();
+        *nanos = value;
+    }
+    match failed {
+        false => Ok(()),
+        true => Err(OperationFailedError),
+    }
+}
+
+/// Converts each count of nanoseconds in `nanos` to a duration, storing the
+/// results in the corresponding elements of `durations`.
+///
+/// Every `i64` count of nanoseconds is a valid duration.
+///
+/// # Panics
+///
+/// Panics if the slices have different lengths.
+pub fn nanos_to_durations(nanos: &[i64], durations: &mut [Duration]) {
+    assert_eq!(
+        nanos.len(),
+        durations.len(),
+        "nanos and durations have different lengths"
+    );
+    for (nanos, duration) in nanos.iter().zip(durations) {
+        // Division truncates towards zero, so the fraction takes the sign of
+        // the seconds, as a valid duration requires.
+        *duration = Duration {
+            seconds: nanos / NANOS_PER_SECOND,
+            nanos: (nanos % NANOS_PER_SECOND) as i32,
+        };
+    }
+}
+
+/// Appends `timestamp` to `out` as an RFC 3339 string in UTC, like
+/// `1972-01-01T10:00:20.021Z`.
+///
+/// As with `TimeUtil::ToString`, the fraction of a second is omitted if it
+/// is zero, and otherwise has 3, 6 or 9 digits, whichever is the fewest that
+/// represent it exactly.
+///
+/// Returns an error, leaving `out` unchanged, if the timestamp is invalid.
+pub fn format_timestamp(
+    timestamp: &Timestamp,
+    out: &mut String,
+) -> Result<(), OperationFailedError> {
+    if !timestamp.is_valid() {
+        return Err(OperationFailedError);
+    }
+    let days = timestamp.seconds.div_euclid(SECONDS_PER_DAY);
+    let time = timestamp.seconds.rem_euclid(SECONDS_PER_DAY) as u32;
+    let (year, month, day) = civil_from_days(days);
+
+    let mut buf = [0; MAX_RFC3339_LEN];
+    put_digits(&mut buf[0..4], year);
+    buf[4] = b'-';
+    put_digits(&mut buf[5..7], month);
+    buf[7] = b'-';
+    put_digits(&mut buf[8..10], day);
+    buf[10] = b'T';
+    put_digits(&mut buf[11..13], time / 3600);
+    buf[13] = b':';
+    put_digits(&mut buf[14..16], time / 60 % 60);
+    buf[16] = b':';
+    put_digits(&mut buf[17..19], time % 60);
+    let nanos = timestamp.nanos as u32;
+    let mut len = 19;
+    if nanos != 0 {
+        let (fraction, digits) = if nanos % 1_000_000 == 0 {
+            (nanos / 1_000_000, 3)
+        } else if nanos % 1_000 == 0 {
+            (nanos / 1_000, 6)
+        } else {
+            (nanos, 9)
+        };
+        buf[len] = b'.';
+        put_digits(&mut buf[len + 1..len + 1 + digits], fraction);
+        len += 1 + digits;
+    }
+    buf[len] = b'Z';
+    len += 1;
+    // SAFETY: only ASCII digits and punctuation have been written.
+    out.push_str(unsafe { str::from_utf8_unchecked(&buf[..len]) });
+    Ok(())
+}
+
+/// Computes `seconds * 10^9 + nanos`, reporting whether it overflowed.
+#[inline]
+fn to_nanos(seconds: i64, nanos: i32) -> (i64, bool) {
+    let (value, mul_overflow) = seconds.overflowing_mul(NANOS_PER_SECOND);
+    let (value, add_overflow) = value.overflowing_add(i64::from(nanos));
+    (value, mul_overflow | add_overflow)
+}
+
+/// Converts days since the Unix epoch to a year, month and day in the
+/// proleptic Gregorian calendar.
+///
+/// See: https://howardhinnant.github.io/date_algorithms.html#civil_from_days
+fn civil_from_days(days: i64) -> (u32, u32, u32) {
+    let z = days + 719_468;
+    let era = z.div_euclid(146_097);
+    let doe = z.rem_euclid(146_097);
+    let yoe = (doe - doe / 1_460 + doe / 36_524 - doe / 146_096) / 365;
+    let doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    let mp = (5 * doy + 2) / 153;
+    let day = doy - (153 * mp + 2) / 5 + 1;
+    let month = if mp < 10 { mp + 3 } else { mp - 9 };
+    let year = yoe + era * 400 + i64::from(month <= 2);
+    (year as u32, month as u32, day as u32)
+}
+
+/// Writes `value` as zero-padded decimal digits filling `buf`.
+#[inline]
+fn put_digits(buf: &mut [u8], mut value: u32) {
+    for b in buf.iter_mut().rev() {
+        *b = b'0' + (value % 10) as u8;
+        value /= 10;
+    }
+}
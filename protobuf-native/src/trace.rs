@@ -0,0 +1,134 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! `tracing` spans around the parse, serialize and descriptor building entry
+//! points.
+//!
+//! With the `tracing` feature enabled, each entry point opens a `TRACE`
+//! level span named after the method, whose fields are recorded only if a
+//! subscriber is interested in the span, so an uninterested process pays for
+//! a single check of the span's callsite. Without the feature, [`Span`] is
+//! empty and every call on it compiles to nothing.
+
+use crate::ffi;
+
+/// Opens a span named `$name` with the given fields, which start out empty.
+macro_rules! span {
+    ($name:literal $(, $field:ident)* $(,)?) => {{
+        #[cfg(feature = "tracing")]
+        let span = $crate::trace::Span(
+            tracing::trace_span!($name, $($field = tracing::field::Empty,)* ok = tracing::field::Empty)
+                .entered(),
+        );
+        #[cfg(not(feature = "tracing"))]
+        let span = $crate::trace::Span();
+        span
+    }};
+}
+
+/// Opens a span named `$name` for a call on `$message`, recording the
+/// message's type name.
+macro_rules! message_span {
+    ($name:literal, $message:expr) => {{
+        let span = $crate::trace::span!($name, message_type, bytes);
+        span.record_message_type($message);
+        span
+    }};
+}
+
+pub(crate) use {message_span, span};
+
+/// An entered span, which is exited when dropped.
+pub(crate) struct Span(#[cfg(feature = "tracing")] pub(crate) tracing::span::EnteredSpan);
+
+impl Span {
+    /// Reports whether a subscriber is interested in the span, so that
+    /// callers can skip computing the values of its fields if not.
+    #[cfg(feature = "tracing")]
+    #[inline]
+    pub(crate) fn is_enabled(&self) -> bool {
+        !self.0.is_disabled()
+    }
+
+    #[cfg(not(feature = "tracing"))]
+    #[inline]
+    pub(crate) fn is_enabled(&self) -> bool {
+        false
+    }
+
+    #[inline]
+    pub(crate) fn record_message_type(&self, message: &ffi::MessageLite) {
+        if self.is_enabled() {
+            #[cfg(feature = "tracing")]
+            self.0
+                .record("message_type", ffi::MessageLiteTypeName(message).as_str());
+        }
+        #[cfg(not(feature = "tracing"))]
+        let _ = message;
+    }
+
+    /// Records the integer `value` of `field`, computing it only if the span
+    /// is enabled.
+    #[inline]
+    pub(crate) fn record_u64<F>(&self, field: &'static str, value: F)
+    where
+        F: FnOnce() -> u64,
+    {
+        if self.is_enabled() {
+            #[cfg(feature = "tracing")]
+            self.0.record(field, value());
+        }
+        #[cfg(not(feature = "tracing"))]
+        let _ = (field, value);
+    }
+
+    /// Records the string `value` of `field`, computing it only if the span
+    /// is enabled.
+    #[inline]
+    pub(crate) fn record_str<F>(&self, field: &'static str, value: F)
+    where
+        F: FnOnce() -> String,
+    {
+        if self.is_enabled() {
+            #[cfg(feature = "tracing")]
+            self.0.record(field, value().as_str());
+        }
+        #[cfg(not(feature = "tracing"))]
+        let _ = (field, value);
+    }
+
+    /// Records whether the call succeeded and, if it did, the number of bytes
+    /// it processed, computing it only if the span is enabled. Exits the
+    /// span.
+    #[inline]
+    pub(crate) fn finish<F>(self, ok: bool, bytes: F)
+    where
+        F: FnOnce() -> usize,
+    {
+        if ok {
+            self.record_u64("bytes", || bytes() as u64);
+        }
+        self.finish_ok(ok);
+    }
+
+    /// Records whether the call succeeded, and exits the span.
+    #[inline]
+    pub(crate) fn finish_ok(self, ok: bool) {
+        #[cfg(feature = "tracing")]
+        self.0.record("ok", ok);
+        #[cfg(not(feature = "tracing"))]
+        let _ = ok;
+    }
+}
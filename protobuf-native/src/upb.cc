@@ -0,0 +1,742 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/upb.h"
+
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "google/protobuf/descriptor.upb.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "protobuf-native/src/internal.rs.h"
+#include "protobuf-native/src/upb.rs.h"
+#include "upb/base/status.h"
+#include "upb/json/decode.h"
+#include "upb/json/encode.h"
+#include "upb/mem/alloc.h"
+#include "upb/message/array.h"
+#include "upb/message/compare.h"
+#include "upb/message/map.h"
+#include "upb/mini_descriptor/build_enum.h"
+#include "upb/mini_descriptor/decode.h"
+#include "upb/mini_descriptor/link.h"
+#include "upb/reflection/enum_def.h"
+#include "upb/reflection/field_def.h"
+#include "upb/reflection/file_def.h"
+#include "upb/reflection/message.h"
+#include "upb/text/encode.h"
+#include "upb/wire/decode.h"
+#include "upb/wire/encode.h"
+
+namespace protobuf_native {
+namespace upb {
+
+using google::protobuf::FileDescriptorProto;
+using google::protobuf::FileDescriptorSet;
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::io::CodedOutputStream;
+using google::protobuf::io::StringOutputStream;
+
+namespace {
+
+// Converts `file` to a upb descriptor and adds it to `pool`. upb has its own
+// descriptor parser, so the file takes a round trip through the wire format.
+bool AddFile(DefPool& pool, const FileDescriptorProto& file, std::string& error) {
+    std::string serialized;
+    if (!file.SerializeToString(&serialized)) {
+        error = "failed to serialize file descriptor";
+        return false;
+    }
+    upb_Arena* arena = upb_Arena_New();
+    if (arena == nullptr) {
+        error = "out of memory";
+        return false;
+    }
+    const google_protobuf_FileDescriptorProto* proto =
+        google_protobuf_FileDescriptorProto_parse(serialized.data(), serialized.size(), arena);
+    bool ok = false;
+    if (proto == nullptr) {
+        error = "failed to parse file descriptor";
+    } else {
+        upb_Status status;
+        upb_Status_Clear(&status);
+        ok = upb_DefPool_AddFile(&pool, proto, &status) != nullptr;
+        if (!ok) {
+            error = upb_Status_ErrorMessage(&status);
+        }
+    }
+    upb_Arena_Free(arena);
+    return ok;
+}
+
+const upb_FieldDef* FindField(const MessageDef& def, absl::string_view name) {
+    return upb_MessageDef_FindFieldByNameWithSize(&def, name.data(), name.size());
+}
+
+int DecodeOptions(bool alias) {
+    int options = kUpb_DecodeOption_CheckRequired;
+    if (alias) {
+        options |= kUpb_DecodeOption_AliasString;
+    }
+    return options;
+}
+
+const upb_ExtensionRegistry* Extensions(const MessageDef& def) {
+    return upb_DefPool_ExtensionRegistry(upb_FileDef_Pool(upb_MessageDef_File(&def)));
+}
+
+bool Decode(upb_Message* message, const upb_MiniTable* table,
+            const upb_ExtensionRegistry* extensions, rust::Slice<const uint8_t> data, bool alias,
+            upb_Arena* arena) {
+    upb_DecodeStatus status = upb_Decode(reinterpret_cast<const char*>(data.data()), data.size(),
+                                         message, table, extensions, DecodeOptions(alias), arena);
+    return status == kUpb_DecodeStatus_Ok;
+}
+
+int EncodeOptions(bool deterministic) {
+    int options = kUpb_EncodeOption_CheckRequired;
+    if (deterministic) {
+        options |= kUpb_EncodeOption_Deterministic;
+    }
+    return options;
+}
+
+rust::Slice<const uint8_t> Encode(const upb_Message* message, const upb_MiniTable* table,
+                                  bool deterministic, bool delimited, upb_Arena* arena,
+                                  bool& ok) {
+    char* buf = nullptr;
+    size_t size = 0;
+    int options = EncodeOptions(deterministic);
+    upb_EncodeStatus status =
+        delimited ? upb_EncodeLengthPrefixed(message, table, options, arena, &buf, &size)
+                  : upb_Encode(message, table, options, arena, &buf, &size);
+    ok = status == kUpb_EncodeStatus_Ok;
+    if (!ok) {
+        return {};
+    }
+    return {reinterpret_cast<const uint8_t*>(buf), size};
+}
+
+// Appends the encoding of `message` to `output`, by way of a scratch arena.
+bool EncodeToVec(const upb_Message* message, const upb_MiniTable* table, bool deterministic,
+                 bool delimited, rust::Vec<uint8_t>& output) {
+    upb_Arena* arena = upb_Arena_New();
+    if (arena == nullptr) {
+        return false;
+    }
+    bool ok;
+    rust::Slice<const uint8_t> encoded =
+        Encode(message, table, deterministic, delimited, arena, ok);
+    if (ok) {
+        size_t old_size = output.size();
+        output.reserve(old_size + encoded.size());
+        if (!encoded.empty()) {
+            std::memcpy(output.data() + old_size, encoded.data(), encoded.size());
+        }
+        vec_u8_set_len(output, old_size + encoded.size());
+    }
+    upb_Arena_Free(arena);
+    return ok;
+}
+
+int TextOptions(const TextPrintOptions& options) {
+    int flags = 0;
+    if (options.single_line) {
+        flags |= UPB_TXTENC_SINGLELINE;
+    }
+    if (options.skip_unknown_fields) {
+        flags |= UPB_TXTENC_SKIPUNKNOWN;
+    }
+    return flags;
+}
+
+// Combines `value` into the running hash `h`. The value is first spread over
+// all 64 bits with the MurmurHash3 finalizer, so that small integers and
+// field numbers do not collide after combining.
+uint64_t HashCombine(uint64_t h, uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return h ^ (value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2));
+}
+
+uint64_t HashBytes(upb_StringView bytes) {
+    // FNV-1a.
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < bytes.size; i++) {
+        h ^= static_cast<uint8_t>(bytes.data[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return HashCombine(bytes.size, h);
+}
+
+uint64_t HashMessage(const upb_Message* message, const MessageDef* def);
+
+// Hashes a single value of field `f`, consistently with the comparison of
+// `upb_MessageValue_IsEqual`: floating-point values hash by their bits.
+uint64_t HashValue(upb_MessageValue value, const upb_FieldDef* f) {
+    switch (upb_FieldDef_CType(f)) {
+        case kUpb_CType_Bool:
+            return value.bool_val;
+        case kUpb_CType_Float:
+        case kUpb_CType_Int32:
+        case kUpb_CType_UInt32:
+        case kUpb_CType_Enum:
+            return static_cast<uint32_t>(value.int32_val);
+        case kUpb_CType_Double:
+        case kUpb_CType_Int64:
+        case kUpb_CType_UInt64:
+            return static_cast<uint64_t>(value.int64_val);
+        case kUpb_CType_String:
+        case kUpb_CType_Bytes:
+            return HashBytes(value.str_val);
+        case kUpb_CType_Message:
+            return HashMessage(value.msg_val, upb_FieldDef_MessageSubDef(f));
+    }
+    return 0;
+}
+
+// Hashes the fields that are set in `message`. Map entries are combined by
+// addition, so that maps hash equally regardless of their iteration order.
+// Extensions and unknown fields are not hashed; messages that differ only in
+// those collide, which is consistent with, if weaker than, equality.
+uint64_t HashMessage(const upb_Message* message, const MessageDef* def) {
+    uint64_t h = 0;
+    if (message == nullptr) {
+        return h;
+    }
+    const upb_FieldDef* f;
+    upb_MessageValue value;
+    size_t iter = kUpb_Message_Begin;
+    while (upb_Message_Next(message, def, nullptr, &f, &value, &iter)) {
+        h = HashCombine(h, upb_FieldDef_Number(f));
+        if (upb_FieldDef_IsMap(f)) {
+            const MessageDef* entry = upb_FieldDef_MessageSubDef(f);
+            const upb_FieldDef* key_field = upb_MessageDef_FindFieldByNumber(entry, 1);
+            const upb_FieldDef* value_field = upb_MessageDef_FindFieldByNumber(entry, 2);
+            uint64_t entries = 0;
+            upb_MessageValue map_key, map_value;
+            size_t map_iter = kUpb_Map_Begin;
+            while (upb_Map_Next(value.map_val, &map_key, &map_value, &map_iter)) {
+                entries += HashCombine(HashValue(map_key, key_field),
+                                       HashValue(map_value, value_field));
+            }
+            h = HashCombine(h, entries);
+        } else if (upb_FieldDef_IsRepeated(f)) {
+            size_t size = upb_Array_Size(value.array_val);
+            for (size_t i = 0; i < size; i++) {
+                h = HashCombine(h, HashValue(upb_Array_Get(value.array_val, i), f));
+            }
+        } else {
+            h = HashCombine(h, HashValue(value, f));
+        }
+    }
+    return h;
+}
+
+}  // namespace
+
+Arena* NewArena() {
+    return upb_Arena_New();
+}
+
+Arena* NewArenaWithInitialBlock(uint8_t* block, size_t size, bool grow) {
+    // Without an allocator, the arena cannot grow beyond the initial block.
+    return upb_Arena_Init(block, size, grow ? &upb_alloc_global : nullptr);
+}
+
+void DeleteArena(Arena* arena) {
+    upb_Arena_Free(arena);
+}
+
+size_t ArenaSpaceAllocated(Arena* arena) {
+    return upb_Arena_SpaceAllocated(arena, nullptr);
+}
+
+bool ArenaFuse(Arena* arena, Arena* other) {
+    return upb_Arena_Fuse(arena, other);
+}
+
+DefPool* NewDefPool() {
+    return upb_DefPool_New();
+}
+
+void DeleteDefPool(DefPool* pool) {
+    upb_DefPool_Free(pool);
+}
+
+bool DefPoolAddFileSet(DefPool& pool, const FileDescriptorSet& set, rust::Vec<FileError>& errors) {
+    // upb requires every dependency of a file to be added before the file
+    // itself, so add the files in as many passes as it takes for each file's
+    // dependencies within the set to have been added first.
+    std::vector<const FileDescriptorProto*> pending;
+    absl::flat_hash_set<std::string> pending_names;
+    for (const FileDescriptorProto& file : set.file()) {
+        if (upb_DefPool_FindFileByName(&pool, file.name().c_str()) == nullptr &&
+            pending_names.insert(file.name()).second) {
+            pending.push_back(&file);
+        }
+    }
+    bool ok = true;
+    bool progress = true;
+    while (!pending.empty() && progress) {
+        progress = false;
+        std::vector<const FileDescriptorProto*> blocked;
+        for (const FileDescriptorProto* file : pending) {
+            bool ready = true;
+            for (const std::string& dependency : file->dependency()) {
+                if (pending_names.contains(dependency)) {
+                    ready = false;
+                    break;
+                }
+            }
+            if (!ready) {
+                blocked.push_back(file);
+                continue;
+            }
+            std::string error;
+            if (!AddFile(pool, *file, error)) {
+                errors.push_back(FileError{
+                    .filename = file->name(),
+                    .message = error,
+                });
+                ok = false;
+            }
+            pending_names.erase(file->name());
+            progress = true;
+        }
+        pending = std::move(blocked);
+    }
+    for (const FileDescriptorProto* file : pending) {
+        errors.push_back(FileError{
+            .filename = file->name(),
+            .message = "file is part of an import cycle",
+        });
+        ok = false;
+    }
+    return ok;
+}
+
+const MessageDef* DefPoolFindMessageByName(const DefPool& pool, absl::string_view name) {
+    // The lookup is by length, so `name` need not be NUL-terminated.
+    return upb_DefPool_FindMessageByNameWithSize(&pool, name.data(), name.size());
+}
+
+rust::Str MessageDefFullName(const MessageDef& def) {
+    return upb_MessageDef_FullName(&def);
+}
+
+// The mini schema encoding is a sequence of varints and length-prefixed
+// strings:
+//
+//     message_count enum_count
+//     message_count * (mini_descriptor message_link_count message_link*
+//                      enum_link_count enum_link*)
+//     enum_count * mini_descriptor
+//
+// The first message is the root. The links of a message are the indices of
+// the message and enum types of its fields, in the order in which
+// `upb_MiniTable_GetSubList` returns the fields.
+bool MessageDefEncodeMiniSchema(const MessageDef& def, rust::Vec<uint8_t>& output) {
+    std::vector<const upb_MessageDef*> messages = {&def};
+    std::vector<const upb_EnumDef*> enums;
+    absl::flat_hash_map<const upb_MessageDef*, uint32_t> message_indices = {{&def, 0}};
+    absl::flat_hash_map<const upb_EnumDef*, uint32_t> enum_indices;
+    std::vector<std::vector<uint32_t>> message_links;
+    std::vector<std::vector<uint32_t>> enum_links;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        const upb_MessageDef* m = messages[i];
+        const upb_MiniTable* table = upb_MessageDef_MiniTable(m);
+        std::vector<const upb_MiniTableField*> subs(upb_MiniTable_FieldCount(table));
+        uint32_t counts = upb_MiniTable_GetSubList(table, subs.data());
+        uint32_t message_count = counts >> 16;
+        message_links.emplace_back();
+        enum_links.emplace_back();
+        for (uint32_t j = 0; j < message_count; ++j) {
+            const upb_MessageDef* sub = upb_FieldDef_MessageSubDef(
+                upb_MessageDef_FindFieldByNumber(m, upb_MiniTableField_Number(subs[j])));
+            auto it = message_indices.emplace(sub, messages.size());
+            if (it.second) {
+                messages.push_back(sub);
+            }
+            message_links.back().push_back(it.first->second);
+        }
+        for (uint32_t j = message_count; j < message_count + (counts & 0xffff); ++j) {
+            const upb_EnumDef* sub = upb_FieldDef_EnumSubDef(
+                upb_MessageDef_FindFieldByNumber(m, upb_MiniTableField_Number(subs[j])));
+            auto it = enum_indices.emplace(sub, enums.size());
+            if (it.second) {
+                enums.push_back(sub);
+            }
+            enum_links.back().push_back(it.first->second);
+        }
+    }
+
+    upb_Arena* arena = upb_Arena_New();
+    if (arena == nullptr) {
+        return false;
+    }
+    bool ok = true;
+    std::string encoded;
+    {
+        StringOutputStream stream(&encoded);
+        CodedOutputStream coded(&stream);
+        auto write_links = [&](const std::vector<uint32_t>& links) {
+            coded.WriteVarint32(links.size());
+            for (uint32_t link : links) {
+                coded.WriteVarint32(link);
+            }
+        };
+        auto write_descriptor = [&](const upb_StringView& descriptor) {
+            coded.WriteVarint32(descriptor.size);
+            coded.WriteRaw(descriptor.data, descriptor.size);
+        };
+        coded.WriteVarint32(messages.size());
+        coded.WriteVarint32(enums.size());
+        for (size_t i = 0; ok && i < messages.size(); ++i) {
+            upb_StringView descriptor;
+            ok = upb_MessageDef_MiniDescriptorEncode(messages[i], arena, &descriptor);
+            if (ok) {
+                write_descriptor(descriptor);
+                write_links(message_links[i]);
+                write_links(enum_links[i]);
+            }
+        }
+        for (size_t i = 0; ok && i < enums.size(); ++i) {
+            upb_StringView descriptor;
+            ok = upb_EnumDef_MiniDescriptorEncode(enums[i], arena, &descriptor);
+            if (ok) {
+                write_descriptor(descriptor);
+            }
+        }
+    }
+    upb_Arena_Free(arena);
+    if (!ok) {
+        return false;
+    }
+    size_t old_size = output.size();
+    output.reserve(old_size + encoded.size());
+    std::memcpy(output.data() + old_size, encoded.data(), encoded.size());
+    vec_u8_set_len(output, old_size + encoded.size());
+    return true;
+}
+
+MiniSchema::MiniSchema() : arena_(upb_Arena_New()) {}
+
+MiniSchema::~MiniSchema() {
+    if (arena_ != nullptr) {
+        upb_Arena_Free(arena_);
+    }
+}
+
+bool MiniSchema::Build(rust::Slice<const uint8_t> data) {
+    if (arena_ == nullptr || data.size() > INT_MAX) {
+        return false;
+    }
+    CodedInputStream input(data.data(), static_cast<int>(data.size()));
+    // Every type takes at least one byte to encode, which bounds the counts
+    // before anything is allocated for them.
+    uint32_t message_count, enum_count;
+    if (!input.ReadVarint32(&message_count) || !input.ReadVarint32(&enum_count) ||
+        message_count == 0 || message_count > data.size() || enum_count > data.size()) {
+        return false;
+    }
+    std::string descriptor;
+    auto read_descriptor = [&]() {
+        uint32_t size;
+        return input.ReadVarint32(&size) && input.ReadString(&descriptor, size);
+    };
+    auto read_links = [&](std::vector<uint32_t>& links, uint32_t limit) {
+        uint32_t count;
+        if (!input.ReadVarint32(&count) || count > data.size()) {
+            return false;
+        }
+        links.resize(count);
+        for (uint32_t& link : links) {
+            if (!input.ReadVarint32(&link) || link >= limit) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    upb_Status status;
+    upb_Status_Clear(&status);
+    std::vector<upb_MiniTable*> tables(message_count);
+    std::vector<std::vector<uint32_t>> message_links(message_count);
+    std::vector<std::vector<uint32_t>> enum_links(message_count);
+    for (uint32_t i = 0; i < message_count; ++i) {
+        if (!read_descriptor()) {
+            return false;
+        }
+        tables[i] = upb_MiniTable_Build(descriptor.data(), descriptor.size(), arena_, &status);
+        if (tables[i] == nullptr || !read_links(message_links[i], message_count) ||
+            !read_links(enum_links[i], enum_count)) {
+            return false;
+        }
+    }
+    std::vector<const upb_MiniTableEnum*> enum_tables(enum_count);
+    for (uint32_t i = 0; i < enum_count; ++i) {
+        if (!read_descriptor()) {
+            return false;
+        }
+        enum_tables[i] =
+            upb_MiniTableEnum_Build(descriptor.data(), descriptor.size(), arena_, &status);
+        if (enum_tables[i] == nullptr) {
+            return false;
+        }
+    }
+    if (input.CurrentPosition() != static_cast<int>(data.size())) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < message_count; ++i) {
+        std::vector<const upb_MiniTable*> subs;
+        for (uint32_t link : message_links[i]) {
+            subs.push_back(tables[link]);
+        }
+        std::vector<const upb_MiniTableEnum*> sub_enums;
+        for (uint32_t link : enum_links[i]) {
+            sub_enums.push_back(enum_tables[link]);
+        }
+        if (!upb_MiniTable_Link(tables[i], subs.data(), subs.size(), sub_enums.data(),
+                                sub_enums.size())) {
+            return false;
+        }
+    }
+    root_ = tables[0];
+    return true;
+}
+
+const upb_MiniTable* MiniSchema::Root() const {
+    return root_;
+}
+
+MiniSchema* NewMiniSchema(rust::Slice<const uint8_t> data) {
+    std::unique_ptr<MiniSchema> schema(new MiniSchema());
+    if (!schema->Build(data)) {
+        return nullptr;
+    }
+    return schema.release();
+}
+
+void DeleteMiniSchema(MiniSchema* schema) {
+    delete schema;
+}
+
+Message* NewMessage(const MessageDef& def, Arena* arena) {
+    return upb_Message_New(upb_MessageDef_MiniTable(&def), arena);
+}
+
+bool MessageDecode(Message* message, const MessageDef& def, rust::Slice<const uint8_t> data,
+                   bool alias, Arena* arena) {
+    return Decode(message, upb_MessageDef_MiniTable(&def), Extensions(def), data, alias, arena);
+}
+
+bool MessageDecodeDelimited(Message* message, const MessageDef& def,
+                            rust::Slice<const uint8_t> data, Arena* arena, size_t& consumed) {
+    upb_DecodeStatus status = upb_DecodeLengthPrefixed(
+        reinterpret_cast<const char*>(data.data()), data.size(), message, &consumed,
+        upb_MessageDef_MiniTable(&def), Extensions(def), DecodeOptions(false), arena);
+    return status == kUpb_DecodeStatus_Ok;
+}
+
+rust::Slice<const uint8_t> MessageGetBytes(const Message* message, const MessageDef& def,
+                                           absl::string_view field, bool& ok) {
+    const upb_FieldDef* f = FindField(def, field);
+    ok = f != nullptr && !upb_FieldDef_IsRepeated(f) &&
+         (upb_FieldDef_CType(f) == kUpb_CType_String || upb_FieldDef_CType(f) == kUpb_CType_Bytes);
+    if (!ok) {
+        return {};
+    }
+    upb_StringView value = upb_Message_GetFieldByDef(message, f).str_val;
+    return {reinterpret_cast<const uint8_t*>(value.data), value.size};
+}
+
+size_t MessageEncodeJson(const Message* message, const MessageDef& def,
+                         const JsonPrintOptions& options, rust::Slice<uint8_t> buf,
+                         rust::String& error, bool& ok) {
+    int flags = 0;
+    if (options.always_print_fields_with_no_presence) {
+        flags |= upb_JsonEncode_EmitDefaults;
+    }
+    if (options.preserve_proto_field_names) {
+        flags |= upb_JsonEncode_UseProtoNames;
+    }
+    if (options.always_print_enums_as_ints) {
+        flags |= upb_JsonEncode_FormatEnumsAsIntegers;
+    }
+    upb_Status status;
+    upb_Status_Clear(&status);
+    // Like snprintf, upb returns the length of the full output even when it
+    // does not fit in the buffer.
+    size_t size = upb_JsonEncode(message, &def, upb_FileDef_Pool(upb_MessageDef_File(&def)),
+                                 flags, reinterpret_cast<char*>(buf.data()), buf.size(), &status);
+    ok = size != static_cast<size_t>(-1);
+    if (!ok) {
+        error = upb_Status_ErrorMessage(&status);
+        return 0;
+    }
+    return size;
+}
+
+bool MessageDecodeJson(Message* message, const MessageDef& def, rust::Str json,
+                       const JsonParseOptions& options, Arena* arena, rust::String& error) {
+    int flags = options.ignore_unknown_fields ? upb_JsonDecode_IgnoreUnknown : 0;
+    upb_Status status;
+    upb_Status_Clear(&status);
+    if (!upb_JsonDecode(json.data(), json.size(), message, &def,
+                        upb_FileDef_Pool(upb_MessageDef_File(&def)), flags, arena, &status)) {
+        error = upb_Status_ErrorMessage(&status);
+        return false;
+    }
+    return true;
+}
+
+size_t MessageEncodeText(const Message* message, const MessageDef& def,
+                         const TextPrintOptions& options, rust::Slice<uint8_t> buf) {
+    return upb_TextEncode(message, &def, upb_FileDef_Pool(upb_MessageDef_File(&def)),
+                          TextOptions(options), reinterpret_cast<char*>(buf.data()), buf.size());
+}
+
+size_t MessageLiteEncodeText(const google::protobuf::MessageLite& message, const DefPool& pool,
+                             const TextPrintOptions& options, rust::Slice<uint8_t> buf,
+                             bool& ok) {
+    std::string name = message.GetTypeName();
+    const MessageDef* def = upb_DefPool_FindMessageByNameWithSize(&pool, name.data(), name.size());
+    std::string serialized;
+    ok = def != nullptr && message.SerializePartialToString(&serialized);
+    if (!ok) {
+        return 0;
+    }
+    // Small messages are decoded without touching the heap.
+    char block[4096];
+    upb_Arena* arena = upb_Arena_Init(block, sizeof(block), &upb_alloc_global);
+    if (arena == nullptr) {
+        ok = false;
+        return 0;
+    }
+    upb_Message* decoded = upb_Message_New(upb_MessageDef_MiniTable(def), arena);
+    ok = decoded != nullptr &&
+         upb_Decode(serialized.data(), serialized.size(), decoded, upb_MessageDef_MiniTable(def),
+                    Extensions(*def), 0, arena) == kUpb_DecodeStatus_Ok;
+    size_t size = 0;
+    if (ok) {
+        size = MessageEncodeText(decoded, *def, options, buf);
+    }
+    upb_Arena_Free(arena);
+    return size;
+}
+
+bool MessageSetMessage(Message* message, const MessageDef& def, absl::string_view field,
+                       const Message* value, const MessageDef& value_def, Arena* arena) {
+    const upb_FieldDef* f = FindField(def, field);
+    if (f == nullptr || !upb_FieldDef_IsSubMessage(f) || upb_FieldDef_IsRepeated(f) ||
+        upb_FieldDef_MessageSubDef(f) != &value_def) {
+        return false;
+    }
+    upb_MessageValue v;
+    v.msg_val = value;
+    return upb_Message_SetFieldByDef(message, f, v, arena);
+}
+
+bool MessageIsEqual(const Message* message, const Message* other, const MessageDef& def,
+                    bool include_unknown_fields) {
+    int options = include_unknown_fields ? kUpb_CompareOption_IncludeUnknownFields : 0;
+    return upb_Message_IsEqual(message, other, upb_MessageDef_MiniTable(&def), options);
+}
+
+uint64_t MessageHash(const Message* message, const MessageDef& def) {
+    return HashMessage(message, &def);
+}
+
+rust::Slice<const uint8_t> MessageEncode(const Message* message, const MessageDef& def,
+                                         bool deterministic, bool delimited, Arena* arena,
+                                         bool& ok) {
+    return Encode(message, upb_MessageDef_MiniTable(&def), deterministic, delimited, arena, ok);
+}
+
+bool MessageEncodeToVec(const Message* message, const MessageDef& def, bool deterministic,
+                        bool delimited, rust::Vec<uint8_t>& output) {
+    return EncodeToVec(message, upb_MessageDef_MiniTable(&def), deterministic, delimited, output);
+}
+
+bool MessageMergeFromLite(Message* message, const MessageDef& def,
+                          const google::protobuf::MessageLite& source, Arena* arena) {
+    if (source.GetTypeName() != upb_MessageDef_FullName(&def)) {
+        return false;
+    }
+    size_t size = source.ByteSizeLong();
+    if (size > INT_MAX) {
+        return false;
+    }
+    // The C++ and upb layouts of a message have nothing in common, so the
+    // message is encoded, but directly into the arena, where the encoding
+    // remains as the storage of the decoded message's strings instead of
+    // being copied again.
+    char* buf = static_cast<char*>(upb_Arena_Malloc(arena, size > 0 ? size : 1));
+    if (buf == nullptr) {
+        return false;
+    }
+    source.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t*>(buf));
+    upb_DecodeStatus status = upb_Decode(buf, size, message, upb_MessageDef_MiniTable(&def),
+                                         Extensions(def), DecodeOptions(true), arena);
+    return status == kUpb_DecodeStatus_Ok;
+}
+
+bool MessageMergeIntoLite(const Message* message, const MessageDef& def,
+                          google::protobuf::MessageLite& target) {
+    if (target.GetTypeName() != upb_MessageDef_FullName(&def)) {
+        return false;
+    }
+    // Small messages are encoded without touching the heap.
+    char block[4096];
+    upb_Arena* arena = upb_Arena_Init(block, sizeof(block), &upb_alloc_global);
+    if (arena == nullptr) {
+        return false;
+    }
+    bool ok;
+    rust::Slice<const uint8_t> encoded =
+        Encode(message, upb_MessageDef_MiniTable(&def), false, false, arena, ok);
+    ok = ok && target.MergeFromString(absl::string_view(
+                   reinterpret_cast<const char*>(encoded.data()), encoded.size()));
+    upb_Arena_Free(arena);
+    return ok;
+}
+
+Message* NewMiniMessage(const MiniSchema& schema, Arena* arena) {
+    return upb_Message_New(schema.Root(), arena);
+}
+
+bool MiniMessageDecode(Message* message, const MiniSchema& schema,
+                       rust::Slice<const uint8_t> data, Arena* arena) {
+    return Decode(message, schema.Root(), nullptr, data, false, arena);
+}
+
+bool MiniMessageEncodeToVec(const Message* message, const MiniSchema& schema, bool deterministic,
+                            rust::Vec<uint8_t>& output) {
+    return EncodeToVec(message, schema.Root(), deterministic, false, output);
+}
+
+}  // namespace upb
+}  // namespace protobuf_native
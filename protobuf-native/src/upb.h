@@ -0,0 +1,113 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "absl/strings/string_view.h"
+#include "google/protobuf/descriptor.pb.h"
+#include "google/protobuf/message_lite.h"
+#include "rust/cxx.h"
+#include "upb/mem/arena.h"
+#include "upb/message/message.h"
+#include "upb/mini_table/message.h"
+#include "upb/reflection/def_pool.h"
+#include "upb/reflection/message_def.h"
+
+namespace protobuf_native {
+namespace upb {
+
+using Arena = upb_Arena;
+using DefPool = upb_DefPool;
+using MessageDef = upb_MessageDef;
+using Message = upb_Message;
+
+struct FileError;
+struct JsonPrintOptions;
+struct JsonParseOptions;
+struct TextPrintOptions;
+
+// A message type and the message and enum types reachable from it, built from
+// the encoding produced by `MessageDefEncodeMiniSchema` without a `DefPool`.
+class MiniSchema {
+   public:
+    MiniSchema();
+    ~MiniSchema();
+
+    bool Build(rust::Slice<const uint8_t> data);
+    const upb_MiniTable* Root() const;
+
+   private:
+    upb_Arena* arena_;
+    const upb_MiniTable* root_ = nullptr;
+};
+
+Arena* NewArena();
+Arena* NewArenaWithInitialBlock(uint8_t* block, size_t size, bool grow);
+void DeleteArena(Arena* arena);
+size_t ArenaSpaceAllocated(Arena* arena);
+bool ArenaFuse(Arena* arena, Arena* other);
+
+DefPool* NewDefPool();
+void DeleteDefPool(DefPool* pool);
+bool DefPoolAddFileSet(DefPool& pool, const google::protobuf::FileDescriptorSet& set,
+                       rust::Vec<FileError>& errors);
+const MessageDef* DefPoolFindMessageByName(const DefPool& pool, absl::string_view name);
+
+rust::Str MessageDefFullName(const MessageDef& def);
+bool MessageDefEncodeMiniSchema(const MessageDef& def, rust::Vec<uint8_t>& output);
+
+MiniSchema* NewMiniSchema(rust::Slice<const uint8_t> data);
+void DeleteMiniSchema(MiniSchema* schema);
+
+Message* NewMessage(const MessageDef& def, Arena* arena);
+bool MessageDecode(Message* message, const MessageDef& def, rust::Slice<const uint8_t> data,
+                   bool alias, Arena* arena);
+bool MessageDecodeDelimited(Message* message, const MessageDef& def,
+                            rust::Slice<const uint8_t> data, Arena* arena, size_t& consumed);
+rust::Slice<const uint8_t> MessageGetBytes(const Message* message, const MessageDef& def,
+                                           absl::string_view field, bool& ok);
+bool MessageIsEqual(const Message* message, const Message* other, const MessageDef& def,
+                    bool include_unknown_fields);
+uint64_t MessageHash(const Message* message, const MessageDef& def);
+rust::Slice<const uint8_t> MessageEncode(const Message* message, const MessageDef& def,
+                                         bool deterministic, bool delimited, Arena* arena,
+                                         bool& ok);
+size_t MessageEncodeJson(const Message* message, const MessageDef& def,
+                         const JsonPrintOptions& options, rust::Slice<uint8_t> buf,
+                         rust::String& error, bool& ok);
+bool MessageDecodeJson(Message* message, const MessageDef& def, rust::Str json,
+                       const JsonParseOptions& options, Arena* arena, rust::String& error);
+size_t MessageEncodeText(const Message* message, const MessageDef& def,
+                         const TextPrintOptions& options, rust::Slice<uint8_t> buf);
+size_t MessageLiteEncodeText(const google::protobuf::MessageLite& message, const DefPool& pool,
+                             const TextPrintOptions& options, rust::Slice<uint8_t> buf,
+                             bool& ok);
+bool MessageSetMessage(Message* message, const MessageDef& def, absl::string_view field,
+                       const Message* value, const MessageDef& value_def, Arena* arena);
+bool MessageEncodeToVec(const Message* message, const MessageDef& def, bool deterministic,
+                        bool delimited, rust::Vec<uint8_t>& output);
+bool MessageMergeFromLite(Message* message, const MessageDef& def,
+                          const google::protobuf::MessageLite& source, Arena* arena);
+bool MessageMergeIntoLite(const Message* message, const MessageDef& def,
+                          google::protobuf::MessageLite& target);
+
+Message* NewMiniMessage(const MiniSchema& schema, Arena* arena);
+bool MiniMessageDecode(Message* message, const MiniSchema& schema,
+                       rust::Slice<const uint8_t> data, Arena* arena);
+bool MiniMessageEncodeToVec(const Message* message, const MiniSchema& schema, bool deterministic,
+                            rust::Vec<uint8_t>& output);
+
+}  // namespace upb
+}  // namespace protobuf_native
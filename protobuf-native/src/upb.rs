@@ -0,0 +1,1192 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Dynamic messages backed by upb.
+//!
+//! [upb] is the small C runtime that underlies several of the protobuf
+//! implementations for other languages. Its messages are allocated entirely
+//! from an [`Arena`] and freed all at once with it, and its message types are
+//! compact tables built at runtime from descriptors. For schemas that are only
+//! known at runtime, a [`DefPool`] and upb [`Message`]s are a lighter-weight
+//! alternative to a [`DescriptorPool`](crate::DescriptorPool) and
+//! [`DynamicMessageFactory`](crate::DynamicMessageFactory).
+//!
+//! The messages in this module do not share storage with the libprotobuf
+//! messages in the rest of the crate, whose layout is entirely different. A
+//! message is converted between the two with
+//! [`Message::merge_from_message_lite`] and
+//! [`Message::merge_into_message_lite`], which go through the wire format in
+//! a single pass, without handing the encoding back to Rust in between.
+//!
+//! This module is only available if the `upb` feature is enabled.
+//!
+//! [upb]: https://github.com/protocolbuffers/protobuf/tree/main/upb
+
+use std::cell::Cell;
+use std::hash::{Hash, Hasher};
+use std::marker::{PhantomData, PhantomPinned};
+use std::mem::MaybeUninit;
+use std::pin::Pin;
+use std::ptr;
+
+use crate::internal::{unsafe_ffi_conversions, BoolExt};
+use crate::json::JsonError;
+use crate::{
+    private, BuildFileError, BuildFileSetError, FileDescriptorSet, MessageLite,
+    OperationFailedError,
+};
+
+#[cxx::bridge(namespace = "protobuf_native::upb")]
+pub(crate) mod ffi {
+    struct FileError {
+        filename: String,
+        message: String,
+    }
+
+    struct JsonPrintOptions {
+        always_print_fields_with_no_presence: bool,
+        always_print_enums_as_ints: bool,
+        preserve_proto_field_names: bool,
+    }
+
+    struct JsonParseOptions {
+        ignore_unknown_fields: bool,
+    }
+
+    struct TextPrintOptions {
+        single_line: bool,
+        skip_unknown_fields: bool,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/upb.h");
+
+        #[namespace = "absl"]
+        type string_view<'a> = crate::internal::StringView<'a>;
+
+        #[namespace = "google::protobuf"]
+        type FileDescriptorSet = crate::ffi::FileDescriptorSet;
+
+        #[namespace = "google::protobuf"]
+        type MessageLite = crate::ffi::MessageLite;
+
+        type Arena;
+        fn NewArena() -> *mut Arena;
+        unsafe fn DeleteArena(arena: *mut Arena);
+        unsafe fn ArenaSpaceAllocated(arena: *mut Arena) -> usize;
+        unsafe fn NewArenaWithInitialBlock(block: *mut u8, size: usize, grow: bool) -> *mut Arena;
+        unsafe fn ArenaFuse(arena: *mut Arena, other: *mut Arena) -> bool;
+
+        type DefPool;
+        fn NewDefPool() -> *mut DefPool;
+        unsafe fn DeleteDefPool(pool: *mut DefPool);
+        fn DefPoolAddFileSet(
+            pool: Pin<&mut DefPool>,
+            set: &FileDescriptorSet,
+            errors: &mut Vec<FileError>,
+        ) -> bool;
+        fn DefPoolFindMessageByName(pool: &DefPool, name: string_view) -> *const MessageDef;
+
+        type MessageDef;
+        fn MessageDefFullName(def: &MessageDef) -> &str;
+        fn MessageDefEncodeMiniSchema(def: &MessageDef, output: &mut Vec<u8>) -> bool;
+
+        type MiniSchema;
+        fn NewMiniSchema(data: &[u8]) -> *mut MiniSchema;
+        unsafe fn DeleteMiniSchema(schema: *mut MiniSchema);
+
+        type Message;
+        unsafe fn NewMessage(def: &MessageDef, arena: *mut Arena) -> *mut Message;
+        unsafe fn MessageDecode(
+            message: *mut Message,
+            def: &MessageDef,
+            data: &[u8],
+            alias: bool,
+            arena: *mut Arena,
+        ) -> bool;
+        unsafe fn MessageDecodeDelimited(
+            message: *mut Message,
+            def: &MessageDef,
+            data: &[u8],
+            arena: *mut Arena,
+            consumed: &mut usize,
+        ) -> bool;
+        unsafe fn MessageGetBytes<'a>(
+            message: *const Message,
+            def: &MessageDef,
+            field: string_view,
+            ok: &mut bool,
+        ) -> &'a [u8];
+        unsafe fn MessageEncode<'a>(
+            message: *const Message,
+            def: &MessageDef,
+            deterministic: bool,
+            delimited: bool,
+            arena: *mut Arena,
+            ok: &mut bool,
+        ) -> &'a [u8];
+        unsafe fn MessageEncodeJson(
+            message: *const Message,
+            def: &MessageDef,
+            options: &JsonPrintOptions,
+            buf: &mut [u8],
+            error: &mut String,
+            ok: &mut bool,
+        ) -> usize;
+        unsafe fn MessageDecodeJson(
+            message: *mut Message,
+            def: &MessageDef,
+            json: &str,
+            options: &JsonParseOptions,
+            arena: *mut Arena,
+            error: &mut String,
+        ) -> bool;
+        unsafe fn MessageEncodeText(
+            message: *const Message,
+            def: &MessageDef,
+            options: &TextPrintOptions,
+            buf: &mut [u8],
+        ) -> usize;
+        fn MessageLiteEncodeText(
+            message: &MessageLite,
+            pool: &DefPool,
+            options: &TextPrintOptions,
+            buf: &mut [u8],
+            ok: &mut bool,
+        ) -> usize;
+        unsafe fn MessageSetMessage(
+            message: *mut Message,
+            def: &MessageDef,
+            field: string_view,
+            value: *const Message,
+            value_def: &MessageDef,
+            arena: *mut Arena,
+        ) -> bool;
+        unsafe fn MessageIsEqual(
+            message: *const Message,
+            other: *const Message,
+            def: &MessageDef,
+            include_unknown_fields: bool,
+        ) -> bool;
+        unsafe fn MessageHash(message: *const Message, def: &MessageDef) -> u64;
+        unsafe fn MessageEncodeToVec(
+            message: *const Message,
+            def: &MessageDef,
+            deterministic: bool,
+            delimited: bool,
+            output: &mut Vec<u8>,
+        ) -> bool;
+
+        unsafe fn MessageMergeFromLite(
+            message: *mut Message,
+            def: &MessageDef,
+            source: &MessageLite,
+            arena: *mut Arena,
+        ) -> bool;
+        unsafe fn MessageMergeIntoLite(
+            message: *const Message,
+            def: &MessageDef,
+            target: Pin<&mut MessageLite>,
+        ) -> bool;
+
+        unsafe fn NewMiniMessage(schema: &MiniSchema, arena: *mut Arena) -> *mut Message;
+        unsafe fn MiniMessageDecode(
+            message: *mut Message,
+            schema: &MiniSchema,
+            data: &[u8],
+            arena: *mut Arena,
+        ) -> bool;
+        unsafe fn MiniMessageEncodeToVec(
+            message: *const Message,
+            schema: &MiniSchema,
+            deterministic: bool,
+            output: &mut Vec<u8>,
+        ) -> bool;
+    }
+}
+
+/// Options that control how upb messages are printed as JSON.
+///
+/// These are the subset of [`json::PrintOptions`](crate::json::PrintOptions)
+/// that upb supports. upb never adds whitespace, and always quotes int64
+/// values.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct JsonPrintOptions {
+    /// Whether to print fields which do not support presence even when they
+    /// would otherwise be omitted, namely implicit presence fields set to
+    /// their zero value, and empty lists and maps.
+    pub always_print_fields_with_no_presence: bool,
+    /// Whether to print enums as integers rather than as strings.
+    pub always_print_enums_as_ints: bool,
+    /// Whether to use the field names from the .proto file rather than their
+    /// lowerCamelCase JSON names.
+    pub preserve_proto_field_names: bool,
+}
+
+impl From<&JsonPrintOptions> for ffi::JsonPrintOptions {
+    fn from(options: &JsonPrintOptions) -> ffi::JsonPrintOptions {
+        ffi::JsonPrintOptions {
+            always_print_fields_with_no_presence: options.always_print_fields_with_no_presence,
+            always_print_enums_as_ints: options.always_print_enums_as_ints,
+            preserve_proto_field_names: options.preserve_proto_field_names,
+        }
+    }
+}
+
+/// Options that control how JSON is parsed into upb messages.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct JsonParseOptions {
+    /// Whether to ignore JSON fields that are not fields of the message,
+    /// rather than failing.
+    pub ignore_unknown_fields: bool,
+}
+
+impl From<&JsonParseOptions> for ffi::JsonParseOptions {
+    fn from(options: &JsonParseOptions) -> ffi::JsonParseOptions {
+        ffi::JsonParseOptions {
+            ignore_unknown_fields: options.ignore_unknown_fields,
+        }
+    }
+}
+
+/// Options that control how messages are printed in the text format.
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct TextPrintOptions {
+    /// Whether to print the message on a single line.
+    pub single_line: bool,
+    /// Whether to omit unknown fields.
+    pub skip_unknown_fields: bool,
+}
+
+impl From<&TextPrintOptions> for ffi::TextPrintOptions {
+    fn from(options: &TextPrintOptions) -> ffi::TextPrintOptions {
+        ffi::TextPrintOptions {
+            single_line: options.single_line,
+            skip_unknown_fields: options.skip_unknown_fields,
+        }
+    }
+}
+
+/// Prints a libprotobuf message in the text format, truncated to at most
+/// `max_len` bytes, by way of upb.
+///
+/// The message is serialized and decoded as the message type of the same
+/// name in `pool`, then printed by upb's text encoder. Unlike
+/// [`text_format`](crate::text_format), this uses no reflection over the
+/// libprotobuf message, and allocates nothing for the output beyond
+/// `max_len` bytes nor, for small messages, for the decoded copy, which
+/// makes it suitable for logging messages on hot error paths. A truncated
+/// multibyte character at the end of the output is replaced by
+/// `U+FFFD REPLACEMENT CHARACTER`.
+///
+/// Returns an error if `pool` has no message type of the message's name, or
+/// if the message cannot be serialized or decoded.
+pub fn debug_string_truncated(
+    message: &dyn MessageLite,
+    pool: &DefPool,
+    max_len: usize,
+    options: &TextPrintOptions,
+) -> Result<String, OperationFailedError> {
+    let mut buf = vec![0; max_len + 1];
+    let mut ok = false;
+    let len = ffi::MessageLiteEncodeText(
+        private::MessageLite::upcast(message),
+        pool.as_ffi(),
+        &options.into(),
+        &mut buf,
+        &mut ok,
+    );
+    ok.as_result()?;
+    buf.truncate(len.min(max_len));
+    Ok(text_from_utf8(buf))
+}
+
+// upb escapes invalid UTF-8 in string and bytes fields, so only truncation
+// can leave the output invalid.
+fn text_from_utf8(buf: Vec<u8>) -> String {
+    match String::from_utf8(buf) {
+        Ok(text) => text,
+        Err(e) => String::from_utf8_lossy(e.as_bytes()).into_owned(),
+    }
+}
+
+/// A upb arena, from which [`Message`]s and their contents are allocated.
+///
+/// Everything allocated from an arena is freed at once when the arena is
+/// dropped. An arena may be sent to another thread, but may not be used by
+/// multiple threads at once.
+pub struct Arena<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+    _not_sync: PhantomData<Cell<u8>>,
+}
+
+impl<'a> Drop for Arena<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteArena(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl Arena<'static> {
+    /// Creates a new arena that allocates its memory from the heap.
+    pub fn new() -> Pin<Box<Arena<'static>>> {
+        let arena = ffi::NewArena();
+        assert!(!arena.is_null(), "failed to allocate upb arena");
+        unsafe { Self::from_ffi_owned(arena) }
+    }
+}
+
+impl<'a> Arena<'a> {
+    /// Creates a new arena that allocates from `block` first, and from the
+    /// heap only once `block` is exhausted.
+    ///
+    /// The block is borrowed for the lifetime of the arena, and holds the
+    /// arena's own bookkeeping as well as its allocations, so a block of a few
+    /// kilobytes on the stack is enough for small messages to be decoded
+    /// without any heap allocation. The start of the block may be skipped to
+    /// satisfy the arena's alignment requirements.
+    ///
+    /// An arena with an initial block cannot be [fused](Arena::fuse).
+    pub fn with_initial_block(block: &'a mut [MaybeUninit<u8>]) -> Pin<Box<Arena<'a>>> {
+        Self::from_block(block, true)
+    }
+
+    /// Creates a new arena that allocates only from `block`.
+    ///
+    /// Once `block` is exhausted, allocations from the arena fail: decoding
+    /// into the arena returns an error, and creating a [`Message`] in it
+    /// panics. Otherwise the arena behaves like one created with
+    /// [`Arena::with_initial_block`].
+    ///
+    /// # Panics
+    ///
+    /// Panics if `block` is too small to hold the arena's bookkeeping.
+    pub fn with_fixed_block(block: &'a mut [MaybeUninit<u8>]) -> Pin<Box<Arena<'a>>> {
+        Self::from_block(block, false)
+    }
+
+    fn from_block(block: &'a mut [MaybeUninit<u8>], grow: bool) -> Pin<Box<Arena<'a>>> {
+        let arena = unsafe {
+            ffi::NewArenaWithInitialBlock(block.as_mut_ptr() as *mut u8, block.len(), grow)
+        };
+        assert!(!arena.is_null(), "failed to allocate upb arena");
+        unsafe { Self::from_ffi_owned(arena) }
+    }
+
+    /// Returns the total size of the memory blocks that the arena has
+    /// allocated from the system.
+    pub fn space_allocated(&self) -> usize {
+        unsafe { ffi::ArenaSpaceAllocated(self.as_raw()) }
+    }
+
+    /// Fuses this arena with `other`, so that the memory of both is freed only
+    /// once both have been dropped.
+    ///
+    /// Fusing is how a message in one arena comes to refer to memory in
+    /// another without a deep copy; see [`Message::set_message`]. It is
+    /// transitive, and fusing arenas that are already fused is a no-op.
+    ///
+    /// Returns an error if the arenas cannot be fused, which is the case if
+    /// either was created with an initial block.
+    pub fn fuse(&self, other: &Arena) -> Result<(), OperationFailedError> {
+        unsafe { ffi::ArenaFuse(self.as_raw(), other.as_raw()) }.as_result()
+    }
+
+    // upb allocates through a mutable pointer to the arena, which is sound
+    // from a shared reference because an `Arena` is never shared between
+    // threads.
+    fn as_raw(&self) -> *mut ffi::Arena {
+        self.as_ffi() as *const ffi::Arena as *mut ffi::Arena
+    }
+
+    unsafe_ffi_conversions!(ffi::Arena);
+}
+
+/// A pool of upb message types, built from file descriptors.
+pub struct DefPool {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for DefPool {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteDefPool(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl DefPool {
+    /// Creates a new, empty pool.
+    pub fn new() -> Pin<Box<DefPool>> {
+        let pool = ffi::NewDefPool();
+        assert!(!pool.is_null(), "failed to allocate upb def pool");
+        unsafe { Self::from_ffi_owned(pool) }
+    }
+
+    /// Adds every file in `set` to this pool.
+    ///
+    /// As with [`DescriptorPool::build_file_set`], the files in the set may
+    /// appear in any order, and dependencies outside of the set must already
+    /// be in the pool. Files that are already in the pool are skipped. upb
+    /// does not report which element of a file is erroneous, so the
+    /// `element_name` of each returned error is empty.
+    ///
+    /// [`DescriptorPool::build_file_set`]: crate::DescriptorPool::build_file_set
+    pub fn add_file_set(
+        self: Pin<&mut Self>,
+        set: &FileDescriptorSet,
+    ) -> Result<(), BuildFileSetError> {
+        let mut errors = Vec::new();
+        match ffi::DefPoolAddFileSet(self.as_ffi_mut(), set.as_ffi(), &mut errors) {
+            true => Ok(()),
+            false => Err(BuildFileSetError {
+                errors: errors
+                    .into_iter()
+                    .map(|error| BuildFileError {
+                        filename: error.filename,
+                        element_name: String::new(),
+                        message: error.message,
+                    })
+                    .collect(),
+            }),
+        }
+    }
+
+    /// Finds a message type by its fully-qualified name, e.g.
+    /// `google.protobuf.FileDescriptorProto`.
+    ///
+    /// Returns `None` if no such message type exists in the pool.
+    pub fn find_message_by_name(&self, name: &str) -> Option<&MessageDef> {
+        let def = ffi::DefPoolFindMessageByName(self.as_ffi(), name.into());
+        match def.is_null() {
+            true => None,
+            false => Some(unsafe { MessageDef::from_ffi_ptr(def) }),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::DefPool);
+}
+
+// SAFETY: lookups in a upb `DefPool` do not mutate it, and adding files
+// requires a mutable reference.
+unsafe impl Send for DefPool {}
+unsafe impl Sync for DefPool {}
+
+/// A upb message type.
+pub struct MessageDef {
+    _opaque: PhantomPinned,
+}
+
+impl MessageDef {
+    /// Returns the fully-qualified name of the message type, e.g.
+    /// `google.protobuf.FileDescriptorProto`.
+    pub fn full_name(&self) -> &str {
+        ffi::MessageDefFullName(self.as_ffi())
+    }
+
+    /// Encodes this message type, and the message and enum types reachable
+    /// from it, as a compact mini schema from which a [`MiniSchema`] can be
+    /// built.
+    ///
+    /// The encoding is made up of upb's mini descriptors, which describe
+    /// each type's fields by number and type but omit the names and options
+    /// of a `FileDescriptorProto`. Extensions are not included.
+    pub fn encode_mini_schema(&self) -> Result<Vec<u8>, OperationFailedError> {
+        let mut output = Vec::new();
+        ffi::MessageDefEncodeMiniSchema(self.as_ffi(), &mut output).as_result()?;
+        Ok(output)
+    }
+
+    unsafe_ffi_conversions!(ffi::MessageDef);
+}
+
+// SAFETY: message types are immutable once built.
+unsafe impl Send for MessageDef {}
+unsafe impl Sync for MessageDef {}
+
+/// A upb message, allocated from an [`Arena`].
+///
+/// The message, including any submessages, strings and repeated fields that
+/// it comes to hold, lives until its arena is dropped.
+pub struct Message<'a> {
+    message: *mut ffi::Message,
+    def: &'a MessageDef,
+    arena: &'a Arena<'a>,
+}
+
+impl<'a> Message<'a> {
+    /// Creates a new, empty message of type `def` in `arena`.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the arena is out of memory, which can only happen to an arena
+    /// created with [`Arena::with_fixed_block`].
+    pub fn new(def: &'a MessageDef, arena: &'a Arena<'a>) -> Message<'a> {
+        let message = unsafe { ffi::NewMessage(def.as_ffi(), arena.as_raw()) };
+        assert!(!message.is_null(), "failed to allocate upb message");
+        Message {
+            message,
+            def,
+            arena,
+        }
+    }
+
+    /// Parses a message of type `def` from `data` into `arena`.
+    ///
+    /// Returns an error if `data` is not a valid encoding of the message type,
+    /// or if any required fields are missing.
+    pub fn parse(
+        def: &'a MessageDef,
+        arena: &'a Arena<'a>,
+        data: &[u8],
+    ) -> Result<Message<'a>, OperationFailedError> {
+        let mut message = Message::new(def, arena);
+        message.merge_from_bytes(data)?;
+        Ok(message)
+    }
+
+    /// Merges the fields encoded in `data` into this message.
+    ///
+    /// The contents of `data` are copied into the message's arena, so `data`
+    /// need not outlive the message.
+    pub fn merge_from_bytes(&mut self, data: &[u8]) -> Result<(), OperationFailedError> {
+        self.merge_inner(data, false)
+    }
+
+    fn merge_inner(&mut self, data: &[u8], alias: bool) -> Result<(), OperationFailedError> {
+        unsafe {
+            ffi::MessageDecode(
+                self.message,
+                self.def.as_ffi(),
+                data,
+                alias,
+                self.arena.as_raw(),
+            )
+        }
+        .as_result()
+    }
+
+    /// Returns the contents of the singular string or bytes field named
+    /// `field`, or its default value if it is not set.
+    ///
+    /// Returns `None` if this message has no such field.
+    pub fn get_bytes(&self, field: &str) -> Option<&'a [u8]> {
+        let mut ok = false;
+        let value =
+            unsafe { ffi::MessageGetBytes(self.message, self.def.as_ffi(), field.into(), &mut ok) };
+        ok.then_some(value)
+    }
+
+    /// Parses a message of type `def` from its JSON representation into
+    /// `arena`.
+    pub fn parse_json(
+        def: &'a MessageDef,
+        arena: &'a Arena<'a>,
+        json: &str,
+        options: &JsonParseOptions,
+    ) -> Result<Message<'a>, JsonError> {
+        let mut message = Message::new(def, arena);
+        message.merge_from_json(json, options)?;
+        Ok(message)
+    }
+
+    /// Merges the fields in the JSON representation `json` into this
+    /// message.
+    pub fn merge_from_json(
+        &mut self,
+        json: &str,
+        options: &JsonParseOptions,
+    ) -> Result<(), JsonError> {
+        let mut error = String::new();
+        match unsafe {
+            ffi::MessageDecodeJson(
+                self.message,
+                self.def.as_ffi(),
+                json,
+                &options.into(),
+                self.arena.as_raw(),
+                &mut error,
+            )
+        } {
+            true => Ok(()),
+            false => Err(JsonError(error)),
+        }
+    }
+
+    /// Prints the message as JSON into `buf`, and returns the length of the
+    /// full JSON representation.
+    ///
+    /// Like `snprintf`, the output is always followed by a NUL byte, so a
+    /// returned length greater than or equal to the length of `buf` means the
+    /// output was truncated. Calling this with an empty buffer queries the
+    /// length of the buffer to provide, which must be one more than the
+    /// returned length.
+    pub fn print_json_into(
+        &self,
+        buf: &mut [u8],
+        options: &JsonPrintOptions,
+    ) -> Result<usize, JsonError> {
+        let mut error = String::new();
+        let mut ok = false;
+        let len = unsafe {
+            ffi::MessageEncodeJson(
+                self.message,
+                self.def.as_ffi(),
+                &options.into(),
+                buf,
+                &mut error,
+                &mut ok,
+            )
+        };
+        match ok {
+            true => Ok(len),
+            false => Err(JsonError(error)),
+        }
+    }
+
+    /// Prints the message as JSON.
+    pub fn to_json(&self, options: &JsonPrintOptions) -> Result<String, JsonError> {
+        let len = self.print_json_into(&mut [], options)?;
+        let mut buf = vec![0; len + 1];
+        self.print_json_into(&mut buf, options)?;
+        buf.truncate(len);
+        String::from_utf8(buf).map_err(|e| JsonError(e.to_string()))
+    }
+
+    /// Prints the message in the text format into `buf`, and returns the
+    /// length of the full text representation.
+    ///
+    /// As with [`Message::print_json_into`], the output is always followed by
+    /// a NUL byte, so a returned length greater than or equal to the length
+    /// of `buf` means the output was truncated.
+    pub fn print_text_into(&self, buf: &mut [u8], options: &TextPrintOptions) -> usize {
+        unsafe { ffi::MessageEncodeText(self.message, self.def.as_ffi(), &options.into(), buf) }
+    }
+
+    /// Prints the message in the text format.
+    pub fn to_text(&self, options: &TextPrintOptions) -> String {
+        let len = self.print_text_into(&mut [], options);
+        let mut buf = vec![0; len + 1];
+        self.print_text_into(&mut buf, options);
+        buf.truncate(len);
+        text_from_utf8(buf)
+    }
+
+    /// Sets the singular message field named `field` to `value`, without
+    /// copying it.
+    ///
+    /// Unless the two messages are allocated from the same arena, the arena of
+    /// `value` is first [fused](Arena::fuse) with the arena of this message,
+    /// so that `value` lives for as long as this message does. From then on
+    /// the field and `value` are the same message: changes to either are
+    /// visible through the other.
+    ///
+    /// Returns an error if this message has no such field, if the type of the
+    /// field is not the type of `value`, or if the arenas cannot be fused.
+    pub fn set_message(
+        &mut self,
+        field: &str,
+        value: &Message,
+    ) -> Result<(), OperationFailedError> {
+        self.arena.fuse(value.arena)?;
+        unsafe {
+            ffi::MessageSetMessage(
+                self.message,
+                self.def.as_ffi(),
+                field.into(),
+                value.message,
+                value.def.as_ffi(),
+                self.arena.as_raw(),
+            )
+        }
+        .as_result()
+    }
+
+    /// Converts a libprotobuf message of the same type into a message in
+    /// `arena`.
+    ///
+    /// See [`Message::merge_from_message_lite`] for details.
+    pub fn from_message_lite<M>(
+        def: &'a MessageDef,
+        arena: &'a Arena<'a>,
+        message: &M,
+    ) -> Result<Message<'a>, OperationFailedError>
+    where
+        M: MessageLite + ?Sized,
+    {
+        let mut converted = Message::new(def, arena);
+        converted.merge_from_message_lite(message)?;
+        Ok(converted)
+    }
+
+    /// Merges the fields of a libprotobuf message of the same type into this
+    /// message.
+    ///
+    /// The conversion makes a single pass through the wire format: `message`
+    /// is encoded directly into this message's arena, and decoded from there
+    /// without copying its strings, which instead refer to the encoding. The
+    /// encoding lives as long as the arena.
+    ///
+    /// Returns an error if `message` is not of this message's type, or if any
+    /// required fields are missing.
+    pub fn merge_from_message_lite<M>(&mut self, message: &M) -> Result<(), OperationFailedError>
+    where
+        M: MessageLite + ?Sized,
+    {
+        unsafe {
+            ffi::MessageMergeFromLite(
+                self.message,
+                self.def.as_ffi(),
+                private::MessageLite::upcast(message),
+                self.arena.as_raw(),
+            )
+        }
+        .as_result()
+    }
+
+    /// Merges the fields of this message into a libprotobuf message of the
+    /// same type.
+    ///
+    /// This message is encoded into a scratch arena, which is allocated on
+    /// the stack for small messages, and `message` is parsed directly from
+    /// it.
+    ///
+    /// Returns an error if `message` is not of this message's type, or if any
+    /// required fields are missing.
+    pub fn merge_into_message_lite<M>(
+        &self,
+        message: Pin<&mut M>,
+    ) -> Result<(), OperationFailedError>
+    where
+        M: MessageLite + ?Sized,
+    {
+        unsafe {
+            ffi::MessageMergeIntoLite(
+                self.message,
+                self.def.as_ffi(),
+                private::MessageLite::upcast_mut(message),
+            )
+        }
+        .as_result()
+    }
+
+    /// Returns the type of this message.
+    pub fn def(&self) -> &'a MessageDef {
+        self.def
+    }
+
+    /// Returns the arena from which this message is allocated.
+    pub fn arena(&self) -> &'a Arena<'a> {
+        self.arena
+    }
+
+    /// Serializes the message.
+    ///
+    /// Returns an error if any required fields are missing.
+    pub fn serialize(&self) -> Result<Vec<u8>, OperationFailedError> {
+        self.serialize_inner(false)
+    }
+
+    /// Serializes the message deterministically, i.e., with map entries in
+    /// the order of their keys.
+    pub fn serialize_deterministic(&self) -> Result<Vec<u8>, OperationFailedError> {
+        self.serialize_inner(true)
+    }
+
+    fn serialize_inner(&self, deterministic: bool) -> Result<Vec<u8>, OperationFailedError> {
+        let mut output = Vec::new();
+        self.serialize_into_inner(deterministic, false, &mut output)?;
+        Ok(output)
+    }
+
+    /// Appends the message to `output`, preceded by its varint-encoded
+    /// length, as read by [`DelimitedReader`].
+    pub fn serialize_delimited_into(
+        &self,
+        output: &mut Vec<u8>,
+    ) -> Result<(), OperationFailedError> {
+        self.serialize_into_inner(false, true, output)
+    }
+
+    fn serialize_into_inner(
+        &self,
+        deterministic: bool,
+        delimited: bool,
+        output: &mut Vec<u8>,
+    ) -> Result<(), OperationFailedError> {
+        unsafe {
+            ffi::MessageEncodeToVec(
+                self.message,
+                self.def.as_ffi(),
+                deterministic,
+                delimited,
+                output,
+            )
+        }
+        .as_result()
+    }
+
+    /// Serializes the message into a buffer allocated from `arena`, avoiding
+    /// the copy into a `Vec` that [`Message::serialize`] makes.
+    pub fn serialize_in<'b>(&self, arena: &'b Arena<'b>) -> Result<&'b [u8], OperationFailedError> {
+        let mut ok = false;
+        let encoded = unsafe {
+            ffi::MessageEncode(
+                self.message,
+                self.def.as_ffi(),
+                false,
+                false,
+                arena.as_raw(),
+                &mut ok,
+            )
+        };
+        ok.as_result()?;
+        Ok(encoded)
+    }
+}
+
+impl<'a> Message<'a> {
+    /// Reports whether this message and `other` are of the same type and have
+    /// the same fields set to the same values, comparing their unknown fields
+    /// too.
+    ///
+    /// Equal unknown fields may be encoded in different ways, so unlike `==`,
+    /// this comparison is inexact: it may report two messages as unequal that
+    /// would be equal once their unknown fields were parsed.
+    pub fn eq_with_unknown_fields(&self, other: &Message) -> bool {
+        self.eq_inner(other, true)
+    }
+
+    fn eq_inner(&self, other: &Message, include_unknown_fields: bool) -> bool {
+        ptr::eq(self.def, other.def)
+            && unsafe {
+                ffi::MessageIsEqual(
+                    self.message,
+                    other.message,
+                    self.def.as_ffi(),
+                    include_unknown_fields,
+                )
+            }
+    }
+}
+
+/// Messages are equal if they are of the same type and have the same fields
+/// set to the same values. Unknown fields are ignored; see
+/// [`Message::eq_with_unknown_fields`]. Floating-point fields compare by
+/// their bits, so NaN equals itself and `0.0` does not equal `-0.0`.
+///
+/// Maps compare equal regardless of the order of their entries, and equal
+/// messages hash equally, so upb messages can be deduplicated in a `HashSet`
+/// without being re-encoded.
+impl<'a, 'b> PartialEq<Message<'b>> for Message<'a> {
+    fn eq(&self, other: &Message<'b>) -> bool {
+        self.eq_inner(other, false)
+    }
+}
+
+impl<'a> Eq for Message<'a> {}
+
+impl<'a> Hash for Message<'a> {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        state.write_u64(unsafe { ffi::MessageHash(self.message, self.def.as_ffi()) });
+    }
+}
+
+/// Reads a sequence of length-delimited upb messages from a buffer.
+///
+/// Each record is a varint-encoded length followed by a message of that
+/// length, as written by [`Message::serialize_delimited_into`] or by
+/// [`DelimitedWriter`](crate::io::DelimitedWriter).
+///
+/// The reader decodes records into an arena of its own, which it frees and
+/// replaces every `chunk_size` records, so the memory it holds stays bounded
+/// however long the buffer is without paying for a new arena per record.
+pub struct DelimitedReader<'a> {
+    def: &'a MessageDef,
+    data: &'a [u8],
+    position: usize,
+    arena: Pin<Box<Arena<'static>>>,
+    chunk_size: usize,
+    chunk_records: usize,
+}
+
+impl<'a> DelimitedReader<'a> {
+    /// The default number of records decoded into each arena.
+    pub const DEFAULT_CHUNK_SIZE: usize = 1024;
+
+    /// Creates a `DelimitedReader` that reads messages of type `def` from
+    /// `data`.
+    pub fn new(def: &'a MessageDef, data: &'a [u8]) -> DelimitedReader<'a> {
+        DelimitedReader::with_chunk_size(def, data, Self::DEFAULT_CHUNK_SIZE)
+    }
+
+    /// Creates a `DelimitedReader` that decodes `chunk_size` records into each
+    /// arena.
+    ///
+    /// A chunk size of zero is treated as one, replacing the arena before
+    /// every record.
+    pub fn with_chunk_size(
+        def: &'a MessageDef,
+        data: &'a [u8],
+        chunk_size: usize,
+    ) -> DelimitedReader<'a> {
+        DelimitedReader {
+            def,
+            data,
+            position: 0,
+            arena: Arena::new(),
+            chunk_size: chunk_size.max(1),
+            chunk_records: 0,
+        }
+    }
+
+    /// Reads the next record.
+    ///
+    /// The message borrows the reader, as the arena it lives in may be
+    /// replaced by the next call.
+    ///
+    /// Returns `Ok(None)` at a clean end of input, or an error if the input
+    /// ends in the middle of a record or a record cannot be parsed.
+    pub fn read_next(&mut self) -> Result<Option<Message<'_>>, OperationFailedError> {
+        if self.position == self.data.len() {
+            return Ok(None);
+        }
+        if self.chunk_records == self.chunk_size {
+            self.arena = Arena::new();
+            self.chunk_records = 0;
+        }
+        self.chunk_records += 1;
+        let message = Message::new(self.def, &self.arena);
+        let mut consumed = 0;
+        unsafe {
+            ffi::MessageDecodeDelimited(
+                message.message,
+                self.def.as_ffi(),
+                &self.data[self.position..],
+                self.arena.as_raw(),
+                &mut consumed,
+            )
+        }
+        .as_result()?;
+        self.position += consumed;
+        Ok(Some(message))
+    }
+
+    /// Returns the number of bytes of the buffer consumed so far.
+    pub fn position(&self) -> usize {
+        self.position
+    }
+}
+
+/// A upb message whose string and bytes fields point into the buffer that it
+/// was parsed from, rather than into copies in its arena.
+///
+/// Parsing an aliased message allocates only the message structures
+/// themselves, which makes it the cheapest way to read fields from large
+/// buffers such as memory-mapped files. The message borrows the buffer, so it
+/// cannot outlive it.
+///
+/// Unlike a [`Message`], an aliased message cannot be spliced into another
+/// message, as the other message could then outlive the buffer.
+pub struct AliasedMessage<'a> {
+    message: Message<'a>,
+}
+
+impl<'a> AliasedMessage<'a> {
+    /// Parses a message of type `def` from `data` into `arena`, without
+    /// copying its string and bytes fields.
+    ///
+    /// Returns an error if `data` is not a valid encoding of the message type,
+    /// or if any required fields are missing.
+    pub fn parse(
+        def: &'a MessageDef,
+        arena: &'a Arena<'a>,
+        data: &'a [u8],
+    ) -> Result<AliasedMessage<'a>, OperationFailedError> {
+        let mut message = AliasedMessage {
+            message: Message::new(def, arena),
+        };
+        message.merge_from_bytes(data)?;
+        Ok(message)
+    }
+
+    /// Merges the fields encoded in `data` into this message, without copying
+    /// its string and bytes fields.
+    pub fn merge_from_bytes(&mut self, data: &'a [u8]) -> Result<(), OperationFailedError> {
+        self.message.merge_inner(data, true)
+    }
+
+    /// Returns the contents of the singular string or bytes field named
+    /// `field`, or its default value if it is not set.
+    ///
+    /// The contents are borrowed from the buffer that the field was parsed
+    /// from. Returns `None` if this message has no such field.
+    pub fn get_bytes(&self, field: &str) -> Option<&'a [u8]> {
+        self.message.get_bytes(field)
+    }
+
+    /// Returns the type of this message.
+    pub fn def(&self) -> &'a MessageDef {
+        self.message.def()
+    }
+
+    /// Serializes the message.
+    ///
+    /// Returns an error if any required fields are missing.
+    pub fn serialize(&self) -> Result<Vec<u8>, OperationFailedError> {
+        self.message.serialize()
+    }
+
+    /// Serializes the message deterministically, i.e., with map entries in
+    /// the order of their keys.
+    pub fn serialize_deterministic(&self) -> Result<Vec<u8>, OperationFailedError> {
+        self.message.serialize_deterministic()
+    }
+}
+
+impl<'a, 'b> PartialEq<AliasedMessage<'b>> for AliasedMessage<'a> {
+    fn eq(&self, other: &AliasedMessage<'b>) -> bool {
+        self.message == other.message
+    }
+}
+
+impl<'a> Eq for AliasedMessage<'a> {}
+
+impl<'a> Hash for AliasedMessage<'a> {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.message.hash(state)
+    }
+}
+
+/// A upb message type built from a mini schema, without a [`DefPool`].
+///
+/// A mini schema, as produced by [`MessageDef::encode_mini_schema`], is a
+/// fraction of the size of the file descriptors it was derived from, and
+/// building one is cheap. It is enough to parse and serialize messages, but
+/// not to look up their fields by name.
+pub struct MiniSchema {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for MiniSchema {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMiniSchema(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl MiniSchema {
+    /// Builds the message types encoded in `data`.
+    ///
+    /// Returns an error if `data` is not a valid mini schema.
+    pub fn new(data: &[u8]) -> Result<Pin<Box<MiniSchema>>, OperationFailedError> {
+        let schema = ffi::NewMiniSchema(data);
+        match schema.is_null() {
+            true => Err(OperationFailedError),
+            false => Ok(unsafe { Self::from_ffi_owned(schema) }),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::MiniSchema);
+}
+
+// SAFETY: the message types of a mini schema are immutable once built.
+unsafe impl Send for MiniSchema {}
+unsafe impl Sync for MiniSchema {}
+
+/// A upb message of the root type of a [`MiniSchema`], allocated from an
+/// [`Arena`].
+pub struct MiniMessage<'a> {
+    message: *mut ffi::Message,
+    schema: &'a MiniSchema,
+    arena: &'a Arena<'a>,
+}
+
+impl<'a> MiniMessage<'a> {
+    /// Creates a new, empty message of the root type of `schema` in `arena`.
+    ///
+    /// # Panics
+    ///
+    /// Panics if the arena is out of memory, which can only happen to an arena
+    /// created with [`Arena::with_fixed_block`].
+    pub fn new(schema: &'a MiniSchema, arena: &'a Arena<'a>) -> MiniMessage<'a> {
+        let message = unsafe { ffi::NewMiniMessage(schema.as_ffi(), arena.as_raw()) };
+        assert!(!message.is_null(), "failed to allocate upb message");
+        MiniMessage {
+            message,
+            schema,
+            arena,
+        }
+    }
+
+    /// Parses a message of the root type of `schema` from `data` into
+    /// `arena`.
+    ///
+    /// Returns an error if `data` is not a valid encoding of the message type,
+    /// or if any required fields are missing.
+    pub fn parse(
+        schema: &'a MiniSchema,
+        arena: &'a Arena<'a>,
+        data: &[u8],
+    ) -> Result<MiniMessage<'a>, OperationFailedError> {
+        let mut message = MiniMessage::new(schema, arena);
+        message.merge_from_bytes(data)?;
+        Ok(message)
+    }
+
+    /// Merges the fields encoded in `data` into this message.
+    ///
+    /// Extensions are preserved as unknown fields.
+    pub fn merge_from_bytes(&mut self, data: &[u8]) -> Result<(), OperationFailedError> {
+        unsafe {
+            ffi::MiniMessageDecode(
+                self.message,
+                self.schema.as_ffi(),
+                data,
+                self.arena.as_raw(),
+            )
+        }
+        .as_result()
+    }
+
+    /// Returns the arena from which this message is allocated.
+    pub fn arena(&self) -> &'a Arena<'a> {
+        self.arena
+    }
+
+    /// Serializes the message.
+    ///
+    /// Returns an error if any required fields are missing.
+    pub fn serialize(&self) -> Result<Vec<u8>, OperationFailedError> {
+        self.serialize_inner(false)
+    }
+
+    /// Serializes the message deterministically, i.e., with map entries in
+    /// the order of their keys.
+    pub fn serialize_deterministic(&self) -> Result<Vec<u8>, OperationFailedError> {
+        self.serialize_inner(true)
+    }
+
+    fn serialize_inner(&self, deterministic: bool) -> Result<Vec<u8>, OperationFailedError> {
+        let mut output = Vec::new();
+        unsafe {
+            ffi::MiniMessageEncodeToVec(
+                self.message,
+                self.schema.as_ffi(),
+                deterministic,
+                &mut output,
+            )
+        }
+        .as_result()?;
+        Ok(output)
+    }
+}
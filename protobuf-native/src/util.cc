@@ -0,0 +1,407 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "protobuf-native/src/util.h"
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "absl/base/internal/endian.h"
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/unknown_field_set.h"
+#include "protobuf-native/src/util.rs.h"
+
+namespace protobuf_native {
+namespace util {
+
+using Differencer = google::protobuf::util::MessageDifferencer;
+
+namespace {
+
+// Serializes a message whose size has already been computed.
+std::string SerializeDeterministically(const Message& message, size_t size) {
+    std::string bytes;
+    bytes.reserve(size);
+    {
+        io::StringOutputStream stream(&bytes);
+        io::CodedOutputStream output(&stream);
+        output.SetSerializationDeterministic(true);
+        message.SerializeWithCachedSizes(&output);
+    }
+    return bytes;
+}
+
+// Hashes messages by reflection, consistently with MessageDifferencer: messages
+// that compare equal with the default settings hash equally.
+class MessageHasher {
+   public:
+    MessageHasher(const HashOptions& options, const FieldDescriptor* ignored = nullptr)
+        : options_(options), ignored_(ignored) {}
+
+    uint64_t HashMessage(uint64_t h, const Message& message) {
+        const Reflection* reflection = message.GetReflection();
+        std::vector<const FieldDescriptor*> fields;
+        reflection->ListFields(message, &fields);
+        for (const FieldDescriptor* field : fields) {
+            if (field == ignored_) {
+                continue;
+            }
+            h = Combine(h, static_cast<uint64_t>(field->number()));
+            if (field->is_map()) {
+                // The order of map entries is unspecified, so the entries are
+                // combined with a commutative operation.
+                uint64_t entries = 0;
+                int size = reflection->FieldSize(message, field);
+                for (int i = 0; i < size; ++i) {
+                    entries += HashMessage(0, reflection->GetRepeatedMessage(message, field, i));
+                }
+                h = Combine(Combine(h, static_cast<uint64_t>(size)), entries);
+            } else if (field->is_repeated()) {
+                int size = reflection->FieldSize(message, field);
+                h = Combine(h, static_cast<uint64_t>(size));
+                for (int i = 0; i < size; ++i) {
+                    h = HashValue(h, message, field, i);
+                }
+            } else {
+                h = HashValue(h, message, field, -1);
+            }
+        }
+        if (!options_.ignore_unknown_fields) {
+            h = HashUnknownFields(h, reflection->GetUnknownFields(message));
+        }
+        return h;
+    }
+
+   private:
+    static uint64_t Mix(uint64_t h) {
+        h ^= h >> 30;
+        h *= 0xbf58476d1ce4e5b9;
+        h ^= h >> 27;
+        h *= 0x94d049bb133111eb;
+        h ^= h >> 31;
+        return h;
+    }
+
+    static uint64_t Combine(uint64_t h, uint64_t value) {
+        return Mix(h ^ (value + 0x9e3779b97f4a7c15));
+    }
+
+    static uint64_t CombineBytes(uint64_t h, absl::string_view bytes) {
+        h = Combine(h, bytes.size());
+        const char* p = bytes.data();
+        size_t remaining = bytes.size();
+        for (; remaining >= 8; p += 8, remaining -= 8) {
+            h = Combine(h, absl::little_endian::Load64(p));
+        }
+        if (remaining > 0) {
+            uint64_t tail = 0;
+            for (size_t i = 0; i < remaining; ++i) {
+                tail |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (8 * i);
+            }
+            h = Combine(h, tail);
+        }
+        return h;
+    }
+
+    static uint64_t CombineDouble(uint64_t h, double value) {
+        // Zero and negative zero compare equal, so they must hash equally.
+        if (value == 0) {
+            value = 0;
+        }
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return Combine(h, bits);
+    }
+
+    // Hashes the value of a singular field, if index is negative, or of the
+    // element at index of a repeated field.
+    uint64_t HashValue(uint64_t h, const Message& message, const FieldDescriptor* field,
+                       int index) {
+        const Reflection* r = message.GetReflection();
+        bool repeated = index >= 0;
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+                return Combine(h, static_cast<uint64_t>(
+                                      repeated ? r->GetRepeatedInt32(message, field, index)
+                                               : r->GetInt32(message, field)));
+            case FieldDescriptor::CPPTYPE_INT64:
+                return Combine(h, static_cast<uint64_t>(
+                                      repeated ? r->GetRepeatedInt64(message, field, index)
+                                               : r->GetInt64(message, field)));
+            case FieldDescriptor::CPPTYPE_UINT32:
+                return Combine(h, repeated ? r->GetRepeatedUInt32(message, field, index)
+                                           : r->GetUInt32(message, field));
+            case FieldDescriptor::CPPTYPE_UINT64:
+                return Combine(h, repeated ? r->GetRepeatedUInt64(message, field, index)
+                                           : r->GetUInt64(message, field));
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                return CombineDouble(h, repeated ? r->GetRepeatedDouble(message, field, index)
+                                                 : r->GetDouble(message, field));
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                return CombineDouble(h, repeated ? r->GetRepeatedFloat(message, field, index)
+                                                 : r->GetFloat(message, field));
+            case FieldDescriptor::CPPTYPE_BOOL:
+                return Combine(h, repeated ? r->GetRepeatedBool(message, field, index)
+                                           : r->GetBool(message, field));
+            case FieldDescriptor::CPPTYPE_ENUM:
+                return Combine(h, static_cast<uint64_t>(
+                                      repeated ? r->GetRepeatedEnumValue(message, field, index)
+                                               : r->GetEnumValue(message, field)));
+            case FieldDescriptor::CPPTYPE_STRING:
+                return CombineBytes(
+                    h, repeated ? r->GetRepeatedStringReference(message, field, index, &scratch_)
+                                : r->GetStringReference(message, field, &scratch_));
+            case FieldDescriptor::CPPTYPE_MESSAGE:
+                return HashMessage(h, repeated ? r->GetRepeatedMessage(message, field, index)
+                                               : r->GetMessage(message, field));
+        }
+        return h;
+    }
+
+    static uint64_t HashUnknownFields(uint64_t h, const UnknownFieldSet& fields) {
+        for (int i = 0; i < fields.field_count(); ++i) {
+            const UnknownField& field = fields.field(i);
+            h = Combine(h, static_cast<uint64_t>(field.number()));
+            h = Combine(h, static_cast<uint64_t>(field.type()));
+            switch (field.type()) {
+                case UnknownField::TYPE_VARINT:
+                    h = Combine(h, field.varint());
+                    break;
+                case UnknownField::TYPE_FIXED32:
+                    h = Combine(h, field.fixed32());
+                    break;
+                case UnknownField::TYPE_FIXED64:
+                    h = Combine(h, field.fixed64());
+                    break;
+                case UnknownField::TYPE_LENGTH_DELIMITED:
+                    h = CombineBytes(h, field.length_delimited());
+                    break;
+                case UnknownField::TYPE_GROUP:
+                    h = HashUnknownFields(h, field.group());
+                    break;
+            }
+        }
+        return h;
+    }
+
+    const HashOptions& options_;
+    const FieldDescriptor* ignored_;
+    std::string scratch_;
+};
+
+}  // namespace
+
+MessageDifferencer::MessageDifferencer() {}
+
+void MessageDifferencer::SetMessageFieldComparison(int comparison) {
+    differencer_.set_message_field_comparison(
+        static_cast<Differencer::MessageFieldComparison>(comparison));
+}
+
+void MessageDifferencer::SetScope(int scope) {
+    differencer_.set_scope(static_cast<Differencer::Scope>(scope));
+}
+
+void MessageDifferencer::SetRepeatedFieldComparison(int comparison) {
+    differencer_.set_repeated_field_comparison(
+        static_cast<Differencer::RepeatedFieldComparison>(comparison));
+}
+
+void MessageDifferencer::IgnoreField(const FieldDescriptor* field) {
+    differencer_.IgnoreField(field);
+}
+
+void MessageDifferencer::SetCompareSerializedFirst(bool compare_serialized_first) {
+    compare_serialized_first_ = compare_serialized_first;
+}
+
+bool MessageDifferencer::Equals(const Message& message1, const Message& message2) {
+    // The differencer treats messages of different types as a programming
+    // error, which is fatal in debug builds.
+    if (message1.GetDescriptor() != message2.GetDescriptor()) {
+        return false;
+    }
+    if (compare_serialized_first_ && SerializedEqual(message1, message2)) {
+        return true;
+    }
+    // With no reporter installed, the differencer returns as soon as it finds
+    // a difference.
+    return differencer_.Compare(message1, message2);
+}
+
+bool MessageDifferencer::Compare(const Message& message1, const Message& message2,
+                                 rust::String& report) {
+    if (message1.GetDescriptor() != message2.GetDescriptor()) {
+        report = "messages are of different types: " + message1.GetDescriptor()->full_name() +
+                 " and " + message2.GetDescriptor()->full_name();
+        return false;
+    }
+    std::string output;
+    differencer_.ReportDifferencesToString(&output);
+    bool equal = differencer_.Compare(message1, message2);
+    differencer_.ReportDifferencesTo(nullptr);
+    report = rust::String::lossy(output);
+    return equal;
+}
+
+// Deterministic serializations that are byte for byte identical imply that the
+// messages are equal under any comparison the differencer supports. The
+// converse does not hold, e.g. for maps or unknown fields, so unequal bytes
+// are not conclusive.
+bool MessageDifferencer::SerializedEqual(const Message& message1,
+                                         const Message& message2) const {
+    size_t size = message1.ByteSizeLong();
+    if (size != message2.ByteSizeLong()) {
+        return false;
+    }
+    return SerializeDeterministically(message1, size) ==
+           SerializeDeterministically(message2, size);
+}
+
+MessageDifferencer* NewMessageDifferencer() { return new MessageDifferencer(); }
+
+void DeleteMessageDifferencer(MessageDifferencer* differencer) { delete differencer; }
+
+uint64_t HashMessage(const Message& message, uint64_t seed, const HashOptions& options) {
+    return MessageHasher(options).HashMessage(seed, message);
+}
+
+uint64_t HashMessageIgnoringField(const Message& message, uint64_t seed,
+                                  const FieldDescriptor* ignored) {
+    HashOptions options{};
+    return MessageHasher(options, ignored).HashMessage(seed, message);
+}
+
+RequiredFieldChecker::RequiredFieldChecker(const Descriptor* descriptor)
+    : descriptor_(descriptor) {
+    // Number the types reachable from the root, which is numbered 0.
+    std::vector<const Descriptor*> types{descriptor};
+    std::unordered_map<const Descriptor*, size_t> numbers{{descriptor, 0}};
+    for (size_t i = 0; i < types.size(); ++i) {
+        for (int j = 0; j < types[i]->field_count(); ++j) {
+            const Descriptor* type = types[i]->field(j)->message_type();
+            if (type != nullptr && numbers.emplace(type, types.size()).second) {
+                types.push_back(type);
+            }
+        }
+    }
+
+    // A type needs checking if it has required fields or extensions, or a
+    // message field of a type that needs checking. As types can be
+    // recursive, iterate until no more types are found to need checking.
+    std::vector<bool> needed(types.size());
+    for (size_t i = 0; i < types.size(); ++i) {
+        needed[i] = types[i]->extension_range_count() > 0;
+        for (int j = 0; j < types[i]->field_count(); ++j) {
+            needed[i] = needed[i] || types[i]->field(j)->is_required();
+        }
+    }
+    for (bool changed = true; changed;) {
+        changed = false;
+        for (size_t i = 0; i < types.size(); ++i) {
+            for (int j = 0; j < types[i]->field_count() && !needed[i]; ++j) {
+                const Descriptor* type = types[i]->field(j)->message_type();
+                if (type != nullptr && needed[numbers[type]]) {
+                    needed[i] = changed = true;
+                }
+            }
+        }
+    }
+
+    plans_.resize(types.size());
+    for (size_t i = 0; i < types.size(); ++i) {
+        if (!needed[i]) {
+            continue;
+        }
+        Plan& plan = plans_[i];
+        plan.extensions = types[i]->extension_range_count() > 0;
+        for (int j = 0; j < types[i]->field_count(); ++j) {
+            const FieldDescriptor* field = types[i]->field(j);
+            if (field->is_required()) {
+                plan.required.push_back(field);
+            }
+            const Descriptor* type = field->message_type();
+            if (type != nullptr && needed[numbers[type]]) {
+                plan.submessages.emplace_back(field, numbers[type]);
+            }
+        }
+    }
+    needed_ = needed[0];
+}
+
+bool RequiredFieldChecker::IsInitialized(const Message& message, bool& ok) const {
+    ok = message.GetDescriptor() == descriptor_;
+    return ok && (!needed_ || Check(message, plans_[0]));
+}
+
+bool RequiredFieldChecker::Check(const Message& message, const Plan& plan) const {
+    const Reflection* reflection = message.GetReflection();
+    for (const FieldDescriptor* field : plan.required) {
+        if (!reflection->HasField(message, field)) {
+            return false;
+        }
+    }
+    for (const auto& submessage : plan.submessages) {
+        const FieldDescriptor* field = submessage.first;
+        const Plan& subplan = plans_[submessage.second];
+        if (field->is_repeated()) {
+            int size = reflection->FieldSize(message, field);
+            for (int i = 0; i < size; ++i) {
+                if (!Check(reflection->GetRepeatedMessage(message, field, i), subplan)) {
+                    return false;
+                }
+            }
+        } else if (reflection->HasField(message, field) &&
+                   !Check(reflection->GetMessage(message, field), subplan)) {
+            return false;
+        }
+    }
+    if (plan.extensions) {
+        // Extensions are not known when the plan is compiled, so fall back to
+        // `IsInitialized` for those that are set. Extensions cannot be
+        // required themselves.
+        std::vector<const FieldDescriptor*> fields;
+        reflection->ListFields(message, &fields);
+        for (const FieldDescriptor* field : fields) {
+            if (!field->is_extension() ||
+                field->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE) {
+                continue;
+            }
+            if (field->is_repeated()) {
+                int size = reflection->FieldSize(message, field);
+                for (int i = 0; i < size; ++i) {
+                    if (!reflection->GetRepeatedMessage(message, field, i).IsInitialized()) {
+                        return false;
+                    }
+                }
+            } else if (!reflection->GetMessage(message, field).IsInitialized()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+RequiredFieldChecker* NewRequiredFieldChecker(const Descriptor* descriptor) {
+    return new RequiredFieldChecker(descriptor);
+}
+
+void DeleteRequiredFieldChecker(RequiredFieldChecker* checker) { delete checker; }
+
+}  // namespace util
+}  // namespace protobuf_native
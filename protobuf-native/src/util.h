@@ -0,0 +1,104 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/descriptor.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/util/message_differencer.h"
+#include "rust/cxx.h"
+
+namespace protobuf_native {
+namespace util {
+
+using namespace google::protobuf;
+
+struct HashOptions;
+
+// Compares messages for equality by reflection.
+//
+// Without a report, the comparison stops at the first difference. Optionally,
+// both messages are first serialized deterministically and compared byte for
+// byte, and the reflective comparison is only performed if the bytes differ.
+class MessageDifferencer {
+   public:
+    MessageDifferencer();
+
+    void SetMessageFieldComparison(int comparison);
+    void SetScope(int scope);
+    void SetRepeatedFieldComparison(int comparison);
+    void IgnoreField(const FieldDescriptor* field);
+    void SetCompareSerializedFirst(bool compare_serialized_first);
+
+    bool Equals(const Message& message1, const Message& message2);
+    bool Compare(const Message& message1, const Message& message2, rust::String& report);
+
+   private:
+    bool SerializedEqual(const Message& message1, const Message& message2) const;
+
+    google::protobuf::util::MessageDifferencer differencer_;
+    bool compare_serialized_first_ = false;
+};
+
+MessageDifferencer* NewMessageDifferencer();
+void DeleteMessageDifferencer(MessageDifferencer* differencer);
+
+uint64_t HashMessage(const Message& message, uint64_t seed, const HashOptions& options);
+// Like HashMessage, with default options, but skips `ignored` wherever it is
+// set in the message or its submessages. Not exposed to Rust.
+uint64_t HashMessageIgnoringField(const Message& message, uint64_t seed,
+                                  const FieldDescriptor* ignored);
+
+// Checks that messages of one type have all of their required fields set,
+// like `Message::IsInitialized`, following a plan compiled from the type's
+// descriptor.
+//
+// The plan lists, for each message type, its required fields and those of
+// its message fields whose types can transitively contain required fields.
+// Subtrees that cannot contain required fields are never visited.
+class RequiredFieldChecker {
+   public:
+    RequiredFieldChecker(const Descriptor* descriptor);
+
+    bool IsInitialized(const Message& message, bool& ok) const;
+
+   private:
+    struct Plan {
+        std::vector<const FieldDescriptor*> required;
+        // The message fields to descend into, with the plans of their types.
+        std::vector<std::pair<const FieldDescriptor*, size_t>> submessages;
+        // Whether the type has extension ranges, whose message extensions
+        // are checked with `IsInitialized`.
+        bool extensions = false;
+    };
+
+    bool Check(const Message& message, const Plan& plan) const;
+
+    const Descriptor* descriptor_;
+    // The plans of the types reachable from `descriptor_`, whose own plan is
+    // first. Only the plans of types that can contain required fields are
+    // populated.
+    std::vector<Plan> plans_;
+    bool needed_ = false;
+};
+
+RequiredFieldChecker* NewRequiredFieldChecker(const Descriptor* descriptor);
+void DeleteRequiredFieldChecker(RequiredFieldChecker* checker);
+
+}  // namespace util
+}  // namespace protobuf_native
@@ -0,0 +1,315 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Utilities for working with messages.
+
+use std::marker::{PhantomData, PhantomPinned};
+use std::mem;
+use std::pin::Pin;
+
+use crate::internal::{unsafe_ffi_conversions, BoolExt, CInt};
+use crate::{private, Descriptor, FieldDescriptor, Message, OperationFailedError};
+
+#[cxx::bridge(namespace = "protobuf_native::util")]
+pub(crate) mod ffi {
+    struct HashOptions {
+        ignore_unknown_fields: bool,
+    }
+
+    unsafe extern "C++" {
+        include!("protobuf-native/src/util.h");
+        include!("protobuf-native/src/internal.h");
+
+        #[namespace = "protobuf_native::internal"]
+        type CInt = crate::internal::CInt;
+
+        #[namespace = "google::protobuf"]
+        type Descriptor = crate::ffi::Descriptor;
+
+        #[namespace = "google::protobuf"]
+        type FieldDescriptor = crate::ffi::FieldDescriptor;
+
+        #[namespace = "google::protobuf"]
+        type Message = crate::ffi::Message;
+
+        type MessageDifferencer;
+        fn NewMessageDifferencer() -> *mut MessageDifferencer;
+        unsafe fn DeleteMessageDifferencer(differencer: *mut MessageDifferencer);
+        fn SetMessageFieldComparison(self: Pin<&mut MessageDifferencer>, comparison: CInt);
+        fn SetScope(self: Pin<&mut MessageDifferencer>, scope: CInt);
+        fn SetRepeatedFieldComparison(self: Pin<&mut MessageDifferencer>, comparison: CInt);
+        unsafe fn IgnoreField(self: Pin<&mut MessageDifferencer>, field: *const FieldDescriptor);
+        fn SetCompareSerializedFirst(self: Pin<&mut MessageDifferencer>, compare: bool);
+        fn Equals(
+            self: Pin<&mut MessageDifferencer>,
+            message1: &Message,
+            message2: &Message,
+        ) -> bool;
+        fn Compare(
+            self: Pin<&mut MessageDifferencer>,
+            message1: &Message,
+            message2: &Message,
+            report: &mut String,
+        ) -> bool;
+
+        fn HashMessage(message: &Message, seed: u64, options: &HashOptions) -> u64;
+
+        type RequiredFieldChecker;
+        unsafe fn NewRequiredFieldChecker(
+            descriptor: *const Descriptor,
+        ) -> *mut RequiredFieldChecker;
+        unsafe fn DeleteRequiredFieldChecker(checker: *mut RequiredFieldChecker);
+        fn IsInitialized(self: &RequiredFieldChecker, message: &Message, ok: &mut bool) -> bool;
+    }
+}
+
+/// How a [`MessageDifferencer`] compares fields that are set in one message
+/// but not the other.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum MessageFieldComparison {
+    /// Fields must be set in both messages, or in neither, to be equal.
+    Equal,
+    /// A field that is not set is equal to a field that is set to its default
+    /// value.
+    Equivalent,
+}
+
+impl MessageFieldComparison {
+    fn to_ffi(self) -> CInt {
+        match self {
+            MessageFieldComparison::Equal => CInt(0),
+            MessageFieldComparison::Equivalent => CInt(1),
+        }
+    }
+}
+
+/// Which fields a [`MessageDifferencer`] compares.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum Scope {
+    /// All fields of both messages are compared.
+    Full,
+    /// Only the fields that are set in the first message are compared.
+    Partial,
+}
+
+impl Scope {
+    fn to_ffi(self) -> CInt {
+        match self {
+            Scope::Full => CInt(0),
+            Scope::Partial => CInt(1),
+        }
+    }
+}
+
+/// How a [`MessageDifferencer`] compares repeated fields.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum RepeatedFieldComparison {
+    /// Elements are compared in order.
+    AsList,
+    /// Elements are compared without regard to their order.
+    AsSet,
+}
+
+impl RepeatedFieldComparison {
+    fn to_ffi(self) -> CInt {
+        match self {
+            RepeatedFieldComparison::AsList => CInt(0),
+            RepeatedFieldComparison::AsSet => CInt(1),
+        }
+    }
+}
+
+/// Compares messages for equality.
+///
+/// A differencer holds only its configuration, so a single differencer can
+/// be configured once and used to compare any number of pairs of messages.
+///
+/// [`MessageDifferencer::equals`] answers only whether two messages are
+/// equal, and stops at the first difference it finds.
+/// [`MessageDifferencer::compare`] additionally describes every difference,
+/// and is correspondingly slower.
+pub struct MessageDifferencer {
+    _opaque: PhantomPinned,
+}
+
+impl Drop for MessageDifferencer {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteMessageDifferencer(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl MessageDifferencer {
+    /// Creates a differencer that compares all fields exactly.
+    pub fn new() -> Pin<Box<MessageDifferencer>> {
+        let differencer = ffi::NewMessageDifferencer();
+        unsafe { Self::from_ffi_owned(differencer) }
+    }
+
+    /// Sets how fields that are set in one message but not the other are
+    /// compared.
+    ///
+    /// The default is [`MessageFieldComparison::Equal`].
+    pub fn set_message_field_comparison(self: Pin<&mut Self>, comparison: MessageFieldComparison) {
+        self.as_ffi_mut()
+            .SetMessageFieldComparison(comparison.to_ffi())
+    }
+
+    /// Sets which fields are compared.
+    ///
+    /// The default is [`Scope::Full`].
+    pub fn set_scope(self: Pin<&mut Self>, scope: Scope) {
+        self.as_ffi_mut().SetScope(scope.to_ffi())
+    }
+
+    /// Sets how repeated fields are compared.
+    ///
+    /// The default is [`RepeatedFieldComparison::AsList`].
+    pub fn set_repeated_field_comparison(
+        self: Pin<&mut Self>,
+        comparison: RepeatedFieldComparison,
+    ) {
+        self.as_ffi_mut()
+            .SetRepeatedFieldComparison(comparison.to_ffi())
+    }
+
+    /// Excludes `field` from comparisons.
+    pub fn ignore_field(self: Pin<&mut Self>, field: &FieldDescriptor) {
+        unsafe { self.as_ffi_mut().IgnoreField(field.as_ffi()) }
+    }
+
+    /// Sets whether [`MessageDifferencer::equals`] first compares the
+    /// deterministic serializations of the messages.
+    ///
+    /// Messages whose serializations are identical are reported equal without
+    /// a reflective comparison. Otherwise the messages are compared field by
+    /// field as usual, since messages can be equal despite differing
+    /// serializations. This is profitable when most compared messages are
+    /// equal.
+    ///
+    /// Note that a floating-point field holding NaN is never equal to itself
+    /// in a reflective comparison, but is equal to an identically encoded NaN
+    /// when serializations are compared.
+    pub fn set_compare_serialized_first(self: Pin<&mut Self>, compare: bool) {
+        self.as_ffi_mut().SetCompareSerializedFirst(compare)
+    }
+
+    /// Reports whether `message1` and `message2` are equal.
+    ///
+    /// Messages of different types are never equal.
+    pub fn equals(self: Pin<&mut Self>, message1: &dyn Message, message2: &dyn Message) -> bool {
+        let message1: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message1)) };
+        let message2: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message2)) };
+        self.as_ffi_mut().Equals(message1, message2)
+    }
+
+    /// Compares `message1` and `message2`, returning a human-readable
+    /// description of their differences, or `None` if they are equal.
+    pub fn compare(
+        self: Pin<&mut Self>,
+        message1: &dyn Message,
+        message2: &dyn Message,
+    ) -> Option<String> {
+        let message1: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message1)) };
+        let message2: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message2)) };
+        let mut report = String::new();
+        match self.as_ffi_mut().Compare(message1, message2, &mut report) {
+            true => None,
+            false => Some(report),
+        }
+    }
+
+    unsafe_ffi_conversions!(ffi::MessageDifferencer);
+}
+
+/// Options that control how messages are hashed by [`hash_message_with_options`].
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct HashOptions {
+    /// Whether to exclude unknown fields from the hash.
+    pub ignore_unknown_fields: bool,
+}
+
+impl From<&HashOptions> for ffi::HashOptions {
+    fn from(options: &HashOptions) -> ffi::HashOptions {
+        ffi::HashOptions {
+            ignore_unknown_fields: options.ignore_unknown_fields,
+        }
+    }
+}
+
+/// Computes a 64-bit hash of `message`.
+///
+/// The message is walked by reflection, so no serialized copy of it is
+/// made. Messages that a default [`MessageDifferencer`] considers equal hash
+/// equally; in particular, the entries of map fields are hashed without
+/// regard to their order. The hash depends only on the message and `seed`,
+/// and not on the process computing it, so it is suitable for partitioning
+/// data across machines. It is not a cryptographic hash.
+pub fn hash_message(message: &dyn Message, seed: u64) -> u64 {
+    hash_message_with_options(message, seed, &HashOptions::default())
+}
+
+/// Like [`hash_message`], but with the given options.
+pub fn hash_message_with_options(message: &dyn Message, seed: u64, options: &HashOptions) -> u64 {
+    let message: &ffi::Message = unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+    ffi::HashMessage(message, seed, &options.into())
+}
+
+/// Checks that messages of one type have all of their required fields set.
+///
+/// The result is the same as that of [`MessageLite::is_initialized`], but
+/// the checker compiles a plan from the message type's descriptor when it is
+/// created, so that checking a message only descends into those of its
+/// message fields whose types can, directly or transitively, contain
+/// required fields. With schemas in which required fields are rare, most of
+/// the message tree is never visited.
+///
+/// [`MessageLite::is_initialized`]: crate::MessageLite::is_initialized
+pub struct RequiredFieldChecker<'a> {
+    _opaque: PhantomPinned,
+    _lifetime: PhantomData<&'a ()>,
+}
+
+impl<'a> Drop for RequiredFieldChecker<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::DeleteRequiredFieldChecker(self.as_ffi_mut_ptr_unpinned()) }
+    }
+}
+
+impl<'a> RequiredFieldChecker<'a> {
+    /// Creates a checker for messages of the specified type.
+    pub fn new(descriptor: &'a Descriptor) -> Pin<Box<RequiredFieldChecker<'a>>> {
+        let checker = unsafe { ffi::NewRequiredFieldChecker(descriptor.as_ffi()) };
+        unsafe { Self::from_ffi_owned(checker) }
+    }
+
+    /// Reports whether `message` and its submessages have all of their
+    /// required fields set.
+    ///
+    /// Returns an error if `message` is not of the checker's message type.
+    pub fn is_initialized(&self, message: &dyn Message) -> Result<bool, OperationFailedError> {
+        let message: &ffi::Message =
+            unsafe { mem::transmute(private::MessageLite::upcast(message)) };
+        let mut ok = false;
+        let initialized = self.as_ffi().IsInitialized(message, &mut ok);
+        ok.as_result()?;
+        Ok(initialized)
+    }
+
+    unsafe_ffi_conversions!(ffi::RequiredFieldChecker);
+}
@@ -0,0 +1,1875 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Schema-less scanning of the protocol buffer wire format.
+//!
+//! A [`WireReader`] decodes the fields of serialized messages directly from a
+//! [`ZeroCopyInputStream`], without a descriptor and without building any
+//! message object. It crosses into C++ once per chunk of the stream, not once
+//! per field, and returns the contents of length-delimited fields as slices
+//! of the stream's buffers wherever they do not straddle two chunks.
+//!
+//! The reader is a pull parser: each call to [`WireReader::next`] returns the
+//! next [`WireEvent`]. As the wire format does not say whether a
+//! length-delimited field holds a string, packed scalars or a nested message,
+//! the caller decides what to do with it: [`WireReader::read_bytes`] returns
+//! its contents, [`WireReader::enter`] descends into it as a nested message,
+//! whose end is signalled by [`WireEvent::EndMessage`], and otherwise the
+//! next call to `next` skips over it.
+//!
+//! When only a single field is needed from a message that is already in
+//! memory, [`extract_field`] finds it directly in the serialized bytes,
+//! skipping over every other field, [`extract_packed_fixed`] borrows the
+//! elements of a repeated fixed-width field without copying them, and a
+//! [`WireTransform`] removes, sets and appends fields while copying a
+//! serialized message. A [`Transcoder`]
+//! converts serialized messages between two versions of a schema, and a
+//! [`WireValidator`] checks serialized messages against their schema
+//! without parsing them.
+//!
+//! # Examples
+//!
+//! Sum the varint fields of a message and of any nested messages in field 2:
+//!
+//! ```
+//! use protobuf_native::io::SliceInputStream;
+//! use protobuf_native::wire::{WireEvent, WireReader};
+//!
+//! let data = b"\x08\x01\x12\x02\x08\x02\x08\x03";
+//! let mut input = SliceInputStream::new(data);
+//! let mut reader = WireReader::new(input.as_mut());
+//! let mut sum = 0;
+//! while let Some(event) = reader.next()? {
+//!     match event {
+//!         WireEvent::Varint { value, .. } => sum += value,
+//!         WireEvent::LengthDelimited { number: 2, .. } => reader.enter()?,
+//!         _ => (),
+//!     }
+//! }
+//! assert_eq!(sum, 6);
+//! # Ok::<_, protobuf_native::OperationFailedError>(())
+//! ```
+
+use std::collections::HashMap;
+use std::error::Error;
+use std::fmt;
+use std::marker::PhantomData;
+use std::mem;
+use std::pin::Pin;
+use std::ptr;
+use std::slice;
+use std::str;
+
+use crate::io::ZeroCopyInputStream;
+use crate::{Descriptor, FieldType, MessageLite, OperationFailedError};
+
+/// The largest length-delimited field the reader accepts, matching the limit
+/// on the size of a serialized message.
+const MAX_LENGTH: u64 = i32::MAX as u64;
+
+/// The deepest nesting of groups that [`IncrementalParser`] accepts, matching
+/// the default recursion limit of the parser.
+const MAX_GROUP_DEPTH: usize = 100;
+
+/// An event in the wire format of a message, returned by [`WireReader::next`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WireEvent {
+    /// A varint field, which holds an `int32`, `int64`, `uint32`, `uint64`,
+    /// `sint32`, `sint64`, `bool` or enum value.
+    Varint {
+        /// The number of the field.
+        number: u32,
+        /// The raw value of the field, before any zigzag decoding.
+        value: u64,
+    },
+    /// A 64-bit field, which holds a `fixed64`, `sfixed64` or `double` value.
+    Fixed64 {
+        /// The number of the field.
+        number: u32,
+        /// The raw bits of the field.
+        value: u64,
+    },
+    /// A 32-bit field, which holds a `fixed32`, `sfixed32` or `float` value.
+    Fixed32 {
+        /// The number of the field.
+        number: u32,
+        /// The raw bits of the field.
+        value: u32,
+    },
+    /// The start of a length-delimited field, which holds a string, bytes, a
+    /// nested message or packed repeated scalars.
+    ///
+    /// The contents may be read with [`WireReader::read_bytes`] or entered
+    /// with [`WireReader::enter`]. If neither is called, the next call to
+    /// [`WireReader::next`] skips them.
+    LengthDelimited {
+        /// The number of the field.
+        number: u32,
+        /// The length of the field's contents in bytes.
+        len: usize,
+    },
+    /// The start of a group.
+    StartGroup {
+        /// The number of the field.
+        number: u32,
+    },
+    /// The end of a group.
+    EndGroup {
+        /// The number of the field.
+        number: u32,
+    },
+    /// The end of a nested message that was entered with
+    /// [`WireReader::enter`].
+    EndMessage,
+}
+
+/// The value of a field, as returned by [`extract_field`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum WireValue<'a> {
+    /// The raw value of a varint field.
+    Varint(u64),
+    /// The raw bits of a 64-bit field.
+    Fixed64(u64),
+    /// The raw bits of a 32-bit field.
+    Fixed32(u32),
+    /// The contents of a length-delimited field.
+    LengthDelimited(&'a [u8]),
+}
+
+/// Finds the field at `path` in the serialized message `data`, without
+/// parsing the message.
+///
+/// Each element of `path` but the last is the number of a message field whose
+/// contents are searched for the next element, and the last element is the
+/// number of the field to extract. As when parsing, if a field occurs more
+/// than once, the last occurrence wins, and the occurrences of a message field
+/// are merged, so the whole message is scanned. All other fields are skipped
+/// without being decoded, and nothing is allocated.
+///
+/// Returns `None` if the field is not present, and an error if `path` is
+/// empty or `data` is not valid wire format. Groups are skipped, not searched,
+/// and the elements of packed repeated fields are not decoded.
+///
+/// # Examples
+///
+/// ```
+/// use protobuf_native::wire::{self, WireValue};
+///
+/// // Field 1 is a message whose field 2 is the string "key".
+/// let data = b"\x0a\x05\x12\x03key\x10\x01";
+/// let key = wire::extract_field(data, &[1, 2])?;
+/// assert_eq!(key, Some(WireValue::LengthDelimited(b"key")));
+/// # Ok::<_, protobuf_native::OperationFailedError>(())
+/// ```
+pub fn extract_field<'a>(
+    data: &'a [u8],
+    path: &[u32],
+) -> Result<Option<WireValue<'a>>, OperationFailedError> {
+    let (&target, rest) = path.split_first().ok_or(OperationFailedError)?;
+    let mut input = data;
+    let mut found = None;
+    while !input.is_empty() {
+        let (number, wire_type) = read_tag(&mut input)?;
+        if wire_type == 3 {
+            skip_group(&mut input, number)?;
+            continue;
+        }
+        let value = read_value(&mut input, wire_type)?;
+        if number != target {
+            continue;
+        }
+        match (rest.is_empty(), value) {
+            (true, value) => found = Some(value),
+            (false, WireValue::LengthDelimited(contents)) => {
+                if let Some(value) = extract_field(contents, rest)? {
+                    found = Some(value);
+                }
+            }
+            (false, _) => (),
+        }
+    }
+    Ok(found)
+}
+
+/// A fixed-width scalar type that [`PackedFixed`] can view: `u32`, `i32` and
+/// `f32`, as in `fixed32`, `sfixed32` and `float` fields, and `u64`, `i64`
+/// and `f64`, as in `fixed64`, `sfixed64` and `double` fields.
+///
+/// This trait is sealed and cannot be implemented outside this crate.
+pub trait FixedWidth: fixed_width::Sealed + Copy + 'static {}
+
+mod fixed_width {
+    pub trait Sealed: Sized {
+        /// The wire type of an unpacked element.
+        const WIRE_TYPE: u32;
+
+        /// Decodes an element from exactly `size_of::<Self>()` little-endian
+        /// bytes.
+        fn from_le_slice(bytes: &[u8]) -> Self;
+    }
+}
+
+macro_rules! impl_fixed_width {
+    ($($ty:ty => $wire_type:expr),*) => {
+        $(
+            impl FixedWidth for $ty {}
+
+            impl fixed_width::Sealed for $ty {
+                const WIRE_TYPE: u32 = $wire_type;
+
+                fn from_le_slice(bytes: &[u8]) -> $ty {
+                    <$ty>::from_le_bytes(bytes.try_into().unwrap())
+                }
+            }
+        )*
+    };
+}
+
+impl_fixed_width!(u32 => 5, i32 => 5, f32 => 5, u64 => 1, i64 => 1, f64 => 1);
+
+/// A borrowed view of the elements of a packed repeated fixed-width field,
+/// such as a `float` or `fixed64` field, in its serialized form.
+///
+/// The view refers to the field's contents in the serialized message, and
+/// decodes elements only when they are accessed, so large packed fields, like
+/// vector embeddings, need not be copied to be read. As the contents of a
+/// field are not necessarily aligned for `T`, the view can only be borrowed
+/// as a `&[T]` by [`PackedFixed::as_slice`] when they happen to be.
+#[derive(Debug, Clone, Copy)]
+pub struct PackedFixed<'a, T> {
+    bytes: &'a [u8],
+    _type: PhantomData<T>,
+}
+
+impl<'a, T> PackedFixed<'a, T>
+where
+    T: FixedWidth,
+{
+    /// Views `bytes`, the contents of a packed field, as elements of type
+    /// `T`.
+    ///
+    /// Returns an error if the length of `bytes` is not a multiple of the
+    /// size of `T`.
+    pub fn new(bytes: &'a [u8]) -> Result<PackedFixed<'a, T>, OperationFailedError> {
+        if bytes.len() % mem::size_of::<T>() != 0 {
+            return Err(OperationFailedError);
+        }
+        Ok(PackedFixed {
+            bytes,
+            _type: PhantomData,
+        })
+    }
+
+    /// Returns the number of elements.
+    pub fn len(&self) -> usize {
+        self.bytes.len() / mem::size_of::<T>()
+    }
+
+    /// Reports whether there are no elements.
+    pub fn is_empty(&self) -> bool {
+        self.bytes.is_empty()
+    }
+
+    /// Returns the `index`th element, or `None` if `index` is out of bounds.
+    pub fn get(&self, index: usize) -> Option<T> {
+        let size = mem::size_of::<T>();
+        let bytes = self.bytes.get(index * size..(index + 1) * size)?;
+        Some(T::from_le_slice(bytes))
+    }
+
+    /// Returns an iterator over the elements.
+    pub fn iter(&self) -> impl DoubleEndedIterator<Item = T> + ExactSizeIterator + 'a {
+        self.bytes
+            .chunks_exact(mem::size_of::<T>())
+            .map(T::from_le_slice)
+    }
+
+    /// Returns the serialized elements, in little-endian byte order.
+    pub fn as_bytes(&self) -> &'a [u8] {
+        self.bytes
+    }
+
+    /// Returns the elements as a slice, without copying them, if they are
+    /// suitably aligned for `T` and this is a little-endian target.
+    pub fn as_slice(&self) -> Option<&'a [T]> {
+        if cfg!(target_endian = "big") {
+            return None;
+        }
+        // SAFETY: every bit pattern is a valid `T`.
+        match unsafe { self.bytes.align_to::<T>() } {
+            ([], elements, []) => Some(elements),
+            _ => None,
+        }
+    }
+
+    /// Copies the elements into a vector.
+    ///
+    /// On little-endian targets, this is a single copy of the serialized
+    /// elements, regardless of their alignment.
+    pub fn to_vec(&self) -> Vec<T> {
+        if cfg!(target_endian = "big") {
+            return self.iter().collect();
+        }
+        let len = self.len();
+        let mut elements = Vec::with_capacity(len);
+        // SAFETY: the vector has room for `len` elements, which occupy
+        // exactly `self.bytes.len()` bytes, and every bit pattern is a valid
+        // `T`.
+        unsafe {
+            ptr::copy_nonoverlapping(
+                self.bytes.as_ptr(),
+                elements.as_mut_ptr() as *mut u8,
+                self.bytes.len(),
+            );
+            elements.set_len(len);
+        }
+        elements
+    }
+}
+
+/// Finds the elements of the repeated fixed-width field at `path` in the
+/// serialized message `data`, without parsing the message or copying the
+/// elements.
+///
+/// `path` is interpreted as by [`extract_field`], except that every
+/// occurrence of the field contributes its elements: each packed occurrence
+/// and each unpacked element is returned as a view, in the order in which
+/// they appear. The elements of the field are those of all of the returned
+/// views, in order.
+///
+/// Returns an error if `path` is empty, if `data` is not valid wire format,
+/// or if an occurrence of the field does not hold elements of type `T`.
+///
+/// # Examples
+///
+/// ```
+/// use protobuf_native::wire;
+///
+/// // Field 1 is a packed `float` field holding 1.0 and 2.0.
+/// let data = b"\x0a\x08\x00\x00\x80\x3f\x00\x00\x00\x40";
+/// let runs = wire::extract_packed_fixed::<f32>(data, &[1])?;
+/// let values: Vec<f32> = runs.iter().flat_map(|run| run.iter()).collect();
+/// assert_eq!(values, [1.0, 2.0]);
+/// # Ok::<_, protobuf_native::OperationFailedError>(())
+/// ```
+pub fn extract_packed_fixed<'a, T>(
+    data: &'a [u8],
+    path: &[u32],
+) -> Result<Vec<PackedFixed<'a, T>>, OperationFailedError>
+where
+    T: FixedWidth,
+{
+    let mut runs = vec![];
+    collect_packed_fixed(data, path, &mut runs)?;
+    Ok(runs)
+}
+
+fn collect_packed_fixed<'a, T>(
+    data: &'a [u8],
+    path: &[u32],
+    runs: &mut Vec<PackedFixed<'a, T>>,
+) -> Result<(), OperationFailedError>
+where
+    T: FixedWidth,
+{
+    let (&target, rest) = path.split_first().ok_or(OperationFailedError)?;
+    let mut input = data;
+    while !input.is_empty() {
+        let (number, wire_type) = read_tag(&mut input)?;
+        if wire_type == 3 {
+            skip_group(&mut input, number)?;
+            continue;
+        }
+        let start = input;
+        let value = read_value(&mut input, wire_type)?;
+        if number != target {
+            continue;
+        }
+        match (rest.is_empty(), value) {
+            (true, WireValue::LengthDelimited(contents)) => runs.push(PackedFixed::new(contents)?),
+            (true, _) if wire_type == T::WIRE_TYPE => {
+                runs.push(PackedFixed::new(&start[..mem::size_of::<T>()])?)
+            }
+            (true, _) => return Err(OperationFailedError),
+            (false, WireValue::LengthDelimited(contents)) => {
+                collect_packed_fixed(contents, rest, runs)?
+            }
+            (false, _) => (),
+        }
+    }
+    Ok(())
+}
+
+fn read_tag(input: &mut &[u8]) -> Result<(u32, u32), OperationFailedError> {
+    let tag = u32::try_from(read_varint(input)?).map_err(|_| OperationFailedError)?;
+    match tag >> 3 {
+        0 => Err(OperationFailedError),
+        number => Ok((number, tag & 7)),
+    }
+}
+
+fn read_value<'a>(
+    input: &mut &'a [u8],
+    wire_type: u32,
+) -> Result<WireValue<'a>, OperationFailedError> {
+    match wire_type {
+        0 => Ok(WireValue::Varint(read_varint(input)?)),
+        1 => Ok(WireValue::Fixed64(u64::from_le_bytes(read_array(input)?))),
+        2 => {
+            let len = read_varint(input)?;
+            if len > input.len() as u64 {
+                return Err(OperationFailedError);
+            }
+            let (contents, rest) = input.split_at(len as usize);
+            *input = rest;
+            Ok(WireValue::LengthDelimited(contents))
+        }
+        5 => Ok(WireValue::Fixed32(u32::from_le_bytes(read_array(input)?))),
+        _ => Err(OperationFailedError),
+    }
+}
+
+fn skip_group(input: &mut &[u8], number: u32) -> Result<(), OperationFailedError> {
+    loop {
+        match read_tag(input)? {
+            (n, 4) if n == number => return Ok(()),
+            (_, 4) => return Err(OperationFailedError),
+            (n, 3) => skip_group(input, n)?,
+            (_, wire_type) => {
+                read_value(input, wire_type)?;
+            }
+        }
+    }
+}
+
+fn read_varint(input: &mut &[u8]) -> Result<u64, OperationFailedError> {
+    let mut value = 0;
+    for (i, &b) in input.iter().take(10).enumerate() {
+        value |= u64::from(b & 0x7f) << (7 * i);
+        if b < 0x80 {
+            *input = &input[i + 1..];
+            return Ok(value);
+        }
+    }
+    Err(OperationFailedError)
+}
+
+/// Like [`read_varint`], but returns `None` if `input` ends within the varint.
+fn scan_varint(input: &mut &[u8]) -> Result<Option<u64>, OperationFailedError> {
+    match input.iter().take(10).position(|&b| b < 0x80) {
+        Some(_) => read_varint(input).map(Some),
+        None if input.len() < 10 => Ok(None),
+        None => Err(OperationFailedError),
+    }
+}
+
+fn read_array<const N: usize>(input: &mut &[u8]) -> Result<[u8; N], OperationFailedError> {
+    if input.len() < N {
+        return Err(OperationFailedError);
+    }
+    let (array, rest) = input.split_at(N);
+    *input = rest;
+    Ok(array.try_into().unwrap())
+}
+
+/// Rewrites serialized messages without parsing them.
+///
+/// A transform removes, sets and appends fields, which may be nested within
+/// message fields, as it copies a serialized message. All other fields are
+/// copied byte for byte without being decoded, and the length prefixes of the
+/// message fields that enclose a removed field are recomputed. This costs a
+/// single pass over the input, rather than a parse, a mutation and a
+/// serialization.
+///
+/// Fields are identified by paths of field numbers, as for
+/// [`extract_field`]. Fields are set and appended by appending them, wrapped
+/// in their enclosing message fields, to the end of the message. As parsing
+/// merges the occurrences of a message field, this has the same effect as
+/// setting or appending the field in the enclosing messages, provided that
+/// the enclosing message fields are singular.
+///
+/// # Examples
+///
+/// ```
+/// use protobuf_native::wire::{WireTransform, WireValue};
+///
+/// let mut transform = WireTransform::new();
+/// transform.remove(&[1, 2]).set(&[3], WireValue::LengthDelimited(b"eu"));
+/// let mut output = vec![];
+/// transform.apply(b"\x0a\x04\x12\x02pi\x10\x01\x1a\x02us", &mut output)?;
+/// assert_eq!(output, b"\x0a\x00\x10\x01\x1a\x02eu");
+/// # Ok::<_, protobuf_native::OperationFailedError>(())
+/// ```
+#[derive(Debug, Clone, Default)]
+pub struct WireTransform<'a> {
+    removals: Vec<Vec<u32>>,
+    additions: Vec<(Vec<u32>, WireValue<'a>)>,
+}
+
+impl<'a> WireTransform<'a> {
+    /// Creates a transform that copies messages unchanged.
+    pub fn new() -> WireTransform<'a> {
+        WireTransform::default()
+    }
+
+    /// Removes every occurrence of the field at `path`.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `path` is empty.
+    pub fn remove(&mut self, path: &[u32]) -> &mut WireTransform<'a> {
+        assert!(!path.is_empty(), "path must not be empty");
+        self.removals.push(path.to_vec());
+        self
+    }
+
+    /// Replaces every occurrence of the field at `path` with `value`, adding
+    /// the field if it is not present.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `path` is empty.
+    pub fn set(&mut self, path: &[u32], value: WireValue<'a>) -> &mut WireTransform<'a> {
+        self.remove(path);
+        self.append(path, value)
+    }
+
+    /// Adds an occurrence of the field at `path` with `value`, after any
+    /// existing occurrences, as for an element of a repeated field.
+    ///
+    /// # Panics
+    ///
+    /// Panics if `path` is empty.
+    pub fn append(&mut self, path: &[u32], value: WireValue<'a>) -> &mut WireTransform<'a> {
+        assert!(!path.is_empty(), "path must not be empty");
+        self.additions.push((path.to_vec(), value));
+        self
+    }
+
+    /// Applies the transform to the serialized message `data`, appending the
+    /// result to `output`.
+    ///
+    /// Returns an error if `data` is not valid wire format, or if a field
+    /// that encloses a removed field is not length-delimited. On error,
+    /// `output` may contain part of the result.
+    pub fn apply(&self, data: &[u8], output: &mut Vec<u8>) -> Result<(), OperationFailedError> {
+        self.copy_message(data, &mut vec![], output)?;
+        for (path, value) in &self.additions {
+            write_nested(path, *value, output);
+        }
+        Ok(())
+    }
+
+    fn copy_message(
+        &self,
+        data: &[u8],
+        prefix: &mut Vec<u32>,
+        output: &mut Vec<u8>,
+    ) -> Result<(), OperationFailedError> {
+        let mut input = data;
+        while !input.is_empty() {
+            let start = input;
+            let (number, wire_type) = read_tag(&mut input)?;
+            let value = match wire_type {
+                3 => {
+                    skip_group(&mut input, number)?;
+                    None
+                }
+                _ => Some(read_value(&mut input, wire_type)?),
+            };
+            let field = &start[..start.len() - input.len()];
+            prefix.push(number);
+            let (removed, descend) = self.removals.iter().fold((false, false), |acc, path| {
+                match path.strip_prefix(prefix.as_slice()) {
+                    Some([]) => (true, acc.1),
+                    Some(_) => (acc.0, true),
+                    None => acc,
+                }
+            });
+            let result = match (removed, descend, value) {
+                (true, _, _) => Ok(()),
+                (false, false, _) => {
+                    output.extend_from_slice(field);
+                    Ok(())
+                }
+                (false, true, Some(WireValue::LengthDelimited(contents))) => {
+                    write_message_field(number, output, |output| {
+                        self.copy_message(contents, prefix, output)
+                    })
+                }
+                (false, true, _) => Err(OperationFailedError),
+            };
+            prefix.pop();
+            result?;
+        }
+        Ok(())
+    }
+}
+
+/// Writes a length-delimited field whose contents are written by `contents`,
+/// which may not know their length up front.
+fn write_message_field<F>(
+    number: u32,
+    output: &mut Vec<u8>,
+    contents: F,
+) -> Result<(), OperationFailedError>
+where
+    F: FnOnce(&mut Vec<u8>) -> Result<(), OperationFailedError>,
+{
+    write_varint(u64::from(number << 3 | 2), output);
+    // Reserve room for the longest possible length prefix, then move the
+    // contents down once their length is known.
+    let start = output.len();
+    output.extend_from_slice(&[0; 5]);
+    let result = contents(output);
+    let len = output.len() - start - 5;
+    let mut prefix = [0; 5];
+    let mut prefix_len = 0;
+    let mut value = len;
+    while value >= 0x80 {
+        prefix[prefix_len] = value as u8 | 0x80;
+        prefix_len += 1;
+        value >>= 7;
+    }
+    prefix[prefix_len] = value as u8;
+    prefix_len += 1;
+    output[start..start + prefix_len].copy_from_slice(&prefix[..prefix_len]);
+    output.copy_within(start + 5.., start + prefix_len);
+    output.truncate(start + prefix_len + len);
+    result
+}
+
+/// Writes `value` as the field at `path`, wrapped in the message fields
+/// named by the rest of the path.
+fn write_nested(path: &[u32], value: WireValue, output: &mut Vec<u8>) {
+    let (&number, rest) = path.split_first().unwrap();
+    if rest.is_empty() {
+        write_value(number, value, output);
+        return;
+    }
+    write_varint(u64::from(number << 3 | 2), output);
+    write_varint(nested_size(rest, value) as u64, output);
+    write_nested(rest, value, output);
+}
+
+/// Computes the size of the output of `write_nested`.
+fn nested_size(path: &[u32], value: WireValue) -> usize {
+    let (&number, rest) = path.split_first().unwrap();
+    let tag_size = varint_size(u64::from(number << 3));
+    if rest.is_empty() {
+        return tag_size
+            + match value {
+                WireValue::Varint(v) => varint_size(v),
+                WireValue::Fixed64(_) => 8,
+                WireValue::Fixed32(_) => 4,
+                WireValue::LengthDelimited(data) => varint_size(data.len() as u64) + data.len(),
+            };
+    }
+    let size = nested_size(rest, value);
+    tag_size + varint_size(size as u64) + size
+}
+
+fn write_value(number: u32, value: WireValue, output: &mut Vec<u8>) {
+    match value {
+        WireValue::Varint(v) => {
+            write_varint(u64::from(number << 3), output);
+            write_varint(v, output);
+        }
+        WireValue::Fixed64(v) => {
+            write_varint(u64::from(number << 3 | 1), output);
+            output.extend_from_slice(&v.to_le_bytes());
+        }
+        WireValue::Fixed32(v) => {
+            write_varint(u64::from(number << 3 | 5), output);
+            output.extend_from_slice(&v.to_le_bytes());
+        }
+        WireValue::LengthDelimited(data) => {
+            write_varint(u64::from(number << 3 | 2), output);
+            write_varint(data.len() as u64, output);
+            output.extend_from_slice(data);
+        }
+    }
+}
+
+pub(crate) fn write_varint(mut value: u64, output: &mut Vec<u8>) {
+    while value >= 0x80 {
+        output.push(value as u8 | 0x80);
+        value >>= 7;
+    }
+    output.push(value as u8);
+}
+
+fn varint_size(value: u64) -> usize {
+    (64 - (value | 1).leading_zeros() as usize + 6) / 7
+}
+
+/// Converts serialized messages of one type into serialized messages of
+/// another, such as a later version of the same type, without parsing them.
+///
+/// The transcoder is compiled once from the source and target types. Each
+/// field of the source type is matched to the field of the target type with
+/// the same name, or with the name given for it by a rename, and is
+/// renumbered to the target field's number; fields with no match in the
+/// target type are dropped. Message fields whose types differ between the
+/// schemas are transcoded recursively. Transcoding is then a single pass over
+/// the input in which matched fields are copied byte for byte, save for their
+/// tags and the length prefixes of the message fields that enclose them.
+///
+/// Unknown fields and extensions, which have no counterpart in the target
+/// type, are dropped. Enum values are not renumbered.
+#[derive(Debug, Clone)]
+pub struct Transcoder {
+    // The plan for the source type comes first.
+    plans: Vec<MessagePlan>,
+}
+
+#[derive(Debug, Clone, Default)]
+struct MessagePlan {
+    // The fields to keep, sorted by their number in the source type.
+    fields: Vec<(u32, FieldPlan)>,
+}
+
+#[derive(Debug, Clone, Copy)]
+enum FieldPlan {
+    // Copy the field, with the given number in the target type.
+    Copy { number: u32 },
+    // Transcode the field's contents with the given plan.
+    Nested { number: u32, plan: usize },
+}
+
+impl Transcoder {
+    /// Compiles a transcoder from messages of type `source` to messages of
+    /// type `target`, matching fields by name.
+    ///
+    /// Returns an error if two matched fields are not encoded alike on the
+    /// wire.
+    pub fn new(
+        source: &Descriptor,
+        target: &Descriptor,
+    ) -> Result<Transcoder, OperationFailedError> {
+        Transcoder::with_renames(source, target, &[])
+    }
+
+    /// Like [`Transcoder::new`], but with renamed fields.
+    ///
+    /// Each rename pairs the fully-qualified name of a field in the source
+    /// schema with the name of the field in the corresponding target type to
+    /// which it is matched instead of the field of the same name.
+    pub fn with_renames(
+        source: &Descriptor,
+        target: &Descriptor,
+        renames: &[(&str, &str)],
+    ) -> Result<Transcoder, OperationFailedError> {
+        let mut compiler = TranscoderCompiler {
+            renames: renames
+                .iter()
+                .map(|(from, to)| (from.as_bytes(), *to))
+                .collect(),
+            plans: vec![],
+            compiled: HashMap::new(),
+        };
+        compiler.compile(source, target)?;
+        Ok(Transcoder {
+            plans: compiler.plans,
+        })
+    }
+
+    /// Transcodes the serialized message `data`, appending the result to
+    /// `output`.
+    ///
+    /// Returns an error if `data` is not valid wire format, or if a message
+    /// field that needs transcoding is not length-delimited. On error,
+    /// `output` may contain part of the result.
+    pub fn transcode(&self, data: &[u8], output: &mut Vec<u8>) -> Result<(), OperationFailedError> {
+        self.transcode_message(0, data, output)
+    }
+
+    fn transcode_message(
+        &self,
+        plan: usize,
+        data: &[u8],
+        output: &mut Vec<u8>,
+    ) -> Result<(), OperationFailedError> {
+        let fields = &self.plans[plan].fields;
+        let mut input = data;
+        while !input.is_empty() {
+            let start = input;
+            let (number, wire_type) = read_tag(&mut input)?;
+            let value = match wire_type {
+                3 => {
+                    let body = input;
+                    skip_group(&mut input, number)?;
+                    let end_tag_len = varint_size(u64::from(number << 3 | 4));
+                    Err(&body[..body.len() - input.len() - end_tag_len])
+                }
+                _ => Ok(read_value(&mut input, wire_type)?),
+            };
+            let plan = match fields.binary_search_by_key(&number, |&(number, _)| number) {
+                Ok(i) => fields[i].1,
+                Err(_) => continue,
+            };
+            match (plan, value) {
+                (FieldPlan::Copy { number: target }, _) if target == number => {
+                    output.extend_from_slice(&start[..start.len() - input.len()]);
+                }
+                (FieldPlan::Copy { number: target }, Ok(value)) => {
+                    write_value(target, value, output);
+                }
+                (FieldPlan::Copy { number: target }, Err(body)) => {
+                    write_varint(u64::from(target << 3 | 3), output);
+                    output.extend_from_slice(body);
+                    write_varint(u64::from(target << 3 | 4), output);
+                }
+                (
+                    FieldPlan::Nested {
+                        number: target,
+                        plan,
+                    },
+                    Ok(WireValue::LengthDelimited(contents)),
+                ) => write_message_field(target, output, |output| {
+                    self.transcode_message(plan, contents, output)
+                })?,
+                (FieldPlan::Nested { .. }, _) => return Err(OperationFailedError),
+            }
+        }
+        Ok(())
+    }
+}
+
+struct TranscoderCompiler<'a> {
+    renames: HashMap<&'a [u8], &'a str>,
+    plans: Vec<MessagePlan>,
+    // The plans compiled so far, keyed by the addresses of their source and
+    // target types, which also terminates the recursion for recursive types.
+    compiled: HashMap<(usize, usize), usize>,
+}
+
+impl TranscoderCompiler<'_> {
+    fn compile(
+        &mut self,
+        source: &Descriptor,
+        target: &Descriptor,
+    ) -> Result<usize, OperationFailedError> {
+        let key = (source as *const _ as usize, target as *const _ as usize);
+        if let Some(&plan) = self.compiled.get(&key) {
+            return Ok(plan);
+        }
+        let plan = self.plans.len();
+        self.plans.push(MessagePlan::default());
+        self.compiled.insert(key, plan);
+
+        let mut fields = vec![];
+        for i in 0..source.field_count() {
+            let field = source.field(i);
+            let name = match self.renames.get(field.full_name()) {
+                Some(name) => *name,
+                None => str::from_utf8(field.name()).map_err(|_| OperationFailedError)?,
+            };
+            let target_field = match target.find_field_by_name(name) {
+                Some(target_field) => target_field,
+                None => continue,
+            };
+            let (field_type, target_type) = (field.field_type(), target_field.field_type());
+            if wire_encoding(field_type) != wire_encoding(target_type) {
+                return Err(OperationFailedError);
+            }
+            let number = target_field.number() as u32;
+            let field_plan = match (field.message_type(), target_field.message_type()) {
+                (Some(from), Some(to)) if !ptr::eq(from, to) => {
+                    if field_type == FieldType::Group {
+                        // The contents of groups are copied unchanged.
+                        return Err(OperationFailedError);
+                    }
+                    FieldPlan::Nested {
+                        number,
+                        plan: self.compile(from, to)?,
+                    }
+                }
+                _ => FieldPlan::Copy { number },
+            };
+            fields.push((field.number() as u32, field_plan));
+        }
+        fields.sort_by_key(|&(number, _)| number);
+        self.plans[plan].fields = fields;
+        Ok(plan)
+    }
+}
+
+/// Classifies field types by their encoding on the wire, such that fields
+/// of types in the same class can be read as one another.
+fn wire_encoding(field_type: FieldType) -> u8 {
+    match field_type {
+        FieldType::Int32
+        | FieldType::Int64
+        | FieldType::UInt32
+        | FieldType::UInt64
+        | FieldType::Bool
+        | FieldType::Enum => 0,
+        FieldType::SInt32 | FieldType::SInt64 => 1,
+        FieldType::Fixed32 | FieldType::SFixed32 | FieldType::Float => 2,
+        FieldType::Fixed64 | FieldType::SFixed64 | FieldType::Double => 3,
+        FieldType::String | FieldType::Bytes => 4,
+        FieldType::Message => 5,
+        FieldType::Group => 6,
+    }
+}
+
+/// Checks serialized messages against their schema without parsing them.
+///
+/// The validator is compiled once from a message type. Validating a message
+/// is then a single pass over its bytes that accepts exactly what parsing the
+/// message would accept: tags and lengths must be well formed, groups must be
+/// closed, messages must not nest more deeply than the parser's recursion
+/// limit of 100, string fields that require it must hold valid UTF-8, and
+/// every required field must be present, in the message and in each nested
+/// message. Nothing is allocated and no message is built, so rejecting
+/// malformed input costs a fraction of parsing it.
+///
+/// Fields that are unknown to the schema, or that are encoded with a wire
+/// type other than their declared one, are stored as unknown fields by the
+/// parser, and so are only checked for well-formedness. A singular message
+/// field that occurs more than once is checked occurrence by occurrence,
+/// whereas the parser merges the occurrences before checking for required
+/// fields; a required field of such a field is reported missing unless every
+/// occurrence has it.
+///
+/// # Examples
+///
+/// ```
+/// # use protobuf_native::compiler::{SourceTreeDescriptorDatabase, VirtualSourceTree};
+/// # use protobuf_native::DescriptorPool;
+/// # use std::path::Path;
+/// use protobuf_native::wire::{ValidationErrorKind, WireValidator};
+///
+/// # let mut source_tree = VirtualSourceTree::new();
+/// # source_tree.as_mut().add_file(
+/// #     Path::new("test.proto"),
+/// #     b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+/// # );
+/// # let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+/// # let fds = db.as_mut().build_file_descriptor_set(&[Path::new("test.proto")])?;
+/// # let mut pool = DescriptorPool::new();
+/// # pool.as_mut().build_file(fds.file(0));
+/// let descriptor = pool.find_message_type_by_name("Test").unwrap();
+/// let validator = WireValidator::new(descriptor);
+/// assert!(validator.validate(b"\x0a\x02hi").is_ok());
+/// let err = validator.validate(b"\x0a\x02\xff\xfe").unwrap_err();
+/// assert_eq!(err.kind, ValidationErrorKind::InvalidUtf8 { number: 1 });
+/// assert_eq!(err.offset, 2);
+/// # Ok::<_, Box<dyn std::error::Error>>(())
+/// ```
+#[derive(Debug, Clone)]
+pub struct WireValidator {
+    // The plan for the validated type comes first.
+    plans: Vec<ValidationPlan>,
+}
+
+#[derive(Debug, Clone, Default)]
+struct ValidationPlan {
+    // The known fields, sorted by number.
+    fields: Vec<FieldRule>,
+    // The numbers of the required fields, in the order of their bits.
+    required: Vec<u32>,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct FieldRule {
+    number: u32,
+    check: FieldCheck,
+    // The field's bit in the set of required fields seen, if it is required.
+    required: Option<usize>,
+}
+
+#[derive(Debug, Clone, Copy)]
+enum FieldCheck {
+    // A scalar of the given wire type, which may also be packed if the field
+    // is repeated.
+    Scalar { wire_type: u32, packable: bool },
+    // A string or bytes field.
+    Bytes { utf8: bool },
+    // A message field, with the plan for its type.
+    Message { plan: usize },
+    // A group field, with the plan for its type.
+    Group { plan: usize },
+}
+
+/// An error found by a [`WireValidator`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct ValidationError {
+    /// The offset in the validated bytes at which the error was found.
+    ///
+    /// For a missing required field, this is the offset of the start of the
+    /// message or group that lacks it.
+    pub offset: usize,
+    /// What is wrong.
+    pub kind: ValidationErrorKind,
+}
+
+/// The kind of a [`ValidationError`].
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub enum ValidationErrorKind {
+    /// A tag has field number zero, an invalid wire type, or does not fit in
+    /// 32 bits.
+    InvalidTag,
+    /// A varint is longer than ten bytes.
+    InvalidVarint,
+    /// A length prefix exceeds the limit on the size of a message.
+    InvalidLength,
+    /// The input ends within a field or an unclosed group.
+    Truncated,
+    /// A group is closed with the wrong field number, or without having been
+    /// opened.
+    UnmatchedEndGroup,
+    /// The elements of a packed repeated field do not fill its contents
+    /// exactly.
+    InvalidPackedField {
+        /// The number of the field.
+        number: u32,
+    },
+    /// A string field that requires UTF-8 validation holds invalid UTF-8.
+    InvalidUtf8 {
+        /// The number of the field.
+        number: u32,
+    },
+    /// Messages and groups nest more deeply than the recursion limit.
+    TooDeep,
+    /// A required field is missing.
+    MissingRequired {
+        /// The number of the field.
+        number: u32,
+    },
+}
+
+impl fmt::Display for ValidationError {
+    fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
+        match self.kind {
+            ValidationErrorKind::InvalidTag => f.write_str("invalid tag")?,
+            ValidationErrorKind::InvalidVarint => f.write_str("invalid varint")?,
+            ValidationErrorKind::InvalidLength => f.write_str("invalid length")?,
+            ValidationErrorKind::Truncated => f.write_str("truncated message")?,
+            ValidationErrorKind::UnmatchedEndGroup => f.write_str("unmatched end group")?,
+            ValidationErrorKind::InvalidPackedField { number } => {
+                write!(f, "invalid packed field {}", number)?
+            }
+            ValidationErrorKind::InvalidUtf8 { number } => {
+                write!(f, "invalid UTF-8 in field {}", number)?
+            }
+            ValidationErrorKind::TooDeep => f.write_str("message nested too deeply")?,
+            ValidationErrorKind::MissingRequired { number } => {
+                write!(f, "missing required field {}", number)?
+            }
+        }
+        write!(f, " at offset {}", self.offset)
+    }
+}
+
+impl Error for ValidationError {}
+
+impl WireValidator {
+    /// Compiles a validator for messages of type `descriptor`.
+    pub fn new(descriptor: &Descriptor) -> WireValidator {
+        let mut compiler = ValidatorCompiler {
+            plans: vec![],
+            compiled: HashMap::new(),
+        };
+        compiler.compile(descriptor);
+        WireValidator {
+            plans: compiler.plans,
+        }
+    }
+
+    /// Checks that `data` is a valid serialized message.
+    pub fn validate(&self, data: &[u8]) -> Result<(), ValidationError> {
+        let mut input = data;
+        let span = Span {
+            start: 0,
+            len: data.len(),
+        };
+        self.validate_fields(Some(0), &mut input, span, 0, None)
+    }
+
+    /// Checks the fields in `input` against `plan`, or only their
+    /// well-formedness if there is no plan, until the end of the input or, if
+    /// `group` is set, the end of that group.
+    fn validate_fields(
+        &self,
+        plan: Option<usize>,
+        input: &mut &[u8],
+        span: Span,
+        depth: usize,
+        group: Option<u32>,
+    ) -> Result<(), ValidationError> {
+        let plan = plan.map(|plan| &self.plans[plan]);
+        let start = span.offset(input);
+        // Messages with more than 128 required fields are rare enough that
+        // their bits may live on the heap.
+        let required = plan.map_or(0, |plan| plan.required.len());
+        let mut seen = 0u128;
+        let mut seen_overflow = vec![false; required.saturating_sub(128)];
+        loop {
+            if input.is_empty() {
+                if group.is_some() {
+                    return Err(span.error(input, ValidationErrorKind::Truncated));
+                }
+                break;
+            }
+            let at = span.offset(input);
+            let fail = |kind| ValidationError { offset: at, kind };
+            let (number, wire_type) = validate_tag(input).map_err(fail)?;
+            if wire_type == 4 {
+                match group {
+                    Some(n) if n == number => break,
+                    _ => return Err(fail(ValidationErrorKind::UnmatchedEndGroup)),
+                }
+            }
+            let rule = plan.and_then(|plan| {
+                plan.fields
+                    .binary_search_by_key(&number, |rule| rule.number)
+                    .ok()
+                    .map(|i| plan.fields[i])
+            });
+            let matched = match (rule.map(|rule| rule.check), wire_type) {
+                (Some(FieldCheck::Scalar { wire_type: w, .. }), _) if w == wire_type => {
+                    skip_scalar(input, wire_type).map_err(|kind| span.error(input, kind))?;
+                    true
+                }
+                (
+                    Some(FieldCheck::Scalar {
+                        wire_type: w,
+                        packable: true,
+                    }),
+                    2,
+                ) => {
+                    let contents = validate_length(input, span)?;
+                    validate_packed(contents, w)
+                        .map_err(|()| fail(ValidationErrorKind::InvalidPackedField { number }))?;
+                    true
+                }
+                (Some(FieldCheck::Bytes { utf8 }), 2) => {
+                    let contents = validate_length(input, span)?;
+                    let contents_at = span.offset(input) - contents.len();
+                    if utf8 && str::from_utf8(contents).is_err() {
+                        return Err(ValidationError {
+                            offset: contents_at,
+                            kind: ValidationErrorKind::InvalidUtf8 { number },
+                        });
+                    }
+                    true
+                }
+                (Some(FieldCheck::Message { plan }), 2) => {
+                    let contents = validate_length(input, span)?;
+                    let mut contents_input = contents;
+                    let contents_span = Span {
+                        start: span.offset(input) - contents.len(),
+                        len: contents.len(),
+                    };
+                    check_depth(depth, at)?;
+                    self.validate_fields(
+                        Some(plan),
+                        &mut contents_input,
+                        contents_span,
+                        depth + 1,
+                        None,
+                    )?;
+                    true
+                }
+                (Some(FieldCheck::Group { plan }), 3) => {
+                    check_depth(depth, at)?;
+                    self.validate_fields(Some(plan), input, span, depth + 1, Some(number))?;
+                    true
+                }
+                (_, 3) => {
+                    check_depth(depth, at)?;
+                    self.validate_fields(None, input, span, depth + 1, Some(number))?;
+                    false
+                }
+                (_, 2) => {
+                    validate_length(input, span)?;
+                    false
+                }
+                (_, _) => {
+                    skip_scalar(input, wire_type).map_err(|kind| span.error(input, kind))?;
+                    false
+                }
+            };
+            if let Some(bit) = rule.and_then(|rule| rule.required).filter(|_| matched) {
+                match bit < 128 {
+                    true => seen |= 1 << bit,
+                    false => seen_overflow[bit - 128] = true,
+                }
+            }
+        }
+        if let Some(plan) = plan {
+            for (bit, &number) in plan.required.iter().enumerate() {
+                let present = match bit < 128 {
+                    true => seen & (1 << bit) != 0,
+                    false => seen_overflow[bit - 128],
+                };
+                if !present {
+                    return Err(ValidationError {
+                        offset: start,
+                        kind: ValidationErrorKind::MissingRequired { number },
+                    });
+                }
+            }
+        }
+        Ok(())
+    }
+}
+
+/// Validates messages of type `descriptor` with a [`WireValidator`].
+///
+/// Compiling the validator allocates; to validate many messages without
+/// allocating, compile a `WireValidator` once and reuse it.
+pub fn validate_wire(data: &[u8], descriptor: &Descriptor) -> Result<(), ValidationError> {
+    WireValidator::new(descriptor).validate(data)
+}
+
+/// Finds the first error in the structure of a serialized message, without a
+/// schema, along with the number of the top-level field in which it lies, or
+/// zero if it lies in a top-level tag.
+///
+/// Length-delimited fields are not descended into, as their contents cannot
+/// be told apart without a schema. Nothing is allocated.
+pub(crate) fn find_structural_error(data: &[u8]) -> Option<(ValidationError, u32)> {
+    let validator = WireValidator { plans: vec![] };
+    let span = Span {
+        start: 0,
+        len: data.len(),
+    };
+    let err = validator
+        .validate_fields(None, &mut { data }, span, 0, None)
+        .err()?;
+    // Skip over the fields that precede the error to find the field that
+    // contains it.
+    let mut input = data;
+    while span.offset(input) < err.offset {
+        let (number, wire_type) = match read_tag(&mut input) {
+            Ok(tag) => tag,
+            Err(_) => break,
+        };
+        let skipped = match wire_type {
+            3 => skip_group(&mut input, number),
+            _ => read_value(&mut input, wire_type).map(|_| ()),
+        };
+        if skipped.is_err() || span.offset(input) > err.offset {
+            return Some((err, number));
+        }
+    }
+    Some((err, 0))
+}
+
+/// The extent of a slice that is being validated, within the whole input, so
+/// that errors can be reported at their offsets in the whole input.
+#[derive(Clone, Copy)]
+struct Span {
+    start: usize,
+    len: usize,
+}
+
+impl Span {
+    /// Returns the offset of `rest`, the unread suffix of the slice.
+    fn offset(&self, rest: &[u8]) -> usize {
+        self.start + self.len - rest.len()
+    }
+
+    fn error(&self, rest: &[u8], kind: ValidationErrorKind) -> ValidationError {
+        ValidationError {
+            offset: self.offset(rest),
+            kind,
+        }
+    }
+}
+
+fn validate_tag(input: &mut &[u8]) -> Result<(u32, u32), ValidationErrorKind> {
+    let tag = validate_varint(input)?;
+    let tag = u32::try_from(tag).map_err(|_| ValidationErrorKind::InvalidTag)?;
+    match (tag >> 3, tag & 7) {
+        (0, _) | (_, 6..) => Err(ValidationErrorKind::InvalidTag),
+        (number, wire_type) => Ok((number, wire_type)),
+    }
+}
+
+fn validate_varint(input: &mut &[u8]) -> Result<u64, ValidationErrorKind> {
+    read_varint(input).map_err(|_| match input.len() < 10 {
+        true => ValidationErrorKind::Truncated,
+        false => ValidationErrorKind::InvalidVarint,
+    })
+}
+
+/// Validates a length prefix and returns the contents that follow it.
+fn validate_length<'a>(input: &mut &'a [u8], span: Span) -> Result<&'a [u8], ValidationError> {
+    let len = validate_varint(input).map_err(|kind| span.error(input, kind))?;
+    if len > MAX_LENGTH {
+        return Err(span.error(input, ValidationErrorKind::InvalidLength));
+    }
+    if len > input.len() as u64 {
+        return Err(span.error(input, ValidationErrorKind::Truncated));
+    }
+    let (contents, rest) = input.split_at(len as usize);
+    *input = rest;
+    Ok(contents)
+}
+
+fn skip_scalar(input: &mut &[u8], wire_type: u32) -> Result<(), ValidationErrorKind> {
+    let size = match wire_type {
+        0 => return validate_varint(input).map(|_| ()),
+        1 => 8,
+        _ => 4,
+    };
+    if input.len() < size {
+        return Err(ValidationErrorKind::Truncated);
+    }
+    *input = &input[size..];
+    Ok(())
+}
+
+/// Checks that `contents` holds packed elements of the given wire type.
+fn validate_packed(mut contents: &[u8], wire_type: u32) -> Result<(), ()> {
+    match wire_type {
+        0 => {
+            while !contents.is_empty() {
+                read_varint(&mut contents).map_err(|_| ())?;
+            }
+            Ok(())
+        }
+        1 if contents.len() % 8 == 0 => Ok(()),
+        5 if contents.len() % 4 == 0 => Ok(()),
+        _ => Err(()),
+    }
+}
+
+fn check_depth(depth: usize, offset: usize) -> Result<(), ValidationError> {
+    match depth < MAX_GROUP_DEPTH {
+        true => Ok(()),
+        false => Err(ValidationError {
+            offset,
+            kind: ValidationErrorKind::TooDeep,
+        }),
+    }
+}
+
+struct ValidatorCompiler {
+    plans: Vec<ValidationPlan>,
+    // The plans compiled so far, keyed by the addresses of their types, which
+    // also terminates the recursion for recursive types.
+    compiled: HashMap<usize, usize>,
+}
+
+impl ValidatorCompiler {
+    fn compile(&mut self, descriptor: &Descriptor) -> usize {
+        let key = descriptor as *const _ as usize;
+        if let Some(&plan) = self.compiled.get(&key) {
+            return plan;
+        }
+        let plan = self.plans.len();
+        self.plans.push(ValidationPlan::default());
+        self.compiled.insert(key, plan);
+
+        let mut fields = vec![];
+        let mut required = vec![];
+        for i in 0..descriptor.field_count() {
+            let field = descriptor.field(i);
+            let number = field.number() as u32;
+            let check = match field.field_type() {
+                FieldType::String => FieldCheck::Bytes {
+                    utf8: field.requires_utf8_validation(),
+                },
+                FieldType::Bytes => FieldCheck::Bytes { utf8: false },
+                FieldType::Message => FieldCheck::Message {
+                    plan: self.compile(field.message_type().unwrap()),
+                },
+                FieldType::Group => FieldCheck::Group {
+                    plan: self.compile(field.message_type().unwrap()),
+                },
+                field_type => FieldCheck::Scalar {
+                    wire_type: match wire_encoding(field_type) {
+                        2 => 5,
+                        3 => 1,
+                        _ => 0,
+                    },
+                    packable: field.is_repeated(),
+                },
+            };
+            let required_bit = field.is_required().then(|| {
+                required.push(number);
+                required.len() - 1
+            });
+            fields.push(FieldRule {
+                number,
+                check,
+                required: required_bit,
+            });
+        }
+        fields.sort_by_key(|rule| rule.number);
+        self.plans[plan] = ValidationPlan { fields, required };
+        plan
+    }
+}
+
+/// A pull parser for the protocol buffer wire format.
+///
+/// See the [module documentation](self) for details.
+///
+/// When the reader is dropped, the stream is backed up to the first byte the
+/// reader did not consume.
+pub struct WireReader<'a> {
+    input: Pin<&'a mut dyn ZeroCopyInputStream>,
+    // The chunk most recently returned by the input stream, which remains
+    // valid until the next call to a method of the stream.
+    chunk: *const u8,
+    chunk_len: usize,
+    // The offset of the next byte to read within the chunk.
+    pos: usize,
+    // The offset of the start of the chunk within the stream.
+    chunk_start: u64,
+    eof: bool,
+    // Holds the contents of a length-delimited field that straddles chunks.
+    carry: Vec<u8>,
+    // The stream offsets of the ends of the entered messages.
+    limits: Vec<u64>,
+    // The length of the contents of the last length-delimited field, if they
+    // have been neither read nor entered.
+    pending: Option<usize>,
+}
+
+impl<'a> WireReader<'a> {
+    /// Creates a reader that decodes the fields of a message from `input`,
+    /// which is assumed to extend until the end of the stream.
+    pub fn new(input: Pin<&'a mut dyn ZeroCopyInputStream>) -> WireReader<'a> {
+        WireReader {
+            input,
+            chunk: ptr::null(),
+            chunk_len: 0,
+            pos: 0,
+            chunk_start: 0,
+            eof: false,
+            carry: vec![],
+            limits: vec![],
+            pending: None,
+        }
+    }
+
+    /// Returns the next event, or `None` at the end of the stream.
+    ///
+    /// Returns an error if the input is not valid wire format or if the
+    /// stream fails.
+    pub fn next(&mut self) -> Result<Option<WireEvent>, OperationFailedError> {
+        if let Some(len) = self.pending.take() {
+            self.skip(len)?;
+        }
+        match self.limits.last() {
+            Some(&limit) if self.position() >= limit => {
+                if self.position() > limit {
+                    return Err(OperationFailedError);
+                }
+                self.limits.pop();
+                return Ok(Some(WireEvent::EndMessage));
+            }
+            Some(_) => (),
+            None => {
+                if self.pos == self.chunk_len && !self.refill() {
+                    return Ok(None);
+                }
+            }
+        }
+        let tag = u32::try_from(self.read_varint()?).map_err(|_| OperationFailedError)?;
+        let number = tag >> 3;
+        if number == 0 {
+            return Err(OperationFailedError);
+        }
+        let event = match tag & 7 {
+            0 => WireEvent::Varint {
+                number,
+                value: self.read_varint()?,
+            },
+            1 => WireEvent::Fixed64 {
+                number,
+                value: u64::from_le_bytes(self.read_array()?),
+            },
+            2 => {
+                let len = self.read_varint()?;
+                if len > MAX_LENGTH {
+                    return Err(OperationFailedError);
+                }
+                let end = self.position() + len;
+                if self.limits.last().map_or(false, |&limit| end > limit) {
+                    return Err(OperationFailedError);
+                }
+                let len = len as usize;
+                self.pending = Some(len);
+                WireEvent::LengthDelimited { number, len }
+            }
+            3 => WireEvent::StartGroup { number },
+            4 => WireEvent::EndGroup { number },
+            5 => WireEvent::Fixed32 {
+                number,
+                value: u32::from_le_bytes(self.read_array()?),
+            },
+            _ => return Err(OperationFailedError),
+        };
+        Ok(Some(event))
+    }
+
+    /// Returns the contents of the length-delimited field returned by the last
+    /// call to [`WireReader::next`].
+    ///
+    /// Returns an error if the last event was not a
+    /// [`WireEvent::LengthDelimited`], if its contents have already been read
+    /// or entered, or if the stream ends before them.
+    pub fn read_bytes(&mut self) -> Result<&[u8], OperationFailedError> {
+        let len = self.pending.take().ok_or(OperationFailedError)?;
+        if self.chunk_len - self.pos >= len {
+            // SAFETY: the chunk holds at least `len` more bytes and remains
+            // valid until `self` is next borrowed mutably.
+            let data = unsafe { slice::from_raw_parts(self.chunk.add(self.pos), len) };
+            self.pos += len;
+            return Ok(data);
+        }
+        let mut carry = std::mem::take(&mut self.carry);
+        carry.clear();
+        carry.reserve(len);
+        while carry.len() < len {
+            if self.pos == self.chunk_len && !self.refill() {
+                self.carry = carry;
+                return Err(OperationFailedError);
+            }
+            let n = (self.chunk_len - self.pos).min(len - carry.len());
+            carry.extend_from_slice(unsafe { slice::from_raw_parts(self.chunk.add(self.pos), n) });
+            self.pos += n;
+        }
+        self.carry = carry;
+        Ok(&self.carry)
+    }
+
+    /// Descends into the length-delimited field returned by the last call to
+    /// [`WireReader::next`], whose contents are decoded as a nested message.
+    ///
+    /// Subsequent events are the fields of the nested message, followed by a
+    /// [`WireEvent::EndMessage`] event.
+    ///
+    /// Returns an error if the last event was not a
+    /// [`WireEvent::LengthDelimited`] or if its contents have already been
+    /// read or entered.
+    pub fn enter(&mut self) -> Result<(), OperationFailedError> {
+        let len = self.pending.take().ok_or(OperationFailedError)?;
+        self.limits.push(self.position() + len as u64);
+        Ok(())
+    }
+
+    /// Skips the rest of the innermost entered message, as if it had been
+    /// read to its end and the [`WireEvent::EndMessage`] event consumed.
+    ///
+    /// Returns an error if no message has been entered or if the stream ends
+    /// before the message does.
+    pub fn exit(&mut self) -> Result<(), OperationFailedError> {
+        let limit = self.limits.pop().ok_or(OperationFailedError)?;
+        self.pending = None;
+        let remaining = limit
+            .checked_sub(self.position())
+            .ok_or(OperationFailedError)?;
+        self.skip(remaining as usize)
+    }
+
+    /// Returns the number of messages that have been entered and not yet
+    /// ended.
+    pub fn depth(&self) -> usize {
+        self.limits.len()
+    }
+
+    /// Returns the offset within the stream of the next byte to be read.
+    pub fn position(&self) -> u64 {
+        self.chunk_start + self.pos as u64
+    }
+
+    /// Replaces the exhausted current chunk with the next non-empty chunk of
+    /// the stream, returning false at the end of the stream.
+    fn refill(&mut self) -> bool {
+        self.chunk_start += self.chunk_len as u64;
+        self.chunk = ptr::null();
+        self.chunk_len = 0;
+        self.pos = 0;
+        while !self.eof {
+            match self.input.as_mut().next() {
+                Ok([]) => (),
+                Ok(chunk) => {
+                    self.chunk = chunk.as_ptr();
+                    self.chunk_len = chunk.len();
+                    return true;
+                }
+                Err(_) => self.eof = true,
+            }
+        }
+        false
+    }
+
+    fn read_byte(&mut self) -> Result<u8, OperationFailedError> {
+        if self.pos == self.chunk_len && !self.refill() {
+            return Err(OperationFailedError);
+        }
+        // SAFETY: `pos` is within the chunk.
+        let b = unsafe { *self.chunk.add(self.pos) };
+        self.pos += 1;
+        Ok(b)
+    }
+
+    fn read_varint(&mut self) -> Result<u64, OperationFailedError> {
+        if self.chunk_len - self.pos >= 10 {
+            // Fast path: the longest possible varint is within the chunk.
+            let data = unsafe { slice::from_raw_parts(self.chunk.add(self.pos), 10) };
+            let mut value = 0;
+            for (i, &b) in data.iter().enumerate() {
+                value |= u64::from(b & 0x7f) << (7 * i);
+                if b < 0x80 {
+                    self.pos += i + 1;
+                    return Ok(value);
+                }
+            }
+            return Err(OperationFailedError);
+        }
+        let mut value = 0;
+        for i in 0..10 {
+            let b = self.read_byte()?;
+            value |= u64::from(b & 0x7f) << (7 * i);
+            if b < 0x80 {
+                return Ok(value);
+            }
+        }
+        Err(OperationFailedError)
+    }
+
+    /// Like [`read_varint`], but returns `None` if `input` ends within the varint.
+    fn scan_varint(input: &mut &[u8]) -> Result<Option<u64>, OperationFailedError> {
+        match input.iter().take(10).position(|&b| b < 0x80) {
+            Some(_) => read_varint(input).map(Some),
+            None if input.len() < 10 => Ok(None),
+            None => Err(OperationFailedError),
+        }
+    }
+
+    fn read_array<const N: usize>(&mut self) -> Result<[u8; N], OperationFailedError> {
+        let mut array = [0; N];
+        if self.chunk_len - self.pos >= N {
+            // SAFETY: the chunk holds at least `N` more bytes.
+            unsafe { ptr::copy_nonoverlapping(self.chunk.add(self.pos), array.as_mut_ptr(), N) };
+            self.pos += N;
+            return Ok(array);
+        }
+        for b in &mut array {
+            *b = self.read_byte()?;
+        }
+        Ok(array)
+    }
+
+    fn skip(&mut self, len: usize) -> Result<(), OperationFailedError> {
+        let available = self.chunk_len - self.pos;
+        if available >= len {
+            self.pos += len;
+            return Ok(());
+        }
+        // Skip the rest of the chunk, then let the stream skip the remainder
+        // without handing its bytes to us.
+        self.chunk_start += (self.chunk_len + (len - available)) as u64;
+        self.chunk = ptr::null();
+        self.chunk_len = 0;
+        self.pos = 0;
+        self.input.as_mut().skip(len - available).map_err(|e| {
+            self.eof = true;
+            e
+        })
+    }
+}
+
+impl Drop for WireReader<'_> {
+    fn drop(&mut self) {
+        if self.pos < self.chunk_len {
+            self.input.as_mut().back_up(self.chunk_len - self.pos);
+        }
+    }
+}
+
+/// Parses a message from input that arrives in pieces.
+///
+/// Each call to [`feed`] merges into the message every top-level field that
+/// the input received so far completes, and buffers only the beginning of
+/// the field that the input ends within, so a parser can be suspended
+/// whenever input runs out without holding on to the whole serialized
+/// message. This relies on the fact that merging the fields of a serialized
+/// message one run at a time is equivalent to parsing them all at once.
+///
+/// The memory the parser needs is therefore bounded by the size of the
+/// largest top-level field rather than the size of the message. A message
+/// that consists of one large nested message is still buffered in full.
+///
+/// [`feed`]: IncrementalParser::feed
+pub struct IncrementalParser<'a> {
+    message: Pin<&'a mut dyn MessageLite>,
+    // The beginning of an incomplete top-level field.
+    pending: Vec<u8>,
+    position: usize,
+}
+
+impl<'a> IncrementalParser<'a> {
+    /// Creates a parser that merges the fields it reads into `message`.
+    pub fn new(message: Pin<&'a mut dyn MessageLite>) -> IncrementalParser<'a> {
+        IncrementalParser {
+            message,
+            pending: vec![],
+            position: 0,
+        }
+    }
+
+    /// Parses the next piece of the input.
+    ///
+    /// Returns an error if the input is not valid wire format or a field
+    /// fails to parse, after which the message is left partially merged and
+    /// the parser is no longer useful.
+    pub fn feed(&mut self, mut data: &[u8]) -> Result<(), OperationFailedError> {
+        self.position += data.len();
+        while !data.is_empty() {
+            if self.pending.is_empty() {
+                let (complete, _) = complete_fields(data)?;
+                self.merge(&data[..complete])?;
+                self.pending.extend_from_slice(&data[complete..]);
+                break;
+            }
+            // Take at least as many bytes as the field is known to still
+            // need, and otherwise as many as are already buffered, so that
+            // rescanning the buffer takes amortized linear time.
+            let (_, needed) = complete_fields(&self.pending)?;
+            let len = needed.max(self.pending.len()).min(data.len());
+            self.pending.extend_from_slice(&data[..len]);
+            data = &data[len..];
+            let (complete, _) = complete_fields(&self.pending)?;
+            if complete > 0 {
+                let pending = std::mem::take(&mut self.pending);
+                self.merge(&pending[..complete])?;
+                self.pending = pending;
+                self.pending.drain(..complete);
+            }
+        }
+        Ok(())
+    }
+
+    /// Finishes parsing.
+    ///
+    /// Returns an error if the input ended within a field or the message is
+    /// missing required fields.
+    pub fn finish(self) -> Result<(), OperationFailedError> {
+        if !self.pending.is_empty() || !self.message.is_initialized() {
+            return Err(OperationFailedError);
+        }
+        Ok(())
+    }
+
+    /// Returns the number of bytes of input fed to the parser so far.
+    pub fn position(&self) -> usize {
+        self.position
+    }
+
+    /// Returns the number of bytes of input buffered until the field they
+    /// begin is complete.
+    pub fn buffered(&self) -> usize {
+        self.pending.len()
+    }
+
+    fn merge(&mut self, data: &[u8]) -> Result<(), OperationFailedError> {
+        if data.is_empty() {
+            return Ok(());
+        }
+        self.message.as_mut().merge_partial_from_bytes(data)
+    }
+}
+
+/// The extent of a field at the start of some input.
+enum FieldExtent {
+    // The field is complete and has the given length.
+    Complete(usize),
+    // The input ends within the field, which needs at least the given number
+    // of further bytes.
+    Partial(usize),
+    // The field is the end-group tag of the enclosing group, of the given
+    // length.
+    EndGroup(usize),
+}
+
+/// Returns the length of the complete fields at the start of `data`, and
+/// the number of bytes that the first incomplete field is known to need.
+fn complete_fields(data: &[u8]) -> Result<(usize, usize), OperationFailedError> {
+    let mut len = 0;
+    while len < data.len() {
+        match field_extent(&data[len..], None, 0)? {
+            FieldExtent::Complete(n) => len += n,
+            FieldExtent::Partial(needed) => return Ok((len, needed)),
+            FieldExtent::EndGroup(_) => unreachable!("end-group tag outside of a group"),
+        }
+    }
+    Ok((len, 0))
+}
+
+/// Measures the field at the start of `data`, which must not be an end-group
+/// tag unless it ends the group with the number `group`.
+fn field_extent(
+    data: &[u8],
+    group: Option<u32>,
+    depth: usize,
+) -> Result<FieldExtent, OperationFailedError> {
+    let mut input = data;
+    let tag = match scan_varint(&mut input)? {
+        Some(tag) => u32::try_from(tag).map_err(|_| OperationFailedError)?,
+        None => return Ok(FieldExtent::Partial(1)),
+    };
+    let (number, wire_type) = (tag >> 3, tag & 7);
+    if number == 0 {
+        return Err(OperationFailedError);
+    }
+    let len = match wire_type {
+        0 => match scan_varint(&mut input)? {
+            Some(_) => 0,
+            None => return Ok(FieldExtent::Partial(1)),
+        },
+        1 => 8,
+        2 => match scan_varint(&mut input)? {
+            Some(len) if len <= MAX_LENGTH => len as usize,
+            Some(_) => return Err(OperationFailedError),
+            None => return Ok(FieldExtent::Partial(1)),
+        },
+        3 => {
+            if depth >= MAX_GROUP_DEPTH {
+                return Err(OperationFailedError);
+            }
+            loop {
+                match field_extent(input, Some(number), depth + 1)? {
+                    FieldExtent::Complete(n) => input = &input[n..],
+                    FieldExtent::EndGroup(n) => {
+                        input = &input[n..];
+                        break 0;
+                    }
+                    partial => return Ok(partial),
+                }
+            }
+        }
+        4 if group == Some(number) => {
+            return Ok(FieldExtent::EndGroup(data.len() - input.len()));
+        }
+        5 => 4,
+        _ => return Err(OperationFailedError),
+    };
+    let len = len + (data.len() - input.len());
+    if len > data.len() {
+        return Ok(FieldExtent::Partial(len - data.len()));
+    }
+    Ok(FieldExtent::Complete(len))
+}
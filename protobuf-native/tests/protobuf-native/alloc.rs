@@ -0,0 +1,90 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//! Tests that steady-state loops do not allocate.
+//!
+//! Each test warms up a loop, so that any buffers it needs are already
+//! allocated, and then asserts that further iterations make no heap
+//! allocations on either side of the bridge.
+
+use std::mem::MaybeUninit;
+use std::pin::pin;
+
+use protobuf_native::bench::{self, Allocations, CountingAllocator};
+use protobuf_native::io::{CodedInputStream, StackCodedInputStream};
+use protobuf_native::{Arena, ArenaOptions, MessageLite};
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+const ITERATIONS: usize = 100;
+
+#[test]
+fn test_read_varints_allocates_nothing() {
+    let data = [0x96_u8, 0x01].repeat(ITERATIONS);
+    let mut input = CodedInputStream::from_slice(&data);
+    let (sum, allocations) = bench::count_allocations(|| {
+        let mut sum = 0;
+        for _ in 0..ITERATIONS {
+            sum += input.as_mut().read_varint32().unwrap();
+        }
+        sum
+    });
+    assert_eq!(sum, 150 * ITERATIONS as u32);
+    assert_eq!(allocations, Allocations::default());
+}
+
+#[test]
+fn test_parse_into_reused_arena_message_allocates_nothing() {
+    let fds = crate::simple_file_descriptor_set().unwrap();
+    let data = fds.serialize().unwrap();
+    let mut block = vec![MaybeUninit::uninit(); 64 << 10];
+    let arena = Arena::with_options(ArenaOptions {
+        initial_block: Some(&mut block[..]),
+        ..Default::default()
+    });
+    let mut message = fds.new_in(&arena);
+    let mut storage = pin!(StackCodedInputStream::new());
+    // The stream methods are used, rather than `parse_from_bytes`, as they
+    // are not instrumented by `metrics`, which another test may enable.
+    let mut parse = || {
+        let input = storage.as_mut().init_from_slice(&data);
+        message.as_mut().clear();
+        message.as_mut().merge_from_coded_stream(input).unwrap();
+    };
+    parse();
+    let ((), allocations) = bench::count_allocations(|| {
+        for _ in 0..ITERATIONS {
+            parse();
+        }
+    });
+    assert_eq!(allocations, Allocations::default());
+}
+
+#[test]
+fn test_allocations_are_counted() {
+    let ((), allocations) = bench::count_allocations(|| drop(Arena::new()));
+    assert!(allocations.cpp > 0);
+    let (vec, allocations) = bench::count_allocations(|| vec![0_u8; 16]);
+    assert_eq!(allocations.rust, 1);
+    drop(vec);
+}
+
+#[cfg(feature = "rust-alloc")]
+#[test]
+fn test_cpp_allocations_use_rust_allocator() {
+    let ((), allocations) = bench::count_allocations(|| drop(Arena::new()));
+    assert_eq!(allocations.rust, allocations.cpp);
+}
@@ -31,11 +31,15 @@
 //! chunks separated at different points. The whole process is run with a
 //! variety of block sizes for both the input and the output.
 
-use std::io::{Seek, SeekFrom};
-use std::pin::Pin;
+use std::borrow::Cow;
+use std::io::{BufRead, BufReader, Cursor, Read, Seek, SeekFrom, Write};
+use std::pin::{pin, Pin};
 
 use protobuf_native::io::{
-    ReaderStream, SliceInputStream, SliceOutputStream, VecOutputStream, WriterStream,
+    BufReadStream, ChainInputStream, ChainOutputStream, CodedInputStream, CodedOutputStream, Cord,
+    CordInputStream, CordOutputStream, Crc32cInputStream, Crc32cOutputStream, LimitingInputStream,
+    MmapInputStream, ReadAhead, ReaderStream, SliceInputStream, SliceOutputStream,
+    StackCodedInputStream, VecGrowth, VecOutputOptions, VecOutputStream, WriteBehind, WriterStream,
     ZeroCopyInputStream, ZeroCopyOutputStream,
 };
 
@@ -121,6 +125,75 @@ fn test_io_vec() {
     assert!(input.as_mut().next().is_err()); // check for EOF
 }
 
+#[test]
+fn test_io_vec_options() {
+    // An accurate size hint results in exactly one allocation.
+    let mut buffer = vec![];
+    check_some_writes(VecOutputStream::with_size_hint(&mut buffer, 200_055).as_mut());
+    assert_eq!(buffer.capacity(), 200_055);
+    check_some_reads(SliceInputStream::new(&buffer).as_mut());
+
+    // A pooled vector with sufficient capacity is not reallocated.
+    buffer.clear();
+    let ptr = buffer.as_ptr();
+    check_some_writes(VecOutputStream::with_size_hint(&mut buffer, 200_055).as_mut());
+    assert_eq!(buffer.as_ptr(), ptr);
+    assert_eq!(buffer.capacity(), 200_055);
+
+    for options in [
+        VecOutputOptions {
+            growth: VecGrowth::Increment(1000),
+            ..Default::default()
+        },
+        VecOutputOptions {
+            max_growth: Some(4096),
+            ..Default::default()
+        },
+        VecOutputOptions {
+            size_hint: Some(10),
+            growth: VecGrowth::Increment(7),
+            max_growth: Some(5),
+        },
+    ] {
+        let mut buffer = vec![];
+        check_some_writes(VecOutputStream::with_options(&mut buffer, &options).as_mut());
+        check_some_reads(SliceInputStream::new(&buffer).as_mut());
+    }
+}
+
+#[cfg(feature = "bytes")]
+#[test]
+fn test_io_bytes() {
+    use bytes::{Buf, BytesMut};
+    use protobuf_native::io::{BufInputStream, BufMutOutputStream};
+
+    let mut output = BytesMut::new();
+    check_some_writes(BufMutOutputStream::new(&mut output).as_mut());
+    assert_eq!(output.len(), 200_055);
+
+    // Read from a non-contiguous buffer, one chunk at a time.
+    let mut buf = output[..1000].chain(&output[1000..]);
+    check_some_reads(BufInputStream::new(&mut buf).as_mut());
+    assert!(!buf.has_remaining());
+
+    // The buffer is advanced past only the bytes that were read.
+    let mut buf = &output[..];
+    check_read(BufInputStream::new(&mut buf).as_mut(), b"Hello world!\n");
+    assert_eq!(buf.remaining(), 200_055 - 13);
+
+    // Writes to a fixed-size buffer fail once it is full.
+    let mut storage = [0; 10];
+    let mut buf = &mut storage[..];
+    let mut output = BufMutOutputStream::new(&mut buf);
+    write_bytes(output.as_mut(), &[1; 9]);
+    let chunk = unsafe { output.as_mut().next() }.unwrap();
+    assert_eq!(chunk.len(), 1);
+    util::copy_to_uninit_slice(chunk, &[1]);
+    assert!(unsafe { output.as_mut().next() }.is_err());
+    drop(output);
+    assert_eq!(storage, [1; 10]);
+}
+
 #[test]
 fn test_io_file() {
     let mut file = tempfile::tempfile().unwrap();
@@ -128,3 +201,707 @@ fn test_io_file() {
     file.seek(SeekFrom::Start(0)).unwrap();
     check_some_reads(ReaderStream::new(&mut file).as_mut());
 }
+
+#[test]
+fn test_io_chain_output() {
+    for segment_size in [1, 7, 4096, 1 << 20] {
+        let mut segments = vec![];
+        check_some_writes(ChainOutputStream::new(&mut segments, segment_size).as_mut());
+        for segment in &segments {
+            assert_eq!(segment.capacity(), segment_size);
+        }
+        let buffer = segments.concat();
+        check_some_reads(SliceInputStream::new(&buffer).as_mut());
+        check_some_reads(ChainInputStream::new(&segments).as_mut());
+    }
+}
+
+#[test]
+fn test_io_chain_input() {
+    let mut buffer = vec![];
+    check_some_writes(VecOutputStream::new(&mut buffer).as_mut());
+    let mut segments: Vec<&[u8]> = vec![];
+    segments.push(&[]);
+    for chunk in buffer.chunks(12_345) {
+        segments.push(chunk);
+        segments.push(&[]);
+    }
+    let mut input = ChainInputStream::new(&segments);
+    check_some_reads(input.as_mut());
+    assert!(input.as_mut().next().is_err()); // check for EOF
+    assert!(input.as_mut().skip(1).is_err());
+}
+
+#[test]
+fn test_io_file_block_size() {
+    for block_size in [1, 100, 1 << 20] {
+        let mut file = tempfile::tempfile().unwrap();
+        check_some_writes(WriterStream::with_block_size(&mut file, block_size).as_mut());
+        file.seek(SeekFrom::Start(0)).unwrap();
+        check_some_reads(ReaderStream::with_block_size(&mut file, block_size).as_mut());
+    }
+}
+
+#[test]
+fn test_io_buf_read() {
+    let mut file = tempfile::tempfile().unwrap();
+    check_some_writes(WriterStream::new(&mut file).as_mut());
+    for capacity in [1, 1000, 1 << 20] {
+        let mut file = BufReader::with_capacity(capacity, file.try_clone().unwrap());
+        file.seek(SeekFrom::Start(0)).unwrap();
+        check_some_reads(BufReadStream::new(&mut file).as_mut());
+    }
+}
+
+#[test]
+fn test_io_buf_read_position() {
+    let data = b"0123456789".to_vec();
+    let mut reader = &data[..];
+    {
+        let mut input = BufReadStream::new(&mut reader);
+        assert_eq!(input.as_mut().next().unwrap(), b"0123456789");
+        input.as_mut().back_up(4);
+        assert_eq!(input.byte_count(), 6);
+    }
+    assert_eq!(reader.fill_buf().unwrap(), b"6789");
+    let mut rest = vec![];
+    reader.read_to_end(&mut rest).unwrap();
+    assert_eq!(rest, b"6789");
+}
+
+#[cfg(unix)]
+#[test]
+fn test_io_mmap() {
+    let mut file = tempfile::NamedTempFile::new().unwrap();
+    check_some_writes(WriterStream::new(&mut file).as_mut());
+    let mut input = MmapInputStream::open(file.path()).unwrap();
+    assert_eq!(input.contents().len(), 200_055);
+    check_some_reads(input.as_mut());
+    assert!(input.as_mut().next().is_err()); // check for EOF
+
+    let empty = tempfile::NamedTempFile::new().unwrap();
+    let mut input = MmapInputStream::open(empty.path()).unwrap();
+    assert_eq!(input.contents(), b"");
+    assert!(input.as_mut().next().is_err());
+}
+
+#[cfg(unix)]
+#[test]
+fn test_io_fd() {
+    use protobuf_native::io::{
+        FileInputOptions, FileInputStream, FileOutputOptions, FileOutputStream,
+    };
+
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("data");
+    for direct in [false, true] {
+        for block_size in [1, 100, 1 << 20] {
+            let options = FileOutputOptions { block_size, direct };
+            let mut output = match FileOutputStream::create(&path, &options) {
+                // Not every file system supports O_DIRECT.
+                Err(_) if direct => return,
+                res => res.unwrap(),
+            };
+            check_some_writes(output.as_mut());
+            output.as_mut().close().unwrap();
+            assert!(output.as_mut().close().is_ok());
+            assert!(output.as_mut().next().is_err());
+
+            let options = FileInputOptions {
+                block_size,
+                sequential: true,
+                direct,
+            };
+            let mut input = FileInputStream::open(&path, &options).unwrap();
+            check_some_reads(input.as_mut());
+            assert!(input.as_mut().next().is_err()); // check for EOF
+            assert!(input.error().is_none());
+        }
+    }
+
+    let res = FileInputStream::open(dir.path().join("missing"), &Default::default());
+    assert_eq!(util::unwrap_err(res).kind(), std::io::ErrorKind::NotFound);
+}
+
+#[test]
+fn test_coded_input_stream_from_slice() {
+    let data = [0x96, 0x01, 0x2a];
+    let mut input = CodedInputStream::from_slice(&data);
+    assert!(input.is_flat());
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 150);
+    assert_eq!(input.as_mut().read_varint64().unwrap(), 42);
+    assert!(input.as_mut().read_varint32().is_err());
+}
+
+#[test]
+fn test_coded_output_stream() {
+    let mut buffer = vec![];
+    {
+        let mut output = VecOutputStream::new(&mut buffer);
+        let mut coded = CodedOutputStream::new(output.as_mut());
+        coded.as_mut().write_tag(8);
+        coded.as_mut().write_varint32(150);
+        coded.as_mut().write_varint64(u64::MAX);
+        coded.as_mut().write_varint32_sign_extended(-1);
+        coded.as_mut().write_little_endian32(0x01020304);
+        coded.as_mut().write_little_endian64(0x0102030405060708);
+        coded.as_mut().write_raw(b"raw");
+        assert_eq!(coded.byte_count(), 1 + 2 + 10 + 10 + 4 + 8 + 3);
+        assert!(!coded.as_mut().had_error());
+    }
+    assert_eq!(buffer.len(), 38);
+
+    let mut input = CodedInputStream::from_slice(&buffer);
+    assert_eq!(input.as_mut().read_tag().unwrap(), 8);
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 150);
+    assert_eq!(input.as_mut().read_varint64().unwrap(), u64::MAX);
+    assert_eq!(input.as_mut().read_varint64().unwrap(), u64::MAX);
+    let mut rest = vec![];
+    input.as_mut().read_to_end(&mut rest).unwrap();
+    assert_eq!(rest[..4], [4, 3, 2, 1]);
+    assert_eq!(rest[4..12], [8, 7, 6, 5, 4, 3, 2, 1]);
+    assert_eq!(&rest[12..], b"raw");
+}
+
+fn encode(f: impl FnOnce(Pin<&mut CodedOutputStream>)) -> Vec<u8> {
+    let mut buffer = vec![];
+    let mut output = VecOutputStream::new(&mut buffer);
+    f(CodedOutputStream::new(output.as_mut()).as_mut());
+    drop(output);
+    buffer
+}
+
+#[test]
+fn test_coded_input_stream_read_packed() {
+    let values: Vec<u64> = (0..1000).map(|i| i * i * i * 7919).collect();
+    let signed: Vec<i64> = values
+        .iter()
+        .map(|v| *v as i64 * (1 - 2 * (*v as i64 & 1)))
+        .collect();
+    let unsigned_data = encode(|mut output| {
+        for v in &values {
+            output.as_mut().write_varint64(*v);
+        }
+    });
+    let signed_data = encode(|mut output| {
+        for v in &signed {
+            output
+                .as_mut()
+                .write_varint64(((v << 1) ^ (v >> 63)) as u64);
+        }
+    });
+    let fixed_data = encode(|mut output| {
+        for v in &values {
+            output.as_mut().write_little_endian64(*v);
+        }
+    });
+    let buffer = [&unsigned_data[..], &signed_data, &fixed_data].concat();
+
+    // Decode from a flat buffer and from a stream of tiny segments, which
+    // forces varints to straddle buffer boundaries.
+    let segments: Vec<&[u8]> = buffer.chunks(3).collect();
+    let mut chain = ChainInputStream::new(&segments);
+    for mut input in [
+        CodedInputStream::from_slice(&buffer),
+        CodedInputStream::new(chain.as_mut()),
+    ] {
+        let mut out = vec![];
+        input
+            .as_mut()
+            .read_packed_varint64_into(&mut out, unsigned_data.len())
+            .unwrap();
+        assert_eq!(out, values);
+
+        let mut out = vec![];
+        input
+            .as_mut()
+            .read_packed_sint64_into(&mut out, signed_data.len())
+            .unwrap();
+        assert_eq!(out, signed);
+
+        let mut out = vec![];
+        input
+            .as_mut()
+            .read_packed_fixed64_into(&mut out, fixed_data.len())
+            .unwrap();
+        assert_eq!(out, values);
+    }
+
+    let mut out = vec![];
+    let mut input = CodedInputStream::from_slice(&[0x96, 0x01, 0x2a, 0x80]);
+    assert!(input
+        .as_mut()
+        .read_packed_varint32_into(&mut out, 4)
+        .is_err());
+    let mut input = CodedInputStream::from_slice(&[0, 0, 0]);
+    assert!(input
+        .as_mut()
+        .read_packed_fixed32_into(&mut out, 3)
+        .is_err());
+}
+
+#[test]
+fn test_coded_input_stream_read_packed_small_values() {
+    // Mostly single-byte varints, in runs of varying length, interrupted by
+    // occasional multi-byte varints.
+    let values: Vec<u32> = (0..1000u32)
+        .map(|i| match i % 37 {
+            0 => i * 100_000,
+            n if n % 11 == 0 => 128 + i,
+            _ => i % 128,
+        })
+        .collect();
+    let signed: Vec<i32> = values.iter().map(|v| (*v as i32 % 64) - 32).collect();
+    let unsigned_data = encode(|mut output| {
+        for v in &values {
+            output.as_mut().write_varint32(*v);
+        }
+    });
+    let signed_data = encode(|mut output| {
+        for v in &signed {
+            output
+                .as_mut()
+                .write_varint32(((v << 1) ^ (v >> 31)) as u32);
+        }
+    });
+    let buffer = [&unsigned_data[..], &signed_data].concat();
+
+    let segments: Vec<&[u8]> = buffer.chunks(13).collect();
+    let mut chain = ChainInputStream::new(&segments);
+    for mut input in [
+        CodedInputStream::from_slice(&buffer),
+        CodedInputStream::new(chain.as_mut()),
+    ] {
+        let mut out = vec![];
+        input
+            .as_mut()
+            .read_packed_varint32_into(&mut out, unsigned_data.len())
+            .unwrap();
+        assert_eq!(out, values);
+
+        let mut out = vec![];
+        input
+            .as_mut()
+            .read_packed_sint32_into(&mut out, signed_data.len())
+            .unwrap();
+        assert_eq!(out, signed);
+    }
+}
+
+#[test]
+fn test_coded_output_stream_write_packed() {
+    // Runs of small values long enough to be written eight at a time,
+    // interrupted by large and negative ones.
+    let values: Vec<i64> = (0..1000i64)
+        .map(|i| match i % 29 {
+            0 => i * 1_000_000_007,
+            n if n % 13 == 0 => -i,
+            _ => i % 128,
+        })
+        .collect();
+
+    fn packed<T: Copy>(values: &[T], write: impl Fn(Pin<&mut CodedOutputStream>, T)) -> Vec<u8> {
+        let body = encode(|mut output| {
+            for v in values {
+                write(output.as_mut(), *v);
+            }
+        });
+        let mut expected = encode(|output| output.write_varint64(body.len() as u64));
+        expected.extend(body);
+        expected
+    }
+
+    let unsigned: Vec<u64> = values.iter().map(|v| *v as u64).collect();
+    assert_eq!(
+        encode(|output| output.write_packed_varint64(&unsigned)),
+        packed(&unsigned, |output, v| output.write_varint64(v))
+    );
+    assert_eq!(
+        encode(|output| output.write_packed_int64(&values)),
+        packed(&values, |output, v| output.write_varint64(v as u64))
+    );
+    assert_eq!(
+        encode(|output| output.write_packed_sint64(&values)),
+        packed(&values, |output, v| output
+            .write_varint64(((v << 1) ^ (v >> 63)) as u64))
+    );
+
+    let unsigned: Vec<u32> = values.iter().map(|v| *v as u32).collect();
+    let signed: Vec<i32> = values.iter().map(|v| *v as i32).collect();
+    assert_eq!(
+        encode(|output| output.write_packed_varint32(&unsigned)),
+        packed(&unsigned, |output, v| output.write_varint32(v))
+    );
+    assert_eq!(
+        encode(|output| output.write_packed_int32(&signed)),
+        packed(&signed, |output, v| output.write_varint32_sign_extended(v))
+    );
+    assert_eq!(
+        encode(|output| output.write_packed_sint32(&signed)),
+        packed(&signed, |output, v| output
+            .write_varint32(((v << 1) ^ (v >> 31)) as u32))
+    );
+    assert_eq!(encode(|output| output.write_packed_varint32(&[])), [0]);
+
+    // The packed encodings round-trip through the packed decoders.
+    let data = encode(|output| output.write_packed_sint32(&signed));
+    let mut input = CodedInputStream::from_slice(&data);
+    let len = input.as_mut().read_varint32().unwrap() as usize;
+    let mut out = vec![];
+    input
+        .as_mut()
+        .read_packed_sint32_into(&mut out, len)
+        .unwrap();
+    assert_eq!(out, signed);
+}
+
+#[test]
+fn test_coded_input_stream_limits() {
+    let data = [0x01, 0x02, 0x03, 0x04, 0x05];
+    let mut input = CodedInputStream::from_slice(&data);
+    assert_eq!(input.bytes_until_limit(), None);
+
+    let outer = input.as_mut().push_limit(4);
+    assert_eq!(input.bytes_until_limit(), Some(4));
+    let inner = input.as_mut().push_limit(2);
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 1);
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 2);
+    assert_eq!(input.bytes_until_limit(), Some(0));
+    assert!(input.as_mut().read_varint32().is_err());
+    input.as_mut().pop_limit(inner);
+    assert_eq!(input.bytes_until_limit(), Some(2));
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 3);
+    input.as_mut().pop_limit(outer);
+    assert_eq!(input.bytes_until_limit(), None);
+
+    let mut input = CodedInputStream::from_slice(&data);
+    assert_eq!(input.bytes_until_total_bytes_limit(), None);
+    input.as_mut().set_total_bytes_limit(3);
+    assert_eq!(input.bytes_until_total_bytes_limit(), Some(3));
+    let mut buf = [0; 5];
+    assert_eq!(input.as_mut().read(&mut buf).unwrap(), 3);
+}
+
+#[test]
+fn test_coded_input_stream_read_tag() {
+    let data = [0x08, 0x96, 0x01, 0x10];
+    let mut input = CodedInputStream::from_slice(&data);
+    assert_eq!(input.as_mut().read_tag_with_cutoff(127).unwrap(), (8, true));
+    assert!(input.as_mut().last_tag_was(8));
+    assert_eq!(
+        input
+            .as_mut()
+            .read_tag_with_cutoff_no_last_tag(127)
+            .unwrap(),
+        (150, false)
+    );
+    assert!(input.as_mut().last_tag_was(8));
+    assert_eq!(input.as_mut().read_tag_no_last_tag().unwrap(), 16);
+    assert!(input.as_mut().last_tag_was(8));
+    assert!(input.as_mut().read_tag_with_cutoff(127).is_err());
+}
+
+#[test]
+fn test_coded_input_stream_skip_field() {
+    // Field 1 (varint), field 2 (bytes), a group 3 with a nested field, and
+    // field 4 (fixed32).
+    let data = b"\x08\x96\x01\x12\x03abc\x1b\x08\x01\x1c\x25\x01\x02\x03\x04";
+    let mut input = CodedInputStream::from_slice(data);
+    for expected in [8, 18, 27] {
+        let tag = input.as_mut().read_tag().unwrap();
+        assert_eq!(tag, expected);
+        input.as_mut().skip_field(tag).unwrap();
+    }
+    assert_eq!(input.as_mut().read_tag().unwrap(), 37);
+    assert!(input.as_mut().skip_field(28).is_err());
+
+    let mut input = CodedInputStream::from_slice(data);
+    input.as_mut().skip_message().unwrap();
+    assert_eq!(input.current_position(), data.len());
+
+    // Skipping stops at the end of the enclosing group.
+    let mut input = CodedInputStream::from_slice(&data[9..]);
+    input.as_mut().skip_message().unwrap();
+    assert!(input.as_mut().last_tag_was(28));
+
+    let mut input = CodedInputStream::from_slice(&data[..5]);
+    assert!(input.as_mut().skip_message().is_err());
+}
+
+#[test]
+fn test_coded_input_stream_read_bytes_borrowed() {
+    let data = b"hello, world";
+    let mut input = CodedInputStream::from_slice(data);
+    let hello = input.as_mut().read_bytes_borrowed(5).unwrap();
+    assert!(matches!(hello, Cow::Borrowed(b"hello")));
+    input.as_mut().skip(2).unwrap();
+    assert_eq!(&*input.as_mut().read_bytes_borrowed(5).unwrap(), b"world");
+    assert!(input.as_mut().read_bytes_borrowed(1).is_err());
+
+    let segments: [&[u8]; 2] = [b"hello, ", b"world"];
+    let mut chain = ChainInputStream::new(&segments);
+    let mut input = CodedInputStream::new(chain.as_mut());
+    assert!(matches!(
+        input.as_mut().read_bytes_borrowed(5).unwrap(),
+        Cow::Borrowed(b"hello")
+    ));
+    let straddling = input.as_mut().read_bytes_borrowed(4).unwrap();
+    assert!(matches!(straddling, Cow::Owned(_)));
+    assert_eq!(&*straddling, b", wo");
+    assert_eq!(&*input.as_mut().read_bytes_borrowed(3).unwrap(), b"rld");
+}
+
+#[test]
+fn test_io_read_ahead() {
+    let mut buffer = vec![];
+    check_some_writes(VecOutputStream::new(&mut buffer).as_mut());
+    for (block_size, depth) in [(1, 1), (7, 2), (4096, 4)] {
+        let mut reader = ReadAhead::new(Cursor::new(buffer.clone()), block_size, depth);
+        let mut input = BufReadStream::new(&mut reader);
+        check_some_reads(input.as_mut());
+        assert!(input.as_mut().next().is_err()); // check for EOF
+
+        let reader = ReadAhead::new(Cursor::new(buffer.clone()), block_size, depth);
+        let mut input = reader.into_stream();
+        check_some_reads(input.as_mut());
+        assert!(input.as_mut().next().is_err()); // check for EOF
+    }
+}
+
+#[cfg(unix)]
+#[test]
+fn test_io_read_ahead_stream() {
+    let mut file = tempfile::NamedTempFile::new().unwrap();
+    check_some_writes(WriterStream::new(&mut file).as_mut());
+    for (block_size, depth) in [(1, 1), (7, 2), (4096, 4), (1 << 20, 1)] {
+        let stream = MmapInputStream::open(file.path()).unwrap();
+        let mut input = ReadAhead::from_stream(stream, block_size, depth).into_stream();
+        check_some_reads(input.as_mut());
+        assert!(input.as_mut().next().is_err()); // check for EOF
+    }
+}
+
+#[cfg(feature = "zlib")]
+#[test]
+fn test_io_parallel_gzip() {
+    use protobuf_native::io::{
+        GzipInputFormat, GzipInputStream, GzipOptions, GzipOutputFormat, ParallelGzipWriter,
+    };
+
+    for (output_format, input_format, block_size, threads) in [
+        (GzipOutputFormat::Gzip, GzipInputFormat::Gzip, None, 4),
+        (GzipOutputFormat::Gzip, GzipInputFormat::Gzip, Some(1000), 3),
+        (GzipOutputFormat::Zlib, GzipInputFormat::Zlib, Some(4096), 1),
+        (GzipOutputFormat::Zlib, GzipInputFormat::Auto, Some(7), 2),
+    ] {
+        let options = GzipOptions {
+            format: output_format,
+            buffer_size: block_size,
+            compression_level: Some(9),
+        };
+        let mut writer = ParallelGzipWriter::new(vec![], options, threads);
+        check_some_writes(WriterStream::new(&mut writer).as_mut());
+        let buffer = writer.finish().unwrap();
+        if block_size.is_none() {
+            assert!(buffer.len() < 1000);
+        }
+
+        let mut input = SliceInputStream::new(&buffer);
+        let mut gzip = GzipInputStream::new(input.as_mut(), input_format);
+        check_some_reads(gzip.as_mut());
+        assert!(gzip.as_mut().next().is_err()); // check for EOF
+        assert_eq!(gzip.zlib_error_message(), None);
+    }
+}
+
+#[test]
+fn test_io_write_behind() {
+    for (block_size, depth) in [(1, 1), (7, 2), (4096, 4)] {
+        let mut writer = WriteBehind::new(vec![], block_size, depth);
+        check_some_writes(WriterStream::new(&mut writer).as_mut());
+        writer.flush().unwrap();
+        let buffer = writer.into_inner().unwrap();
+        check_some_reads(SliceInputStream::new(&buffer).as_mut());
+    }
+}
+
+#[cfg(feature = "zlib")]
+#[test]
+fn test_io_gzip() {
+    use protobuf_native::io::{
+        GzipInputFormat, GzipInputStream, GzipOptions, GzipOutputFormat, GzipOutputStream,
+    };
+
+    for (output_format, input_format) in [
+        (GzipOutputFormat::Gzip, GzipInputFormat::Gzip),
+        (GzipOutputFormat::Gzip, GzipInputFormat::Auto),
+        (GzipOutputFormat::Zlib, GzipInputFormat::Zlib),
+        (GzipOutputFormat::Zlib, GzipInputFormat::Auto),
+    ] {
+        let mut buffer = vec![];
+        {
+            let mut output = VecOutputStream::new(&mut buffer);
+            let options = GzipOptions {
+                format: output_format,
+                buffer_size: Some(1024),
+                compression_level: Some(9),
+            };
+            let mut gzip = GzipOutputStream::with_options(output.as_mut(), options);
+            check_some_writes(gzip.as_mut());
+            gzip.as_mut().close().unwrap();
+        }
+        assert!(buffer.len() < 1000);
+
+        let mut input = SliceInputStream::new(&buffer);
+        let mut gzip = GzipInputStream::new(input.as_mut(), input_format);
+        check_some_reads(gzip.as_mut());
+        assert!(gzip.as_mut().next().is_err()); // check for EOF
+        assert_eq!(gzip.zlib_error_message(), None);
+    }
+
+    let mut input = SliceInputStream::new(b"not compressed");
+    let mut gzip = GzipInputStream::with_buffer_size(input.as_mut(), GzipInputFormat::Gzip, 64);
+    assert!(gzip.as_mut().next().is_err());
+    assert!(gzip.zlib_error_message().is_some());
+}
+
+#[test]
+fn test_io_crc32c() {
+    // The standard CRC32C check value.
+    const CHECK: u32 = 0xe306_9283;
+
+    let mut buffer = vec![];
+    {
+        let mut output = VecOutputStream::new(&mut buffer);
+        let mut crc = Crc32cOutputStream::new(output.as_mut());
+        assert_eq!(crc.crc32c(), 0);
+        write_bytes(crc.as_mut(), b"123456789");
+        assert_eq!(crc.crc32c(), CHECK);
+    }
+    assert_eq!(buffer, b"123456789");
+
+    // Backed up and skipped bytes are accounted for.
+    let mut input = SliceInputStream::new(&buffer);
+    let mut crc = Crc32cInputStream::new(input.as_mut());
+    read_bytes(crc.as_mut(), &mut [0; 4]);
+    assert!(crc.as_mut().skip(5).is_ok());
+    assert_eq!(crc.crc32c(), CHECK);
+    assert!(crc.as_mut().next().is_err());
+    assert_eq!(crc.crc32c(), CHECK);
+
+    let mut buffer = vec![];
+    let written = {
+        let mut output = VecOutputStream::new(&mut buffer);
+        let mut crc = Crc32cOutputStream::new(output.as_mut());
+        check_some_writes(crc.as_mut());
+        crc.crc32c()
+    };
+    let mut input = SliceInputStream::new(&buffer);
+    let mut crc = Crc32cInputStream::new(input.as_mut());
+    check_some_reads(crc.as_mut());
+    assert_eq!(crc.crc32c(), written);
+    assert_ne!(written, 0);
+
+    // A coded stream backs up what it did not consume when it is dropped.
+    let mut input = SliceInputStream::new(&buffer);
+    let mut crc = Crc32cInputStream::new(input.as_mut());
+    {
+        let mut coded = CodedInputStream::new(crc.as_mut());
+        coded.as_mut().skip(buffer.len() - 1).unwrap();
+    }
+    assert!(crc.as_mut().skip(1).is_ok());
+    assert_eq!(crc.crc32c(), written);
+}
+
+#[test]
+fn test_io_limiting() {
+    let mut buffer = vec![];
+    check_some_writes(VecOutputStream::new(&mut buffer).as_mut());
+    buffer.extend(b"trailer");
+
+    let mut input = SliceInputStream::new(&buffer);
+    {
+        let mut limited = LimitingInputStream::new(input.as_mut(), 200_055);
+        check_some_reads(limited.as_mut());
+        assert!(limited.as_mut().next().is_err()); // check for EOF
+    }
+    check_read(input.as_mut(), b"trailer");
+}
+
+#[test]
+fn test_io_cord() {
+    let mut output = CordOutputStream::new();
+    check_some_writes(output.as_mut());
+    let cord = output.as_mut().consume();
+    check_some_reads(CordInputStream::new(&cord).as_mut());
+
+    // Large payloads are chained into the output and read back by reference.
+    let payload = vec![7; 1 << 16];
+    let payload_ptr = payload.as_ptr();
+    let mut external = Cord::new();
+    external.as_mut().append_external(payload);
+    let mut output = CordOutputStream::new();
+    {
+        let mut coded = CodedOutputStream::new(output.as_mut());
+        coded.as_mut().write_tag(0x0a);
+        coded.as_mut().write_varint32(1 << 16);
+        coded.as_mut().write_cord(&external);
+    }
+    let cord = output.as_mut().consume();
+    assert_eq!(cord.len(), 3 + (1 << 16));
+    assert!(cord.chunks().iter().any(|c| c.as_ptr() == payload_ptr));
+
+    let mut input = CordInputStream::new(&cord);
+    let mut coded = CodedInputStream::new(input.as_mut());
+    assert_eq!(coded.as_mut().read_tag().unwrap(), 0x0a);
+    assert_eq!(coded.as_mut().read_varint32().unwrap(), 1 << 16);
+    let mut read = Cord::new();
+    coded.as_mut().read_cord(read.as_mut(), 1 << 16).unwrap();
+    assert_eq!(read.to_vec(), vec![7; 1 << 16]);
+    assert!(read.chunks().iter().any(|c| c.as_ptr() == payload_ptr));
+    assert!(coded.as_mut().read_cord(read.as_mut(), 1).is_err());
+}
+
+#[test]
+fn test_io_reset() {
+    let buffers: [&[u8]; 3] = [&[0x01, 0x02], &[], &[0x96, 0x01]];
+
+    let mut input = SliceInputStream::new(buffers[0]);
+    for buffer in buffers {
+        input.as_mut().reset(buffer);
+        check_read(input.as_mut(), buffer);
+        assert!(input.as_mut().next().is_err()); // check for EOF
+        assert_eq!(input.byte_count(), buffer.len() as i64);
+    }
+
+    let mut input = CodedInputStream::from_slice(buffers[0]);
+    let _ = input.as_mut().push_limit(1);
+    input.as_mut().reset(buffers[2]);
+    assert!(input.is_flat());
+    assert_eq!(input.bytes_until_limit(), None);
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 150);
+    assert_eq!(input.current_position(), 2);
+}
+
+#[test]
+fn test_stack_coded_input_stream() {
+    // The sources must outlive the storage, which may still refer to them
+    // when it is dropped.
+    let mut buffer = vec![];
+    check_some_writes(VecOutputStream::new(&mut buffer).as_mut());
+    let mut slice = SliceInputStream::new(&buffer);
+
+    let mut storage = pin!(StackCodedInputStream::new());
+    assert!(storage.as_mut().get().is_none());
+
+    let mut input = storage.as_mut().init_from_slice(&[0x96, 0x01]);
+    assert!(input.is_flat());
+    assert_eq!(input.as_mut().read_varint32().unwrap(), 150);
+
+    let mut input = storage.as_mut().init(slice.as_mut());
+    assert!(!input.is_flat());
+    let mut out = vec![0; 13];
+    input.read_exact(&mut out).unwrap();
+    assert_eq!(out, b"Hello world!\n");
+    assert_eq!(storage.as_mut().get().unwrap().current_position(), 13);
+}
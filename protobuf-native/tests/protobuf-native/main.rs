@@ -13,20 +13,95 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use std::collections::HashMap;
 use std::error::Error;
-use std::path::Path;
+use std::fs;
+use std::mem::MaybeUninit;
+use std::path::{Path, PathBuf};
+use std::pin::Pin;
+use std::sync::Arc;
+use std::thread;
 
 use pretty_assertions::assert_eq;
 
+use protobuf_native::any::{Any, AnyResolver};
+use protobuf_native::columnar::{self, ColumnType, ColumnValues, ColumnarExtractor};
+use protobuf_native::compat::{self, CompatibilityChecker, CompatibilityIssue, IssueKind};
 use protobuf_native::compiler::{
-    DiskSourceTree, FileLoadError, Location, Severity, SimpleErrorCollector, SourceTree,
+    self, CachingSourceTree, CachingSourceTreeDescriptorDatabase, CompileError, CompileServer,
+    CustomSourceTree, DiskSourceTree, FileLoadError, FileOpenError, Importer, Location,
+    MappedFileCache, MmapSourceTree, MultiFileErrorCollector, ParallelSourceTreeParser,
+    ProtoWorkspace, RustErrorCollector, RustSourceTree, Severity, SimpleErrorCollector, SourceTree,
     SourceTreeDescriptorDatabase, VirtualSourceTree,
 };
-use protobuf_native::{DescriptorDatabase, MessageLite, OperationFailedError};
+use protobuf_native::frozen::FrozenMessage;
+use protobuf_native::io::{
+    ChainInputStream, CodedInputStream, CodedOutputStream, DelimitedReader, DelimitedWriter,
+    SliceInputStream, VecOutputStream, ZeroCopyInputStream,
+};
+use protobuf_native::json::{self, ParseOptions, PrintOptions, TypeResolver};
+use protobuf_native::metrics::{self, LATENCY_BUCKETS};
+use protobuf_native::numa;
+use protobuf_native::pool::{ArenaPool, ArenaPoolOptions, MessagePool, MessagePoolOptions};
+use protobuf_native::profile::{FieldProfiler, FieldStats};
+use protobuf_native::sample::{self, Capture, CaptureOptions, ReplayOptions, TypeSamples};
+use protobuf_native::text_format::{Parser, Printer};
+use protobuf_native::time_util::{self, Duration, Timestamp};
+use protobuf_native::util::{self, HashOptions, MessageDifferencer, RequiredFieldChecker, Scope};
+use protobuf_native::wire::{
+    self, IncrementalParser, PackedFixed, Transcoder, ValidationError, ValidationErrorKind,
+    WireEvent, WireReader, WireTransform, WireValidator, WireValue,
+};
+use protobuf_native::{
+    Arena, ArenaMessage, ArenaOptions, BuildOptions, DescriptorDatabase, DescriptorIndex,
+    DescriptorPool, DescriptorPoolImage, DynamicMessageFactory, EncodedDescriptorDatabase,
+    FieldDescriptor, FieldMask, FieldType, FieldValue, FieldVisitor, FieldWalker,
+    FileDescriptorProto, FileDescriptorSet, MemoryUsage, MergeConflictError, MergeOptions,
+    MergedDescriptorDatabase, Message, MessageLite, OperationFailedError, ParseError,
+    ParseErrorKind, RepeatedScalars, RepeatedScalarsMut, SourceLocation,
+};
 
+#[cfg(feature = "bench")]
+mod alloc;
 mod io;
 mod util;
 
+/// Builds a file descriptor set containing a single, simple file, for use as
+/// an arbitrary message in tests.
+fn simple_file_descriptor_set() -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto3";
+
+message Test {
+    string s = 1;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])
+}
+
+/// Builds a file descriptor set containing the given files, each a name and
+/// its contents, in order.
+fn build_file_descriptor_set(
+    files: &[(&str, &str)],
+) -> Result<Pin<Box<FileDescriptorSet>>, OperationFailedError> {
+    let mut source_tree = VirtualSourceTree::new();
+    for (name, contents) in files {
+        source_tree
+            .as_mut()
+            .add_file(Path::new(name), contents.as_bytes().to_vec());
+    }
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let names: Vec<_> = files.iter().map(|(name, _)| *name).collect();
+    db.as_mut().build_file_descriptor_set(&names)
+}
+
 /// Test that opening a nonexistent file fails with an appropriate error
 /// message.
 #[test]
@@ -220,3 +295,4631 @@ message Test {
     assert!(out.len() > 0);
     Ok(())
 }
+
+#[test]
+fn test_descriptor_proto_bulk_accessors() -> Result<(), Box<dyn Error>> {
+    let fds = build_file_descriptor_set(&[
+        (
+            "imported.proto",
+            "syntax = \"proto3\"; message ImportMe { int32 f = 1; }",
+        ),
+        (
+            "root.proto",
+            r#"
+syntax = "proto3";
+
+import "imported.proto";
+
+message Test {
+    ImportMe im = 1;
+}
+
+message Other {}
+"#,
+        ),
+    ])?;
+    let files = fds.files();
+    assert_eq!(files.len(), 2);
+    assert_eq!(files[0].name(), b"root.proto");
+    assert_eq!(
+        files[0].dependencies().collect::<Vec<_>>(),
+        vec![&b"imported.proto"[..]]
+    );
+    assert_eq!(files[1].dependencies().len(), 0);
+    let names: Vec<_> = files[0]
+        .message_types()
+        .iter()
+        .map(|message| message.name())
+        .collect();
+    assert_eq!(names, [&b"Test"[..], b"Other"]);
+    assert_eq!(files[1].message_types().len(), 1);
+    assert_eq!(files[1].message_types()[0].name(), b"ImportMe");
+    Ok(())
+}
+
+#[test]
+fn test_dynamic_message() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    let file = pool.as_mut().build_file(fds.file(0));
+    assert_eq!(file.message_type_count(), 1);
+    assert_eq!(file.message_type(0).full_name(), b"Test");
+
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    assert_eq!(descriptor.name(), b"Test");
+    assert!(pool.find_message_type_by_name("Missing").is_none());
+
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let mut message = prototype.new();
+    message.as_mut().parse_from_bytes(b"\x0a\x02hi")?;
+    assert_eq!(message.serialize()?, b"\x0a\x02hi");
+    drop(message);
+
+    // The prototype is cached.
+    let a: *const dyn Message = factory.as_mut().get_prototype(descriptor);
+    let b: *const dyn Message = factory.as_mut().get_prototype(descriptor);
+    assert_eq!(a as *const u8, b as *const u8);
+    Ok(())
+}
+
+#[test]
+fn test_message_copy_merge_swap() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let mut a = prototype.new_message();
+    a.as_mut().parse_from_bytes(b"\x0a\x02hi")?;
+    let mut b = prototype.new_message();
+    b.as_mut().copy_from(&*a)?;
+    assert_eq!(b.serialize()?, b"\x0a\x02hi");
+
+    a.as_mut().parse_from_bytes(b"\x0a\x03bye")?;
+    b.as_mut().merge_from(&*a)?;
+    assert_eq!(b.serialize()?, b"\x0a\x03bye");
+
+    b.as_mut().clear();
+    a.as_mut().swap(b.as_mut())?;
+    assert_eq!(a.serialize()?, b"");
+    assert_eq!(b.serialize()?, b"\x0a\x03bye");
+    b.as_mut().unsafe_arena_swap(a.as_mut())?;
+    assert_eq!(a.serialize()?, b"\x0a\x03bye");
+
+    // Messages of different types are rejected rather than merged.
+    assert!(a.as_mut().merge_from(&*fds).is_err());
+    assert!(a.as_mut().copy_from(&*fds).is_err());
+
+    // Messages with the same descriptor but different reflection, as a
+    // dynamic message and the generated message it mirrors or two dynamic
+    // messages from different factories have, are rejected rather than
+    // swapped.
+    let mut fds = fds;
+    let set_descriptor = DescriptorPool::generated()
+        .find_message_type_by_name("google.protobuf.FileDescriptorSet")
+        .unwrap();
+    let mut dynamic_set = factory.as_mut().get_prototype(set_descriptor).new_message();
+    assert!(dynamic_set.as_mut().swap(fds.as_mut()).is_err());
+    assert!(dynamic_set
+        .as_mut()
+        .unsafe_arena_swap(fds.as_mut())
+        .is_err());
+    let mut other_factory = DynamicMessageFactory::new();
+    let mut c = other_factory
+        .as_mut()
+        .get_prototype(descriptor)
+        .new_message();
+    assert!(a.as_mut().swap(c.as_mut()).is_err());
+    assert_eq!(a.serialize()?, b"\x0a\x03bye");
+    Ok(())
+}
+
+#[test]
+fn test_message_space_used() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+    let empty = message.space_used();
+    assert!(empty > 0);
+
+    let mut data = b"\x0a\x80\x08".to_vec();
+    data.extend([b'x'; 1024]);
+    message.as_mut().parse_from_bytes(&data)?;
+    assert!(message.space_used() >= empty + 1024);
+    assert_eq!(message.space_used_estimate(), message.space_used());
+    Ok(())
+}
+
+#[test]
+fn test_message_pool() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let messages = MessagePool::with_options(
+        prototype,
+        MessagePoolOptions {
+            max_retained: 1,
+            max_space_used: 512,
+        },
+    );
+    let mut a = messages.get();
+    a.as_mut().parse_from_bytes(b"\x0a\x02hi")?;
+    let b = messages.get();
+    assert_eq!(messages.idle_count(), 0);
+    drop(a);
+    drop(b);
+    assert_eq!(messages.idle_count(), 1);
+
+    // Returned messages are cleared.
+    let mut a = messages.get();
+    assert_eq!(messages.idle_count(), 0);
+    assert_eq!(a.serialize()?, b"");
+
+    // Messages that retain too much memory are freed rather than retained.
+    let mut data = b"\x0a\x80\x08".to_vec();
+    data.extend([b'x'; 1024]);
+    a.as_mut().parse_from_bytes(&data)?;
+    drop(a);
+    assert_eq!(messages.idle_count(), 0);
+
+    let detached = messages.get().detach();
+    drop(detached);
+    assert_eq!(messages.idle_count(), 0);
+    Ok(())
+}
+
+#[test]
+fn test_message_thread_handoff() -> Result<(), Box<dyn Error>> {
+    fn assert_send_sync<T: Send + Sync + ?Sized>() {}
+    assert_send_sync::<Pin<Box<dyn MessageLite>>>();
+    assert_send_sync::<Pin<Box<dyn Message>>>();
+    assert_send_sync::<FileDescriptorSet>();
+
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    // Parse on one thread and process on another.
+    let mut message = prototype.new_message();
+    thread::scope(|s| {
+        s.spawn(|| message.as_mut().parse_from_bytes(b"\x0a\x02hi"))
+            .join()
+            .unwrap()
+    })?;
+    let message = Arc::new(message);
+    let serialized = thread::scope(|s| {
+        let handles: Vec<_> = (0..4)
+            .map(|_| {
+                let message = Arc::clone(&message);
+                s.spawn(move || message.serialize())
+            })
+            .collect();
+        handles
+            .into_iter()
+            .map(|h| h.join().unwrap())
+            .collect::<Result<Vec<_>, _>>()
+    })?;
+    assert!(serialized.iter().all(|s| s == b"\x0a\x02hi"));
+    Ok(())
+}
+
+#[test]
+fn test_any() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let mut message = prototype.new_message();
+    message.as_mut().parse_from_bytes(b"\x0a\x02hi")?;
+    let mut any = Any::new();
+    any.as_mut().pack_from(&*message)?;
+    assert_eq!(any.type_url(), b"type.googleapis.com/Test");
+    assert_eq!(any.value(), b"\x0a\x02hi");
+
+    let mut unpacked = prototype.new_message();
+    any.unpack_to(unpacked.as_mut())?;
+    assert_eq!(unpacked.serialize()?, b"\x0a\x02hi");
+    // Messages of other types are rejected.
+    assert!(any.unpack_to(fds.new_message().as_mut()).is_err());
+
+    let resolver = AnyResolver::new(&pool);
+    let unpacked = resolver.unpack(&any)?;
+    assert_eq!(unpacked.serialize()?, b"\x0a\x02hi");
+    drop(unpacked);
+    let resolved = resolver.resolve(b"type.googleapis.com/Test").unwrap();
+    assert_eq!(resolved.descriptor.full_name(), b"Test");
+    assert!(resolver.resolve(b"type.googleapis.com/Missing").is_none());
+    assert!(resolver.resolve(b"Test").is_none());
+    any.as_mut().set_type_url("type.googleapis.com/Missing");
+    assert!(resolver.unpack(&any).is_err());
+
+    // Resolve many distinct type URLs concurrently, enough to grow the
+    // resolver's table several times.
+    let urls: Vec<_> = (0..500).map(|i| format!("example.com/{i}/Test")).collect();
+    thread::scope(|s| {
+        for _ in 0..4 {
+            s.spawn(|| {
+                for url in &urls {
+                    let resolved = resolver.resolve(url.as_bytes()).unwrap();
+                    assert_eq!(resolved.descriptor.full_name(), b"Test");
+                }
+            });
+        }
+    });
+    let a: *const dyn Message = resolver.resolve(b"example.com/0/Test").unwrap().prototype;
+    let b: *const dyn Message = resolver.resolve(b"example.com/499/Test").unwrap().prototype;
+    assert_eq!(a as *const u8, b as *const u8);
+    Ok(())
+}
+
+#[test]
+fn test_descriptor_index() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto3";
+
+message Outer {
+    message Inner {
+        int32 a = 1;
+    }
+    Inner inner = 1;
+    string s = 2;
+}
+
+message Other {
+    bool b = 1;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    let file = pool.as_mut().build_file(fds.file(0));
+    let index = DescriptorIndex::new([file]);
+
+    assert_eq!(index.message_count(), 3);
+    let names: Vec<_> = (0..3).map(|id| index.message(id).full_name()).collect();
+    assert_eq!(names, [&b"Outer"[..], b"Outer.Inner", b"Other"]);
+    assert_eq!(index.find_message_id_by_name("Outer.Inner"), Some(1));
+    assert_eq!(index.find_message_id_by_name("Missing"), None);
+    for id in 0..index.message_count() {
+        assert_eq!(index.message_id(index.message(id)), Some(id));
+    }
+
+    assert_eq!(index.field_count(), 4);
+    let names: Vec<_> = (0..4).map(|id| index.field(id).full_name()).collect();
+    assert_eq!(
+        names,
+        [
+            &b"Outer.inner"[..],
+            b"Outer.s",
+            b"Outer.Inner.a",
+            b"Other.b"
+        ]
+    );
+    for id in 0..index.field_count() {
+        assert_eq!(index.field_id(index.field(id)), Some(id));
+    }
+    Ok(())
+}
+
+#[test]
+fn test_wire_reader() -> Result<(), Box<dyn Error>> {
+    fn scan(input: Pin<&mut dyn ZeroCopyInputStream>) -> Result<Vec<String>, OperationFailedError> {
+        let mut reader = WireReader::new(input);
+        let mut events = vec![];
+        while let Some(event) = reader.next()? {
+            match event {
+                WireEvent::LengthDelimited { number: 2, .. } => reader.enter()?,
+                WireEvent::LengthDelimited { number: 3, .. } => {
+                    events.push(format!("bytes {:?}", reader.read_bytes()?))
+                }
+                event => events.push(format!("{:?}", event)),
+            }
+        }
+        Ok(events)
+    }
+
+    let data: &[u8] = b"\x08\x96\x01\x12\x0c\x08\x02\x1a\x03abc\x25\x01\x00\x00\x00\
+        \x22\x02\x09\x09\x19\x01\x02\x03\x04\x05\x06\x07\x08\x1a\x02hi";
+    let expected = [
+        "Varint { number: 1, value: 150 }",
+        "Varint { number: 1, value: 2 }",
+        "bytes [97, 98, 99]",
+        "Fixed32 { number: 4, value: 1 }",
+        "EndMessage",
+        "LengthDelimited { number: 4, len: 2 }",
+        "Fixed64 { number: 3, value: 578437695752307201 }",
+        "bytes [104, 105]",
+    ];
+    assert_eq!(scan(SliceInputStream::new(data).as_mut())?, expected);
+    // Fields that straddle chunks decode identically.
+    for size in 1..data.len() {
+        let segments: Vec<_> = data.chunks(size).collect();
+        assert_eq!(scan(ChainInputStream::new(&segments).as_mut())?, expected);
+    }
+
+    // Dropping the reader backs the stream up to the first unread byte.
+    let mut input = SliceInputStream::new(data);
+    let mut reader = WireReader::new(input.as_mut());
+    reader.next()?;
+    let position = reader.position();
+    drop(reader);
+    assert_eq!(input.byte_count(), position as i64);
+
+    let mut input = SliceInputStream::new(b"\x08");
+    assert!(WireReader::new(input.as_mut()).next().is_err());
+    Ok(())
+}
+
+#[test]
+fn test_extract_field() -> Result<(), Box<dyn Error>> {
+    // Field 1 is a message holding the string field 2, followed by the varint
+    // field 2, a group 3, and a second occurrence of field 1.
+    let data: &[u8] = b"\x0a\x05\x12\x03key\x10\x01\x1b\x08\x01\x1c\x0a\x04\x12\x02k2";
+    assert_eq!(
+        wire::extract_field(data, &[1, 2])?,
+        Some(WireValue::LengthDelimited(b"k2"))
+    );
+    assert_eq!(wire::extract_field(data, &[2])?, Some(WireValue::Varint(1)));
+    assert_eq!(wire::extract_field(data, &[3])?, None);
+    assert_eq!(wire::extract_field(data, &[1, 3])?, None);
+    assert!(wire::extract_field(data, &[]).is_err());
+    assert!(wire::extract_field(b"\x0a\x09", &[1, 2]).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_extract_packed_fixed() -> Result<(), Box<dyn Error>> {
+    // Field 1 holds packed floats.
+    let data: &[u8] = b"\x0a\x08\x00\x00\x80\x3f\x00\x00\x00\x40";
+    let runs = wire::extract_packed_fixed::<f32>(data, &[1])?;
+    assert_eq!(runs.len(), 1);
+    assert_eq!(runs[0].len(), 2);
+    assert_eq!(runs[0].get(1), Some(2.0));
+    assert_eq!(runs[0].get(2), None);
+    assert_eq!(runs[0].to_vec(), [1.0, 2.0]);
+    assert_eq!(runs[0].iter().rev().collect::<Vec<_>>(), [2.0, 1.0]);
+    assert!(wire::extract_packed_fixed::<f32>(data, &[2])?.is_empty());
+
+    // Field 1 is a message holding an unpacked and a packed occurrence of the
+    // fixed32 field 2, followed by a second occurrence of field 1.
+    let data: &[u8] = b"\x0a\x0f\x15\x01\x00\x00\x00\x12\x08\x02\x00\x00\x00\x03\x00\x00\x00\
+                        \x0a\x05\x15\x04\x00\x00\x00";
+    let runs = wire::extract_packed_fixed::<u32>(data, &[1, 2])?;
+    let values: Vec<u32> = runs.iter().flat_map(|run| run.iter()).collect();
+    assert_eq!(values, [1, 2, 3, 4]);
+    assert_eq!(runs[1].as_bytes(), b"\x02\x00\x00\x00\x03\x00\x00\x00");
+
+    // The field has a different width, or a truncated packed encoding.
+    assert!(wire::extract_packed_fixed::<u64>(data, &[1, 2]).is_err());
+    assert!(wire::extract_packed_fixed::<f64>(b"\x0a\x03\x00\x00\x00", &[1]).is_err());
+    assert!(PackedFixed::<i32>::new(b"\x00\x00\x00").is_err());
+
+    // Aligned little-endian data can be borrowed as a slice.
+    let values: Vec<u64> = vec![7, 8];
+    let bytes: Vec<u8> = values.iter().flat_map(|v| v.to_le_bytes()).collect();
+    let run = PackedFixed::<u64>::new(&bytes)?;
+    assert_eq!(run.to_vec(), values);
+    if let Some(slice) = run.as_slice() {
+        assert_eq!(slice, &values[..]);
+    }
+    Ok(())
+}
+
+#[test]
+fn test_wire_transform() -> Result<(), Box<dyn Error>> {
+    // Field 1 is a message holding a 200-byte string field 2 and a varint
+    // field 3, followed by the string field 4.
+    let mut data = b"\x0a\xcd\x01\x12\xc8\x01".to_vec();
+    data.extend([b'x'; 200]);
+    data.extend(b"\x18\x07\x22\x02us");
+
+    let mut transform = WireTransform::new();
+    transform
+        .remove(&[1, 2])
+        .set(&[4], WireValue::LengthDelimited(b"eu"))
+        .append(&[1, 5], WireValue::Fixed32(9));
+    let mut output = vec![];
+    transform.apply(&data, &mut output)?;
+    assert_eq!(
+        output,
+        b"\x0a\x02\x18\x07\x22\x02eu\x0a\x05\x2d\x09\x00\x00\x00"
+    );
+    assert_eq!(wire::extract_field(&output, &[1, 2])?, None);
+    assert_eq!(
+        wire::extract_field(&output, &[1, 3])?,
+        Some(WireValue::Varint(7))
+    );
+    assert_eq!(
+        wire::extract_field(&output, &[1, 5])?,
+        Some(WireValue::Fixed32(9))
+    );
+
+    // A removal path must pass through length-delimited fields.
+    let mut transform = WireTransform::new();
+    transform.remove(&[1, 1]);
+    assert!(transform.apply(b"\x08\x01", &mut vec![]).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_transcoder() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto3";
+
+message V1 {
+    int32 id = 1;
+    string name = 2;
+    V1 child = 3;
+    fixed32 legacy = 4;
+}
+
+message V2 {
+    bytes title = 1;
+    V2 child = 2;
+    uint64 id = 5;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let v1 = pool.find_message_type_by_name("V1").unwrap();
+    let v2 = pool.find_message_type_by_name("V2").unwrap();
+
+    // V1 { id: 1, name: "x", child { id: 2, legacy: 7, child { name: "yz" } } },
+    // followed by an unknown field 9.
+    let data = b"\x08\x01\x12\x01x\x1a\x0d\x08\x02\x25\x07\x00\x00\x00\x1a\x04\x12\x02yz\x48\x01";
+    let transcoder = Transcoder::with_renames(v1, v2, &[("V1.name", "title")])?;
+    let mut output = vec![];
+    transcoder.transcode(data, &mut output)?;
+    assert_eq!(
+        output,
+        b"\x28\x01\x0a\x01x\x12\x08\x28\x02\x12\x04\x0a\x02yz"
+    );
+
+    // Without the rename, the name is dropped.
+    let mut output = vec![];
+    Transcoder::new(v1, v2)?.transcode(data, &mut output)?;
+    assert_eq!(output, b"\x28\x01\x12\x04\x28\x02\x12\x00");
+
+    // Fields that are encoded differently cannot be matched.
+    assert!(Transcoder::with_renames(v1, v2, &[("V1.legacy", "id")]).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_wire_validator() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto2";
+
+message Node {
+    required int32 id = 1;
+    optional string name = 2;
+    optional Node child = 3;
+    repeated fixed32 values = 4 [packed = true];
+    optional group Extra = 5 {
+        required int32 x = 6;
+    }
+}
+"#
+        .to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("test3.proto"),
+        b"syntax = \"proto3\"; message Text { string s = 1; }".to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto"), Path::new("test3.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    pool.as_mut().build_file(fds.file(1));
+    let node = pool.find_message_type_by_name("Node").unwrap();
+    let text = pool.find_message_type_by_name("Text").unwrap();
+    let validator = WireValidator::new(node);
+    let check = |data: &[u8]| validator.validate(data).map_err(|e| (e.offset, e.kind));
+
+    // Node { id: 1, name: "hi", child { id: 2 }, values: [7], Extra { x: 3 } },
+    // followed by an unknown field 9.
+    let data =
+        b"\x08\x01\x12\x02hi\x1a\x02\x08\x02\x22\x04\x07\x00\x00\x00\x2b\x30\x03\x2c\x48\x01";
+    assert_eq!(check(data), Ok(()));
+    assert_eq!(wire::validate_wire(data, node), Ok(()));
+    // The parser accepts what the validator accepts.
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(node).new_message();
+    message.as_mut().parse_from_bytes(data)?;
+
+    use ValidationErrorKind::*;
+    assert_eq!(check(b""), Err((0, MissingRequired { number: 1 })));
+    assert_eq!(
+        check(b"\x08\x01\x1a\x00"),
+        Err((4, MissingRequired { number: 1 }))
+    );
+    assert_eq!(
+        check(b"\x08\x01\x2b\x2c"),
+        Err((3, MissingRequired { number: 6 }))
+    );
+    assert_eq!(
+        check(b"\x08\x01\x22\x03abc"),
+        Err((2, InvalidPackedField { number: 4 }))
+    );
+    // Like the parser, only proto3 strings are checked for valid UTF-8.
+    assert_eq!(check(b"\x08\x01\x12\x01\xff"), Ok(()));
+    assert_eq!(
+        wire::validate_wire(b"\x0a\x03ab\xff", text).map_err(|e| (e.offset, e.kind)),
+        Err((2, InvalidUtf8 { number: 1 }))
+    );
+    assert_eq!(check(b"\x08\x01\x12\x05ab"), Err((4, Truncated)));
+    assert_eq!(check(b"\x08\x01\x2b\x30\x03"), Err((5, Truncated)));
+    assert_eq!(
+        check(b"\x08\x01\x2b\x30\x03\x34"),
+        Err((5, UnmatchedEndGroup))
+    );
+    assert_eq!(check(b"\x00"), Err((0, InvalidTag)));
+    assert_eq!(
+        check(b"\x08\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"),
+        Err((1, InvalidVarint))
+    );
+    assert_eq!(check(&[0x4b; 101]), Err((100, TooDeep)));
+    // A field with an unexpected wire type is an unknown field.
+    assert_eq!(check(b"\x08\x01\x15\x00\x00\x00\x00"), Ok(()));
+
+    let err: ValidationError = validator.validate(b"\x00").unwrap_err();
+    assert_eq!(err.to_string(), "invalid tag at offset 0");
+    Ok(())
+}
+
+#[test]
+fn test_parse_error() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto2";
+
+message Test {
+    required int32 id = 1;
+    optional bytes data = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new();
+    let mut parse = |data: &[u8]| {
+        message
+            .as_mut()
+            .parse_from_bytes_detailed(data)
+            .map_err(|e| (e.kind, e.offset, e.number))
+    };
+
+    use ParseErrorKind::*;
+    assert_eq!(parse(b"\x08\x01\x12\x02hi"), Ok(()));
+    assert_eq!(parse(b"\x12\x02hi"), Err((MissingRequired, 4, 0)));
+    assert_eq!(parse(b"\x08\x01\x12\x05hi"), Err((Truncated, 4, 2)));
+    assert_eq!(parse(b"\x08\x01\x00"), Err((InvalidTag, 2, 0)));
+    assert_eq!(
+        parse(b"\x08\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"),
+        Err((InvalidVarint, 1, 1))
+    );
+    assert_eq!(
+        parse(b"\x08\x01\x1b\x08\x01\x24"),
+        Err((UnmatchedEndGroup, 5, 3))
+    );
+
+    let err: ParseError = message
+        .as_mut()
+        .parse_from_bytes_detailed(b"\x08\x01\x12\x05hi")
+        .unwrap_err();
+    assert_eq!(err.to_string(), "truncated message at offset 4 in field 2");
+    Ok(())
+}
+
+#[test]
+fn test_incremental_parser() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let data = b"\x0a\x02hi\x0a\x03bye";
+    for chunk_size in 1..data.len() {
+        let mut message = prototype.new_message();
+        let mut parser = IncrementalParser::new(message.as_mut());
+        for chunk in data.chunks(chunk_size) {
+            parser.feed(chunk)?;
+            assert!(parser.buffered() < 5);
+        }
+        assert_eq!(parser.position(), data.len());
+        parser.finish()?;
+        assert_eq!(message.serialize()?, b"\x0a\x03bye");
+    }
+
+    // Input that ends within a field is incomplete.
+    let mut message = prototype.new_message();
+    let mut parser = IncrementalParser::new(message.as_mut());
+    parser.feed(&data[..6])?;
+    assert_eq!(parser.buffered(), 2);
+    assert!(parser.finish().is_err());
+
+    let mut parser = IncrementalParser::new(message.as_mut());
+    assert!(parser.feed(b"\x0c").is_err());
+    Ok(())
+}
+
+#[test]
+fn test_json() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+    message.as_mut().parse_from_bytes(b"\x0a\x02hi")?;
+
+    let json = json::message_to_json(&*message, &PrintOptions::default())?;
+    assert_eq!(json, r#"{"s":"hi"}"#);
+    let pretty = PrintOptions {
+        add_whitespace: true,
+        ..Default::default()
+    };
+    let pretty = json::message_to_json(&*message, &pretty)?;
+    assert!(pretty.contains('\n'));
+    assert_eq!(pretty.split_whitespace().collect::<String>(), json);
+
+    let mut parsed = message.new_message();
+    json::json_to_message(r#"{"s":"bye"}"#, parsed.as_mut(), &ParseOptions::default())?;
+    assert_eq!(parsed.serialize()?, b"\x0a\x03bye");
+    let err = json::json_to_message(r#"{"t":1}"#, parsed.as_mut(), &ParseOptions::default());
+    assert!(err.is_err());
+    let ignore_unknown = ParseOptions {
+        ignore_unknown_fields: true,
+        ..Default::default()
+    };
+    json::json_to_message(r#"{"t":1}"#, parsed.as_mut(), &ignore_unknown)?;
+
+    let resolver = TypeResolver::new(&pool);
+    let type_url = "type.googleapis.com/Test";
+    assert_eq!(
+        json::binary_to_json(&resolver, type_url, b"\x0a\x02hi", &PrintOptions::default())?,
+        json
+    );
+    assert_eq!(
+        json::json_to_binary(&resolver, type_url, &json, &ParseOptions::default())?,
+        b"\x0a\x02hi"
+    );
+    let res = json::binary_to_json(
+        &resolver,
+        "type.googleapis.com/Missing",
+        b"",
+        &PrintOptions::default(),
+    );
+    assert!(res.is_err());
+    Ok(())
+}
+
+#[test]
+fn test_json_stream() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let resolver = TypeResolver::new(&pool);
+    let type_url = "type.googleapis.com/Test";
+
+    let binary = b"\x0a\x02hi";
+    let mut json = vec![];
+    json::binary_to_json_stream(
+        &resolver,
+        type_url,
+        SliceInputStream::new(binary).as_mut(),
+        VecOutputStream::new(&mut json).as_mut(),
+        &PrintOptions::default(),
+    )?;
+    assert_eq!(json, br#"{"s":"hi"}"#);
+
+    let mut out = vec![];
+    json::json_to_binary_stream(
+        &resolver,
+        type_url,
+        SliceInputStream::new(&json).as_mut(),
+        VecOutputStream::new(&mut out).as_mut(),
+        &ParseOptions::default(),
+    )?;
+    assert_eq!(out, binary);
+
+    let res = json::json_to_binary_stream(
+        &resolver,
+        type_url,
+        SliceInputStream::new(b"{").as_mut(),
+        VecOutputStream::new(&mut vec![]).as_mut(),
+        &ParseOptions::default(),
+    );
+    assert!(res.is_err());
+    Ok(())
+}
+
+#[test]
+fn test_text_format() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+
+    let printer = Printer::new();
+    let text = printer.print_to_string(&*fds)?;
+    assert!(text.contains(r#"name: "test.proto""#));
+    let mut out = vec![];
+    printer.print(&*fds, VecOutputStream::new(&mut out).as_mut())?;
+    assert_eq!(out, text.as_bytes());
+
+    let mut single_line = Printer::new();
+    single_line.as_mut().set_single_line_mode(true);
+    assert!(!single_line
+        .print_to_string(&*fds)?
+        .trim_end()
+        .contains('\n'));
+
+    let mut parser = Parser::new();
+    let mut parsed = fds.new();
+    parser
+        .as_mut()
+        .parse(SliceInputStream::new(&out).as_mut(), parsed.as_mut())?;
+    assert_eq!(parsed.serialize()?, fds.serialize()?);
+    parser
+        .as_mut()
+        .merge_from_str(r#"file { name: "other.proto" }"#, parsed.as_mut())?;
+    assert_eq!(parsed.file_size(), 2);
+    parser
+        .as_mut()
+        .parse_from_str(r#"file { name: "other.proto" }"#, parsed.as_mut())?;
+    assert_eq!(parsed.file_size(), 1);
+
+    let err = parser
+        .as_mut()
+        .parse_from_str("file { nonexistent: 1 }", parsed.as_mut())
+        .unwrap_err();
+    assert!(err.to_string().starts_with("1:"), "{}", err);
+    parser.as_mut().allow_unknown_field(true);
+    parser
+        .as_mut()
+        .parse_from_str("file { nonexistent: 1 }", parsed.as_mut())?;
+    Ok(())
+}
+
+#[test]
+fn test_message_differencer() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut copy = fds.new();
+    copy.as_mut().merge_from_bytes(&fds.serialize()?)?;
+    let mut other = fds.new();
+    other.as_mut().merge_from_bytes(&fds.serialize()?)?;
+    Parser::new()
+        .as_mut()
+        .merge_from_str(r#"file { name: "other.proto" }"#, other.as_mut())?;
+
+    let mut differencer = MessageDifferencer::new();
+    assert!(differencer.as_mut().equals(&*fds, &*copy));
+    assert!(!differencer.as_mut().equals(&*fds, &*other));
+    assert_eq!(differencer.as_mut().compare(&*fds, &*copy), None);
+    let report = differencer.as_mut().compare(&*fds, &*other).unwrap();
+    assert!(report.contains("other.proto"), "{}", report);
+
+    differencer.as_mut().set_compare_serialized_first(true);
+    assert!(differencer.as_mut().equals(&*fds, &*copy));
+    assert!(!differencer.as_mut().equals(&*fds, &*other));
+
+    differencer.as_mut().set_scope(Scope::Partial);
+    assert!(differencer.as_mut().equals(&*fds.new(), &*other));
+    assert!(!differencer.as_mut().equals(&*other, &*fds.new()));
+    Ok(())
+}
+
+#[test]
+fn test_hash_message() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut copy = fds.new();
+    copy.as_mut().merge_from_bytes(&fds.serialize()?)?;
+    let mut other = fds.new();
+    Parser::new()
+        .as_mut()
+        .merge_from_str(r#"file { name: "other.proto" }"#, other.as_mut())?;
+
+    let hash = util::hash_message(&*fds, 0);
+    assert_eq!(util::hash_message(&*copy, 0), hash);
+    assert_ne!(util::hash_message(&*copy, 1), hash);
+    assert_ne!(util::hash_message(&*other, 0), hash);
+
+    // Field 99 is not a field of FileDescriptorSet.
+    copy.as_mut().merge_from_bytes(b"\x98\x06\x01")?;
+    assert_ne!(util::hash_message(&*copy, 0), hash);
+    let ignore_unknown = HashOptions {
+        ignore_unknown_fields: true,
+    };
+    assert_eq!(
+        util::hash_message_with_options(&*copy, 0, &ignore_unknown),
+        util::hash_message_with_options(&*fds, 0, &ignore_unknown)
+    );
+    Ok(())
+}
+
+#[test]
+fn test_required_field_checker() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto2";
+
+message Leaf {
+    required int32 r = 1;
+}
+
+message Free {
+    optional int32 x = 1;
+    optional Free next = 2;
+}
+
+message Root {
+    optional Free free = 1;
+    repeated Leaf leaves = 2;
+    optional Root child = 3;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Root").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+    let checker = RequiredFieldChecker::new(descriptor);
+
+    assert!(checker.is_initialized(&*message)?);
+    message
+        .as_mut()
+        .parse_partial_from_bytes(b"\x0a\x02\x08\x01\x12\x02\x08\x01")?;
+    assert!(message.is_initialized());
+    assert!(checker.is_initialized(&*message)?);
+    // A leaf without its required field, nested in a child.
+    message
+        .as_mut()
+        .merge_partial_from_bytes(b"\x1a\x02\x12\x00")?;
+    assert!(!message.is_initialized());
+    assert!(!checker.is_initialized(&*message)?);
+
+    // Messages of other types are rejected.
+    let free = pool.find_message_type_by_name("Free").unwrap();
+    let free = factory.as_mut().get_prototype(free).new_message();
+    assert!(checker.is_initialized(&*free).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_compiled_field_mask() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let mut source = prototype.new_message();
+    source.as_mut().merge_from_bytes(b"\x0a\x03bye")?;
+
+    let mut mask = FieldMask::new();
+    mask.as_mut().add_path("s");
+    let compiled = mask.compile(descriptor)?;
+    let mut destination = prototype.new_message();
+    destination.as_mut().merge_from_bytes(b"\x0a\x02hi")?;
+    compiled.merge_message_to(&*source, destination.as_mut(), &MergeOptions::default())?;
+    assert_eq!(destination.serialize()?, b"\x0a\x03bye");
+    // A selected field that is not set in the source is cleared.
+    compiled.merge_message_to(&*prototype, destination.as_mut(), &MergeOptions::default())?;
+    assert_eq!(destination.serialize()?, b"");
+
+    let mut parsed = prototype.new_message();
+    compiled.merge_from_bytes(parsed.as_mut(), b"\x0a\x02hi\x10\x01")?;
+    assert_eq!(parsed.serialize()?, b"\x0a\x02hi");
+    assert!(!compiled.trim_message(parsed.as_mut())?);
+    let empty = FieldMask::new().compile(descriptor)?;
+    assert!(empty.trim_message(parsed.as_mut())?);
+    assert_eq!(parsed.serialize()?, b"");
+
+    // Messages of other types are rejected.
+    assert!(compiled.trim_message(fds.new().as_mut()).is_err());
+    mask.as_mut().add_path("missing");
+    assert!(mask.compile(descriptor).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_time_util() -> Result<(), Box<dyn Error>> {
+    let timestamps = [
+        Timestamp {
+            seconds: 0,
+            nanos: 0,
+        },
+        Timestamp {
+            seconds: -1,
+            nanos: 500_000_000,
+        },
+        Timestamp {
+            seconds: 63_081_620,
+            nanos: 21_000_000,
+        },
+    ];
+    let mut nanos = [0; 3];
+    time_util::timestamps_to_nanos(&timestamps, &mut nanos)?;
+    assert_eq!(nanos, [0, -500_000_000, 63_081_620_021_000_000]);
+    let mut roundtrip = [Timestamp::default(); 3];
+    time_util::nanos_to_timestamps(&nanos, &mut roundtrip);
+    assert_eq!(roundtrip, timestamps);
+
+    let durations = [
+        Duration {
+            seconds: -1,
+            nanos: -500_000_000,
+        },
+        Duration {
+            seconds: 2,
+            nanos: 1,
+        },
+    ];
+    let mut nanos = [0; 2];
+    time_util::durations_to_nanos(&durations, &mut nanos)?;
+    assert_eq!(nanos, [-1_500_000_000, 2_000_000_001]);
+    let mut roundtrip = [Duration::default(); 2];
+    time_util::nanos_to_durations(&nanos, &mut roundtrip);
+    assert_eq!(roundtrip, durations);
+
+    // Invalid and unrepresentable values are rejected.
+    let mut nanos = [0; 1];
+    let invalid = Timestamp {
+        seconds: 0,
+        nanos: -1,
+    };
+    assert!(time_util::timestamps_to_nanos(&[invalid], &mut nanos).is_err());
+    let overflow = Timestamp {
+        seconds: 253_402_300_799,
+        nanos: 0,
+    };
+    assert!(time_util::timestamps_to_nanos(&[overflow], &mut nanos).is_err());
+    let mixed_signs = Duration {
+        seconds: 1,
+        nanos: -1,
+    };
+    assert!(time_util::durations_to_nanos(&[mixed_signs], &mut nanos).is_err());
+
+    let mut s = String::new();
+    for timestamp in &timestamps {
+        time_util::format_timestamp(timestamp, &mut s)?;
+        s.push(' ');
+    }
+    time_util::format_timestamp(&overflow, &mut s)?;
+    assert_eq!(
+        s,
+        "1970-01-01T00:00:00Z 1969-12-31T23:59:59.500Z 1972-01-01T02:40:20.021Z \
+         9999-12-31T23:59:59Z"
+    );
+    assert!(time_util::format_timestamp(&invalid, &mut s).is_err());
+    Ok(())
+}
+
+#[cfg(feature = "arenaz")]
+#[test]
+fn test_arenaz() {
+    use protobuf_native::arenaz;
+
+    arenaz::set_sample_rate(1);
+    let arenas: Vec<_> = (0..100).map(|_| Arena::new()).collect();
+    let stats = arenaz::collect_stats();
+    assert!(!stats.is_empty());
+    assert!(stats.iter().all(|s| s
+        .block_histogram
+        .windows(2)
+        .all(|w| w[0].max_block_size < w[1].min_block_size)));
+    drop(arenas);
+}
+
+#[test]
+fn test_lazy_view() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("envelope.proto"),
+        br#"
+syntax = "proto3";
+
+message Payload {
+    string s = 1;
+}
+
+message Envelope {
+    int32 kind = 1;
+    Payload payload = 2;
+    repeated Payload items = 3;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("envelope.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let envelope = pool.find_message_type_by_name("Envelope").unwrap();
+    let payload = pool.find_message_type_by_name("Payload").unwrap();
+    let view = envelope.lazy_view()?;
+    let lazy = view.descriptor();
+    assert_eq!(lazy.name(), b"Envelope");
+    assert_eq!(lazy.field(0).field_type(), FieldType::Int32);
+    assert_eq!(lazy.field(1).field_type(), FieldType::Bytes);
+    assert_eq!(lazy.field(2).field_type(), FieldType::Bytes);
+
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(lazy).new_message();
+    let data = b"\x08\x01\x12\x03\x0a\x01a\x1a\x00\x1a\x03\x0a\x01b";
+    message.as_mut().parse_from_bytes(data)?;
+    assert_eq!(message.serialize()?, data);
+    // An empty submessage is still present after a round trip.
+    message.as_mut().parse_from_bytes(b"\x12\x00")?;
+    assert_eq!(message.serialize()?, b"\x12\x00");
+
+    message.as_mut().parse_from_bytes(data)?;
+    let mut output = factory.as_mut().get_prototype(payload).new_message();
+    view.parse_field(&*message, lazy.field(1), output.as_mut())?;
+    assert_eq!(output.serialize()?, b"\x0a\x01a");
+    view.parse_repeated_field(&*message, lazy.field(2), 1, output.as_mut())?;
+    assert_eq!(output.serialize()?, b"\x0a\x01b");
+    assert!(view
+        .parse_repeated_field(&*message, lazy.field(2), 2, output.as_mut())
+        .is_err());
+    assert!(view
+        .parse_field(&*message, lazy.field(0), output.as_mut())
+        .is_err());
+
+    // Malformed submessages are only detected when they are parsed.
+    message.as_mut().parse_from_bytes(b"\x12\x01\xff")?;
+    assert!(view
+        .parse_field(&*message, lazy.field(1), output.as_mut())
+        .is_err());
+    Ok(())
+}
+
+#[test]
+fn test_unknown_field_handling() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let data = b"\x10\x01\x0a\x02hi\x1a\x01x\x25\x01\x02\x03\x04";
+
+    let mut message = prototype.new_message();
+    message
+        .as_mut()
+        .merge_from_bytes_discarding_unknown_fields(data)?;
+    assert_eq!(message.serialize()?, b"\x0a\x02hi");
+
+    let mut message = prototype.new_message();
+    let mut unknown = b"prefix".to_vec();
+    message
+        .as_mut()
+        .merge_from_bytes_with_raw_unknown_fields(data, &mut unknown)?;
+    assert_eq!(message.serialize()?, b"\x0a\x02hi");
+    assert_eq!(unknown, b"prefix\x10\x01\x1a\x01x\x25\x01\x02\x03\x04");
+
+    assert!(message
+        .as_mut()
+        .merge_from_bytes_discarding_unknown_fields(b"\x1a\x05x")
+        .is_err());
+    Ok(())
+}
+
+#[test]
+fn test_string_field() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+    let field = descriptor.field(0);
+    assert_eq!(message.string_field(field)?, b"");
+    message.as_mut().parse_from_bytes(b"\x0a\x05hello")?;
+    assert_eq!(message.string_field(field)?, b"hello");
+    assert!(message.repeated_string_field(field, 0).is_err());
+    assert!(fds.new().string_field(field).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_repeated_field_slices() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto3";
+
+enum E { ZERO = 0; }
+
+message Test {
+    repeated sint32 ints = 1;
+    repeated double doubles = 2;
+    repeated string strings = 3;
+    repeated E enums = 4;
+    int32 single = 5;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let field = |name| descriptor.find_field_by_name(name).unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+
+    assert_eq!(
+        message.repeated_scalar_field(field("ints"))?,
+        RepeatedScalars::Int32(&[])
+    );
+    assert_eq!(
+        message.repeated_string_field_iter(field("strings"))?.len(),
+        0
+    );
+
+    message.as_mut().parse_from_bytes(
+        b"\x0a\x03\x02\x03\x04\x12\x08\x00\x00\x00\x00\x00\x00\xf0\x3f\x1a\x01a\x1a\x00\x1a\x02bc",
+    )?;
+    assert_eq!(
+        message.repeated_scalar_field(field("ints"))?,
+        RepeatedScalars::Int32(&[1, -2, 2])
+    );
+    assert_eq!(
+        message.repeated_scalar_field(field("doubles"))?,
+        RepeatedScalars::Double(&[1.0])
+    );
+    let strings: Vec<&[u8]> = message
+        .repeated_string_field_iter(field("strings"))?
+        .collect();
+    assert_eq!(strings, [&b"a"[..], b"", b"bc"]);
+
+    match message.as_mut().repeated_scalar_field_mut(field("ints"))? {
+        RepeatedScalarsMut::Int32(ints) => ints.iter_mut().for_each(|i| *i *= 10),
+        other => panic!("unexpected variant: {:?}", other),
+    }
+    assert_eq!(
+        message.repeated_scalar_field(field("ints"))?,
+        RepeatedScalars::Int32(&[10, -20, 20])
+    );
+
+    assert!(message.repeated_scalar_field(field("strings")).is_err());
+    assert_eq!(
+        message.repeated_scalar_field(field("enums"))?,
+        RepeatedScalars::Int32(&[])
+    );
+    assert!(message.repeated_scalar_field(field("single")).is_err());
+    assert!(message.repeated_string_field_iter(field("ints")).is_err());
+    assert!(fds.new().repeated_scalar_field(field("ints")).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_field_walker() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto3";
+
+enum E { ZERO = 0; ONE = 1; }
+
+message Inner {
+    uint64 x = 1;
+}
+
+message Test {
+    int32 a = 1;
+    string s = 2;
+    Inner inner = 3;
+    repeated Inner inners = 4;
+    repeated sint32 ints = 5;
+    E e = 6;
+    double unset = 7;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+    message.as_mut().parse_from_bytes(
+        b"\x08\x07\x12\x02hi\x1a\x02\x08\x05\x22\x02\x08\x01\x22\x00\x2a\x01\x01\x30\x01",
+    )?;
+
+    struct Log {
+        entries: Vec<String>,
+        descend: bool,
+    }
+
+    impl FieldVisitor for Log {
+        fn visit(&mut self, field: &FieldDescriptor, value: FieldValue<'_>) -> bool {
+            let value = match value {
+                FieldValue::Int32(v) => v.to_string(),
+                FieldValue::UInt64(v) => v.to_string(),
+                FieldValue::Enum(v) => format!("enum {}", v),
+                FieldValue::Bytes(v) => String::from_utf8_lossy(v).into_owned(),
+                FieldValue::Message(_) => "message".into(),
+                FieldValue::RepeatedScalars(RepeatedScalars::Int32(v)) => format!("{:?}", v),
+                FieldValue::RepeatedMessages(v) => format!("{} messages", v.len()),
+                _ => panic!("unexpected value"),
+            };
+            let name = String::from_utf8_lossy(field.name());
+            self.entries.push(format!("{}: {}", name, value));
+            self.descend
+        }
+    }
+
+    let mut walker = FieldWalker::new();
+    let mut log = Log {
+        entries: vec![],
+        descend: true,
+    };
+    walker.walk(&*message, &mut log);
+    assert_eq!(
+        log.entries,
+        [
+            "a: 7",
+            "s: hi",
+            "inner: message",
+            "x: 5",
+            "inners: 2 messages",
+            "x: 1",
+            "ints: [-1]",
+            "e: enum 1",
+        ]
+    );
+
+    let mut log = Log {
+        entries: vec![],
+        descend: false,
+    };
+    walker.walk(&*message, &mut log);
+    assert_eq!(
+        log.entries,
+        [
+            "a: 7",
+            "s: hi",
+            "inner: message",
+            "inners: 2 messages",
+            "ints: [-1]",
+            "e: enum 1",
+        ]
+    );
+    Ok(())
+}
+
+#[test]
+fn test_frozen_message() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto3";
+
+message Test {
+    int32 a = 1;
+    Test child = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let mut child = prototype.new_message();
+    child.as_mut().parse_from_bytes(b"\x08\x05")?;
+    let frozen = FrozenMessage::freeze(child)?;
+    assert_eq!(frozen.encoded(), b"\x08\x05");
+    assert_eq!(&*frozen.shared(), b"\x08\x05");
+    assert_eq!(frozen.message().serialize()?, b"\x08\x05");
+
+    let mut encoded = b"\x08\x01".to_vec();
+    frozen.append_as_field(2, &mut encoded);
+    let mut parent = prototype.new_message();
+    parent.as_mut().parse_from_bytes(&encoded)?;
+    assert_eq!(parent.serialize()?, b"\x08\x01\x12\x02\x08\x05");
+
+    let child = frozen.thaw();
+    assert_eq!(child.serialize()?, b"\x08\x05");
+    Ok(())
+}
+
+#[test]
+fn test_merge_from_bytes_aliasing() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("blob.proto"),
+        br#"
+syntax = "proto3";
+
+message Blob {
+    string name = 1;
+    bytes data = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("blob.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Blob").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+
+    let data = b"\x12\x03abc\x0a\x01n\x12\x02de";
+    let aliased = message
+        .as_mut()
+        .merge_from_bytes_aliasing(data, &[descriptor.field(1)])?;
+    assert_eq!(
+        aliased
+            .iter()
+            .map(|f| (f.number, f.value))
+            .collect::<Vec<_>>(),
+        &[(2, &data[2..5]), (2, &data[10..12])]
+    );
+    assert_eq!(message.serialize()?, b"\x0a\x01n");
+
+    assert!(message
+        .as_mut()
+        .merge_from_bytes_aliasing(data, &[descriptor.field(0)])
+        .is_err());
+    assert!(message
+        .as_mut()
+        .merge_from_bytes_aliasing(b"\x12\x05ab", &[descriptor.field(1)])
+        .is_err());
+    Ok(())
+}
+
+#[test]
+fn test_serialize_parallel() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("snapshot.proto"),
+        br#"
+syntax = "proto3";
+
+message Snapshot {
+    repeated Row rows = 1;
+    string name = 2;
+}
+
+message Row {
+    int32 id = 1;
+    string value = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("snapshot.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Snapshot").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let mut data = vec![];
+    for i in 0..1000u32 {
+        let value = "x".repeat((i % 7 + 1) as usize);
+        let row_len = 2 + 2 + value.len();
+        data.extend([
+            0x0a,
+            row_len as u8,
+            0x08,
+            (i % 127 + 1) as u8,
+            0x12,
+            value.len() as u8,
+        ]);
+        data.extend(value.as_bytes());
+    }
+    data.extend(b"\x12\x04snap");
+    let mut message = prototype.new_message();
+    message.as_mut().merge_from_bytes(&data)?;
+
+    for threads in [1, 3, 8] {
+        let output = message.serialize_parallel(descriptor.field(0), threads)?;
+        assert_eq!(output.len(), data.len());
+        // The other fields are emitted before the parallel field.
+        assert!(output.starts_with(b"\x12\x04snap"));
+        let mut parsed = prototype.new_message();
+        parsed.as_mut().merge_from_bytes(&output)?;
+        assert_eq!(parsed.serialize()?, data);
+        assert_eq!(
+            message.serialize_parallel_deterministic(descriptor.field(0), threads)?,
+            output
+        );
+    }
+
+    let empty = prototype.new_message();
+    assert!(empty.serialize_parallel(descriptor.field(0), 4)?.is_empty());
+    assert!(message.serialize_parallel(descriptor.field(1), 4).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_serialize_chunks() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("snapshot.proto"),
+        br#"
+syntax = "proto3";
+
+message Snapshot {
+    repeated Row rows = 1;
+    string name = 2;
+}
+
+message Row {
+    int32 id = 1;
+    string value = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("snapshot.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Snapshot").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let mut data = vec![];
+    for i in 0..100u8 {
+        data.extend([0x0a, 0x06, 0x08, i + 1, 0x12, 0x02, b'a' + i % 26, b'z']);
+    }
+    // The name, and an unknown field.
+    data.extend(b"\x12\x04snap\x48\x01");
+    let mut message = prototype.new_message();
+    message.as_mut().merge_from_bytes(&data)?;
+
+    for chunk_len in [1, 7, 64, 4096] {
+        let chunks = message
+            .serialize_chunks(chunk_len)?
+            .collect::<Result<Vec<_>, _>>()?;
+        let (last, rest) = chunks.split_last().unwrap();
+        assert!(rest.iter().all(|chunk| chunk.len() == chunk_len));
+        assert!(!last.is_empty() && last.len() <= chunk_len);
+        assert_eq!(chunks.concat(), data);
+        let chunks = message.serialize_chunks_deterministic(chunk_len)?;
+        assert_eq!(chunks.collect::<Result<Vec<_>, _>>()?.concat(), data);
+    }
+
+    let empty = prototype.new_message();
+    assert_eq!(empty.serialize_chunks(16)?.count(), 0);
+    Ok(())
+}
+
+#[test]
+fn test_merge_from_bytes_parallel() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("snapshot.proto"),
+        br#"
+syntax = "proto3";
+
+message Snapshot {
+    repeated Row rows = 1;
+    repeated string tags = 2;
+}
+
+message Row {
+    int32 id = 1;
+    string value = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("snapshot.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Snapshot").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+
+    let mut data = vec![];
+    for i in 0..1000u32 {
+        if i % 100 == 0 {
+            data.extend(b"\x12\x03tag");
+        }
+        let row_len = 2 + 2 + (i % 5) as usize;
+        data.extend([0x0a, row_len as u8, 0x08, (i % 127 + 1) as u8, 0x12]);
+        data.push((i % 5) as u8);
+        data.extend("v".repeat((i % 5) as usize).as_bytes());
+    }
+    let mut expected = prototype.new_message();
+    expected.as_mut().merge_from_bytes(&data)?;
+    let expected = expected.serialize()?;
+
+    for threads in [1, 3, 8] {
+        let mut message = prototype.new_message();
+        message
+            .as_mut()
+            .merge_from_bytes_parallel(&data, descriptor.field(0), threads)?;
+        assert_eq!(message.serialize()?, expected);
+    }
+
+    let mut message = prototype.new_message();
+    assert!(message
+        .as_mut()
+        .merge_from_bytes_parallel(&data, descriptor.field(1), 4)
+        .is_err());
+    assert!(message
+        .as_mut()
+        .merge_from_bytes_parallel(&data[..data.len() - 1], descriptor.field(0), 4)
+        .is_err());
+    assert!(message
+        .as_mut()
+        .merge_from_bytes_parallel(b"\x0a\x02\x08", descriptor.field(0), 4)
+        .is_err());
+    Ok(())
+}
+
+#[test]
+fn test_field_accessor() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("record.proto"),
+        br#"
+syntax = "proto2";
+
+enum Color {
+    RED = 1;
+    BLUE = 2;
+}
+
+message Record {
+    optional int32 id = 1;
+    optional uint32 count = 2;
+    optional float score = 3;
+    optional bool flag = 4;
+    optional string name = 5;
+    optional Color color = 6;
+    repeated int32 values = 7;
+    optional Record child = 8;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("record.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Record").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+
+    let id = descriptor.field(0).accessor()?;
+    let count = descriptor.field(1).accessor()?;
+    let score = descriptor.field(2).accessor()?;
+    let flag = descriptor.field(3).accessor()?;
+    let name = descriptor.field(4).accessor()?;
+    let color = descriptor.field(5).accessor()?;
+    assert!(descriptor.field(6).accessor().is_err());
+    assert!(descriptor.field(7).accessor().is_err());
+
+    assert!(!id.has(&*message)?);
+    assert_eq!(id.get_i64(&*message)?, 0);
+    assert_eq!(color.get_i64(&*message)?, 1);
+    id.set_i64(message.as_mut(), -7)?;
+    count.set_u64(message.as_mut(), 3)?;
+    score.set_f64(message.as_mut(), 0.5)?;
+    flag.set_bool(message.as_mut(), true)?;
+    name.set_bytes(message.as_mut(), b"hi")?;
+    color.set_i64(message.as_mut(), 2)?;
+    assert!(id.has(&*message)?);
+    assert_eq!(id.get_i64(&*message)?, -7);
+    assert_eq!(count.get_u64(&*message)?, 3);
+    assert_eq!(score.get_f64(&*message)?, 0.5);
+    assert!(flag.get_bool(&*message)?);
+    assert_eq!(name.get_bytes(&*message)?, b"hi");
+    assert_eq!(color.get_i64(&*message)?, 2);
+    assert_eq!(
+        message.serialize()?,
+        b"\x08\xf9\xff\xff\xff\xff\xff\xff\xff\xff\x01\x10\x03\x1d\x00\x00\x00\x3f\x20\x01\x2a\x02hi\x30\x02"
+    );
+
+    assert!(id.get_u64(&*message).is_err());
+    assert!(id.set_i64(message.as_mut(), i64::MAX).is_err());
+    assert!(count.set_u64(message.as_mut(), u64::MAX).is_err());
+    assert!(color.set_i64(message.as_mut(), 3).is_err());
+    assert!(name.set_i64(message.as_mut(), 1).is_err());
+    id.clear(message.as_mut())?;
+    assert!(!id.has(&*message)?);
+
+    let other = fds.new();
+    assert!(id.get_i64(&*other).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_field_profiler() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("event.proto"),
+        br#"
+syntax = "proto3";
+
+package profile;
+
+message Event {
+    int32 id = 1;
+    Payload payload = 2;
+    string unused = 3;
+}
+
+message Payload {
+    repeated int64 values = 1;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("event.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("profile.Event").unwrap();
+
+    let mut profiler = FieldProfiler::new(descriptor, 2);
+    for _ in 0..4 {
+        profiler.record(b"\x08\x01\x12\x04\x08\x05\x08\x06\x28\x00")?;
+    }
+    let stats = |full_name: &str, occurrences, bytes| FieldStats {
+        full_name: full_name.into(),
+        occurrences,
+        bytes,
+    };
+    assert_eq!(profiler.messages(), 4);
+    assert_eq!(profiler.samples(), 2);
+    assert_eq!(
+        profiler.stats(),
+        &[
+            stats("profile.Event.id", 2, 4),
+            stats("profile.Event.payload", 2, 12),
+            stats("profile.Event.unused", 0, 0),
+            stats("profile.Payload.values", 4, 8),
+        ]
+    );
+
+    // Only sampled messages are decoded, so only the first of these is
+    // rejected.
+    assert!(profiler.record(b"\x12").is_err());
+    profiler.record(b"\x12")?;
+    assert_eq!(profiler.samples(), 2);
+
+    profiler.as_mut().reset();
+    assert_eq!(profiler.messages(), 0);
+    assert!(profiler.stats().iter().all(|s| s.occurrences == 0));
+    Ok(())
+}
+
+#[test]
+fn test_metrics() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("metered.proto"),
+        br#"
+syntax = "proto3";
+
+package metrics;
+
+message Metered {
+    int32 id = 1;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("metered.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("metrics.Metered").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+
+    // Other tests may be collecting metrics concurrently, so only the
+    // metrics for this test's message type are inspected.
+    let find = || {
+        metrics::snapshot()
+            .into_iter()
+            .find(|m| m.type_name == "metrics.Metered")
+    };
+    message.as_mut().parse_from_bytes(b"\x08\x01")?;
+    assert_eq!(find(), None);
+
+    metrics::set_enabled(true);
+    message.as_mut().parse_from_bytes(b"\x08\x02")?;
+    message.as_mut().merge_from_bytes(b"\x08\x03")?;
+    assert_eq!(message.serialize()?, b"\x08\x03");
+    assert!(message.as_mut().merge_from_bytes(b"\x08").is_err());
+    metrics::set_enabled(false);
+    message.as_mut().parse_from_bytes(b"\x08\x04")?;
+
+    let metered = find().unwrap();
+    assert_eq!(metered.parse.calls, 3);
+    assert_eq!(metered.parse.errors, 1);
+    assert_eq!(metered.parse.bytes, 5);
+    assert_eq!(metered.parse.latency.count(), 3);
+    assert_eq!(
+        metered.parse.latency.counts.len(),
+        LATENCY_BUCKETS.len() + 1
+    );
+    assert_eq!(metered.serialize.calls, 1);
+    assert_eq!(metered.serialize.errors, 0);
+    assert_eq!(metered.serialize.bytes, 2);
+    Ok(())
+}
+
+#[test]
+fn test_sample_capture_replay() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::record::{RecordReader, RecordWriter, RecordWriterOptions};
+
+    let fds = build_file_descriptor_set(&[(
+        "sampled.proto",
+        r#"
+syntax = "proto3";
+
+package sample;
+
+message Sampled {
+    int32 id = 1;
+    string name = 2;
+}
+"#,
+    )])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("sample.Sampled").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut message = factory.as_mut().get_prototype(descriptor).new_message();
+
+    // Other tests may be parsing and serializing concurrently, so only this
+    // test's message type is captured.
+    let writer = RecordWriter::new(vec![], RecordWriterOptions::default())?;
+    let capture = Capture::start(
+        writer,
+        CaptureOptions {
+            sample_rate: 1,
+            max_samples_per_type: 3,
+            types: vec!["sample.Sampled".into()],
+            ..Default::default()
+        },
+    )?;
+    // Only one capture may be active at a time.
+    let writer = RecordWriter::new(vec![], RecordWriterOptions::default())?;
+    assert!(Capture::start(writer, CaptureOptions::default()).is_err());
+
+    // Failed calls are not captured.
+    assert!(message.as_mut().parse_from_bytes(b"\x08").is_err());
+    message.as_mut().parse_from_bytes(b"\x08\x01")?;
+    message.as_mut().merge_from_bytes(b"\x12\x02hi")?;
+    assert_eq!(message.serialize()?, b"\x08\x01\x12\x02hi");
+    // The type has reached its limit.
+    message.as_mut().parse_from_bytes(b"\x08\x02")?;
+    assert_eq!(capture.sample_count(), 3);
+    let file = capture.finish()?;
+    // Once the capture has finished, another may start.
+    let writer = RecordWriter::new(vec![], RecordWriterOptions::default())?;
+    drop(Capture::start(writer, CaptureOptions::default())?);
+
+    let reader = RecordReader::new(&file)?;
+    assert!(reader.blocks()[0].may_contain_key(b"sample.Sampled"));
+    let samples = sample::load(&reader)?;
+    assert_eq!(
+        samples,
+        [TypeSamples {
+            type_url: "type.googleapis.com/sample.Sampled".into(),
+            samples: vec![
+                b"\x08\x01".to_vec(),
+                b"\x12\x02hi".to_vec(),
+                b"\x08\x01\x12\x02hi".to_vec(),
+            ],
+        }]
+    );
+    assert_eq!(samples[0].bytes(), 12);
+
+    let resolver = AnyResolver::new(&pool);
+    let reports = sample::replay(
+        &samples,
+        &resolver,
+        &ReplayOptions {
+            iterations: 2,
+            json: true,
+        },
+    )?;
+    assert_eq!(reports.len(), 1);
+    assert_eq!(reports[0].type_url, samples[0].type_url);
+    assert_eq!(reports[0].samples, 3);
+    assert_eq!(reports[0].bytes, 12);
+    assert!(reports[0].json.is_some());
+
+    // Samples of types that the pool does not know cannot be replayed.
+    let unknown = [TypeSamples {
+        type_url: "type.googleapis.com/sample.Unknown".into(),
+        samples: vec![vec![]],
+    }];
+    assert!(sample::replay(&unknown, &resolver, &ReplayOptions::default()).is_err());
+    Ok(())
+}
+
+#[cfg(feature = "tracing")]
+#[test]
+fn test_tracing() -> Result<(), Box<dyn Error>> {
+    use std::fmt::{self, Write as _};
+    use std::sync::Mutex;
+
+    use tracing::field::{Field, Visit};
+    use tracing::span::{Attributes, Id, Record};
+    use tracing::{Event, Metadata, Subscriber};
+
+    /// Records each span as its name followed by its fields, in the order in
+    /// which they were recorded.
+    #[derive(Clone, Default)]
+    struct SpanRecorder(Arc<Mutex<Vec<String>>>);
+
+    struct FieldWriter<'a>(&'a mut String);
+
+    impl Visit for FieldWriter<'_> {
+        fn record_debug(&mut self, field: &Field, value: &dyn fmt::Debug) {
+            write!(self.0, " {}={:?}", field.name(), value).unwrap();
+        }
+    }
+
+    impl Subscriber for SpanRecorder {
+        fn enabled(&self, _: &Metadata) -> bool {
+            true
+        }
+
+        fn new_span(&self, attrs: &Attributes) -> Id {
+            let mut spans = self.0.lock().unwrap();
+            spans.push(attrs.metadata().name().into());
+            Id::from_u64(spans.len() as u64)
+        }
+
+        fn record(&self, id: &Id, values: &Record) {
+            let mut spans = self.0.lock().unwrap();
+            values.record(&mut FieldWriter(&mut spans[id.into_u64() as usize - 1]));
+        }
+
+        fn record_follows_from(&self, _: &Id, _: &Id) {}
+        fn event(&self, _: &Event) {}
+        fn enter(&self, _: &Id) {}
+        fn exit(&self, _: &Id) {}
+    }
+
+    let recorder = SpanRecorder::default();
+    let data = tracing::subscriber::with_default(recorder.clone(), || {
+        let fds = simple_file_descriptor_set()?;
+        let data = fds.file(0).serialize()?;
+        let mut proto = FileDescriptorProto::new();
+        proto.as_mut().parse_from_bytes(&data)?;
+        assert!(proto.as_mut().parse_from_bytes(b"\x0a").is_err());
+        let mut pool = DescriptorPool::new();
+        pool.as_mut().build_file(fds.file(0));
+        Ok::<_, OperationFailedError>(data)
+    })?;
+
+    let message_type = "message_type=\"google.protobuf.FileDescriptorProto\"";
+    let len = data.len();
+    assert_eq!(
+        *recorder.0.lock().unwrap(),
+        [
+            "build_file_descriptor_set roots=1 files=1 ok=true".to_string(),
+            format!("serialize_into {message_type} bytes={len} ok=true"),
+            format!("parse_from_bytes {message_type} bytes={len} ok=true"),
+            format!("parse_from_bytes {message_type} ok=false"),
+            "build_file file=\"test.proto\" ok=true".to_string(),
+        ]
+    );
+    Ok(())
+}
+
+#[cfg(feature = "protoc")]
+#[test]
+fn test_protoc() -> Result<(), Box<dyn Error>> {
+    use std::ffi::OsStr;
+
+    use protobuf_native::protoc::{CodeGenerator, CommandLineInterface, Language};
+
+    let proto = br#"
+syntax = "proto3";
+
+package test;
+
+message Test {
+    string s = 1;
+}
+"#;
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree
+        .as_mut()
+        .add_file(Path::new("test.proto"), proto.to_vec());
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let pool = DescriptorPool::with_database(db.as_mut());
+    let files = [pool.find_file_by_name(Path::new("test.proto")).unwrap()];
+
+    let cpp = CodeGenerator::new(Language::Cpp).generate(&files, "")?;
+    let names: Vec<_> = cpp.iter().map(|file| file.name.as_str()).collect();
+    assert_eq!(names, ["test.pb.cc", "test.pb.h"]);
+    assert!(String::from_utf8_lossy(&cpp[1].contents).contains("class Test final"));
+    let python = CodeGenerator::new(Language::Python).generate(&files, "")?;
+    assert_eq!(python.len(), 1);
+    assert_eq!(python[0].name, "test_pb2.py");
+    assert!(CodeGenerator::new(Language::Cpp)
+        .generate(&files, "bogus_option")
+        .is_err());
+
+    let out_dir = tempfile::tempdir()?;
+    for file in &cpp {
+        file.write_to(&out_dir.path().join("gen"))?;
+    }
+    assert_eq!(
+        fs::read(out_dir.path().join("gen/test.pb.h"))?,
+        cpp[1].contents
+    );
+
+    let proto_dir = tempfile::tempdir()?;
+    fs::write(proto_dir.path().join("test.proto"), proto)?;
+    let mut cli = CommandLineInterface::new();
+    cli.as_mut().run([
+        OsStr::new("--proto_path"),
+        proto_dir.path().as_os_str(),
+        OsStr::new("--python_out"),
+        out_dir.path().as_os_str(),
+        OsStr::new("test.proto"),
+    ])?;
+    let generated = fs::read_to_string(out_dir.path().join("test_pb2.py"))?;
+    assert!(generated.contains("DESCRIPTOR"));
+    assert!(cli.as_mut().run(["--bogus_out=.", "test.proto"]).is_err());
+    Ok(())
+}
+
+#[cfg(feature = "protoc")]
+#[test]
+fn test_protoc_generate_parallel() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::protoc::{self, CodeGenerator, Language};
+
+    let mut source_tree = VirtualSourceTree::new();
+    let names: Vec<_> = (0..8).map(|i| format!("file{i}.proto")).collect();
+    for (i, name) in names.iter().enumerate() {
+        let import = match i {
+            0 => String::new(),
+            _ => format!("import \"file{}.proto\";", i - 1),
+        };
+        let proto =
+            format!("syntax = \"proto2\";\n{import}\nmessage M{i} {{ optional int32 f = 1; }}\n");
+        source_tree
+            .as_mut()
+            .add_file(Path::new(name), proto.into_bytes());
+    }
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let pool = DescriptorPool::with_database(db.as_mut());
+    let files: Vec<_> = names
+        .iter()
+        .map(|name| pool.find_file_by_name(Path::new(name)).unwrap())
+        .collect();
+
+    for language in [Language::Cpp, Language::Java, Language::Python] {
+        let generator = CodeGenerator::new(language);
+        let serial = generator.generate(&files, "")?;
+        for threads in [1, 3, 16] {
+            assert_eq!(generator.generate_parallel(&files, "", threads)?, serial);
+        }
+    }
+    let generator = CodeGenerator::new(Language::Cpp);
+    assert!(generator
+        .generate_parallel(&files, "bogus_option", 4)
+        .is_err());
+    assert!(generator.generate_parallel(&[], "", 4)?.is_empty());
+
+    let generated = generator.generate_parallel(&files, "", 4)?;
+    let out_dir = tempfile::tempdir()?;
+    protoc::write_files(&generated, out_dir.path(), 4)?;
+    for file in &generated {
+        assert_eq!(fs::read(out_dir.path().join(&file.name))?, file.contents);
+    }
+    Ok(())
+}
+
+#[cfg(all(feature = "protoc", feature = "zlib"))]
+#[test]
+fn test_protoc_generate_zip() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::io::VecOutputStream;
+    use protobuf_native::protoc::{CodeGenerator, Language, ZipWriter};
+
+    let mut source_tree = VirtualSourceTree::new();
+    let names: Vec<_> = (0..4).map(|i| format!("file{i}.proto")).collect();
+    for (i, name) in names.iter().enumerate() {
+        let proto = format!("syntax = \"proto2\";\nmessage M{i} {{ optional int32 f = 1; }}\n");
+        source_tree
+            .as_mut()
+            .add_file(Path::new(name), proto.into_bytes());
+    }
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let pool = DescriptorPool::with_database(db.as_mut());
+    let files: Vec<_> = names
+        .iter()
+        .map(|name| pool.find_file_by_name(Path::new(name)).unwrap())
+        .collect();
+    let generator = CodeGenerator::new(Language::Cpp);
+    let expected = generator.generate(&files, "")?;
+
+    let mut archive = vec![];
+    {
+        let mut output = VecOutputStream::new(&mut archive);
+        let mut zip = ZipWriter::new(output.as_mut());
+        generator.generate_zip(&files, "", 3, zip.as_mut())?;
+        zip.as_mut().write("extra.txt", b"extra")?;
+        zip.as_mut().finish()?;
+    }
+
+    // Walk the central directory.
+    let u16_at = |offset: usize| u16::from_le_bytes([archive[offset], archive[offset + 1]]);
+    let u32_at = |offset: usize| {
+        u32::from_le_bytes(archive[offset..offset + 4].try_into().unwrap()) as usize
+    };
+    let end = archive.len() - 22;
+    assert_eq!(u32_at(end), 0x06054b50);
+    let entries = usize::from(u16_at(end + 10));
+    assert_eq!(entries, expected.len() + 1);
+    let mut offset = u32_at(end + 16);
+    let mut names = vec![];
+    for _ in 0..entries {
+        assert_eq!(u32_at(offset), 0x02014b50);
+        let method = u16_at(offset + 10);
+        let compressed_size = u32_at(offset + 20);
+        let size = u32_at(offset + 24);
+        let name_len = usize::from(u16_at(offset + 28));
+        let name = std::str::from_utf8(&archive[offset + 46..offset + 46 + name_len])?;
+        match expected.iter().find(|file| file.name == name) {
+            Some(file) => {
+                assert_eq!(size, file.contents.len());
+                assert_eq!(method, 8);
+                assert!(compressed_size < size);
+            }
+            None => {
+                // Compression cannot shrink tiny files, which are stored.
+                assert_eq!(name, "extra.txt");
+                assert_eq!(method, 0);
+                assert_eq!(compressed_size, 5);
+                let local = u32_at(offset + 42);
+                assert_eq!(u32_at(local), 0x04034b50);
+                let data = local + 30 + name_len;
+                assert_eq!(&archive[data..data + 5], b"extra");
+            }
+        }
+        names.push(name.to_owned());
+        offset += 46 + name_len;
+    }
+    let mut expected_names: Vec<_> = expected.iter().map(|file| file.name.clone()).collect();
+    expected_names.push("extra.txt".into());
+    assert_eq!(names, expected_names);
+
+    let mut output = VecOutputStream::new(&mut archive);
+    let mut zip = ZipWriter::with_compression_level(output.as_mut(), 0);
+    assert!(generator
+        .generate_zip(&files, "bogus_option", 3, zip.as_mut())
+        .is_err());
+    Ok(())
+}
+
+#[cfg(feature = "protoc")]
+#[test]
+fn test_protoc_rust_wrappers() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::protoc::CodeGenerator;
+
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("inner.proto"),
+        br#"
+syntax = "proto2";
+
+package wrappers.inner;
+
+enum Kind {
+    A = 0;
+    B = 1;
+}
+
+message Inner {
+    optional int64 id = 1;
+    optional Kind kind = 2;
+}
+"#
+        .to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("outer.proto"),
+        br#"
+syntax = "proto3";
+
+package wrappers;
+
+import "inner.proto";
+
+message Outer {
+    message Nested {
+        bytes data = 1;
+    }
+    optional string name = 1;
+    inner.Inner inner = 2;
+    repeated uint32 values = 3;
+    repeated Nested nested = 4;
+    map<string, int32> tags = 5;
+    bool type = 6;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let pool = DescriptorPool::with_database(db.as_mut());
+    let files = [
+        pool.find_file_by_name(Path::new("inner.proto")).unwrap(),
+        pool.find_file_by_name(Path::new("outer.proto")).unwrap(),
+    ];
+
+    let generator = CodeGenerator::rust_wrappers();
+    let generated = generator.generate(&files, "")?;
+    let names: Vec<_> = generated.iter().map(|file| file.name.as_str()).collect();
+    assert_eq!(
+        names,
+        [
+            "inner.pb.rs",
+            "inner.pb.rs.cc",
+            "outer.pb.rs",
+            "outer.pb.rs.cc",
+            "protobuf_native.rs"
+        ]
+    );
+    let contents: Vec<_> = generated
+        .iter()
+        .map(|file| String::from_utf8_lossy(&file.contents))
+        .collect();
+    assert!(contents[0].contains("pub struct Inner {"));
+    assert!(contents[0].contains("pub fn set_kind("));
+    assert!(contents[1].contains("#include \"inner.pb.h\""));
+    assert!(contents[1].contains("Kind_IsValid(v)"));
+    assert!(contents[2].contains("pub struct Outer_Nested {"));
+    assert!(contents[2].contains("pub fn has_name(&self) -> bool"));
+    assert!(contents[2].contains("pub fn inner(&self) -> &super::wrappers::inner::Inner"));
+    assert!(contents[2].contains("pub fn values(&self) -> &[u32]"));
+    assert!(contents[2].contains("pub fn nested_len(&self) -> usize"));
+    assert!(contents[2].contains("pub fn r#type(&self) -> bool"));
+    assert!(!contents[2].contains("tags"));
+    assert!(!contents[2].contains("TagsEntry"));
+    assert!(contents[4].contains("pub mod wrappers {"));
+    assert!(contents[4].contains("pub mod inner {"));
+    assert!(contents[4].contains("include!(\"outer.pb.rs\");"));
+
+    // Only the invocation that generates the first file writes the index.
+    assert_eq!(generator.generate_parallel(&files, "", 2)?, generated);
+    assert!(generator.generate(&files, "bogus_option").is_err());
+    Ok(())
+}
+
+#[cfg(feature = "upb")]
+#[test]
+fn test_upb() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::upb::{self, Arena, DefPool};
+
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("inner.proto"),
+        br#"
+syntax = "proto3";
+
+package upbtest;
+
+message Inner {
+    repeated int64 values = 1;
+}
+
+message Tagged {
+    map<string, int64> tags = 1;
+}
+"#
+        .to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("outer.proto"),
+        br#"
+syntax = "proto3";
+
+package upbtest;
+
+import "inner.proto";
+
+message Outer {
+    int32 id = 1;
+    Inner inner = 2;
+    string name = 3;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("outer.proto"), Path::new("inner.proto")])?;
+    let mut pool = DefPool::new();
+    pool.as_mut().add_file_set(&fds)?;
+    // Files that are already in the pool are skipped.
+    pool.as_mut().add_file_set(&fds)?;
+    assert!(pool.find_message_by_name("upbtest.Missing").is_none());
+    let def = pool.find_message_by_name("upbtest.Outer").unwrap();
+    assert_eq!(def.full_name(), "upbtest.Outer");
+
+    let arena = Arena::new();
+    let encoded = b"\x08\x01\x12\x04\x0a\x02\x05\x06";
+    let mut message = upb::Message::parse(def, &arena, encoded)?;
+    assert_eq!(message.serialize()?, encoded);
+    message.merge_from_bytes(encoded)?;
+    assert_eq!(
+        message.serialize_deterministic()?,
+        b"\x08\x01\x12\x06\x0a\x04\x05\x06\x05\x06"
+    );
+    let output = Arena::new();
+    assert_eq!(
+        message.serialize_in(&output)?,
+        b"\x08\x01\x12\x06\x0a\x04\x05\x06\x05\x06"
+    );
+    assert!(arena.space_allocated() > 0);
+    assert!(upb::Message::parse(def, &arena, b"\x12\x04").is_err());
+    assert_eq!(upb::Message::new(def, &arena).serialize()?, b"");
+
+    // Splice a message from another arena into the message, which must keep
+    // that arena's memory alive.
+    let inner_def = pool.find_message_by_name("upbtest.Inner").unwrap();
+    let cache = Arena::new();
+    let inner = upb::Message::parse(inner_def, &cache, b"\x0a\x01\x07")?;
+    assert!(message.set_message("id", &inner).is_err());
+    assert!(message.set_message("missing", &inner).is_err());
+    message.set_message("inner", &inner)?;
+    drop(inner);
+    drop(cache);
+    assert_eq!(message.serialize()?, b"\x08\x01\x12\x03\x0a\x01\x07");
+
+    // An arena with an initial block grows onto the heap once the block is
+    // exhausted, while an arena with a fixed block fails to allocate.
+    let mut large = vec![0x12, 0xeb, 0x07, 0x0a, 0xe8, 0x07];
+    large.extend([0x01; 1000]);
+    let mut block = [MaybeUninit::uninit(); 512];
+    let stack = Arena::with_initial_block(&mut block);
+    assert_eq!(
+        upb::Message::parse(def, &stack, encoded)?.serialize()?,
+        encoded
+    );
+    assert_eq!(
+        upb::Message::parse(def, &stack, &large)?.serialize()?,
+        large
+    );
+    assert!(stack.fuse(&arena).is_err());
+    drop(stack);
+    let fixed = Arena::with_fixed_block(&mut block);
+    assert_eq!(
+        upb::Message::parse(def, &fixed, encoded)?.serialize()?,
+        encoded
+    );
+    assert!(upb::Message::parse(def, &fixed, &large).is_err());
+
+    // An aliased message borrows its strings from the input, while a regular
+    // message copies them.
+    let named = b"\x08\x01\x1a\x05hello".to_vec();
+    let aliased = upb::AliasedMessage::parse(def, &arena, &named)?;
+    let name = aliased.get_bytes("name").unwrap();
+    assert_eq!(name, b"hello");
+    assert_eq!(name.as_ptr(), named[4..].as_ptr());
+    assert_eq!(aliased.serialize()?, named);
+    assert!(aliased.get_bytes("id").is_none());
+    assert!(aliased.get_bytes("missing").is_none());
+    let copied = upb::Message::parse(def, &arena, &named)?;
+    assert_eq!(copied.get_bytes("name").unwrap(), b"hello");
+    assert_ne!(
+        copied.get_bytes("name").unwrap().as_ptr(),
+        named[4..].as_ptr()
+    );
+    assert_eq!(
+        upb::Message::new(def, &arena).get_bytes("name").unwrap(),
+        b""
+    );
+
+    // Delimited records round trip through a reader that replaces its arena
+    // between chunks.
+    let mut records = Vec::new();
+    for data in [&encoded[..], &named[..], &large[..]] {
+        upb::Message::parse(def, &arena, data)?.serialize_delimited_into(&mut records)?;
+    }
+    let mut reader = upb::DelimitedReader::with_chunk_size(def, &records, 2);
+    for data in [&encoded[..], &named[..], &large[..]] {
+        assert_eq!(reader.read_next()?.unwrap().serialize()?, data);
+    }
+    assert!(reader.read_next()?.is_none());
+    assert_eq!(reader.position(), records.len());
+    let mut reader = upb::DelimitedReader::new(def, &records[..records.len() - 1]);
+    reader.read_next()?;
+    reader.read_next()?;
+    assert!(reader.read_next().is_err());
+
+    // A mini schema is enough to round trip messages, submessages included.
+    let mini = def.encode_mini_schema()?;
+    let schema = upb::MiniSchema::new(&mini)?;
+    for data in [&encoded[..], &named[..], &large[..]] {
+        assert_eq!(
+            upb::MiniMessage::parse(&schema, &arena, data)?.serialize()?,
+            data
+        );
+    }
+    assert!(upb::MiniMessage::parse(&schema, &arena, b"\x12\x04").is_err());
+    assert!(upb::MiniSchema::new(b"").is_err());
+    assert!(upb::MiniSchema::new(&mini[..mini.len() - 1]).is_err());
+
+    // JSON round trips, and printing truncates to the buffer provided.
+    let print_options = upb::JsonPrintOptions::default();
+    let parse_options = upb::JsonParseOptions::default();
+    let message = upb::Message::parse(def, &arena, b"\x08\x01\x12\x02\x0a\x00\x1a\x02hi")?;
+    let json = r#"{"id":1,"inner":{},"name":"hi"}"#;
+    assert_eq!(message.to_json(&print_options)?, json);
+    let mut buf = [0xff; 8];
+    assert_eq!(
+        message.print_json_into(&mut buf, &print_options)?,
+        json.len()
+    );
+    assert_eq!(&buf, b"{\"id\":1\0");
+    let parsed = upb::Message::parse_json(def, &arena, json, &parse_options)?;
+    assert_eq!(parsed.serialize()?, message.serialize()?);
+    assert_eq!(
+        upb::Message::new(def, &arena).to_json(&upb::JsonPrintOptions {
+            always_print_fields_with_no_presence: true,
+            ..Default::default()
+        })?,
+        r#"{"id":0,"name":""}"#
+    );
+    let unknown = r#"{"id":1,"unknown":2}"#;
+    assert!(upb::Message::parse_json(def, &arena, unknown, &parse_options).is_err());
+    let ignore_unknown = upb::JsonParseOptions {
+        ignore_unknown_fields: true,
+    };
+    upb::Message::parse_json(def, &arena, unknown, &ignore_unknown)?;
+    assert!(upb::Message::parse_json(def, &arena, "{", &parse_options).is_err());
+
+    // Text format, for upb messages and, by way of upb, libprotobuf messages.
+    let message = upb::Message::parse(def, &arena, &named)?;
+    let text_options = upb::TextPrintOptions::default();
+    assert_eq!(message.to_text(&text_options), "id: 1\nname: \"hello\"\n");
+    let single_line = upb::TextPrintOptions {
+        single_line: true,
+        ..Default::default()
+    };
+    assert_eq!(message.to_text(&single_line), "id: 1 name: \"hello\" ");
+    let mut cpp_pool = DescriptorPool::new();
+    cpp_pool.as_mut().build_file_set(&fds)?;
+    let descriptor = cpp_pool.find_message_type_by_name("upbtest.Outer").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let mut cpp_message = factory.as_mut().get_prototype(descriptor).new();
+    cpp_message.as_mut().parse_from_bytes(&named)?;
+    assert_eq!(
+        upb::debug_string_truncated(&*cpp_message, &pool, 100, &text_options)?,
+        "id: 1\nname: \"hello\"\n"
+    );
+    assert_eq!(
+        upb::debug_string_truncated(&*cpp_message, &pool, 8, &text_options)?,
+        "id: 1\nna"
+    );
+    assert!(upb::debug_string_truncated(&*cpp_message, &DefPool::new(), 8, &text_options).is_err());
+
+    // Comparison and hashing, which ignore the order of map entries.
+    let tagged = pool.find_message_by_name("upbtest.Tagged").unwrap();
+    let ab = b"\x0a\x05\x0a\x01a\x10\x01\x0a\x05\x0a\x01b\x10\x02";
+    let ba = b"\x0a\x05\x0a\x01b\x10\x02\x0a\x05\x0a\x01a\x10\x01";
+    let ab = upb::Message::parse(tagged, &arena, ab)?;
+    let ba = upb::Message::parse(tagged, &arena, ba)?;
+    assert!(ab == ba);
+    assert!(ab.eq_with_unknown_fields(&ba));
+    let mut unique = std::collections::HashSet::new();
+    assert!(unique.insert(ab));
+    assert!(!unique.insert(ba));
+    let a = upb::Message::parse(tagged, &arena, b"\x0a\x05\x0a\x01a\x10\x01")?;
+    assert!(unique.insert(a));
+    let empty = upb::Message::new(tagged, &arena);
+    assert!(upb::Message::new(def, &arena) != empty);
+    let unknown = upb::Message::parse(tagged, &arena, b"\x10\x01")?;
+    assert!(unknown == empty);
+    assert!(!unknown.eq_with_unknown_fields(&empty));
+    Ok(())
+}
+
+#[cfg(feature = "upb")]
+#[test]
+fn test_upb_message_lite_conversion() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::upb::{self, Arena, DefPool};
+
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        br#"
+syntax = "proto2";
+
+package upbtest;
+
+message Test {
+    required int32 id = 1;
+    optional string name = 2;
+    repeated int64 values = 3;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("test.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("upbtest.Test").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let mut upb_pool = DefPool::new();
+    upb_pool.as_mut().add_file_set(&fds)?;
+    let def = upb_pool.find_message_by_name("upbtest.Test").unwrap();
+
+    let encoded = b"\x08\x01\x12\x02hi\x18\x05\x18\x06";
+    let mut message = prototype.new_message();
+    message.as_mut().parse_from_bytes(encoded)?;
+    let arena = Arena::new();
+    let converted = upb::Message::from_message_lite(def, &arena, &*message)?;
+    assert_eq!(converted.get_bytes("name"), Some(&b"hi"[..]));
+    assert_eq!(converted.serialize()?, encoded);
+
+    let mut back = prototype.new_message();
+    converted.merge_into_message_lite(back.as_mut())?;
+    assert_eq!(back.serialize()?, encoded);
+
+    // Required fields are checked in both directions.
+    let mut partial = prototype.new_message();
+    partial.as_mut().parse_partial_from_bytes(b"\x12\x02hi")?;
+    assert!(upb::Message::from_message_lite(def, &arena, &*partial).is_err());
+    let partial = upb::Message::new(def, &arena);
+    assert!(partial
+        .merge_into_message_lite(prototype.new_message().as_mut())
+        .is_err());
+
+    // Messages of other types are rejected.
+    let fds_def = fds.new();
+    assert!(upb::Message::from_message_lite(def, &arena, &*fds_def).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_columnar_extractor() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("row.proto"),
+        br#"
+syntax = "proto2";
+
+message Row {
+    optional int32 id = 1;
+    optional string name = 2;
+    optional Inner inner = 3;
+}
+
+message Inner {
+    optional bool flag = 1;
+    optional double score = 2;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("row.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Row").unwrap();
+
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let mut a = prototype.new_message();
+    a.as_mut()
+        .parse_from_bytes(b"\x08\x07\x12\x02hi\x1a\x02\x08\x01")?;
+    let mut b = prototype.new_message();
+    b.as_mut().parse_from_bytes(b"\x08\x09")?;
+
+    let mut extractor = ColumnarExtractor::new(descriptor);
+    assert_eq!(extractor.as_mut().add_column("id")?, 0);
+    assert_eq!(extractor.as_mut().add_column("name")?, 1);
+    assert_eq!(extractor.as_mut().add_column("inner.flag")?, 2);
+    assert!(extractor.as_mut().add_column("inner").is_err());
+    assert!(extractor.as_mut().add_column("missing").is_err());
+    assert!(extractor.as_mut().add_column("id.missing").is_err());
+
+    extractor.as_mut().extract(&[&*a, &*b])?;
+    assert_eq!(extractor.num_rows(), 2);
+    assert_eq!(extractor.column_type(0), ColumnType::Int64);
+    assert_eq!(extractor.column(0).values, ColumnValues::Int64(&[7, 9]));
+    assert_eq!(extractor.column(0).null_count, 0);
+    let name = extractor.column(1);
+    assert_eq!(
+        name.values,
+        ColumnValues::Bytes {
+            offsets: &[0, 2, 2],
+            data: b"hi",
+        }
+    );
+    assert_eq!(name.validity, &[0b01]);
+    assert_eq!(name.null_count, 1);
+    assert!(name.is_valid(0));
+    assert!(!name.is_valid(1));
+    let flag = extractor.column(2);
+    assert_eq!(flag.values, ColumnValues::Bool(&[true, false]));
+    assert_eq!(flag.null_count, 1);
+
+    // Columns cannot be added once rows have been extracted.
+    assert!(extractor.as_mut().add_column("inner.score").is_err());
+
+    // Messages of other types are rejected.
+    let fds = simple_file_descriptor_set()?;
+    assert!(extractor.as_mut().extract(&[&*fds]).is_err());
+    assert_eq!(extractor.num_rows(), 2);
+
+    extractor.as_mut().clear();
+    assert_eq!(extractor.num_rows(), 0);
+    assert_eq!(extractor.column(0).values, ColumnValues::Int64(&[]));
+
+    // Decoding the wire format produces the same columns as reflection.
+    let mut reflected = ColumnarExtractor::new(descriptor);
+    let mut decoded = ColumnarExtractor::new(descriptor);
+    for path in ["id", "name", "inner.flag", "inner.score"] {
+        reflected.as_mut().add_column(path)?;
+        decoded.as_mut().add_column(path)?;
+    }
+    reflected.as_mut().extract(&[&*a, &*b])?;
+    decoded.as_mut().decode(&a.serialize()?)?;
+    let mut batch = vec![];
+    for message in [&b, &a] {
+        batch.push(u8::try_from(message.byte_size())?);
+        message.serialize_into(&mut batch)?;
+    }
+    decoded
+        .as_mut()
+        .decode_delimited(&batch[..1 + b.byte_size()])?;
+    assert_eq!(decoded.num_rows(), 2);
+    for i in 0..4 {
+        assert_eq!(decoded.column(i), reflected.column(i));
+    }
+
+    // A malformed batch extracts no rows.
+    assert!(decoded
+        .as_mut()
+        .decode_delimited(&batch[..batch.len() - 1])
+        .is_err());
+    assert!(decoded.as_mut().decode(b"\x1a\x05\x08").is_err());
+    assert_eq!(decoded.num_rows(), 2);
+    assert_eq!(decoded.column(1), reflected.column(1));
+    Ok(())
+}
+
+#[test]
+fn test_presence_bitmaps() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("row.proto"),
+        br#"
+syntax = "proto2";
+
+message Row {
+    optional int32 id = 1;
+    optional string name = 2;
+    repeated int32 tags = 3;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("row.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Row").unwrap();
+    let fields = [
+        descriptor.field(0),
+        descriptor.field(1),
+        descriptor.field(2),
+    ];
+
+    // Row `i` has an ID if `i` is even, a name if `i` is a multiple of
+    // three, and tags if it is the last.
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let mut rows = vec![];
+    for i in 0..9 {
+        let mut data = vec![];
+        if i % 2 == 0 {
+            data.extend_from_slice(b"\x08\x01");
+        }
+        if i % 3 == 0 {
+            data.extend_from_slice(b"\x12\x00");
+        }
+        if i == 8 {
+            data.extend_from_slice(b"\x18\x01");
+        }
+        let mut row = prototype.new_message();
+        row.as_mut().parse_from_bytes(&data)?;
+        rows.push(row);
+    }
+    let messages: Vec<&dyn Message> = rows.iter().map(|row| &**row).collect();
+
+    let mut bitmaps = vec![0xff];
+    columnar::presence_bitmaps(&messages, &fields, &mut bitmaps)?;
+    assert_eq!(bitmaps, [0x55, 0x01, 0x49, 0x00, 0x00, 0x01]);
+    columnar::presence_bitmaps(&messages[..1], &fields[1..], &mut bitmaps)?;
+    assert_eq!(bitmaps, [0x01, 0x00]);
+
+    // Messages and fields of other types are rejected.
+    let other = simple_file_descriptor_set()?;
+    assert!(columnar::presence_bitmaps(&[&*rows[0], &*other], &fields, &mut bitmaps).is_err());
+    assert!(bitmaps.is_empty());
+    assert!(columnar::presence_bitmaps(&[&*other], &fields, &mut bitmaps).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_merge_from_bytes_with_mask() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let data = fds.serialize()?;
+
+    let mut mask = FieldMask::new();
+    mask.as_mut().add_path("file.name");
+    assert_eq!(mask.paths_size(), 1);
+    assert_eq!(mask.path(0), b"file.name");
+
+    let mut trimmed = fds.new_message();
+    trimmed.as_mut().merge_from_bytes_with_mask(&data, &mask)?;
+    assert_eq!(trimmed.serialize()?, b"\x0a\x0c\x0a\x0atest.proto");
+
+    // The compiled mask is cached, and does not leak into other masks.
+    let mut trimmed = fds.new_message();
+    trimmed.as_mut().merge_from_bytes_with_mask(&data, &mask)?;
+    assert_eq!(trimmed.serialize()?, b"\x0a\x0c\x0a\x0atest.proto");
+    mask.as_mut().clear_paths();
+    mask.as_mut().add_path("file");
+    let mut trimmed = fds.new_message();
+    trimmed.as_mut().merge_from_bytes_with_mask(&data, &mask)?;
+    assert_eq!(trimmed.serialize()?, data);
+
+    mask.as_mut().add_path("missing");
+    let mut trimmed = fds.new_message();
+    assert!(trimmed
+        .as_mut()
+        .merge_from_bytes_with_mask(&data, &mask)
+        .is_err());
+    Ok(())
+}
+
+#[test]
+fn test_field_descriptor() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    assert_eq!(descriptor.field_count(), 1);
+
+    let field = descriptor.field(0);
+    assert_eq!(field.name(), b"s");
+    assert_eq!(field.full_name(), b"Test.s");
+    assert_eq!(field.number(), 1);
+    assert_eq!(field.index(), 0);
+    assert_eq!(field.field_type(), FieldType::String);
+    assert!(!field.is_repeated());
+    assert!(!field.has_presence());
+    assert!(field.message_type().is_none());
+    assert_eq!(field.containing_type().full_name(), b"Test");
+
+    let by_name = descriptor.find_field_by_name("s").unwrap();
+    assert_eq!(by_name as *const _, field as *const _);
+    let by_number = descriptor.find_field_by_number(1).unwrap();
+    assert_eq!(by_number as *const _, field as *const _);
+    assert!(descriptor.find_field_by_name("t").is_none());
+    assert!(descriptor.find_field_by_number(2).is_none());
+
+    let index = descriptor.field_index();
+    assert_eq!(
+        index.find_field_by_name("s").unwrap() as *const _,
+        field as *const _
+    );
+    assert_eq!(
+        index.find_field_by_number(1).unwrap() as *const _,
+        field as *const _
+    );
+    assert!(index.find_field_by_name("t").is_none());
+    assert!(index.find_field_by_number(2).is_none());
+    Ok(())
+}
+
+#[test]
+fn test_descriptor_pool_with_database() -> Result<(), Box<dyn Error>> {
+    struct SymbolDatabase<'a> {
+        inner: Pin<Box<SourceTreeDescriptorDatabase<'a>>>,
+        loads: usize,
+    }
+
+    impl DescriptorDatabase for SymbolDatabase<'_> {
+        fn find_file_by_name(
+            self: Pin<&mut Self>,
+            filename: &Path,
+        ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+            let this = self.get_mut();
+            this.loads += 1;
+            this.inner.as_mut().find_file_by_name(filename)
+        }
+
+        fn find_file_containing_symbol(
+            self: Pin<&mut Self>,
+            symbol_name: &str,
+        ) -> Result<Pin<Box<FileDescriptorProto>>, OperationFailedError> {
+            match symbol_name {
+                "Test" => self.find_file_by_name(Path::new("test.proto")),
+                _ => Err(OperationFailedError),
+            }
+        }
+    }
+
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+    );
+    let mut db = SymbolDatabase {
+        inner: SourceTreeDescriptorDatabase::new(source_tree.as_mut()),
+        loads: 0,
+    };
+    {
+        let pool = DescriptorPool::with_database(Pin::new(&mut db));
+        let descriptor = pool.find_message_type_by_name("Test").unwrap();
+        assert_eq!(descriptor.full_name(), b"Test");
+        let file = pool.find_file_by_name(Path::new("test.proto")).unwrap();
+        assert_eq!(file.message_type_count(), 1);
+        let file = pool.find_file_containing_symbol("Test").unwrap();
+        assert_eq!(file.message_type(0).name(), b"Test");
+        assert!(pool.find_message_type_by_name("Missing").is_none());
+        assert!(pool.find_file_by_name(Path::new("missing.proto")).is_none());
+    }
+    // Each file is loaded from the database at most once.
+    assert_eq!(db.loads, 2);
+    Ok(())
+}
+
+#[test]
+fn test_encoded_descriptor_database() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.file(0).serialize()?;
+
+    let mut db = EncodedDescriptorDatabase::new();
+    db.as_mut().add(&encoded)?;
+    // Adding the same file twice conflicts.
+    assert!(db.as_mut().add_copy(&encoded).is_err());
+    assert!(db.as_mut().add_copy(b"\xff").is_err());
+
+    let file = db.as_mut().find_file_by_name(Path::new("test.proto"))?;
+    assert_eq!(file.serialize()?, encoded);
+    let file = db.as_mut().find_file_containing_symbol("Test")?;
+    assert_eq!(file.serialize()?, encoded);
+    assert!(db.as_mut().find_file_containing_symbol("Missing").is_err());
+
+    let pool = DescriptorPool::with_database(db.as_mut());
+    let descriptor = pool.find_message_type_by_name("Test").unwrap();
+    assert_eq!(descriptor.field(0).name(), b"s");
+    Ok(())
+}
+
+#[test]
+fn test_merged_descriptor_database() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let test = fds.file(0).serialize()?;
+    let other = b"\x0a\x0bother.proto\x22\x07\x0a\x05Other";
+
+    let mut db1 = EncodedDescriptorDatabase::new();
+    db1.as_mut().add(&test)?;
+    let mut db2 = EncodedDescriptorDatabase::new();
+    db2.as_mut().add(other)?;
+
+    let mut merged = MergedDescriptorDatabase::new(vec![
+        db1.as_mut() as Pin<&mut (dyn DescriptorDatabase + Send)>,
+        db2.as_mut(),
+    ]);
+    let file = merged.as_mut().find_file_containing_symbol("Test")?;
+    assert_eq!(file.serialize()?, test);
+    let file = merged.as_mut().find_file_containing_symbol("Other")?;
+    assert_eq!(file.serialize()?, other);
+    assert!(merged
+        .as_mut()
+        .find_file_containing_extension("Test", 100)
+        .is_err());
+    assert_eq!(
+        merged.as_mut().find_all_file_names()?,
+        vec![PathBuf::from("test.proto"), PathBuf::from("other.proto")]
+    );
+
+    let pool = DescriptorPool::with_database(merged.as_mut());
+    assert!(pool.find_message_type_by_name("Other").is_some());
+    assert!(pool.find_message_type_by_name("Test").is_some());
+    Ok(())
+}
+
+#[test]
+fn test_shared_descriptor_pool() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.file(0).serialize()?;
+    let mut db = EncodedDescriptorDatabase::new();
+    db.as_mut().add(&encoded)?;
+
+    let pool = DescriptorPool::with_database(db.as_mut()).into_shared();
+    thread::scope(|s| {
+        for _ in 0..4 {
+            let pool = pool.clone();
+            s.spawn(move || {
+                let descriptor = pool.find_message_type_by_name("Test").unwrap();
+                assert_eq!(descriptor.field(0).name(), b"s");
+                assert!(pool.find_message_type_by_name("Missing").is_none());
+            });
+        }
+    });
+    Ok(())
+}
+
+#[test]
+fn test_build_file_set() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("dependent.proto"),
+        b"syntax = \"proto3\"; import \"test.proto\"; message Dependent { Test test = 1; }"
+            .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let mut fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("dependent.proto")])?;
+
+    // Dependents precede their dependencies in the set.
+    assert_eq!(fds.file(0).dependency(0), b"test.proto");
+    let dependent = fds.file(0).serialize()?;
+
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file_set(&fds)?;
+    let descriptor = pool.find_message_type_by_name("Dependent").unwrap();
+    assert_eq!(descriptor.field(0).message_type().unwrap().name(), b"Test");
+
+    // Without `test.proto`, `dependent.proto` fails to build.
+    fds.as_mut().clear_file();
+    fds.as_mut().add_file().merge_from_bytes(&dependent)?;
+    let err = DescriptorPool::new()
+        .as_mut()
+        .build_file_set(&fds)
+        .unwrap_err();
+    assert_eq!(err.errors.len(), 1);
+    assert_eq!(err.errors[0].filename, "dependent.proto");
+    Ok(())
+}
+
+#[test]
+fn test_build_file_set_shared_features() -> Result<(), Box<dyn Error>> {
+    // The fields of both files set the same features, within different file
+    // features, and the nested message repeats the fields of its parent.
+    const A: &str = r#"
+edition = "2023";
+package a;
+option features.field_presence = IMPLICIT;
+message A {
+    string s = 1 [features.utf8_validation = NONE];
+    int32 i = 2 [features.field_presence = EXPLICIT];
+    message Nested {
+        string s = 1 [features.utf8_validation = NONE];
+        int32 i = 2 [features.field_presence = EXPLICIT];
+    }
+}
+"#;
+    const B: &str = r#"
+edition = "2023";
+package b;
+message B {
+    string s = 1 [features.utf8_validation = NONE];
+    int32 i = 2 [features.field_presence = EXPLICIT];
+    int32 r = 3 [features.field_presence = LEGACY_REQUIRED];
+}
+"#;
+    const MESSAGES: &[&str] = &["a.A", "a.A.Nested", "b.B"];
+
+    fn resolved_features(pool: &DescriptorPool, name: &str) -> Vec<(bool, bool, bool)> {
+        let message = pool.find_message_type_by_name(name).unwrap();
+        (0..message.field_count())
+            .map(|i| {
+                let field = message.field(i);
+                (
+                    field.has_presence(),
+                    field.is_required(),
+                    field.requires_utf8_validation(),
+                )
+            })
+            .collect()
+    }
+
+    let fds = build_file_descriptor_set(&[("a.proto", A), ("b.proto", B)])?;
+    let mut shared = DescriptorPool::new();
+    shared.as_mut().build_file_set(&fds)?;
+    let mut separate_a = DescriptorPool::new();
+    separate_a
+        .as_mut()
+        .build_file_set(&build_file_descriptor_set(&[("a.proto", A)])?)?;
+    let mut separate_b = DescriptorPool::new();
+    separate_b
+        .as_mut()
+        .build_file_set(&build_file_descriptor_set(&[("b.proto", B)])?)?;
+
+    assert_eq!(
+        resolved_features(&shared, "a.A"),
+        [(false, false, false), (true, false, false)]
+    );
+    assert_eq!(
+        resolved_features(&shared, "b.B"),
+        [
+            (true, false, false),
+            (true, false, false),
+            (true, true, false)
+        ]
+    );
+    for name in MESSAGES {
+        let separate = match name.starts_with("a.") {
+            true => &separate_a,
+            false => &separate_b,
+        };
+        assert_eq!(
+            resolved_features(&shared, name),
+            resolved_features(separate, name)
+        );
+    }
+    assert_eq!(
+        resolved_features(&shared, "a.A"),
+        resolved_features(&shared, "a.A.Nested")
+    );
+    Ok(())
+}
+
+#[test]
+fn test_descriptor_pool_with_underlay() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    // A stand-in for the well-known type, which the underlay provides.
+    source_tree.as_mut().add_file(
+        Path::new("google/protobuf/timestamp.proto"),
+        b"syntax = \"proto3\"; package google.protobuf; message Timestamp { int64 seconds = 1; }"
+            .to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("event.proto"),
+        b"syntax = \"proto3\"; import \"google/protobuf/timestamp.proto\";
+          message Event { google.protobuf.Timestamp time = 1; }"
+            .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("event.proto")])?;
+    assert_eq!(fds.file_size(), 2);
+
+    let mut pool = DescriptorPool::with_underlay(DescriptorPool::generated());
+    pool.as_mut().build_file_set(&fds)?;
+    let event = pool.find_message_type_by_name("Event").unwrap();
+    let timestamp = event.field(0).message_type().unwrap();
+    assert_eq!(timestamp.full_name(), b"google.protobuf.Timestamp");
+    // The timestamp type is the generated one, not the stand-in.
+    assert_eq!(timestamp.field_count(), 2);
+    assert!(std::ptr::eq(
+        timestamp,
+        DescriptorPool::generated()
+            .find_message_type_by_name("google.protobuf.Timestamp")
+            .unwrap()
+    ));
+    Ok(())
+}
+
+#[test]
+fn test_descriptor_memory_usage() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut()
+        .build_file_set_with_options(&fds, &BuildOptions::compact())?;
+    let usage = pool
+        .find_file_by_name(Path::new("test.proto"))
+        .unwrap()
+        .memory_usage();
+    assert!(usage.descriptors > 0);
+    assert_eq!(usage.source_code_info, 0);
+    assert_eq!(
+        [usage, usage].into_iter().sum::<MemoryUsage>().total(),
+        2 * usage.total()
+    );
+    Ok(())
+}
+
+#[test]
+fn test_descriptor_pool_image() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("dependent.proto"),
+        b"syntax = \"proto3\"; import \"test.proto\"; message Dependent { Test test = 1; }"
+            .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("dependent.proto")])?;
+    let encoded = DescriptorPoolImage::encode(&fds)?;
+
+    // The image records the files in dependency order.
+    let image = DescriptorPoolImage::open(&encoded)?;
+    assert_eq!(image.file_count(), 2);
+    assert_eq!(image.files().next(), Some(&*fds.file(1).serialize()?));
+
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_image(&image)?;
+    let descriptor = pool.find_message_type_by_name("Dependent").unwrap();
+    assert_eq!(descriptor.field(0).message_type().unwrap().name(), b"Test");
+
+    let mut database = image.database()?;
+    let pool = DescriptorPool::with_database(database.as_mut());
+    assert!(pool.find_message_type_by_name("Dependent").is_some());
+
+    // Truncated or corrupt images are rejected.
+    assert!(DescriptorPoolImage::open(&encoded[..encoded.len() - 1]).is_err());
+    let mut corrupt = encoded.clone();
+    corrupt[20] ^= 1;
+    assert!(DescriptorPoolImage::open(&corrupt).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_parallel_source_tree_parser() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    for (name, contents) in [
+        ("a.proto", r#"import "b.proto"; import "c.proto";"#),
+        ("b.proto", r#"import "d.proto";"#),
+        ("c.proto", r#"import "d.proto";"#),
+        ("d.proto", r#"message D {}"#),
+        ("e.proto", r#"import "missing.proto";"#),
+    ] {
+        source_tree.as_mut().add_file(
+            Path::new(name),
+            format!(r#"syntax = "proto3"; {}"#, contents).into_bytes(),
+        );
+    }
+
+    let serial = SourceTreeDescriptorDatabase::new(source_tree.as_mut())
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("a.proto")])?;
+    let mut serial_files = (0..serial.file_size())
+        .map(|i| serial.file(i).serialize())
+        .collect::<Result<Vec<_>, _>>()?;
+    serial_files.sort();
+
+    let mut parser = ParallelSourceTreeParser::new(source_tree.as_mut());
+    let one = parser
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("a.proto")], 1)?;
+    let many = parser
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("a.proto")], 4)?;
+    assert_eq!(one.serialize()?, many.serialize()?);
+    let mut parallel_files = (0..many.file_size())
+        .map(|i| many.file(i).serialize())
+        .collect::<Result<Vec<_>, _>>()?;
+    parallel_files.sort();
+    assert_eq!(serial_files, parallel_files);
+    drop(parser);
+
+    let mut error_collector = SimpleErrorCollector::new();
+    let mut parser = ParallelSourceTreeParser::new(source_tree.as_mut());
+    parser.as_mut().record_errors_to(error_collector.as_mut());
+    let res = parser
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("e.proto")], 4);
+    assert_eq!(util::unwrap_err(res), OperationFailedError);
+    drop(parser);
+    let errors: Vec<_> = error_collector.as_mut().collect();
+    assert_eq!(
+        errors,
+        &[FileLoadError {
+            filename: "missing.proto".into(),
+            message: "File not found.".into(),
+            severity: Severity::Error,
+            location: None,
+        }]
+    );
+    Ok(())
+}
+
+#[test]
+fn test_parallel_source_tree_parser_split_files() -> Result<(), Box<dyn Error>> {
+    let mut contents = String::from(
+        "syntax = \"proto3\";\npackage big;\nimport \"dep.proto\";\noption java_package = \"big\";\n",
+    );
+    for i in 0..3000 {
+        // Braces in comments and strings must not confuse the splitter.
+        contents += &format!(
+            r#"/* message Skipped{0} {{ */
+message M{0} {{
+  // }}
+  string s = 1 [json_name = "}}{{"];
+  Dep d = 2;
+}}
+enum E{0} {{ E{0}_A = 0; }}
+"#,
+            i
+        );
+    }
+    let broken = contents.replace("message M2500 {\n", "message M2500 {\n  int32 = 3;\n");
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("dep.proto"),
+        b"syntax = \"proto3\"; package big; message Dep {}".to_vec(),
+    );
+    source_tree
+        .as_mut()
+        .add_file(Path::new("big.proto"), contents.into_bytes());
+    source_tree
+        .as_mut()
+        .add_file(Path::new("broken.proto"), broken.into_bytes());
+
+    let mut error_collector = SimpleErrorCollector::new();
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut().set_include_source_code_info(false);
+    db.as_mut().record_errors_to(error_collector.as_mut());
+    let serial = db.as_mut().build_file_descriptor_set(&["big.proto"])?;
+    assert!(db
+        .as_mut()
+        .find_file_by_name(Path::new("broken.proto"))
+        .is_err());
+    drop(db);
+    let serial_errors: Vec<_> = error_collector.as_mut().collect();
+    assert_eq!(serial_errors.len(), 1);
+
+    let mut parser = ParallelSourceTreeParser::new(source_tree.as_mut());
+    parser.as_mut().set_split_large_files(true);
+    parser.as_mut().record_errors_to(error_collector.as_mut());
+    let split = parser
+        .as_mut()
+        .build_file_descriptor_set(&["big.proto"], 4)?;
+    assert_eq!(split.file_size(), 2);
+    assert_eq!(split.file(0).message_type_size(), 3000);
+    assert_eq!(split.file(0).serialize()?, serial.file(0).serialize()?);
+    let res = parser
+        .as_mut()
+        .build_file_descriptor_set(&["broken.proto"], 4);
+    assert_eq!(util::unwrap_err(res), OperationFailedError);
+    drop(parser);
+    let split_errors: Vec<_> = error_collector.as_mut().collect();
+    assert_eq!(split_errors, serial_errors);
+    Ok(())
+}
+
+#[test]
+fn test_caching_source_tree_descriptor_database() -> Result<(), Box<dyn Error>> {
+    let cache_dir = tempfile::tempdir()?;
+    let cache_entries = || -> Result<Vec<_>, std::io::Error> {
+        let mut entries = fs::read_dir(cache_dir.path())?
+            .map(|entry| entry.map(|entry| entry.path()))
+            .collect::<Result<Vec<_>, _>>()?;
+        entries.sort();
+        Ok(entries)
+    };
+
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+    );
+    let expected = SourceTreeDescriptorDatabase::new(source_tree.as_mut())
+        .as_mut()
+        .find_file_by_name(Path::new("test.proto"))?
+        .serialize()?;
+
+    let mut db = CachingSourceTreeDescriptorDatabase::new(source_tree.as_mut(), cache_dir.path());
+    let file = Pin::new(&mut db).find_file_by_name(Path::new("test.proto"))?;
+    assert_eq!(file.serialize()?, expected);
+    drop(db);
+    let entries = cache_entries()?;
+    assert_eq!(entries.len(), 1);
+    assert_eq!(fs::read(&entries[0])?, expected);
+
+    // Lookups are served from the cache while the contents are unchanged.
+    let fds = simple_file_descriptor_set()?;
+    fs::write(&entries[0], fds.file(0).serialize()?)?;
+    let mut db = CachingSourceTreeDescriptorDatabase::new(source_tree.as_mut(), cache_dir.path());
+    let file = Pin::new(&mut db).find_file_by_name(Path::new("test.proto"))?;
+    assert_eq!(file.serialize()?, fds.file(0).serialize()?);
+    drop(db);
+
+    // Changing the contents invalidates the cached file.
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message Test { string t = 1; }".to_vec(),
+    );
+    let mut error_collector = SimpleErrorCollector::new();
+    let mut db = CachingSourceTreeDescriptorDatabase::new(source_tree.as_mut(), cache_dir.path());
+    db.record_errors_to(error_collector.as_mut());
+    let fds = db.build_file_descriptor_set(&[Path::new("test.proto")])?;
+    assert_ne!(fds.file(0).serialize()?, expected);
+    assert!(Pin::new(&mut db)
+        .find_file_by_name(Path::new("missing.proto"))
+        .is_err());
+    drop(db);
+    assert_eq!(cache_entries()?.len(), 2);
+    let errors: Vec<_> = error_collector.as_mut().collect();
+    assert_eq!(
+        errors,
+        &[FileLoadError {
+            filename: "missing.proto".into(),
+            message: "File not found.".into(),
+            severity: Severity::Error,
+            location: None,
+        }]
+    );
+    Ok(())
+}
+
+#[test]
+fn test_virtual_source_tree_shared_file() -> Result<(), Box<dyn Error>> {
+    let contents: Arc<[u8]> = Arc::from(&b"syntax = \"proto3\"; message Test {}"[..]);
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree
+        .as_mut()
+        .add_shared_file(Path::new("test.proto"), contents.clone());
+    assert_eq!(Arc::strong_count(&contents), 2);
+
+    let mut stream = source_tree.as_mut().open(Path::new("test.proto"))?;
+    let buf = stream.as_mut().next()?;
+    // The stream reads directly from the shared contents.
+    assert_eq!(buf.as_ptr(), contents.as_ptr());
+    assert_eq!(buf, &contents[..]);
+    drop(stream);
+
+    // Replacing the file releases the shared contents.
+    source_tree
+        .as_mut()
+        .add_file(Path::new("test.proto"), b"syntax = \"proto3\";".to_vec());
+    assert_eq!(Arc::strong_count(&contents), 1);
+    Ok(())
+}
+
+#[test]
+fn test_mmap_source_tree() -> Result<(), Box<dyn Error>> {
+    let dir = tempfile::tempdir()?;
+    fs::write(
+        dir.path().join("test.proto"),
+        "syntax = \"proto3\"; message Test { string s = 1; }",
+    )?;
+
+    let cache = MappedFileCache::new();
+    let mut source_tree = MmapSourceTree::with_cache(&cache);
+    drop(cache);
+    source_tree
+        .as_mut()
+        .map_path(Path::new("protos"), dir.path());
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let file = db
+        .as_mut()
+        .find_file_by_name(Path::new("protos/test.proto"))?;
+    assert_eq!(file.message_type(0).name(), b"Test");
+    drop(db);
+
+    // Modified files are remapped.
+    fs::write(
+        dir.path().join("test.proto"),
+        "syntax = \"proto3\"; message Other {}",
+    )?;
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let file = db
+        .as_mut()
+        .find_file_by_name(Path::new("protos/test.proto"))?;
+    assert_eq!(file.message_type(0).name(), b"Other");
+    drop(db);
+
+    let res = source_tree.as_mut().open(Path::new("protos/missing.proto"));
+    assert_eq!(util::unwrap_err(res).to_string(), "File not found.");
+    Ok(())
+}
+
+#[test]
+fn test_caching_source_tree() -> Result<(), Box<dyn Error>> {
+    let dir = tempfile::tempdir()?;
+    fs::write(dir.path().join("test.proto"), "syntax = \"proto3\";")?;
+    let mut disk_source_tree = DiskSourceTree::new();
+    disk_source_tree
+        .as_mut()
+        .map_path(Path::new(""), dir.path());
+    let mut source_tree = CachingSourceTree::new(disk_source_tree.as_mut());
+
+    fn read(
+        source_tree: Pin<&mut CachingSourceTree>,
+        name: &str,
+    ) -> Result<Vec<u8>, Box<dyn Error>> {
+        let mut contents = vec![];
+        let mut stream = source_tree.open(Path::new(name))?;
+        while let Ok(buf) = stream.as_mut().next() {
+            contents.extend_from_slice(buf);
+        }
+        Ok(contents)
+    }
+    assert_eq!(
+        read(source_tree.as_mut(), "test.proto")?,
+        b"syntax = \"proto3\";"
+    );
+    let err = read(source_tree.as_mut(), "new.proto").unwrap_err();
+    assert_eq!(err.to_string(), "File not found.");
+
+    // Both results are remembered until the cache is cleared.
+    fs::write(dir.path().join("test.proto"), "syntax = \"proto2\";")?;
+    fs::write(dir.path().join("new.proto"), "")?;
+    assert_eq!(
+        read(source_tree.as_mut(), "test.proto")?,
+        b"syntax = \"proto3\";"
+    );
+    assert!(read(source_tree.as_mut(), "new.proto").is_err());
+    source_tree.as_mut().clear();
+    assert_eq!(
+        read(source_tree.as_mut(), "test.proto")?,
+        b"syntax = \"proto2\";"
+    );
+    assert_eq!(read(source_tree.as_mut(), "new.proto")?, b"");
+    Ok(())
+}
+
+#[test]
+fn test_rust_source_tree() -> Result<(), Box<dyn Error>> {
+    struct MapSourceTree(HashMap<PathBuf, Vec<u8>>);
+
+    impl CustomSourceTree for MapSourceTree {
+        fn open(
+            &self,
+            filename: &Path,
+        ) -> Result<Pin<Box<dyn ZeroCopyInputStream + '_>>, FileOpenError> {
+            match self.0.get(filename) {
+                Some(contents) => Ok(SliceInputStream::new(contents)),
+                None => Err(FileOpenError::new(format!(
+                    "{} is not in the map",
+                    filename.display()
+                ))),
+            }
+        }
+    }
+
+    let files = HashMap::from([(
+        PathBuf::from("test.proto"),
+        b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+    )]);
+    let mut source_tree = RustSourceTree::new(Box::new(MapSourceTree(files)));
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let file = db.as_mut().find_file_by_name(Path::new("test.proto"))?;
+    assert_eq!(file.message_type(0).name(), b"Test");
+    drop(db);
+
+    let res = source_tree.as_mut().open(Path::new("missing.proto"));
+    assert_eq!(
+        util::unwrap_err(res).to_string(),
+        "missing.proto is not in the map"
+    );
+    Ok(())
+}
+
+#[test]
+fn test_bounded_error_collector() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message { message { message {".to_vec(),
+    );
+    let mut error_collector = SimpleErrorCollector::new();
+    error_collector.as_mut().set_max_errors(1);
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut().record_errors_to(error_collector.as_mut());
+    assert!(db
+        .as_mut()
+        .find_file_by_name(Path::new("test.proto"))
+        .is_err());
+    drop(db);
+    assert!(error_collector.dropped() > 0);
+    let errors: Vec<_> = error_collector.as_mut().collect();
+    assert_eq!(errors.len(), 1);
+
+    let mut error_collector = SimpleErrorCollector::new();
+    error_collector.as_mut().set_ignore_warnings(true);
+    error_collector
+        .as_mut()
+        .add_warning("test.proto", 0, 0, "warning");
+    error_collector
+        .as_mut()
+        .add_error("test.proto", 0, 0, "error");
+    assert_eq!(error_collector.dropped(), 1);
+    let errors: Vec<_> = error_collector.as_mut().collect();
+    assert_eq!(errors.len(), 1);
+    assert_eq!(errors[0].severity, Severity::Error);
+    Ok(())
+}
+
+#[test]
+fn test_rust_error_collector() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\";\nmessage".to_vec(),
+    );
+    let mut messages = vec![];
+    let mut error_collector = RustErrorCollector::new(Box::new(
+        |filename: &str, location: Option<Location>, severity: Severity, message: &str| {
+            messages.push(format!(
+                "{}:{:?}:{}: {}",
+                filename, location, severity, message
+            ))
+        },
+    ));
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    db.as_mut().record_errors_to(error_collector.as_mut());
+    assert!(db
+        .as_mut()
+        .find_file_by_name(Path::new("test.proto"))
+        .is_err());
+    drop(db);
+    drop(error_collector);
+    assert_eq!(
+        messages,
+        &["test.proto:Some(Location { line: 2, column: 8 }):error: Expected message name."]
+    );
+    Ok(())
+}
+
+#[test]
+fn test_exclude_source_code_info() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\"; message Test { string s = 1; }".to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let file = db.as_mut().find_file_by_name(Path::new("test.proto"))?;
+    assert!(file.has_source_code_info());
+    let size = file.byte_size();
+
+    db.as_mut().set_include_source_code_info(false);
+    let set = db.as_mut().build_file_descriptor_set(&["test.proto"])?;
+    assert!(!set.file(0).has_source_code_info());
+    assert!(set.file(0).byte_size() < size);
+    assert_eq!(set.file(0).message_type(0).name(), b"Test");
+    Ok(())
+}
+
+#[test]
+fn test_compatibility_checker() -> Result<(), Box<dyn Error>> {
+    let old = build_file_descriptor_set(&[
+        (
+            "m.proto",
+            "syntax = \"proto2\"; package p;
+            message M {
+                optional int32 a = 1;
+                optional string b = 2;
+                repeated int32 c = 3;
+                reserved 10 to 12;
+                reserved \"old\";
+                message N { optional int32 x = 1; }
+            }
+            message Gone {}",
+        ),
+        (
+            "same.proto",
+            "syntax = \"proto3\"; message S { int32 s = 1; }",
+        ),
+        ("removed.proto", "syntax = \"proto3\"; message R {}"),
+    ])?;
+    let new = build_file_descriptor_set(&[
+        (
+            "m.proto",
+            "syntax = \"proto2\"; package p;
+            message M {
+                optional int64 a = 1;
+                repeated string b = 2;
+                optional int32 old = 11;
+                reserved 3;
+                message N { optional int32 x = 1; }
+            }",
+        ),
+        (
+            "same.proto",
+            "syntax = \"proto3\";\n// Only a comment changed.\nmessage S { int32 s = 1; }",
+        ),
+        ("added.proto", "syntax = \"proto3\"; message A {}"),
+    ])?;
+    assert_eq!(
+        compat::file_fingerprint(old.file(1)),
+        compat::file_fingerprint(new.file(1))
+    );
+
+    let checker = CompatibilityChecker::new(&old, 4);
+    for threads in [1, 4] {
+        let issues = checker.check(&new, threads);
+        let summary: Vec<_> = issues
+            .iter()
+            .map(|issue| (issue.kind, issue.element.as_str()))
+            .collect();
+        assert_eq!(
+            summary,
+            [
+                (IssueKind::FieldTypeChanged, "p.M.a"),
+                (IssueKind::FieldLabelChanged, "p.M.b"),
+                (IssueKind::ReservedNumberReused, "p.M.old"),
+                (IssueKind::ReservedNameReused, "p.M.old"),
+                (IssueKind::MessageRemoved, "p.Gone"),
+                (IssueKind::FileRemoved, ""),
+            ]
+        );
+        assert_eq!(
+            issues[0],
+            CompatibilityIssue {
+                kind: IssueKind::FieldTypeChanged,
+                file: "m.proto".into(),
+                element: "p.M.a".into(),
+                number: Some(1),
+                old_value: "int32".into(),
+                new_value: "int64".into(),
+            }
+        );
+        assert_eq!(issues[5].file, "removed.proto");
+    }
+    assert!(checker.check(&old, 4).is_empty());
+    Ok(())
+}
+
+#[test]
+fn test_file_descriptor_set_merge_dedup() -> Result<(), Box<dyn Error>> {
+    let common = (
+        "common.proto",
+        "syntax = \"proto3\"; message C { int32 c = 1; }",
+    );
+    let a = build_file_descriptor_set(&[common, ("a.proto", "syntax = \"proto3\"; message A {}")])?;
+    let b = build_file_descriptor_set(&[
+        ("b.proto", "syntax = \"proto3\"; message B {}"),
+        (
+            "common.proto",
+            "syntax = \"proto3\";\n// A comment.\nmessage C { int32 c = 1; }",
+        ),
+    ])?;
+    let merged = FileDescriptorSet::merge_dedup(&[&a, &b, &a])?;
+    let names: Vec<_> = merged.files().iter().map(|file| file.name()).collect();
+    assert_eq!(names, [&b"common.proto"[..], b"a.proto", b"b.proto"]);
+    // The first copy of a duplicated file is kept.
+    assert_eq!(merged.file(0).serialize()?, a.file(0).serialize()?);
+
+    let conflicting = build_file_descriptor_set(&[(
+        "common.proto",
+        "syntax = \"proto3\"; message C { int64 c = 1; }",
+    )])?;
+    assert_eq!(
+        FileDescriptorSet::merge_dedup(&[&a, &b, &conflicting]).err(),
+        Some(MergeConflictError {
+            filename: "common.proto".into(),
+            first_set: 0,
+            conflicting_set: 2,
+        })
+    );
+    Ok(())
+}
+
+#[test]
+fn test_source_code_index() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("test.proto"),
+        b"syntax = \"proto3\";
+
+// Detached.
+
+// A test message.
+message Test {
+  string s = 1; // The s field.
+}
+"
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let proto = db.as_mut().find_file_by_name(Path::new("test.proto"))?;
+    let mut pool = DescriptorPool::new();
+    let file = pool.as_mut().build_file(&proto);
+
+    for index in [proto.source_code_index(), file.source_code_index()] {
+        assert!(!index.is_empty());
+        assert_eq!(
+            index.get(&[4, 0]),
+            Some(&SourceLocation {
+                start_line: 5,
+                start_column: 0,
+                end_line: 7,
+                end_column: 1,
+                leading_comments: " A test message.\n".into(),
+                trailing_comments: "".into(),
+                leading_detached_comments: vec![" Detached.\n".into()],
+            })
+        );
+        let field = index.get(&[4, 0, 2, 0]).unwrap();
+        assert_eq!(
+            (
+                field.start_line,
+                field.start_column,
+                field.end_line,
+                field.end_column
+            ),
+            (6, 2, 6, 15)
+        );
+        assert_eq!(field.trailing_comments, " The s field.\n");
+        assert_eq!(index.get(&[4, 1]), None);
+    }
+
+    let mut stripped = proto;
+    stripped.as_mut().clear_source_code_info();
+    assert!(stripped.source_code_index().is_empty());
+    Ok(())
+}
+
+#[test]
+fn test_proto_workspace() -> Result<(), Box<dyn Error>> {
+    let dir = tempfile::tempdir()?;
+    fs::write(
+        dir.path().join("common.proto"),
+        "syntax = \"proto3\"; message Common {}",
+    )?;
+    fs::write(
+        dir.path().join("a.proto"),
+        "syntax = \"proto3\"; import \"common.proto\"; message A { Common c = 1; }",
+    )?;
+    fs::write(
+        dir.path().join("b.proto"),
+        "syntax = \"proto3\"; import \"a.proto\"; message B { A a = 1; }",
+    )?;
+    let mut source_tree = DiskSourceTree::new();
+    source_tree.as_mut().map_path(Path::new(""), dir.path());
+    let mut workspace = ProtoWorkspace::new(source_tree.as_mut());
+    let set = workspace.build_file_descriptor_set(&["b.proto"])?;
+    assert_eq!(set.file_size(), 3);
+
+    // Unchanged files are not parsed again, even if they change on disk.
+    fs::write(
+        dir.path().join("a.proto"),
+        "syntax = \"proto3\"; message A2 {}",
+    )?;
+    fs::write(
+        dir.path().join("common.proto"),
+        "syntax = \"proto3\"; message C2 {}",
+    )?;
+    let set = workspace.build_file_descriptor_set(&["b.proto"])?;
+    assert_eq!(set.file(1).message_type(0).name(), b"A");
+
+    // Changing a file affects the files that depend on it.
+    assert_eq!(
+        workspace.file_changed(Path::new("a.proto")),
+        &[PathBuf::from("a.proto"), PathBuf::from("b.proto")]
+    );
+    assert_eq!(
+        workspace.file_changed(Path::new("unknown.proto")),
+        Vec::<PathBuf>::new()
+    );
+    let set = workspace.build_file_descriptor_set(&["b.proto"])?;
+    // a.proto no longer imports common.proto.
+    assert_eq!(set.file_size(), 2);
+    assert_eq!(set.file(1).message_type(0).name(), b"A2");
+    assert_eq!(
+        workspace.file_changed(Path::new("common.proto")),
+        &[PathBuf::from("common.proto")]
+    );
+    Ok(())
+}
+
+#[test]
+fn test_compile_server() -> Result<(), Box<dyn Error>> {
+    let dir = tempfile::tempdir()?;
+    fs::create_dir(dir.path().join("protos"))?;
+    fs::write(
+        dir.path().join("protos/common.proto"),
+        "syntax = \"proto3\"; message Common {}",
+    )?;
+    fs::write(
+        dir.path().join("protos/a.proto"),
+        "syntax = \"proto3\"; import \"common.proto\"; message A { Common c = 1; }",
+    )?;
+    let mut server = CompileServer::new();
+    server.map_path(Path::new(""), &dir.path().join("protos"));
+    assert!(server.pool().is_none());
+    let set = server.compile(&["a.proto"])?;
+    assert_eq!(set.file_size(), 2);
+    let pool = server.pool().unwrap();
+    assert!(pool.find_file_by_name(Path::new("common.proto")).is_some());
+
+    // Changes on disk are noticed by the next compilation.
+    fs::write(
+        dir.path().join("protos/common.proto"),
+        "syntax = \"proto3\"; message Extra {} message Common {}",
+    )?;
+    let set = server.compile(&["a.proto"])?;
+    assert_eq!(set.file(1).message_type(0).name(), b"Extra");
+
+    // Semantic errors are reported by the descriptor pool.
+    fs::write(
+        dir.path().join("protos/common.proto"),
+        "syntax = \"proto3\"; message Renamed {}",
+    )?;
+    assert!(matches!(
+        server.compile(&["a.proto"]),
+        Err(CompileError::Build(_))
+    ));
+    match server.compile(&["missing.proto"]) {
+        Err(CompileError::Load(errors)) => assert_eq!(errors[0].filename, "missing.proto"),
+        _ => panic!("expected load error"),
+    }
+
+    // Names cannot reach files outside the mapped directories.
+    fs::write(
+        dir.path().join("secret.proto"),
+        "syntax = \"proto3\"; message Secret {}",
+    )?;
+    let absolute = dir.path().join("secret.proto");
+    for name in [
+        Path::new("../secret.proto"),
+        Path::new("./a.proto"),
+        absolute.as_path(),
+    ] {
+        match server.compile(&[name]) {
+            Err(CompileError::Load(errors)) => assert_eq!(errors.len(), 1),
+            _ => panic!("expected load error for {}", name.display()),
+        }
+    }
+
+    #[cfg(unix)]
+    {
+        use std::os::unix::net::{UnixListener, UnixStream};
+
+        let socket_path = dir.path().join("compile.sock");
+        let listener = UnixListener::bind(&socket_path)?;
+        let client = thread::spawn(move || {
+            let set = compiler::compile_remote(&socket_path, &["common.proto"]).unwrap();
+            let error = compiler::compile_remote(&socket_path, &["a.proto"])
+                .err()
+                .unwrap();
+            (
+                set.file(0).message_type(0).name().to_vec(),
+                error.to_string(),
+            )
+        });
+        for _ in 0..2 {
+            server.handle(listener.accept()?.0)?;
+        }
+        let (name, error) = client.join().unwrap();
+        assert_eq!(name, b"Renamed");
+        assert!(error.contains("a.proto"), "{}", error);
+
+        // A client that never finishes its request times out.
+        server.set_request_timeout(std::time::Duration::from_millis(50));
+        let _stalled = UnixStream::connect(dir.path().join("compile.sock"))?;
+        assert!(server.handle(listener.accept()?.0).is_err());
+    }
+    Ok(())
+}
+
+#[test]
+fn test_importer() -> Result<(), Box<dyn Error>> {
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("common.proto"),
+        b"syntax = \"proto3\"; message Common {}".to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("a.proto"),
+        b"syntax = \"proto3\"; import \"common.proto\"; message A { Common c = 1; }".to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("b.proto"),
+        b"syntax = \"proto3\"; import \"common.proto\"; message B { Common c = 1; }".to_vec(),
+    );
+    source_tree.as_mut().add_file(
+        Path::new("bad.proto"),
+        b"syntax = \"proto3\"; message".to_vec(),
+    );
+
+    let mut error_collector = SimpleErrorCollector::new();
+    let mut importer = Importer::new(source_tree.as_mut(), Some(error_collector.as_mut()));
+    let file = importer.as_mut().import(Path::new("a.proto"))?;
+    assert_eq!(file.name(), b"a.proto");
+    assert_eq!(file.message_type(0).name(), b"A");
+    let file = importer.as_mut().import(Path::new("b.proto"))?;
+    let mut proto = FileDescriptorProto::new();
+    file.copy_to(proto.as_mut());
+    assert_eq!(proto.dependency(0), b"common.proto");
+
+    // Both roots share the same pool, and so the same dependency.
+    let pool = importer.pool();
+    let common = pool.find_file_by_name(Path::new("common.proto"));
+    assert_eq!(
+        common.map(|f| f.message_type(0).name()),
+        Some(&b"Common"[..])
+    );
+    assert!(pool.find_message_type_by_name("A").is_some());
+    assert!(pool.find_message_type_by_name("B").is_some());
+
+    let res = importer.as_mut().import(Path::new("bad.proto"));
+    assert_eq!(util::unwrap_err(res), OperationFailedError);
+    drop(importer);
+    let errors: Vec<_> = error_collector.as_mut().collect();
+    assert!(!errors.is_empty());
+    assert!(errors.iter().all(|e| e.filename == "bad.proto"));
+    Ok(())
+}
+
+#[test]
+fn test_serialize_into() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+
+    let mut expected = vec![];
+    fds.serialize_to_writer(&mut expected)?;
+    assert_eq!(fds.serialize()?, expected);
+    assert_eq!(fds.byte_size(), expected.len());
+
+    let mut out = b"prefix".to_vec();
+    fds.serialize_into(&mut out)?;
+    assert_eq!(&out[..6], b"prefix");
+    assert_eq!(&out[6..], expected);
+    Ok(())
+}
+
+#[cfg(feature = "bytes")]
+#[test]
+fn test_bytes() -> Result<(), Box<dyn Error>> {
+    use bytes::{Buf, BytesMut};
+
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+
+    let mut out = BytesMut::from(&b"prefix"[..]);
+    fds.serialize_to_bytes_mut(&mut out)?;
+    assert_eq!(&out[..6], b"prefix");
+    assert_eq!(&out[6..], expected);
+
+    let (head, tail) = expected.split_at(expected.len() / 2);
+    let mut decoded = fds.new();
+    decoded.as_mut().merge_from_buf(&mut head.chain(tail))?;
+    assert_eq!(decoded.serialize()?, expected);
+    Ok(())
+}
+
+#[cfg(feature = "tokio-util")]
+#[test]
+fn test_delimited_codec() -> Result<(), Box<dyn Error>> {
+    use bytes::BytesMut;
+    use protobuf_native::codec::DelimitedCodec;
+    use tokio_util::codec::{Decoder, Encoder};
+
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+    let empty = fds.new();
+    let mut codec = DelimitedCodec::new(&*fds);
+
+    let mut encoded = BytesMut::new();
+    codec.encode(&*fds, &mut encoded)?;
+    codec.encode(&*empty, &mut encoded)?;
+    codec.encode(fds.new(), &mut encoded)?;
+    assert_eq!(encoded[0] as usize, expected.len());
+    assert_eq!(&encoded[1..=expected.len()], expected);
+
+    // Frames are only decoded once they have arrived in full.
+    let mut src = BytesMut::new();
+    let mut decoded = vec![];
+    for &b in encoded.iter() {
+        src.extend_from_slice(&[b]);
+        while let Some(message) = codec.decode(&mut src)? {
+            decoded.push(message.serialize()?);
+        }
+    }
+    assert!(src.is_empty());
+    assert_eq!(decoded, [expected, vec![], vec![]]);
+
+    let mut codec = DelimitedCodec::new(&*fds).with_max_frame_len(4);
+    assert!(codec.encode(&*fds, &mut BytesMut::new()).is_err());
+    let mut src = BytesMut::from(&encoded[..]);
+    assert!(codec.decode(&mut src).is_err());
+    let mut src = BytesMut::from(&b"\x02\x0a\x05"[..]);
+    assert!(codec.decode(&mut src).is_err());
+    Ok(())
+}
+
+#[test]
+fn test_record_file() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::record::{
+        RecordCompression, RecordReader, RecordWriter, RecordWriterOptions,
+    };
+
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+    let empty = fds.new();
+    let record = |i: u64| -> &dyn MessageLite {
+        if i % 3 == 0 {
+            &*empty
+        } else {
+            &*fds
+        }
+    };
+
+    for compression in [
+        RecordCompression::None,
+        #[cfg(feature = "zlib")]
+        RecordCompression::Zlib,
+    ] {
+        let options = RecordWriterOptions {
+            block_size: 2 * expected.len(),
+            compression,
+            ..Default::default()
+        };
+        let mut writer = RecordWriter::new(Vec::new(), options)?;
+        for i in 0..50u64 {
+            if i < 30 {
+                writer.append_with_key(record(i), format!("key{i:02}").as_bytes())?;
+            } else {
+                writer.append(record(i))?;
+            }
+        }
+        assert_eq!(writer.record_count(), 50);
+        let file = writer.finish()?;
+
+        let reader = RecordReader::new(&file)?;
+        assert_eq!(reader.compression(), compression);
+        assert_eq!(reader.record_count(), 50);
+        assert!(reader.blocks().len() > 1);
+        for (i, block) in reader.blocks().iter().enumerate() {
+            assert_eq!(reader.find_block(block.first_record), Some(i));
+            if block.records().end <= 30 {
+                let key = format!("key{:02}", block.first_record);
+                assert!(block.may_contain_key(key.as_bytes()));
+                assert!(!block.may_contain_key(b"key99"));
+            } else if block.records().start >= 30 {
+                assert!(block.key_range.is_none());
+            }
+        }
+        assert_eq!(reader.find_block(50), None);
+
+        // Blocks are independent, so partitions can be read concurrently.
+        let parts = reader.partition(3);
+        assert_eq!(parts.first().map(|r| r.start), Some(0));
+        assert_eq!(parts.last().map(|r| r.end), Some(reader.blocks().len()));
+        let counts = thread::scope(|s| {
+            let handles: Vec<_> = parts
+                .iter()
+                .map(|part| {
+                    let reader = &reader;
+                    let prototype: &dyn MessageLite = &*fds;
+                    let part = part.clone();
+                    s.spawn(move || -> Result<u64, OperationFailedError> {
+                        let mut count = 0;
+                        for block in part {
+                            reader.read_block(block, prototype, |i, message| {
+                                assert_eq!(message.byte_size(), record(i).byte_size());
+                                count += 1;
+                            })?;
+                        }
+                        Ok(count)
+                    })
+                })
+                .collect();
+            handles
+                .into_iter()
+                .map(|h| h.join().unwrap())
+                .collect::<Result<Vec<_>, _>>()
+        })?;
+        assert_eq!(counts.iter().sum::<u64>(), 50);
+
+        let mut message = fds.new();
+        for i in [0, 1, 29, 30, 49] {
+            reader.read_record(i, message.as_mut())?;
+            assert_eq!(message.serialize()?, record(i).serialize()?);
+        }
+        assert!(reader.read_record(50, message.as_mut()).is_err());
+
+        assert!(RecordReader::new(&file[..file.len() - 1]).is_err());
+        assert!(RecordReader::new(&file[1..]).is_err());
+        assert!(RecordReader::new(b"").is_err());
+    }
+    Ok(())
+}
+
+#[test]
+fn test_serialize_batch() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+    let empty = fds.new();
+    let messages: [&dyn MessageLite; 3] = [&*fds, &*empty, &*fds];
+
+    let out = protobuf_native::serialize_batch(&messages, false)?;
+    assert_eq!(out, [&expected[..], &expected[..]].concat());
+
+    let mut out = b"prefix".to_vec();
+    protobuf_native::serialize_batch_into(&messages, true, &mut out)?;
+    assert_eq!(&out[..6], b"prefix");
+    let mut input = SliceInputStream::new(&out[6..]);
+    let mut reader = DelimitedReader::new(input.as_mut(), fds.new());
+    for expected in [&expected[..], &[], &expected[..]] {
+        assert_eq!(reader.read_next()?.unwrap().serialize()?, expected);
+    }
+    assert!(reader.read_next()?.is_none());
+    Ok(())
+}
+
+#[test]
+fn test_parse_delimited_batch() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+    let empty = fds.new();
+    let data = protobuf_native::serialize_batch(&[&*fds, &*empty, &*fds], true)?;
+
+    let arena = Arena::new();
+    let messages = protobuf_native::parse_delimited_batch(&data, &*fds, &arena)?;
+    assert_eq!(messages.len(), 3);
+    assert_eq!(messages[0].serialize()?, expected);
+    assert_eq!(messages[1].byte_size(), 0);
+    assert_eq!(messages[2].serialize()?, expected);
+
+    assert!(protobuf_native::parse_delimited_batch(&[], &*fds, &arena)?.is_empty());
+    assert!(
+        protobuf_native::parse_delimited_batch(&data[..data.len() - 1], &*fds, &arena).is_err()
+    );
+    Ok(())
+}
+
+#[test]
+fn test_serialize_with_cached_sizes() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+    assert_eq!(fds.byte_size(), expected.len());
+    assert_eq!(fds.cached_size(), expected.len());
+
+    let mut out = b"prefix".to_vec();
+    unsafe { fds.serialize_with_cached_sizes_into(&mut out) };
+    assert_eq!(&out[..6], b"prefix");
+    assert_eq!(&out[6..], expected);
+
+    let mut out = vec![];
+    {
+        let mut stream = VecOutputStream::new(&mut out);
+        let mut output = CodedOutputStream::new(stream.as_mut());
+        output
+            .as_mut()
+            .write_varint32(u32::try_from(fds.byte_size())?);
+        fds.serialize_with_cached_sizes(output.as_mut());
+        assert!(!output.as_mut().had_error());
+    }
+    let mut input = CodedInputStream::from_slice(&out);
+    assert_eq!(
+        input.as_mut().read_varint32()?,
+        u32::try_from(expected.len())?
+    );
+    assert_eq!(&out[input.current_position()..], expected);
+    Ok(())
+}
+
+#[test]
+fn test_partial() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+
+    let mut out = vec![];
+    fds.serialize_partial_to_zero_copy_stream(VecOutputStream::new(&mut out).as_mut())?;
+    assert_eq!(out, expected);
+
+    let mut decoded = fds.new();
+    decoded.as_mut().merge_partial_from_bytes(&expected)?;
+    assert_eq!(decoded.serialize()?, expected);
+    assert!(decoded.as_mut().merge_partial_from_bytes(&[0xff]).is_err());
+
+    let mut input = SliceInputStream::new(&expected);
+    decoded
+        .as_mut()
+        .parse_partial_from_zero_copy_stream(input.as_mut())?;
+    assert_eq!(decoded.serialize()?, expected);
+
+    // Only the partial variants accept a message that is missing a required
+    // field.
+    let fds = build_file_descriptor_set(&[(
+        "partial.proto",
+        r#"
+syntax = "proto2";
+
+message Partial {
+    required int32 id = 1;
+    optional string name = 2;
+}
+"#,
+    )])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let descriptor = pool.find_message_type_by_name("Partial").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+    let prototype = factory.as_mut().get_prototype(descriptor);
+    let incomplete = b"\x12\x02hi";
+    let complete = b"\x08\x07\x12\x02hi";
+
+    let mut message = prototype.new_message();
+    assert!(message.as_mut().merge_from_bytes(incomplete).is_err());
+    message.as_mut().clear();
+    let mut input = CodedInputStream::from_slice(incomplete);
+    assert!(message
+        .as_mut()
+        .merge_from_coded_stream(input.as_mut())
+        .is_err());
+    message.as_mut().clear();
+    message.as_mut().merge_partial_from_bytes(incomplete)?;
+    assert!(!message.is_initialized());
+
+    let mut out = vec![];
+    assert!(message
+        .serialize_to_zero_copy_stream(VecOutputStream::new(&mut out).as_mut())
+        .is_err());
+    assert!(out.is_empty());
+    message.serialize_partial_to_zero_copy_stream(VecOutputStream::new(&mut out).as_mut())?;
+    assert_eq!(out, incomplete);
+
+    let mut input = SliceInputStream::new(complete);
+    message
+        .as_mut()
+        .parse_partial_from_zero_copy_stream(input.as_mut())?;
+    assert!(message.is_initialized());
+    out.clear();
+    message.serialize_to_zero_copy_stream(VecOutputStream::new(&mut out).as_mut())?;
+    assert_eq!(out, complete);
+    Ok(())
+}
+
+#[test]
+fn test_serialize_deterministic() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+    assert_eq!(fds.serialize_deterministic()?, expected);
+
+    let mut out = b"prefix".to_vec();
+    fds.serialize_deterministic_into(&mut out)?;
+    assert_eq!(&out[..6], b"prefix");
+    assert_eq!(&out[6..], expected);
+    Ok(())
+}
+
+#[test]
+fn test_serialize_to_uninit_slice() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let expected = fds.serialize()?;
+
+    let mut too_small = vec![MaybeUninit::uninit(); expected.len() - 1];
+    assert!(fds.serialize_to_uninit_slice(&mut too_small).is_err());
+
+    let mut out = vec![MaybeUninit::uninit(); expected.len() + 10];
+    assert_eq!(fds.serialize_to_uninit_slice(&mut out)?, &expected[..]);
+
+    // Encode a batch into one contiguous region using the cached sizes.
+    let messages = [&fds, &fds, &fds];
+    let sizes: Vec<_> = messages.iter().map(|m| m.byte_size()).collect();
+    let mut out = vec![MaybeUninit::uninit(); sizes.iter().sum()];
+    let mut remaining = &mut out[..];
+    for (message, size) in messages.iter().zip(sizes) {
+        let (head, tail) = remaining.split_at_mut(size);
+        let encoded = unsafe { message.serialize_with_cached_sizes_to_uninit_slice(head) };
+        assert_eq!(encoded, &expected[..]);
+        remaining = tail;
+    }
+    Ok(())
+}
+
+#[test]
+fn test_parse_from_bytes() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+
+    let mut decoded = fds.new();
+    decoded.as_mut().parse_from_bytes(&encoded)?;
+    assert_eq!(decoded.serialize()?, encoded);
+
+    decoded.as_mut().merge_from_bytes(&encoded)?;
+    assert_eq!(decoded.byte_size(), 2 * encoded.len());
+
+    decoded.as_mut().parse_partial_from_bytes(&encoded)?;
+    assert_eq!(decoded.serialize()?, encoded);
+
+    assert_eq!(
+        decoded.as_mut().parse_from_bytes(b"\xff"),
+        Err(OperationFailedError)
+    );
+    Ok(())
+}
+
+#[test]
+fn test_delimited() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+    let empty = fds.new();
+
+    let mut buffer = vec![];
+    {
+        let mut output = VecOutputStream::new(&mut buffer);
+        let mut writer = DelimitedWriter::new(output.as_mut());
+        writer.write(&*fds)?;
+        writer.write(&*empty)?;
+        writer.write(&*fds)?;
+    }
+    assert_eq!(buffer.len(), 2 * (encoded.len() + 1) + 1);
+
+    let mut input = SliceInputStream::new(&buffer);
+    let mut reader = DelimitedReader::new(input.as_mut(), fds.new());
+    assert_eq!(reader.read_next()?.unwrap().serialize()?, encoded);
+    assert_eq!(reader.read_next()?.unwrap().byte_size(), 0);
+    assert_eq!(reader.read_next()?.unwrap().serialize()?, encoded);
+    assert!(reader.read_next()?.is_none());
+
+    let mut input = SliceInputStream::new(&buffer[..buffer.len() - 1]);
+    let mut reader = DelimitedReader::new(input.as_mut(), fds.new());
+    reader.read_next()?;
+    reader.read_next()?;
+    assert_eq!(reader.read_next().err(), Some(OperationFailedError));
+
+    let mut decoded = fds.new();
+    let mut input = SliceInputStream::new(&buffer);
+    assert!(decoded
+        .as_mut()
+        .parse_delimited_from_zero_copy_stream(input.as_mut())?);
+    assert_eq!(decoded.serialize()?, encoded);
+
+    // A record that fails to parse does not leave its length limit behind.
+    let mut input = CodedInputStream::from_slice(b"\x02\xff\xff\x00");
+    assert!(decoded
+        .as_mut()
+        .parse_delimited_from_coded_stream(input.as_mut())
+        .is_err());
+    assert_eq!(input.bytes_until_limit(), None);
+    Ok(())
+}
+
+#[test]
+fn test_arena() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+
+    let arena = Arena::new();
+    let mut m1 = fds.new_in(&arena);
+    let mut m2 = fds.new_in(&arena);
+    m1.as_mut().parse_from_bytes(&encoded)?;
+    m2.as_mut().merge_from_bytes(&encoded)?;
+    assert_eq!(m1.serialize()?, encoded);
+    assert_eq!(m2.serialize()?, encoded);
+    Ok(())
+}
+
+#[test]
+fn test_arena_initial_block() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+
+    let mut block = vec![MaybeUninit::uninit(); 1 << 16];
+    let arena = Arena::with_options(ArenaOptions {
+        start_block_size: 1 << 10,
+        max_block_size: 1 << 20,
+        initial_block: Some(&mut block[..]),
+        ..Default::default()
+    });
+    let mut m = fds.new_in(&arena);
+    m.as_mut().parse_from_bytes(&encoded)?;
+    assert_eq!(m.serialize()?, encoded);
+    Ok(())
+}
+
+#[test]
+fn test_arena_reset() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+
+    let mut arena = Arena::new();
+    for _ in 0..3 {
+        for _ in 0..100 {
+            let mut m = fds.new_in(&arena);
+            m.as_mut().parse_from_bytes(&encoded)?;
+        }
+        assert!(arena.space_used() > 0);
+        assert!(arena.space_allocated() >= arena.space_used());
+        assert!(arena.as_mut().reset() > 0);
+    }
+    Ok(())
+}
+
+#[test]
+fn test_arena_pool() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+    assert!(numa::node_count() >= 1);
+
+    let pool = ArenaPool::with_options(ArenaPoolOptions {
+        max_retained: 1,
+        ..Default::default()
+    });
+    for _ in 0..3 {
+        let arena = pool.get();
+        for _ in 0..100 {
+            let mut m = fds.new_in(&arena);
+            m.as_mut().parse_from_bytes(&encoded)?;
+            assert_eq!(m.serialize()?, encoded);
+        }
+        assert!(arena.space_used() > 0);
+    }
+    assert_eq!(pool.idle_count(), 1);
+
+    // Arenas beyond the retained one are freed, and their blocks cached.
+    let (a, b) = (pool.get(), pool.get());
+    fds.new_in(&a).parse_from_bytes(&encoded)?;
+    fds.new_in(&b).parse_from_bytes(&encoded)?;
+    drop((a, b));
+    assert_eq!(pool.idle_count(), 1);
+    let cached: usize = (0..numa::node_count()).map(numa::cache_size).sum();
+    assert!(cached > 0);
+    Ok(())
+}
+
+#[test]
+fn test_arena_huge_pages() -> Result<(), Box<dyn Error>> {
+    let fds = simple_file_descriptor_set()?;
+    let encoded = fds.serialize()?;
+    assert!(numa::huge_page_size().is_power_of_two());
+    assert!(numa::huge_page_block_size() < numa::huge_page_size());
+
+    let mut options = ArenaOptions::default();
+    options.set_huge_page_block_allocator();
+    assert_eq!(options.start_block_size, numa::huge_page_block_size());
+    let arena = Arena::with_options(options);
+    for _ in 0..100 {
+        let mut m = fds.new_in(&arena);
+        m.as_mut().parse_from_bytes(&encoded)?;
+        assert_eq!(m.serialize()?, encoded);
+    }
+    drop(arena);
+    let cached: usize = (0..numa::node_count()).map(numa::cache_size).sum();
+    assert!(cached >= numa::huge_page_size());
+
+    let pool = ArenaPool::with_options(ArenaPoolOptions {
+        huge_pages: true,
+        ..Default::default()
+    });
+    let arena = pool.get();
+    fds.new_in(&arena).parse_from_bytes(&encoded)?;
+    assert!(arena.space_allocated() >= numa::huge_page_block_size() as u64);
+    Ok(())
+}
+
+#[test]
+fn test_arena_parallel_parse() -> Result<(), Box<dyn Error>> {
+    fn assert_send_sync<T: Send + Sync + ?Sized>() {}
+    assert_send_sync::<Arena>();
+    assert_send_sync::<ArenaMessage>();
+
+    let mut source_tree = VirtualSourceTree::new();
+    source_tree.as_mut().add_file(
+        Path::new("table.proto"),
+        br#"
+syntax = "proto3";
+
+message Table {
+    repeated Row rows = 1;
+}
+
+message Row {
+    int32 id = 1;
+}
+"#
+        .to_vec(),
+    );
+    let mut db = SourceTreeDescriptorDatabase::new(source_tree.as_mut());
+    let fds = db
+        .as_mut()
+        .build_file_descriptor_set(&[Path::new("table.proto")])?;
+    let mut pool = DescriptorPool::new();
+    pool.as_mut().build_file(fds.file(0));
+    let table_descriptor = pool.find_message_type_by_name("Table").unwrap();
+    let row_descriptor = pool.find_message_type_by_name("Row").unwrap();
+    let rows = table_descriptor.find_field_by_name("rows").unwrap();
+    let mut factory = DynamicMessageFactory::new();
+
+    // Parse rows on several threads into one arena, then add them to the
+    // table in order.
+    let arena = Arena::new();
+    let mut table = factory
+        .as_mut()
+        .get_prototype(table_descriptor)
+        .new_message_in(&arena);
+    let row_prototype = factory.as_mut().get_prototype(row_descriptor);
+    let parsed = thread::scope(|s| {
+        let workers: Vec<_> = (0..4u8)
+            .map(|w| {
+                let arena = &arena;
+                s.spawn(move || {
+                    (0..25u8)
+                        .map(|i| {
+                            let mut row = row_prototype.new_message_in(arena);
+                            row.as_mut().parse_from_bytes(&[0x08, w * 25 + i + 1])?;
+                            Ok(row)
+                        })
+                        .collect::<Result<Vec<_>, OperationFailedError>>()
+                })
+            })
+            .collect();
+        workers
+            .into_iter()
+            .map(|w| w.join().unwrap())
+            .collect::<Result<Vec<_>, _>>()
+    })?;
+    for row in parsed.into_iter().flatten() {
+        table.as_mut().add_allocated_message(rows, row)?;
+    }
+    let mut expected = vec![];
+    for id in 1..=100u8 {
+        expected.extend([0x0a, 0x02, 0x08, id]);
+    }
+    assert_eq!(table.serialize()?, expected);
+
+    // Elements of the wrong type, or on another arena, are rejected.
+    let other = table.new_message_in(&arena);
+    assert!(table.as_mut().add_allocated_message(rows, other).is_err());
+    let other_arena = Arena::new();
+    let row = row_prototype.new_message_in(&other_arena);
+    assert!(table.as_mut().add_allocated_message(rows, row).is_err());
+    Ok(())
+}
+
+#[cfg(feature = "serde_json")]
+#[test]
+fn test_struct_value() -> Result<(), Box<dyn Error>> {
+    use protobuf_native::struct_value::{Struct, Value};
+    use serde_json::json;
+
+    let config = json!({
+        "name": "db",
+        "replicas": 3,
+        "ratio": 0.5,
+        "enabled": true,
+        "owner": null,
+        "tags": ["a", 1, [false], {}],
+        "limits": {"cpu": -2, "memory": {"unit": "GiB", "amount": 1.25}},
+    });
+    let object = config.as_object().unwrap();
+    let s = Struct::from_json(object);
+    assert_eq!(&s.to_json(), object);
+    assert_eq!(serde_json::to_value(&*s)?, config);
+
+    // The conversion agrees with libprotobuf's JSON mapping.
+    let printed = json::message_to_json(&*s, &PrintOptions::default())?;
+    assert_eq!(serde_json::from_str::<serde_json::Value>(&printed)?, config);
+    let mut parsed = Struct::new();
+    json::json_to_message(
+        &config.to_string(),
+        parsed.as_mut(),
+        &ParseOptions::default(),
+    )?;
+    assert_eq!(
+        parsed.serialize_deterministic()?,
+        s.serialize_deterministic()?
+    );
+
+    // Setting a struct replaces its contents.
+    let mut s = s;
+    s.as_mut().set_json(json!({"x": "y"}).as_object().unwrap());
+    assert_eq!(serde_json::Value::Object(s.to_json()), json!({"x": "y"}));
+
+    for value in [json!(null), json!(7), json!("s"), json!([1, [2]]), config] {
+        let v = Value::from_json(&value);
+        assert_eq!(v.to_json(), value);
+        assert_eq!(serde_json::to_value(&*v)?, value);
+    }
+    // A value with no kind set converts to null.
+    assert_eq!(Value::new().to_json(), json!(null));
+    Ok(())
+}
@@ -0,0 +1,45 @@
+// Copyright Materialize, Inc. All rights reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License in the LICENSE file at the
+// root of this repository, or online at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Declarations needed to compile libprotobuf with PROTOBUF_ARENAZ_SAMPLE
+// defined. The open source release of protobuf omits them from
+// arenaz_sampler.h and arenaz_sampler.cc, since it does not otherwise build
+// with arena sampling. This header is included before every C++ source file,
+// so that the vendored sources can be built unmodified.
+
+#ifndef PROTOBUF_SRC_ARENAZ_H_
+#define PROTOBUF_SRC_ARENAZ_H_
+
+#ifdef __cplusplus
+
+#include "absl/base/internal/sysinfo.h"
+#include "absl/debugging/stacktrace.h"
+#include "absl/numeric/bits.h"
+#include "absl/profiling/internal/exponential_biased.h"
+#include "absl/profiling/internal/sample_recorder.h"
+
+namespace google {
+namespace protobuf {
+namespace internal {
+
+using absl::base_internal::GetCachedTID;
+
+}  // namespace internal
+}  // namespace protobuf
+}  // namespace google
+
+#endif  // __cplusplus
+
+#endif  // PROTOBUF_SRC_ARENAZ_H_
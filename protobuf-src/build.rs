@@ -13,22 +13,449 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+use std::collections::hash_map::DefaultHasher;
+use std::collections::{HashMap, HashSet};
+use std::env;
 use std::error::Error;
+use std::fs;
+use std::hash::{Hash, Hasher};
+use std::io;
+use std::path::{Path, PathBuf};
+use std::process::{self, Command};
 
 fn main() -> Result<(), Box<dyn Error>> {
-    let install_dir = cmake::Config::new("protobuf")
-        .define("ABSL_PROPAGATE_CXX_STD", "ON")
-        .define("protobuf_BUILD_TESTS", "OFF")
-        .define("protobuf_DEBUG_POSTFIX", "")
-        .define("CMAKE_CXX_STANDARD", "14")
-        // CMAKE_INSTALL_LIBDIR is inferred as "lib64" on some platforms, but we
-        // want a stable location that we can add to the linker search path.
-        // Since we're not actually installing to /usr or /usr/local, there's no
-        // harm to always using "lib" here.
-        .define("CMAKE_INSTALL_LIBDIR", "lib")
-        .build();
+    let mut config = cmake::Config::new("protobuf");
+    let mut manifest = Manifest::new();
+    // Arena sampling changes the layout of arenas, so every library compiled
+    // against these headers must agree on it. Dependents find the header that
+    // must be included alongside the define in `DEP_PROTOBUF_SRC_ARENAZ`.
+    if env::var_os("CARGO_FEATURE_ARENAZ").is_some() {
+        let prelude = PathBuf::from(env::var("CARGO_MANIFEST_DIR")?).join("arenaz.h");
+        config.cxxflag(format!(
+            "-DPROTOBUF_ARENAZ_SAMPLE -include {}",
+            prelude.display()
+        ));
+        println!("cargo:ARENAZ={}", prelude.display());
+        manifest.record("arenaz", "on");
+    }
+    // utf8_range, which validates UTF-8 in string fields, has an SSE4.1 code
+    // path that is compiled only if the compiler may assume SSE4.1. Enable it
+    // whenever the Rust target does, e.g. with `-C target-cpu=native`.
+    let target_features = env::var("CARGO_CFG_TARGET_FEATURE").unwrap_or_default();
+    let msvc = env::var("CARGO_CFG_TARGET_ENV").map_or(false, |env| env == "msvc");
+    if !msvc && target_features.split(',').any(|f| f == "sse4.1") {
+        config.cflag("-msse4.1");
+        manifest.record("sse4.1", "on");
+    }
+    // With the `lto` feature, compile the C++ runtime to LLVM bitcode for
+    // ThinLTO, so that a Rust binary linked with `-C linker-plugin-lto` can
+    // inline small C++ functions across the language boundary. Dependents
+    // that compile C++ of their own must do the same with the archiver in
+    // `DEP_PROTOBUF_SRC_LLVM_AR` when `DEP_PROTOBUF_SRC_LTO` is set. As the
+    // feature only works with a matching toolchain, which `--all-features`
+    // builds need not have, an unsuitable toolchain falls back to a regular
+    // build with a warning rather than failing.
+    if env::var_os("CARGO_FEATURE_LTO").is_some() {
+        match thin_lto_toolchain() {
+            Ok(toolchain) => {
+                config
+                    .cflag("-flto=thin")
+                    .cxxflag("-flto=thin")
+                    .define("CMAKE_AR", &toolchain.ar)
+                    .define("CMAKE_RANLIB", &toolchain.ranlib)
+                    // protoc itself is linked from bitcode too, which needs a
+                    // linker that understands it.
+                    .define("CMAKE_EXE_LINKER_FLAGS", "-fuse-ld=lld");
+                println!("cargo:LTO=thin");
+                println!("cargo:LLVM_AR={}", toolchain.ar.display());
+                manifest.record("lto", "thin");
+                manifest.record("llvm-ar", toolchain.ar.display());
+            }
+            Err(reason) => {
+                println!("cargo:warning=building without cross-language LTO: {reason}");
+            }
+        }
+    }
+    // libprotoc and protoc are needed only to generate code, not by the
+    // runtime libraries, so they are built only with the `protoc` feature.
+    let protoc = env::var_os("CARGO_FEATURE_PROTOC").is_some();
+    config.define(
+        "protobuf_BUILD_PROTOC_BINARIES",
+        if protoc { "ON" } else { "OFF" },
+    );
+    manifest.record("protoc", protoc);
+    // The gzip streams in libprotobuf are compiled only with zlib. Rather than
+    // depend on whether CMake happens to find zlib on the build machine, use
+    // it exactly when the `zlib` feature asks for it, and then require it
+    // (which CMake enforces from version 3.22).
+    let zlib = env::var_os("CARGO_FEATURE_ZLIB").is_some();
+    config.define("protobuf_WITH_ZLIB", if zlib { "ON" } else { "OFF" });
+    if zlib {
+        config.define("CMAKE_REQUIRE_FIND_PACKAGE_ZLIB", "ON");
+    }
+    manifest.record("zlib", zlib);
+    // With `PROTOBUF_SRC_CACHE_DIR` set, reuse an installation from an
+    // earlier build with the same configuration, as recorded in the manifest
+    // of each cached installation, rather than building anew.
+    println!("cargo:rerun-if-env-changed={CACHE_DIR_VAR}");
+    // Printing any rerun-if directive disables Cargo's default of rerunning
+    // on every change to the package, so name the sources explicitly.
+    for path in VENDORED_SOURCES {
+        println!("cargo:rerun-if-changed={path}");
+    }
+    println!("cargo:rerun-if-changed=build.rs");
+    let cache_dir = env::var_os(CACHE_DIR_VAR).map(PathBuf::from);
+    // The vendored sources carry local patches, and may be edited in place
+    // during development, so a cached installation is only reused if they
+    // hash the same. Hashing them is only worth doing if there is a cache.
+    if cache_dir.is_some() {
+        let mut hasher = DefaultHasher::new();
+        for path in VENDORED_SOURCES {
+            hash_tree(Path::new(path), &mut hasher)?;
+        }
+        manifest.record("sources", format!("{:016x}", hasher.finish()));
+    }
+    let cached = cache_dir
+        .as_deref()
+        .and_then(|dir| manifest.find_cached(dir));
+    let install_dir = match cached {
+        Some(install_dir) => {
+            // As set by the cmake crate for a fresh build.
+            println!("cargo:root={}", install_dir.display());
+            install_dir
+        }
+        None => {
+            let install_dir = config
+                .define("ABSL_PROPAGATE_CXX_STD", "ON")
+                .define("protobuf_BUILD_TESTS", "OFF")
+                .define("protobuf_DEBUG_POSTFIX", "")
+                // Build libupb, the runtime of the upb protobuf implementation, and
+                // install it and its headers alongside libprotobuf.
+                .define("protobuf_BUILD_LIBUPB", "ON")
+                .define("CMAKE_CXX_STANDARD", "14")
+                // CMAKE_INSTALL_LIBDIR is inferred as "lib64" on some platforms, but we
+                // want a stable location that we can add to the linker search path.
+                // Since we're not actually installing to /usr or /usr/local, there's no
+                // harm to always using "lib" here.
+                .define("CMAKE_INSTALL_LIBDIR", "lib")
+                .build();
+            if let Some(cache_dir) = &cache_dir {
+                if let Err(e) = manifest.store(cache_dir, &install_dir) {
+                    println!("cargo:warning=failed to cache the protobuf build: {e}");
+                }
+            }
+            install_dir
+        }
+    };
 
     println!("cargo:rustc-env=INSTALL_DIR={}", install_dir.display());
     println!("cargo:CXXBRIDGE_DIR0={}/include", install_dir.display());
+    // Dependents link libupb, which libprotobuf does not depend on, by the
+    // library name in `DEP_PROTOBUF_SRC_UPB` from `DEP_PROTOBUF_SRC_ROOT/lib`.
+    println!("cargo:UPB=upb");
+    // With the `protoc` feature, dependents that run code generators
+    // in-process link libprotoc by the library name in
+    // `DEP_PROTOBUF_SRC_PROTOC`, ahead of the libraries in
+    // `DEP_PROTOBUF_SRC_LIBS`, which it depends on.
+    if protoc {
+        println!("cargo:PROTOC=protoc");
+    }
+    // Dependents link exactly the static libraries that libprotobuf, or
+    // libprotobuf-lite for dependents that use only the lite runtime, needs,
+    // in link order, from the lists in `DEP_PROTOBUF_SRC_LIBS` and
+    // `DEP_PROTOBUF_SRC_LITE_LIBS`.
+    let lib_dir = install_dir.join("lib");
+    println!(
+        "cargo:LIBS={}",
+        static_libs(&lib_dir, "protobuf")?.join(",")
+    );
+    println!(
+        "cargo:LITE_LIBS={}",
+        static_libs(&lib_dir, "protobuf-lite")?.join(",")
+    );
     Ok(())
 }
+
+/// Returns the static libraries in `lib_dir` that the pkg-config module
+/// `module` and its transitive requirements link, ordered such that every
+/// library precedes those it depends on.
+///
+/// Both libprotobuf and Abseil install a pkg-config file for every library,
+/// so this is the minimal set of Abseil's many libraries to link. Libraries
+/// that are not installed in `lib_dir`, like system libraries, are omitted.
+fn static_libs(lib_dir: &Path, module: &str) -> Result<Vec<String>, Box<dyn Error>> {
+    fn visit<'a>(
+        modules: &'a HashMap<String, PkgConfig>,
+        module: &'a str,
+        visited: &mut HashSet<&'a str>,
+        order: &mut Vec<&'a str>,
+    ) -> Result<(), Box<dyn Error>> {
+        if visited.insert(module) {
+            let pc = modules
+                .get(module)
+                .ok_or_else(|| format!("missing pkg-config file for {module}"))?;
+            for requirement in &pc.requires {
+                visit(modules, requirement, visited, order)?;
+            }
+            order.push(module);
+        }
+        Ok(())
+    }
+
+    let mut modules = HashMap::new();
+    for entry in fs::read_dir(lib_dir.join("pkgconfig"))? {
+        let path = entry?.path();
+        if path.extension().map_or(false, |ext| ext == "pc") {
+            let name = path.file_stem().unwrap().to_string_lossy().into_owned();
+            modules.insert(name, PkgConfig::parse(&fs::read_to_string(&path)?));
+        }
+    }
+    let mut order = vec![];
+    visit(&modules, module, &mut HashSet::new(), &mut order)?;
+    // A postorder traversal places every module after its requirements, so
+    // the reverse places it before them.
+    let mut libs = vec![];
+    for module in order.into_iter().rev() {
+        for lib in &modules[module].libs {
+            let installed = ["lib{}.a", "{}.lib"]
+                .iter()
+                .any(|pattern| lib_dir.join(pattern.replace("{}", lib)).exists());
+            if installed && !libs.contains(lib) {
+                libs.push(lib.clone());
+            }
+        }
+    }
+    Ok(libs)
+}
+
+/// The parts of a pkg-config file that determine what to link.
+struct PkgConfig {
+    /// The names of the required modules.
+    requires: Vec<String>,
+    /// The names of the libraries passed as `-l` flags.
+    libs: Vec<String>,
+}
+
+impl PkgConfig {
+    fn parse(contents: &str) -> PkgConfig {
+        let mut pc = PkgConfig {
+            requires: vec![],
+            libs: vec![],
+        };
+        for line in contents.lines() {
+            if let Some(requires) = line.strip_prefix("Requires:") {
+                // Requirements are separated by commas or whitespace and may
+                // carry version constraints, as in `absl_base = 20240116`.
+                let mut words = requires
+                    .split(|c: char| c == ',' || c.is_whitespace())
+                    .filter(|word| !word.is_empty());
+                while let Some(word) = words.next() {
+                    if ["=", "<", ">", "<=", ">=", "!="].contains(&word) {
+                        words.next();
+                    } else {
+                        pc.requires.push(word.into());
+                    }
+                }
+            } else if let Some(libs) = line.strip_prefix("Libs:") {
+                pc.libs.extend(
+                    libs.split_whitespace()
+                        .filter_map(|flag| flag.strip_prefix("-l"))
+                        .map(String::from),
+                );
+            }
+        }
+        pc
+    }
+}
+
+/// The environment variable that names the directory of cached builds.
+const CACHE_DIR_VAR: &str = "PROTOBUF_SRC_CACHE_DIR";
+
+/// The files and directories, relative to the package, whose contents are
+/// compiled into the installation.
+const VENDORED_SOURCES: &[&str] = &["protobuf", "arenaz.h"];
+
+/// The environment variables, besides their target-specific variants, that
+/// the cmake and cc crates pass on to the build and that so affect its output.
+const BUILD_ENV_VARS: &[&str] = &[
+    "CC",
+    "CXX",
+    "CFLAGS",
+    "CXXFLAGS",
+    "AR",
+    "CMAKE_GENERATOR",
+    "CMAKE_TOOLCHAIN_FILE",
+];
+
+/// A description of everything that determines the output of the build.
+///
+/// A cached installation is stored in a directory named for a hash of its
+/// manifest, and the manifest itself is stored within, so that a lookup can
+/// verify that the installation was built with exactly this configuration.
+/// The vendored sources are captured by a hash of their contents, which
+/// `main` records when a cache is in use.
+struct Manifest(String);
+
+impl Manifest {
+    const FILE_NAME: &'static str = "protobuf-src-manifest.txt";
+
+    fn new() -> Manifest {
+        let mut manifest = Manifest(String::new());
+        manifest.record("version", env!("CARGO_PKG_VERSION"));
+        for var in ["TARGET", "HOST", "PROFILE", "OPT_LEVEL", "DEBUG"] {
+            manifest.record(var, env::var(var).unwrap_or_default());
+        }
+        let target = env::var("TARGET").unwrap_or_default();
+        for var in BUILD_ENV_VARS {
+            for var in [
+                var.to_string(),
+                format!("{var}_{target}"),
+                format!("{var}_{}", target.replace('-', "_")),
+            ] {
+                if let Some(value) = env::var_os(&var) {
+                    manifest.record(&var, value.to_string_lossy());
+                }
+            }
+        }
+        manifest
+    }
+
+    fn record(&mut self, key: &str, value: impl std::fmt::Display) {
+        self.0.push_str(&format!("{key}={value}\n"));
+    }
+
+    fn key(&self) -> String {
+        let mut hasher = DefaultHasher::new();
+        self.0.hash(&mut hasher);
+        format!("{:016x}", hasher.finish())
+    }
+
+    /// Returns the cached installation in `cache_dir` with this manifest, if
+    /// any.
+    fn find_cached(&self, cache_dir: &Path) -> Option<PathBuf> {
+        let install_dir = cache_dir.join(self.key());
+        let manifest = fs::read_to_string(install_dir.join(Self::FILE_NAME)).ok()?;
+        (manifest == self.0).then_some(install_dir)
+    }
+
+    /// Copies the installation in `install_dir` into `cache_dir`.
+    ///
+    /// The copy is made in a temporary directory that is renamed into place
+    /// once complete, manifest included, so concurrent builds never see a
+    /// partial installation. Of concurrent builds with the same manifest, the
+    /// first to finish wins.
+    fn store(&self, cache_dir: &Path, install_dir: &Path) -> io::Result<()> {
+        let key = self.key();
+        let tmp_dir = cache_dir.join(format!(".{key}.{}", process::id()));
+        fs::create_dir_all(&tmp_dir)?;
+        for entry in fs::read_dir(install_dir)? {
+            let entry = entry?;
+            // The CMake build tree is not part of the installation.
+            if entry.file_name() != "build" {
+                copy_all(&entry.path(), &tmp_dir.join(entry.file_name()))?;
+            }
+        }
+        fs::write(tmp_dir.join(Self::FILE_NAME), &self.0)?;
+        if fs::rename(&tmp_dir, cache_dir.join(&key)).is_err() {
+            fs::remove_dir_all(&tmp_dir)?;
+        }
+        Ok(())
+    }
+}
+
+/// Recursively hashes the paths and contents of the files under `path`, in
+/// a deterministic order.
+fn hash_tree(path: &Path, hasher: &mut DefaultHasher) -> io::Result<()> {
+    path.hash(hasher);
+    if path.is_dir() {
+        let mut entries = fs::read_dir(path)?
+            .map(|entry| entry.map(|entry| entry.path()))
+            .collect::<Result<Vec<_>, _>>()?;
+        entries.sort();
+        for entry in entries {
+            hash_tree(&entry, hasher)?;
+        }
+    } else {
+        fs::read(path)?.hash(hasher);
+    }
+    Ok(())
+}
+
+/// Recursively copies the file or directory `from` to `to`.
+fn copy_all(from: &Path, to: &Path) -> io::Result<()> {
+    if from.is_dir() {
+        fs::create_dir_all(to)?;
+        for entry in fs::read_dir(from)? {
+            let entry = entry?;
+            copy_all(&entry.path(), &to.join(entry.file_name()))?;
+        }
+    } else {
+        fs::copy(from, to)?;
+    }
+    Ok(())
+}
+
+/// The LLVM tools needed to archive bitcode objects.
+struct LtoToolchain {
+    ar: PathBuf,
+    ranlib: PathBuf,
+}
+
+/// Checks that the toolchain can produce C++ bitcode that rustc's linker
+/// plugin LTO can consume: Rust code must be compiled with
+/// `-C linker-plugin-lto`, the C and C++ compilers must be clang based on the
+/// same major version of LLVM as rustc, `llvm-ar` and `llvm-ranlib` must be
+/// available to index archives of bitcode objects, and lld must be available
+/// to link protoc.
+fn thin_lto_toolchain() -> Result<LtoToolchain, String> {
+    let rustflags = env::var("CARGO_ENCODED_RUSTFLAGS").unwrap_or_default();
+    if !rustflags.contains("linker-plugin-lto") {
+        return Err("RUSTFLAGS does not include `-C linker-plugin-lto`".into());
+    }
+    let compiler = cc::Build::new().cpp(true).get_compiler();
+    if !compiler.is_like_clang() {
+        return Err(format!(
+            "the C++ compiler {} is not clang; set CC and CXX to clang",
+            compiler.path().display()
+        ));
+    }
+    let clang_llvm = version_of(compiler.path(), "--version", "clang version ")?;
+    let rustc = env::var_os("RUSTC").unwrap_or_else(|| "rustc".into());
+    let rustc_llvm = version_of(Path::new(&rustc), "-vV", "LLVM version: ")?;
+    if clang_llvm != rustc_llvm {
+        return Err(format!(
+            "clang is based on LLVM {clang_llvm}, but rustc on LLVM {rustc_llvm}"
+        ));
+    }
+    let tool = |name: &str, var: &str| {
+        let path = env::var_os(var).map_or_else(|| PathBuf::from(name), PathBuf::from);
+        match Command::new(&path).arg("--version").output() {
+            Ok(output) if output.status.success() => Ok(path),
+            _ => Err(format!("{name} not found; set {var} to its path")),
+        }
+    };
+    let toolchain = LtoToolchain {
+        ar: tool("llvm-ar", "LLVM_AR")?,
+        ranlib: tool("llvm-ranlib", "LLVM_RANLIB")?,
+    };
+    match Command::new("ld.lld").arg("--version").output() {
+        Ok(output) if output.status.success() => Ok(toolchain),
+        _ => Err("ld.lld not found in PATH".into()),
+    }
+}
+
+/// Returns the major version that follows `prefix` in the output of running
+/// `program` with `arg`.
+fn version_of(program: &Path, arg: &str, prefix: &str) -> Result<u32, String> {
+    let output = Command::new(program)
+        .arg(arg)
+        .output()
+        .map_err(|e| format!("failed to run {}: {e}", program.display()))?;
+    let output = String::from_utf8_lossy(&output.stdout);
+    output
+        .split(prefix)
+        .nth(1)
+        .and_then(|version| version.split('.').next())
+        .and_then(|major| major.trim().parse().ok())
+        .ok_or_else(|| format!("cannot determine the LLVM version of {}", program.display()))
+}
@@ -1511,6 +1511,15 @@ class DescriptorPool::Tables {
   // allocation owned by the pool.
   const FeatureSet* InternFeatureSet(FeatureSet&& features);
 
+  // Returns the previously resolved features of a descriptor in `edition`
+  // whose parent resolved to `parent` and that sets `features` itself, or
+  // null if there are none.
+  const FeatureSet* FindMergedFeatureSet(Edition edition,
+                                         const FeatureSet* parent,
+                                         const std::string& features) const;
+  void AddMergedFeatureSet(Edition edition, const FeatureSet* parent,
+                           std::string features, const FeatureSet* merged);
+
   // -----------------------------------------------------------------
   // Allocating memory.
 
@@ -1562,6 +1571,15 @@ class DescriptorPool::Tables {
   absl::flat_hash_map<std::string, std::unique_ptr<FeatureSet>>
       feature_set_cache_;
 
+  // A cache of feature resolutions, which merge the features that a
+  // descriptor sets into the resolved features of its parent. Descriptors
+  // across the pool commonly set the same features within the same parent
+  // features, so each distinct resolution is computed once. Both sets of
+  // features are interned in `feature_set_cache_`, so they outlive it.
+  absl::flat_hash_map<std::tuple<Edition, const FeatureSet*, std::string>,
+                      const FeatureSet*>
+      merged_feature_set_cache_;
+
   struct CheckPoint {
     explicit CheckPoint(const Tables* tables)
         : flat_allocations_before_checkpoint(
@@ -1984,6 +2002,22 @@ const FeatureSet* DescriptorPool::Tables::InternFeatureSet(
   return result.get();
 }
 
+const FeatureSet* DescriptorPool::Tables::FindMergedFeatureSet(
+    Edition edition, const FeatureSet* parent,
+    const std::string& features) const {
+  auto it = merged_feature_set_cache_.find(
+      std::make_tuple(edition, parent, features));
+  return it == merged_feature_set_cache_.end() ? nullptr : it->second;
+}
+
+void DescriptorPool::Tables::AddMergedFeatureSet(Edition edition,
+                                                 const FeatureSet* parent,
+                                                 std::string features,
+                                                 const FeatureSet* merged) {
+  merged_feature_set_cache_.emplace(
+      std::make_tuple(edition, parent, std::move(features)), merged);
+}
+
 // -------------------------------------------------------------------
 
 template <typename Type>
@@ -5521,6 +5555,16 @@ void DescriptorBuilder::ResolveFeaturesImpl(
     return;
   }
 
+  // Reuse an identical resolution made for another descriptor in the pool.
+  // Only successful resolutions are cached, so that every descriptor with
+  // invalid features reports its own error.
+  std::string key = base_features.SerializeAsString();
+  if (const FeatureSet* cached =
+          tables_->FindMergedFeatureSet(edition, &parent_features, key)) {
+    descriptor->merged_features_ = cached;
+    return;
+  }
+
   // Calculate the merged features for this target.
   absl::StatusOr<FeatureSet> merged =
       feature_resolver_->MergeFeatures(parent_features, base_features);
@@ -5531,6 +5575,8 @@ void DescriptorBuilder::ResolveFeaturesImpl(
   }
 
   descriptor->merged_features_ = tables_->InternFeatureSet(*std::move(merged));
+  tables_->AddMergedFeatureSet(edition, &parent_features, std::move(key),
+                               descriptor->merged_features_);
 }
 
 template <class DescriptorT>
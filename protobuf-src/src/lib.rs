@@ -41,8 +41,35 @@
 //! C/C++ library against this copy of libprotobuf or generate Rust bindings and
 //! link Rust code against this copy of libprotobuf.
 //!
+//! The vendored copy of libupb, the runtime of the upb implementation of
+//! Protocol Buffers, is installed alongside libprotobuf as a static library
+//! whose name is given by `DEP_PROTOBUF_SRC_UPB`. Its headers, like
+//! `upb/wire/decode.h`, are installed in the same include directory.
+//!
+//! Building libprotobuf takes minutes. To reuse builds across clean checkouts
+//! or CI runs, set `PROTOBUF_SRC_CACHE_DIR` to a directory in which to cache
+//! them. Each installation is cached under a key derived from the crate
+//! version, target, profile, enabled features, and compiler environment
+//! variables, and is used in place of a fresh build only when all of these
+//! match. `DEP_PROTOBUF_SRC_ROOT` then points into the cache directory, so it
+//! must outlive the builds that use it.
+//!
+//! The static libraries to link libprotobuf, including only those of Abseil's
+//! libraries that it needs, are listed in link order in
+//! `DEP_PROTOBUF_SRC_LIBS`. Dependents that use only the lite runtime can
+//! instead link the smaller `DEP_PROTOBUF_SRC_LITE_LIBS`.
+//!
 //! If you simply need to invoke the vendored protoc binary, [`protoc`] returns
-//! the path to pass to [`std::process::Command`].
+//! the path to pass to [`std::process::Command`]. Dependents that only link
+//! against libprotobuf can disable the default `protoc` feature to skip
+//! building libprotoc and protoc.
+//!
+//! With the `protoc` feature, libprotoc, which contains protoc's command-line
+//! interface and code generators, is installed alongside libprotobuf as a
+//! static library whose name is given by `DEP_PROTOBUF_SRC_PROTOC`, so that
+//! build scripts can generate code in-process rather than spawning protoc.
+//! libprotoc must precede the libraries in `DEP_PROTOBUF_SRC_LIBS` on the
+//! link line.
 //!
 //! [Materialize]: https://materialize.com
 //! [Protocol Buffers]: https://developers.google.com/protocol-buffers
@@ -52,6 +79,9 @@
 use std::path::PathBuf;
 
 /// Returns the path to the vendored protoc binary.
+///
+/// Requires the `protoc` feature, which is enabled by default.
+#[cfg(feature = "protoc")]
 pub fn protoc() -> PathBuf {
     PathBuf::from(env!("INSTALL_DIR"))
         .join("bin")